@@ -29,6 +29,33 @@ typedef struct _LDRP_TLS_DATA
     IMAGE_TLS_DIRECTORY TlsDirectory;
 } LDRP_TLS_DATA, *PLDRP_TLS_DATA;
 
+/* Hash index of an export name table, built once import hints start to miss */
+typedef struct _LDRP_EXPORT_INDEX
+{
+    ULONG BucketMask;
+    PULONG Buckets;     /* Name index + 1 of the first name in the bucket, 0 if none */
+    PULONG Chain;       /* Name index + 1 of the next name in the same bucket */
+    PULONG Hashes;
+} LDRP_EXPORT_INDEX, *PLDRP_EXPORT_INDEX;
+
+/* What the loader keeps about a module besides the public entry */
+typedef struct _LDRP_DATA_TABLE_ENTRY
+{
+    LDR_DATA_TABLE_ENTRY Entry;
+    PLDRP_EXPORT_INDEX ExportIndex;
+} LDRP_DATA_TABLE_ENTRY, *PLDRP_DATA_TABLE_ENTRY;
+
+#define LdrpGetPrivateEntry(LdrEntry) \
+    CONTAINING_RECORD((LdrEntry), LDRP_DATA_TABLE_ENTRY, Entry)
+
+/* Time spent in a loader phase, nested calls count as part of the outer one */
+typedef struct _LDRP_TIMER
+{
+    LONGLONG Total;
+    ULONG Count;
+    ULONG Depth;
+} LDRP_TIMER, *PLDRP_TIMER;
+
 typedef
 NTSTATUS
 (NTAPI* PLDR_APP_COMPAT_DLL_REDIRECTION_CALLBACK_FUNCTION)(
@@ -45,6 +72,9 @@ extern BOOLEAN LdrpInLdrInit;
 extern PVOID LdrpHeap;
 extern LIST_ENTRY LdrpHashTable[LDR_HASH_TABLE_ENTRIES];
 extern BOOLEAN ShowSnaps;
+extern BOOLEAN LdrpShowTiming;
+extern LDRP_TIMER LdrpSnapTimer, LdrpRelocationTimer, LdrpInitRoutineTimer;
+extern ULONG LdrpExportIndexCount;
 extern UNICODE_STRING LdrpDefaultPath;
 extern HANDLE LdrpKnownDllObjectDirectory;
 extern ULONG LdrpNumberOfProcessors;
@@ -79,11 +109,38 @@ NTSTATUS NTAPI LdrpInitializeProcess(IN PCONTEXT Context, IN PVOID SystemArgumen
 VOID NTAPI LdrpInitFailure(NTSTATUS Status);
 VOID NTAPI LdrpValidateImageForMp(IN PLDR_DATA_TABLE_ENTRY LdrDataTableEntry);
 VOID NTAPI LdrpEnsureLoaderLockIsHeld(VOID);
+VOID NTAPI LdrpReportTiming(IN PCSTR When);
+
+FORCEINLINE
+LONGLONG
+LdrpStartTimer(IN PLDRP_TIMER Timer)
+{
+    LARGE_INTEGER Counter;
+
+    if (!LdrpShowTiming || Timer->Depth++) return 0;
+
+    NtQueryPerformanceCounter(&Counter, NULL);
+    return Counter.QuadPart;
+}
+
+FORCEINLINE
+VOID
+LdrpStopTimer(IN PLDRP_TIMER Timer,
+              IN LONGLONG Start)
+{
+    LARGE_INTEGER Counter;
+
+    if (!LdrpShowTiming || --Timer->Depth) return;
+
+    NtQueryPerformanceCounter(&Counter, NULL);
+    Timer->Total += Counter.QuadPart - Start;
+    Timer->Count++;
+}
 
 /* ldrpe.c */
 NTSTATUS
 NTAPI
-LdrpSnapThunk(IN PVOID ExportBase,
+LdrpSnapThunk(IN PLDR_DATA_TABLE_ENTRY ExportLdrEntry,
               IN PVOID ImportBase,
               IN PIMAGE_THUNK_DATA OriginalThunk,
               IN OUT PIMAGE_THUNK_DATA Thunk,
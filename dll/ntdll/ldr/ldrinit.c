@@ -79,6 +79,8 @@ RTL_CRITICAL_SECTION LdrpLoaderLock =
 RTL_CRITICAL_SECTION FastPebLock;
 
 BOOLEAN ShowSnaps;
+BOOLEAN LdrpShowTiming;
+LDRP_TIMER LdrpSnapTimer, LdrpRelocationTimer, LdrpInitRoutineTimer;
 
 ULONG LdrpFatalHardErrorCount;
 ULONG LdrpActiveUnloadCount;
@@ -649,6 +651,7 @@ LdrpRunInitializeRoutines(IN PCONTEXT Context OPTIONAL)
     ULONG BreakOnDllLoad;
     PTEB OldTldTeb;
     BOOLEAN DllStatus;
+    LONGLONG Start;
 
     DPRINT("LdrpRunInitializeRoutines() called for %wZ (%p/%p)\n",
         &LdrpImageEntry->BaseDllName,
@@ -824,6 +827,7 @@ LdrpRunInitializeRoutines(IN PCONTEXT Context OPTIONAL)
             RtlActivateActivationContextUnsafeFast(&ActCtx,
                                                    LdrEntry->EntryPointActivationContext);
 
+            Start = LdrpStartTimer(&LdrpInitRoutineTimer);
             _SEH2_TRY
             {
                 /* Check if it has TLS */
@@ -851,6 +855,7 @@ LdrpRunInitializeRoutines(IN PCONTEXT Context OPTIONAL)
                         _SEH2_GetExceptionCode(), &LdrEntry->BaseDllName);
             }
             _SEH2_END;
+            LdrpStopTimer(&LdrpInitRoutineTimer, Start);
 
             /* Deactivate the ActCtx */
             RtlDeactivateActivationContextUnsafeFast(&ActCtx);
@@ -1411,13 +1416,46 @@ LdrpFreeTls(VOID)
                 TlsVector);
 }
 
+static
+ULONG
+LdrpTimerToMicroseconds(IN PLDRP_TIMER Timer,
+                        IN PLARGE_INTEGER Frequency)
+{
+    if (!Frequency->QuadPart) return 0;
+    return (ULONG)(Timer->Total * 1000000 / Frequency->QuadPart);
+}
+
+VOID
+NTAPI
+LdrpReportTiming(IN PCSTR When)
+{
+    LARGE_INTEGER Counter, Frequency;
+
+    if (!LdrpShowTiming) return;
+
+    NtQueryPerformanceCounter(&Counter, &Frequency);
+
+    /* Phases can nest (a DllMain loading a DLL), so these overlap */
+    DPRINT1("LDR: %wZ timing %s: snap %lu us (%lu), relocation %lu us (%lu), "
+            "init routines %lu us (%lu), %lu export indexes\n",
+            &LdrpImageEntry->BaseDllName,
+            When,
+            LdrpTimerToMicroseconds(&LdrpSnapTimer, &Frequency),
+            LdrpSnapTimer.Count,
+            LdrpTimerToMicroseconds(&LdrpRelocationTimer, &Frequency),
+            LdrpRelocationTimer.Count,
+            LdrpTimerToMicroseconds(&LdrpInitRoutineTimer, &Frequency),
+            LdrpInitRoutineTimer.Count,
+            LdrpExportIndexCount);
+}
+
 NTSTATUS
 NTAPI
 LdrpInitializeExecutionOptions(PUNICODE_STRING ImagePathName, PPEB Peb, PHANDLE OptionsKey)
 {
     NTSTATUS Status;
     HANDLE KeyHandle;
-    ULONG ExecuteOptions, MinimumStackCommit = 0, GlobalFlag;
+    ULONG ExecuteOptions, MinimumStackCommit = 0, GlobalFlag, LoaderTiming;
 
     /* Return error if we were not provided a pointer where to save the options key handle */
     if (!OptionsKey) return STATUS_INVALID_HANDLE;
@@ -1503,6 +1541,17 @@ LdrpInitializeExecutionOptions(PUNICODE_STRING ImagePathName, PPEB Peb, PHANDLE
         else
             GlobalFlag = 0;
 
+        /* Check if we should report how long loading took */
+        Status = LdrQueryImageFileKeyOption(KeyHandle,
+                                            L"LoaderTiming",
+                                            REG_DWORD,
+                                            &LoaderTiming,
+                                            sizeof(LoaderTiming),
+                                            NULL);
+
+        if (NT_SUCCESS(Status) && LoaderTiming)
+            LdrpShowTiming = TRUE;
+
         /* Call AVRF if necessary */
         if (Peb->NtGlobalFlag & (FLG_APPLICATION_VERIFIER | FLG_HEAP_PAGE_ALLOCS))
         {
@@ -1788,6 +1837,7 @@ LdrpInitializeProcess(IN PCONTEXT Context,
     PWCHAR Current;
     ULONG ExecuteOptions = 0;
     PVOID ViewBase;
+    LONGLONG Start;
 
     /* Set a NULL SEH Filter */
     RtlSetUnhandledExceptionFilter(NULL);
@@ -2362,12 +2412,14 @@ LdrpInitializeProcess(IN PCONTEXT Context,
         if (!NT_SUCCESS(Status)) return Status;
 
         /* Do the relocation */
+        Start = LdrpStartTimer(&LdrpRelocationTimer);
         Status = LdrRelocateImageWithBias(ViewBase,
                                           0LL,
                                           NULL,
                                           STATUS_SUCCESS,
                                           STATUS_CONFLICTING_ADDRESSES,
                                           STATUS_INVALID_IMAGE_FORMAT);
+        LdrpStopTimer(&LdrpRelocationTimer, Start);
         if (!NT_SUCCESS(Status))
         {
             DPRINT1("LdrRelocateImageWithBias() failed\n");
@@ -2505,6 +2557,9 @@ LdrpInitializeProcess(IN PCONTEXT Context,
         return Status;
     }
 
+    /* Report how long the static imports took to load */
+    LdrpReportTiming("at startup");
+
     /* Notify Shim Engine */
     if (g_ShimsEnabled)
     {
@@ -17,6 +17,10 @@
 
 PLDR_MANIFEST_PROBER_ROUTINE LdrpManifestProberRoutine;
 ULONG LdrpNormalSnap;
+ULONG LdrpExportIndexCount;
+
+/* Below this, a binary search costs about as much as hashing the name */
+#define LDRP_EXPORT_INDEX_MIN_NAMES     64
 
 /* FUNCTIONS *****************************************************************/
 
@@ -161,7 +165,7 @@ LdrpSnapIAT(IN PLDR_DATA_TABLE_ENTRY ExportLdrEntry,
             /* Snap the thunk */
             _SEH2_TRY
             {
-                Status = LdrpSnapThunk(ExportLdrEntry->DllBase,
+                Status = LdrpSnapThunk(ExportLdrEntry,
                                        ImportLdrEntry->DllBase,
                                        OriginalThunk,
                                        FirstThunk,
@@ -217,7 +221,7 @@ LdrpSnapIAT(IN PLDR_DATA_TABLE_ENTRY ExportLdrEntry,
             /* Snap the Thunk */
             _SEH2_TRY
             {
-                Status = LdrpSnapThunk(ExportLdrEntry->DllBase,
+                Status = LdrpSnapThunk(ExportLdrEntry,
                                        ImportLdrEntry->DllBase,
                                        OriginalThunk,
                                        FirstThunk,
@@ -270,6 +274,7 @@ LdrpHandleOneNewFormatImportDescriptor(IN LPWSTR DllPath OPTIONAL,
     PIMAGE_BOUND_IMPORT_DESCRIPTOR BoundEntry;
     PPEB Peb = NtCurrentPeb();
     ULONG i, IatSize;
+    LONGLONG Start;
 
     /* Get the pointer to the bound entry */
     BoundEntry = *BoundEntryPtr;
@@ -456,10 +461,12 @@ LdrpHandleOneNewFormatImportDescriptor(IN LPWSTR DllPath OPTIONAL,
         }
 
         /* Snap the IAT Entry*/
+        Start = LdrpStartTimer(&LdrpSnapTimer);
         Status = LdrpSnapIAT(DllLdrEntry,
                              LdrEntry,
                              ImportEntry,
                              FALSE);
+        LdrpStopTimer(&LdrpSnapTimer, Start);
 
         /* Make sure we didn't fail */
         if (!NT_SUCCESS(Status))
@@ -523,6 +530,7 @@ LdrpHandleOneOldFormatImportDescriptor(IN LPWSTR DllPath OPTIONAL,
     PLDR_DATA_TABLE_ENTRY DllLdrEntry;
     PIMAGE_THUNK_DATA FirstThunk;
     PPEB Peb = NtCurrentPeb();
+    LONGLONG Start;
 
     /* Get the import name's VA */
     ImportName = (LPSTR)((ULONG_PTR)LdrEntry->DllBase + (*ImportEntry)->Name);
@@ -580,7 +588,9 @@ LdrpHandleOneOldFormatImportDescriptor(IN LPWSTR DllPath OPTIONAL,
     }
 
     /* Now snap the IAT Entry */
+    Start = LdrpStartTimer(&LdrpSnapTimer);
     Status = LdrpSnapIAT(DllLdrEntry, LdrEntry, *ImportEntry, FALSE);
+    LdrpStopTimer(&LdrpSnapTimer, Start);
     if (!NT_SUCCESS(Status))
     {
         /* Fail */
@@ -623,15 +633,113 @@ LdrpHandleOldFormatImportDescriptors(IN LPWSTR DllPath OPTIONAL,
     return STATUS_SUCCESS;
 }
 
+static
+ULONG
+LdrpHashExportName(IN PCSTR Name)
+{
+    ULONG Hash = 2166136261U;
+
+    /* FNV-1a, export names are short and mostly distinct */
+    while (*Name)
+    {
+        Hash ^= (UCHAR)*Name++;
+        Hash *= 16777619U;
+    }
+
+    return Hash;
+}
+
+static
+PLDRP_EXPORT_INDEX
+LdrpBuildExportIndex(IN PLDR_DATA_TABLE_ENTRY ExportLdrEntry,
+                     IN ULONG NumberOfNames,
+                     IN PULONG NameTable)
+{
+    PLDRP_EXPORT_INDEX ExportIndex;
+    ULONG Buckets, i, Bucket;
+    SIZE_T Size;
+
+    /* Use a power of two number of buckets, at least one per name */
+    for (Buckets = 1; Buckets < NumberOfNames; Buckets <<= 1);
+
+    /* Allocate the index and its tables in one block */
+    Size = sizeof(LDRP_EXPORT_INDEX) +
+           (Buckets + 2 * NumberOfNames) * sizeof(ULONG);
+    ExportIndex = RtlAllocateHeap(LdrpHeap, HEAP_ZERO_MEMORY, Size);
+    if (!ExportIndex) return NULL;
+
+    ExportIndex->BucketMask = Buckets - 1;
+    ExportIndex->Buckets = (PULONG)(ExportIndex + 1);
+    ExportIndex->Chain = ExportIndex->Buckets + Buckets;
+    ExportIndex->Hashes = ExportIndex->Chain + NumberOfNames;
+
+    /* Insert backwards so each chain stays in name table order */
+    for (i = NumberOfNames; i-- > 0;)
+    {
+        ExportIndex->Hashes[i] =
+            LdrpHashExportName((PCSTR)((ULONG_PTR)ExportLdrEntry->DllBase + NameTable[i]));
+        Bucket = ExportIndex->Hashes[i] & ExportIndex->BucketMask;
+        ExportIndex->Chain[i] = ExportIndex->Buckets[Bucket];
+        ExportIndex->Buckets[Bucket] = i + 1;
+    }
+
+    LdrpExportIndexCount++;
+
+    if (ShowSnaps)
+    {
+        DPRINT1("LDR: Indexed %lu exports of %wZ\n",
+                NumberOfNames,
+                &ExportLdrEntry->BaseDllName);
+    }
+
+    return ExportIndex;
+}
+
 USHORT
 NTAPI
 LdrpNameToOrdinal(IN LPSTR ImportName,
                   IN ULONG NumberOfNames,
-                  IN PVOID ExportBase,
+                  IN PLDR_DATA_TABLE_ENTRY ExportLdrEntry,
                   IN PULONG NameTable,
                   IN PUSHORT OrdinalTable)
 {
+    PLDRP_DATA_TABLE_ENTRY PrivateEntry = LdrpGetPrivateEntry(ExportLdrEntry);
+    PLDRP_EXPORT_INDEX ExportIndex;
+    PVOID ExportBase = ExportLdrEntry->DllBase;
     LONG Start, End, Next, CmpResult;
+    ULONG Hash, Index;
+
+    /*
+     * Large export tables get a hash index the first time a hint misses.
+     * Callers hold the loader lock, so building it here is safe.
+     */
+    ExportIndex = PrivateEntry->ExportIndex;
+    if (!ExportIndex &&
+        (NumberOfNames >= LDRP_EXPORT_INDEX_MIN_NAMES) &&
+        (NumberOfNames <= MAXUSHORT + 1))
+    {
+        ExportIndex = LdrpBuildExportIndex(ExportLdrEntry, NumberOfNames, NameTable);
+        PrivateEntry->ExportIndex = ExportIndex;
+    }
+
+    if (ExportIndex)
+    {
+        /* Walk the bucket, only comparing names whose hash matches */
+        Hash = LdrpHashExportName(ImportName);
+        for (Index = ExportIndex->Buckets[Hash & ExportIndex->BucketMask];
+             Index;
+             Index = ExportIndex->Chain[Index - 1])
+        {
+            if ((ExportIndex->Hashes[Index - 1] == Hash) &&
+                !strcmp(ImportName, (PCHAR)((ULONG_PTR)ExportBase + NameTable[Index - 1])))
+            {
+                return OrdinalTable[Index - 1];
+            }
+        }
+
+        /* Not exported */
+        return -1;
+    }
 
     /* Use classical binary search to find the ordinal */
     Start = Next = 0;
@@ -947,7 +1055,7 @@ done:
 
 NTSTATUS
 NTAPI
-LdrpSnapThunk(IN PVOID ExportBase,
+LdrpSnapThunk(IN PLDR_DATA_TABLE_ENTRY ExportLdrEntry,
               IN PVOID ImportBase,
               IN PIMAGE_THUNK_DATA OriginalThunk,
               IN OUT PIMAGE_THUNK_DATA Thunk,
@@ -956,6 +1064,7 @@ LdrpSnapThunk(IN PVOID ExportBase,
               IN BOOLEAN Static,
               IN LPSTR DllName)
 {
+    PVOID ExportBase = ExportLdrEntry->DllBase;
     BOOLEAN IsOrdinal;
     USHORT Ordinal;
     ULONG OriginalOrdinal = 0;
@@ -1015,7 +1124,7 @@ LdrpSnapThunk(IN PVOID ExportBase,
             /* Well bummer, hint didn't work, do it the long way */
             Ordinal = LdrpNameToOrdinal(ImportName,
                                         ExportDirectory->NumberOfNames,
-                                        ExportBase,
+                                        ExportLdrEntry,
                                         NameTable,
                                         OrdinalTable);
         }
@@ -1051,6 +1051,7 @@ LdrpMapDll(IN PWSTR SearchPath OPTIONAL,
     UNICODE_STRING IllegalDll;
     PVOID RelocData;
     ULONG RelocDataSize = 0;
+    LONGLONG Start;
 
     // FIXME: AppCompat stuff is missing
 
@@ -1442,8 +1443,10 @@ SkipCheck:
             if (NT_SUCCESS(Status))
             {
                 /* Do the relocation */
+                Start = LdrpStartTimer(&LdrpRelocationTimer);
                 Status = LdrRelocateImageWithBias(ViewBase, 0LL, NULL, STATUS_SUCCESS,
                     STATUS_CONFLICTING_ADDRESSES, STATUS_INVALID_IMAGE_FORMAT);
+                LdrpStopTimer(&LdrpRelocationTimer, Start);
 
                 if (NT_SUCCESS(Status))
                 {
@@ -1554,10 +1557,10 @@ LdrpAllocateDataTableEntry(IN PVOID BaseAddress)
 
     if (NtHeader)
     {
-        /* Allocate an entry */
+        /* Allocate an entry, with room for what only the loader sees */
         LdrEntry = RtlAllocateHeap(LdrpHeap,
                                    HEAP_ZERO_MEMORY,
-                                   sizeof(LDR_DATA_TABLE_ENTRY));
+                                   sizeof(LDRP_DATA_TABLE_ENTRY));
 
         /* Make sure we got one */
         if (LdrEntry)
@@ -1594,6 +1597,8 @@ VOID
 NTAPI
 LdrpFinalizeAndDeallocateDataTableEntry(IN PLDR_DATA_TABLE_ENTRY Entry)
 {
+    PLDRP_DATA_TABLE_ENTRY PrivateEntry;
+
     /* Sanity check */
     ASSERT(Entry != NULL);
 
@@ -1609,6 +1614,10 @@ LdrpFinalizeAndDeallocateDataTableEntry(IN PLDR_DATA_TABLE_ENTRY Entry)
     /* Release the full dll name string */
     if (Entry->FullDllName.Buffer) LdrpFreeUnicodeString(&Entry->FullDllName);
 
+    /* Release the export index if one was built */
+    PrivateEntry = LdrpGetPrivateEntry(Entry);
+    if (PrivateEntry->ExportIndex) RtlFreeHeap(LdrpHeap, 0, PrivateEntry->ExportIndex);
+
     /* Finally free the entry's memory */
     RtlFreeHeap(LdrpHeap, 0, Entry);
 }
@@ -2355,7 +2364,7 @@ LdrpGetProcedureAddress(IN PVOID BaseAddress,
         }
 
         /* Now get the thunk */
-        Status = LdrpSnapThunk(LdrEntry->DllBase,
+        Status = LdrpSnapThunk(LdrEntry,
                                ImageBase,
                                &Thunk,
                                &Thunk,
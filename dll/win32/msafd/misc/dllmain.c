@@ -1821,6 +1821,158 @@ WSPAccept(
     return AcceptSocket;
 }
 
+BOOL
+WSPAPI
+WSPAcceptEx(
+    IN SOCKET sListenSocket,
+    IN SOCKET sAcceptSocket,
+    OUT PVOID lpOutputBuffer,
+    IN DWORD dwReceiveDataLength,
+    IN DWORD dwLocalAddressLength,
+    IN DWORD dwRemoteAddressLength,
+    OUT LPDWORD lpdwBytesReceived,
+    IN OUT LPOVERLAPPED lpOverlapped)
+{
+    PIO_STATUS_BLOCK            IOSB;
+    IO_STATUS_BLOCK             DummyIOSB;
+    AFD_SUPER_ACCEPT_INFO       AcceptInfo;
+    AFD_WSABUF                  Buffer;
+    PSOCKET_INFORMATION         Socket;
+    PSOCKET_INFORMATION         AcceptSocketInfo;
+    NTSTATUS                    Status;
+    HANDLE                      Event;
+    HANDLE                      SockEvent = NULL;
+
+    TRACE("Called (%x, %x)\n", sListenSocket, sAcceptSocket);
+
+    /* Get the Socket Structures associated to these Sockets */
+    Socket = GetSocketStructure(sListenSocket);
+    AcceptSocketInfo = GetSocketStructure(sAcceptSocket);
+    if (!Socket || !AcceptSocketInfo)
+    {
+        SetLastError(WSAENOTSOCK);
+        return FALSE;
+    }
+    if (!Socket->SharedData->Listening)
+    {
+        SetLastError(WSAEINVAL);
+        return FALSE;
+    }
+    if (!lpOutputBuffer || (!lpOverlapped && !lpdwBytesReceived))
+    {
+        SetLastError(WSAEFAULT);
+        return FALSE;
+    }
+
+    /* The received data comes first, AFD puts the addresses behind it */
+    Buffer.buf = lpOutputBuffer;
+    Buffer.len = dwReceiveDataLength + dwLocalAddressLength + dwRemoteAddressLength;
+
+    AcceptInfo.BufferArray = &Buffer;
+    AcceptInfo.BufferCount = 1;
+    AcceptInfo.AfdFlags = 0;
+    AcceptInfo.TdiFlags = TDI_RECEIVE_NORMAL;
+    AcceptInfo.AcceptHandle = (HANDLE)sAcceptSocket;
+    AcceptInfo.ReceiveDataLength = dwReceiveDataLength;
+    AcceptInfo.LocalAddressLength = dwLocalAddressLength;
+    AcceptInfo.RemoteAddressLength = dwRemoteAddressLength;
+
+    if (lpOverlapped == NULL)
+    {
+        Status = NtCreateEvent(&SockEvent, EVENT_ALL_ACCESS,
+                               NULL, SynchronizationEvent, FALSE);
+        if (!NT_SUCCESS(Status))
+        {
+            SetLastError(TranslateNtStatusError(Status));
+            return FALSE;
+        }
+
+        Event = SockEvent;
+        IOSB = &DummyIOSB;
+    }
+    else
+    {
+        Event = lpOverlapped->hEvent;
+        IOSB = (PIO_STATUS_BLOCK)&lpOverlapped->Internal;
+        AcceptInfo.AfdFlags |= AFD_OVERLAPPED;
+    }
+
+    IOSB->Status = STATUS_PENDING;
+
+    /* Send IOCTL */
+    Status = NtDeviceIoControlFile((HANDLE)Socket->Handle,
+                                   Event,
+                                   NULL,
+                                   lpOverlapped,
+                                   IOSB,
+                                   IOCTL_AFD_SUPER_ACCEPT,
+                                   &AcceptInfo,
+                                   sizeof(AcceptInfo),
+                                   NULL,
+                                   0);
+
+    /* Wait for completion of not overlapped */
+    if (Status == STATUS_PENDING && lpOverlapped == NULL)
+    {
+        WaitForSingleObject(SockEvent, INFINITE);
+        Status = IOSB->Status;
+    }
+
+    if (SockEvent)
+        NtClose(SockEvent);
+
+    if (Status == STATUS_PENDING)
+    {
+        TRACE("Leaving (Pending)\n");
+        SetLastError(WSA_IO_PENDING);
+        return FALSE;
+    }
+
+    /* Re-enable Async Event */
+    SockReenableAsyncSelectEvent(Socket, FD_ACCEPT);
+
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(TranslateNtStatusError(Status));
+        return FALSE;
+    }
+
+    /* Done right away, otherwise SO_UPDATE_ACCEPT_CONTEXT does this */
+    AcceptSocketInfo->SharedData->State = SocketConnected;
+    AcceptSocketInfo->SharedData->ConnectTime = GetCurrentTimeInSeconds();
+
+    if (lpdwBytesReceived)
+        *lpdwBytesReceived = (DWORD)IOSB->Information;
+
+    return TRUE;
+}
+
+VOID
+WSPAPI
+WSPGetAcceptExSockaddrs(
+    IN PVOID lpOutputBuffer,
+    IN DWORD dwReceiveDataLength,
+    IN DWORD dwLocalAddressLength,
+    IN DWORD dwRemoteAddressLength,
+    OUT struct sockaddr **LocalSockaddr,
+    OUT LPINT LocalSockaddrLength,
+    OUT struct sockaddr **RemoteSockaddr,
+    OUT LPINT RemoteSockaddrLength)
+{
+    PCHAR Buffer = (PCHAR)lpOutputBuffer + dwReceiveDataLength;
+
+    UNREFERENCED_PARAMETER(dwRemoteAddressLength);
+
+    /* Each address follows its length, see WSPAcceptEx */
+    *LocalSockaddrLength = *(PINT)Buffer;
+    *LocalSockaddr = (struct sockaddr *)(Buffer + sizeof(INT));
+
+    Buffer += dwLocalAddressLength;
+
+    *RemoteSockaddrLength = *(PINT)Buffer;
+    *RemoteSockaddr = (struct sockaddr *)(Buffer + sizeof(INT));
+}
+
 int
 WSPAPI
 WSPConnect(SOCKET Handle,
@@ -2486,6 +2638,7 @@ WSPIoctl(IN  SOCKET Handle,
                 GUID ConnectExGUID = WSAID_CONNECTEX;
                 GUID DisconnectExGUID = WSAID_DISCONNECTEX;
                 GUID GetAcceptExSockaddrsGUID = WSAID_GETACCEPTEXSOCKADDRS;
+                GUID TransmitFileGUID = WSAID_TRANSMITFILE;
 
                 if (IsEqualGUID(&AcceptExGUID, lpvInBuffer))
                 {
@@ -2515,6 +2668,13 @@ WSPIoctl(IN  SOCKET Handle,
                     Errno = NO_ERROR;
                     Ret = NO_ERROR;
                 }
+                else if (IsEqualGUID(&TransmitFileGUID, lpvInBuffer))
+                {
+                    *((PVOID *)lpvOutBuffer) = WSPTransmitFile;
+                    cbRet = sizeof(PVOID);
+                    Errno = NO_ERROR;
+                    Ret = NO_ERROR;
+                }
                 else
                 {
                     ERR("Querying unknown extension function: %x\n", ((GUID*)lpvInBuffer)->Data1);
@@ -2890,10 +3050,8 @@ WSPSetSockOpt(
                   return SOCKET_ERROR;
               }
 
-              /* FIXME: We should not have to limit the packet receive buffer size like this. workaround for CORE-15804 */
-              if (*(PULONG)optval > 0x2000)
-                  *(PULONG)optval = 0x2000;
-
+              /* AFD limits its own receive buffer, see CORE-15804, but
+               * passes the full size on to the transport's window */
               SetSocketInformation(Socket,
                                    AFD_INFO_RECEIVE_WINDOW_SIZE,
                                    NULL,
@@ -2947,6 +3105,18 @@ WSPSetSockOpt(
                             sizeof(DWORD));
               return NO_ERROR;
 
+           case SO_UPDATE_ACCEPT_CONTEXT:
+              if (optlen < sizeof(SOCKET))
+              {
+                  if (lpErrno) *lpErrno = WSAEFAULT;
+                  return SOCKET_ERROR;
+              }
+
+              /* An overlapped WSPAcceptEx completed on this socket */
+              Socket->SharedData->State = SocketConnected;
+              Socket->SharedData->ConnectTime = GetCurrentTimeInSeconds();
+              return NO_ERROR;
+
            case SO_KEEPALIVE:
            case SO_DONTROUTE:
               /* These go directly to the helper dll */
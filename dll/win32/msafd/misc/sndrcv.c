@@ -714,6 +714,141 @@ WSPSend(SOCKET Handle,
     return MsafdReturnWithErrno( Status, lpErrno, IOSB->Information, lpNumberOfBytesSent );
 }
 
+BOOL
+WSPAPI
+WSPTransmitFile(
+    IN SOCKET hSocket,
+    IN HANDLE hFile,
+    IN DWORD nNumberOfBytesToWrite,
+    IN DWORD nNumberOfBytesPerSend,
+    IN OUT LPOVERLAPPED lpOverlapped,
+    IN LPTRANSMIT_FILE_BUFFERS lpTransmitBuffers,
+    IN DWORD dwFlags)
+{
+    PIO_STATUS_BLOCK            IOSB;
+    IO_STATUS_BLOCK             DummyIOSB;
+    AFD_TRANSMIT_FILE_INFO      TransmitInfo;
+    FILE_POSITION_INFORMATION   FilePosition;
+    NTSTATUS                    Status;
+    HANDLE                      Event;
+    HANDLE                      SockEvent = NULL;
+    PSOCKET_INFORMATION         Socket;
+
+    TRACE("Called (%x, %p, %lu)\n", hSocket, hFile, nNumberOfBytesToWrite);
+
+    /* Get the Socket Structure associate to this Socket*/
+    Socket = GetSocketStructure(hSocket);
+    if (!Socket)
+    {
+        SetLastError(WSAENOTSOCK);
+        return FALSE;
+    }
+
+    /* Set up the Transmit Structure */
+    RtlZeroMemory(&TransmitInfo, sizeof(TransmitInfo));
+    TransmitInfo.FileHandle = hFile;
+    TransmitInfo.WriteLength.QuadPart = nNumberOfBytesToWrite;
+    TransmitInfo.SendPacketLength = nNumberOfBytesPerSend;
+
+    if (dwFlags & TF_DISCONNECT)
+        TransmitInfo.Flags |= AFD_TF_DISCONNECT;
+    if (dwFlags & TF_REUSE_SOCKET)
+        TransmitInfo.Flags |= AFD_TF_REUSE_SOCKET;
+
+    if (lpTransmitBuffers)
+    {
+        TransmitInfo.Buffers[0].buf = lpTransmitBuffers->Head;
+        TransmitInfo.Buffers[0].len = lpTransmitBuffers->HeadLength;
+        TransmitInfo.Buffers[1].buf = lpTransmitBuffers->Tail;
+        TransmitInfo.Buffers[1].len = lpTransmitBuffers->TailLength;
+    }
+
+    /* The file is sent from the overlapped offset, or from where it is now */
+    if (hFile && lpOverlapped)
+    {
+        TransmitInfo.Offset.LowPart = lpOverlapped->Offset;
+        TransmitInfo.Offset.HighPart = lpOverlapped->OffsetHigh;
+    }
+    else if (hFile)
+    {
+        Status = NtQueryInformationFile(hFile,
+                                        &DummyIOSB,
+                                        &FilePosition,
+                                        sizeof(FilePosition),
+                                        FilePositionInformation);
+        if (!NT_SUCCESS(Status))
+        {
+            SetLastError(TranslateNtStatusError(Status));
+            return FALSE;
+        }
+
+        TransmitInfo.Offset = FilePosition.CurrentByteOffset;
+    }
+
+    if (lpOverlapped == NULL)
+    {
+        Status = NtCreateEvent(&SockEvent, EVENT_ALL_ACCESS,
+                               NULL, SynchronizationEvent, FALSE);
+        if (!NT_SUCCESS(Status))
+        {
+            SetLastError(TranslateNtStatusError(Status));
+            return FALSE;
+        }
+
+        Event = SockEvent;
+        IOSB = &DummyIOSB;
+    }
+    else
+    {
+        Event = lpOverlapped->hEvent;
+        IOSB = (PIO_STATUS_BLOCK)&lpOverlapped->Internal;
+    }
+
+    IOSB->Status = STATUS_PENDING;
+
+    /* Send IOCTL */
+    Status = NtDeviceIoControlFile((HANDLE)hSocket,
+                                   Event,
+                                   NULL,
+                                   lpOverlapped,
+                                   IOSB,
+                                   IOCTL_AFD_TRANSMIT_FILE,
+                                   &TransmitInfo,
+                                   sizeof(TransmitInfo),
+                                   NULL,
+                                   0);
+
+    /* Wait for completion of not overlapped */
+    if (Status == STATUS_PENDING && lpOverlapped == NULL)
+    {
+        WaitForSingleObject(SockEvent, INFINITE);
+        Status = IOSB->Status;
+    }
+
+    if (SockEvent)
+        NtClose(SockEvent);
+
+    if (Status == STATUS_PENDING)
+    {
+        TRACE("Leaving (Pending)\n");
+        SetLastError(WSA_IO_PENDING);
+        return FALSE;
+    }
+
+    /* Re-enable Async Event */
+    SockReenableAsyncSelectEvent(Socket, FD_WRITE);
+
+    TRACE("Leaving (%x, %d)\n", Status, IOSB->Information);
+
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(TranslateNtStatusError(Status));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 int
 WSPAPI
 WSPSendTo(SOCKET Handle,
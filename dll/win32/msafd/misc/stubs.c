@@ -53,23 +53,6 @@ WSPJoinLeaf(
     return (SOCKET)0;
 }
 
-BOOL
-WSPAPI
-WSPAcceptEx(
-    IN SOCKET sListenSocket,
-    IN SOCKET sAcceptSocket,
-    OUT PVOID lpOutputBuffer,
-    IN DWORD dwReceiveDataLength,
-    IN DWORD dwLocalAddressLength,
-    IN DWORD dwRemoteAddressLength,
-    OUT LPDWORD lpdwBytesReceived,
-    IN OUT LPOVERLAPPED lpOverlapped)
-{
-    UNIMPLEMENTED;
-
-    return FALSE;
-}
-
 BOOL
 WSPAPI
 WSPConnectEx(
@@ -99,19 +82,4 @@ WSPDisconnectEx(
     return FALSE;
 }
 
-VOID
-WSPAPI
-WSPGetAcceptExSockaddrs(
-    IN PVOID lpOutputBuffer,
-    IN DWORD dwReceiveDataLength,
-    IN DWORD dwLocalAddressLength,
-    IN DWORD dwRemoteAddressLength,
-    OUT struct sockaddr **LocalSockaddr,
-    OUT LPINT LocalSockaddrLength,
-    OUT struct sockaddr **RemoteSockaddr,
-    OUT LPINT RemoteSockaddrLength)
-{
-    UNIMPLEMENTED;
-}
-
 /* EOF */
@@ -457,6 +457,17 @@ WSPDisconnectEx(
     IN DWORD dwFlags,
     IN DWORD reserved);
 
+BOOL
+WSPAPI
+WSPTransmitFile(
+    IN SOCKET hSocket,
+    IN HANDLE hFile,
+    IN DWORD nNumberOfBytesToWrite,
+    IN DWORD nNumberOfBytesPerSend,
+    IN OUT LPOVERLAPPED lpOverlapped,
+    IN LPTRANSMIT_FILE_BUFFERS lpTransmitBuffers,
+    IN DWORD dwFlags);
+
 VOID
 WSPAPI
 WSPGetAcceptExSockaddrs(
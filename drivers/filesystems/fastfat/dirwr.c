@@ -1033,6 +1033,7 @@ FATDelEntry(
             WriteCluster(DeviceExt, CurrentCluster, 0);
             CurrentCluster = NextCluster;
         }
+        FsRtlTruncateLargeMcb(&pFcb->Mcb, 0);
 
         if (DeviceExt->FatInfo.FatType == FAT32)
         {
@@ -1112,6 +1113,7 @@ FATXDelEntry(
             WriteCluster(DeviceExt, CurrentCluster, 0);
             CurrentCluster = NextCluster;
         }
+        FsRtlTruncateLargeMcb(&pFcb->Mcb, 0);
     }
 
     return STATUS_SUCCESS;
@@ -451,17 +451,68 @@ VfatMdlRead(
     OUT PIO_STATUS_BLOCK IoStatus,
     IN PDEVICE_OBJECT DeviceObject)
 {
+    PVFATFCB FCB;
+    BOOLEAN Success = FALSE;
+
     DPRINT("VfatMdlRead\n");
 
-    UNREFERENCED_PARAMETER(FileObject);
-    UNREFERENCED_PARAMETER(FileOffset);
-    UNREFERENCED_PARAMETER(Length);
     UNREFERENCED_PARAMETER(LockKey);
-    UNREFERENCED_PARAMETER(MdlChain);
-    UNREFERENCED_PARAMETER(IoStatus);
     UNREFERENCED_PARAMETER(DeviceObject);
 
-    return FALSE;
+    FCB = (PVFATFCB)FileObject->FsContext;
+    if (FCB == NULL ||
+        FileObject->PrivateCacheMap == NULL ||
+        vfatFCBIsDirectory(FCB) ||
+        BooleanFlagOn(FCB->Flags, FCB_IS_PAGE_FILE | FCB_IS_VOLUME))
+    {
+        return FALSE;
+    }
+
+    FsRtlEnterFileSystem();
+
+    if (!ExAcquireResourceSharedLite(&FCB->MainResource, TRUE))
+    {
+        FsRtlExitFileSystem();
+        return FALSE;
+    }
+
+    /* Let the IRP path check byte range locks */
+    if (FsRtlAreThereCurrentFileLocks(&FCB->FileLock))
+    {
+        goto Cleanup;
+    }
+
+    if (FileOffset->QuadPart >= FCB->RFCB.FileSize.QuadPart)
+    {
+        IoStatus->Status = STATUS_END_OF_FILE;
+        IoStatus->Information = 0;
+        Success = TRUE;
+        goto Cleanup;
+    }
+
+    if (FileOffset->QuadPart + Length > FCB->RFCB.FileSize.QuadPart)
+    {
+        Length = (ULONG)(FCB->RFCB.FileSize.QuadPart - FileOffset->QuadPart);
+    }
+
+    _SEH2_TRY
+    {
+        CcMdlRead(FileObject, FileOffset, Length, MdlChain, IoStatus);
+        Success = TRUE;
+    }
+    _SEH2_EXCEPT(FsRtlIsNtstatusExpected(_SEH2_GetExceptionCode()) ?
+                 EXCEPTION_EXECUTE_HANDLER :
+                 EXCEPTION_CONTINUE_SEARCH)
+    {
+        Success = FALSE;
+    }
+    _SEH2_END;
+
+Cleanup:
+    ExReleaseResourceLite(&FCB->MainResource);
+    FsRtlExitFileSystem();
+
+    return Success;
 }
 
 static FAST_IO_MDL_READ_COMPLETE VfatMdlReadComplete;
@@ -476,11 +527,8 @@ VfatMdlReadComplete(
 {
     DPRINT("VfatMdlReadComplete\n");
 
-    UNREFERENCED_PARAMETER(FileObject);
-    UNREFERENCED_PARAMETER(MdlChain);
-    UNREFERENCED_PARAMETER(DeviceObject);
-
-    return FALSE;
+    /* The pages came from the cache manager */
+    return FsRtlMdlReadCompleteDev(FileObject, MdlChain, DeviceObject);
 }
 
 static FAST_IO_PREPARE_MDL_WRITE VfatPrepareMdlWrite;
@@ -377,7 +377,8 @@ FAT32FindAndMarkAvailableCluster(
 static
 NTSTATUS
 FAT12CountAvailableClusters(
-    PDEVICE_EXTENSION DeviceExt)
+    PDEVICE_EXTENSION DeviceExt,
+    PRTL_BITMAP Bitmap)
 {
     ULONG Entry;
     PVOID BaseAddress;
@@ -415,6 +416,8 @@ FAT12CountAvailableClusters(
 
         if (Entry == 0)
             ulCount++;
+        else if (Bitmap)
+            RtlSetBit(Bitmap, i);
     }
 
     CcUnpinData(Context);
@@ -431,7 +434,8 @@ FAT12CountAvailableClusters(
 static
 NTSTATUS
 FAT16CountAvailableClusters(
-    PDEVICE_EXTENSION DeviceExt)
+    PDEVICE_EXTENSION DeviceExt,
+    PRTL_BITMAP Bitmap)
 {
     PUSHORT Block;
     PUSHORT BlockEnd;
@@ -466,6 +470,8 @@ FAT16CountAvailableClusters(
         {
             if (*Block == 0)
                 ulCount++;
+            else if (Bitmap)
+                RtlSetBit(Bitmap, i);
             Block++;
             i++;
         }
@@ -486,7 +492,8 @@ FAT16CountAvailableClusters(
 static
 NTSTATUS
 FAT32CountAvailableClusters(
-    PDEVICE_EXTENSION DeviceExt)
+    PDEVICE_EXTENSION DeviceExt,
+    PRTL_BITMAP Bitmap)
 {
     PULONG Block;
     PULONG BlockEnd;
@@ -522,6 +529,8 @@ FAT32CountAvailableClusters(
         {
             if ((*Block & 0x0fffffff) == 0)
                 ulCount++;
+            else if (Bitmap)
+                RtlSetBit(Bitmap, i);
             Block++;
             i++;
         }
@@ -541,15 +550,29 @@ CountAvailableClusters(
     PLARGE_INTEGER Clusters)
 {
     NTSTATUS Status = STATUS_SUCCESS;
+    PRTL_BITMAP Bitmap = NULL;
+
     ExAcquireResourceExclusiveLite (&DeviceExt->FatResource, TRUE);
     if (!DeviceExt->AvailableClustersValid)
     {
+        /* Fill the cluster bitmap in the same pass */
+        if (DeviceExt->ClusterBitmap.Buffer)
+        {
+            Bitmap = &DeviceExt->ClusterBitmap;
+            RtlClearAllBits(Bitmap);
+            RtlSetBits(Bitmap, 0, 2);
+        }
+
         if (DeviceExt->FatInfo.FatType == FAT12)
-            Status = FAT12CountAvailableClusters(DeviceExt);
+            Status = FAT12CountAvailableClusters(DeviceExt, Bitmap);
         else if (DeviceExt->FatInfo.FatType == FAT16 || DeviceExt->FatInfo.FatType == FATX16)
-            Status = FAT16CountAvailableClusters(DeviceExt);
+            Status = FAT16CountAvailableClusters(DeviceExt, Bitmap);
         else
-            Status = FAT32CountAvailableClusters(DeviceExt);
+            Status = FAT32CountAvailableClusters(DeviceExt, Bitmap);
+
+        /* Don't allocate from a half built bitmap */
+        if (!NT_SUCCESS(Status) && Bitmap)
+            UninitializeClusterBitmap(DeviceExt);
     }
     if (Clusters != NULL)
     {
@@ -710,6 +733,12 @@ WriteCluster(
 
     ExAcquireResourceExclusiveLite (&DeviceExt->FatResource, TRUE);
     Status = DeviceExt->WriteCluster(DeviceExt, ClusterToWrite, NewValue, &OldValue);
+    if (!NT_SUCCESS(Status))
+    {
+        ExReleaseResourceLite(&DeviceExt->FatResource);
+        return Status;
+    }
+
     if (DeviceExt->AvailableClustersValid)
     {
         if (OldValue && NewValue == 0)
@@ -717,6 +746,186 @@ WriteCluster(
         else if (OldValue == 0 && NewValue)
             InterlockedDecrement((PLONG)&DeviceExt->AvailableClusters);
     }
+    if (DeviceExt->ClusterBitmap.Buffer)
+    {
+        if (NewValue == 0)
+            RtlClearBit(&DeviceExt->ClusterBitmap, ClusterToWrite);
+        else
+            RtlSetBit(&DeviceExt->ClusterBitmap, ClusterToWrite);
+    }
+    ExReleaseResourceLite(&DeviceExt->FatResource);
+    return Status;
+}
+
+/*
+ * FUNCTION: Allocates the in-memory map of the clusters in use. It gets
+ *           filled when the free clusters are counted at mount time. It's
+ *           only touched under FatResource, so it can be paged
+ */
+NTSTATUS
+InitializeClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    ULONG Clusters;
+    PULONG Buffer;
+
+    Clusters = DeviceExt->FatInfo.NumberOfClusters + 2;
+    Buffer = ExAllocatePoolWithTag(PagedPool,
+                                   ROUND_UP(Clusters, 32) / 8,
+                                   TAG_BITMAP);
+    if (Buffer == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlInitializeBitMap(&DeviceExt->ClusterBitmap, Buffer, Clusters);
+    return STATUS_SUCCESS;
+}
+
+VOID
+UninitializeClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    if (DeviceExt->ClusterBitmap.Buffer)
+    {
+        ExFreePoolWithTag(DeviceExt->ClusterBitmap.Buffer, TAG_BITMAP);
+        RtlInitializeBitMap(&DeviceExt->ClusterBitmap, NULL, 0);
+    }
+}
+
+/*
+ * FUNCTION: Finds a free cluster and marks it as end of chain. Uses the
+ *           cluster bitmap when there is one and scans the FAT otherwise
+ */
+static
+NTSTATUS
+FindAndMarkAvailableCluster(
+    PDEVICE_EXTENSION DeviceExt,
+    PULONG Cluster)
+{
+    ULONG NewCluster;
+    NTSTATUS Status;
+
+    if (!DeviceExt->ClusterBitmap.Buffer)
+    {
+        return DeviceExt->FindAndMarkAvailableCluster(DeviceExt, Cluster);
+    }
+
+    NewCluster = RtlFindClearBits(&DeviceExt->ClusterBitmap, 1, DeviceExt->LastAvailableCluster);
+    if (NewCluster == MAXULONG)
+    {
+        return STATUS_DISK_FULL;
+    }
+
+    Status = WriteCluster(DeviceExt, NewCluster, 0xffffffff);
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    DPRINT("Found available cluster 0x%x\n", NewCluster);
+    DeviceExt->LastAvailableCluster = *Cluster = NewCluster;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * FUNCTION: Appends ClusterCount clusters to the chain ending at LastCluster,
+ *           or starts a new chain if LastCluster is 0. The clusters are taken
+ *           as one run if there is a free run long enough, else from the
+ *           longest free runs. On failure, the clusters allocated so far stay
+ *           chained so the caller can free them
+ */
+NTSTATUS
+ExtendClusterChain(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG LastCluster,
+    ULONG ClusterCount,
+    PULONG FirstNewCluster)
+{
+    PRTL_BITMAP Bitmap = &DeviceExt->ClusterBitmap;
+    ULONG Start, Length, Hint, i;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    DPRINT("ExtendClusterChain(DeviceExt %p, LastCluster %x, ClusterCount %u)\n",
+           DeviceExt, LastCluster, ClusterCount);
+
+    *FirstNewCluster = 0;
+
+    ExAcquireResourceExclusiveLite(&DeviceExt->FatResource, TRUE);
+
+    /* Fail early rather than allocating and freeing again */
+    if (DeviceExt->AvailableClustersValid && DeviceExt->AvailableClusters < ClusterCount)
+    {
+        ExReleaseResourceLite(&DeviceExt->FatResource);
+        return STATUS_DISK_FULL;
+    }
+
+    /* Keep the file contiguous if the clusters after it are free */
+    Hint = LastCluster != 0 ? LastCluster + 1 : DeviceExt->LastAvailableCluster;
+
+    while (ClusterCount > 0)
+    {
+        if (Bitmap->Buffer)
+        {
+            Length = ClusterCount;
+            Start = RtlFindClearBits(Bitmap, ClusterCount, Hint);
+            if (Start == MAXULONG)
+            {
+                Length = min(RtlFindLongestRunClear(Bitmap, &Start), ClusterCount);
+                if (Length == 0)
+                {
+                    Status = STATUS_DISK_FULL;
+                    break;
+                }
+            }
+
+            /* Chain the run, WriteCluster marks it in the bitmap */
+            for (i = 0; i < Length; i++)
+            {
+                Status = WriteCluster(DeviceExt,
+                                      Start + i,
+                                      i + 1 < Length ? Start + i + 1 : 0xffffffff);
+                if (!NT_SUCCESS(Status))
+                    break;
+            }
+
+            if (!NT_SUCCESS(Status))
+            {
+                /* Give back the part of the run we didn't chain yet */
+                while (i-- > 0)
+                    WriteCluster(DeviceExt, Start + i, 0);
+                break;
+            }
+        }
+        else
+        {
+            Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &Start);
+            if (!NT_SUCCESS(Status))
+                break;
+            Length = 1;
+        }
+
+        /* Link the run to the chain */
+        if (LastCluster != 0)
+        {
+            Status = WriteCluster(DeviceExt, LastCluster, Start);
+            if (!NT_SUCCESS(Status))
+            {
+                for (i = 0; i < Length; i++)
+                    WriteCluster(DeviceExt, Start + i, 0);
+                break;
+            }
+        }
+
+        if (*FirstNewCluster == 0)
+            *FirstNewCluster = Start;
+
+        LastCluster = Start + Length - 1;
+        ClusterCount -= Length;
+        Hint = LastCluster + 1;
+        DeviceExt->LastAvailableCluster = Hint;
+    }
+
     ExReleaseResourceLite(&DeviceExt->FatResource);
     return Status;
 }
@@ -786,7 +995,7 @@ GetNextClusterExtend(
      */
     if (CurrentCluster == 0)
     {
-        Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
+        Status = FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
         if (!NT_SUCCESS(Status))
         {
             ExReleaseResourceLite(&DeviceExt->FatResource);
@@ -805,7 +1014,7 @@ GetNextClusterExtend(
         /* We are after last existing cluster, we must add one to file */
         /* Firstly, find the next available open allocation unit and
            mark it as end of file */
-        Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
+        Status = FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
         if (!NT_SUCCESS(Status))
         {
             ExReleaseResourceLite(&DeviceExt->FatResource);
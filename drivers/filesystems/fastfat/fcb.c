@@ -151,7 +151,7 @@ vfatNewFCB(
     ExInitializeResourceLite(&rcFCB->PagingIoResource);
     ExInitializeResourceLite(&rcFCB->MainResource);
     FsRtlInitializeFileLock(&rcFCB->FileLock, NULL, NULL);
-    ExInitializeFastMutex(&rcFCB->LastMutex);
+    FsRtlInitializeLargeMcb(&rcFCB->Mcb, NonPagedPool);
     rcFCB->RFCB.PagingIoResource = &rcFCB->PagingIoResource;
     rcFCB->RFCB.Resource = &rcFCB->MainResource;
     rcFCB->RFCB.IsFastIoPossible = FastIoIsNotPossible;
@@ -277,6 +277,7 @@ vfatDestroyFCB(
 #endif
 
     FsRtlUninitializeFileLock(&pFCB->FileLock);
+    FsRtlUninitializeLargeMcb(&pFCB->Mcb);
 
     if (!vfatFCBIsRoot(pFCB) &&
         !BooleanFlagOn(pFCB->Flags, FCB_IS_FAT) && !BooleanFlagOn(pFCB->Flags, FCB_IS_VOLUME))
@@ -1244,24 +1244,18 @@ VfatSetAllocationSizeInformation(
         AllocSizeChanged = TRUE;
         if (FirstCluster == 0)
         {
-            Fcb->LastCluster = Fcb->LastOffset = 0;
-            Status = NextCluster(DeviceExt, FirstCluster, &FirstCluster, TRUE);
+            /* Allocate the whole chain at once, as contiguous as we can */
+            Status = ExtendClusterChain(DeviceExt, 0,
+                                        (NewSize - 1) / ClusterSize + 1,
+                                        &FirstCluster);
             if (!NT_SUCCESS(Status))
             {
-                DPRINT1("NextCluster failed. Status = %x\n", Status);
-                return Status;
-            }
-
-            if (FirstCluster == 0xffffffff)
-            {
-                return STATUS_DISK_FULL;
-            }
+                DPRINT1("ExtendClusterChain failed. Status = %x\n", Status);
+                if (FirstCluster == 0)
+                {
+                    return Status;
+                }
 
-            Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                     ROUND_DOWN(NewSize - 1, ClusterSize),
-                                     &NCluster, TRUE);
-            if (NCluster == 0xffffffff || !NT_SUCCESS(Status))
-            {
                 /* disk is full */
                 NCluster = Cluster = FirstCluster;
                 Status = STATUS_SUCCESS;
@@ -1294,43 +1288,26 @@ VfatSetAllocationSizeInformation(
         }
         else
         {
-            if (Fcb->LastCluster > 0)
-            {
-                if (Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize == Fcb->LastOffset)
-                {
-                    Cluster = Fcb->LastCluster;
-                    Status = STATUS_SUCCESS;
-                }
-                else
-                {
-                    Status = OffsetToCluster(DeviceExt, Fcb->LastCluster,
-                                             Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize - Fcb->LastOffset,
-                                             &Cluster, FALSE);
-                }
-            }
-            else
-            {
-                Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                         Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize,
-                                         &Cluster, FALSE);
-            }
-
+            Status = OffsetToClusterRun(DeviceExt, Fcb,
+                                        Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize,
+                                        &Cluster, &NCluster);
             if (!NT_SUCCESS(Status))
             {
                 return Status;
             }
+            if (Cluster == 0xffffffff)
+            {
+                return STATUS_FILE_CORRUPT_ERROR;
+            }
 
-            Fcb->LastCluster = Cluster;
-            Fcb->LastOffset = Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize;
-
-            /* FIXME: Check status */
             /* Cluster points now to the last cluster within the chain */
-            Status = OffsetToCluster(DeviceExt, Cluster,
-                                     ROUND_DOWN(NewSize - 1, ClusterSize) - Fcb->LastOffset,
-                                     &NCluster, TRUE);
-            if (NCluster == 0xffffffff || !NT_SUCCESS(Status))
+            Status = ExtendClusterChain(DeviceExt, Cluster,
+                                        (ROUND_DOWN(NewSize - 1, ClusterSize) - Fcb->RFCB.AllocationSize.u.LowPart) / ClusterSize + 1,
+                                        &NCluster);
+            if (!NT_SUCCESS(Status))
             {
                 /* disk is full */
+                ExAcquireResourceExclusiveLite(&DeviceExt->FatResource, TRUE);
                 NCluster = Cluster;
                 Status = NextCluster(DeviceExt, FirstCluster, &NCluster, FALSE);
                 WriteCluster(DeviceExt, Cluster, 0xffffffff);
@@ -1341,6 +1318,9 @@ VfatSetAllocationSizeInformation(
                     WriteCluster(DeviceExt, Cluster, 0);
                     Cluster = NCluster;
                 }
+                /* A concurrent lookup may have cached the clusters we gave back */
+                FsRtlTruncateLargeMcb(&Fcb->Mcb, Fcb->RFCB.AllocationSize.u.LowPart / ClusterSize);
+                ExReleaseResourceLite(&DeviceExt->FatResource);
                 return STATUS_DISK_FULL;
             }
         }
@@ -1358,19 +1338,22 @@ VfatSetAllocationSizeInformation(
         DPRINT("Can set file size\n");
 
         AllocSizeChanged = TRUE;
-        /* FIXME: Use the cached cluster/offset better way. */
-        Fcb->LastCluster = Fcb->LastOffset = 0;
         UpdateFileSize(FileObject, Fcb, NewSize, ClusterSize, vfatVolumeIsFatX(DeviceExt));
         if (NewSize > 0)
         {
-            Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                     ROUND_DOWN(NewSize - 1, ClusterSize),
-                                     &Cluster, FALSE);
+            Status = OffsetToClusterRun(DeviceExt, Fcb,
+                                        ROUND_DOWN(NewSize - 1, ClusterSize),
+                                        &Cluster, &NCluster);
 
-            NCluster = Cluster;
-            Status = NextCluster(DeviceExt, FirstCluster, &NCluster, FALSE);
-            WriteCluster(DeviceExt, Cluster, 0xffffffff);
-            Cluster = NCluster;
+            /* Lookups cache the chain under the FAT resource, so cut it back with it held */
+            ExAcquireResourceExclusiveLite(&DeviceExt->FatResource, TRUE);
+            if (NT_SUCCESS(Status) && Cluster != 0xffffffff)
+            {
+                NCluster = Cluster;
+                Status = NextCluster(DeviceExt, FirstCluster, &NCluster, FALSE);
+                WriteCluster(DeviceExt, Cluster, 0xffffffff);
+                Cluster = NCluster;
+            }
         }
         else
         {
@@ -1391,6 +1374,7 @@ VfatSetAllocationSizeInformation(
                 }
             }
 
+            ExAcquireResourceExclusiveLite(&DeviceExt->FatResource, TRUE);
             NCluster = Cluster = FirstCluster;
             Status = STATUS_SUCCESS;
         }
@@ -1402,6 +1386,9 @@ VfatSetAllocationSizeInformation(
             Cluster = NCluster;
         }
 
+        FsRtlTruncateLargeMcb(&Fcb->Mcb, ROUND_UP(NewSize, ClusterSize) / ClusterSize);
+        ExReleaseResourceLite(&DeviceExt->FatResource);
+
         if (DeviceExt->FatInfo.FatType == FAT32)
         {
             FAT32UpdateFreeClustersCount(DeviceExt);
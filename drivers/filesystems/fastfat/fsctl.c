@@ -733,9 +733,15 @@ VfatMount(
     _SEH2_END;
 
     DeviceExt->LastAvailableCluster = 2;
-    CountAvailableClusters(DeviceExt, NULL);
     ExInitializeResourceLite(&DeviceExt->FatResource);
 
+    /* Allocations scan the FAT if we can't keep a cluster bitmap */
+    if (!NT_SUCCESS(InitializeClusterBitmap(DeviceExt)))
+    {
+        DPRINT1("No cluster bitmap for %u clusters\n", DeviceExt->FatInfo.NumberOfClusters);
+    }
+    CountAvailableClusters(DeviceExt, NULL);
+
     InitializeListHead(&DeviceExt->FcbListHead);
 
     VolumeFcb = vfatNewFCB(DeviceExt, &VolumeNameU);
@@ -825,6 +831,8 @@ ByeBye:
             ExFreePoolWithTag(DeviceExt->SpareVPB, TAG_VPB);
         if (DeviceExt && DeviceExt->Statistics)
             ExFreePoolWithTag(DeviceExt->Statistics, TAG_STATS);
+        if (DeviceExt)
+            UninitializeClusterBitmap(DeviceExt);
         if (DeviceObject)
             IoDeleteDevice(DeviceObject);
     }
@@ -578,6 +578,7 @@ VfatCheckForDismount(
 
         /* Release resources */
         ExFreePoolWithTag(DeviceExt->Statistics, TAG_STATS);
+        UninitializeClusterBitmap(DeviceExt);
         ExDeleteResourceLite(&DeviceExt->DirResource);
         ExDeleteResourceLite(&DeviceExt->FatResource);
 
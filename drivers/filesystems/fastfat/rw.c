@@ -16,14 +16,19 @@
 #include <debug.h>
 
 /*
- * Uncomment to enable strict verification of cluster/offset pair
- * caching. If this option is enabled you lose all the benefits of
- * the caching and the read/write operations will actually be
- * slower. It's meant only for debugging!!!
+ * Uncomment to enable strict verification of the cluster runs
+ * cached in the FCB. If this option is enabled you lose all the
+ * benefits of the caching and the read/write operations will
+ * actually be slower. It's meant only for debugging!!!
  * - Filip Navara, 26/07/2004
  */
 /* #define DEBUG_VERIFY_OFFSET_CACHING */
 
+/* How far past the requested cluster we decode the chain on a miss,
+ * so that sequential access doesn't walk the FAT for every run
+ */
+#define CLUSTER_RUN_DECODE_AHEAD 256
+
 /* Arbitrary, taken from MS FastFAT, should be
  * refined given what we experience in common
  * out of stack operations
@@ -113,6 +118,117 @@ OffsetToCluster(
    }
 }
 
+/*
+ * Map a file offset to its cluster and the number of clusters following it
+ * contiguously on disk. The runs of the chain are cached in the FCB MCB,
+ * file cluster to disk cluster, so that the FAT only gets walked past what
+ * was decoded before. The MCB only ever holds a prefix of the chain, it's cut
+ * back under the FAT resource when clusters are freed. Returns 0xffffffff
+ * as the cluster when the offset lies past the end of the chain.
+ */
+NTSTATUS
+OffsetToClusterRun(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB Fcb,
+    ULONG FileOffset,
+    PULONG Cluster,
+    PULONG RunClusters)
+{
+    LONGLONG Vcn, Lbn, Count;
+    LONGLONG RunVcn, RunStart, RunLength;
+    ULONG CurrentCluster;
+    BOOLEAN EndOfChain = FALSE;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    Vcn = FileOffset / DeviceExt->FatInfo.BytesPerCluster;
+
+    if (!FsRtlLookupLargeMcbEntry(&Fcb->Mcb, Vcn, &Lbn, &Count, NULL, NULL, NULL) || Lbn == -1)
+    {
+        ExAcquireResourceSharedLite(&DeviceExt->FatResource, TRUE);
+
+        /* Carry on decoding from the last cluster we know */
+        if (FsRtlLookupLastLargeMcbEntry(&Fcb->Mcb, &RunVcn, &Lbn))
+        {
+            RunVcn++;
+            Status = GetNextCluster(DeviceExt, (ULONG)Lbn, &CurrentCluster);
+        }
+        else
+        {
+            RunVcn = 0;
+            CurrentCluster = vfatDirEntryGetFirstCluster(DeviceExt, &Fcb->entry);
+        }
+
+        RunStart = CurrentCluster;
+        RunLength = 0;
+        while (NT_SUCCESS(Status))
+        {
+            if (CurrentCluster == 0xffffffff || CurrentCluster < 2)
+            {
+                EndOfChain = TRUE;
+                break;
+            }
+
+            if (RunLength > 0 && CurrentCluster != RunStart + RunLength)
+            {
+                /* The run ends here, stop if it covers what we were asked for */
+                FsRtlAddLargeMcbEntry(&Fcb->Mcb, RunVcn, RunStart, RunLength);
+                RunVcn += RunLength;
+                RunLength = 0;
+                RunStart = CurrentCluster;
+                if (RunVcn > Vcn)
+                    break;
+            }
+
+            RunLength++;
+            if (RunVcn + RunLength > Vcn + CLUSTER_RUN_DECODE_AHEAD)
+                break;
+
+            Status = GetNextCluster(DeviceExt, CurrentCluster, &CurrentCluster);
+        }
+
+        if (RunLength > 0)
+        {
+            FsRtlAddLargeMcbEntry(&Fcb->Mcb, RunVcn, RunStart, RunLength);
+        }
+
+        ExReleaseResourceLite(&DeviceExt->FatResource);
+
+        if (!NT_SUCCESS(Status))
+        {
+            return Status;
+        }
+
+        if (!FsRtlLookupLargeMcbEntry(&Fcb->Mcb, Vcn, &Lbn, &Count, NULL, NULL, NULL) || Lbn == -1)
+        {
+            if (EndOfChain)
+            {
+                *Cluster = 0xffffffff;
+                *RunClusters = 0;
+                return STATUS_SUCCESS;
+            }
+
+            /* We couldn't cache the run */
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+#ifdef DEBUG_VERIFY_OFFSET_CACHING
+    /* DEBUG VERIFICATION */
+    {
+        ULONG CorrectCluster;
+        OffsetToCluster(DeviceExt, vfatDirEntryGetFirstCluster(DeviceExt, &Fcb->entry),
+                        ROUND_DOWN(FileOffset, DeviceExt->FatInfo.BytesPerCluster),
+                        &CorrectCluster, FALSE);
+        if (CorrectCluster != (ULONG)Lbn)
+            KeBugCheck(FAT_FILE_SYSTEM);
+    }
+#endif
+
+    *Cluster = (ULONG)Lbn;
+    *RunClusters = (ULONG)Count;
+    return STATUS_SUCCESS;
+}
+
 /*
  * FUNCTION: Reads data from a file
  */
@@ -124,20 +240,17 @@ VfatReadFileData(
     LARGE_INTEGER ReadOffset,
     PULONG LengthRead)
 {
-    ULONG CurrentCluster;
     ULONG FirstCluster;
     ULONG StartCluster;
     ULONG ClusterCount;
+    ULONG ClusterOffset;
     LARGE_INTEGER StartOffset;
     PDEVICE_EXTENSION DeviceExt;
-    BOOLEAN First = TRUE;
     PVFATFCB Fcb;
-    NTSTATUS Status;
+    NTSTATUS Status = STATUS_SUCCESS;
     ULONG BytesDone;
     ULONG BytesPerSector;
     ULONG BytesPerCluster;
-    ULONG LastCluster;
-    ULONG LastOffset;
 
     /* PRECONDITION */
     ASSERT(IrpContext);
@@ -194,8 +307,7 @@ VfatReadFileData(
     }
 
     /* Find the first cluster */
-    FirstCluster =
-    CurrentCluster = vfatDirEntryGetFirstCluster (DeviceExt, &Fcb->entry);
+    FirstCluster = vfatDirEntryGetFirstCluster (DeviceExt, &Fcb->entry);
 
     if (FirstCluster == 1)
     {
@@ -215,87 +327,24 @@ VfatReadFileData(
         return Status;
     }
 
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    LastCluster = Fcb->LastCluster;
-    LastOffset = Fcb->LastOffset;
-    ExReleaseFastMutex(&Fcb->LastMutex);
-
-    /* Find the cluster to start the read from */
-    if (LastCluster > 0 && ReadOffset.u.LowPart >= LastOffset)
-    {
-        Status = OffsetToCluster(DeviceExt, LastCluster,
-                                 ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster) -
-                                 LastOffset,
-                                 &CurrentCluster, FALSE);
-#ifdef DEBUG_VERIFY_OFFSET_CACHING
-        /* DEBUG VERIFICATION */
-        {
-            ULONG CorrectCluster;
-            OffsetToCluster(DeviceExt, FirstCluster,
-                            ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster),
-                            &CorrectCluster, FALSE);
-            if (CorrectCluster != CurrentCluster)
-                KeBugCheck(FAT_FILE_SYSTEM);
-        }
-#endif
-    }
-    else
-    {
-        Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                 ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster),
-                                 &CurrentCluster, FALSE);
-    }
-
-    if (!NT_SUCCESS(Status))
-    {
-        return Status;
-    }
-
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    Fcb->LastCluster = CurrentCluster;
-    Fcb->LastOffset = ROUND_DOWN (ReadOffset.u.LowPart, BytesPerCluster);
-    ExReleaseFastMutex(&Fcb->LastMutex);
-
     KeInitializeEvent(&IrpContext->Event, NotificationEvent, FALSE);
     IrpContext->RefCount = 1;
 
-    while (Length > 0 && CurrentCluster != 0xffffffff)
+    while (Length > 0)
     {
-        StartCluster = CurrentCluster;
-        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector;
-        BytesDone = 0;
-        ClusterCount = 0;
-
-        do
+        /* Find the run of clusters holding the data at ReadOffset */
+        Status = OffsetToClusterRun(DeviceExt, Fcb, ReadOffset.u.LowPart,
+                                    &StartCluster, &ClusterCount);
+        if (!NT_SUCCESS(Status) || StartCluster == 0xffffffff)
         {
-            ClusterCount++;
-            if (First)
-            {
-                BytesDone =  min (Length, BytesPerCluster - (ReadOffset.u.LowPart % BytesPerCluster));
-                StartOffset.QuadPart += ReadOffset.u.LowPart % BytesPerCluster;
-                First = FALSE;
-            }
-            else
-            {
-                if (Length - BytesDone > BytesPerCluster)
-                {
-                    BytesDone += BytesPerCluster;
-                }
-                else
-                {
-                    BytesDone = Length;
-                }
-            }
-            Status = NextCluster(DeviceExt, FirstCluster, &CurrentCluster, FALSE);
+            break;
         }
-        while (StartCluster + ClusterCount == CurrentCluster && NT_SUCCESS(Status) && Length > BytesDone);
-        DPRINT("start %08x, next %08x, count %u\n",
-               StartCluster, CurrentCluster, ClusterCount);
 
-        ExAcquireFastMutex(&Fcb->LastMutex);
-        Fcb->LastCluster = StartCluster + (ClusterCount - 1);
-        Fcb->LastOffset = ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster) + (ClusterCount - 1) * BytesPerCluster;
-        ExReleaseFastMutex(&Fcb->LastMutex);
+        /* And read as much of it as we can in one go */
+        ClusterOffset = ReadOffset.u.LowPart % BytesPerCluster;
+        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector + ClusterOffset;
+        BytesDone = (ULONG)min((ULONGLONG)Length, (ULONGLONG)ClusterCount * BytesPerCluster - ClusterOffset);
+        DPRINT("start %08x, count %u\n", StartCluster, ClusterCount);
 
         /* Fire up the read command */
         Status = VfatReadDiskPartial (IrpContext, &StartOffset, BytesDone, *LengthRead, FALSE);
@@ -339,18 +388,15 @@ VfatWriteFileData(
     PVFATFCB Fcb;
     ULONG Count;
     ULONG FirstCluster;
-    ULONG CurrentCluster;
     ULONG BytesDone;
     ULONG StartCluster;
     ULONG ClusterCount;
+    ULONG ClusterOffset;
     NTSTATUS Status = STATUS_SUCCESS;
-    BOOLEAN First = TRUE;
     ULONG BytesPerSector;
     ULONG BytesPerCluster;
     LARGE_INTEGER StartOffset;
     ULONG BufferOffset;
-    ULONG LastCluster;
-    ULONG LastOffset;
 
     /* PRECONDITION */
     ASSERT(IrpContext);
@@ -415,8 +461,7 @@ VfatWriteFileData(
     /*
      * Find the first cluster
      */
-    FirstCluster =
-    CurrentCluster = vfatDirEntryGetFirstCluster (DeviceExt, &Fcb->entry);
+    FirstCluster = vfatDirEntryGetFirstCluster (DeviceExt, &Fcb->entry);
 
     if (FirstCluster == 1)
     {
@@ -428,89 +473,25 @@ VfatWriteFileData(
         return Status;
     }
 
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    LastCluster = Fcb->LastCluster;
-    LastOffset = Fcb->LastOffset;
-    ExReleaseFastMutex(&Fcb->LastMutex);
-
-    /*
-     * Find the cluster to start the write from
-     */
-    if (LastCluster > 0 && WriteOffset.u.LowPart >= LastOffset)
-    {
-        Status = OffsetToCluster(DeviceExt, LastCluster,
-                                 ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster) -
-                                 LastOffset,
-                                 &CurrentCluster, FALSE);
-#ifdef DEBUG_VERIFY_OFFSET_CACHING
-        /* DEBUG VERIFICATION */
-        {
-            ULONG CorrectCluster;
-            OffsetToCluster(DeviceExt, FirstCluster,
-                            ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster),
-                            &CorrectCluster, FALSE);
-            if (CorrectCluster != CurrentCluster)
-                KeBugCheck(FAT_FILE_SYSTEM);
-        }
-#endif
-    }
-    else
-    {
-        Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                 ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster),
-                                 &CurrentCluster, FALSE);
-    }
-
-    if (!NT_SUCCESS(Status))
-    {
-        return Status;
-    }
-
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    Fcb->LastCluster = CurrentCluster;
-    Fcb->LastOffset = ROUND_DOWN (WriteOffset.u.LowPart, BytesPerCluster);
-    ExReleaseFastMutex(&Fcb->LastMutex);
-
     IrpContext->RefCount = 1;
     BufferOffset = 0;
 
-    while (Length > 0 && CurrentCluster != 0xffffffff)
+    while (Length > 0)
     {
-        StartCluster = CurrentCluster;
-        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector;
-        BytesDone = 0;
-        ClusterCount = 0;
-
-        do
+        /*
+         * Find the run of clusters to write to
+         */
+        Status = OffsetToClusterRun(DeviceExt, Fcb, WriteOffset.u.LowPart,
+                                    &StartCluster, &ClusterCount);
+        if (!NT_SUCCESS(Status) || StartCluster == 0xffffffff)
         {
-            ClusterCount++;
-            if (First)
-            {
-                BytesDone =  min (Length, BytesPerCluster - (WriteOffset.u.LowPart % BytesPerCluster));
-                StartOffset.QuadPart += WriteOffset.u.LowPart % BytesPerCluster;
-                First = FALSE;
-            }
-            else
-            {
-                if (Length - BytesDone > BytesPerCluster)
-                {
-                    BytesDone += BytesPerCluster;
-                }
-                else
-                {
-                    BytesDone = Length;
-                }
-            }
-            Status = NextCluster(DeviceExt, FirstCluster, &CurrentCluster, FALSE);
+            break;
         }
-        while (StartCluster + ClusterCount == CurrentCluster && NT_SUCCESS(Status) && Length > BytesDone);
-        DPRINT("start %08x, next %08x, count %u\n",
-               StartCluster, CurrentCluster, ClusterCount);
-
-        ExAcquireFastMutex(&Fcb->LastMutex);
-        Fcb->LastCluster = StartCluster + (ClusterCount - 1);
-        Fcb->LastOffset = ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster) + (ClusterCount - 1) * BytesPerCluster;
-        ExReleaseFastMutex(&Fcb->LastMutex);
+
+        ClusterOffset = WriteOffset.u.LowPart % BytesPerCluster;
+        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector + ClusterOffset;
+        BytesDone = (ULONG)min((ULONGLONG)Length, (ULONGLONG)ClusterCount * BytesPerCluster - ClusterOffset);
+        DPRINT("start %08x, count %u\n", StartCluster, ClusterCount);
 
         // Fire up the write command
         Status = VfatWriteDiskPartial (IrpContext, &StartOffset, BytesDone, BufferOffset, FALSE);
@@ -325,6 +325,7 @@ typedef struct DEVICE_EXTENSION
     ULONG LastAvailableCluster;
     ULONG AvailableClusters;
     BOOLEAN AvailableClustersValid;
+    RTL_BITMAP ClusterBitmap;           /* A set bit for each cluster in use, if Buffer isn't NULL */
     ULONG Flags;
     struct _VFATFCB *VolumeFcb;
     struct _VFATFCB *RootFcb;
@@ -514,13 +515,11 @@ typedef struct _VFATFCB
     FILE_LOCK FileLock;
 
     /*
-     * Optimization: caching of last read/write cluster+offset pair. Can't
-     * be in VFATCCB because it must be reset everytime the allocated clusters
-     * change.
+     * Optimization: runs of the cluster chain decoded so far, file cluster
+     * to disk cluster. Can't be in VFATCCB because it must be cut back
+     * everytime the allocated clusters change.
      */
-    FAST_MUTEX LastMutex;
-    ULONG LastCluster;
-    ULONG LastOffset;
+    LARGE_MCB Mcb;
 
     struct _VFAT_CLOSE_CONTEXT * CloseContext;
 } VFATFCB, *PVFATFCB;
@@ -547,6 +546,7 @@ typedef struct _VFATCCB
 #define TAG_NAME 'ntaF'
 #define TAG_SEARCH 'LtaF'
 #define TAG_DIRENT 'DtaF'
+#define TAG_BITMAP 'BtaF'
 
 #define ENTRIES_PER_SECTOR (BLOCKSIZE / sizeof(FATDirEntry))
 
@@ -898,6 +898,14 @@ OffsetToCluster(
     PULONG Cluster,
     BOOLEAN Extend);
 
+NTSTATUS
+OffsetToClusterRun(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB Fcb,
+    ULONG FileOffset,
+    PULONG Cluster,
+    PULONG RunClusters);
+
 ULONGLONG
 ClusterToSector(
     PDEVICE_EXTENSION DeviceExt,
@@ -920,6 +928,21 @@ CountAvailableClusters(
     PDEVICE_EXTENSION DeviceExt,
     PLARGE_INTEGER Clusters);
 
+NTSTATUS
+InitializeClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt);
+
+VOID
+UninitializeClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt);
+
+NTSTATUS
+ExtendClusterChain(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG LastCluster,
+    ULONG ClusterCount,
+    PULONG FirstNewCluster);
+
 NTSTATUS
 WriteCluster(
     PDEVICE_EXTENSION DeviceExt,
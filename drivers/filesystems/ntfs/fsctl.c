@@ -466,6 +466,8 @@ NtfsMountVolume(PDEVICE_OBJECT DeviceObject,
 
     Lookaside = TRUE;
 
+    NtfsInitializeMftCache(Vcb);
+
     NewDeviceObject->Vpb = DeviceToMount->Vpb;
 
     Vcb->StorageDevice = DeviceToMount;
@@ -565,7 +567,10 @@ ByeBye:
             ExFreePool(Ccb);
 
         if (Lookaside)
+        {
+            NtfsUninitializeMftCache(Vcb);
             ExDeleteNPagedLookasideList(&Vcb->FileRecLookasideList);
+        }
 
         if (NewDeviceObject)
             IoDeleteDevice(NewDeviceObject);
@@ -63,30 +63,10 @@ PrepareAttributeContext(PNTFS_ATTR_RECORD AttrRecord)
 
     if (AttrRecord->IsNonResident)
     {
-        LONGLONG DataRunOffset;
-        ULONGLONG DataRunLength;
         ULONGLONG NextVBN = 0;
         PUCHAR DataRun = (PUCHAR)((ULONG_PTR)Context->pRecord + Context->pRecord->NonResident.MappingPairsOffset);
 
-        Context->CacheRun = DataRun;
-        Context->CacheRunOffset = 0;
-        Context->CacheRun = DecodeRun(Context->CacheRun, &DataRunOffset, &DataRunLength);
-        Context->CacheRunLength = DataRunLength;
-        if (DataRunOffset != -1)
-        {
-            /* Normal run. */
-            Context->CacheRunStartLCN =
-            Context->CacheRunLastLCN = DataRunOffset;
-        }
-        else
-        {
-            /* Sparse run. */
-            Context->CacheRunStartLCN = -1;
-            Context->CacheRunLastLCN = 0;
-        }
-        Context->CacheRunCurrentOffset = 0;
-
-        // Convert the data runs to a map control block
+        // Decode the data runs once, reads and writes look them up by VCN from then on
         if (!NT_SUCCESS(ConvertDataRunsToLargeMCB(DataRun, &Context->DataRunsMCB, &NextVBN)))
         {
             DPRINT1("Unable to convert data runs to MCB!\n");
@@ -1068,18 +1048,12 @@ ReadAttribute(PDEVICE_EXTENSION Vcb,
               PCHAR Buffer,
               ULONG Length)
 {
-    ULONGLONG LastLCN;
-    PUCHAR DataRun;
-    LONGLONG DataRunOffset;
-    ULONGLONG DataRunLength;
     LONGLONG DataRunStartLCN;
-    ULONGLONG CurrentOffset;
+    LONGLONG DataRunLength;
+    ULONG RunOffset;
     ULONG ReadLength;
     ULONG AlreadyRead;
     NTSTATUS Status;
-    
-    //TEMPTEMP
-    PUCHAR TempBuffer;
 
     if (!Context->pRecord->IsNonResident)
     {
@@ -1101,170 +1075,63 @@ ReadAttribute(PDEVICE_EXTENSION Vcb,
      * Non-resident attribute
      */
 
-    /*
-     * I. Find the corresponding start data run.
-     */
-
     AlreadyRead = 0;
 
-    // FIXME: Cache seems to be non-working. Disable it for now
-    //if(Context->CacheRunOffset <= Offset && Offset < Context->CacheRunOffset + Context->CacheRunLength * Volume->ClusterSize)
-    if (0)
-    {
-        DataRun = Context->CacheRun;
-        LastLCN = Context->CacheRunLastLCN;
-        DataRunStartLCN = Context->CacheRunStartLCN;
-        DataRunLength = Context->CacheRunLength;
-        CurrentOffset = Context->CacheRunCurrentOffset;
-    }
-    else
+    while (Length > 0)
     {
-        //TEMPTEMP
-        ULONG UsedBufferSize;
-        TempBuffer = ExAllocatePoolWithTag(NonPagedPool, Vcb->NtfsInfo.BytesPerFileRecord, TAG_NTFS);
-        if (TempBuffer == NULL)
+        /*
+         * Find the data run holding Offset. A trailing sparse run isn't in
+         * the MCB, so past the last mapped run, zero-fill up to the
+         * allocated size.
+         */
+        if (!FsRtlLookupLargeMcbEntry(&Context->DataRunsMCB,
+                                      Offset / Vcb->NtfsInfo.BytesPerCluster,
+                                      &DataRunStartLCN,
+                                      &DataRunLength,
+                                      NULL,
+                                      NULL,
+                                      NULL))
         {
-            return STATUS_INSUFFICIENT_RESOURCES;
-        }
-
-        LastLCN = 0;
-        CurrentOffset = 0;
-
-        // This will be rewritten in the next iteration to just use the DataRuns MCB directly
-        ConvertLargeMCBToDataRuns(&Context->DataRunsMCB,
-                                  TempBuffer,
-                                  Vcb->NtfsInfo.BytesPerFileRecord,
-                                  &UsedBufferSize);
-
-        DataRun = TempBuffer;
-
-        while (1)
-        {
-            DataRun = DecodeRun(DataRun, &DataRunOffset, &DataRunLength);
-            if (DataRunOffset != -1)
-            {
-                /* Normal data run. */
-                DataRunStartLCN = LastLCN + DataRunOffset;
-                LastLCN = DataRunStartLCN;
-            }
-            else
-            {
-                /* Sparse data run. */
-                DataRunStartLCN = -1;
-            }
-
-            if (Offset >= CurrentOffset &&
-                Offset < CurrentOffset + (DataRunLength * Vcb->NtfsInfo.BytesPerCluster))
-            {
+            if (Offset >= (ULONGLONG)Context->pRecord->NonResident.AllocatedSize)
                 break;
-            }
 
-            if (*DataRun == 0)
-            {
-                ExFreePoolWithTag(TempBuffer, TAG_NTFS);
-                return AlreadyRead;
-            }
+            ReadLength = (ULONG)min(Context->pRecord->NonResident.AllocatedSize - Offset, Length);
+            RtlZeroMemory(Buffer, ReadLength);
 
-            CurrentOffset += DataRunLength * Vcb->NtfsInfo.BytesPerCluster;
+            Length -= ReadLength;
+            Buffer += ReadLength;
+            Offset += ReadLength;
+            AlreadyRead += ReadLength;
+            continue;
         }
-    }
-
-    /*
-     * II. Go through the run list and read the data
-     */
 
-    ReadLength = (ULONG)min(DataRunLength * Vcb->NtfsInfo.BytesPerCluster - (Offset - CurrentOffset), Length);
-    if (DataRunStartLCN == -1)
-    {
-        RtlZeroMemory(Buffer, ReadLength);
-        Status = STATUS_SUCCESS;
-    }
-    else
-    {
-        Status = NtfsReadDisk(Vcb->StorageDevice,
-                              DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster + Offset - CurrentOffset,
-                              ReadLength,
-                              Vcb->NtfsInfo.BytesPerSector,
-                              (PVOID)Buffer,
-                              FALSE);
-    }
-    if (NT_SUCCESS(Status))
-    {
-        Length -= ReadLength;
-        Buffer += ReadLength;
-        AlreadyRead += ReadLength;
-
-        if (ReadLength == DataRunLength * Vcb->NtfsInfo.BytesPerCluster - (Offset - CurrentOffset))
+        /*
+         * Read as much of the run as we need
+         */
+        RunOffset = (ULONG)(Offset % Vcb->NtfsInfo.BytesPerCluster);
+        ReadLength = (ULONG)min(DataRunLength * Vcb->NtfsInfo.BytesPerCluster - RunOffset, Length);
+        if (DataRunStartLCN == -1)
         {
-            CurrentOffset += DataRunLength * Vcb->NtfsInfo.BytesPerCluster;
-            DataRun = DecodeRun(DataRun, &DataRunOffset, &DataRunLength);
-            if (DataRunOffset != (ULONGLONG)-1)
-            {
-                DataRunStartLCN = LastLCN + DataRunOffset;
-                LastLCN = DataRunStartLCN;
-            }
-            else
-                DataRunStartLCN = -1;
+            /* Sparse data run. */
+            RtlZeroMemory(Buffer, ReadLength);
         }
-
-        while (Length > 0)
+        else
         {
-            ReadLength = (ULONG)min(DataRunLength * Vcb->NtfsInfo.BytesPerCluster, Length);
-            if (DataRunStartLCN == -1)
-                RtlZeroMemory(Buffer, ReadLength);
-            else
-            {
-                Status = NtfsReadDisk(Vcb->StorageDevice,
-                                      DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster,
-                                      ReadLength,
-                                      Vcb->NtfsInfo.BytesPerSector,
-                                      (PVOID)Buffer,
-                                      FALSE);
-                if (!NT_SUCCESS(Status))
-                    break;
-            }
-
-            Length -= ReadLength;
-            Buffer += ReadLength;
-            AlreadyRead += ReadLength;
-
-            /* We finished this request, but there still data in this data run. */
-            if (Length == 0 && ReadLength != DataRunLength * Vcb->NtfsInfo.BytesPerCluster)
-                break;
-
-            /*
-             * Go to next run in the list.
-             */
-
-            if (*DataRun == 0)
+            Status = NtfsReadDisk(Vcb->StorageDevice,
+                                  DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster + RunOffset,
+                                  ReadLength,
+                                  Vcb->NtfsInfo.BytesPerSector,
+                                  (PVOID)Buffer,
+                                  FALSE);
+            if (!NT_SUCCESS(Status))
                 break;
-            CurrentOffset += DataRunLength * Vcb->NtfsInfo.BytesPerCluster;
-            DataRun = DecodeRun(DataRun, &DataRunOffset, &DataRunLength);
-            if (DataRunOffset != -1)
-            {
-                /* Normal data run. */
-                DataRunStartLCN = LastLCN + DataRunOffset;
-                LastLCN = DataRunStartLCN;
-            }
-            else
-            {
-                /* Sparse data run. */
-                DataRunStartLCN = -1;
-            }
-        } /* while */
-
-    } /* if Disk */
-
-    // TEMPTEMP
-    if (Context->pRecord->IsNonResident)
-        ExFreePoolWithTag(TempBuffer, TAG_NTFS);
+        }
 
-    Context->CacheRun = DataRun;
-    Context->CacheRunOffset = Offset + AlreadyRead;
-    Context->CacheRunStartLCN = DataRunStartLCN;
-    Context->CacheRunLength = DataRunLength;
-    Context->CacheRunLastLCN = LastLCN;
-    Context->CacheRunCurrentOffset = CurrentOffset;
+        Length -= ReadLength;
+        Buffer += ReadLength;
+        Offset += ReadLength;
+        AlreadyRead += ReadLength;
+    }
 
     return AlreadyRead;
 }
@@ -1320,21 +1187,15 @@ WriteAttribute(PDEVICE_EXTENSION Vcb,
                PULONG RealLengthWritten,
                PFILE_RECORD_HEADER FileRecord)
 {
-    ULONGLONG LastLCN;
-    PUCHAR DataRun;
-    LONGLONG DataRunOffset;
-    ULONGLONG DataRunLength;
     LONGLONG DataRunStartLCN;
-    ULONGLONG CurrentOffset;
+    LONGLONG DataRunLength;
+    ULONG RunOffset;
     ULONG WriteLength;
     NTSTATUS Status;
     PUCHAR SourceBuffer = Buffer;
-    LONGLONG StartingOffset;
     BOOLEAN FileRecordAllocated = FALSE;
-    
-    //TEMPTEMP
-    PUCHAR TempBuffer;
-        
+    ULONGLONG StartOffset;
+    ULONG StartLength;
 
     DPRINT("WriteAttribute(%p, %p, %I64u, %p, %lu, %p, %p)\n", Vcb, Context, Offset, Buffer, Length, RealLengthWritten, FileRecord);
 
@@ -1423,208 +1284,285 @@ WriteAttribute(PDEVICE_EXTENSION Vcb,
 
     // This is a non-resident attribute.
 
-    // I. Find the corresponding start data run.	
+    StartOffset = Offset;
+    StartLength = Length;
+    Status = STATUS_SUCCESS;
 
-    // FIXME: Cache seems to be non-working. Disable it for now
-    //if(Context->CacheRunOffset <= Offset && Offset < Context->CacheRunOffset + Context->CacheRunLength * Volume->ClusterSize)
-    /*if (0)
-    {
-    DataRun = Context->CacheRun;
-    LastLCN = Context->CacheRunLastLCN;
-    DataRunStartLCN = Context->CacheRunStartLCN;
-    DataRunLength = Context->CacheRunLength;
-    CurrentOffset = Context->CacheRunCurrentOffset;
-    }
-    else*/
+    while (Length > 0)
     {
-        ULONG UsedBufferSize;
-        LastLCN = 0;
-        CurrentOffset = 0;  
+        // Find the data run we're trying to write to
+        if (!FsRtlLookupLargeMcbEntry(&Context->DataRunsMCB,
+                                      Offset / Vcb->NtfsInfo.BytesPerCluster,
+                                      &DataRunStartLCN,
+                                      &DataRunLength,
+                                      NULL,
+                                      NULL,
+                                      NULL))
+        {
+            // We reached the last assigned cluster
+            // TODO: assign new clusters to the end of the file. 
+            // (Presently, this code will rarely be reached, the write will usually have already failed by now)
+            // [We can reach here by creating a new file record when the MFT isn't large enough]
+            DPRINT1("FIXME: Master File Table needs to be enlarged.\n");
+            Status = STATUS_END_OF_FILE;
+            break;
+        }
 
-        // This will be rewritten in the next iteration to just use the DataRuns MCB directly
-        TempBuffer = ExAllocatePoolWithTag(NonPagedPool, Vcb->NtfsInfo.BytesPerFileRecord, TAG_NTFS);
-        if (TempBuffer == NULL)
+        if (DataRunStartLCN == -1)
         {
-            return STATUS_INSUFFICIENT_RESOURCES;
+            // Sparse data run. We can't support writing to sparse files yet 
+            // (it may require increasing the allocation size).
+            DPRINT1("FIXME: Writing to sparse files is not supported yet!\n");
+            Status = STATUS_NOT_IMPLEMENTED;
+            break;
         }
 
-        ConvertLargeMCBToDataRuns(&Context->DataRunsMCB,
-                                  TempBuffer,
-                                  Vcb->NtfsInfo.BytesPerFileRecord,
-                                  &UsedBufferSize);
+        // Make sure we don't write past the end of the current data run
+        RunOffset = (ULONG)(Offset % Vcb->NtfsInfo.BytesPerCluster);
+        WriteLength = (ULONG)min(DataRunLength * Vcb->NtfsInfo.BytesPerCluster - RunOffset, Length);
+
+        // Write the data to the disk
+        Status = NtfsWriteDisk(Vcb->StorageDevice,
+                               DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster + RunOffset,
+                               WriteLength,
+                               Vcb->NtfsInfo.BytesPerSector,
+                               (PVOID)SourceBuffer);
+        if (!NT_SUCCESS(Status))
+            break;
 
-        DataRun = TempBuffer;
+        Length -= WriteLength;
+        SourceBuffer += WriteLength;
+        Offset += WriteLength;
+        *RealLengthWritten += WriteLength;
+    }
 
-        while (1)
-        {
-            DataRun = DecodeRun(DataRun, &DataRunOffset, &DataRunLength);
-            if (DataRunOffset != -1)
-            {
-                // Normal data run. 
-                // DPRINT1("Writing to normal data run, LastLCN %I64u DataRunOffset %I64d\n", LastLCN, DataRunOffset);
-                DataRunStartLCN = LastLCN + DataRunOffset;
-                LastLCN = DataRunStartLCN;
-            }
-            else
-            {
-                // Sparse data run. We can't support writing to sparse files yet 
-                // (it may require increasing the allocation size).
-                DataRunStartLCN = -1;
-                DPRINT1("FIXME: Writing to sparse files is not supported yet!\n");
-                Status = STATUS_NOT_IMPLEMENTED;
-                goto Cleanup;
-            }
+    // Writing to the $MFT data goes around the cached file records. Only drop
+    // them once the write is done, so a record read from the disk meanwhile
+    // can't be cached with the new generation.
+    if (StartLength > 0 && NtfsIsMftDataContext(Vcb, Context))
+    {
+        NtfsInvalidateMftCache(Vcb,
+                               StartOffset / Vcb->NtfsInfo.BytesPerFileRecord,
+                               (StartOffset + StartLength - 1) / Vcb->NtfsInfo.BytesPerFileRecord);
+    }
 
-            // Have we reached the data run we're trying to write to?
-            if (Offset >= CurrentOffset &&
-                Offset < CurrentOffset + (DataRunLength * Vcb->NtfsInfo.BytesPerCluster))
-            {
-                break;
-            }
+    return Status;
+}
 
-            if (*DataRun == 0)
-            {
-                // We reached the last assigned cluster
-                // TODO: assign new clusters to the end of the file. 
-                // (Presently, this code will rarely be reached, the write will usually have already failed by now)
-                // [We can reach here by creating a new file record when the MFT isn't large enough]
-                DPRINT1("FIXME: Master File Table needs to be enlarged.\n");
-                Status = STATUS_END_OF_FILE;
-                goto Cleanup;
-            }
+/*
+ * Tells whether Context is the $DATA attribute of the $MFT. Besides the one on
+ * the VCB, contexts found in the $MFT file record count too; they're
+ * recognized by their first run starting where the boot sector puts the MFT.
+ */
+BOOLEAN
+NtfsIsMftDataContext(PDEVICE_EXTENSION Vcb,
+                     PNTFS_ATTR_CONTEXT Context)
+{
+    LONGLONG FirstLCN;
 
-            CurrentOffset += DataRunLength * Vcb->NtfsInfo.BytesPerCluster;
-        }
+    if (Context == Vcb->MFTContext)
+        return TRUE;
+
+    if (Context->pRecord->Type != AttributeData ||
+        !Context->pRecord->IsNonResident ||
+        Context->pRecord->NonResident.LowestVCN != 0)
+    {
+        return FALSE;
     }
 
-    // II. Go through the run list and write the data
+    return FsRtlLookupLargeMcbEntry(&Context->DataRunsMCB, 0, &FirstLCN,
+                                    NULL, NULL, NULL, NULL) &&
+           FirstLCN == (LONGLONG)Vcb->NtfsInfo.MftStart.QuadPart;
+}
 
-    /* REVIEWME -- As adapted from NtfsReadAttribute():
-    We seem to be making a special case for the first applicable data run, but I'm not sure why.
-    Does it have something to do with (not) caching? Is this strategy equally applicable to writing? */
+/*
+ * The file records read last are kept fixed up in a small cache on the VCB,
+ * directory walks keep going back to the same few of them. Writes to the MFT
+ * drop the records they cover, and the generation makes sure a record read
+ * from the disk while one of those writes was going on doesn't get cached.
+ */
+VOID
+NtfsInitializeMftCache(PDEVICE_EXTENSION Vcb)
+{
+    PLIST_ENTRY Buckets;
+    ULONG i;
 
-    WriteLength = (ULONG)min(DataRunLength * Vcb->NtfsInfo.BytesPerCluster - (Offset - CurrentOffset), Length);
+    ExInitializeFastMutex(&Vcb->MftCacheLock);
+    InitializeListHead(&Vcb->MftCacheLruList);
+    Vcb->MftCacheCount = 0;
+    Vcb->MftCacheGeneration = 0;
 
-    StartingOffset = DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster + Offset - CurrentOffset;
+    Buckets = ExAllocatePoolWithTag(NonPagedPool,
+                                    NTFS_MFT_CACHE_BUCKETS * sizeof(LIST_ENTRY),
+                                    TAG_MFT_CACHE);
+    if (Buckets == NULL)
+    {
+        DPRINT1("Not caching file records\n");
+        return;
+    }
 
-    // Write the data to the disk
-    Status = NtfsWriteDisk(Vcb->StorageDevice,
-                           StartingOffset,
-                           WriteLength,
-                           Vcb->NtfsInfo.BytesPerSector,
-                           (PVOID)SourceBuffer);
+    for (i = 0; i < NTFS_MFT_CACHE_BUCKETS; i++)
+    {
+        InitializeListHead(&Buckets[i]);
+    }
 
-    // Did the write fail?
-    if (!NT_SUCCESS(Status))
+    Vcb->MftCacheBuckets = Buckets;
+}
+
+VOID
+NtfsUninitializeMftCache(PDEVICE_EXTENSION Vcb)
+{
+    PNTFS_MFT_CACHE_ENTRY CacheEntry;
+
+    if (Vcb->MftCacheBuckets == NULL)
+        return;
+
+    while (!IsListEmpty(&Vcb->MftCacheLruList))
     {
-        Context->CacheRun = DataRun;
-        Context->CacheRunOffset = Offset;
-        Context->CacheRunStartLCN = DataRunStartLCN;
-        Context->CacheRunLength = DataRunLength;
-        Context->CacheRunLastLCN = LastLCN;
-        Context->CacheRunCurrentOffset = CurrentOffset;
+        CacheEntry = CONTAINING_RECORD(RemoveHeadList(&Vcb->MftCacheLruList), NTFS_MFT_CACHE_ENTRY, LruEntry);
+        ExFreePoolWithTag(CacheEntry, TAG_MFT_CACHE);
+    }
+
+    ExFreePoolWithTag(Vcb->MftCacheBuckets, TAG_MFT_CACHE);
+    Vcb->MftCacheBuckets = NULL;
+    Vcb->MftCacheCount = 0;
+}
 
-        goto Cleanup;
+static
+PNTFS_MFT_CACHE_ENTRY
+MftCacheFind(PDEVICE_EXTENSION Vcb,
+             ULONGLONG MftIndex)
+{
+    PLIST_ENTRY Bucket, Entry;
+    PNTFS_MFT_CACHE_ENTRY CacheEntry;
+
+    Bucket = &Vcb->MftCacheBuckets[MftIndex % NTFS_MFT_CACHE_BUCKETS];
+    for (Entry = Bucket->Flink; Entry != Bucket; Entry = Entry->Flink)
+    {
+        CacheEntry = CONTAINING_RECORD(Entry, NTFS_MFT_CACHE_ENTRY, HashEntry);
+        if (CacheEntry->MftIndex == MftIndex)
+            return CacheEntry;
     }
 
-    Length -= WriteLength;
-    SourceBuffer += WriteLength;
-    *RealLengthWritten += WriteLength;
+    return NULL;
+}
 
-    // Did we write to the end of the data run?
-    if (WriteLength == DataRunLength * Vcb->NtfsInfo.BytesPerCluster - (Offset - CurrentOffset))
+/* On a miss, returns the generation to pass to MftCacheInsert() */
+static
+BOOLEAN
+MftCacheLookup(PDEVICE_EXTENSION Vcb,
+               ULONGLONG MftIndex,
+               PFILE_RECORD_HEADER FileRecord,
+               PULONG Generation)
+{
+    PNTFS_MFT_CACHE_ENTRY CacheEntry;
+
+    if (Vcb->MftCacheBuckets == NULL)
+        return FALSE;
+
+    ExAcquireFastMutex(&Vcb->MftCacheLock);
+
+    CacheEntry = MftCacheFind(Vcb, MftIndex);
+    if (CacheEntry != NULL)
     {
-        // Advance to the next data run
-        CurrentOffset += DataRunLength * Vcb->NtfsInfo.BytesPerCluster;
-        DataRun = DecodeRun(DataRun, &DataRunOffset, &DataRunLength);
+        RtlCopyMemory(FileRecord, CacheEntry->Record, Vcb->NtfsInfo.BytesPerFileRecord);
+        RemoveEntryList(&CacheEntry->LruEntry);
+        InsertHeadList(&Vcb->MftCacheLruList, &CacheEntry->LruEntry);
+    }
 
-        if (DataRunOffset != (ULONGLONG)-1)
-        {
-            DataRunStartLCN = LastLCN + DataRunOffset;
-            LastLCN = DataRunStartLCN;
-        }
-        else
-            DataRunStartLCN = -1;
+    *Generation = Vcb->MftCacheGeneration;
+
+    ExReleaseFastMutex(&Vcb->MftCacheLock);
+
+    return (CacheEntry != NULL);
+}
+
+static
+VOID
+MftCacheInsert(PDEVICE_EXTENSION Vcb,
+               ULONGLONG MftIndex,
+               PFILE_RECORD_HEADER FileRecord,
+               ULONG Generation)
+{
+    PNTFS_MFT_CACHE_ENTRY CacheEntry;
+
+    if (Vcb->MftCacheBuckets == NULL)
+        return;
+
+    ExAcquireFastMutex(&Vcb->MftCacheLock);
+
+    // Was the MFT written since we read the record?
+    if (Generation != Vcb->MftCacheGeneration)
+    {
+        ExReleaseFastMutex(&Vcb->MftCacheLock);
+        return;
     }
 
-    // Do we have more data to write?
-    while (Length > 0)
+    CacheEntry = MftCacheFind(Vcb, MftIndex);
+    if (CacheEntry != NULL)
     {
-        // Make sure we don't write past the end of the current data run
-        WriteLength = (ULONG)min(DataRunLength * Vcb->NtfsInfo.BytesPerCluster, Length);
-        
-        // Are we dealing with a sparse data run?
-        if (DataRunStartLCN == -1)
-        {
-            DPRINT1("FIXME: Don't know how to write to sparse files yet! (DataRunStartLCN == -1)\n");
-            Status = STATUS_NOT_IMPLEMENTED;
-            goto Cleanup;
-        }
-        else
+        RemoveEntryList(&CacheEntry->HashEntry);
+        RemoveEntryList(&CacheEntry->LruEntry);
+    }
+    else if (Vcb->MftCacheCount >= NTFS_MFT_CACHE_ENTRIES)
+    {
+        // Recycle the least recently used one
+        CacheEntry = CONTAINING_RECORD(RemoveTailList(&Vcb->MftCacheLruList), NTFS_MFT_CACHE_ENTRY, LruEntry);
+        RemoveEntryList(&CacheEntry->HashEntry);
+    }
+    else
+    {
+        CacheEntry = ExAllocatePoolWithTag(NonPagedPool,
+                                           FIELD_OFFSET(NTFS_MFT_CACHE_ENTRY, Record[Vcb->NtfsInfo.BytesPerFileRecord]),
+                                           TAG_MFT_CACHE);
+        if (CacheEntry == NULL)
         {
-            // write the data to the disk
-            Status = NtfsWriteDisk(Vcb->StorageDevice,
-                                   DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster,
-                                   WriteLength,
-                                   Vcb->NtfsInfo.BytesPerSector,
-                                   (PVOID)SourceBuffer);
-            if (!NT_SUCCESS(Status))
-                break;
+            ExReleaseFastMutex(&Vcb->MftCacheLock);
+            return;
         }
+        Vcb->MftCacheCount++;
+    }
 
-        Length -= WriteLength;
-        SourceBuffer += WriteLength;
-        *RealLengthWritten += WriteLength;
+    CacheEntry->MftIndex = MftIndex;
+    RtlCopyMemory(CacheEntry->Record, FileRecord, Vcb->NtfsInfo.BytesPerFileRecord);
+    InsertHeadList(&Vcb->MftCacheBuckets[MftIndex % NTFS_MFT_CACHE_BUCKETS], &CacheEntry->HashEntry);
+    InsertHeadList(&Vcb->MftCacheLruList, &CacheEntry->LruEntry);
 
-        // We finished this request, but there's still data in this data run. 
-        if (Length == 0 && WriteLength != DataRunLength * Vcb->NtfsInfo.BytesPerCluster)
-            break;
+    ExReleaseFastMutex(&Vcb->MftCacheLock);
+}
 
-        // Go to next run in the list.
+/* Drops the file records FirstIndex to LastIndex (inclusive) from the cache */
+VOID
+NtfsInvalidateMftCache(PDEVICE_EXTENSION Vcb,
+                       ULONGLONG FirstIndex,
+                       ULONGLONG LastIndex)
+{
+    PLIST_ENTRY Entry;
+    PNTFS_MFT_CACHE_ENTRY CacheEntry;
 
-        if (*DataRun == 0)
-        {
-            // that was the last run
-            if (Length > 0)
-            {
-                // Failed sanity check.
-                DPRINT1("Encountered EOF before expected!\n");
-                Status = STATUS_END_OF_FILE;
-                goto Cleanup;
-            }
+    if (Vcb->MftCacheBuckets == NULL)
+        return;
 
-            break;
-        }
+    ExAcquireFastMutex(&Vcb->MftCacheLock);
 
-        // Advance to the next data run
-        CurrentOffset += DataRunLength * Vcb->NtfsInfo.BytesPerCluster;
-        DataRun = DecodeRun(DataRun, &DataRunOffset, &DataRunLength);
-        if (DataRunOffset != -1)
-        {
-            // Normal data run.
-            DataRunStartLCN = LastLCN + DataRunOffset;
-            LastLCN = DataRunStartLCN;
-        }
-        else
-        {
-            // Sparse data run. 
-            DataRunStartLCN = -1;
-        }
-    } // end while (Length > 0) [more data to write]
+    Vcb->MftCacheGeneration++;
 
-    Context->CacheRun = DataRun;
-    Context->CacheRunOffset = Offset + *RealLengthWritten;
-    Context->CacheRunStartLCN = DataRunStartLCN;
-    Context->CacheRunLength = DataRunLength;
-    Context->CacheRunLastLCN = LastLCN;
-    Context->CacheRunCurrentOffset = CurrentOffset;
+    Entry = Vcb->MftCacheLruList.Flink;
+    while (Entry != &Vcb->MftCacheLruList)
+    {
+        CacheEntry = CONTAINING_RECORD(Entry, NTFS_MFT_CACHE_ENTRY, LruEntry);
+        Entry = Entry->Flink;
 
-Cleanup:
-    // TEMPTEMP
-    if (Context->pRecord->IsNonResident)
-        ExFreePoolWithTag(TempBuffer, TAG_NTFS);
+        if (CacheEntry->MftIndex >= FirstIndex && CacheEntry->MftIndex <= LastIndex)
+        {
+            RemoveEntryList(&CacheEntry->HashEntry);
+            RemoveEntryList(&CacheEntry->LruEntry);
+            ExFreePoolWithTag(CacheEntry, TAG_MFT_CACHE);
+            Vcb->MftCacheCount--;
+        }
+    }
 
-    return Status;
+    ExReleaseFastMutex(&Vcb->MftCacheLock);
 }
 
 NTSTATUS
@@ -1633,9 +1571,16 @@ ReadFileRecord(PDEVICE_EXTENSION Vcb,
                PFILE_RECORD_HEADER file)
 {
     ULONGLONG BytesRead;
+    ULONG Generation;
+    NTSTATUS Status;
 
     DPRINT("ReadFileRecord(%p, %I64x, %p)\n", Vcb, index, file);
 
+    if (MftCacheLookup(Vcb, index, file, &Generation))
+    {
+        return STATUS_SUCCESS;
+    }
+
     BytesRead = ReadAttribute(Vcb, Vcb->MFTContext, index * Vcb->NtfsInfo.BytesPerFileRecord, (PCHAR)file, Vcb->NtfsInfo.BytesPerFileRecord);
     if (BytesRead != Vcb->NtfsInfo.BytesPerFileRecord)
     {
@@ -1645,7 +1590,13 @@ ReadFileRecord(PDEVICE_EXTENSION Vcb,
 
     /* Apply update sequence array fixups. */
     DPRINT("Sequence number: %u\n", file->SequenceNumber);
-    return FixupUpdateSequenceArray(Vcb, &file->Ntfs);
+    Status = FixupUpdateSequenceArray(Vcb, &file->Ntfs);
+    if (NT_SUCCESS(Status))
+    {
+        MftCacheInsert(Vcb, index, file, Generation);
+    }
+
+    return Status;
 }
 
 
@@ -1940,7 +1891,7 @@ UpdateFileRecord(PDEVICE_EXTENSION Vcb,
     // Add the fixup array to prepare the data for writing to disk
     AddFixupArray(Vcb, &FileRecord->Ntfs);
 
-    // write the file record to the master file table
+    // write the file record to the master file table, this drops our cached copy of it
     Status = WriteAttribute(Vcb, 
                             Vcb->MFTContext,
                             MftIndex * Vcb->NtfsInfo.BytesPerFileRecord,
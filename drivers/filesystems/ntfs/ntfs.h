@@ -15,6 +15,7 @@
 #define TAG_IRP_CTXT 'iftN'
 #define TAG_ATT_CTXT 'aftN'
 #define TAG_FILE_REC 'rftN'
+#define TAG_MFT_CACHE 'mftN'
 
 #define ROUND_UP(N, S) ((((N) + (S) - 1) / (S)) * (S))
 #define ROUND_DOWN(N, S) ((N) - ((N) % (S)))
@@ -96,6 +97,18 @@ typedef struct
     ULONG Size;
 } NTFSIDENTIFIER, *PNTFSIDENTIFIER;
 
+/* A fixed up file record, as ReadFileRecord() returns it */
+typedef struct _NTFS_MFT_CACHE_ENTRY
+{
+    LIST_ENTRY HashEntry;
+    LIST_ENTRY LruEntry;
+    ULONGLONG MftIndex;
+    UCHAR Record[ANYSIZE_ARRAY];
+} NTFS_MFT_CACHE_ENTRY, *PNTFS_MFT_CACHE_ENTRY;
+
+#define NTFS_MFT_CACHE_ENTRIES  128
+#define NTFS_MFT_CACHE_BUCKETS  32
+
 typedef struct
 {
     NTFSIDENTIFIER Identifier;
@@ -122,6 +135,14 @@ typedef struct
     ULONG Flags;
     ULONG OpenHandleCount;
 
+    /* Recently read file records, most recently used first. Bumping the
+     * generation keeps records read before a write out of the cache */
+    FAST_MUTEX MftCacheLock;
+    PLIST_ENTRY MftCacheBuckets;
+    LIST_ENTRY MftCacheLruList;
+    ULONG MftCacheCount;
+    ULONG MftCacheGeneration;
+
 } DEVICE_EXTENSION, *PDEVICE_EXTENSION, NTFS_VCB, *PNTFS_VCB;
 
 #define VCB_VOLUME_LOCKED       0x0001
@@ -489,13 +510,7 @@ typedef struct
 
 typedef struct _NTFS_ATTR_CONTEXT
 {
-    PUCHAR            CacheRun;
-    ULONGLONG            CacheRunOffset;
-    LONGLONG            CacheRunStartLCN;
-    ULONGLONG            CacheRunLength;
-    LONGLONG            CacheRunLastLCN;
-    ULONGLONG            CacheRunCurrentOffset;
-    LARGE_MCB           DataRunsMCB;
+    LARGE_MCB           DataRunsMCB;    /* Decoded runs, VCN to LCN, sparse runs are holes */
     ULONGLONG           FileMFTIndex;
     ULONGLONG           FileOwnerMFTIndex; /* If attribute list attribute, reference the original file */
     PNTFS_ATTR_RECORD    pRecord;
@@ -1111,6 +1126,21 @@ ReadFileRecord(PDEVICE_EXTENSION Vcb,
                ULONGLONG index,
                PFILE_RECORD_HEADER file);
 
+VOID
+NtfsInitializeMftCache(PDEVICE_EXTENSION Vcb);
+
+VOID
+NtfsUninitializeMftCache(PDEVICE_EXTENSION Vcb);
+
+VOID
+NtfsInvalidateMftCache(PDEVICE_EXTENSION Vcb,
+                       ULONGLONG FirstIndex,
+                       ULONGLONG LastIndex);
+
+BOOLEAN
+NtfsIsMftDataContext(PDEVICE_EXTENSION Vcb,
+                     PNTFS_ATTR_CONTEXT Context);
+
 NTSTATUS
 UpdateIndexEntryFileNameSize(PDEVICE_EXTENSION Vcb,
                              PFILE_RECORD_HEADER MftRecord,
@@ -10,6 +10,8 @@
 
 #include "afd.h"
 
+#include <tdiinfo.h>
+
 NTSTATUS NTAPI
 AfdGetInfo( PDEVICE_OBJECT DeviceObject, PIRP Irp,
             PIO_STACK_LOCATION IrpSp ) {
@@ -98,6 +100,26 @@ AfdGetInfo( PDEVICE_OBJECT DeviceObject, PIRP Irp,
     return UnlockAndMaybeComplete( FCB, Status, Irp, 0 );
 }
 
+static VOID
+AfdSetTransportWindow( PAFD_FCB FCB, ULONG Id, ULONG Size ) {
+    NTSTATUS Status;
+
+    /* Only a connection has a TCP window */
+    if (FCB->Flags & AFD_ENDPOINT_CONNECTIONLESS || !FCB->Connection.Object)
+        return;
+
+    Status = TdiSetInformationEx(FCB->Connection.Object,
+                                 CO_TL_ENTITY,
+                                 TL_INSTANCE,
+                                 INFO_CLASS_PROTOCOL,
+                                 INFO_TYPE_CONNECTION,
+                                 Id,
+                                 &Size,
+                                 sizeof(Size));
+    if (!NT_SUCCESS(Status))
+        AFD_DbgPrint(MIN_TRACE,("Failed to set window %u of the transport (%x)\n", Id, Status));
+}
+
 NTSTATUS NTAPI
 AfdSetInfo( PDEVICE_OBJECT DeviceObject, PIRP Irp,
             PIO_STACK_LOCATION IrpSp ) {
@@ -106,6 +128,7 @@ AfdSetInfo( PDEVICE_OBJECT DeviceObject, PIRP Irp,
     PFILE_OBJECT FileObject = IrpSp->FileObject;
     PAFD_FCB FCB = FileObject->FsContext;
     PCHAR NewBuffer;
+    ULONG BufferSize;
 
     UNREFERENCED_PARAMETER(DeviceObject);
 
@@ -127,18 +150,26 @@ AfdSetInfo( PDEVICE_OBJECT DeviceObject, PIRP Irp,
                 if (FCB->State == SOCKET_STATE_CONNECTED ||
                     FCB->Flags & AFD_ENDPOINT_CONNECTIONLESS)
                 {
+                    /* The transport opens its window as far as asked, our
+                     * own buffer stays small */
+                    if (InfoReq->Information.Ulong > 0 &&
+                        InfoReq->Information.Ulong <= AFD_MAX_WINDOW_SIZE)
+                    {
+                        AfdSetTransportWindow(FCB, TCP_SOCKET_WINDOW, InfoReq->Information.Ulong);
+                    }
+
                     /* FIXME: likely not right, check tcpip.sys for TDI_QUERY_MAX_DATAGRAM_INFO */
-                    if (InfoReq->Information.Ulong > 0 && InfoReq->Information.Ulong < 0xFFFF &&
-                        InfoReq->Information.Ulong != FCB->Recv.Size)
+                    BufferSize = MIN(InfoReq->Information.Ulong, AFD_MAX_RECV_BUFFER_SIZE);
+                    if (BufferSize > 0 && BufferSize != FCB->Recv.Size)
                     {
                         NewBuffer = ExAllocatePoolWithTag(PagedPool,
-                                                          InfoReq->Information.Ulong,
+                                                          BufferSize,
                                                           TAG_AFD_DATA_BUFFER);
 
                         if (NewBuffer)
                         {
-                            if (FCB->Recv.Content > InfoReq->Information.Ulong)
-                                FCB->Recv.Content = InfoReq->Information.Ulong;
+                            if (FCB->Recv.Content > BufferSize)
+                                FCB->Recv.Content = BufferSize;
 
                             if (FCB->Recv.Window)
                             {
@@ -149,7 +180,7 @@ AfdSetInfo( PDEVICE_OBJECT DeviceObject, PIRP Irp,
                                 ExFreePoolWithTag(FCB->Recv.Window, TAG_AFD_DATA_BUFFER);
                             }
 
-                            FCB->Recv.Size = InfoReq->Information.Ulong;
+                            FCB->Recv.Size = BufferSize;
                             FCB->Recv.Window = NewBuffer;
 
                             Status = STATUS_SUCCESS;
@@ -173,9 +204,12 @@ AfdSetInfo( PDEVICE_OBJECT DeviceObject, PIRP Irp,
                 if (FCB->State == SOCKET_STATE_CONNECTED ||
                     FCB->Flags & AFD_ENDPOINT_CONNECTIONLESS)
                 {
-                    if (InfoReq->Information.Ulong > 0 && InfoReq->Information.Ulong < 0xFFFF &&
+                    if (InfoReq->Information.Ulong > 0 &&
+                        InfoReq->Information.Ulong <= AFD_MAX_WINDOW_SIZE &&
                         InfoReq->Information.Ulong != FCB->Send.Size)
                     {
+                        AfdSetTransportWindow(FCB, TCP_SOCKET_SNDBUF, InfoReq->Information.Ulong);
+
                         NewBuffer = ExAllocatePoolWithTag(PagedPool,
                                                           InfoReq->Information.Ulong,
                                                           TAG_AFD_DATA_BUFFER);
@@ -10,18 +10,9 @@
 
 #include "afd.h"
 
-static NTSTATUS SatisfyAccept( PAFD_DEVICE_EXTENSION DeviceExt,
-                               PIRP Irp,
-                               PFILE_OBJECT NewFileObject,
-                               PAFD_TDI_OBJECT_QELT Qelt ) {
-    PAFD_FCB FCB = NewFileObject->FsContext;
+static NTSTATUS TransferConnection( PAFD_FCB FCB, PAFD_TDI_OBJECT_QELT Qelt ) {
     NTSTATUS Status;
 
-    UNREFERENCED_PARAMETER(DeviceExt);
-
-    if( !SocketAcquireStateLock( FCB ) )
-        return LostSocket( Irp );
-
     /* Transfer the connection to the new socket, launch the opening read */
     AFD_DbgPrint(MID_TRACE,("Completing a real accept (FCB %p)\n", FCB));
 
@@ -46,6 +37,23 @@ static NTSTATUS SatisfyAccept( PAFD_DEVICE_EXTENSION DeviceExt,
     if (NT_SUCCESS(Status))
         Status = TdiBuildConnectionInfo(&FCB->ConnectReturnInfo, FCB->RemoteAddress);
 
+    return Status;
+}
+
+static NTSTATUS SatisfyAccept( PAFD_DEVICE_EXTENSION DeviceExt,
+                               PIRP Irp,
+                               PFILE_OBJECT NewFileObject,
+                               PAFD_TDI_OBJECT_QELT Qelt ) {
+    PAFD_FCB FCB = NewFileObject->FsContext;
+    NTSTATUS Status;
+
+    UNREFERENCED_PARAMETER(DeviceExt);
+
+    if( !SocketAcquireStateLock( FCB ) )
+        return LostSocket( Irp );
+
+    Status = TransferConnection( FCB, Qelt );
+
     return UnlockAndMaybeComplete( FCB, Status, Irp, 0 );
 }
 
@@ -86,6 +94,100 @@ static NTSTATUS SatisfyPreAccept( PIRP Irp, PAFD_TDI_OBJECT_QELT Qelt ) {
     return STATUS_SUCCESS;
 }
 
+static NTSTATUS WriteAcceptAddress( PCHAR Buffer,
+                                    ULONG BufferLength,
+                                    PTRANSPORT_ADDRESS Address ) {
+    PTA_ADDRESS TaAddress = &Address->Address[0];
+    INT SockAddrLength = TaAddress->AddressLength + sizeof(TaAddress->AddressType);
+
+    /* Laid out as GetAcceptExSockaddrs expects it: the length, then the sockaddr */
+    if( BufferLength < sizeof(INT) + SockAddrLength )
+        return STATUS_BUFFER_TOO_SMALL;
+
+    RtlCopyMemory( Buffer, &SockAddrLength, sizeof(INT) );
+    RtlCopyMemory( Buffer + sizeof(INT), &TaAddress->AddressType, SockAddrLength );
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS WriteAcceptAddresses( PAFD_FCB ListenFCB,
+                                      PAFD_FCB FCB,
+                                      PAFD_SUPER_ACCEPT_INFO AcceptReq ) {
+    PAFD_MAPBUF Map = (PAFD_MAPBUF)(AcceptReq->BufferArray + AcceptReq->BufferCount);
+    PTRANSPORT_ADDRESS LocalAddress = NULL;
+    PCHAR Buffer;
+    NTSTATUS Status;
+
+    /* The listener may be bound to any address, so ask the connection */
+    Status = TdiQueryLocalAddress( FCB->Connection.Object, &LocalAddress );
+    if( !NT_SUCCESS(Status) ) {
+        AFD_DbgPrint(MIN_TRACE,("Using the listen address (%x)\n", Status));
+        LocalAddress = TaCopyTransportAddress( ListenFCB->LocalAddress );
+        if( !LocalAddress ) return STATUS_NO_MEMORY;
+    }
+
+    Buffer = MmMapLockedPages( Map[0].Mdl, KernelMode );
+    Buffer += AcceptReq->ReceiveDataLength;
+
+    Status = WriteAcceptAddress( Buffer,
+                                 AcceptReq->LocalAddressLength,
+                                 LocalAddress );
+    if( NT_SUCCESS(Status) )
+        Status = WriteAcceptAddress( Buffer + AcceptReq->LocalAddressLength,
+                                     AcceptReq->RemoteAddressLength,
+                                     FCB->RemoteAddress );
+
+    MmUnmapLockedPages( Buffer - AcceptReq->ReceiveDataLength, Map[0].Mdl );
+
+    ExFreePoolWithTag(LocalAddress, TAG_AFD_TRANSPORT_ADDRESS);
+
+    return Status;
+}
+
+static NTSTATUS SatisfySuperAccept( PAFD_FCB ListenFCB,
+                                    PIRP Irp,
+                                    PAFD_TDI_OBJECT_QELT Qelt ) {
+    PIO_STACK_LOCATION IrpSp = IoGetCurrentIrpStackLocation( Irp );
+    PAFD_SUPER_ACCEPT_INFO AcceptReq = GetLockedData( Irp, IrpSp );
+    PFILE_OBJECT NewFileObject = Irp->Tail.Overlay.DriverContext[3];
+    PAFD_FCB FCB = NewFileObject->FsContext;
+    NTSTATUS Status;
+
+    if( !SocketAcquireStateLock( FCB ) ) {
+        UnlockBuffers( AcceptReq->BufferArray, AcceptReq->BufferCount, FALSE );
+        ObDereferenceObject( NewFileObject );
+        return LostSocket( Irp );
+    }
+
+    Status = TransferConnection( FCB, Qelt );
+
+    if( NT_SUCCESS(Status) )
+        Status = WriteAcceptAddresses( ListenFCB, FCB, AcceptReq );
+
+    if( !NT_SUCCESS(Status) || !AcceptReq->ReceiveDataLength ) {
+        UnlockBuffers( AcceptReq->BufferArray, AcceptReq->BufferCount, FALSE );
+        Status = UnlockAndMaybeComplete( FCB, Status, Irp, 0 );
+    } else {
+        /* From here on it is a receive on the new socket that completes
+         * with the first data, the addresses stay behind it */
+        AcceptReq->BufferArray[0].len = AcceptReq->ReceiveDataLength;
+        Irp->Tail.Overlay.DriverContext[2] = NewFileObject;
+        Irp->Tail.Overlay.DriverContext[3] = NULL;
+
+        Status = AfdQueueAcceptReceive( FCB, Irp );
+        SocketStateUnlock( FCB );
+    }
+
+    ObDereferenceObject( NewFileObject );
+
+    return Status;
+}
+
+static VOID FreeQelt( PAFD_TDI_OBJECT_QELT Qelt ) {
+    ExFreePoolWithTag(Qelt->ConnInfo, TAG_AFD_TDI_CONNECTION_INFORMATION);
+    ExFreePoolWithTag(Qelt, TAG_AFD_ACCEPT_QUEUE);
+}
+
 static IO_COMPLETION_ROUTINE ListenComplete;
 static NTSTATUS NTAPI ListenComplete( PDEVICE_OBJECT DeviceObject,
                                       PIRP Irp,
@@ -172,6 +274,22 @@ static NTSTATUS NTAPI ListenComplete( PDEVICE_OBJECT DeviceObject,
         }
     }
 
+    /* An AcceptEx request takes the connection right away */
+    if( !IsListEmpty( &FCB->PendingIrpList[FUNCTION_SUPER_ACCEPT] ) &&
+        !IsListEmpty( &FCB->PendingConnections ) ) {
+        PLIST_ENTRY PendingIrp  =
+            RemoveHeadList( &FCB->PendingIrpList[FUNCTION_SUPER_ACCEPT] );
+        PLIST_ENTRY PendingConn = RemoveHeadList( &FCB->PendingConnections );
+        PAFD_TDI_OBJECT_QELT PendingConnObj =
+            CONTAINING_RECORD( PendingConn, AFD_TDI_OBJECT_QELT, ListEntry );
+
+        SatisfySuperAccept( FCB,
+                            CONTAINING_RECORD( PendingIrp, IRP,
+                                               Tail.Overlay.ListEntry ),
+                            PendingConnObj );
+        FreeQelt( PendingConnObj );
+    }
+
     /* Satisfy a pre-accept request if one is available */
     if( !IsListEmpty( &FCB->PendingIrpList[FUNCTION_PREACCEPT] ) &&
         !IsListEmpty( &FCB->PendingConnections ) ) {
@@ -404,3 +522,101 @@ NTSTATUS AfdAccept( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 
     return UnlockAndMaybeComplete( FCB, STATUS_UNSUCCESSFUL, Irp, 0 );
 }
+
+NTSTATUS AfdSuperAccept( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                         PIO_STACK_LOCATION IrpSp ) {
+    NTSTATUS Status;
+    PFILE_OBJECT FileObject = IrpSp->FileObject;
+    PAFD_FCB FCB = FileObject->FsContext;
+    PAFD_SUPER_ACCEPT_INFO AcceptReq;
+    PFILE_OBJECT NewFileObject;
+    PAFD_FCB NewFCB;
+    KPROCESSOR_MODE LockMode;
+    PLIST_ENTRY PendingConn;
+    PAFD_TDI_OBJECT_QELT PendingConnObj;
+
+    AFD_DbgPrint(MID_TRACE,("Called on %p\n", FCB));
+
+    if( !SocketAcquireStateLock( FCB ) ) return LostSocket( Irp );
+
+    FCB->EventSelectDisabled &= ~AFD_EVENT_ACCEPT;
+
+    if( FCB->State != SOCKET_STATE_LISTENING ) {
+        AFD_DbgPrint(MIN_TRACE,("Called on a socket that isn't listening\n"));
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+    }
+
+    if( IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(*AcceptReq) )
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+
+    if( !(AcceptReq = LockRequest( Irp, IrpSp, FALSE, &LockMode )) )
+        return UnlockAndMaybeComplete( FCB, STATUS_NO_MEMORY, Irp, 0 );
+
+    if( AcceptReq->BufferCount != 1 )
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+
+    AcceptReq->BufferArray = LockBuffers( AcceptReq->BufferArray,
+                                          AcceptReq->BufferCount,
+                                          NULL, NULL,
+                                          TRUE, FALSE, LockMode );
+
+    if( !AcceptReq->BufferArray )
+        return UnlockAndMaybeComplete( FCB, STATUS_ACCESS_VIOLATION, Irp, 0 );
+
+    if( (ULONGLONG)AcceptReq->ReceiveDataLength +
+        AcceptReq->LocalAddressLength +
+        AcceptReq->RemoteAddressLength > AcceptReq->BufferArray[0].len ) {
+        UnlockBuffers( AcceptReq->BufferArray, AcceptReq->BufferCount, FALSE );
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+    }
+
+    Status = ObReferenceObjectByHandle( AcceptReq->AcceptHandle,
+                                        FILE_ALL_ACCESS,
+                                        *IoFileObjectType,
+                                        Irp->RequestorMode,
+                                        (PVOID *)&NewFileObject,
+                                        NULL );
+
+    if( !NT_SUCCESS(Status) ) {
+        UnlockBuffers( AcceptReq->BufferArray, AcceptReq->BufferCount, FALSE );
+        return UnlockAndMaybeComplete( FCB, Status, Irp, 0 );
+    }
+
+    /* The connection goes to another of our sockets that isn't in use yet */
+    NewFCB = NewFileObject->FsContext;
+    if( NewFileObject->DeviceObject != DeviceObject || NewFCB == FCB ||
+        (NewFCB->State != SOCKET_STATE_CREATED &&
+         NewFCB->State != SOCKET_STATE_BOUND) ) {
+        AFD_DbgPrint(MIN_TRACE,("Bad accept socket %p\n", NewFCB));
+        ObDereferenceObject( NewFileObject );
+        UnlockBuffers( AcceptReq->BufferArray, AcceptReq->BufferCount, FALSE );
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+    }
+
+    /* Holds the reference until a connection comes in */
+    Irp->Tail.Overlay.DriverContext[2] = NULL;
+    Irp->Tail.Overlay.DriverContext[3] = NewFileObject;
+
+    if( IsListEmpty( &FCB->PendingConnections ) ) {
+        AFD_DbgPrint(MID_TRACE,("Holding\n"));
+        return LeaveIrpUntilLater( FCB, Irp, FUNCTION_SUPER_ACCEPT );
+    }
+
+    PendingConn = RemoveHeadList( &FCB->PendingConnections );
+    PendingConnObj = CONTAINING_RECORD( PendingConn, AFD_TDI_OBJECT_QELT, ListEntry );
+
+    Status = SatisfySuperAccept( FCB, Irp, PendingConnObj );
+
+    FreeQelt( PendingConnObj );
+
+    if( !IsListEmpty( &FCB->PendingConnections ) )
+    {
+        FCB->PollState |= AFD_EVENT_ACCEPT;
+        FCB->PollStatus[FD_ACCEPT_BIT] = STATUS_SUCCESS;
+        PollReeval( FCB->DeviceExt, FCB->FileObject );
+    } else
+        FCB->PollState &= ~AFD_EVENT_ACCEPT;
+
+    SocketStateUnlock( FCB );
+    return Status;
+}
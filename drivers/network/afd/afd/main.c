@@ -367,6 +367,7 @@ AfdCreateSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 
     InitializeListHead( &FCB->DatagramList );
     InitializeListHead( &FCB->PendingConnections );
+    InitializeListHead( &FCB->PollWaiters );
 
     AFD_DbgPrint(MID_TRACE,("%p: Checking command channel\n", FCB));
 
@@ -497,6 +498,8 @@ AfdCloseSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
     ASSERT(IsListEmpty(&FCB->PendingIrpList[FUNCTION_RECV]));
     ASSERT(IsListEmpty(&FCB->PendingIrpList[FUNCTION_PREACCEPT]));
     ASSERT(IsListEmpty(&FCB->PendingIrpList[FUNCTION_DISCONNECT]));
+    ASSERT(IsListEmpty(&FCB->PendingIrpList[FUNCTION_TRANSMIT]));
+    ASSERT(IsListEmpty(&FCB->PendingIrpList[FUNCTION_SUPER_ACCEPT]));
 
     while (!IsListEmpty(&FCB->PendingConnections))
     {
@@ -704,7 +707,8 @@ RetryDisconnectCompletion(PAFD_FCB FCB)
 {
     ASSERT(FCB->RemoteAddress);
 
-    if (IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]) && !FCB->SendIrp.InFlightRequest && FCB->DisconnectPending)
+    if (IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]) && !FCB->SendIrp.InFlightRequest &&
+        IsListEmpty(&FCB->PendingIrpList[FUNCTION_TRANSMIT]) && FCB->DisconnectPending)
     {
         /* Sends are done; fire off a TDI_DISCONNECT request */
         DoDisconnect(FCB);
@@ -814,7 +818,8 @@ AfdDisconnect(PDEVICE_OBJECT DeviceObject, PIRP Irp,
         Status = QueueUserModeIrp(FCB, Irp, FUNCTION_DISCONNECT);
         if (Status == STATUS_PENDING)
         {
-            if ((IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]) && !FCB->SendIrp.InFlightRequest) ||
+            if ((IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]) && !FCB->SendIrp.InFlightRequest &&
+                 IsListEmpty(&FCB->PendingIrpList[FUNCTION_TRANSMIT])) ||
                 (FCB->DisconnectFlags & TDI_DISCONNECT_ABORT))
             {
                 /* Go ahead and execute the disconnect because we're ready for it */
@@ -1002,6 +1007,12 @@ AfdDispatch(PDEVICE_OBJECT DeviceObject, PIRP Irp)
         case IOCTL_AFD_ACCEPT:
             return AfdAccept( DeviceObject, Irp, IrpSp );
 
+        case IOCTL_AFD_SUPER_ACCEPT:
+            return AfdSuperAccept( DeviceObject, Irp, IrpSp );
+
+        case IOCTL_AFD_TRANSMIT_FILE:
+            return AfdTransmitFile( DeviceObject, Irp, IrpSp );
+
         case IOCTL_AFD_DISCONNECT:
             return AfdDisconnect( DeviceObject, Irp, IrpSp );
 
@@ -1062,6 +1073,9 @@ AfdDispatch(PDEVICE_OBJECT DeviceObject, PIRP Irp)
             DbgPrint("IOCTL_AFD_VALIDATE_GROUP is UNIMPLEMENTED!\n");
             break;
 
+        case IOCTL_AFD_SET_READINESS:
+            return AfdSetReadiness(DeviceObject, Irp, IrpSp);
+
         default:
             Status = STATUS_NOT_SUPPORTED;
             DbgPrint("Unknown IOCTL (0x%x)\n",
@@ -1168,6 +1182,19 @@ CleanupPendingIrp(PAFD_FCB FCB, PIRP Irp, PIO_STACK_LOCATION IrpSp, PAFD_ACTIVE_
             SendReq = GetLockedData(Irp, IrpSp);
             UnlockBuffers(SendReq->BufferArray, SendReq->BufferCount, CheckUnlockExtraBuffers(FCB, IrpSp));
         }
+        else if (IrpSp->Parameters.DeviceIoControl.IoControlCode == IOCTL_AFD_SUPER_ACCEPT)
+        {
+            RecvReq = GetLockedData(Irp, IrpSp);
+            UnlockBuffers(RecvReq->BufferArray, RecvReq->BufferCount, FALSE);
+
+            /* Still waiting for a connection, drop the accept socket */
+            if (Irp->Tail.Overlay.DriverContext[3])
+                ObDereferenceObject(Irp->Tail.Overlay.DriverContext[3]);
+        }
+        else if (IrpSp->Parameters.DeviceIoControl.IoControlCode == IOCTL_AFD_TRANSMIT_FILE)
+        {
+            FreeTransmit(Irp->Tail.Overlay.DriverContext[2]);
+        }
         else if (IrpSp->Parameters.DeviceIoControl.IoControlCode == IOCTL_AFD_SELECT)
         {
             ASSERT(Poll);
@@ -1196,6 +1223,14 @@ AfdCancelHandler(PDEVICE_OBJECT DeviceObject,
 
     IoReleaseCancelSpinLock(Irp->CancelIrql);
 
+    /* An AcceptEx request waiting for data sits on the accepted socket */
+    if (IrpSp->MajorFunction == IRP_MJ_DEVICE_CONTROL &&
+        IrpSp->Parameters.DeviceIoControl.IoControlCode == IOCTL_AFD_SUPER_ACCEPT &&
+        Irp->Tail.Overlay.DriverContext[2])
+    {
+        FCB = ((PFILE_OBJECT)Irp->Tail.Overlay.DriverContext[2])->FsContext;
+    }
+
     if (!SocketAcquireStateLock(FCB))
         return;
 
@@ -1271,6 +1306,21 @@ AfdCancelHandler(PDEVICE_OBJECT DeviceObject,
             Function = FUNCTION_DISCONNECT;
             break;
 
+        case IOCTL_AFD_SUPER_ACCEPT:
+            Function = Irp->Tail.Overlay.DriverContext[2] ? FUNCTION_RECV : FUNCTION_SUPER_ACCEPT;
+            break;
+
+        case IOCTL_AFD_TRANSMIT_FILE:
+            if (FCB->Transmit && FCB->Transmit->Irp == Irp)
+            {
+                /* It's running, the worker completes it */
+                CancelTransmit(FCB);
+                SocketStateUnlock(FCB);
+                return;
+            }
+            Function = FUNCTION_TRANSMIT;
+            break;
+
         default:
             ASSERT(FALSE);
             UnlockAndMaybeComplete(FCB, STATUS_CANCELLED, Irp, 0);
@@ -540,6 +540,28 @@ AfdConnectedSocketReadData(PDEVICE_OBJECT DeviceObject, PIRP Irp,
     return Status;
 }
 
+NTSTATUS AfdQueueAcceptReceive( PAFD_FCB FCB, PIRP Irp ) {
+    NTSTATUS Status;
+
+    /* An AcceptEx request that wants the first data. Its request starts like
+     * a receive request, so it waits and completes like one */
+    Irp->IoStatus.Status = STATUS_PENDING;
+    Irp->IoStatus.Information = 0;
+
+    InsertTailList( &FCB->PendingIrpList[FUNCTION_RECV],
+                    &Irp->Tail.Overlay.ListEntry );
+
+    Status = ReceiveActivity( FCB, Irp );
+
+    if( Status == STATUS_PENDING ) {
+        AFD_DbgPrint(MID_TRACE,("Leaving accept irp\n"));
+        IoMarkIrpPending( Irp );
+        (void)IoSetCancelRoutine(Irp, AfdCancelHandler);
+    }
+
+    return Status;
+}
+
 NTSTATUS NTAPI
 PacketSocketRecvComplete(
         PDEVICE_OBJECT DeviceObject,
@@ -68,6 +68,8 @@ VOID SignalSocket(
     {
         KeCancelTimer( &Poll->Timer );
         RemoveEntryList( &Poll->ListEntry );
+        for( i = 0; i < Poll->WaiterCount; i++ )
+            RemoveEntryList( &Poll->Waiters[i].ListEntry );
         ExFreePoolWithTag(Poll, TAG_AFD_ACTIVE_POLL);
     }
 
@@ -122,40 +124,51 @@ static VOID NTAPI SelectTimeout( PKDPC Dpc,
     AFD_DbgPrint(MID_TRACE,("Timeout\n"));
 }
 
+/* A select puts all of its waiters for a socket on the socket's list in one
+ * go under the lock, so they are next to each other. Returns the entry after
+ * them, which stays valid when the select is signalled. */
+static PLIST_ENTRY SkipPollWaiters( PAFD_FCB FCB, PAFD_POLL_WAITER Waiter ) {
+    PLIST_ENTRY ListEntry = Waiter->ListEntry.Flink;
+
+    while( ListEntry != &FCB->PollWaiters &&
+           CONTAINING_RECORD(ListEntry, AFD_POLL_WAITER, ListEntry)->Poll ==
+           Waiter->Poll )
+        ListEntry = ListEntry->Flink;
+
+    return ListEntry;
+}
+
 VOID KillSelectsForFCB( PAFD_DEVICE_EXTENSION DeviceExt,
                         PFILE_OBJECT FileObject,
                         BOOLEAN OnlyExclusive ) {
     KIRQL OldIrql;
     PLIST_ENTRY ListEntry;
+    PAFD_POLL_WAITER Waiter;
     PAFD_ACTIVE_POLL Poll;
-    PIRP Irp;
     PAFD_POLL_INFO PollReq;
-    PAFD_HANDLE HandleArray;
-    UINT i;
+    PAFD_FCB FCB = FileObject->FsContext;
 
     AFD_DbgPrint(MID_TRACE,("Killing selects that refer to %p\n", FileObject));
 
     KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
 
-    ListEntry = DeviceExt->Polls.Flink;
-    while ( ListEntry != &DeviceExt->Polls ) {
-        Poll = CONTAINING_RECORD(ListEntry, AFD_ACTIVE_POLL, ListEntry);
-        ListEntry = ListEntry->Flink;
-        Irp = Poll->Irp;
-        PollReq = Irp->AssociatedIrp.SystemBuffer;
-        HandleArray = AFD_HANDLES(PollReq);
+    ListEntry = FCB->PollWaiters.Flink;
+    while ( ListEntry != &FCB->PollWaiters ) {
+        Waiter = CONTAINING_RECORD(ListEntry, AFD_POLL_WAITER, ListEntry);
+        Poll = Waiter->Poll;
+        ListEntry = SkipPollWaiters( FCB, Waiter );
 
-        for( i = 0; i < PollReq->HandleCount; i++ ) {
-            AFD_DbgPrint(MAX_TRACE,("Req: %u, This %p\n",
-                                    HandleArray[i].Handle, FileObject));
-            if( (PVOID)HandleArray[i].Handle == FileObject &&
-                (!OnlyExclusive || (OnlyExclusive && Poll->Exclusive)) ) {
-                ZeroEvents( PollReq->Handles, PollReq->HandleCount );
-                SignalSocket( Poll, NULL, PollReq, STATUS_CANCELLED );
-            }
+        if( !OnlyExclusive || Poll->Exclusive ) {
+            PollReq = Poll->Irp->AssociatedIrp.SystemBuffer;
+            ZeroEvents( PollReq->Handles, PollReq->HandleCount );
+            SignalSocket( Poll, NULL, PollReq, STATUS_CANCELLED );
         }
     }
 
+    /* The socket is going away, so nothing is to be reported for it */
+    if( !OnlyExclusive )
+        FCB->ReadinessEvents = 0;
+
     KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
 
     AFD_DbgPrint(MID_TRACE,("Done\n"));
@@ -189,6 +202,21 @@ AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
         return STATUS_NO_MEMORY;
     }
 
+    /* Only our own sockets have an AFD_FCB behind their FsContext */
+    for( i = 0; i < PollReq->HandleCount; i++ ) {
+        if( !AFD_HANDLES(PollReq)[i].Handle ) continue;
+
+        FileObject = (PFILE_OBJECT)AFD_HANDLES(PollReq)[i].Handle;
+        if( FileObject->DeviceObject != DeviceObject ) {
+            AFD_DbgPrint(MIN_TRACE,("Not a socket: %p\n", FileObject));
+            UnlockHandles( AFD_HANDLES(PollReq), PollReq->HandleCount );
+            Irp->IoStatus.Status = STATUS_INVALID_HANDLE;
+            Irp->IoStatus.Information = 0;
+            IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+            return STATUS_INVALID_HANDLE;
+        }
+    }
+
     if( Exclusive ) {
         for( i = 0; i < PollReq->HandleCount; i++ ) {
             if( !AFD_HANDLES(PollReq)[i].Handle ) continue;
@@ -227,15 +255,31 @@ AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
     } else {
 
        PAFD_ACTIVE_POLL Poll = NULL;
+       PAFD_POLL_WAITER Waiter;
 
        Poll = ExAllocatePoolWithTag(NonPagedPool,
-                                    sizeof(AFD_ACTIVE_POLL),
+                                    FIELD_OFFSET(AFD_ACTIVE_POLL, Waiters) +
+                                    PollReq->HandleCount * sizeof(AFD_POLL_WAITER),
                                     TAG_AFD_ACTIVE_POLL);
 
        if (Poll){
           Poll->Irp = Irp;
           Poll->DeviceExt = DeviceExt;
           Poll->Exclusive = Exclusive;
+          Poll->WaiterCount = 0;
+
+          /* Let each socket find us when its state changes */
+          for( i = 0; i < PollReq->HandleCount; i++ ) {
+              if( !AFD_HANDLES(PollReq)[i].Handle ) continue;
+
+              FileObject = (PFILE_OBJECT)AFD_HANDLES(PollReq)[i].Handle;
+              FCB = FileObject->FsContext;
+
+              Waiter = &Poll->Waiters[Poll->WaiterCount++];
+              Waiter->Poll = Poll;
+              Waiter->Index = i;
+              InsertTailList( &FCB->PollWaiters, &Waiter->ListEntry );
+          }
 
           KeInitializeTimerEx( &Poll->Timer, NotificationTimer );
 
@@ -378,10 +422,81 @@ AfdEnumEvents( PDEVICE_OBJECT DeviceObject, PIRP Irp,
     return UnlockAndMaybeComplete( FCB, STATUS_SUCCESS, Irp, 0 );
 }
 
+/* Posts a packet to the socket's completion port once it is ready for
+ * any of the events that were asked for. It is only posted once, the
+ * application asks again after handling it. Called with DeviceExt->Lock
+ * held. */
+static VOID SignalReadiness( PAFD_FCB FCB, PFILE_OBJECT FileObject ) {
+    PIO_COMPLETION_CONTEXT CompletionContext = FileObject->CompletionContext;
+    DWORD Events = FCB->PollState & FCB->ReadinessEvents;
+    NTSTATUS Status;
+
+    if( !Events || !CompletionContext ) return;
+
+    AFD_DbgPrint(MID_TRACE,("Reporting %x for %p\n", Events, FCB));
+
+    FCB->ReadinessEvents = 0;
+
+    Status = IoSetIoCompletion( CompletionContext->Port,
+                                CompletionContext->Key,
+                                FCB->ReadinessContext,
+                                STATUS_SUCCESS,
+                                Events,
+                                FALSE );
+    if( !NT_SUCCESS(Status) )
+        AFD_DbgPrint(MIN_TRACE,("Failed to report readiness (0x%x)\n", Status));
+}
+
+NTSTATUS NTAPI
+AfdSetReadiness( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                 PIO_STACK_LOCATION IrpSp ) {
+    PFILE_OBJECT FileObject = IrpSp->FileObject;
+    PAFD_FCB FCB = FileObject->FsContext;
+    PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
+    PAFD_READINESS_INFO ReadinessInfo;
+    KIRQL OldIrql;
+
+    if( !SocketAcquireStateLock( FCB ) ) {
+        return LostSocket( Irp );
+    }
+
+    if( IrpSp->Parameters.DeviceIoControl.InputBufferLength <
+        sizeof(AFD_READINESS_INFO) ) {
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+    }
+
+    ReadinessInfo = LockRequest( Irp, IrpSp, FALSE, NULL );
+    if( !ReadinessInfo ) {
+        return UnlockAndMaybeComplete( FCB, STATUS_NO_MEMORY, Irp, 0 );
+    }
+
+    AFD_DbgPrint(MID_TRACE,("Called (FCB %p Events %x Context %p)\n",
+                            FCB, ReadinessInfo->Events,
+                            ReadinessInfo->Context));
+
+    /* Readiness is only ever reported to the socket's completion port */
+    if( ReadinessInfo->Events && !FileObject->CompletionContext ) {
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+    }
+
+    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+
+    FCB->ReadinessEvents = ReadinessInfo->Events;
+    FCB->ReadinessContext = ReadinessInfo->Context;
+
+    /* The socket may be ready already */
+    SignalReadiness( FCB, FileObject );
+
+    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+
+    return UnlockAndMaybeComplete( FCB, STATUS_SUCCESS, Irp, 0 );
+}
+
 /* * * NOTE ALWAYS CALLED AT DISPATCH_LEVEL * * */
-static BOOLEAN UpdatePollWithFCB( PAFD_ACTIVE_POLL Poll, PFILE_OBJECT FileObject ) {
+static BOOLEAN UpdatePollWithFCB( PAFD_ACTIVE_POLL Poll ) {
     UINT i;
     PAFD_FCB FCB;
+    PFILE_OBJECT FileObject;
     UINT Signalled = 0;
     PAFD_POLL_INFO PollReq = Poll->Irp->AssociatedIrp.SystemBuffer;
 
@@ -407,6 +522,7 @@ static BOOLEAN UpdatePollWithFCB( PAFD_ACTIVE_POLL Poll, PFILE_OBJECT FileObject
 VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceExt, PFILE_OBJECT FileObject ) {
     PAFD_ACTIVE_POLL Poll = NULL;
     PLIST_ENTRY ThePollEnt = NULL;
+    PAFD_POLL_WAITER Waiter;
     PAFD_FCB FCB;
     KIRQL OldIrql;
     PAFD_POLL_INFO PollReq;
@@ -424,22 +540,27 @@ VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceExt, PFILE_OBJECT FileObject ) {
         return;
     }
 
-    /* Now signal normal select irps */
-    ThePollEnt = DeviceExt->Polls.Flink;
+    /* Now signal normal select irps, only those waiting on this socket */
+    ThePollEnt = FCB->PollWaiters.Flink;
 
-    while( ThePollEnt != &DeviceExt->Polls ) {
-        Poll = CONTAINING_RECORD( ThePollEnt, AFD_ACTIVE_POLL, ListEntry );
+    while( ThePollEnt != &FCB->PollWaiters ) {
+        Waiter = CONTAINING_RECORD( ThePollEnt, AFD_POLL_WAITER, ListEntry );
+        Poll = Waiter->Poll;
         PollReq = Poll->Irp->AssociatedIrp.SystemBuffer;
         AFD_DbgPrint(MID_TRACE,("Checking poll %p\n", Poll));
 
-        if( UpdatePollWithFCB( Poll, FileObject ) ) {
-            ThePollEnt = ThePollEnt->Flink;
+        if( PollReq->Handles[Waiter->Index].Events & FCB->PollState ) {
+            /* Fill in the status of the other sockets too */
+            UpdatePollWithFCB( Poll );
+            ThePollEnt = SkipPollWaiters( FCB, Waiter );
             AFD_DbgPrint(MID_TRACE,("Signalling socket\n"));
             SignalSocket( Poll, NULL, PollReq, STATUS_SUCCESS );
         } else
             ThePollEnt = ThePollEnt->Flink;
     }
 
+    SignalReadiness( FCB, FileObject );
+
     KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
 
     if((FCB->EventSelect) &&
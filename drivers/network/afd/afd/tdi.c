@@ -278,6 +278,71 @@ NTSTATUS TdiQueryMaxDatagramLength(
     return STATUS_SUCCESS;
 }
 
+NTSTATUS TdiQueryLocalAddress(
+    PFILE_OBJECT FileObject,
+    PTRANSPORT_ADDRESS *LocalAddress)
+/*
+ * FUNCTION: Queries the address an address file or a connection is bound to
+ * ARGUMENTS:
+ *     FileObject   = Pointer to file object
+ *     LocalAddress = Address of buffer to place a copy of the address,
+ *                    to be freed with the TAG_AFD_TRANSPORT_ADDRESS tag
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    PMDL Mdl;
+    PTDI_ADDRESS_INFO Buffer;
+    ULONG BufferLength = sizeof(TDI_ADDRESS_INFO) + TDI_ADDRESS_LENGTH_OSI_TSAP;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    Buffer = ExAllocatePoolWithTag(NonPagedPool,
+                                   BufferLength,
+                                   TAG_AFD_DATA_BUFFER);
+
+    if (!Buffer) return STATUS_NO_MEMORY;
+
+    Mdl = IoAllocateMdl(Buffer, BufferLength, FALSE, FALSE, NULL);
+    if (!Mdl)
+    {
+        ExFreePoolWithTag(Buffer, TAG_AFD_DATA_BUFFER);
+        return STATUS_NO_MEMORY;
+    }
+
+    _SEH2_TRY
+    {
+         MmProbeAndLockPages(Mdl, KernelMode, IoModifyAccess);
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+         Status = _SEH2_GetExceptionCode();
+    }
+    _SEH2_END;
+
+    if (!NT_SUCCESS(Status))
+    {
+        AFD_DbgPrint(MIN_TRACE,("Failed to lock pages\n"));
+        IoFreeMdl(Mdl);
+        ExFreePoolWithTag(Buffer, TAG_AFD_DATA_BUFFER);
+        return Status;
+    }
+
+    /* The MDL goes away with the query IRP */
+    Status = TdiQueryInformation(FileObject,
+                                 TDI_QUERY_ADDRESS_INFO,
+                                 Mdl);
+    if (NT_SUCCESS(Status))
+    {
+        *LocalAddress = TaCopyTransportAddress(&Buffer->Address);
+        if (!*LocalAddress)
+            Status = STATUS_NO_MEMORY;
+    }
+
+    ExFreePoolWithTag(Buffer, TAG_AFD_DATA_BUFFER);
+
+    return Status;
+}
+
 NTSTATUS TdiOpenConnectionEndpointFile(
     PUNICODE_STRING DeviceName,
     PHANDLE ConnectionHandle,
@@ -759,6 +824,60 @@ NTSTATUS TdiQueryInformationEx(
                                  OutputLength);                             /* Return information */
 }
 
+NTSTATUS TdiSetInformationEx(
+    PFILE_OBJECT FileObject,
+    ULONG Entity,
+    ULONG Instance,
+    ULONG Class,
+    ULONG Type,
+    ULONG Id,
+    PVOID InputBuffer,
+    ULONG InputLength)
+/*
+ * FUNCTION: Extended set of information
+ * ARGUMENTS:
+ *     FileObject   = Pointer to file object
+ *     Entity       = Entity
+ *     Instance     = Instance
+ *     Class        = Entity class
+ *     Type         = Entity type
+ *     Id           = Entity id
+ *     InputBuffer  = Pointer to buffer with the data to set
+ *     InputLength  = Length of InputBuffer
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    PTCP_REQUEST_SET_INFORMATION_EX SetInfo;
+    ULONG Length = FIELD_OFFSET(TCP_REQUEST_SET_INFORMATION_EX, Buffer) + InputLength;
+    NTSTATUS Status;
+
+    SetInfo = ExAllocatePoolWithTag(NonPagedPool, Length, TAG_AFD_SET_INFO);
+    if (!SetInfo)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    RtlZeroMemory(SetInfo, Length);
+    SetInfo->ID.toi_entity.tei_entity   = Entity;
+    SetInfo->ID.toi_entity.tei_instance = Instance;
+    SetInfo->ID.toi_class = Class;
+    SetInfo->ID.toi_type  = Type;
+    SetInfo->ID.toi_id    = Id;
+    SetInfo->BufferSize   = InputLength;
+    RtlCopyMemory(SetInfo->Buffer, InputBuffer, InputLength);
+
+    Status = TdiQueryDeviceControl(FileObject,                      /* Transport/connection object */
+                                   IOCTL_TCP_SET_INFORMATION_EX,    /* Control code */
+                                   SetInfo,                         /* Input buffer */
+                                   Length,                          /* Input buffer length */
+                                   NULL,                            /* Output buffer */
+                                   0,                               /* Output buffer length */
+                                   NULL);                           /* Return information */
+
+    ExFreePoolWithTag(SetInfo, TAG_AFD_SET_INFO);
+
+    return Status;
+}
+
 NTSTATUS TdiQueryAddress(
     PFILE_OBJECT FileObject,
     PULONG Address)
@@ -973,6 +1092,63 @@ NTSTATUS TdiSend(
     return STATUS_PENDING;
 }
 
+NTSTATUS TdiSendMdl(
+    PIRP *Irp,
+    PFILE_OBJECT TransportObject,
+    USHORT Flags,
+    PMDL Mdl,
+    UINT BufferLength,
+    PIO_COMPLETION_ROUTINE CompletionRoutine,
+    PVOID CompletionContext)
+/*
+ * FUNCTION: Sends data described by a locked MDL owned by the caller
+ * NOTES:
+ *     The completion routine has to clear Irp->MdlAddress before it
+ *     returns, or the I/O manager frees the caller's MDL
+ */
+{
+    PDEVICE_OBJECT DeviceObject;
+
+    ASSERT(*Irp == NULL);
+
+    if (!TransportObject) {
+        AFD_DbgPrint(MIN_TRACE, ("Bad transport object.\n"));
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    DeviceObject = IoGetRelatedDeviceObject(TransportObject);
+    if (!DeviceObject) {
+        AFD_DbgPrint(MIN_TRACE, ("Bad device object.\n"));
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    *Irp = TdiBuildInternalDeviceControlIrp(TDI_SEND,                /* Sub function */
+                                            DeviceObject,            /* Device object */
+                                            TransportObject,         /* File object */
+                                            NULL,                    /* Event */
+                                            NULL);                   /* Status */
+
+    if (!*Irp) {
+        AFD_DbgPrint(MIN_TRACE, ("Insufficient resources.\n"));
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    AFD_DbgPrint(MID_TRACE, ("Sending MDL %p:%u\n", Mdl, BufferLength));
+
+    TdiBuildSend(*Irp,                   /* I/O Request Packet */
+                 DeviceObject,           /* Device object */
+                 TransportObject,        /* File object */
+                 CompletionRoutine,      /* Completion routine */
+                 CompletionContext,      /* Completion context */
+                 Mdl,                    /* Data buffer */
+                 Flags,                  /* Flags */
+                 BufferLength);          /* Length of data */
+
+    TdiCall(*Irp, DeviceObject, NULL, NULL);
+
+    return STATUS_PENDING;
+}
+
 NTSTATUS TdiReceive(
     PIRP *Irp,
     PFILE_OBJECT TransportObject,
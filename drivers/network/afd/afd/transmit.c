@@ -0,0 +1,507 @@
+/*
+ * PROJECT:     ReactOS Ancillary Function Driver
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     TransmitFile, sending file data from the cache without copying it
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ * NOTES:
+ *   A TransmitFile request owns the send side of its connection while it
+ *   runs. It waits until the send window is drained, then hands the head
+ *   buffer, the file and the tail buffer to the transport one piece at a
+ *   time, straight from the locked user pages and from the pages the cache
+ *   manager gives us. Sends made once it's queued wait until it's done,
+ *   and it waits for those made before it.
+ */
+
+#include "afd.h"
+
+/* Largest piece given to the transport at once, unless the caller asks for less */
+#define AFD_TRANSMIT_PACKET_SIZE        0x10000
+#define AFD_TRANSMIT_MAX_PACKET_SIZE    0x40000
+
+static IO_WORKITEM_ROUTINE TransmitWorker;
+
+static VOID SetSource( PAFD_TRANSMIT Transmit, PMDL Mdl, ULONG Length ) {
+    Transmit->SourceMdl = Mdl;
+    Transmit->SourceOffset = 0;
+    Transmit->SourceBytesLeft = Length;
+}
+
+static VOID SetFileSource( PAFD_TRANSMIT Transmit, PMDL Mdl ) {
+    ULONG Length = MIN(MmGetMdlByteCount(Mdl), Transmit->FileMdlBytesLeft);
+
+    Transmit->FileMdlBytesLeft -= Length;
+    SetSource(Transmit, Mdl, Length);
+}
+
+static VOID ReleaseFileData( PAFD_TRANSMIT Transmit ) {
+    PMDL Mdl;
+
+    if( !Transmit->FileMdl ) return;
+
+    if( Transmit->FileMdlCached &&
+        !FsRtlMdlReadComplete( Transmit->FileObject, Transmit->FileMdl ) ) {
+        /* The file system doesn't want them back, unlock them ourselves */
+        while( (Mdl = Transmit->FileMdl) ) {
+            Transmit->FileMdl = Mdl->Next;
+            MmUnlockPages( Mdl );
+            IoFreeMdl( Mdl );
+        }
+    }
+
+    Transmit->FileMdl = NULL;
+    Transmit->FileMdlBytesLeft = 0;
+    Transmit->SourceMdl = NULL;
+}
+
+static NTSTATUS ReadFileData( PAFD_TRANSMIT Transmit ) {
+    PDEVICE_OBJECT DeviceObject;
+    IO_STATUS_BLOCK Iosb;
+    PMDL MdlChain = NULL;
+    KEVENT Event;
+    PIRP Irp;
+    ULONG Length;
+    NTSTATUS Status;
+
+    ASSERT(KeGetCurrentIrql() == PASSIVE_LEVEL);
+    ASSERT(!Transmit->FileMdl);
+
+    Length = (ULONG)MIN(Transmit->FileBytesLeft, Transmit->PacketSize);
+
+    /* Lock the pages in the cache if the file system lets us */
+    if( FsRtlMdlRead( Transmit->FileObject, &Transmit->Offset, Length, 0,
+                      &MdlChain, &Iosb ) ) {
+        Status = Iosb.Status;
+        Transmit->FileMdl = MdlChain;
+        Transmit->FileMdlCached = TRUE;
+    } else {
+        /* Go through the file system instead. This also brings the file into
+         * the cache, so the next pieces are likely to be found there */
+        if( !Transmit->ReadBuffer ) {
+            Transmit->ReadBuffer = ExAllocatePoolWithTag( NonPagedPool,
+                                                          Transmit->PacketSize,
+                                                          TAG_AFD_TRANSMIT );
+            if( !Transmit->ReadBuffer )
+                return STATUS_INSUFFICIENT_RESOURCES;
+
+            Transmit->ReadMdl = IoAllocateMdl( Transmit->ReadBuffer,
+                                               Transmit->PacketSize,
+                                               FALSE,
+                                               FALSE,
+                                               NULL );
+            if( !Transmit->ReadMdl )
+                return STATUS_INSUFFICIENT_RESOURCES;
+
+            MmBuildMdlForNonPagedPool( Transmit->ReadMdl );
+        }
+
+        DeviceObject = IoGetRelatedDeviceObject( Transmit->FileObject );
+
+        KeInitializeEvent( &Event, NotificationEvent, FALSE );
+        Irp = IoBuildSynchronousFsdRequest( IRP_MJ_READ,
+                                            DeviceObject,
+                                            Transmit->ReadBuffer,
+                                            Length,
+                                            &Transmit->Offset,
+                                            &Event,
+                                            &Iosb );
+        if( !Irp )
+            return STATUS_INSUFFICIENT_RESOURCES;
+
+        IoGetNextIrpStackLocation( Irp )->FileObject = Transmit->FileObject;
+
+        Status = IoCallDriver( DeviceObject, Irp );
+        if( Status == STATUS_PENDING ) {
+            KeWaitForSingleObject( &Event, Executive, KernelMode, FALSE, NULL );
+            Status = Iosb.Status;
+        }
+
+        if( NT_SUCCESS(Status) && Iosb.Information ) {
+            Transmit->FileMdl = Transmit->ReadMdl;
+            Transmit->FileMdlCached = FALSE;
+        }
+    }
+
+    if( Status == STATUS_END_OF_FILE ) {
+        Status = STATUS_SUCCESS;
+        Iosb.Information = 0;
+    }
+
+    if( !NT_SUCCESS(Status) ) {
+        AFD_DbgPrint(MIN_TRACE,("Reading the file failed with %x\n", Status));
+        ReleaseFileData( Transmit );
+        return Status;
+    }
+
+    AFD_DbgPrint(MID_TRACE,("Read %u bytes at %I64x (%s)\n",
+                            (UINT)Iosb.Information,
+                            Transmit->Offset.QuadPart,
+                            Transmit->FileMdlCached ? "cached" : "copied"));
+
+    Transmit->FileMdlBytesLeft = (ULONG)Iosb.Information;
+    Transmit->Offset.QuadPart += Iosb.Information;
+    Transmit->FileBytesLeft -= Iosb.Information;
+
+    /* A short read means we got to the end of the file */
+    if( Iosb.Information < Length || !Transmit->FileBytesLeft )
+        Transmit->FileDone = TRUE;
+
+    return STATUS_SUCCESS;
+}
+
+static BOOLEAN NextSource( PAFD_TRANSMIT Transmit ) {
+    PAFD_MAPBUF Map = (PAFD_MAPBUF)(Transmit->Buffers + 2);
+    NTSTATUS Status;
+
+    /* Reading the file may block, so the socket isn't locked here */
+    ASSERT(KeGetCurrentIrql() == PASSIVE_LEVEL);
+
+    /* The cache manager gives us an MDL per view */
+    if( Transmit->FileMdlBytesLeft ) {
+        ASSERT(Transmit->SourceMdl->Next);
+        SetFileSource( Transmit, Transmit->SourceMdl->Next );
+        return TRUE;
+    }
+
+    ReleaseFileData( Transmit );
+
+    if( !Transmit->HeadSent ) {
+        Transmit->HeadSent = TRUE;
+
+        if( Transmit->Buffers[0].len && Map[0].Mdl ) {
+            SetSource( Transmit, Map[0].Mdl, Transmit->Buffers[0].len );
+            return TRUE;
+        }
+    }
+
+    if( !Transmit->FileDone ) {
+        Status = ReadFileData( Transmit );
+        if( !NT_SUCCESS(Status) ) {
+            Transmit->Status = Status;
+            return FALSE;
+        }
+
+        if( Transmit->FileMdl ) {
+            SetFileSource( Transmit, Transmit->FileMdl );
+            return TRUE;
+        }
+    }
+
+    if( !Transmit->TailSent ) {
+        Transmit->TailSent = TRUE;
+
+        if( Transmit->Buffers[1].len && Map[1].Mdl ) {
+            SetSource( Transmit, Map[1].Mdl, Transmit->Buffers[1].len );
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static IO_COMPLETION_ROUTINE TransmitComplete;
+static NTSTATUS NTAPI TransmitComplete
+( PDEVICE_OBJECT DeviceObject,
+  PIRP Irp,
+  PVOID Context ) {
+    PAFD_TRANSMIT Transmit = Context;
+    PAFD_FCB FCB = Transmit->FCB;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    AFD_DbgPrint(MID_TRACE,("Called, status %x, %u bytes sent\n",
+                            Irp->IoStatus.Status,
+                            Irp->IoStatus.Information));
+
+    /* The MDL is ours, don't let the I/O manager free it */
+    Irp->MdlAddress = NULL;
+
+    if( !SocketAcquireStateLock( FCB ) )
+        return STATUS_FILE_CLOSED;
+
+    ASSERT(FCB->SendIrp.InFlightRequest == Irp);
+    FCB->SendIrp.InFlightRequest = NULL;
+
+    if( NT_SUCCESS(Irp->IoStatus.Status) ) {
+        ASSERT(Irp->IoStatus.Information <= Transmit->SourceBytesLeft);
+
+        Transmit->BytesSent += Irp->IoStatus.Information;
+        Transmit->SourceOffset += (ULONG)Irp->IoStatus.Information;
+        Transmit->SourceBytesLeft -= (ULONG)Irp->IoStatus.Information;
+    } else if( NT_SUCCESS(Transmit->Status) ) {
+        Transmit->Status = Irp->IoStatus.Status;
+    }
+
+    /* The next piece may have to be read from disk */
+    IoQueueWorkItem( Transmit->WorkItem, TransmitWorker, DelayedWorkQueue,
+                     Transmit );
+
+    SocketStateUnlock( FCB );
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS SendPiece( PAFD_TRANSMIT Transmit ) {
+    PAFD_FCB FCB = Transmit->FCB;
+    ULONG Length = MIN(Transmit->SourceBytesLeft, Transmit->PacketSize);
+
+    /* The transport only sends from the first MDL it gets, so each piece
+     * goes out through a partial MDL of its source */
+    MmPrepareMdlForReuse( Transmit->SendMdl );
+    IoBuildPartialMdl( Transmit->SourceMdl,
+                       Transmit->SendMdl,
+                       (PCHAR)MmGetMdlVirtualAddress( Transmit->SourceMdl ) +
+                           Transmit->SourceOffset,
+                       Length );
+
+    return TdiSendMdl( &FCB->SendIrp.InFlightRequest,
+                       FCB->Connection.Object,
+                       0,
+                       Transmit->SendMdl,
+                       Length,
+                       TransmitComplete,
+                       Transmit );
+}
+
+static VOID FinishTransmit( PAFD_TRANSMIT Transmit ) {
+    PAFD_FCB FCB = Transmit->FCB;
+    PIRP Irp = Transmit->Irp;
+
+    AFD_DbgPrint(MID_TRACE,("Done with %p, status %x, %u bytes sent\n",
+                            Irp, Transmit->Status, (UINT)Transmit->BytesSent));
+
+    ASSERT(FCB->Transmit == Transmit);
+    ASSERT(!FCB->SendIrp.InFlightRequest);
+
+    RemoveEntryList( &Irp->Tail.Overlay.ListEntry );
+    FCB->Transmit = NULL;
+
+    /* TF_REUSE_SOCKET has to disconnect as well, we just can't reuse the socket yet */
+    if( NT_SUCCESS(Transmit->Status) &&
+        (Transmit->Flags & (AFD_TF_DISCONNECT | AFD_TF_REUSE_SOCKET)) &&
+        !FCB->DisconnectPending && FCB->ConnectCallInfo ) {
+        /* Same as shutdown(SD_SEND) */
+        FCB->DisconnectFlags = TDI_DISCONNECT_RELEASE;
+        FCB->DisconnectTimeout.QuadPart = -1000000;
+        FCB->DisconnectPending = TRUE;
+        FCB->SendClosed = TRUE;
+        FCB->PollState &= ~AFD_EVENT_SEND;
+    }
+
+    /* Let the sends that queued up behind us go */
+    ResumeSends( FCB );
+
+    SocketStateUnlock( FCB );
+
+    Irp->IoStatus.Status = Transmit->Status;
+    Irp->IoStatus.Information = Transmit->BytesSent;
+
+    FreeTransmit( Transmit );
+
+    if( Irp->MdlAddress ) UnlockRequest( Irp, IoGetCurrentIrpStackLocation( Irp ) );
+    (void)IoSetCancelRoutine( Irp, NULL );
+    IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+}
+
+static VOID LostTransmit( PAFD_TRANSMIT Transmit ) {
+    PIRP Irp = Transmit->Irp;
+
+    /* The socket is going away and takes its IRP lists along */
+    FreeTransmit( Transmit );
+    (void)IoSetCancelRoutine( Irp, NULL );
+    LostSocket( Irp );
+}
+
+static VOID NTAPI TransmitWorker( PDEVICE_OBJECT DeviceObject, PVOID Context ) {
+    PAFD_TRANSMIT Transmit = Context;
+    PAFD_FCB FCB = Transmit->FCB;
+    NTSTATUS Status;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    for( ;; ) {
+        if( !SocketAcquireStateLock( FCB ) ) {
+            LostTransmit( Transmit );
+            return;
+        }
+
+        if( !NT_SUCCESS(Transmit->Status) )
+            break;
+
+        if( Transmit->SourceBytesLeft ) {
+            Status = SendPiece( Transmit );
+            if( Status == STATUS_PENDING ) {
+                SocketStateUnlock( FCB );
+                return;
+            }
+
+            Transmit->Status = Status;
+            break;
+        }
+
+        SocketStateUnlock( FCB );
+
+        if( !NextSource( Transmit ) ) {
+            if( !SocketAcquireStateLock( FCB ) ) {
+                LostTransmit( Transmit );
+                return;
+            }
+            break;
+        }
+    }
+
+    FinishTransmit( Transmit );
+}
+
+VOID FreeTransmit( PAFD_TRANSMIT Transmit ) {
+    ReleaseFileData( Transmit );
+
+    if( Transmit->SendMdl ) IoFreeMdl( Transmit->SendMdl );
+    if( Transmit->ReadMdl ) IoFreeMdl( Transmit->ReadMdl );
+    if( Transmit->ReadBuffer )
+        ExFreePoolWithTag( Transmit->ReadBuffer, TAG_AFD_TRANSMIT );
+    if( Transmit->Buffers ) UnlockBuffers( Transmit->Buffers, 2, FALSE );
+    if( Transmit->FileObject ) ObDereferenceObject( Transmit->FileObject );
+    if( Transmit->WorkItem ) IoFreeWorkItem( Transmit->WorkItem );
+
+    ExFreePoolWithTag( Transmit, TAG_AFD_TRANSMIT );
+}
+
+VOID StartNextTransmit( PAFD_FCB FCB ) {
+    PIRP Irp;
+
+    /* Whatever was sent before has to be out of the window first */
+    if( FCB->Transmit ||
+        FCB->Send.BytesUsed ||
+        FCB->SendIrp.InFlightRequest ||
+        IsListEmpty( &FCB->PendingIrpList[FUNCTION_TRANSMIT] ) ||
+        SendsGoFirst( FCB ) )
+        return;
+
+    /* It stays at the head of the list until it's done */
+    Irp = CONTAINING_RECORD(FCB->PendingIrpList[FUNCTION_TRANSMIT].Flink,
+                            IRP, Tail.Overlay.ListEntry);
+    FCB->Transmit = Irp->Tail.Overlay.DriverContext[2];
+
+    AFD_DbgPrint(MID_TRACE,("Starting %p\n", Irp));
+
+    IoQueueWorkItem( FCB->Transmit->WorkItem, TransmitWorker, DelayedWorkQueue,
+                     FCB->Transmit );
+}
+
+VOID CancelTransmit( PAFD_FCB FCB ) {
+    /* The worker completes the request once the piece in flight is back */
+    FCB->Transmit->Status = STATUS_CANCELLED;
+
+    if( FCB->SendIrp.InFlightRequest )
+        IoCancelIrp( FCB->SendIrp.InFlightRequest );
+}
+
+NTSTATUS NTAPI
+AfdTransmitFile( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                 PIO_STACK_LOCATION IrpSp ) {
+    PFILE_OBJECT FileObject = IrpSp->FileObject;
+    PAFD_FCB FCB = FileObject->FsContext;
+    PAFD_TRANSMIT_FILE_INFO TransmitReq;
+    PAFD_TRANSMIT Transmit;
+    KPROCESSOR_MODE LockMode;
+    NTSTATUS Status;
+
+    AFD_DbgPrint(MID_TRACE,("Called on %p\n", FCB));
+
+    if( !SocketAcquireStateLock( FCB ) ) return LostSocket( Irp );
+
+    if( (FCB->Flags & AFD_ENDPOINT_CONNECTIONLESS) ||
+        FCB->State != SOCKET_STATE_CONNECTED ) {
+        AFD_DbgPrint(MIN_TRACE,("Socket not connected\n"));
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_CONNECTION, Irp, 0 );
+    }
+
+    if( FCB->SendClosed ) {
+        AFD_DbgPrint(MIN_TRACE,("No more sends\n"));
+        return UnlockAndMaybeComplete( FCB, STATUS_FILE_CLOSED, Irp, 0 );
+    }
+
+    if( IrpSp->Parameters.DeviceIoControl.InputBufferLength <
+        sizeof(AFD_TRANSMIT_FILE_INFO) )
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+
+    if( !(TransmitReq = LockRequest( Irp, IrpSp, FALSE, &LockMode )) )
+        return UnlockAndMaybeComplete( FCB, STATUS_NO_MEMORY, Irp, 0 );
+
+    if( TransmitReq->Offset.QuadPart < 0 || TransmitReq->WriteLength.QuadPart < 0 )
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+
+    Transmit = ExAllocatePoolWithTag( NonPagedPool, sizeof(AFD_TRANSMIT),
+                                      TAG_AFD_TRANSMIT );
+    if( !Transmit )
+        return UnlockAndMaybeComplete( FCB, STATUS_NO_MEMORY, Irp, 0 );
+
+    RtlZeroMemory( Transmit, sizeof(AFD_TRANSMIT) );
+    Transmit->Irp = Irp;
+    Transmit->FCB = FCB;
+    Transmit->Offset = TransmitReq->Offset;
+    Transmit->Flags = TransmitReq->Flags;
+    Transmit->Status = STATUS_SUCCESS;
+
+    /* No length means the whole file */
+    Transmit->FileBytesLeft = TransmitReq->WriteLength.QuadPart ?
+        TransmitReq->WriteLength.QuadPart : MAXLONGLONG;
+
+    if( !TransmitReq->SendPacketLength )
+        Transmit->PacketSize = AFD_TRANSMIT_PACKET_SIZE;
+    else
+        Transmit->PacketSize = MIN(TransmitReq->SendPacketLength,
+                                   AFD_TRANSMIT_MAX_PACKET_SIZE);
+
+    /* Without a file only the head and tail buffers are sent */
+    if( !TransmitReq->FileHandle ) {
+        Transmit->FileDone = TRUE;
+    } else {
+        Status = ObReferenceObjectByHandle( TransmitReq->FileHandle,
+                                            FILE_READ_DATA,
+                                            *IoFileObjectType,
+                                            Irp->RequestorMode,
+                                            (PVOID*)&Transmit->FileObject,
+                                            NULL );
+        if( !NT_SUCCESS(Status) ) {
+            AFD_DbgPrint(MIN_TRACE,("Bad file handle %p\n", TransmitReq->FileHandle));
+            FreeTransmit( Transmit );
+            return UnlockAndMaybeComplete( FCB, Status, Irp, 0 );
+        }
+    }
+
+    Transmit->WorkItem = IoAllocateWorkItem( DeviceObject );
+
+    /* A piece spans one more page than its size when it isn't aligned */
+    Transmit->SendMdl = IoAllocateMdl( NULL,
+                                       Transmit->PacketSize + PAGE_SIZE,
+                                       FALSE,
+                                       FALSE,
+                                       NULL );
+
+    if( !Transmit->WorkItem || !Transmit->SendMdl ) {
+        FreeTransmit( Transmit );
+        return UnlockAndMaybeComplete( FCB, STATUS_NO_MEMORY, Irp, 0 );
+    }
+
+    Transmit->Buffers = LockBuffers( TransmitReq->Buffers, 2,
+                                     NULL, NULL,
+                                     FALSE, FALSE, LockMode );
+    if( !Transmit->Buffers ) {
+        FreeTransmit( Transmit );
+        return UnlockAndMaybeComplete( FCB, STATUS_ACCESS_VIOLATION, Irp, 0 );
+    }
+
+    Irp->Tail.Overlay.DriverContext[2] = Transmit;
+    Transmit->Sequence = ++FCB->TransmitSequence;
+
+    Status = QueueUserModeIrp( FCB, Irp, FUNCTION_TRANSMIT );
+    if( Status == STATUS_PENDING )
+        StartNextTransmit( FCB );
+
+    SocketStateUnlock( FCB );
+
+    return Status;
+}
+
+/* EOF */
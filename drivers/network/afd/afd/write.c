@@ -10,6 +10,130 @@
 
 #include "afd.h"
 
+/*
+ * A send keeps its place against the TransmitFile requests around it. Its
+ * IRP remembers the sequence of the last request queued before it, and none
+ * of its data goes into the window while that request is still queued. The
+ * window holds the data of the sends at the head of the queue, the one
+ * after them hasn't been copied yet.
+ */
+#define SEND_BARRIER(Irp)   ((ULONG)(ULONG_PTR)(Irp)->Tail.Overlay.DriverContext[2])
+#define SEND_COPIED(Irp)    ((ULONG_PTR)(Irp)->Tail.Overlay.DriverContext[3])
+
+static BOOLEAN SendIsBehindTransmit( PAFD_FCB FCB, PIRP Irp ) {
+    PIRP TransmitIrp;
+    PAFD_TRANSMIT Transmit;
+
+    if( IsListEmpty( &FCB->PendingIrpList[FUNCTION_TRANSMIT] ) )
+        return FALSE;
+
+    /* They are queued in order, so the head one is the oldest */
+    TransmitIrp = CONTAINING_RECORD(FCB->PendingIrpList[FUNCTION_TRANSMIT].Flink,
+                                    IRP, Tail.Overlay.ListEntry);
+    Transmit = TransmitIrp->Tail.Overlay.DriverContext[2];
+
+    return (LONG)(SEND_BARRIER(Irp) - Transmit->Sequence) >= 0;
+}
+
+static PIRP FirstUnsentIrp( PAFD_FCB FCB ) {
+    PIRP Irp;
+
+    if( IsListEmpty( &FCB->PendingIrpList[FUNCTION_SEND] ) )
+        return NULL;
+
+    Irp = CONTAINING_RECORD(FCB->PendingIrpList[FUNCTION_SEND].Flink,
+                            IRP, Tail.Overlay.ListEntry);
+
+    return SEND_COPIED(Irp) ? NULL : Irp;
+}
+
+static BOOLEAN LastSendIsWaiting( PAFD_FCB FCB ) {
+    PIRP Irp;
+
+    if( IsListEmpty( &FCB->PendingIrpList[FUNCTION_SEND] ) )
+        return FALSE;
+
+    Irp = CONTAINING_RECORD(FCB->PendingIrpList[FUNCTION_SEND].Blink,
+                            IRP, Tail.Overlay.ListEntry);
+
+    return !SEND_COPIED(Irp);
+}
+
+BOOLEAN SendsGoFirst( PAFD_FCB FCB ) {
+    PIRP Irp = FirstUnsentIrp( FCB );
+
+    /* A send made before the next TransmitFile request has to be copied first */
+    return Irp && !SendIsBehindTransmit( FCB, Irp );
+}
+
+/* Copy the first waiting send to the window, if its turn came */
+static VOID FillSendWindow( PAFD_FCB FCB ) {
+    PIRP NextIrp;
+    PAFD_SEND_INFO SendReq;
+    PAFD_MAPBUF Map;
+    SIZE_T TotalBytesCopied = 0, SpaceAvail, i;
+    UINT SendLength, BytesCopied;
+
+    NextIrp = FirstUnsentIrp( FCB );
+    if( !NextIrp || SendIsBehindTransmit( FCB, NextIrp ) )
+        return;
+
+    SendReq = GetLockedData(NextIrp, IoGetCurrentIrpStackLocation( NextIrp ));
+    Map = (PAFD_MAPBUF)(SendReq->BufferArray + SendReq->BufferCount);
+
+    AFD_DbgPrint(MID_TRACE,("SendReq @ %p\n", SendReq));
+
+    SpaceAvail = FCB->Send.Size - FCB->Send.BytesUsed;
+
+    /* Count the total transfer size */
+    SendLength = 0;
+    for (i = 0; i < SendReq->BufferCount; i++)
+    {
+        SendLength += SendReq->BufferArray[i].len;
+    }
+
+    /* Make sure we've got the space */
+    if (SendLength > SpaceAvail)
+    {
+       /* Blocking sockets have to wait here */
+       if (SendLength <= FCB->Send.Size && !((SendReq->AfdFlags & AFD_IMMEDIATE) || (FCB->NonBlocking)))
+       {
+           FCB->PollState &= ~AFD_EVENT_SEND;
+           return;
+       }
+
+       /* Check if we can send anything */
+       if (SpaceAvail == 0)
+       {
+           FCB->PollState &= ~AFD_EVENT_SEND;
+
+           /* We should never be non-overlapped and get to this point */
+           ASSERT(SendReq->AfdFlags & AFD_OVERLAPPED);
+           return;
+       }
+    }
+
+    for( i = 0; i < SendReq->BufferCount; i++ ) {
+        BytesCopied = MIN(SendReq->BufferArray[i].len, SpaceAvail);
+
+        Map[i].BufferAddress =
+           MmMapLockedPages( Map[i].Mdl, KernelMode );
+
+        RtlCopyMemory( FCB->Send.Window + FCB->Send.BytesUsed,
+                       Map[i].BufferAddress,
+                       BytesCopied );
+
+        MmUnmapLockedPages( Map[i].BufferAddress, Map[i].Mdl );
+
+        TotalBytesCopied += BytesCopied;
+        SpaceAvail -= BytesCopied;
+        FCB->Send.BytesUsed += BytesCopied;
+    }
+
+    NextIrp->IoStatus.Information = TotalBytesCopied;
+    NextIrp->Tail.Overlay.DriverContext[3] = (PVOID)NextIrp->IoStatus.Information;
+}
+
 static IO_COMPLETION_ROUTINE SendComplete;
 static NTSTATUS NTAPI SendComplete
 ( PDEVICE_OBJECT DeviceObject,
@@ -21,9 +145,8 @@ static NTSTATUS NTAPI SendComplete
     PIRP NextIrp = NULL;
     PIO_STACK_LOCATION NextIrpSp;
     PAFD_SEND_INFO SendReq = NULL;
-    PAFD_MAPBUF Map;
-    SIZE_T TotalBytesCopied = 0, TotalBytesProcessed = 0, SpaceAvail, i;
-    UINT SendLength, BytesCopied;
+    SIZE_T TotalBytesCopied = 0, TotalBytesProcessed = 0;
+    UINT SendLength;
     BOOLEAN HaltSendQueue;
 
     UNREFERENCED_PARAMETER(DeviceObject);
@@ -111,7 +234,6 @@ static NTSTATUS NTAPI SendComplete
         NextIrp = CONTAINING_RECORD(NextIrpEntry, IRP, Tail.Overlay.ListEntry);
         NextIrpSp = IoGetCurrentIrpStackLocation( NextIrp );
         SendReq = GetLockedData(NextIrp, NextIrpSp);
-        Map = (PAFD_MAPBUF)(SendReq->BufferArray + SendReq->BufferCount);
 
         TotalBytesCopied = (ULONG_PTR)NextIrp->Tail.Overlay.DriverContext[3];
         ASSERT(TotalBytesCopied != 0);
@@ -156,71 +278,8 @@ static NTSTATUS NTAPI SendComplete
 
     ASSERT(SendLength == 0);
 
-   if ( !HaltSendQueue && !IsListEmpty( &FCB->PendingIrpList[FUNCTION_SEND] ) ) {
-        NextIrpEntry = FCB->PendingIrpList[FUNCTION_SEND].Flink;
-        NextIrp = CONTAINING_RECORD(NextIrpEntry, IRP, Tail.Overlay.ListEntry);
-        NextIrpSp = IoGetCurrentIrpStackLocation( NextIrp );
-        SendReq = GetLockedData(NextIrp, NextIrpSp);
-        Map = (PAFD_MAPBUF)(SendReq->BufferArray + SendReq->BufferCount);
-
-        AFD_DbgPrint(MID_TRACE,("SendReq @ %p\n", SendReq));
-
-        SpaceAvail = FCB->Send.Size - FCB->Send.BytesUsed;
-        TotalBytesCopied = 0;
-
-        /* Count the total transfer size */
-        SendLength = 0;
-        for (i = 0; i < SendReq->BufferCount; i++)
-        {
-            SendLength += SendReq->BufferArray[i].len;
-        }
-
-        /* Make sure we've got the space */
-        if (SendLength > SpaceAvail)
-        {
-           /* Blocking sockets have to wait here */
-           if (SendLength <= FCB->Send.Size && !((SendReq->AfdFlags & AFD_IMMEDIATE) || (FCB->NonBlocking)))
-           {
-               FCB->PollState &= ~AFD_EVENT_SEND;
-
-               NextIrp = NULL;
-           }
-
-           /* Check if we can send anything */
-           if (SpaceAvail == 0)
-           {
-               FCB->PollState &= ~AFD_EVENT_SEND;
-
-               /* We should never be non-overlapped and get to this point */
-               ASSERT(SendReq->AfdFlags & AFD_OVERLAPPED);
-
-               NextIrp = NULL;
-           }
-        }
-
-        if (NextIrp != NULL)
-        {
-            for( i = 0; i < SendReq->BufferCount; i++ ) {
-                BytesCopied = MIN(SendReq->BufferArray[i].len, SpaceAvail);
-
-                Map[i].BufferAddress =
-                   MmMapLockedPages( Map[i].Mdl, KernelMode );
-
-                RtlCopyMemory( FCB->Send.Window + FCB->Send.BytesUsed,
-                               Map[i].BufferAddress,
-                               BytesCopied );
-
-                MmUnmapLockedPages( Map[i].BufferAddress, Map[i].Mdl );
-
-                TotalBytesCopied += BytesCopied;
-                SpaceAvail -= BytesCopied;
-                FCB->Send.BytesUsed += BytesCopied;
-            }
-
-            NextIrp->IoStatus.Information = TotalBytesCopied;
-            NextIrp->Tail.Overlay.DriverContext[3] = (PVOID)NextIrp->IoStatus.Information;
-        }
-    }
+    if( !HaltSendQueue )
+        FillSendWindow( FCB );
 
     if (FCB->Send.Size - FCB->Send.BytesUsed != 0 && !FCB->SendClosed &&
         IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]))
@@ -248,7 +307,8 @@ static NTSTATUS NTAPI SendComplete
     }
     else
     {
-        /* Nothing is waiting so try to complete a pending disconnect */
+        /* Nothing is waiting so a TransmitFile request can go, or a pending disconnect */
+        StartNextTransmit(FCB);
         RetryDisconnectCompletion(FCB);
     }
 
@@ -257,6 +317,30 @@ static NTSTATUS NTAPI SendComplete
     return STATUS_SUCCESS;
 }
 
+VOID ResumeSends( PAFD_FCB FCB )
+{
+    /* A TransmitFile request is done with the connection, the sends that
+     * waited behind it go before anything else */
+    if (!FCB->SendIrp.InFlightRequest)
+        FillSendWindow(FCB);
+
+    if (FCB->Send.BytesUsed && !FCB->SendIrp.InFlightRequest)
+    {
+        TdiSend(&FCB->SendIrp.InFlightRequest,
+                FCB->Connection.Object,
+                0,
+                FCB->Send.Window,
+                FCB->Send.BytesUsed,
+                SendComplete,
+                FCB);
+    }
+    else
+    {
+        StartNextTransmit(FCB);
+        RetryDisconnectCompletion(FCB);
+    }
+}
+
 static IO_COMPLETION_ROUTINE PacketSocketSendComplete;
 static NTSTATUS NTAPI PacketSocketSendComplete
 ( PDEVICE_OBJECT DeviceObject,
@@ -457,6 +541,25 @@ AfdConnectedSocketWriteData(PDEVICE_OBJECT DeviceObject, PIRP Irp,
         return UnlockAndMaybeComplete( FCB, STATUS_INVALID_CONNECTION, Irp, 0 );
     }
 
+    Irp->Tail.Overlay.DriverContext[2] = (PVOID)(ULONG_PTR)FCB->TransmitSequence;
+    Irp->Tail.Overlay.DriverContext[3] = NULL;
+
+    /* Behind a TransmitFile request or a send that waits, it's as if there was no space */
+    if (!IsListEmpty(&FCB->PendingIrpList[FUNCTION_TRANSMIT]) || LastSendIsWaiting(FCB))
+    {
+        FCB->PollState &= ~AFD_EVENT_SEND;
+
+        /* Non-blocking, non-overlapped sockets can't wait */
+        if (!(SendReq->AfdFlags & AFD_OVERLAPPED) &&
+            ((SendReq->AfdFlags & AFD_IMMEDIATE) || FCB->NonBlocking))
+        {
+            UnlockBuffers( SendReq->BufferArray, SendReq->BufferCount, FALSE );
+            return UnlockAndMaybeComplete( FCB, STATUS_CANT_WAIT, Irp, 0 );
+        }
+
+        return LeaveIrpUntilLater(FCB, Irp, FUNCTION_SEND);
+    }
+
     AFD_DbgPrint(MID_TRACE,("FCB->Send.BytesUsed = %u\n",
                             FCB->Send.BytesUsed));
 
@@ -544,6 +647,7 @@ AfdConnectedSocketWriteData(PDEVICE_OBJECT DeviceObject, PIRP Irp,
     Irp->Tail.Overlay.DriverContext[3] = (PVOID)Irp->IoStatus.Information;
 
     Status = QueueUserModeIrp(FCB, Irp, FUNCTION_SEND);
+
     if (Status == STATUS_PENDING && !FCB->SendIrp.InFlightRequest)
     {
         TdiSend(&FCB->SendIrp.InFlightRequest,
@@ -52,6 +52,13 @@
 #define TAG_AFD_SNMP_ADDRESS_INFO          'asfA'
 #define TAG_AFD_TDI_CONNECTION_INFORMATION 'cTfA'
 #define TAG_AFD_WSA_BUFFER                 'bWfA'
+#define TAG_AFD_SET_INFO                   'isfA'
+#define TAG_AFD_TRANSMIT                   'mtfA'
+
+/* Largest receive window and send buffer a socket can ask the transport for */
+#define AFD_MAX_WINDOW_SIZE                (8 * 1024 * 1024)
+/* FIXME: We should not have to limit the packet receive buffer size like this. workaround for CORE-15804 */
+#define AFD_MAX_RECV_BUFFER_SIZE           0x2000
 
 typedef struct IPADDR_ENTRY {
 	ULONG  Addr;
@@ -88,7 +95,9 @@ typedef struct IPADDR_ENTRY {
 #define FUNCTION_ACCEPT                 4
 #define FUNCTION_DISCONNECT             5
 #define FUNCTION_CLOSE                  6
-#define MAX_FUNCTIONS                   7
+#define FUNCTION_TRANSMIT               7
+#define FUNCTION_SUPER_ACCEPT           8
+#define MAX_FUNCTIONS                   9
 
 #define IN_FLIGHT_REQUESTS              5
 
@@ -113,6 +122,14 @@ typedef struct _AFD_DEVICE_EXTENSION {
     KSPIN_LOCK Lock;
 } AFD_DEVICE_EXTENSION, *PAFD_DEVICE_EXTENSION;
 
+/* Links a pending select to one of the sockets it waits on, so a socket
+ * only has to look at the selects that refer to it */
+typedef struct _AFD_POLL_WAITER {
+    LIST_ENTRY ListEntry;
+    struct _AFD_ACTIVE_POLL *Poll;
+    UINT Index;
+} AFD_POLL_WAITER, *PAFD_POLL_WAITER;
+
 typedef struct _AFD_ACTIVE_POLL {
     LIST_ENTRY ListEntry;
     PIRP Irp;
@@ -121,6 +138,8 @@ typedef struct _AFD_ACTIVE_POLL {
     KTIMER Timer;
     PKEVENT EventObject;
     BOOLEAN Exclusive;
+    UINT WaiterCount;
+    AFD_POLL_WAITER Waiters[1];
 } AFD_ACTIVE_POLL, *PAFD_ACTIVE_POLL;
 
 typedef struct _IRP_LIST {
@@ -151,6 +170,33 @@ typedef struct _AFD_DATA_WINDOW {
     UINT BytesUsed, Size, Content;
 } AFD_DATA_WINDOW, *PAFD_DATA_WINDOW;
 
+/* A TransmitFile request that owns the send side of its connection. It walks
+ * through the head buffer, the file and the tail buffer, sending a piece of
+ * one of them at a time straight from its pages */
+typedef struct _AFD_TRANSMIT {
+    PIRP Irp;
+    struct _AFD_FCB *FCB;
+    PIO_WORKITEM WorkItem;
+    PFILE_OBJECT FileObject;
+    LARGE_INTEGER Offset;
+    LONGLONG FileBytesLeft;
+    ULONG PacketSize;
+    ULONG Flags;
+    PAFD_WSABUF Buffers;          /* Head and tail, locked */
+    PMDL FileMdl;                 /* File data being sent */
+    ULONG FileMdlBytesLeft;       /* Part of it not handed to SourceMdl yet */
+    BOOLEAN FileMdlCached;        /* FileMdl came from the cache manager */
+    PVOID ReadBuffer;             /* Used when the file can't be read from the cache */
+    PMDL ReadMdl;
+    PMDL SourceMdl;               /* What we're sending from */
+    ULONG SourceOffset, SourceBytesLeft;
+    PMDL SendMdl;                 /* Partial MDL of the piece in flight */
+    BOOLEAN HeadSent, FileDone, TailSent;
+    NTSTATUS Status;
+    ULONG_PTR BytesSent;
+    ULONG Sequence;               /* Orders it against the sends around it */
+} AFD_TRANSMIT, *PAFD_TRANSMIT;
+
 typedef struct _AFD_STORED_DATAGRAM {
     LIST_ENTRY ListEntry;
     UINT Len;
@@ -201,6 +247,11 @@ typedef struct _AFD_FCB {
     LIST_ENTRY PendingIrpList[MAX_FUNCTIONS];
     LIST_ENTRY DatagramList;
     LIST_ENTRY PendingConnections;
+    LIST_ENTRY PollWaiters;       /* Protected by DeviceExt->Lock */
+    DWORD ReadinessEvents;        /* Protected by DeviceExt->Lock */
+    PVOID ReadinessContext;
+    PAFD_TRANSMIT Transmit;       /* Head of PendingIrpList[FUNCTION_TRANSMIT] once started */
+    ULONG TransmitSequence;       /* Last one given to a TransmitFile request */
 } AFD_FCB, *PAFD_FCB;
 
 /* bind.c */
@@ -276,6 +327,9 @@ NTSTATUS AfdListenSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 NTSTATUS AfdAccept( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 		    PIO_STACK_LOCATION IrpSp );
 
+NTSTATUS AfdSuperAccept( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+			 PIO_STACK_LOCATION IrpSp );
+
 /* lock.c */
 
 PAFD_WSABUF LockBuffers( PAFD_WSABUF Buf, UINT Count,
@@ -316,9 +370,16 @@ AfdConnectedSocketReadData(PDEVICE_OBJECT DeviceObject, PIRP Irp, PIO_STACK_LOCA
 NTSTATUS NTAPI
 AfdPacketSocketReadData(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 			PIO_STACK_LOCATION IrpSp );
+NTSTATUS AfdQueueAcceptReceive( PAFD_FCB FCB, PIRP Irp );
 
 /* select.c */
 
+/* Exported by the kernel, but not declared in the DDK */
+NTSTATUS NTAPI
+IoSetIoCompletion( PVOID IoCompletion, PVOID KeyContext, PVOID ApcContext,
+		   NTSTATUS IoStatus, ULONG_PTR IoStatusInformation,
+		   BOOLEAN Quota );
+
 NTSTATUS NTAPI
 AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 	   PIO_STACK_LOCATION IrpSp );
@@ -328,6 +389,9 @@ AfdEventSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 NTSTATUS NTAPI
 AfdEnumEvents( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 	       PIO_STACK_LOCATION IrpSp );
+NTSTATUS NTAPI
+AfdSetReadiness( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+		 PIO_STACK_LOCATION IrpSp );
 VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceObject, PFILE_OBJECT FileObject );
 VOID KillSelectsForFCB( PAFD_DEVICE_EXTENSION DeviceExt,
                         PFILE_OBJECT FileObject, BOOLEAN ExclusiveOnly );
@@ -379,6 +443,15 @@ NTSTATUS TdiSend
   PIO_COMPLETION_ROUTINE  CompletionRoutine,
   PVOID CompletionContext);
 
+NTSTATUS TdiSendMdl
+( PIRP *Irp,
+  PFILE_OBJECT ConnectionObject,
+  USHORT Flags,
+  PMDL Mdl,
+  UINT BufferLength,
+  PIO_COMPLETION_ROUTINE  CompletionRoutine,
+  PVOID CompletionContext);
+
 NTSTATUS TdiReceiveDatagram(
     PIRP *Irp,
     PFILE_OBJECT TransportObject,
@@ -402,6 +475,35 @@ NTSTATUS TdiQueryMaxDatagramLength(
         PFILE_OBJECT FileObject,
         PUINT MaxDatagramLength);
 
+NTSTATUS TdiQueryLocalAddress(
+        PFILE_OBJECT FileObject,
+        PTRANSPORT_ADDRESS *LocalAddress);
+
+NTSTATUS TdiSetInformationEx(
+    PFILE_OBJECT FileObject,
+    ULONG Entity,
+    ULONG Instance,
+    ULONG Class,
+    ULONG Type,
+    ULONG Id,
+    PVOID InputBuffer,
+    ULONG InputLength);
+
+/* transmit.c */
+
+/* Exported by the kernel, but not declared in the DDK */
+BOOLEAN NTAPI
+FsRtlMdlRead( PFILE_OBJECT FileObject, PLARGE_INTEGER FileOffset,
+	      ULONG Length, ULONG LockKey, PMDL *MdlChain,
+	      PIO_STATUS_BLOCK IoStatus );
+
+NTSTATUS NTAPI
+AfdTransmitFile( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+		 PIO_STACK_LOCATION IrpSp );
+VOID StartNextTransmit( PAFD_FCB FCB );
+VOID CancelTransmit( PAFD_FCB FCB );
+VOID FreeTransmit( PAFD_TRANSMIT Transmit );
+
 /* write.c */
 
 NTSTATUS NTAPI
@@ -410,5 +512,7 @@ AfdConnectedSocketWriteData(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 NTSTATUS NTAPI
 AfdPacketSocketWriteData(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 			 PIO_STACK_LOCATION IrpSp);
+VOID ResumeSends( PAFD_FCB FCB );
+BOOLEAN SendsGoFirst( PAFD_FCB FCB );
 
 #endif /* _AFD_H */
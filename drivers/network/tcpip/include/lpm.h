@@ -0,0 +1,37 @@
+/*
+ * PROJECT:     ReactOS TCP/IP protocol driver
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Longest prefix match tree for IPv4 routes
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#pragma once
+
+#define LPM_TAG ' MPL'
+
+/*
+ * Path compressed binary trie. Every node holds a prefix, and its children
+ * extend it by at least one bit. Nodes without a value only exist to join
+ * two subtrees, so the tree never has more than twice as many nodes as
+ * prefixes and a lookup visits at most 33 of them.
+ */
+typedef struct _LPM_NODE {
+    struct _LPM_NODE *Child[2];
+    struct _LPM_NODE *Parent;
+    ULONG Prefix;                 /* Host order, bits past the length are clear */
+    UINT PrefixLength;
+    PVOID Value;                  /* NULL for nodes that only join subtrees */
+} LPM_NODE, *PLPM_NODE;
+
+typedef struct _LPM_TREE {
+    PLPM_NODE Root;
+    UINT NodeCount;
+} LPM_TREE, *PLPM_TREE;
+
+VOID LpmInitialize( PLPM_TREE Tree );
+PLPM_NODE LpmInsert( PLPM_TREE Tree, ULONG Prefix, UINT PrefixLength );
+PLPM_NODE LpmFind( PLPM_TREE Tree, ULONG Prefix, UINT PrefixLength );
+PLPM_NODE LpmLookup( PLPM_TREE Tree, ULONG Address );
+VOID LpmRemove( PLPM_TREE Tree, PLPM_NODE Node );
+
+/* EOF */
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <neighbor.h>
+#include <lpm.h>
 
 
 /* Forward Information Base Entry */
@@ -18,6 +19,8 @@ typedef struct _FIB_ENTRY {
     IP_ADDRESS Netmask;           /* Netmask of network */
     PNEIGHBOR_CACHE_ENTRY Router; /* Pointer to NCE of router to use */
     UINT Metric;                  /* Cost of this route */
+    PLPM_NODE Node;               /* Node of the prefix in the route tree */
+    struct _FIB_ENTRY *NextSamePrefix; /* Next route with the same prefix */
 } FIB_ENTRY, *PFIB_ENTRY;
 
 PFIB_ENTRY RouterAddRoute(
@@ -188,6 +188,8 @@ BOOLEAN TCPRemoveIRP( PCONNECTION_ENDPOINT Connection, PIRP Irp );
 
 NTSTATUS TCPSetNoDelay(PCONNECTION_ENDPOINT Connection, BOOLEAN Set);
 
+NTSTATUS TCPSetWindow(PCONNECTION_ENDPOINT Connection, ULONG ReceiveWindow, ULONG SendBuffer);
+
 VOID
 TCPUpdateInterfaceLinkStatus(PIP_INTERFACE IF);
 
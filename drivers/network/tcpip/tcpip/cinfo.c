@@ -24,6 +24,18 @@ TDI_STATUS SetConnectionInfo(TDIObjectID *ID,
             Set = *(BOOLEAN*)Buffer;
             return TCPSetNoDelay(Connection, Set);
         }
+        case TCP_SOCKET_WINDOW:
+        {
+            if (BufferSize < sizeof(ULONG))
+                return TDI_INVALID_PARAMETER;
+            return TCPSetWindow(Connection, *(ULONG*)Buffer, 0);
+        }
+        case TCP_SOCKET_SNDBUF:
+        {
+            if (BufferSize < sizeof(ULONG))
+                return TDI_INVALID_PARAMETER;
+            return TCPSetWindow(Connection, 0, *(ULONG*)Buffer);
+        }
         default:
             DbgPrint("TCPIP: Unknown connection info ID: %u.\n", ID->toi_id);
     }
@@ -1519,6 +1519,14 @@ NTSTATUS DispTdiSetInformationEx(
 
     case TDI_CONNECTION_FILE:
         Request.Handle.ConnectionContext = TranContext->Handle.ConnectionContext;
+        /* Options of a connection can be set on the connection object
+         * itself, no need to look up its address file entity */
+        if (Info->ID.toi_class == INFO_CLASS_PROTOCOL &&
+            Info->ID.toi_type == INFO_TYPE_CONNECTION)
+        {
+            return SetConnectionInfo(&Info->ID, Request.Handle.ConnectionContext,
+                                     &Info->Buffer, Info->BufferSize);
+        }
         break;
 
     case TDI_CONTROL_CHANNEL_FILE:
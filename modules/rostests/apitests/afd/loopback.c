@@ -0,0 +1,339 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1+ (https://spdx.org/licenses/LGPL-2.1+)
+ * PURPOSE:     Throughput and latency of TCP over the loopback interface
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include "precomp.h"
+
+#define CHUNK_SIZE          4096
+#define TOTAL_SIZE          (16 * 1024 * 1024)
+#define QUEUED_SENDS        16
+#define ROUND_TRIPS         2000
+
+typedef struct _RECEIVER_CONTEXT
+{
+    SOCKET Socket;
+    ULONG Expected;
+    ULONG Received;
+    BOOL Corrupted;
+} RECEIVER_CONTEXT, *PRECEIVER_CONTEXT;
+
+static
+void
+FillPattern(PUCHAR Buffer, ULONG Length, ULONG Offset)
+{
+    ULONG i;
+
+    for (i = 0; i < Length; i++)
+        Buffer[i] = (UCHAR)((Offset + i) % 251);
+}
+
+static
+DWORD
+WINAPI
+ReceiverThread(PVOID Parameter)
+{
+    PRECEIVER_CONTEXT Context = Parameter;
+    UCHAR Buffer[CHUNK_SIZE];
+    ULONG i;
+    int Length;
+
+    while (Context->Received < Context->Expected)
+    {
+        Length = recv(Context->Socket, (char *)Buffer, sizeof(Buffer), 0);
+        if (Length <= 0)
+            break;
+
+        for (i = 0; i < (ULONG)Length; i++)
+        {
+            if (Buffer[i] != (UCHAR)((Context->Received + i) % 251))
+                Context->Corrupted = TRUE;
+        }
+
+        Context->Received += Length;
+    }
+
+    return 0;
+}
+
+static
+BOOL
+ConnectPair(SOCKET *Client, SOCKET *Server)
+{
+    SOCKET Listener;
+    struct sockaddr_in addr;
+    int AddrLength = sizeof(addr);
+    int Error;
+
+    *Client = *Server = INVALID_SOCKET;
+
+    Listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ok(Listener != INVALID_SOCKET, "socket failed with %d\n", WSAGetLastError());
+    if (Listener == INVALID_SOCKET)
+        return FALSE;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_port = htons(0);
+
+    Error = bind(Listener, (const struct sockaddr *)&addr, sizeof(addr));
+    ok(Error == 0, "bind failed with %d\n", WSAGetLastError());
+    Error = listen(Listener, 1);
+    ok(Error == 0, "listen failed with %d\n", WSAGetLastError());
+    Error = getsockname(Listener, (struct sockaddr *)&addr, &AddrLength);
+    ok(Error == 0, "getsockname failed with %d\n", WSAGetLastError());
+
+    *Client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ok(*Client != INVALID_SOCKET, "socket failed with %d\n", WSAGetLastError());
+    if (*Client != INVALID_SOCKET)
+    {
+        Error = connect(*Client, (const struct sockaddr *)&addr, sizeof(addr));
+        ok(Error == 0, "connect failed with %d\n", WSAGetLastError());
+        if (Error == 0)
+        {
+            *Server = accept(Listener, NULL, NULL);
+            ok(*Server != INVALID_SOCKET, "accept failed with %d\n", WSAGetLastError());
+        }
+    }
+
+    closesocket(Listener);
+
+    if (*Server == INVALID_SOCKET)
+    {
+        if (*Client != INVALID_SOCKET)
+            closesocket(*Client);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+double
+ElapsedSeconds(PLARGE_INTEGER Start, PLARGE_INTEGER End)
+{
+    LARGE_INTEGER Frequency;
+
+    QueryPerformanceFrequency(&Frequency);
+    return (double)(End->QuadPart - Start->QuadPart) / Frequency.QuadPart;
+}
+
+static
+void
+ReportThroughput(const char *Name, PLARGE_INTEGER Start, PLARGE_INTEGER End, ULONG Bytes)
+{
+    double Seconds = ElapsedSeconds(Start, End);
+
+    trace("%s: %lu bytes in %u ms, %u KB/s\n",
+          Name,
+          Bytes,
+          (unsigned)(Seconds * 1000),
+          Seconds > 0 ? (unsigned)(Bytes / 1024 / Seconds) : 0);
+}
+
+static
+void
+TestThroughput(void)
+{
+    SOCKET Client, Server;
+    RECEIVER_CONTEXT Context;
+    HANDLE Thread;
+    LARGE_INTEGER Start, End;
+    UCHAR Buffer[CHUNK_SIZE];
+    ULONG Sent;
+    int Length;
+
+    if (!ConnectPair(&Client, &Server))
+        return;
+
+    Context.Socket = Server;
+    Context.Expected = TOTAL_SIZE;
+    Context.Received = 0;
+    Context.Corrupted = FALSE;
+
+    Thread = CreateThread(NULL, 0, ReceiverThread, &Context, 0, NULL);
+    ok(Thread != NULL, "CreateThread failed with %lu\n", GetLastError());
+    if (!Thread)
+        goto cleanup;
+
+    QueryPerformanceCounter(&Start);
+
+    for (Sent = 0; Sent < TOTAL_SIZE; Sent += Length)
+    {
+        FillPattern(Buffer, sizeof(Buffer), Sent);
+        Length = send(Client, (const char *)Buffer, sizeof(Buffer), 0);
+        ok(Length > 0, "send failed with %d\n", WSAGetLastError());
+        if (Length <= 0)
+            break;
+    }
+
+    ok(WaitForSingleObject(Thread, 60 * 1000) == WAIT_OBJECT_0, "Receiver timed out\n");
+    QueryPerformanceCounter(&End);
+    CloseHandle(Thread);
+
+    ok(Context.Received == TOTAL_SIZE, "Received %lu bytes\n", Context.Received);
+    ok(!Context.Corrupted, "Received data is corrupted\n");
+
+    ReportThroughput("Blocking sends", &Start, &End, Context.Received);
+
+cleanup:
+    closesocket(Client);
+    closesocket(Server);
+}
+
+static
+void
+TestQueuedThroughput(void)
+{
+    SOCKET Client, Server;
+    RECEIVER_CONTEXT Context;
+    HANDLE Thread;
+    LARGE_INTEGER Start, End;
+    WSAOVERLAPPED Overlapped[QUEUED_SENDS];
+    HANDLE Events[QUEUED_SENDS];
+    WSABUF WsaBuffers[QUEUED_SENDS];
+    PUCHAR Buffer;
+    ULONG Sent, i;
+    DWORD Length, Flags;
+    int Error;
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, QUEUED_SENDS * CHUNK_SIZE);
+    ok(Buffer != NULL, "HeapAlloc failed\n");
+    if (!Buffer)
+        return;
+
+    if (!ConnectPair(&Client, &Server))
+    {
+        HeapFree(GetProcessHeap(), 0, Buffer);
+        return;
+    }
+
+    for (i = 0; i < QUEUED_SENDS; i++)
+    {
+        Events[i] = WSACreateEvent();
+        ok(Events[i] != WSA_INVALID_EVENT, "WSACreateEvent failed with %d\n", WSAGetLastError());
+    }
+
+    Context.Socket = Server;
+    Context.Expected = TOTAL_SIZE;
+    Context.Received = 0;
+    Context.Corrupted = FALSE;
+
+    Thread = CreateThread(NULL, 0, ReceiverThread, &Context, 0, NULL);
+    ok(Thread != NULL, "CreateThread failed with %lu\n", GetLastError());
+    if (!Thread)
+        goto cleanup;
+
+    QueryPerformanceCounter(&Start);
+
+    /* Keep many writes outstanding so AFD has to queue them in tcpip */
+    for (Sent = 0; Sent < TOTAL_SIZE; Sent += QUEUED_SENDS * CHUNK_SIZE)
+    {
+        for (i = 0; i < QUEUED_SENDS; i++)
+        {
+            FillPattern(Buffer + i * CHUNK_SIZE, CHUNK_SIZE, Sent + i * CHUNK_SIZE);
+            WsaBuffers[i].buf = (char *)Buffer + i * CHUNK_SIZE;
+            WsaBuffers[i].len = CHUNK_SIZE;
+
+            memset(&Overlapped[i], 0, sizeof(Overlapped[i]));
+            Overlapped[i].hEvent = Events[i];
+
+            Error = WSASend(Client, &WsaBuffers[i], 1, &Length, 0, &Overlapped[i], NULL);
+            ok(Error == 0 || WSAGetLastError() == WSA_IO_PENDING,
+               "WSASend failed with %d\n", WSAGetLastError());
+        }
+
+        for (i = 0; i < QUEUED_SENDS; i++)
+        {
+            ok(WSAGetOverlappedResult(Client, &Overlapped[i], &Length, TRUE, &Flags),
+               "WSAGetOverlappedResult failed with %d\n", WSAGetLastError());
+            ok(Length == CHUNK_SIZE, "Sent %lu bytes\n", Length);
+        }
+    }
+
+    ok(WaitForSingleObject(Thread, 60 * 1000) == WAIT_OBJECT_0, "Receiver timed out\n");
+    QueryPerformanceCounter(&End);
+    CloseHandle(Thread);
+
+    ok(Context.Received == TOTAL_SIZE, "Received %lu bytes\n", Context.Received);
+    ok(!Context.Corrupted, "Received data is corrupted\n");
+
+    ReportThroughput("Queued sends", &Start, &End, Context.Received);
+
+cleanup:
+    for (i = 0; i < QUEUED_SENDS; i++)
+    {
+        if (Events[i] != WSA_INVALID_EVENT)
+            WSACloseEvent(Events[i]);
+    }
+
+    closesocket(Client);
+    closesocket(Server);
+    HeapFree(GetProcessHeap(), 0, Buffer);
+}
+
+static
+void
+TestLatency(void)
+{
+    SOCKET Client, Server;
+    LARGE_INTEGER Start, End;
+    BOOL NoDelay = TRUE;
+    char Byte = 'x';
+    ULONG i;
+    double Seconds;
+
+    if (!ConnectPair(&Client, &Server))
+        return;
+
+    setsockopt(Client, IPPROTO_TCP, TCP_NODELAY, (const char *)&NoDelay, sizeof(NoDelay));
+    setsockopt(Server, IPPROTO_TCP, TCP_NODELAY, (const char *)&NoDelay, sizeof(NoDelay));
+
+    QueryPerformanceCounter(&Start);
+
+    for (i = 0; i < ROUND_TRIPS; i++)
+    {
+        if (send(Client, &Byte, 1, 0) != 1 ||
+            recv(Server, &Byte, 1, 0) != 1 ||
+            send(Server, &Byte, 1, 0) != 1 ||
+            recv(Client, &Byte, 1, 0) != 1)
+        {
+            ok(0, "Round trip %lu failed with %d\n", i, WSAGetLastError());
+            break;
+        }
+    }
+
+    QueryPerformanceCounter(&End);
+
+    if (i == ROUND_TRIPS)
+    {
+        Seconds = ElapsedSeconds(&Start, &End);
+        trace("Round trips: %lu in %u ms, %u us each\n",
+              i,
+              (unsigned)(Seconds * 1000),
+              (unsigned)(Seconds * 1000000 / i));
+    }
+
+    closesocket(Client);
+    closesocket(Server);
+}
+
+START_TEST(loopback)
+{
+    WSADATA WsaData;
+    int Error;
+
+    Error = WSAStartup(MAKEWORD(2, 2), &WsaData);
+    ok(Error == 0, "WSAStartup failed with %d\n", Error);
+    if (Error)
+        return;
+
+    TestThroughput();
+    TestQueuedThroughput();
+    TestLatency();
+
+    WSACleanup();
+}
@@ -0,0 +1,556 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1+ (https://spdx.org/licenses/LGPL-2.1+)
+ * PURPOSE:     Readiness notification with many idle sockets
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include "precomp.h"
+
+#define IDLE_SOCKETS        10000
+#define ACTIVE_SOCKETS      4
+#define PENDING_SELECTS     16
+#define ROUND_TRIPS         2000
+#define READINESS_KEY       0x1234
+
+typedef struct _PENDING_SELECT
+{
+    HANDLE Event;
+    IO_STATUS_BLOCK IoStatus;
+    PAFD_POLL_INFO PollInfo;
+    ULONG PollInfoSize;
+} PENDING_SELECT, *PPENDING_SELECT;
+
+static
+SOCKET
+CreateBoundSocket(struct sockaddr_in *Address)
+{
+    SOCKET Socket;
+    int AddrLength = sizeof(*Address);
+
+    Socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (Socket == INVALID_SOCKET)
+        return INVALID_SOCKET;
+
+    memset(Address, 0, sizeof(*Address));
+    Address->sin_family = AF_INET;
+    Address->sin_addr.s_addr = inet_addr("127.0.0.1");
+    Address->sin_port = htons(0);
+
+    if (bind(Socket, (const struct sockaddr *)Address, sizeof(*Address)) != 0 ||
+        getsockname(Socket, (struct sockaddr *)Address, &AddrLength) != 0)
+    {
+        closesocket(Socket);
+        return INVALID_SOCKET;
+    }
+
+    return Socket;
+}
+
+static
+double
+ElapsedSeconds(PLARGE_INTEGER Start, PLARGE_INTEGER End)
+{
+    LARGE_INTEGER Frequency;
+
+    QueryPerformanceFrequency(&Frequency);
+    return (double)(End->QuadPart - Start->QuadPart) / Frequency.QuadPart;
+}
+
+static
+void
+ReportRoundTrips(const char *Name, PLARGE_INTEGER Start, PLARGE_INTEGER End, ULONG Count)
+{
+    double Seconds = ElapsedSeconds(Start, End);
+
+    trace("%s: %lu in %u ms, %u us each\n",
+          Name,
+          Count,
+          (unsigned)(Seconds * 1000),
+          Count ? (unsigned)(Seconds * 1000000 / Count) : 0);
+}
+
+static
+BOOL
+StartSelect(PPENDING_SELECT Select, SOCKET *Sockets, ULONG Count, ULONG Events)
+{
+    NTSTATUS Status;
+    ULONG i;
+
+    Select->PollInfoSize = FIELD_OFFSET(AFD_POLL_INFO, Handles) + Count * sizeof(AFD_HANDLE);
+    Select->PollInfo = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, Select->PollInfoSize);
+    if (!Select->PollInfo)
+        return FALSE;
+
+    Status = NtCreateEvent(&Select->Event, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE);
+    if (!NT_SUCCESS(Status))
+    {
+        HeapFree(GetProcessHeap(), 0, Select->PollInfo);
+        return FALSE;
+    }
+
+    /* A minute, relative */
+    Select->PollInfo->Timeout.QuadPart = -60LL * 10000000;
+    Select->PollInfo->HandleCount = Count;
+    Select->PollInfo->Exclusive = FALSE;
+    for (i = 0; i < Count; i++)
+    {
+        Select->PollInfo->Handles[i].Handle = Sockets[i];
+        Select->PollInfo->Handles[i].Events = Events;
+    }
+
+    Status = NtDeviceIoControlFile((HANDLE)Sockets[0],
+                                   Select->Event,
+                                   NULL,
+                                   NULL,
+                                   &Select->IoStatus,
+                                   IOCTL_AFD_SELECT,
+                                   Select->PollInfo,
+                                   Select->PollInfoSize,
+                                   Select->PollInfo,
+                                   Select->PollInfoSize);
+    ok(Status == STATUS_PENDING, "Select returned 0x%lx\n", Status);
+    if (!NT_SUCCESS(Status))
+    {
+        NtClose(Select->Event);
+        HeapFree(GetProcessHeap(), 0, Select->PollInfo);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+NTSTATUS
+WaitSelect(PPENDING_SELECT Select)
+{
+    LARGE_INTEGER Timeout;
+    NTSTATUS Status;
+
+    Timeout.QuadPart = -10LL * 10000000;
+    Status = NtWaitForSingleObject(Select->Event, FALSE, &Timeout);
+    ok(Status == STATUS_SUCCESS, "Wait for select returned 0x%lx\n", Status);
+    if (Status == STATUS_SUCCESS)
+        Status = Select->IoStatus.Status;
+
+    return Status;
+}
+
+static
+void
+FreeSelect(PPENDING_SELECT Select)
+{
+    NtClose(Select->Event);
+    HeapFree(GetProcessHeap(), 0, Select->PollInfo);
+}
+
+static
+BOOL
+RoundTrip(SOCKET Sender, SOCKET Receiver, const struct sockaddr_in *Address)
+{
+    struct timeval Timeout = { 5, 0 };
+    fd_set ReadSet;
+    char Byte = 'x';
+
+    if (sendto(Sender, &Byte, 1, 0, (const struct sockaddr *)Address, sizeof(*Address)) != 1)
+        return FALSE;
+
+    FD_ZERO(&ReadSet);
+    FD_SET(Receiver, &ReadSet);
+    if (select(0, &ReadSet, NULL, NULL, &Timeout) != 1)
+        return FALSE;
+
+    return recv(Receiver, &Byte, 1, 0) == 1;
+}
+
+static
+void
+TestSelect(SOCKET *Idle, ULONG IdleCount)
+{
+    SOCKET Active[ACTIVE_SOCKETS], Sender;
+    struct sockaddr_in Address[ACTIVE_SOCKETS], SenderAddress;
+    PENDING_SELECT Selects[PENDING_SELECTS], Mixed;
+    LARGE_INTEGER Start, End, NoWait;
+    SOCKET *Sockets;
+    NTSTATUS Status;
+    ULONG i, Started = 0;
+    char Byte = 'x';
+
+    Sender = CreateBoundSocket(&SenderAddress);
+    ok(Sender != INVALID_SOCKET, "Failed to create sender with %d\n", WSAGetLastError());
+    if (Sender == INVALID_SOCKET)
+        return;
+
+    for (i = 0; i < ACTIVE_SOCKETS; i++)
+    {
+        Active[i] = CreateBoundSocket(&Address[i]);
+        ok(Active[i] != INVALID_SOCKET, "Failed to create socket with %d\n", WSAGetLastError());
+    }
+
+    /* Without anything waiting on the idle sockets */
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < ROUND_TRIPS; i++)
+    {
+        if (!RoundTrip(Sender, Active[i % ACTIVE_SOCKETS], &Address[i % ACTIVE_SOCKETS]))
+            break;
+    }
+    QueryPerformanceCounter(&End);
+    ok(i == ROUND_TRIPS, "Round trip %lu failed with %d\n", i, WSAGetLastError());
+    ReportRoundTrips("Round trips without pending selects", &Start, &End, i);
+
+    /* Every state change used to look at all of these */
+    for (i = 0; i < PENDING_SELECTS; i++)
+    {
+        if (!StartSelect(&Selects[i], Idle, IdleCount, AFD_EVENT_RECEIVE))
+            break;
+        Started++;
+    }
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < ROUND_TRIPS; i++)
+    {
+        if (!RoundTrip(Sender, Active[i % ACTIVE_SOCKETS], &Address[i % ACTIVE_SOCKETS]))
+            break;
+    }
+    QueryPerformanceCounter(&End);
+    ok(i == ROUND_TRIPS, "Round trip %lu failed with %d\n", i, WSAGetLastError());
+    trace("%lu selects pending on %lu idle sockets\n", Started, IdleCount);
+    ReportRoundTrips("Round trips with pending selects", &Start, &End, i);
+
+    /* None of the idle sockets became ready */
+    NoWait.QuadPart = 0;
+    for (i = 0; i < Started; i++)
+    {
+        Status = NtWaitForSingleObject(Selects[i].Event, FALSE, &NoWait);
+        ok(Status == STATUS_TIMEOUT, "Select %lu completed with 0x%lx\n", i, Selects[i].IoStatus.Status);
+    }
+
+    /* A select over idle and active sockets completes for the active one */
+    Sockets = HeapAlloc(GetProcessHeap(), 0, (IdleCount + 1) * sizeof(SOCKET));
+    ok(Sockets != NULL, "HeapAlloc failed\n");
+    if (Sockets)
+    {
+        memcpy(Sockets, Idle, IdleCount * sizeof(SOCKET));
+        Sockets[IdleCount] = Active[0];
+
+        if (StartSelect(&Mixed, Sockets, IdleCount + 1, AFD_EVENT_RECEIVE))
+        {
+            sendto(Sender, &Byte, 1, 0, (const struct sockaddr *)&Address[0], sizeof(Address[0]));
+
+            Status = WaitSelect(&Mixed);
+            ok(Status == STATUS_SUCCESS, "Select returned 0x%lx\n", Status);
+            if (Status == STATUS_SUCCESS)
+            {
+                ok(Mixed.IoStatus.Information == Mixed.PollInfoSize,
+                   "Information is %Iu\n", Mixed.IoStatus.Information);
+                ok(Mixed.PollInfo->Handles[IdleCount].Events & AFD_EVENT_RECEIVE,
+                   "Events are 0x%lx\n", Mixed.PollInfo->Handles[IdleCount].Events);
+                ok(Mixed.PollInfo->Handles[0].Events == 0,
+                   "Events are 0x%lx\n", Mixed.PollInfo->Handles[0].Events);
+            }
+            FreeSelect(&Mixed);
+
+            recv(Active[0], &Byte, 1, 0);
+        }
+
+        HeapFree(GetProcessHeap(), 0, Sockets);
+    }
+
+    /* Closing the first idle socket cancels the selects waiting on it */
+    closesocket(Idle[0]);
+    Idle[0] = INVALID_SOCKET;
+
+    for (i = 0; i < Started; i++)
+    {
+        Status = WaitSelect(&Selects[i]);
+        ok(Status == STATUS_CANCELLED, "Select %lu returned 0x%lx\n", i, Status);
+        FreeSelect(&Selects[i]);
+    }
+
+    for (i = 0; i < ACTIVE_SOCKETS; i++)
+    {
+        if (Active[i] != INVALID_SOCKET)
+            closesocket(Active[i]);
+    }
+
+    closesocket(Sender);
+}
+
+static
+NTSTATUS
+SetReadiness(SOCKET Socket, ULONG Events, PVOID Context)
+{
+    AFD_READINESS_INFO ReadinessInfo;
+    IO_STATUS_BLOCK IoStatus;
+    NTSTATUS Status;
+    HANDLE Event;
+
+    Status = NtCreateEvent(&Event, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    ReadinessInfo.Events = Events;
+    ReadinessInfo.Context = Context;
+
+    Status = NtDeviceIoControlFile((HANDLE)Socket,
+                                   Event,
+                                   NULL,
+                                   NULL,
+                                   &IoStatus,
+                                   IOCTL_AFD_SET_READINESS,
+                                   &ReadinessInfo,
+                                   sizeof(ReadinessInfo),
+                                   NULL,
+                                   0);
+    if (Status == STATUS_PENDING)
+    {
+        NtWaitForSingleObject(Event, FALSE, NULL);
+        Status = IoStatus.Status;
+    }
+
+    NtClose(Event);
+
+    return Status;
+}
+
+static
+BOOL
+WaitReadiness(HANDLE Port, DWORD Timeout, PVOID Context, PULONG Events)
+{
+    LPOVERLAPPED Overlapped;
+    ULONG_PTR Key;
+    DWORD Bytes;
+
+    /* Requests on the socket itself complete to the port as well */
+    for (;;)
+    {
+        if (!GetQueuedCompletionStatus(Port, &Bytes, &Key, &Overlapped, Timeout))
+            return FALSE;
+
+        if (Overlapped == NULL)
+            continue;
+
+        ok(Key == READINESS_KEY, "Key is %Iu\n", Key);
+        ok(Overlapped == Context, "Context is %p\n", Overlapped);
+        *Events = Bytes;
+        return TRUE;
+    }
+}
+
+static
+void
+TestReadiness(void)
+{
+    SOCKET Receiver, Sender;
+    struct sockaddr_in Address, SenderAddress;
+    LARGE_INTEGER Start, End;
+    HANDLE Port;
+    NTSTATUS Status;
+    ULONG Events, i;
+    char Byte = 'x';
+    int Context;
+
+    Receiver = CreateBoundSocket(&Address);
+    Sender = CreateBoundSocket(&SenderAddress);
+    ok(Receiver != INVALID_SOCKET && Sender != INVALID_SOCKET,
+       "Failed to create sockets with %d\n", WSAGetLastError());
+    if (Receiver == INVALID_SOCKET || Sender == INVALID_SOCKET)
+        goto cleanup;
+
+    /* Readiness goes to the completion port, there has to be one */
+    Status = SetReadiness(Receiver, AFD_EVENT_RECEIVE, &Context);
+    ok(Status == STATUS_INVALID_PARAMETER, "SetReadiness returned 0x%lx\n", Status);
+
+    Port = CreateIoCompletionPort((HANDLE)Receiver, NULL, READINESS_KEY, 0);
+    ok(Port != NULL, "CreateIoCompletionPort failed with %lu\n", GetLastError());
+    if (!Port)
+        goto cleanup;
+
+    Status = SetReadiness(Receiver, AFD_EVENT_RECEIVE, &Context);
+    ok(Status == STATUS_SUCCESS, "SetReadiness returned 0x%lx\n", Status);
+    ok(!WaitReadiness(Port, 0, &Context, &Events), "Idle socket reported 0x%lx\n", Events);
+
+    sendto(Sender, &Byte, 1, 0, (const struct sockaddr *)&Address, sizeof(Address));
+    ok(WaitReadiness(Port, 5000, &Context, &Events), "No readiness reported\n");
+    ok(Events & AFD_EVENT_RECEIVE, "Events are 0x%lx\n", Events);
+
+    /* Reported once, until it is asked for again */
+    sendto(Sender, &Byte, 1, 0, (const struct sockaddr *)&Address, sizeof(Address));
+    ok(!WaitReadiness(Port, 200, &Context, &Events), "Readiness reported again with 0x%lx\n", Events);
+
+    /* Still readable, so this reports right away */
+    Status = SetReadiness(Receiver, AFD_EVENT_RECEIVE, &Context);
+    ok(Status == STATUS_SUCCESS, "SetReadiness returned 0x%lx\n", Status);
+    ok(WaitReadiness(Port, 0, &Context, &Events), "No readiness reported\n");
+
+    recv(Receiver, &Byte, 1, 0);
+    recv(Receiver, &Byte, 1, 0);
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < ROUND_TRIPS; i++)
+    {
+        if (!NT_SUCCESS(SetReadiness(Receiver, AFD_EVENT_RECEIVE, &Context)) ||
+            sendto(Sender, &Byte, 1, 0, (const struct sockaddr *)&Address, sizeof(Address)) != 1 ||
+            !WaitReadiness(Port, 5000, &Context, &Events) ||
+            recv(Receiver, &Byte, 1, 0) != 1)
+        {
+            break;
+        }
+    }
+    QueryPerformanceCounter(&End);
+    ok(i == ROUND_TRIPS, "Round trip %lu failed\n", i);
+    ReportRoundTrips("Round trips through the completion port", &Start, &End, i);
+
+    CloseHandle(Port);
+
+cleanup:
+    if (Receiver != INVALID_SOCKET)
+        closesocket(Receiver);
+    if (Sender != INVALID_SOCKET)
+        closesocket(Sender);
+}
+
+/* Selects on Socket and Other together, and returns how the select ended */
+static
+NTSTATUS
+SelectWith(SOCKET Socket, HANDLE Other)
+{
+    PENDING_SELECT Select;
+    NTSTATUS Status;
+
+    Select.PollInfoSize = FIELD_OFFSET(AFD_POLL_INFO, Handles) + 2 * sizeof(AFD_HANDLE);
+    Select.PollInfo = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, Select.PollInfoSize);
+    if (!Select.PollInfo)
+        return STATUS_NO_MEMORY;
+
+    Status = NtCreateEvent(&Select.Event, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE);
+    if (!NT_SUCCESS(Status))
+    {
+        HeapFree(GetProcessHeap(), 0, Select.PollInfo);
+        return Status;
+    }
+
+    /* Don't wait, the select must not get as far as pending */
+    Select.PollInfo->Timeout.QuadPart = 0;
+    Select.PollInfo->HandleCount = 2;
+    Select.PollInfo->Exclusive = FALSE;
+    Select.PollInfo->Handles[0].Handle = Socket;
+    Select.PollInfo->Handles[0].Events = AFD_EVENT_RECEIVE;
+    Select.PollInfo->Handles[1].Handle = (SOCKET)Other;
+    Select.PollInfo->Handles[1].Events = AFD_EVENT_RECEIVE;
+
+    Status = NtDeviceIoControlFile((HANDLE)Socket,
+                                   Select.Event,
+                                   NULL,
+                                   NULL,
+                                   &Select.IoStatus,
+                                   IOCTL_AFD_SELECT,
+                                   Select.PollInfo,
+                                   Select.PollInfoSize,
+                                   Select.PollInfo,
+                                   Select.PollInfoSize);
+    if (Status == STATUS_PENDING)
+    {
+        NtWaitForSingleObject(Select.Event, FALSE, NULL);
+        Status = Select.IoStatus.Status;
+    }
+
+    FreeSelect(&Select);
+    return Status;
+}
+
+static
+void
+TestNonSocket(void)
+{
+    struct sockaddr_in Address;
+    WCHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+    SOCKET Socket;
+    HANDLE File, Event;
+    NTSTATUS Status;
+
+    Socket = CreateBoundSocket(&Address);
+    ok(Socket != INVALID_SOCKET, "Failed to create socket, error %d\n", WSAGetLastError());
+    if (Socket == INVALID_SOCKET)
+        return;
+
+    /* AFD must not take the FsContext of another file system for a socket */
+    if (GetTempPathW(_countof(TempPath), TempPath) &&
+        GetTempFileNameW(TempPath, L"afd", 0, FileName))
+    {
+        File = CreateFileW(FileName, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                           OPEN_EXISTING, FILE_FLAG_DELETE_ON_CLOSE, NULL);
+        ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+        if (File != INVALID_HANDLE_VALUE)
+        {
+            Status = SelectWith(Socket, File);
+            ok(Status == STATUS_INVALID_HANDLE, "Select with a file returned 0x%lx\n", Status);
+            CloseHandle(File);
+        }
+    }
+    else
+    {
+        skip("No temporary file\n");
+    }
+
+    /* Nor anything that isn't a file object */
+    Status = NtCreateEvent(&Event, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE);
+    ok(NT_SUCCESS(Status), "NtCreateEvent returned 0x%lx\n", Status);
+    if (NT_SUCCESS(Status))
+    {
+        Status = SelectWith(Socket, Event);
+        ok(!NT_SUCCESS(Status), "Select with an event returned 0x%lx\n", Status);
+        NtClose(Event);
+    }
+
+    closesocket(Socket);
+}
+
+START_TEST(select)
+{
+    struct sockaddr_in Address;
+    WSADATA WsaData;
+    SOCKET *Idle;
+    ULONG IdleCount, i;
+    int Error;
+
+    Error = WSAStartup(MAKEWORD(2, 2), &WsaData);
+    ok(Error == 0, "WSAStartup failed with %d\n", Error);
+    if (Error)
+        return;
+
+    Idle = HeapAlloc(GetProcessHeap(), 0, IDLE_SOCKETS * sizeof(SOCKET));
+    ok(Idle != NULL, "HeapAlloc failed\n");
+    if (!Idle)
+    {
+        WSACleanup();
+        return;
+    }
+
+    for (IdleCount = 0; IdleCount < IDLE_SOCKETS; IdleCount++)
+    {
+        Idle[IdleCount] = CreateBoundSocket(&Address);
+        if (Idle[IdleCount] == INVALID_SOCKET)
+            break;
+    }
+
+    if (IdleCount < IDLE_SOCKETS)
+        trace("Only created %lu idle sockets, error %d\n", IdleCount, WSAGetLastError());
+
+    if (IdleCount)
+        TestSelect(Idle, IdleCount);
+    else
+        skip("No idle sockets\n");
+
+    TestReadiness();
+    TestNonSocket();
+
+    for (i = 0; i < IdleCount; i++)
+    {
+        if (Idle[i] != INVALID_SOCKET)
+            closesocket(Idle[i]);
+    }
+
+    HeapFree(GetProcessHeap(), 0, Idle);
+    WSACleanup();
+}
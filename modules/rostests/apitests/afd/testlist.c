@@ -1,12 +1,18 @@
 #define STANDALONE
 #include <apitest.h>
 
+extern void func_loopback(void);
+extern void func_select(void);
 extern void func_send(void);
+extern void func_transmitfile(void);
 extern void func_windowsize(void);
 
 const struct test winetest_testlist[] =
 {
+    { "loopback", func_loopback },
+    { "select", func_select },
     { "send", func_send },
+    { "transmitfile", func_transmitfile },
     { "windowsize", func_windowsize },
     { 0, 0 }
 };
@@ -0,0 +1,551 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1+ (https://spdx.org/licenses/LGPL-2.1+)
+ * PURPOSE:     TransmitFile and AcceptEx, and serving a file compared to a read/send loop
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include "precomp.h"
+#include <mswsock.h>
+
+#define CHUNK_SIZE          0x10000
+#define FILE_SIZE           (32 * 1024 * 1024)
+#define ACCEPT_DATA_SIZE    64
+#define BEFORE_SIZE         4000
+#define ACCEPT_ADDRESS_SIZE (sizeof(struct sockaddr_in) + 16)
+
+typedef struct _RECEIVER_CONTEXT
+{
+    SOCKET Socket;
+    ULONG Expected;
+    ULONG Received;
+    BOOL Corrupted;
+} RECEIVER_CONTEXT, *PRECEIVER_CONTEXT;
+
+static
+void
+FillPattern(PUCHAR Buffer, ULONG Length, ULONG Offset)
+{
+    ULONG i;
+
+    for (i = 0; i < Length; i++)
+        Buffer[i] = (UCHAR)((Offset + i) % 251);
+}
+
+static
+DWORD
+WINAPI
+ReceiverThread(PVOID Parameter)
+{
+    PRECEIVER_CONTEXT Context = Parameter;
+    PUCHAR Buffer;
+    ULONG i;
+    int Length;
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, CHUNK_SIZE);
+    if (!Buffer)
+        return 1;
+
+    while (Context->Received < Context->Expected)
+    {
+        Length = recv(Context->Socket, (char *)Buffer, CHUNK_SIZE, 0);
+        if (Length <= 0)
+            break;
+
+        for (i = 0; i < (ULONG)Length; i++)
+        {
+            if (Buffer[i] != (UCHAR)((Context->Received + i) % 251))
+                Context->Corrupted = TRUE;
+        }
+
+        Context->Received += Length;
+    }
+
+    HeapFree(GetProcessHeap(), 0, Buffer);
+    return 0;
+}
+
+static
+SOCKET
+CreateListener(struct sockaddr_in *addr)
+{
+    SOCKET Listener;
+    int AddrLength = sizeof(*addr);
+    int Error;
+
+    Listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ok(Listener != INVALID_SOCKET, "socket failed with %d\n", WSAGetLastError());
+    if (Listener == INVALID_SOCKET)
+        return INVALID_SOCKET;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr->sin_port = htons(0);
+
+    Error = bind(Listener, (const struct sockaddr *)addr, sizeof(*addr));
+    ok(Error == 0, "bind failed with %d\n", WSAGetLastError());
+    Error = listen(Listener, 1);
+    ok(Error == 0, "listen failed with %d\n", WSAGetLastError());
+    Error = getsockname(Listener, (struct sockaddr *)addr, &AddrLength);
+    ok(Error == 0, "getsockname failed with %d\n", WSAGetLastError());
+
+    return Listener;
+}
+
+static
+BOOL
+ConnectPair(SOCKET *Client, SOCKET *Server)
+{
+    SOCKET Listener;
+    struct sockaddr_in addr;
+    int Error;
+
+    *Client = *Server = INVALID_SOCKET;
+
+    Listener = CreateListener(&addr);
+    if (Listener == INVALID_SOCKET)
+        return FALSE;
+
+    *Client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ok(*Client != INVALID_SOCKET, "socket failed with %d\n", WSAGetLastError());
+    if (*Client != INVALID_SOCKET)
+    {
+        Error = connect(*Client, (const struct sockaddr *)&addr, sizeof(addr));
+        ok(Error == 0, "connect failed with %d\n", WSAGetLastError());
+        if (Error == 0)
+        {
+            *Server = accept(Listener, NULL, NULL);
+            ok(*Server != INVALID_SOCKET, "accept failed with %d\n", WSAGetLastError());
+        }
+    }
+
+    closesocket(Listener);
+
+    if (*Server == INVALID_SOCKET)
+    {
+        if (*Client != INVALID_SOCKET)
+            closesocket(*Client);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+HANDLE
+CreateTestFile(PCWSTR FileName, ULONG Size)
+{
+    HANDLE File;
+    PUCHAR Buffer;
+    ULONG Offset;
+    DWORD Written;
+
+    File = CreateFileW(FileName,
+                       GENERIC_READ | GENERIC_WRITE,
+                       FILE_SHARE_READ,
+                       NULL,
+                       CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE |
+                           FILE_FLAG_SEQUENTIAL_SCAN,
+                       NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, CHUNK_SIZE);
+    ok(Buffer != NULL, "HeapAlloc failed\n");
+    if (!Buffer)
+    {
+        CloseHandle(File);
+        return NULL;
+    }
+
+    for (Offset = 0; Offset < Size; Offset += Written)
+    {
+        FillPattern(Buffer, CHUNK_SIZE, Offset);
+        if (!WriteFile(File, Buffer, min(CHUNK_SIZE, Size - Offset), &Written, NULL) ||
+            !Written)
+        {
+            ok(0, "WriteFile failed with %lu\n", GetLastError());
+            HeapFree(GetProcessHeap(), 0, Buffer);
+            CloseHandle(File);
+            return NULL;
+        }
+    }
+
+    HeapFree(GetProcessHeap(), 0, Buffer);
+    SetFilePointer(File, 0, NULL, FILE_BEGIN);
+
+    return File;
+}
+
+static
+double
+ElapsedSeconds(PLARGE_INTEGER Start, PLARGE_INTEGER End)
+{
+    LARGE_INTEGER Frequency;
+
+    QueryPerformanceFrequency(&Frequency);
+    return (double)(End->QuadPart - Start->QuadPart) / Frequency.QuadPart;
+}
+
+static
+void
+ReportThroughput(const char *Name, PLARGE_INTEGER Start, PLARGE_INTEGER End, ULONG Bytes)
+{
+    double Seconds = ElapsedSeconds(Start, End);
+
+    trace("%s: %lu bytes in %u ms, %u KB/s\n",
+          Name,
+          Bytes,
+          (unsigned)(Seconds * 1000),
+          Seconds > 0 ? (unsigned)(Bytes / 1024 / Seconds) : 0);
+}
+
+static
+void
+ServeFile(HANDLE File, BOOL UseTransmitFile)
+{
+    SOCKET Client, Server;
+    RECEIVER_CONTEXT Context;
+    HANDLE Thread;
+    LARGE_INTEGER Start, End;
+    PUCHAR Buffer = NULL;
+    ULONG Sent;
+    DWORD Read;
+    int Length;
+
+    if (!ConnectPair(&Client, &Server))
+        return;
+
+    SetFilePointer(File, 0, NULL, FILE_BEGIN);
+
+    Context.Socket = Client;
+    Context.Expected = FILE_SIZE;
+    Context.Received = 0;
+    Context.Corrupted = FALSE;
+
+    Thread = CreateThread(NULL, 0, ReceiverThread, &Context, 0, NULL);
+    ok(Thread != NULL, "CreateThread failed with %lu\n", GetLastError());
+    if (!Thread)
+        goto cleanup;
+
+    QueryPerformanceCounter(&Start);
+
+    if (UseTransmitFile)
+    {
+        ok(TransmitFile(Server, File, 0, 0, NULL, NULL, 0),
+           "TransmitFile failed with %d\n", WSAGetLastError());
+    }
+    else
+    {
+        Buffer = HeapAlloc(GetProcessHeap(), 0, CHUNK_SIZE);
+        ok(Buffer != NULL, "HeapAlloc failed\n");
+
+        for (Sent = 0; Buffer && Sent < FILE_SIZE; Sent += Read)
+        {
+            if (!ReadFile(File, Buffer, CHUNK_SIZE, &Read, NULL) || !Read)
+            {
+                ok(0, "ReadFile failed with %lu\n", GetLastError());
+                break;
+            }
+
+            Length = send(Server, (const char *)Buffer, Read, 0);
+            if (Length != (int)Read)
+            {
+                ok(0, "send failed with %d\n", WSAGetLastError());
+                break;
+            }
+        }
+    }
+
+    ok(WaitForSingleObject(Thread, 60 * 1000) == WAIT_OBJECT_0, "Receiver timed out\n");
+    QueryPerformanceCounter(&End);
+    CloseHandle(Thread);
+
+    ok(Context.Received == FILE_SIZE, "Received %lu bytes\n", Context.Received);
+    ok(!Context.Corrupted, "Received data is corrupted\n");
+
+    ReportThroughput(UseTransmitFile ? "TransmitFile" : "ReadFile and send",
+                     &Start, &End, Context.Received);
+
+cleanup:
+    if (Buffer)
+        HeapFree(GetProcessHeap(), 0, Buffer);
+    closesocket(Client);
+    closesocket(Server);
+}
+
+static
+void
+TestServeFile(void)
+{
+    WCHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+    HANDLE File;
+
+    GetTempPathW(MAX_PATH, TempPath);
+    GetTempFileNameW(TempPath, L"afd", 0, FileName);
+
+    File = CreateTestFile(FileName, FILE_SIZE);
+    if (!File)
+        return;
+
+    /* The first pass brings the file into the cache for both */
+    ServeFile(File, FALSE);
+    ServeFile(File, FALSE);
+    ServeFile(File, TRUE);
+
+    CloseHandle(File);
+}
+
+static
+void
+TestHeadAndTail(void)
+{
+    WCHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+    TRANSMIT_FILE_BUFFERS Buffers;
+    WSAOVERLAPPED Overlapped;
+    SOCKET Client, Server;
+    UCHAR Data[100 + 3000 + 100 + 1];
+    UCHAR Expected[3000];
+    HANDLE File;
+    DWORD Length, Flags;
+    int Received, Total;
+
+    GetTempPathW(MAX_PATH, TempPath);
+    GetTempFileNameW(TempPath, L"afd", 0, FileName);
+
+    File = CreateTestFile(FileName, 5000);
+    if (!File)
+        return;
+
+    if (!ConnectPair(&Client, &Server))
+    {
+        CloseHandle(File);
+        return;
+    }
+
+    memset(Data, 0, sizeof(Data));
+    memset(Data, 'H', 100);
+    memset(Data + 100 + 3000, 'T', 100);
+    FillPattern(Expected, sizeof(Expected), 1000);
+
+    Buffers.Head = Data;
+    Buffers.HeadLength = 100;
+    Buffers.Tail = Data + 100 + 3000;
+    Buffers.TailLength = 100;
+
+    /* 3000 bytes from offset 1000, then the socket is shut down */
+    memset(&Overlapped, 0, sizeof(Overlapped));
+    Overlapped.Offset = 1000;
+    Overlapped.hEvent = WSACreateEvent();
+
+    if (!TransmitFile(Server, File, 3000, 0, &Overlapped, &Buffers, TF_DISCONNECT))
+    {
+        ok(WSAGetLastError() == WSA_IO_PENDING,
+           "TransmitFile failed with %d\n", WSAGetLastError());
+    }
+
+    ok(WSAGetOverlappedResult(Server, &Overlapped, &Length, TRUE, &Flags),
+       "WSAGetOverlappedResult failed with %d\n", WSAGetLastError());
+    ok(Length == 3200, "Sent %lu bytes\n", Length);
+
+    memset(Data, 0, sizeof(Data));
+    for (Total = 0; Total < (int)sizeof(Data); Total += Received)
+    {
+        Received = recv(Client, (char *)Data + Total, sizeof(Data) - Total, 0);
+        if (Received <= 0)
+            break;
+    }
+
+    ok(Received == 0, "recv returned %d with %d\n", Received, WSAGetLastError());
+    ok(Total == 3200, "Received %d bytes\n", Total);
+    ok(Data[0] == 'H' && Data[99] == 'H', "Wrong head\n");
+    ok(!memcmp(Data + 100, Expected, sizeof(Expected)), "Wrong file data\n");
+    ok(Data[3100] == 'T' && Data[3199] == 'T', "Wrong tail\n");
+
+    WSACloseEvent(Overlapped.hEvent);
+    closesocket(Client);
+    closesocket(Server);
+    CloseHandle(File);
+}
+
+static
+void
+TestOrdering(void)
+{
+    WCHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+    WSAOVERLAPPED Overlapped[3];
+    WSABUF Before, After;
+    SOCKET Client, Server;
+    PUCHAR Buffer;
+    PUCHAR Data;
+    HANDLE File;
+    DWORD Length, Flags;
+    ULONG Size = BEFORE_SIZE + 3000 + 100;
+    ULONG i;
+    int Received, Total;
+
+    GetTempPathW(MAX_PATH, TempPath);
+    GetTempFileNameW(TempPath, L"afd", 0, FileName);
+
+    File = CreateTestFile(FileName, 3000);
+    if (!File)
+        return;
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, BEFORE_SIZE + 100);
+    Data = HeapAlloc(GetProcessHeap(), 0, Size + 1);
+    ok(Buffer != NULL && Data != NULL, "HeapAlloc failed\n");
+    if (!Buffer || !Data || !ConnectPair(&Client, &Server))
+    {
+        if (Buffer) HeapFree(GetProcessHeap(), 0, Buffer);
+        if (Data) HeapFree(GetProcessHeap(), 0, Data);
+        CloseHandle(File);
+        return;
+    }
+
+    memset(Buffer, 'B', BEFORE_SIZE);
+    memset(Buffer + BEFORE_SIZE, 'A', 100);
+    Before.buf = (char *)Buffer;
+    Before.len = BEFORE_SIZE;
+    After.buf = (char *)Buffer + BEFORE_SIZE;
+    After.len = 100;
+
+    for (i = 0; i < 3; i++)
+    {
+        memset(&Overlapped[i], 0, sizeof(Overlapped[i]));
+        Overlapped[i].hEvent = WSACreateEvent();
+    }
+
+    /* The TransmitFile request waits for the window to drain, the send
+     * after it must not get ahead meanwhile */
+    if (WSASend(Server, &Before, 1, &Length, 0, &Overlapped[0], NULL))
+        ok(WSAGetLastError() == WSA_IO_PENDING, "WSASend failed with %d\n", WSAGetLastError());
+    if (!TransmitFile(Server, File, 0, 0, &Overlapped[1], NULL, 0))
+        ok(WSAGetLastError() == WSA_IO_PENDING, "TransmitFile failed with %d\n", WSAGetLastError());
+    if (WSASend(Server, &After, 1, &Length, 0, &Overlapped[2], NULL))
+        ok(WSAGetLastError() == WSA_IO_PENDING, "WSASend failed with %d\n", WSAGetLastError());
+
+    for (Total = 0; Total < (int)Size; Total += Received)
+    {
+        Received = recv(Client, (char *)Data + Total, Size - Total, 0);
+        if (Received <= 0)
+            break;
+    }
+
+    ok(Total == (int)Size, "Received %d bytes\n", Total);
+    for (i = 0; i < 3; i++)
+    {
+        ok(WSAGetOverlappedResult(Server, &Overlapped[i], &Length, TRUE, &Flags),
+           "Request %lu failed with %d\n", i, WSAGetLastError());
+        WSACloseEvent(Overlapped[i].hEvent);
+    }
+
+    FillPattern(Buffer, 3000, 0);
+    ok(Data[0] == 'B' && Data[BEFORE_SIZE - 1] == 'B', "Wrong data before\n");
+    ok(!memcmp(Data + BEFORE_SIZE, Buffer, 3000), "Wrong file data\n");
+    ok(Data[BEFORE_SIZE + 3000] == 'A' && Data[Size - 1] == 'A', "Wrong data after\n");
+
+    HeapFree(GetProcessHeap(), 0, Data);
+    HeapFree(GetProcessHeap(), 0, Buffer);
+    closesocket(Client);
+    closesocket(Server);
+    CloseHandle(File);
+}
+
+static
+void
+TestAcceptEx(void)
+{
+    SOCKET Listener, Client, Server;
+    struct sockaddr_in addr, ClientAddr;
+    struct sockaddr *LocalAddr, *RemoteAddr;
+    int LocalLength, RemoteLength, AddrLength;
+    UCHAR Buffer[ACCEPT_DATA_SIZE + 2 * ACCEPT_ADDRESS_SIZE];
+    WSAOVERLAPPED Overlapped;
+    DWORD Length, Flags;
+    char Reply[8];
+    int Error;
+
+    Listener = CreateListener(&addr);
+    if (Listener == INVALID_SOCKET)
+        return;
+
+    Server = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    Client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ok(Server != INVALID_SOCKET && Client != INVALID_SOCKET,
+       "socket failed with %d\n", WSAGetLastError());
+
+    memset(&Overlapped, 0, sizeof(Overlapped));
+    Overlapped.hEvent = WSACreateEvent();
+    memset(Buffer, 0, sizeof(Buffer));
+
+    /* Waits for the connection and its first data */
+    if (!AcceptEx(Listener, Server, Buffer, ACCEPT_DATA_SIZE,
+                  ACCEPT_ADDRESS_SIZE, ACCEPT_ADDRESS_SIZE, &Length, &Overlapped))
+    {
+        ok(WSAGetLastError() == WSA_IO_PENDING,
+           "AcceptEx failed with %d\n", WSAGetLastError());
+    }
+
+    Error = connect(Client, (const struct sockaddr *)&addr, sizeof(addr));
+    ok(Error == 0, "connect failed with %d\n", WSAGetLastError());
+
+    ok(WaitForSingleObject(Overlapped.hEvent, 0) == WAIT_TIMEOUT,
+       "AcceptEx completed without data\n");
+
+    Error = send(Client, "hello", 5, 0);
+    ok(Error == 5, "send failed with %d\n", WSAGetLastError());
+
+    ok(WSAGetOverlappedResult(Listener, &Overlapped, &Length, TRUE, &Flags),
+       "WSAGetOverlappedResult failed with %d\n", WSAGetLastError());
+    ok(Length == 5, "Received %lu bytes\n", Length);
+    ok(!memcmp(Buffer, "hello", 5), "Wrong data\n");
+
+    GetAcceptExSockaddrs(Buffer, ACCEPT_DATA_SIZE,
+                         ACCEPT_ADDRESS_SIZE, ACCEPT_ADDRESS_SIZE,
+                         &LocalAddr, &LocalLength,
+                         &RemoteAddr, &RemoteLength);
+
+    AddrLength = sizeof(ClientAddr);
+    getsockname(Client, (struct sockaddr *)&ClientAddr, &AddrLength);
+
+    ok(LocalLength == sizeof(addr), "Local address length %d\n", LocalLength);
+    ok(!memcmp(LocalAddr, &addr, 8), "Wrong local address\n");
+    ok(RemoteLength == sizeof(ClientAddr), "Remote address length %d\n", RemoteLength);
+    ok(!memcmp(RemoteAddr, &ClientAddr, 8), "Wrong remote address\n");
+
+    /* The accepted socket works like one from accept() */
+    Error = setsockopt(Server, SOL_SOCKET, SO_UPDATE_ACCEPT_CONTEXT,
+                       (const char *)&Listener, sizeof(Listener));
+    ok(Error == 0, "setsockopt failed with %d\n", WSAGetLastError());
+
+    Error = send(Server, "world", 5, 0);
+    ok(Error == 5, "send failed with %d\n", WSAGetLastError());
+    Error = recv(Client, Reply, sizeof(Reply), 0);
+    ok(Error == 5 && !memcmp(Reply, "world", 5), "recv returned %d\n", Error);
+
+    WSACloseEvent(Overlapped.hEvent);
+    closesocket(Client);
+    closesocket(Server);
+    closesocket(Listener);
+}
+
+START_TEST(transmitfile)
+{
+    WSADATA WsaData;
+    int Error;
+
+    Error = WSAStartup(MAKEWORD(2, 2), &WsaData);
+    ok(Error == 0, "WSAStartup failed with %d\n", Error);
+    if (Error)
+        return;
+
+    TestHeadAndTail();
+    TestOrdering();
+    TestAcceptEx();
+    TestServeFile();
+
+    WSACleanup();
+}
@@ -0,0 +1,257 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Cluster allocation on FAT volumes
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include "precomp.h"
+#include <winioctl.h>
+
+#define FILE_SIZE           (8 * 1024 * 1024)
+#define WRITE_SIZE          (64 * 1024)
+
+static WCHAR RootPath[MAX_PATH];
+static WCHAR TestDir[MAX_PATH];
+static DWORD BytesPerCluster;
+
+static
+BOOL
+GetFreeClusters(PULONGLONG FreeClusters)
+{
+    DWORD SectorsPerCluster, BytesPerSector, NumberOfFreeClusters, TotalNumberOfClusters;
+
+    if (!GetDiskFreeSpaceW(RootPath,
+                           &SectorsPerCluster,
+                           &BytesPerSector,
+                           &NumberOfFreeClusters,
+                           &TotalNumberOfClusters))
+    {
+        return FALSE;
+    }
+
+    *FreeClusters = NumberOfFreeClusters;
+    return TRUE;
+}
+
+static
+ULONG
+CountExtents(HANDLE File)
+{
+    STARTING_VCN_INPUT_BUFFER Input;
+    struct
+    {
+        RETRIEVAL_POINTERS_BUFFER Buffer;
+        LARGE_INTEGER Extents[2 * 255];
+    } Output;
+    DWORD Returned;
+    ULONG Extents = 0;
+    BOOL Ret;
+
+    Input.StartingVcn.QuadPart = 0;
+    for (;;)
+    {
+        Ret = DeviceIoControl(File,
+                              FSCTL_GET_RETRIEVAL_POINTERS,
+                              &Input,
+                              sizeof(Input),
+                              &Output,
+                              sizeof(Output),
+                              &Returned,
+                              NULL);
+        if (!Ret && GetLastError() != ERROR_MORE_DATA)
+        {
+            ok(0, "FSCTL_GET_RETRIEVAL_POINTERS failed with %lu\n", GetLastError());
+            return 0;
+        }
+
+        Extents += Output.Buffer.ExtentCount;
+        if (Ret || !Output.Buffer.ExtentCount)
+            break;
+
+        Input.StartingVcn = Output.Buffer.Extents[Output.Buffer.ExtentCount - 1].NextVcn;
+    }
+
+    return Extents;
+}
+
+static
+HANDLE
+CreateTestFile(PCWSTR Name, PWSTR Path)
+{
+    HANDLE File;
+
+    StringCchPrintfW(Path, MAX_PATH, L"%s\\%s", TestDir, Name);
+    File = CreateFileW(Path,
+                       GENERIC_READ | GENERIC_WRITE,
+                       0,
+                       NULL,
+                       CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_NORMAL | FILE_FLAG_DELETE_ON_CLOSE,
+                       NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW(%S) failed with %lu\n", Path, GetLastError());
+    return File;
+}
+
+static
+BOOL
+SetFileSize(HANDLE File, LONGLONG Size)
+{
+    LARGE_INTEGER Offset;
+
+    Offset.QuadPart = Size;
+    return SetFilePointerEx(File, Offset, NULL, FILE_BEGIN) && SetEndOfFile(File);
+}
+
+static
+void
+TestSetEndOfFile(void)
+{
+    WCHAR Path[MAX_PATH];
+    ULONGLONG FreeBefore, FreeAfter;
+    ULONG Clusters;
+    HANDLE File;
+
+    File = CreateTestFile(L"alloc1.bin", Path);
+    if (File == INVALID_HANDLE_VALUE)
+        return;
+
+    Clusters = FILE_SIZE / BytesPerCluster;
+    ok(GetFreeClusters(&FreeBefore), "GetDiskFreeSpaceW failed with %lu\n", GetLastError());
+
+    /* The whole file should come as one run */
+    ok(SetFileSize(File, FILE_SIZE), "SetEndOfFile failed with %lu\n", GetLastError());
+    ok(GetFreeClusters(&FreeAfter), "GetDiskFreeSpaceW failed with %lu\n", GetLastError());
+    ok(FreeBefore - FreeAfter == Clusters,
+       "Expected %lu clusters to be allocated, got %I64u\n", Clusters, FreeBefore - FreeAfter);
+    ok(CountExtents(File) == 1, "Expected a single extent, got %lu\n", CountExtents(File));
+
+    /* Growing it should continue that run */
+    ok(SetFileSize(File, 2 * FILE_SIZE), "SetEndOfFile failed with %lu\n", GetLastError());
+    ok(GetFreeClusters(&FreeAfter), "GetDiskFreeSpaceW failed with %lu\n", GetLastError());
+    ok(FreeBefore - FreeAfter == 2 * Clusters,
+       "Expected %lu clusters to be allocated, got %I64u\n", 2 * Clusters, FreeBefore - FreeAfter);
+    ok(CountExtents(File) == 1, "Expected a single extent, got %lu\n", CountExtents(File));
+
+    /* And shrinking it gives the clusters back */
+    ok(SetFileSize(File, FILE_SIZE / 2), "SetEndOfFile failed with %lu\n", GetLastError());
+    ok(GetFreeClusters(&FreeAfter), "GetDiskFreeSpaceW failed with %lu\n", GetLastError());
+    ok(FreeBefore - FreeAfter == Clusters / 2,
+       "Expected %lu clusters to be allocated, got %I64u\n", Clusters / 2, FreeBefore - FreeAfter);
+
+    CloseHandle(File);
+
+    ok(GetFreeClusters(&FreeAfter), "GetDiskFreeSpaceW failed with %lu\n", GetLastError());
+    ok(FreeAfter == FreeBefore, "Expected %I64u free clusters, got %I64u\n", FreeBefore, FreeAfter);
+}
+
+static
+void
+TestDiskFull(void)
+{
+    WCHAR Path[MAX_PATH];
+    ULONGLONG FreeBefore, FreeAfter;
+    HANDLE File;
+
+    ok(GetFreeClusters(&FreeBefore), "GetDiskFreeSpaceW failed with %lu\n", GetLastError());
+
+    /* FAT files can't reach 4 GB, so we can only try that on small volumes */
+    if ((FreeBefore + 1) * BytesPerCluster > MAXDWORD)
+    {
+        skip("Volume has too much free space\n");
+        return;
+    }
+
+    File = CreateTestFile(L"alloc2.bin", Path);
+    if (File == INVALID_HANDLE_VALUE)
+        return;
+
+    SetLastError(0xdeadbeef);
+    ok(!SetFileSize(File, (FreeBefore + 1) * BytesPerCluster), "SetEndOfFile succeeded\n");
+    ok(GetLastError() == ERROR_DISK_FULL, "Expected ERROR_DISK_FULL, got %lu\n", GetLastError());
+
+    /* Nothing should have been left allocated */
+    ok(GetFreeClusters(&FreeAfter), "GetDiskFreeSpaceW failed with %lu\n", GetLastError());
+    ok(FreeAfter == FreeBefore, "Expected %I64u free clusters, got %I64u\n", FreeBefore, FreeAfter);
+
+    CloseHandle(File);
+}
+
+static
+void
+TestAppend(void)
+{
+    WCHAR Path[MAX_PATH];
+    LARGE_INTEGER Start, End, Frequency;
+    PUCHAR Buffer;
+    HANDLE File;
+    DWORD Written;
+    ULONG i;
+
+    Buffer = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, WRITE_SIZE);
+    ok(Buffer != NULL, "HeapAlloc failed\n");
+    if (!Buffer)
+        return;
+
+    File = CreateTestFile(L"alloc3.bin", Path);
+    if (File == INVALID_HANDLE_VALUE)
+    {
+        HeapFree(GetProcessHeap(), 0, Buffer);
+        return;
+    }
+
+    /* Each write extends the file, the allocations should stay contiguous */
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < FILE_SIZE / WRITE_SIZE; i++)
+    {
+        if (!WriteFile(File, Buffer, WRITE_SIZE, &Written, NULL) || Written != WRITE_SIZE)
+        {
+            ok(0, "WriteFile failed with %lu\n", GetLastError());
+            break;
+        }
+    }
+    QueryPerformanceCounter(&End);
+    QueryPerformanceFrequency(&Frequency);
+
+    ok(CountExtents(File) == 1, "Expected a single extent, got %lu\n", CountExtents(File));
+    trace("Appended %u bytes in %I64u ms\n",
+          FILE_SIZE,
+          (End.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart);
+
+    CloseHandle(File);
+    HeapFree(GetProcessHeap(), 0, Buffer);
+}
+
+START_TEST(FatAllocation)
+{
+    WCHAR FileSystem[MAX_PATH];
+    DWORD SectorsPerCluster, BytesPerSector, FreeClusters, TotalClusters;
+
+    GetTempPathW(_countof(TestDir), TestDir);
+    StringCchCopyW(RootPath, _countof(RootPath), TestDir);
+    RootPath[3] = UNICODE_NULL;
+
+    if (!GetVolumeInformationW(RootPath, NULL, 0, NULL, NULL, NULL, FileSystem, _countof(FileSystem)) ||
+        wcsncmp(FileSystem, L"FAT", 3))
+    {
+        skip("Temporary directory is not on a FAT volume\n");
+        return;
+    }
+
+    if (!GetDiskFreeSpaceW(RootPath, &SectorsPerCluster, &BytesPerSector, &FreeClusters, &TotalClusters))
+    {
+        skip("GetDiskFreeSpaceW failed with %lu\n", GetLastError());
+        return;
+    }
+
+    BytesPerCluster = SectorsPerCluster * BytesPerSector;
+    if ((ULONGLONG)FreeClusters * BytesPerCluster < 4 * FILE_SIZE)
+    {
+        skip("Not enough free space\n");
+        return;
+    }
+
+    TestSetEndOfFile();
+    TestDiskFull();
+    TestAppend();
+}
@@ -0,0 +1,278 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Directory walks and file record caching on NTFS volumes
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include "precomp.h"
+
+/* Enough to go through a Windows install image without taking all day */
+#define MAX_ENTRIES         20000
+#define MAX_DEPTH           8
+#define PASSES              3
+
+typedef struct _WALK_STATS
+{
+    ULONG Directories;
+    ULONG Files;
+    ULONG Failures;
+} WALK_STATS, *PWALK_STATS;
+
+static
+void
+WalkDirectory(PCWSTR Directory, ULONG Depth, PWALK_STATS Stats)
+{
+    WCHAR Path[MAX_PATH];
+    WIN32_FIND_DATAW FindData;
+    WIN32_FILE_ATTRIBUTE_DATA AttributeData;
+    HANDLE Find;
+
+    if (FAILED(StringCchPrintfW(Path, _countof(Path), L"%s*", Directory)))
+        return;
+
+    Find = FindFirstFileW(Path, &FindData);
+    if (Find == INVALID_HANDLE_VALUE)
+    {
+        /* e.g. System Volume Information */
+        if (GetLastError() != ERROR_ACCESS_DENIED)
+            Stats->Failures++;
+        return;
+    }
+
+    do
+    {
+        if (!wcscmp(FindData.cFileName, L".") || !wcscmp(FindData.cFileName, L".."))
+            continue;
+
+        if (Stats->Directories + Stats->Files >= MAX_ENTRIES)
+            break;
+
+        if (FAILED(StringCchPrintfW(Path, _countof(Path), L"%s%s", Directory, FindData.cFileName)))
+            continue;
+
+        /* Opening the file goes through its file record, not just the index entry */
+        if (!GetFileAttributesExW(Path, GetFileExInfoStandard, &AttributeData))
+        {
+            if (GetLastError() != ERROR_ACCESS_DENIED)
+                Stats->Failures++;
+            continue;
+        }
+
+        if (FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            Stats->Directories++;
+            if (Depth < MAX_DEPTH &&
+                !(FindData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) &&
+                SUCCEEDED(StringCchCatW(Path, _countof(Path), L"\\")))
+            {
+                WalkDirectory(Path, Depth + 1, Stats);
+            }
+        }
+        else
+        {
+            Stats->Files++;
+        }
+    } while (FindNextFileW(Find, &FindData));
+
+    FindClose(Find);
+}
+
+static
+BOOL
+FindNtfsVolume(PWSTR RootPath, DWORD Length)
+{
+    WCHAR Drives[26 * 4 + 1];
+    WCHAR FileSystem[MAX_PATH];
+    PWSTR Drive;
+    UINT Type;
+
+    if (!GetLogicalDriveStringsW(_countof(Drives), Drives))
+        return FALSE;
+
+    for (Drive = Drives; *Drive; Drive += wcslen(Drive) + 1)
+    {
+        Type = GetDriveTypeW(Drive);
+        if (Type != DRIVE_FIXED && Type != DRIVE_REMOVABLE)
+            continue;
+
+        if (GetVolumeInformationW(Drive, NULL, 0, NULL, NULL, NULL, FileSystem, _countof(FileSystem)) &&
+            !wcscmp(FileSystem, L"NTFS"))
+        {
+            StringCchCopyW(RootPath, Length, Drive);
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static
+BOOL
+FindInDirectory(PCWSTR Directory, PCWSTR Name)
+{
+    WCHAR Path[MAX_PATH];
+    WIN32_FIND_DATAW FindData;
+    HANDLE Find;
+    BOOL Found = FALSE;
+
+    StringCchPrintfW(Path, _countof(Path), L"%s*", Directory);
+    Find = FindFirstFileW(Path, &FindData);
+    if (Find == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    do
+    {
+        if (!_wcsicmp(FindData.cFileName, Name))
+            Found = TRUE;
+    } while (!Found && FindNextFileW(Find, &FindData));
+
+    FindClose(Find);
+    return Found;
+}
+
+/*
+ * Read a file record so that it gets cached, change it, and make sure what
+ * comes back is the new record and not the cached one
+ */
+static
+void
+TestWriteThenRead(PCWSTR RootPath)
+{
+    WCHAR TestDir[MAX_PATH], OldPath[MAX_PATH], NewPath[MAX_PATH];
+    WIN32_FILE_ATTRIBUTE_DATA AttributeData;
+    static const CHAR First[] = "first";
+    static const CHAR Second[] = "second write";
+    CHAR Buffer[32];
+    FILETIME Time;
+    HANDLE File;
+    DWORD Bytes;
+    BOOL Ret;
+
+    StringCchPrintfW(TestDir, _countof(TestDir), L"%sNtfsDirectoryWalk.tmp\\", RootPath);
+    StringCchPrintfW(OldPath, _countof(OldPath), L"%sold.txt", TestDir);
+    StringCchPrintfW(NewPath, _countof(NewPath), L"%snew.txt", TestDir);
+
+    if (!CreateDirectoryW(TestDir, NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
+    {
+        skip("Can't create %S: %lu\n", TestDir, GetLastError());
+        return;
+    }
+
+    File = CreateFileW(OldPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+    {
+        RemoveDirectoryW(TestDir);
+        return;
+    }
+    Ret = WriteFile(File, First, sizeof(First) - 1, &Bytes, NULL);
+    ok(Ret && Bytes == sizeof(First) - 1, "WriteFile failed with %lu\n", GetLastError());
+    CloseHandle(File);
+
+    /* Get the record cached */
+    Ret = GetFileAttributesExW(OldPath, GetFileExInfoStandard, &AttributeData);
+    ok(Ret, "GetFileAttributesExW failed with %lu\n", GetLastError());
+    ok(AttributeData.nFileSizeLow == sizeof(First) - 1, "Size is %lu\n", AttributeData.nFileSizeLow);
+    ok(FindInDirectory(TestDir, L"old.txt"), "old.txt not found\n");
+
+    /* Change its size, time stamp and attributes */
+    File = CreateFileW(OldPath, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    if (File != INVALID_HANDLE_VALUE)
+    {
+        Ret = WriteFile(File, Second, sizeof(Second) - 1, &Bytes, NULL);
+        ok(Ret && Bytes == sizeof(Second) - 1, "WriteFile failed with %lu\n", GetLastError());
+
+        Time.dwLowDateTime = 0x12345678;
+        Time.dwHighDateTime = 0x01c00000;
+        Ret = SetFileTime(File, NULL, NULL, &Time);
+        ok(Ret, "SetFileTime failed with %lu\n", GetLastError());
+        CloseHandle(File);
+    }
+    Ret = SetFileAttributesW(OldPath, FILE_ATTRIBUTE_HIDDEN);
+    ok(Ret, "SetFileAttributesW failed with %lu\n", GetLastError());
+
+    /* Read it back */
+    Ret = GetFileAttributesExW(OldPath, GetFileExInfoStandard, &AttributeData);
+    ok(Ret, "GetFileAttributesExW failed with %lu\n", GetLastError());
+    ok(AttributeData.nFileSizeLow == sizeof(Second) - 1, "Size is %lu\n", AttributeData.nFileSizeLow);
+    ok(AttributeData.dwFileAttributes & FILE_ATTRIBUTE_HIDDEN, "Attributes are 0x%lx\n", AttributeData.dwFileAttributes);
+    ok(AttributeData.ftLastWriteTime.dwLowDateTime == Time.dwLowDateTime &&
+       AttributeData.ftLastWriteTime.dwHighDateTime == Time.dwHighDateTime,
+       "Last write time is %08lx%08lx\n",
+       AttributeData.ftLastWriteTime.dwHighDateTime, AttributeData.ftLastWriteTime.dwLowDateTime);
+
+    File = CreateFileW(OldPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    if (File != INVALID_HANDLE_VALUE)
+    {
+        ZeroMemory(Buffer, sizeof(Buffer));
+        Ret = ReadFile(File, Buffer, sizeof(Buffer), &Bytes, NULL);
+        ok(Ret && Bytes == sizeof(Second) - 1, "ReadFile returned %d, %lu bytes\n", Ret, Bytes);
+        ok(!memcmp(Buffer, Second, sizeof(Second) - 1), "Read '%s'\n", Buffer);
+        CloseHandle(File);
+    }
+
+    /* Rename it, the old name must be gone */
+    SetFileAttributesW(OldPath, FILE_ATTRIBUTE_NORMAL);
+    if (!MoveFileW(OldPath, NewPath))
+    {
+        skip("MoveFileW failed with %lu\n", GetLastError());
+        DeleteFileW(OldPath);
+    }
+    else
+    {
+        ok(GetFileAttributesW(OldPath) == INVALID_FILE_ATTRIBUTES, "old.txt still exists\n");
+        ok(GetLastError() == ERROR_FILE_NOT_FOUND, "GetLastError() is %lu\n", GetLastError());
+        Ret = GetFileAttributesExW(NewPath, GetFileExInfoStandard, &AttributeData);
+        ok(Ret, "GetFileAttributesExW failed with %lu\n", GetLastError());
+        ok(AttributeData.nFileSizeLow == sizeof(Second) - 1, "Size is %lu\n", AttributeData.nFileSizeLow);
+        ok(!FindInDirectory(TestDir, L"old.txt"), "old.txt still listed\n");
+        ok(FindInDirectory(TestDir, L"new.txt"), "new.txt not listed\n");
+        DeleteFileW(NewPath);
+    }
+
+    ok(RemoveDirectoryW(TestDir), "RemoveDirectoryW failed with %lu\n", GetLastError());
+}
+
+START_TEST(NtfsDirectoryWalk)
+{
+    WCHAR RootPath[MAX_PATH];
+    WALK_STATS Stats;
+    LARGE_INTEGER Start, End, Frequency;
+    ULONG Pass;
+
+    if (!FindNtfsVolume(RootPath, _countof(RootPath)))
+    {
+        skip("No NTFS volume found\n");
+        return;
+    }
+
+    TestWriteThenRead(RootPath);
+
+    QueryPerformanceFrequency(&Frequency);
+
+    /*
+     * The first pass reads everything from the disk, the others should mostly
+     * hit the caches. The volume is live, so the counts aren't compared.
+     */
+    for (Pass = 0; Pass < PASSES; Pass++)
+    {
+        ZeroMemory(&Stats, sizeof(Stats));
+
+        QueryPerformanceCounter(&Start);
+        WalkDirectory(RootPath, 0, &Stats);
+        QueryPerformanceCounter(&End);
+
+        trace("Pass %lu on %S: %lu directories, %lu files in %I64u ms\n",
+              Pass,
+              RootPath,
+              Stats.Directories,
+              Stats.Files,
+              (End.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart);
+
+        ok(Stats.Directories + Stats.Files != 0, "Nothing found on %S\n", RootPath);
+        ok(Stats.Failures == 0, "%lu entries couldn't be read\n", Stats.Failures);
+    }
+}
@@ -0,0 +1,273 @@
+/*
+ * PROJECT:     ReactOS API tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test and benchmark for the low fragmentation heap front end
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include "precomp.h"
+
+#define LFH_ENABLE          2
+#define MAX_THREADS         8
+#define LIVE_BLOCKS         64
+#define BENCH_ITERATIONS    (256 * 1024)
+
+static PVOID BenchHeap;
+static volatile LONG StartWork;
+
+static
+ULONG
+QueryFrontEnd(
+    _In_ PVOID Heap)
+{
+    ULONG Value = 0xdeadbeef;
+    SIZE_T ReturnLength = 0;
+    NTSTATUS Status;
+
+    Status = RtlQueryHeapInformation(Heap,
+                                     HeapCompatibilityInformation,
+                                     &Value,
+                                     sizeof(Value),
+                                     &ReturnLength);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_size_t(ReturnLength, sizeof(ULONG));
+    return Value;
+}
+
+static
+NTSTATUS
+EnableFrontEnd(
+    _In_ PVOID Heap)
+{
+    ULONG Value = LFH_ENABLE;
+
+    return RtlSetHeapInformation(Heap,
+                                 HeapCompatibilityInformation,
+                                 &Value,
+                                 sizeof(Value));
+}
+
+static
+VOID
+TestBlocks(
+    _In_ PVOID Heap)
+{
+    PUCHAR Blocks[128];
+    PUCHAR Block;
+    SIZE_T Size, i, j, Round;
+
+    /* Enough traffic on every size to get the buckets going */
+    for (Round = 0; Round < 32; Round++)
+    {
+        for (i = 0; i < _countof(Blocks); i++)
+        {
+            Block = RtlAllocateHeap(Heap, 0, (i * 37) % 3000 + 1);
+            ok(Block != NULL, "Allocation failed\n");
+            RtlFreeHeap(Heap, 0, Block);
+        }
+    }
+
+    for (i = 0; i < _countof(Blocks); i++)
+    {
+        Size = (i * 37) % 3000 + 1;
+        Blocks[i] = RtlAllocateHeap(Heap, 0, Size);
+        ok(Blocks[i] != NULL, "Allocation of %Iu bytes failed\n", Size);
+        if (!Blocks[i])
+            return;
+
+        ok_size_t(RtlSizeHeap(Heap, 0, Blocks[i]), Size);
+        ok(((ULONG_PTR)Blocks[i] & (MEMORY_ALLOCATION_ALIGNMENT - 1)) == 0,
+           "Block %p is misaligned\n", Blocks[i]);
+        RtlFillMemory(Blocks[i], Size, (UCHAR)i);
+    }
+
+    /* Nothing may have overwritten anything */
+    for (i = 0; i < _countof(Blocks); i++)
+    {
+        Size = (i * 37) % 3000 + 1;
+        for (j = 0; j < Size; j++)
+        {
+            if (Blocks[i][j] != (UCHAR)i)
+                break;
+        }
+        ok(j == Size, "Block %Iu corrupted at offset %Iu\n", i, j);
+        ok(RtlValidateHeap(Heap, 0, Blocks[i]), "Block %Iu is not valid\n", i);
+    }
+
+    /* Zeroed blocks must be zeroed even when they are recycled */
+    for (i = 0; i < _countof(Blocks); i += 2)
+    {
+        ok(RtlFreeHeap(Heap, 0, Blocks[i]), "Freeing block %Iu failed\n", i);
+        Blocks[i] = RtlAllocateHeap(Heap, HEAP_ZERO_MEMORY, 48);
+        ok(Blocks[i] != NULL, "Zeroed allocation failed\n");
+        if (!Blocks[i])
+            return;
+
+        for (j = 0; j < 48; j++)
+        {
+            if (Blocks[i][j])
+                break;
+        }
+        ok(j == 48, "Block %Iu not zeroed at offset %Iu\n", i, j);
+    }
+
+    /* Growing within a bucket, then out of it, keeps the contents */
+    Block = RtlAllocateHeap(Heap, 0, 40);
+    ok(Block != NULL, "Allocation failed\n");
+    if (Block)
+    {
+        RtlFillMemory(Block, 40, 0x5A);
+        Block = RtlReAllocateHeap(Heap, HEAP_ZERO_MEMORY, Block, 41);
+        ok(Block != NULL, "Reallocation failed\n");
+        if (Block)
+        {
+            ok_size_t(RtlSizeHeap(Heap, 0, Block), 41);
+            ok_int(Block[39], 0x5A);
+            ok_int(Block[40], 0);
+
+            Block = RtlReAllocateHeap(Heap, HEAP_ZERO_MEMORY, Block, 1000);
+            ok(Block != NULL, "Reallocation failed\n");
+        }
+        if (Block)
+        {
+            ok_size_t(RtlSizeHeap(Heap, 0, Block), 1000);
+            ok_int(Block[0], 0x5A);
+            ok_int(Block[39], 0x5A);
+            ok_int(Block[999], 0);
+            ok(RtlFreeHeap(Heap, 0, Block), "Freeing failed\n");
+        }
+    }
+
+    for (i = 0; i < _countof(Blocks); i++)
+        ok(RtlFreeHeap(Heap, 0, Blocks[i]), "Freeing block %Iu failed\n", i);
+
+    ok(RtlValidateHeap(Heap, 0, NULL), "Heap is not valid\n");
+}
+
+static
+DWORD
+WINAPI
+BenchThread(
+    _In_ PVOID Parameter)
+{
+    PVOID Live[LIVE_BLOCKS] = { NULL };
+    ULONG Seed = PtrToUlong(Parameter);
+    ULONG i, Index;
+
+    while (!StartWork)
+        YieldProcessor();
+
+    /* Keep a window of live blocks of mixed small sizes */
+    for (i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        Seed = Seed * 1664525 + 1013904223;
+        Index = i % LIVE_BLOCKS;
+        if (Live[Index])
+            RtlFreeHeap(BenchHeap, 0, Live[Index]);
+        Live[Index] = RtlAllocateHeap(BenchHeap, 0, 8 + (Seed >> 16) % 504);
+    }
+
+    for (i = 0; i < LIVE_BLOCKS; i++)
+        RtlFreeHeap(BenchHeap, 0, Live[i]);
+
+    return 0;
+}
+
+static
+ULONG
+RunBenchmark(
+    _In_ PVOID Heap,
+    _In_ ULONG Count)
+{
+    HANDLE Threads[MAX_THREADS];
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG i;
+    DWORD Result;
+    LONGLONG Elapsed;
+
+    BenchHeap = Heap;
+    StartWork = FALSE;
+    for (i = 0; i < Count; i++)
+    {
+        Threads[i] = CreateThread(NULL, 0, BenchThread, UlongToPtr(i + 1), 0, NULL);
+        ok(Threads[i] != NULL, "CreateThread failed with %lu\n", GetLastError());
+        if (!Threads[i])
+        {
+            Count = i;
+            break;
+        }
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    InterlockedExchange(&StartWork, TRUE);
+
+    Result = WaitForMultipleObjects(Count, Threads, TRUE, 5 * 60 * 1000);
+    ok(Result == WAIT_OBJECT_0, "WaitForMultipleObjects returned %lu\n", Result);
+    QueryPerformanceCounter(&End);
+
+    for (i = 0; i < Count; i++)
+        CloseHandle(Threads[i]);
+
+    /* Return thousands of allocate and free pairs per second */
+    Elapsed = max(End.QuadPart - Start.QuadPart, 1);
+    return (ULONG)((LONGLONG)Count * BENCH_ITERATIONS * Frequency.QuadPart / Elapsed / 1000);
+}
+
+START_TEST(RtlHeapLfh)
+{
+    PVOID PlainHeap, LfhHeap, Heap;
+    ULONG Threads, PlainRate, LfhRate;
+    ULONG Value = 1;
+    NTSTATUS Status;
+
+    PlainHeap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    LfhHeap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    ok(PlainHeap != NULL && LfhHeap != NULL, "RtlCreateHeap failed\n");
+    if (!PlainHeap || !LfhHeap)
+        return;
+
+    /* A new heap has no front end, and only the LFH can be asked for */
+    ok_long(QueryFrontEnd(LfhHeap), 0);
+    Status = RtlSetHeapInformation(LfhHeap,
+                                   HeapCompatibilityInformation,
+                                   &Value,
+                                   sizeof(Value));
+    ok(!NT_SUCCESS(Status), "Status = 0x%lx\n", Status);
+
+    Status = EnableFrontEnd(LfhHeap);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_long(QueryFrontEnd(LfhHeap), LFH_ENABLE);
+
+    /* Enabling it twice is fine */
+    Status = EnableFrontEnd(LfhHeap);
+    ok_hex(Status, STATUS_SUCCESS);
+
+    /* Heaps without serialization can't have it */
+    Heap = RtlCreateHeap(HEAP_GROWABLE | HEAP_NO_SERIALIZE, NULL, 0, 0, NULL, NULL);
+    ok(Heap != NULL, "RtlCreateHeap failed\n");
+    if (Heap)
+    {
+        Status = EnableFrontEnd(Heap);
+        ok(!NT_SUCCESS(Status), "Status = 0x%lx\n", Status);
+        ok_long(QueryFrontEnd(Heap), 0);
+        RtlDestroyHeap(Heap);
+    }
+
+    TestBlocks(PlainHeap);
+    TestBlocks(LfhHeap);
+
+    /* Compare throughput with and without the front end */
+    for (Threads = 1; Threads <= MAX_THREADS; Threads *= 2)
+    {
+        PlainRate = RunBenchmark(PlainHeap, Threads);
+        LfhRate = RunBenchmark(LfhHeap, Threads);
+        trace("%lu thread(s): %lu k/s without LFH, %lu k/s with LFH\n",
+              Threads, PlainRate, LfhRate);
+    }
+
+    ok(RtlValidateHeap(LfhHeap, 0, NULL), "Heap is not valid\n");
+
+    RtlDestroyHeap(PlainHeap);
+    RtlDestroyHeap(LfhHeap);
+}
@@ -0,0 +1,156 @@
+/*
+ * PROJECT:     ReactOS API tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for multi-processor scaling of CPU-bound threads
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include "precomp.h"
+
+#define WORK_ITERATIONS     (64 * 1024 * 1024)
+#define MAX_WORKERS         16
+
+static volatile LONG StartWork;
+
+static
+DWORD
+WINAPI
+WorkerThread(
+    _In_ PVOID Parameter)
+{
+    ULONG Value = PtrToUlong(Parameter);
+    ULONG i;
+
+    /* Start all workers at the same time */
+    while (!StartWork)
+        YieldProcessor();
+
+    /* Pure CPU work: a linear congruential generator */
+    for (i = 0; i < WORK_ITERATIONS; i++)
+        Value = Value * 1664525 + 1013904223;
+
+    return Value;
+}
+
+static
+ULONG
+RunWorkers(
+    _In_ ULONG Count)
+{
+    HANDLE Threads[MAX_WORKERS];
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG i;
+    DWORD Result;
+
+    StartWork = FALSE;
+    for (i = 0; i < Count; i++)
+    {
+        Threads[i] = CreateThread(NULL, 0, WorkerThread, UlongToPtr(i + 1), 0, NULL);
+        ok(Threads[i] != NULL, "CreateThread failed with %lu\n", GetLastError());
+        if (!Threads[i])
+        {
+            Count = i;
+            break;
+        }
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    InterlockedExchange(&StartWork, TRUE);
+
+    Result = WaitForMultipleObjects(Count, Threads, TRUE, 5 * 60 * 1000);
+    ok(Result == WAIT_OBJECT_0, "WaitForMultipleObjects returned %lu\n", Result);
+    QueryPerformanceCounter(&End);
+
+    for (i = 0; i < Count; i++)
+        CloseHandle(Threads[i]);
+
+    /* Return the elapsed time in milliseconds */
+    return (ULONG)((End.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart);
+}
+
+static
+NTSTATUS
+QueryContextSwitches(
+    _Out_ PSYSTEM_CONTEXT_SWITCH_INFORMATION Information)
+{
+    NTSTATUS Status;
+    ULONG ReturnLength;
+
+    RtlFillMemory(Information, sizeof(*Information), 0x55);
+    Status = NtQuerySystemInformation(SystemContextSwitchInformation,
+                                      Information,
+                                      sizeof(*Information),
+                                      &ReturnLength);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (NT_SUCCESS(Status))
+        ok_size_t(ReturnLength, sizeof(*Information));
+    return Status;
+}
+
+START_TEST(ThreadScaling)
+{
+    SYSTEM_CONTEXT_SWITCH_INFORMATION Before, After;
+    SYSTEM_INFO SystemInfo;
+    ULONG Workers, SingleTime, ParallelTime, Speedup;
+    NTSTATUS Status;
+
+    /* The size must match exactly */
+    Status = NtQuerySystemInformation(SystemContextSwitchInformation,
+                                      &Before,
+                                      sizeof(Before) - 1,
+                                      NULL);
+    ok_hex(Status, STATUS_INFO_LENGTH_MISMATCH);
+
+    GetSystemInfo(&SystemInfo);
+    Workers = min(SystemInfo.dwNumberOfProcessors, MAX_WORKERS);
+    if (Workers < 2)
+    {
+        skip("Only one processor, scaling can't be measured\n");
+        return;
+    }
+
+    /* Reference time for one worker */
+    SingleTime = RunWorkers(1);
+    if (SingleTime == 0)
+    {
+        skip("Work finished too quickly to be timed\n");
+        return;
+    }
+
+    /* Now one worker per processor, which should take about as long */
+    if (!NT_SUCCESS(QueryContextSwitches(&Before)))
+        return;
+    ParallelTime = RunWorkers(Workers);
+    if (!NT_SUCCESS(QueryContextSwitches(&After)))
+        return;
+
+    /* Speedup in percent of a single processor */
+    Speedup = SingleTime * Workers * 100 / max(ParallelTime, 1);
+    trace("%lu workers: %lu ms, 1 worker: %lu ms, speedup %lu.%02lux\n",
+          Workers, ParallelTime, SingleTime, Speedup / 100, Speedup % 100);
+    trace("Switches %lu, idle ideal/last/current/any %lu/%lu/%lu/%lu, "
+          "preempt last/current/any %lu/%lu/%lu, find ideal/last/any %lu/%lu/%lu, "
+          "to idle %lu\n",
+          After.ContextSwitches - Before.ContextSwitches,
+          After.IdleIdeal - Before.IdleIdeal,
+          After.IdleLast - Before.IdleLast,
+          After.IdleCurrent - Before.IdleCurrent,
+          After.IdleAny - Before.IdleAny,
+          After.PreemptLast - Before.PreemptLast,
+          After.PreemptCurrent - Before.PreemptCurrent,
+          After.PreemptAny - Before.PreemptAny,
+          After.FindIdeal - Before.FindIdeal,
+          After.FindLast - Before.FindLast,
+          After.FindAny - Before.FindAny,
+          After.SwitchToIdle - Before.SwitchToIdle);
+
+    ok(After.ContextSwitches >= Before.ContextSwitches,
+       "Context switches went from %lu to %lu\n",
+       Before.ContextSwitches, After.ContextSwitches);
+
+    /* Expect at least half of linear scaling, so busy hosts don't fail us */
+    ok(Speedup >= Workers * 50,
+       "Speedup with %lu workers is only %lu.%02lux\n",
+       Workers, Speedup / 100, Speedup % 100);
+}
@@ -61,6 +61,7 @@ extern void func_RtlGetLongestNtPathLength(void);
 extern void func_RtlGetNtProductType(void);
 extern void func_RtlGetUnloadEventTrace(void);
 extern void func_RtlHandle(void);
+extern void func_RtlHeapLfh(void);
 extern void func_RtlImageRvaToVa(void);
 extern void func_RtlIsNameLegalDOS8Dot3(void);
 extern void func_RtlMemoryStream(void);
@@ -73,6 +74,7 @@ extern void func_RtlUnicodeStringToAnsiString(void);
 extern void func_RtlUpcaseUnicodeStringToCountedOemString(void);
 extern void func_RtlValidateUnicodeString(void);
 extern void func_StackOverflow(void);
+extern void func_ThreadScaling(void);
 extern void func_TimerResolution(void);
 
 const struct test winetest_testlist[] =
@@ -135,6 +137,7 @@ const struct test winetest_testlist[] =
     { "RtlGetNtProductType",            func_RtlGetNtProductType },
     { "RtlGetUnloadEventTrace",         func_RtlGetUnloadEventTrace },
     { "RtlHandle",                      func_RtlHandle },
+    { "RtlHeapLfh",                     func_RtlHeapLfh },
     { "RtlImageRvaToVa",                func_RtlImageRvaToVa },
     { "RtlIsNameLegalDOS8Dot3",         func_RtlIsNameLegalDOS8Dot3 },
     { "RtlMemoryStream",                func_RtlMemoryStream },
@@ -147,6 +150,7 @@ const struct test winetest_testlist[] =
     { "RtlUpcaseUnicodeStringToCountedOemString", func_RtlUpcaseUnicodeStringToCountedOemString },
     { "RtlValidateUnicodeString",       func_RtlValidateUnicodeString },
     { "StackOverflow",                  func_StackOverflow },
+    { "ThreadScaling",                  func_ThreadScaling },
     { "TimerResolution",                func_TimerResolution },
 
     { 0, 0 }
@@ -151,7 +151,7 @@ CcRemapBcb (
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -163,8 +163,14 @@ CcScheduleReadAhead (
 {
     KIRQL OldIrql;
     LARGE_INTEGER NewOffset;
+    LONGLONG Stride, Scheduled, Start, End;
+    LARGE_INTEGER PreviousOffset;
+    ULONG Window, Count, PreviousLength, i;
+    LARGE_INTEGER Offsets[CC_MAX_READ_AHEAD_IN_FLIGHT];
+    ULONG Lengths[CC_MAX_READ_AHEAD_IN_FLIGHT];
+    PWORK_QUEUE_ENTRY WorkItem;
     PROS_SHARED_CACHE_MAP SharedCacheMap;
-    PPRIVATE_CACHE_MAP PrivateCacheMap;
+    PROS_PRIVATE_CACHE_MAP PrivateCacheMap;
 
     SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
     PrivateCacheMap = FileObject->PrivateCacheMap;
@@ -183,72 +189,173 @@ CcScheduleReadAhead (
 
     /* Lock read ahead spin lock */
     KeAcquireSpinLock(&PrivateCacheMap->ReadAheadSpinLock, &OldIrql);
-    /* Easy case: the file is sequentially read */
-    if (BooleanFlagOn(FileObject->Flags, FO_SEQUENTIAL_ONLY))
+
+    /* Find out the access pattern from the read history, which doesn't
+     * contain the current read yet. Sequential first: the file is flagged
+     * so, or the read starts where the previous one ended.
+     */
+    Stride = FileOffset->QuadPart - PrivateCacheMap->FileOffset2.QuadPart;
+    if (BooleanFlagOn(FileObject->Flags, FO_SEQUENTIAL_ONLY) ||
+        FileOffset->QuadPart == PrivateCacheMap->BeyondLastByte2.QuadPart)
     {
-        /* If we went backward, this is no go! */
-        if (NewOffset.QuadPart < PrivateCacheMap->ReadAheadOffset[1].QuadPart)
-        {
-            KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
-            return;
-        }
+        Stride = 0;
+    }
+    /* Then, reads going forward by a constant step */
+    else if (Stride <= 0 ||
+             Stride != PrivateCacheMap->FileOffset2.QuadPart - PrivateCacheMap->FileOffset1.QuadPart)
+    {
+        /* Random access, forget about the stream, it will have to ramp up again */
+        PrivateCacheMap->ReadAheadWindow = 0;
+        PrivateCacheMap->ReadAheadStride = 0;
+        KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+        return;
+    }
 
-        /* FIXME: hackish, but will do the job for now */
+    /* The pattern changed, restart from the smallest window */
+    if (PrivateCacheMap->ReadAheadWindow == 0 || PrivateCacheMap->ReadAheadStride != Stride)
+    {
+        PrivateCacheMap->ReadAheadWindow = max(CC_MIN_READ_AHEAD_WINDOW, Length);
+        PrivateCacheMap->ReadAheadStride = Stride;
         PrivateCacheMap->ReadAheadOffset[1].QuadPart = NewOffset.QuadPart;
-        PrivateCacheMap->ReadAheadLength[1] = Length;
+        PrivateCacheMap->ReadAheadLength[1] = 0;
+    }
+
+    /* ReadAheadOffset[1]/ReadAheadLength[1] is the last range we scheduled,
+     * ignore it if the reader went past it or seeked back.
+     */
+    Scheduled = PrivateCacheMap->ReadAheadOffset[1].QuadPart + PrivateCacheMap->ReadAheadLength[1];
+    if (Scheduled < NewOffset.QuadPart ||
+        Scheduled > NewOffset.QuadPart + 2 * CC_MAX_READ_AHEAD_WINDOW)
+    {
+        Scheduled = NewOffset.QuadPart;
+    }
+
+    /* Enough data is on its way, wait for the reader to consume half of it */
+    Window = PrivateCacheMap->ReadAheadWindow;
+    if (Scheduled - NewOffset.QuadPart >= Window / 2)
+    {
+        KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+        return;
+    }
+
+    /* The reader keeps up with read ahead, grow the window for next time */
+    PrivateCacheMap->ReadAheadWindow = min(Window * 2, CC_MAX_READ_AHEAD_WINDOW);
+
+    /* Split what we want to read ahead in view sized work items, so that
+     * several workers can bring it in. Every iteration posts an item, so
+     * there are never more than CC_MAX_READ_AHEAD_IN_FLIGHT of them.
+     * Records that touch or overlap are read ahead as a sequential stream.
+     */
+    Count = 0;
+    End = NewOffset.QuadPart + Window;
+    if (Stride <= Length)
+    {
+        Start = Scheduled;
+        while (Start < End &&
+               PrivateCacheMap->ReadAheadsInFlight + Count < CC_MAX_READ_AHEAD_IN_FLIGHT)
+        {
+            Offsets[Count].QuadPart = Start;
+            Lengths[Count] = (ULONG)min(End - Start,
+                                        VACB_MAPPING_GRANULARITY - (Start % VACB_MAPPING_GRANULARITY));
+            Start += Lengths[Count];
+            ++Count;
+        }
     }
-    /* Other cases: try to find some logic in that mess... */
     else
     {
-        /* Let's check if we always read the same way (like going down in the file)
-         * and pretend it's enough for now
+        /* For strided reads, fetch the next records the reader will ask for,
+         * starting with the first one that isn't fully scheduled yet
          */
-        if (PrivateCacheMap->FileOffset2.QuadPart >= PrivateCacheMap->FileOffset1.QuadPart &&
-            FileOffset->QuadPart >= PrivateCacheMap->FileOffset2.QuadPart)
+        Start = FileOffset->QuadPart + Stride;
+        if (Start + Length <= Scheduled)
         {
-            /* FIXME: hackish, but will do the job for now */
-            PrivateCacheMap->ReadAheadOffset[1].QuadPart = NewOffset.QuadPart;
-            PrivateCacheMap->ReadAheadLength[1] = Length;
+            Start += ((Scheduled - Start - Length) / Stride + 1) * Stride;
         }
-        else
+
+        /* The records don't touch, so only the first one can start in
+         * what is already scheduled
+         */
+        while (Start < End &&
+               PrivateCacheMap->ReadAheadsInFlight + Count < CC_MAX_READ_AHEAD_IN_FLIGHT)
         {
-            /* FIXME: handle the other cases */
-            KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
-            UNIMPLEMENTED_ONCE;
-            return;
+            Offsets[Count].QuadPart = max(Start, Scheduled);
+            Lengths[Count] = (ULONG)(Start + Length - Offsets[Count].QuadPart);
+            Start += Stride;
+            ++Count;
         }
     }
 
-    /* If read ahead isn't active yet */
-    if (!PrivateCacheMap->Flags.ReadAheadActive)
+    if (Count == 0)
     {
-        PWORK_QUEUE_ENTRY WorkItem;
-
-        /* It's active now!
-         * Be careful with the mask, you don't want to mess with node code
-         */
-        InterlockedOr((volatile long *)&PrivateCacheMap->UlongFlags, PRIVATE_CACHE_MAP_READ_AHEAD_ACTIVE);
         KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+        return;
+    }
+
+    /* Remember what we schedule, so that the next reads don't post it again */
+    PreviousOffset = PrivateCacheMap->ReadAheadOffset[1];
+    PreviousLength = PrivateCacheMap->ReadAheadLength[1];
+    PrivateCacheMap->ReadAheadOffset[1].QuadPart = Offsets[Count - 1].QuadPart;
+    PrivateCacheMap->ReadAheadLength[1] = Lengths[Count - 1];
+
+    /* It's active now!
+     * Be careful with the mask, you don't want to mess with node code
+     */
+    PrivateCacheMap->ReadAheadsInFlight += Count;
+    InterlockedOr((volatile long *)&PrivateCacheMap->UlongFlags, PRIVATE_CACHE_MAP_READ_AHEAD_ACTIVE);
+    KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
 
+    for (i = 0; i < Count; i++)
+    {
         /* Get a work item */
         WorkItem = ExAllocateFromNPagedLookasideList(&CcTwilightLookasideList);
-        if (WorkItem != NULL)
+        if (WorkItem == NULL)
         {
-            /* Reference our FO so that it doesn't go in between */
-            ObReferenceObject(FileObject);
+            break;
+        }
 
-            /* We want to do read ahead! */
-            WorkItem->Function = ReadAhead;
-            WorkItem->Parameters.Read.FileObject = FileObject;
+        /* Reference our FO so that it doesn't go in between */
+        ObReferenceObject(FileObject);
 
-            /* Queue in the read ahead dedicated queue */
-            CcPostWorkQueue(WorkItem, &CcExpressWorkQueue);
+        /* We want to do read ahead! */
+        WorkItem->Function = ReadAhead;
+        WorkItem->Parameters.Read.FileObject = FileObject;
+        WorkItem->Parameters.Read.FileOffset = Offsets[i];
+        WorkItem->Parameters.Read.Length = Lengths[i];
+        WorkItem->Parameters.Read.Serial = PrivateCacheMap->ReadAheadSerial;
 
-            return;
-        }
+        /* Queue in the read ahead dedicated queue */
+        CcPostWorkQueue(WorkItem, &CcExpressWorkQueue);
+    }
 
-        /* Fail path: lock again, and revert read ahead active */
-        KeAcquireSpinLock(&PrivateCacheMap->ReadAheadSpinLock, &OldIrql);
+    if (i == Count)
+    {
+        return;
+    }
+
+    /* Fail path: lock again, and forget about the items we couldn't post */
+    KeAcquireSpinLock(&PrivateCacheMap->ReadAheadSpinLock, &OldIrql);
+    ASSERT(PrivateCacheMap->ReadAheadsInFlight >= Count - i);
+    PrivateCacheMap->ReadAheadsInFlight -= Count - i;
+
+    /* Unless another read scheduled more since, only the items we posted
+     * are on their way
+     */
+    if (PrivateCacheMap->ReadAheadOffset[1].QuadPart == Offsets[Count - 1].QuadPart &&
+        PrivateCacheMap->ReadAheadLength[1] == Lengths[Count - 1])
+    {
+        if (i > 0)
+        {
+            PrivateCacheMap->ReadAheadOffset[1].QuadPart = Offsets[i - 1].QuadPart;
+            PrivateCacheMap->ReadAheadLength[1] = Lengths[i - 1];
+        }
+        else
+        {
+            PrivateCacheMap->ReadAheadOffset[1] = PreviousOffset;
+            PrivateCacheMap->ReadAheadLength[1] = PreviousLength;
+        }
+    }
+    if (PrivateCacheMap->ReadAheadsInFlight == 0)
+    {
         InterlockedAnd((volatile long *)&PrivateCacheMap->UlongFlags, ~PRIVATE_CACHE_MAP_READ_AHEAD_ACTIVE);
     }
 
@@ -361,7 +468,7 @@ CcSetReadAheadGranularity (
 	IN	ULONG		Granularity
 	)
 {
-    PPRIVATE_CACHE_MAP PrivateMap;
+    PROS_PRIVATE_CACHE_MAP PrivateMap;
 
     CCTRACE(CC_API_DEBUG, "FileObject=%p Granularity=%lu\n",
         FileObject, Granularity);
@@ -50,6 +50,15 @@ ULONG CcFastReadResourceMiss;
 ULONG CcDataPages = 0;
 ULONG CcDataFlushes = 0;
 
+/* Read ahead counters:
+ * - Number of views read by read ahead
+ * - Number of views brought by read ahead which were then read
+ * - Number of views read synchronously while read ahead was on for the stream
+ */
+ULONG CcReadAheadIos = 0;
+ULONG CcReadAheadHits = 0;
+ULONG CcReadAheadMisses = 0;
+
 /* FUNCTIONS *****************************************************************/
 
 VOID
@@ -221,6 +230,126 @@ CcWriteVirtualAddress (
     return STATUS_SUCCESS;
 }
 
+/*
+ * Writes adjacent views of a file with a single paging I/O. Each view is
+ * locked through its own MDL, and the pages are gathered into one MDL
+ * given to the file system. All views but the last one must be full.
+ */
+NTSTATUS
+NTAPI
+CcWriteVirtualAddressRun (
+    PROS_VACB *Vacbs,
+    ULONG Count)
+{
+    ULONG i, j, Size, TotalSize;
+    PMDL Mdl;
+    PMDL ViewMdls[CC_MAX_LAZY_WRITE_RUN];
+    NTSTATUS Status;
+    IO_STATUS_BLOCK IoStatus;
+    KEVENT Event;
+    ULARGE_INTEGER LargeSize;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+
+    ASSERT(Count > 0 && Count <= CC_MAX_LAZY_WRITE_RUN);
+
+    if (Count == 1)
+    {
+        return CcWriteVirtualAddress(Vacbs[0]);
+    }
+
+    SharedCacheMap = Vacbs[0]->SharedCacheMap;
+    TotalSize = 0;
+    for (i = 0; i < Count; i++)
+    {
+        ASSERT(Vacbs[i]->SharedCacheMap == SharedCacheMap);
+        ASSERT(Vacbs[i]->FileOffset.QuadPart == Vacbs[0]->FileOffset.QuadPart + i * VACB_MAPPING_GRANULARITY);
+
+        LargeSize.QuadPart = SharedCacheMap->SectionSize.QuadPart - Vacbs[i]->FileOffset.QuadPart;
+        if (LargeSize.QuadPart > VACB_MAPPING_GRANULARITY)
+        {
+            LargeSize.QuadPart = VACB_MAPPING_GRANULARITY;
+        }
+        Size = LargeSize.LowPart;
+        ASSERT(Size > 0);
+        ASSERT(i == Count - 1 || Size == VACB_MAPPING_GRANULARITY);
+
+        /* Same PDE synchronization dance as in CcWriteVirtualAddress() */
+        j = 0;
+        do
+        {
+            MmGetPfnForProcess(NULL, (PVOID)((ULONG_PTR)Vacbs[i]->BaseAddress + (j << PAGE_SHIFT)));
+        } while (++j < (Size >> PAGE_SHIFT));
+
+        ViewMdls[i] = IoAllocateMdl(Vacbs[i]->BaseAddress, Size, FALSE, FALSE, NULL);
+        if (!ViewMdls[i])
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Cleanup;
+        }
+
+        _SEH2_TRY
+        {
+            MmProbeAndLockPages(ViewMdls[i], KernelMode, IoReadAccess);
+        }
+        _SEH2_EXCEPT (EXCEPTION_EXECUTE_HANDLER)
+        {
+            Status = _SEH2_GetExceptionCode();
+            DPRINT1("MmProbeAndLockPages failed with: %lx for %p (%p, %p)\n", Status, ViewMdls[i], Vacbs[i], Vacbs[i]->BaseAddress);
+            KeBugCheck(CACHE_MANAGER);
+        } _SEH2_END;
+
+        TotalSize += Size;
+    }
+
+    /* The views pages are kept locked by their own MDL, just describe them */
+    Mdl = IoAllocateMdl(Vacbs[0]->BaseAddress, TotalSize, FALSE, FALSE, NULL);
+    if (!Mdl)
+    {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Cleanup;
+    }
+
+    for (j = 0; j < Count; j++)
+    {
+        RtlCopyMemory(MmGetMdlPfnArray(Mdl) + j * (VACB_MAPPING_GRANULARITY / PAGE_SIZE),
+                      MmGetMdlPfnArray(ViewMdls[j]),
+                      ADDRESS_AND_SIZE_TO_SPAN_PAGES(0, MmGetMdlByteCount(ViewMdls[j])) * sizeof(PFN_NUMBER));
+    }
+    Mdl->MdlFlags |= MDL_PAGES_LOCKED;
+
+    KeInitializeEvent(&Event, NotificationEvent, FALSE);
+    Status = IoSynchronousPageWrite(SharedCacheMap->FileObject, Mdl, &Vacbs[0]->FileOffset, &Event, &IoStatus);
+    if (Status == STATUS_PENDING)
+    {
+        KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
+        Status = IoStatus.Status;
+    }
+
+    /* Only drop the system mapping the FSD may have created, don't unlock */
+    if (Mdl->MdlFlags & MDL_MAPPED_TO_SYSTEM_VA)
+    {
+        MmUnmapLockedPages(Mdl->MappedSystemVa, Mdl);
+    }
+    Mdl->MdlFlags &= ~MDL_PAGES_LOCKED;
+    IoFreeMdl(Mdl);
+
+Cleanup:
+    /* i is the number of views we locked */
+    while (i-- > 0)
+    {
+        MmUnlockPages(ViewMdls[i]);
+        IoFreeMdl(ViewMdls[i]);
+    }
+
+    if (!NT_SUCCESS(Status) && (Status != STATUS_END_OF_FILE))
+    {
+        DPRINT1("IoPageWrite failed, Status %x\n", Status);
+        return Status;
+    }
+
+    return STATUS_SUCCESS;
+}
+
 NTSTATUS
 ReadWriteOrZero(
     _Inout_ PVOID BaseAddress,
@@ -253,6 +382,24 @@ ReadWriteOrZero(
     return Status;
 }
 
+static
+VOID
+CcUpdateReadAheadStats (
+    _In_ PROS_PRIVATE_CACHE_MAP PrivateCacheMap,
+    _In_ PROS_VACB Vacb,
+    _In_ BOOLEAN Valid)
+{
+    if (Vacb->ReadAhead)
+    {
+        Vacb->ReadAhead = FALSE;
+        ++CcReadAheadHits;
+    }
+    else if (!Valid && PrivateCacheMap != NULL && PrivateCacheMap->ReadAheadWindow != 0)
+    {
+        ++CcReadAheadMisses;
+    }
+}
+
 BOOLEAN
 CcCopyData (
     _In_ PFILE_OBJECT FileObject,
@@ -268,12 +415,12 @@ CcCopyData (
     ULONG BytesCopied;
     KIRQL OldIrql;
     PROS_SHARED_CACHE_MAP SharedCacheMap;
-    PLIST_ENTRY ListEntry;
+    LONGLONG ViewOffset;
     PROS_VACB Vacb;
     ULONG PartialLength;
     PVOID BaseAddress;
     BOOLEAN Valid;
-    PPRIVATE_CACHE_MAP PrivateCacheMap;
+    PROS_PRIVATE_CACHE_MAP PrivateCacheMap;
 
     SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
     PrivateCacheMap = FileObject->PrivateCacheMap;
@@ -285,25 +432,18 @@ CcCopyData (
         /* test if the requested data is available */
         KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &OldIrql);
         /* FIXME: this loop doesn't take into account areas that don't have
-         * a VACB in the list yet */
-        ListEntry = SharedCacheMap->CacheMapVacbListHead.Flink;
-        while (ListEntry != &SharedCacheMap->CacheMapVacbListHead)
+         * a VACB in the index yet */
+        for (ViewOffset = ROUND_DOWN(CurrentOffset, VACB_MAPPING_GRANULARITY);
+             ViewOffset < CurrentOffset + Length;
+             ViewOffset += VACB_MAPPING_GRANULARITY)
         {
-            Vacb = CONTAINING_RECORD(ListEntry,
-                                     ROS_VACB,
-                                     CacheMapVacbListEntry);
-            ListEntry = ListEntry->Flink;
-            if (!Vacb->Valid &&
-                DoRangesIntersect(Vacb->FileOffset.QuadPart,
-                                  VACB_MAPPING_GRANULARITY,
-                                  CurrentOffset, Length))
+            Vacb = CcRosVacbIndexLookup(SharedCacheMap, ViewOffset);
+            if (Vacb != NULL && !Vacb->Valid)
             {
                 KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, OldIrql);
                 /* data not available */
                 return FALSE;
             }
-            if (Vacb->FileOffset.QuadPart >= CurrentOffset + Length)
-                break;
         }
         KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, OldIrql);
     }
@@ -320,6 +460,8 @@ CcCopyData (
                                   &Vacb);
         if (!NT_SUCCESS(Status))
             ExRaiseStatus(Status);
+        if (Operation == CcOperationRead)
+            CcUpdateReadAheadStats(PrivateCacheMap, Vacb, Valid);
         if (!Valid)
         {
             Status = CcReadVirtualAddress(Vacb);
@@ -358,6 +500,8 @@ CcCopyData (
                                   &Vacb);
         if (!NT_SUCCESS(Status))
             ExRaiseStatus(Status);
+        if (Operation == CcOperationRead)
+            CcUpdateReadAheadStats(PrivateCacheMap, Vacb, Valid);
         if (!Valid &&
             (Operation == CcOperationRead ||
              PartialLength < VACB_MAPPING_GRANULARITY))
@@ -387,11 +531,10 @@ CcCopyData (
     /* If that was a successful sync read operation, let's handle read ahead */
     if (Operation == CcOperationRead && Length == 0 && Wait)
     {
-        /* If file isn't random access and next read may get us cross VACB boundary,
-         * schedule next read
+        /* If file isn't random access, let read ahead look at the pattern
+         * It only schedules I/O once the reader consumed enough of what's in flight
          */
-        if (!BooleanFlagOn(FileObject->Flags, FO_RANDOM_ACCESS) &&
-            (CurrentOffset - 1) / VACB_MAPPING_GRANULARITY != (CurrentOffset + BytesCopied - 1) / VACB_MAPPING_GRANULARITY)
+        if (!BooleanFlagOn(FileObject->Flags, FO_RANDOM_ACCESS))
         {
             CcScheduleReadAhead(FileObject, (PLARGE_INTEGER)&FileOffset, BytesCopied);
         }
@@ -484,7 +627,10 @@ CcPostDeferredWrites(VOID)
 
 VOID
 CcPerformReadAhead(
-    IN PFILE_OBJECT FileObject)
+    IN PFILE_OBJECT FileObject,
+    IN LONGLONG FileOffset,
+    IN ULONG Length,
+    IN ULONG Serial)
 {
     NTSTATUS Status;
     LONGLONG CurrentOffset;
@@ -494,36 +640,23 @@ CcPerformReadAhead(
     ULONG PartialLength;
     PVOID BaseAddress;
     BOOLEAN Valid;
-    ULONG Length;
-    PPRIVATE_CACHE_MAP PrivateCacheMap;
+    PROS_PRIVATE_CACHE_MAP PrivateCacheMap;
     BOOLEAN Locked;
 
     SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    CurrentOffset = FileOffset;
 
-    /* Critical:
-     * PrivateCacheMap might disappear in-between if the handle
-     * to the file is closed (private is attached to the handle not to
-     * the file), so we need to lock the master lock while we deal with
-     * it. It won't disappear without attempting to lock such lock.
+    /* If the handle was closed since the read ahead was scheduled, just quit
+     * (See the comment about the private cache map below)
      */
     OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
     PrivateCacheMap = FileObject->PrivateCacheMap;
-    /* If the handle was closed since the read ahead was scheduled, just quit */
+    KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
     if (PrivateCacheMap == NULL)
     {
-        KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
         ObDereferenceObject(FileObject);
         return;
     }
-    /* Otherwise, extract read offset and length and release private map */
-    else
-    {
-        KeAcquireSpinLockAtDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
-        CurrentOffset = PrivateCacheMap->ReadAheadOffset[1].QuadPart;
-        Length = PrivateCacheMap->ReadAheadLength[1];
-        KeReleaseSpinLockFromDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
-    }
-    KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
 
     /* Time to go! */
     DPRINT("Doing ReadAhead for %p\n", FileObject);
@@ -551,10 +684,10 @@ CcPerformReadAhead(
      * difference that we don't copy data back to an user-backed buffer
      * We just bring data into Cc
      */
-    PartialLength = CurrentOffset % VACB_MAPPING_GRANULARITY;
-    if (PartialLength != 0)
+    while (Length > 0)
     {
-        PartialLength = min(Length, VACB_MAPPING_GRANULARITY - PartialLength);
+        PartialLength = min(Length,
+                            VACB_MAPPING_GRANULARITY - (CurrentOffset % VACB_MAPPING_GRANULARITY));
         Status = CcRosRequestVacb(SharedCacheMap,
                                   ROUND_DOWN(CurrentOffset,
                                              VACB_MAPPING_GRANULARITY),
@@ -576,38 +709,10 @@ CcPerformReadAhead(
                 DPRINT1("Failed to read data: %lx!\n", Status);
                 goto Clear;
             }
-        }
-
-        CcRosReleaseVacb(SharedCacheMap, Vacb, TRUE, FALSE, FALSE);
-
-        Length -= PartialLength;
-        CurrentOffset += PartialLength;
-    }
 
-    while (Length > 0)
-    {
-        ASSERT(CurrentOffset % VACB_MAPPING_GRANULARITY == 0);
-        PartialLength = min(VACB_MAPPING_GRANULARITY, Length);
-        Status = CcRosRequestVacb(SharedCacheMap,
-                                  CurrentOffset,
-                                  &BaseAddress,
-                                  &Valid,
-                                  &Vacb);
-        if (!NT_SUCCESS(Status))
-        {
-            DPRINT1("Failed to request VACB: %lx!\n", Status);
-            goto Clear;
-        }
-
-        if (!Valid)
-        {
-            Status = CcReadVirtualAddress(Vacb);
-            if (!NT_SUCCESS(Status))
-            {
-                CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE, FALSE);
-                DPRINT1("Failed to read data: %lx!\n", Status);
-                goto Clear;
-            }
+            /* Remember it for the hit counter */
+            Vacb->ReadAhead = TRUE;
+            ++CcReadAheadIos;
         }
 
         CcRosReleaseVacb(SharedCacheMap, Vacb, TRUE, FALSE, FALSE);
@@ -617,14 +722,26 @@ CcPerformReadAhead(
     }
 
 Clear:
-    /* See previous comment about private cache map */
+    /* Critical:
+     * PrivateCacheMap might disappear in-between if the handle
+     * to the file is closed (private is attached to the handle not to
+     * the file), so we need to lock the master lock while we deal with
+     * it. It won't disappear without attempting to lock such lock.
+     */
     OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
     PrivateCacheMap = FileObject->PrivateCacheMap;
-    if (PrivateCacheMap != NULL)
+    /* If the handle was closed and the file object cached again, the
+     * new private cache map didn't count us
+     */
+    if (PrivateCacheMap != NULL && PrivateCacheMap->ReadAheadSerial == Serial)
     {
-        /* Mark read ahead as unactive */
+        /* Mark read ahead as unactive once the last item is done */
         KeAcquireSpinLockAtDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
-        InterlockedAnd((volatile long *)&PrivateCacheMap->UlongFlags, ~PRIVATE_CACHE_MAP_READ_AHEAD_ACTIVE);
+        ASSERT(PrivateCacheMap->ReadAheadsInFlight != 0);
+        if (--PrivateCacheMap->ReadAheadsInFlight == 0)
+        {
+            InterlockedAnd((volatile long *)&PrivateCacheMap->UlongFlags, ~PRIVATE_CACHE_MAP_READ_AHEAD_ACTIVE);
+        }
         KeReleaseSpinLockFromDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
     }
     KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
@@ -20,6 +20,21 @@
 ULONG CcLazyWritePages = 0;
 ULONG CcLazyWriteIos = 0;
 
+/* Write behind tuning and stats:
+ * - Dirty data older than this is due for write, even under throttle
+ * - Number of writes which covered several adjacent views
+ * - Measured lazy writer throughput, in pages per second
+ * - Target of the last lazy writer run, in pages
+ * - Pages found older than CcDirtyPageAge during last run
+ * - Lazy writer run counter, used for per-file fairness
+ */
+LARGE_INTEGER CcDirtyPageAge = RTL_CONSTANT_LARGE_INTEGER((LONGLONG)5*1000*1000*10);
+ULONG CcLazyWriteCoalescedIos = 0;
+ULONG CcLazyWriteThroughput = 0;
+ULONG CcLazyWriteTarget = 0;
+ULONG CcLazyWriteAgedPages = 0;
+ULONG CcLazyWritePass = 0;
+
 /* Internal vars (MS):
  * - Lazy writer status structure
  * - Lookaside list where to allocate work items
@@ -113,29 +128,96 @@ CcScanDpc(
     CcPostWorkQueue(WorkItem, &CcRegularWorkQueue);
 }
 
+static
+ULONG
+CcCalculateWriteBehindTarget(VOID)
+{
+    ULONG Target, Aged;
+    LONGLONG Now;
+    KIRQL OldIrql;
+    PLIST_ENTRY ListEntry;
+    PROS_VACB Vacb;
+
+    /* Count the pages that have been dirty for too long. VACBs are
+     * queued in the dirty list when they get dirty, so stop at the
+     * first young one.
+     */
+    Aged = 0;
+    Now = KeQueryInterruptTime();
+    OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
+    for (ListEntry = DirtyVacbListHead.Flink;
+         ListEntry != &DirtyVacbListHead;
+         ListEntry = ListEntry->Flink)
+    {
+        Vacb = CONTAINING_RECORD(ListEntry, ROS_VACB, DirtyVacbListEntry);
+        if (Now - Vacb->DirtyTime.QuadPart < CcDirtyPageAge.QuadPart)
+        {
+            break;
+        }
+
+        Aged += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
+    }
+    KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
+    CcLazyWriteAgedPages = Aged;
+
+    /* Default to one-eighth of the dirty pages, but get rid of old data */
+    Target = max(CcTotalDirtyPages / 8, Aged);
+
+    if (CcTotalDirtyPages > CcDirtyPageThreshold / 2)
+    {
+        /* Under pressure, bring the dirty pages back under half the threshold */
+        Target = max(Target, CcTotalDirtyPages - CcDirtyPageThreshold / 2);
+    }
+    else if (CcLazyWriteThroughput != 0)
+    {
+        /* Otherwise, don't ask more than what the disk absorbed during
+         * a lazy writer period (one second) to avoid write bursts
+         */
+        Target = min(Target, max(CcLazyWriteThroughput,
+                                 VACB_MAPPING_GRANULARITY / PAGE_SIZE));
+    }
+
+    return Target;
+}
+
 VOID
 CcWriteBehind(VOID)
 {
     ULONG Target, Count;
+    ULONGLONG Rate;
+    LONGLONG StartTime, Elapsed;
 
-    Target = CcTotalDirtyPages / 8;
+    Target = CcCalculateWriteBehindTarget();
+    CcLazyWriteTarget = Target;
     if (Target != 0)
     {
         /* Flush! */
         DPRINT("Lazy writer starting (%d)\n", Target);
+        StartTime = KeQueryInterruptTime();
         CcRosFlushDirtyPages(Target, &Count, FALSE, TRUE);
+        Elapsed = KeQueryInterruptTime() - StartTime;
 
         /* And update stats */
         CcLazyWritePages += Count;
         ++CcLazyWriteIos;
         DPRINT("Lazy writer done (%d)\n", Count);
+
+        /* Update the throughput estimate with the completion time of the writes */
+        if (Count != 0 && Elapsed > 0)
+        {
+            Rate = min((ULONGLONG)Count * 1000 * 1000 * 10 / Elapsed, MAXULONG);
+            if (CcLazyWriteThroughput != 0)
+            {
+                Rate = ((ULONGLONG)CcLazyWriteThroughput * 3 + Rate) / 4;
+            }
+            CcLazyWriteThroughput = (ULONG)Rate;
+        }
     }
 }
 
 VOID
 CcLazyWriteScan(VOID)
 {
-    ULONG Target;
     KIRQL OldIrql;
     PLIST_ENTRY ListEntry;
     LIST_ENTRY ToPost;
@@ -156,9 +238,8 @@ CcLazyWriteScan(VOID)
     }
     KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
 
-    /* Our target is one-eighth of the dirty pages */
-    Target = CcTotalDirtyPages / 8;
-    if (Target != 0)
+    /* CcWriteBehind() will decide how much to write */
+    if (CcTotalDirtyPages != 0)
     {
         /* There is stuff to flush, schedule a write-behind operation */
 
@@ -188,6 +269,11 @@ CcLazyWriteScan(VOID)
          */
         CcScheduleLazyWriteScan(FALSE);
     }
+    /* Keep running while there's dirty data, so that it doesn't age forever */
+    else if (CcTotalDirtyPages != 0)
+    {
+        CcScheduleLazyWriteScan(FALSE);
+    }
     else
     {
         /* We're no longer active */
@@ -303,7 +389,10 @@ CcWorkerThread(
         switch (WorkItem->Function)
         {
             case ReadAhead:
-                CcPerformReadAhead(WorkItem->Parameters.Read.FileObject);
+                CcPerformReadAhead(WorkItem->Parameters.Read.FileObject,
+                                   WorkItem->Parameters.Read.FileOffset.QuadPart,
+                                   WorkItem->Parameters.Read.Length,
+                                   WorkItem->Parameters.Read.Serial);
                 break;
 
             case WriteBehind:
@@ -28,10 +28,108 @@ CcMdlRead (
     OUT PIO_STATUS_BLOCK IoStatus
     )
 {
+    NTSTATUS Status;
+    LONGLONG CurrentOffset;
+    ULONG BytesRead;
+    ULONG PartialLength;
+    ULONG ViewOffset;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    PROS_VACB Vacb;
+    PVOID BaseAddress;
+    BOOLEAN Valid;
+    PMDL Mdl, FirstMdl = NULL, *NextMdl;
+
     CCTRACE(CC_API_DEBUG, "FileObject=%p FileOffset=%I64d Length=%lu\n",
         FileObject, FileOffset->QuadPart, Length);
 
-    UNIMPLEMENTED;
+    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    CurrentOffset = FileOffset->QuadPart;
+    BytesRead = 0;
+
+    /* New MDLs go at the end of the caller's chain */
+    NextMdl = MdlChain;
+    while (*NextMdl)
+        NextMdl = &(*NextMdl)->Next;
+
+    /* Lock the view pages of every piece, the MDLs keep them resident once the views are released */
+    while (Length > 0)
+    {
+        ViewOffset = CurrentOffset % VACB_MAPPING_GRANULARITY;
+        PartialLength = min(Length, VACB_MAPPING_GRANULARITY - ViewOffset);
+
+        Status = CcRosRequestVacb(SharedCacheMap,
+                                  CurrentOffset - ViewOffset,
+                                  &BaseAddress,
+                                  &Valid,
+                                  &Vacb);
+        if (!NT_SUCCESS(Status))
+            goto Failure;
+        if (!Valid)
+        {
+            Status = CcReadVirtualAddress(Vacb);
+            if (!NT_SUCCESS(Status))
+            {
+                CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE, FALSE);
+                goto Failure;
+            }
+        }
+
+        Mdl = IoAllocateMdl((PUCHAR)BaseAddress + ViewOffset, PartialLength, FALSE, FALSE, NULL);
+        if (!Mdl)
+        {
+            CcRosReleaseVacb(SharedCacheMap, Vacb, TRUE, FALSE, FALSE);
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Failure;
+        }
+
+        Status = STATUS_SUCCESS;
+        _SEH2_TRY
+        {
+            MmProbeAndLockPages(Mdl, KernelMode, IoReadAccess);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            Status = _SEH2_GetExceptionCode();
+        }
+        _SEH2_END;
+
+        CcRosReleaseVacb(SharedCacheMap, Vacb, TRUE, FALSE, FALSE);
+
+        if (!NT_SUCCESS(Status))
+        {
+            IoFreeMdl(Mdl);
+            goto Failure;
+        }
+
+        if (!FirstMdl)
+            FirstMdl = Mdl;
+        *NextMdl = Mdl;
+        NextMdl = &Mdl->Next;
+
+        Length -= PartialLength;
+        CurrentOffset += PartialLength;
+        BytesRead += PartialLength;
+    }
+
+    if (!BooleanFlagOn(FileObject->Flags, FO_RANDOM_ACCESS))
+    {
+        CcScheduleReadAhead(FileObject, FileOffset, BytesRead);
+    }
+
+    IoStatus->Status = STATUS_SUCCESS;
+    IoStatus->Information = BytesRead;
+    return;
+
+Failure:
+    /* Only give back what we added, the rest of the chain is the caller's */
+    if (FirstMdl)
+    {
+        for (NextMdl = MdlChain; *NextMdl != FirstMdl; NextMdl = &(*NextMdl)->Next);
+        *NextMdl = NULL;
+        CcMdlReadComplete2(FileObject, FirstMdl);
+    }
+
+    ExRaiseStatus(Status);
 }
 
 /*
@@ -101,10 +199,13 @@ CcMdlReadComplete (
     /* Check if we support Fast Calls, and check this one */
     if (FastDispatch && FastDispatch->MdlReadComplete)
     {
-         /* Use the fast path */
-        FastDispatch->MdlReadComplete(FileObject,
-                                      MdlChain,
-                                      DeviceObject);
+         /* Use the fast path, the chain is gone if it succeeds */
+        if (FastDispatch->MdlReadComplete(FileObject,
+                                          MdlChain,
+                                          DeviceObject))
+        {
+            return;
+        }
     }
 
     /* Use slow path */
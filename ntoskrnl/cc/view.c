@@ -62,6 +62,18 @@ LIST_ENTRY CcDeferredWrites;
 KSPIN_LOCK CcDeferredWriteSpinLock;
 LIST_ENTRY CcCleanSharedCacheMapList;
 
+/* VACB index counters:
+ * - Number of VACB lookups
+ * - Number of lookups which found a VACB
+ * - Number of index slots examined to keep the per-file VACB list sorted
+ */
+ULONG CcVacbLookups = 0;
+ULONG CcVacbLookupHits = 0;
+ULONG CcVacbIndexScans = 0;
+
+/* Serial of the last private cache map, protected by the master lock */
+static ULONG CcPrivateCacheMapSerial = 0;
+
 #if DBG
 ULONG CcRosVacbIncRefCount_(PROS_VACB vacb, PCSTR file, INT line)
 {
@@ -113,6 +125,183 @@ ULONG CcRosVacbGetRefCount_(PROS_VACB vacb, PCSTR file, INT line)
 
 /* FUNCTIONS *****************************************************************/
 
+/* Must be called with the CacheMapLock held */
+PROS_VACB
+CcRosVacbIndexLookup (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset)
+{
+    ULONG Key;
+    PROS_VACB_INDEX_LEAF Leaf;
+
+    Key = (ULONG)(FileOffset / VACB_MAPPING_GRANULARITY);
+    if ((Key >> VACB_INDEX_LEAF_SHIFT) >= SharedCacheMap->VacbIndexSize)
+    {
+        return NULL;
+    }
+
+    Leaf = SharedCacheMap->VacbIndex[Key >> VACB_INDEX_LEAF_SHIFT];
+    if (Leaf == NULL)
+    {
+        return NULL;
+    }
+
+    return Leaf->Vacbs[Key & VACB_INDEX_LEAF_MASK];
+}
+
+/* Must be called with the CacheMapLock held */
+static
+NTSTATUS
+CcRosVacbIndexInsert (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    PROS_VACB Vacb)
+{
+    ULONG Key, Slot, NewSize;
+    PROS_VACB_INDEX_LEAF *NewIndex;
+    PROS_VACB_INDEX_LEAF Leaf;
+
+    ASSERT(Vacb->FileOffset.QuadPart / VACB_MAPPING_GRANULARITY <= MAXULONG);
+
+    Key = (ULONG)(Vacb->FileOffset.QuadPart / VACB_MAPPING_GRANULARITY);
+    Slot = Key >> VACB_INDEX_LEAF_SHIFT;
+
+    /* Grow the directory so that it covers the slot */
+    if (Slot >= SharedCacheMap->VacbIndexSize)
+    {
+        NewSize = max(SharedCacheMap->VacbIndexSize, 4);
+        while (NewSize <= Slot)
+        {
+            NewSize *= 2;
+        }
+
+        NewIndex = ExAllocatePoolWithTag(NonPagedPool,
+                                         NewSize * sizeof(PROS_VACB_INDEX_LEAF),
+                                         TAG_VACB_INDEX);
+        if (NewIndex == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        RtlZeroMemory(NewIndex, NewSize * sizeof(PROS_VACB_INDEX_LEAF));
+        if (SharedCacheMap->VacbIndex != NULL)
+        {
+            RtlCopyMemory(NewIndex,
+                          SharedCacheMap->VacbIndex,
+                          SharedCacheMap->VacbIndexSize * sizeof(PROS_VACB_INDEX_LEAF));
+            ExFreePoolWithTag(SharedCacheMap->VacbIndex, TAG_VACB_INDEX);
+        }
+
+        SharedCacheMap->VacbIndex = NewIndex;
+        SharedCacheMap->VacbIndexSize = NewSize;
+    }
+
+    Leaf = SharedCacheMap->VacbIndex[Slot];
+    if (Leaf == NULL)
+    {
+        Leaf = ExAllocatePoolWithTag(NonPagedPool, sizeof(*Leaf), TAG_VACB_INDEX);
+        if (Leaf == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        RtlZeroMemory(Leaf, sizeof(*Leaf));
+        SharedCacheMap->VacbIndex[Slot] = Leaf;
+    }
+
+    ASSERT(Leaf->Vacbs[Key & VACB_INDEX_LEAF_MASK] == NULL);
+    Leaf->Vacbs[Key & VACB_INDEX_LEAF_MASK] = Vacb;
+    Leaf->Count++;
+    SharedCacheMap->VacbCount++;
+
+    return STATUS_SUCCESS;
+}
+
+/* Must be called with the CacheMapLock held */
+VOID
+CcRosVacbIndexRemove (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    PROS_VACB Vacb)
+{
+    ULONG Key, Slot;
+    PROS_VACB_INDEX_LEAF Leaf;
+
+    Key = (ULONG)(Vacb->FileOffset.QuadPart / VACB_MAPPING_GRANULARITY);
+    Slot = Key >> VACB_INDEX_LEAF_SHIFT;
+
+    ASSERT(Slot < SharedCacheMap->VacbIndexSize);
+    Leaf = SharedCacheMap->VacbIndex[Slot];
+    ASSERT(Leaf != NULL);
+    ASSERT(Leaf->Vacbs[Key & VACB_INDEX_LEAF_MASK] == Vacb);
+
+    Leaf->Vacbs[Key & VACB_INDEX_LEAF_MASK] = NULL;
+    SharedCacheMap->VacbCount--;
+
+    /* Release the leaf as soon as it no longer maps anything */
+    if (--Leaf->Count == 0)
+    {
+        SharedCacheMap->VacbIndex[Slot] = NULL;
+        ExFreePoolWithTag(Leaf, TAG_VACB_INDEX);
+    }
+}
+
+/*
+ * Returns the indexed VACB with the highest file offset below FileOffset.
+ * Used to keep CacheMapVacbListHead sorted. Must be called with the
+ * CacheMapLock held.
+ */
+static
+PROS_VACB
+CcRosVacbIndexFindPrevious (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset)
+{
+    ULONG Key, Slot, Entry;
+    PROS_VACB_INDEX_LEAF Leaf;
+
+    Key = (ULONG)(FileOffset / VACB_MAPPING_GRANULARITY);
+    Slot = Key >> VACB_INDEX_LEAF_SHIFT;
+    Entry = Key & VACB_INDEX_LEAF_MASK;
+
+    if (Slot >= SharedCacheMap->VacbIndexSize)
+    {
+        Slot = SharedCacheMap->VacbIndexSize;
+        Entry = 0;
+    }
+    else
+    {
+        Leaf = SharedCacheMap->VacbIndex[Slot];
+        while (Leaf != NULL && Entry > 0)
+        {
+            ++CcVacbIndexScans;
+            if (Leaf->Vacbs[--Entry] != NULL)
+            {
+                return Leaf->Vacbs[Entry];
+            }
+        }
+    }
+
+    /* Walk the previous leaves, skipping the unallocated ones */
+    while (Slot > 0)
+    {
+        Leaf = SharedCacheMap->VacbIndex[--Slot];
+        if (Leaf == NULL)
+        {
+            continue;
+        }
+
+        for (Entry = VACB_INDEX_LEAF_ENTRIES; Entry > 0; --Entry)
+        {
+            ++CcVacbIndexScans;
+            if (Leaf->Vacbs[Entry - 1] != NULL)
+            {
+                return Leaf->Vacbs[Entry - 1];
+            }
+        }
+    }
+
+    return NULL;
+}
+
 VOID
 NTAPI
 CcRosTraceCacheMap (
@@ -178,6 +367,138 @@ CcRosFlushVacb (
     return Status;
 }
 
+/*
+ * Gathers the dirty views following Vacb in the file, for the lazy writer
+ * to write them with a single I/O. Every view added to the run is referenced.
+ * Must be called with the master lock held.
+ */
+static
+ULONG
+CcRosGatherDirtyRun (
+    PROS_VACB Vacb,
+    PROS_VACB *Run)
+{
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    PROS_VACB Next;
+    LONGLONG Offset;
+    ULONG RunLength;
+
+    SharedCacheMap = Vacb->SharedCacheMap;
+    Run[0] = Vacb;
+    RunLength = 1;
+
+    KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
+    Offset = Vacb->FileOffset.QuadPart + VACB_MAPPING_GRANULARITY;
+    while (RunLength < CC_MAX_LAZY_WRITE_RUN &&
+           Offset < SharedCacheMap->SectionSize.QuadPart)
+    {
+        Next = CcRosVacbIndexLookup(SharedCacheMap, Offset);
+        if (Next == NULL || !Next->Dirty)
+        {
+            break;
+        }
+
+        CcRosVacbIncRefCount(Next);
+        Run[RunLength++] = Next;
+        Offset += VACB_MAPPING_GRANULARITY;
+    }
+    KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+
+    return RunLength;
+}
+
+static
+NTSTATUS
+CcRosFlushVacbRun (
+    PROS_VACB *Run,
+    ULONG RunLength,
+    PULONG Written)
+{
+    NTSTATUS Status;
+    KIRQL OldIrql;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    ULONG i;
+
+    SharedCacheMap = Run[0]->SharedCacheMap;
+
+    /* Someone may have flushed part of the run while the locks
+     * were released, only keep the views which are still dirty.
+     */
+    OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
+    KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
+    for (i = 0; i < RunLength; i++)
+    {
+        if (!Run[i]->Dirty)
+        {
+            break;
+        }
+
+        CcRosUnmarkDirtyVacb(Run[i], FALSE);
+    }
+    KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+    KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
+
+    *Written = i;
+    if (i == 0)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    Status = CcWriteVirtualAddressRun(Run, i);
+    if (!NT_SUCCESS(Status))
+    {
+        while (i-- > 0)
+        {
+            CcRosMarkDirtyVacb(Run[i]);
+        }
+    }
+    else if (*Written > 1)
+    {
+        ++CcLazyWriteCoalescedIos;
+    }
+
+    return Status;
+}
+
+/*
+ * Share the lazy writer target among the files with dirty data, so that
+ * a big writer doesn't starve the small ones. Must be called with the
+ * master lock held.
+ */
+static
+ULONG
+CcRosComputeLazyWriteQuota (
+    ULONG Target)
+{
+    PLIST_ENTRY ListEntry;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    ULONG DirtyFiles;
+
+    /* Start a new pass, that invalidates all the per-file counts */
+    ++CcLazyWritePass;
+
+    DirtyFiles = 0;
+    for (ListEntry = CcCleanSharedCacheMapList.Flink;
+         ListEntry != &CcCleanSharedCacheMapList;
+         ListEntry = ListEntry->Flink)
+    {
+        SharedCacheMap = CONTAINING_RECORD(ListEntry, ROS_SHARED_CACHE_MAP, SharedCacheMapLinks);
+        if (SharedCacheMap->DirtyPages != 0)
+        {
+            ++DirtyFiles;
+        }
+    }
+
+    if (DirtyFiles < 2)
+    {
+        return MAXULONG;
+    }
+
+    /* Always allow at least a full run per file */
+    return max(Target / DirtyFiles,
+               CC_MAX_LAZY_WRITE_RUN * (VACB_MAPPING_GRANULARITY / PAGE_SIZE));
+}
+
 NTSTATUS
 NTAPI
 CcRosFlushDirtyPages (
@@ -188,7 +509,10 @@ CcRosFlushDirtyPages (
 {
     PLIST_ENTRY current_entry;
     PROS_VACB current;
-    BOOLEAN Locked;
+    PROS_VACB Run[CC_MAX_LAZY_WRITE_RUN];
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    ULONG RunLength, Written, FileQuota, i;
+    BOOLEAN Locked, OverQuota;
     NTSTATUS Status;
     KIRQL OldIrql;
 
@@ -199,24 +523,48 @@ CcRosFlushDirtyPages (
     KeEnterCriticalRegion();
     OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
 
+    FileQuota = MAXULONG;
+    if (CalledFromLazy)
+    {
+        FileQuota = CcRosComputeLazyWriteQuota(Target);
+    }
+
     current_entry = DirtyVacbListHead.Flink;
     if (current_entry == &DirtyVacbListHead)
     {
         DPRINT("No Dirty pages\n");
     }
 
-    while ((current_entry != &DirtyVacbListHead) && (Target > 0))
+    OverQuota = FALSE;
+    while (TRUE)
     {
+        if ((current_entry == &DirtyVacbListHead) || (Target == 0))
+        {
+            /* Files which had their share didn't leave anything for the
+             * others, so let them use what remains of the target.
+             */
+            if (OverQuota && Target > 0)
+            {
+                FileQuota = MAXULONG;
+                OverQuota = FALSE;
+                current_entry = DirtyVacbListHead.Flink;
+                continue;
+            }
+
+            break;
+        }
+
         current = CONTAINING_RECORD(current_entry,
                                     ROS_VACB,
                                     DirtyVacbListEntry);
         current_entry = current_entry->Flink;
+        SharedCacheMap = current->SharedCacheMap;
 
         CcRosVacbIncRefCount(current);
 
         /* When performing lazy write, don't handle temporary files */
         if (CalledFromLazy &&
-            BooleanFlagOn(current->SharedCacheMap->FileObject->Flags, FO_TEMPORARY_FILE))
+            BooleanFlagOn(SharedCacheMap->FileObject->Flags, FO_TEMPORARY_FILE))
         {
             CcRosVacbDecRefCount(current);
             continue;
@@ -224,32 +572,67 @@ CcRosFlushDirtyPages (
 
         /* Don't attempt to lazy write the files that asked not to */
         if (CalledFromLazy &&
-            BooleanFlagOn(current->SharedCacheMap->Flags, WRITEBEHIND_DISABLED))
+            BooleanFlagOn(SharedCacheMap->Flags, WRITEBEHIND_DISABLED))
         {
             CcRosVacbDecRefCount(current);
             continue;
         }
 
+        /* Skip the files which already got their share of this pass */
+        if (CalledFromLazy)
+        {
+            if (SharedCacheMap->LazyWritePass != CcLazyWritePass)
+            {
+                SharedCacheMap->LazyWritePass = CcLazyWritePass;
+                SharedCacheMap->LazyWritePassPages = 0;
+            }
+
+            if (SharedCacheMap->LazyWritePassPages >= FileQuota)
+            {
+                OverQuota = TRUE;
+                CcRosVacbDecRefCount(current);
+                continue;
+            }
+        }
+
         ASSERT(current->Dirty);
 
+        /* The lazy writer merges the adjacent dirty views in a single write */
+        RunLength = 1;
+        Run[0] = current;
+        if (CalledFromLazy)
+        {
+            RunLength = CcRosGatherDirtyRun(current, Run);
+        }
+
         KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
 
-        Locked = current->SharedCacheMap->Callbacks->AcquireForLazyWrite(
-                     current->SharedCacheMap->LazyWriteContext, Wait);
+        Locked = SharedCacheMap->Callbacks->AcquireForLazyWrite(
+                     SharedCacheMap->LazyWriteContext, Wait);
         if (!Locked)
         {
             OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
-            CcRosVacbDecRefCount(current);
+            for (i = 0; i < RunLength; i++)
+            {
+                CcRosVacbDecRefCount(Run[i]);
+            }
             continue;
         }
 
-        Status = CcRosFlushVacb(current);
+        if (CalledFromLazy)
+        {
+            Status = CcRosFlushVacbRun(Run, RunLength, &Written);
+        }
+        else
+        {
+            Status = CcRosFlushVacb(current);
+            Written = 1;
+        }
 
-        current->SharedCacheMap->Callbacks->ReleaseFromLazyWrite(
-            current->SharedCacheMap->LazyWriteContext);
+        SharedCacheMap->Callbacks->ReleaseFromLazyWrite(
+            SharedCacheMap->LazyWriteContext);
 
         OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
-        CcRosVacbDecRefCount(current);
 
         if (!NT_SUCCESS(Status) && (Status != STATUS_END_OF_FILE) &&
             (Status != STATUS_MEDIA_WRITE_PROTECTED))
@@ -261,8 +644,12 @@ CcRosFlushDirtyPages (
             ULONG PagesFreed;
 
             /* How many pages did we free? */
-            PagesFreed = VACB_MAPPING_GRANULARITY / PAGE_SIZE;
+            PagesFreed = Written * (VACB_MAPPING_GRANULARITY / PAGE_SIZE);
             (*Count) += PagesFreed;
+            if (CalledFromLazy)
+            {
+                SharedCacheMap->LazyWritePassPages += PagesFreed;
+            }
 
             /* Make sure we don't overflow target! */
             if (Target < PagesFreed)
@@ -276,6 +663,11 @@ CcRosFlushDirtyPages (
             }
         }
 
+        for (i = 0; i < RunLength; i++)
+        {
+            CcRosVacbDecRefCount(Run[i]);
+        }
+
         current_entry = DirtyVacbListHead.Flink;
     }
 
@@ -363,6 +755,7 @@ retry:
             ASSERT(!current->MappedCount);
             ASSERT(Refs == 1);
 
+            CcRosVacbIndexRemove(current->SharedCacheMap, current);
             RemoveEntryList(&current->CacheMapVacbListEntry);
             RemoveEntryList(&current->VacbLruListEntry);
             InitializeListHead(&current->VacbLruListEntry);
@@ -459,7 +852,6 @@ CcRosLookupVacb (
     PROS_SHARED_CACHE_MAP SharedCacheMap,
     LONGLONG FileOffset)
 {
-    PLIST_ENTRY current_entry;
     PROS_VACB current;
     KIRQL oldIrql;
 
@@ -468,33 +860,22 @@ CcRosLookupVacb (
     DPRINT("CcRosLookupVacb(SharedCacheMap 0x%p, FileOffset %I64u)\n",
            SharedCacheMap, FileOffset);
 
-    oldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
-    KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
+    /* VACBs are only ever unlinked from the index with the CacheMapLock
+     * held, so there is no need for the master lock here.
+     */
+    KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &oldIrql);
 
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    ++CcVacbLookups;
+    current = CcRosVacbIndexLookup(SharedCacheMap, FileOffset);
+    if (current != NULL)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
-        {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
-            KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
-            return current;
-        }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+        ++CcVacbLookupHits;
+        CcRosVacbIncRefCount(current);
     }
 
-    KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
-    KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+    KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
 
-    return NULL;
+    return current;
 }
 
 VOID
@@ -513,6 +894,7 @@ CcRosMarkDirtyVacb (
     ASSERT(!Vacb->Dirty);
 
     InsertTailList(&DirtyVacbListHead, &Vacb->DirtyVacbListEntry);
+    Vacb->DirtyTime.QuadPart = KeQueryInterruptTime();
     CcTotalDirtyPages += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
     Vacb->SharedCacheMap->DirtyPages += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
     CcRosVacbIncRefCount(Vacb);
@@ -733,6 +1115,7 @@ CcRosFreeUnusedVacb (
             ASSERT(Refs == 1);
 
             /* Reset and move to free list */
+            CcRosVacbIndexRemove(current->SharedCacheMap, current);
             RemoveEntryList(&current->CacheMapVacbListEntry);
             RemoveEntryList(&current->VacbLruListEntry);
             InitializeListHead(&current->VacbLruListEntry);
@@ -784,7 +1167,6 @@ CcRosCreateVacb (
 {
     PROS_VACB current;
     PROS_VACB previous;
-    PLIST_ENTRY current_entry;
     NTSTATUS Status;
     KIRQL oldIrql;
     ULONG Refs;
@@ -805,6 +1187,7 @@ CcRosCreateVacb (
     current->Valid = FALSE;
     current->Dirty = FALSE;
     current->PageOut = FALSE;
+    current->ReadAhead = FALSE;
     current->FileOffset.QuadPart = ROUND_DOWN(FileOffset, VACB_MAPPING_GRANULARITY);
     current->SharedCacheMap = SharedCacheMap;
 #if DBG
@@ -853,48 +1236,46 @@ Retry:
      * our newly created VACB and return the existing one.
      */
     KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    previous = NULL;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    current = CcRosVacbIndexLookup(SharedCacheMap, FileOffset);
+    if (current != NULL)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
-        {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+        CcRosVacbIncRefCount(current);
+        KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
 #if DBG
-            if (SharedCacheMap->Trace)
-            {
-                DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
-                        SharedCacheMap,
-                        (*Vacb),
-                        current);
-            }
+        if (SharedCacheMap->Trace)
+        {
+            DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
+                    SharedCacheMap,
+                    (*Vacb),
+                    current);
+        }
 #endif
-            KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+        KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
 
-            Refs = CcRosVacbDecRefCount(*Vacb);
-            ASSERT(Refs == 0);
+        Refs = CcRosVacbDecRefCount(*Vacb);
+        ASSERT(Refs == 0);
 
-            *Vacb = current;
-            return STATUS_SUCCESS;
-        }
-        if (current->FileOffset.QuadPart < FileOffset)
-        {
-            ASSERT(previous == NULL ||
-                   previous->FileOffset.QuadPart < current->FileOffset.QuadPart);
-            previous = current;
-        }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+        *Vacb = current;
+        return STATUS_SUCCESS;
     }
     /* There was no existing VACB. */
     current = *Vacb;
+    Status = CcRosVacbIndexInsert(SharedCacheMap, current);
+    if (!NT_SUCCESS(Status))
+    {
+        KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+        KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+
+        Refs = CcRosVacbDecRefCount(current);
+        ASSERT(Refs == 0);
+
+        *Vacb = NULL;
+        return Status;
+    }
+    /* Keep the per-file list sorted, CcPurgeCacheSection relies on it */
+    previous = CcRosVacbIndexFindPrevious(SharedCacheMap, current->FileOffset.QuadPart);
+    ASSERT(previous == NULL ||
+           previous->FileOffset.QuadPart < current->FileOffset.QuadPart);
     if (previous)
     {
         InsertHeadList(&previous->CacheMapVacbListEntry, &current->CacheMapVacbListEntry);
@@ -1189,9 +1570,10 @@ CcRosDeleteFileCache (
         while (!IsListEmpty(&SharedCacheMap->CacheMapVacbListHead))
         {
             current_entry = RemoveTailList(&SharedCacheMap->CacheMapVacbListHead);
+            current = CONTAINING_RECORD(current_entry, ROS_VACB, CacheMapVacbListEntry);
+            CcRosVacbIndexRemove(SharedCacheMap, current);
             KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
 
-            current = CONTAINING_RECORD(current_entry, ROS_VACB, CacheMapVacbListEntry);
             RemoveEntryList(&current->VacbLruListEntry);
             InitializeListHead(&current->VacbLruListEntry);
             if (current->Dirty)
@@ -1214,6 +1596,14 @@ CcRosDeleteFileCache (
 #if DBG
         SharedCacheMap->Trace = FALSE;
 #endif
+        /* All the leaves went away with their last VACB, drop the directory */
+        ASSERT(SharedCacheMap->VacbCount == 0);
+        if (SharedCacheMap->VacbIndex != NULL)
+        {
+            ExFreePoolWithTag(SharedCacheMap->VacbIndex, TAG_VACB_INDEX);
+            SharedCacheMap->VacbIndex = NULL;
+            SharedCacheMap->VacbIndexSize = 0;
+        }
         KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
 
         KeReleaseQueuedSpinLock(LockQueueMasterLock, *OldIrql);
@@ -1339,7 +1729,7 @@ CcRosReleaseFileCache (
  */
 {
     KIRQL OldIrql;
-    PPRIVATE_CACHE_MAP PrivateMap;
+    PROS_PRIVATE_CACHE_MAP PrivateMap;
     PROS_SHARED_CACHE_MAP SharedCacheMap;
 
     OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
@@ -1460,12 +1850,12 @@ CcRosInitializeFileCache (
     }
     if (FileObject->PrivateCacheMap == NULL)
     {
-        PPRIVATE_CACHE_MAP PrivateMap;
+        PROS_PRIVATE_CACHE_MAP PrivateMap;
 
         /* Allocate the private cache map for this handle */
         if (SharedCacheMap->PrivateCacheMap.NodeTypeCode != 0)
         {
-            PrivateMap = ExAllocatePoolWithTag(NonPagedPool, sizeof(PRIVATE_CACHE_MAP), TAG_PRIVATE_CACHE_MAP);
+            PrivateMap = ExAllocatePoolWithTag(NonPagedPool, sizeof(ROS_PRIVATE_CACHE_MAP), TAG_PRIVATE_CACHE_MAP);
         }
         else
         {
@@ -1489,10 +1879,11 @@ CcRosInitializeFileCache (
         }
 
         /* Initialize it */
-        RtlZeroMemory(PrivateMap, sizeof(PRIVATE_CACHE_MAP));
+        RtlZeroMemory(PrivateMap, sizeof(ROS_PRIVATE_CACHE_MAP));
         PrivateMap->NodeTypeCode = NODE_TYPE_PRIVATE_MAP;
         PrivateMap->ReadAheadMask = PAGE_SIZE - 1;
         PrivateMap->FileObject = FileObject;
+        PrivateMap->ReadAheadSerial = ++CcPrivateCacheMapSerial;
         KeInitializeSpinLock(&PrivateMap->ReadAheadSpinLock);
 
         /* Link it to the file */
@@ -1577,7 +1968,7 @@ ExpKdbgExtFileCache(ULONG Argc, PCHAR Argv[])
     UNICODE_STRING NoName = RTL_CONSTANT_STRING(L"No name for File");
 
     KdbpPrint("  Usage Summary (in kb)\n");
-    KdbpPrint("Shared\t\tValid\tDirty\tName\n");
+    KdbpPrint("Shared\t\tValid\tDirty\tViews\tName\n");
     /* No need to lock the spin lock here, we're in DBG */
     for (ListEntry = CcCleanSharedCacheMapList.Flink;
          ListEntry != &CcCleanSharedCacheMapList;
@@ -1629,9 +2020,15 @@ ExpKdbgExtFileCache(ULONG Argc, PCHAR Argv[])
         }
 
         /* And print */
-        KdbpPrint("%p\t%d\t%d\t%wZ%S\n", SharedCacheMap, Valid, Dirty, FileName, Extra);
+        KdbpPrint("%p\t%d\t%d\t%lu\t%wZ%S\n", SharedCacheMap, Valid, Dirty,
+                  SharedCacheMap->VacbCount, FileName, Extra);
     }
 
+    KdbpPrint("VACB lookups:\t%lu (%lu hits)\n", CcVacbLookups, CcVacbLookupHits);
+    KdbpPrint("VACB index slots scanned on insert:\t%lu\n", CcVacbIndexScans);
+    KdbpPrint("Read ahead:\t%lu Ios (%lu hits, %lu misses)\n", CcReadAheadIos,
+              CcReadAheadHits, CcReadAheadMisses);
+
     return TRUE;
 }
 
@@ -1642,6 +2039,12 @@ ExpKdbgExtDefWrites(ULONG Argc, PCHAR Argv[])
               (CcTotalDirtyPages * PAGE_SIZE) / 1024);
     KdbpPrint("CcDirtyPageThreshold:\t%lu (%lu Kb)\n", CcDirtyPageThreshold,
               (CcDirtyPageThreshold * PAGE_SIZE) / 1024);
+    KdbpPrint("CcLazyWritePages:\t%lu (%lu Ios, %lu coalesced)\n", CcLazyWritePages,
+              CcLazyWriteIos, CcLazyWriteCoalescedIos);
+    KdbpPrint("CcLazyWriteTarget:\t%lu (%lu aged pages)\n", CcLazyWriteTarget,
+              CcLazyWriteAgedPages);
+    KdbpPrint("CcLazyWriteThroughput:\t%lu pages/s (%lu Kb/s)\n", CcLazyWriteThroughput,
+              (CcLazyWriteThroughput * (PAGE_SIZE / 1024)));
     KdbpPrint("MmAvailablePages:\t%lu (%lu Kb)\n", MmAvailablePages,
               (MmAvailablePages * PAGE_SIZE) / 1024);
     KdbpPrint("MmThrottleTop:\t\t%lu (%lu Kb)\n", MmThrottleTop,
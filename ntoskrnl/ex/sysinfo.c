@@ -796,7 +796,7 @@ QSI_DEF(SystemPerformanceInformation)
     Spi->CcMdlReadWait = 0; /* FIXME */
     Spi->CcMdlReadNoWaitMiss = 0; /* FIXME */
     Spi->CcMdlReadWaitMiss = 0; /* FIXME */
-    Spi->CcReadAheadIos = 0; /* FIXME */
+    Spi->CcReadAheadIos = CcReadAheadIos;
     Spi->CcLazyWriteIos = CcLazyWriteIos;
     Spi->CcLazyWritePages = CcLazyWritePages;
     Spi->CcDataFlushes = CcDataFlushes;
@@ -1852,18 +1852,18 @@ QSI_DEF(SystemContextSwitchInformation)
 
     ContextSwitchInformation->ContextSwitches = ContextSwitches;
 
-    /* FIXME */
-    ContextSwitchInformation->FindAny = 0;
-    ContextSwitchInformation->FindLast = 0;
-    ContextSwitchInformation->FindIdeal = 0;
-    ContextSwitchInformation->IdleAny = 0;
-    ContextSwitchInformation->IdleCurrent = 0;
-    ContextSwitchInformation->IdleLast = 0;
-    ContextSwitchInformation->IdleIdeal = 0;
-    ContextSwitchInformation->PreemptAny = 0;
-    ContextSwitchInformation->PreemptCurrent = 0;
-    ContextSwitchInformation->PreemptLast = 0;
-    ContextSwitchInformation->SwitchToIdle = 0;
+    /* Copy the scheduler's thread placement counters */
+    ContextSwitchInformation->FindAny = KiThreadSwitchCounters.FindAny;
+    ContextSwitchInformation->FindLast = KiThreadSwitchCounters.FindLast;
+    ContextSwitchInformation->FindIdeal = KiThreadSwitchCounters.FindIdeal;
+    ContextSwitchInformation->IdleAny = KiThreadSwitchCounters.IdleAny;
+    ContextSwitchInformation->IdleCurrent = KiThreadSwitchCounters.IdleCurrent;
+    ContextSwitchInformation->IdleLast = KiThreadSwitchCounters.IdleLast;
+    ContextSwitchInformation->IdleIdeal = KiThreadSwitchCounters.IdleIdeal;
+    ContextSwitchInformation->PreemptAny = KiThreadSwitchCounters.PreemptAny;
+    ContextSwitchInformation->PreemptCurrent = KiThreadSwitchCounters.PreemptCurrent;
+    ContextSwitchInformation->PreemptLast = KiThreadSwitchCounters.PreemptLast;
+    ContextSwitchInformation->SwitchToIdle = KiThreadSwitchCounters.SwitchToIdle;
 
     return STATUS_SUCCESS;
 }
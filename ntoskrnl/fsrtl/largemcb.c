@@ -512,9 +512,40 @@ FsRtlLookupBaseMcbEntry(IN PBASE_MCB OpaqueMcb,
     BOOLEAN Result = FALSE;
     ULONG i;
     LONGLONG LastVbn = 0, LastLbn = 0, Count = 0;   // the last values we've found during traversal
+    PBASE_MCB_INTERNAL Mcb = (PBASE_MCB_INTERNAL)OpaqueMcb;
+    LARGE_MCB_MAPPING_ENTRY NeedleRun;
+    PLARGE_MCB_MAPPING_ENTRY Run;
 
     DPRINT("FsRtlLookupBaseMcbEntry(%p, %I64d, %p, %p, %p, %p, %p)\n", OpaqueMcb, Vbn, Lbn, SectorCountFromLbn, StartingLbn, SectorCountFromStartingLbn, Index);
 
+    /* Unless the caller wants the index, find the run in the tree instead of
+     * enumerating all the ones before it. Holes aren't stored in the tree,
+     * so those still go through the enumeration below */
+    if (!Index)
+    {
+        NeedleRun.RunStartVbn.QuadPart = Vbn;
+        NeedleRun.RunEndVbn.QuadPart = Vbn + 1;
+        NeedleRun.StartingLbn.QuadPart = ~0ULL;
+        Mcb->Mapping->Table.CompareRoutine = McbMappingIntersectCompare;
+        Run = RtlLookupElementGenericTable(&Mcb->Mapping->Table, &NeedleRun);
+        Mcb->Mapping->Table.CompareRoutine = McbMappingCompare;
+
+        if (Run)
+        {
+            if (Lbn)
+                *Lbn = Run->StartingLbn.QuadPart + (Vbn - Run->RunStartVbn.QuadPart);
+            if (SectorCountFromLbn)
+                *SectorCountFromLbn = Run->RunEndVbn.QuadPart - Vbn;
+            if (StartingLbn)
+                *StartingLbn = Run->StartingLbn.QuadPart;
+            if (SectorCountFromStartingLbn)
+                *SectorCountFromStartingLbn = Run->RunEndVbn.QuadPart - Run->RunStartVbn.QuadPart;
+
+            Result = TRUE;
+            goto quit;
+        }
+    }
+
     for (i = 0; FsRtlGetNextBaseMcbEntry(OpaqueMcb, i, &LastVbn, &LastLbn, &Count); i++)
     {
         // have we reached the target mapping?
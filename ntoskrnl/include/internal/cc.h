@@ -58,6 +58,14 @@ extern LARGE_INTEGER CcIdleDelay;
 //
 extern ULONG CcLazyWritePages;
 extern ULONG CcLazyWriteIos;
+extern ULONG CcLazyWriteCoalescedIos;
+extern ULONG CcLazyWriteThroughput;
+extern ULONG CcLazyWriteTarget;
+extern ULONG CcLazyWriteAgedPages;
+extern ULONG CcLazyWritePass;
+extern ULONG CcReadAheadIos;
+extern ULONG CcReadAheadHits;
+extern ULONG CcReadAheadMisses;
 extern ULONG CcMapDataWait;
 extern ULONG CcMapDataNoWait;
 extern ULONG CcPinReadWait;
@@ -65,6 +73,9 @@ extern ULONG CcPinReadNoWait;
 extern ULONG CcPinMappedDataCount;
 extern ULONG CcDataPages;
 extern ULONG CcDataFlushes;
+extern ULONG CcVacbLookups;
+extern ULONG CcVacbLookupHits;
+extern ULONG CcVacbIndexScans;
 
 typedef struct _PF_SCENARIO_ID
 {
@@ -167,6 +178,57 @@ typedef struct _PFSN_PREFETCHER_GLOBALS
     LONG ActivePrefetches;
 } PFSN_PREFETCHER_GLOBALS, *PPFSN_PREFETCHER_GLOBALS;
 
+/*
+ * VACBs of a shared cache map are indexed by FileOffset / VACB_MAPPING_GRANULARITY
+ * in a sparse two-level table: a directory of leaves, each covering
+ * VACB_INDEX_LEAF_ENTRIES consecutive views. Leaves are only allocated for
+ * the ranges of the file that actually have views.
+ */
+#define VACB_INDEX_LEAF_SHIFT   7
+#define VACB_INDEX_LEAF_ENTRIES (1 << VACB_INDEX_LEAF_SHIFT)
+#define VACB_INDEX_LEAF_MASK    (VACB_INDEX_LEAF_ENTRIES - 1)
+
+typedef struct _ROS_VACB_INDEX_LEAF
+{
+    ULONG Count;
+    struct _ROS_VACB *Vacbs[VACB_INDEX_LEAF_ENTRIES];
+} ROS_VACB_INDEX_LEAF, *PROS_VACB_INDEX_LEAF;
+
+/*
+ * Layout compatible with PRIVATE_CACHE_MAP, which is only known by the
+ * file systems through FileObject->PrivateCacheMap being set.
+ */
+typedef struct _ROS_PRIVATE_CACHE_MAP
+{
+    union
+    {
+        CSHORT NodeTypeCode;
+        PRIVATE_CACHE_MAP_FLAGS Flags;
+        ULONG UlongFlags;
+    };
+    ULONG ReadAheadMask;
+    PFILE_OBJECT FileObject;
+    LARGE_INTEGER FileOffset1;
+    LARGE_INTEGER BeyondLastByte1;
+    LARGE_INTEGER FileOffset2;
+    LARGE_INTEGER BeyondLastByte2;
+    LARGE_INTEGER ReadAheadOffset[2];
+    ULONG ReadAheadLength[2];
+    KSPIN_LOCK ReadAheadSpinLock;
+    LIST_ENTRY PrivateLinks;
+    PVOID ReadAheadWorkItem;
+
+    /* ROS specific */
+    ULONG ReadAheadWindow; /* Current read ahead window in bytes, 0 when the stream looks random */
+    LONGLONG ReadAheadStride; /* Distance between two reads of a strided stream, 0 if sequential */
+    ULONG ReadAheadsInFlight; /* Number of posted read ahead work items */
+    ULONG ReadAheadSerial; /* Tells this map apart from earlier private maps of the file object */
+} ROS_PRIVATE_CACHE_MAP, *PROS_PRIVATE_CACHE_MAP;
+
+#define CC_MIN_READ_AHEAD_WINDOW    (VACB_MAPPING_GRANULARITY / 4)
+#define CC_MAX_READ_AHEAD_WINDOW    (8 * VACB_MAPPING_GRANULARITY)
+#define CC_MAX_READ_AHEAD_IN_FLIGHT 8
+
 typedef struct _ROS_SHARED_CACHE_MAP
 {
     CSHORT NodeTypeCode;
@@ -184,10 +246,15 @@ typedef struct _ROS_SHARED_CACHE_MAP
     LIST_ENTRY PrivateList;
     ULONG DirtyPageThreshold;
     KSPIN_LOCK BcbSpinLock;
-    PRIVATE_CACHE_MAP PrivateCacheMap;
+    ROS_PRIVATE_CACHE_MAP PrivateCacheMap;
 
     /* ROS specific */
     LIST_ENTRY CacheMapVacbListHead;
+    PROS_VACB_INDEX_LEAF *VacbIndex; /* Protected by CacheMapLock */
+    ULONG VacbIndexSize;
+    ULONG VacbCount;
+    ULONG LazyWritePass; /* Lazy writer pass for which LazyWritePassPages is valid */
+    ULONG LazyWritePassPages;
     BOOLEAN PinAccess;
     KSPIN_LOCK CacheMapLock;
 #if DBG
@@ -198,6 +265,9 @@ typedef struct _ROS_SHARED_CACHE_MAP
 #define READAHEAD_DISABLED 0x1
 #define WRITEBEHIND_DISABLED 0x2
 
+/* Maximum number of adjacent dirty views the lazy writer merges in a single write */
+#define CC_MAX_LAZY_WRITE_RUN 4
+
 typedef struct _ROS_VACB
 {
     /* Base address of the region where the view's data is mapped. */
@@ -210,6 +280,8 @@ typedef struct _ROS_VACB
     BOOLEAN Dirty;
     /* Page out in progress */
     BOOLEAN PageOut;
+    /* Was the view brought in by read ahead, and not read since. */
+    BOOLEAN ReadAhead;
     ULONG MappedCount;
     /* Entry in the list of VACBs for this shared cache map. */
     LIST_ENTRY CacheMapVacbListEntry;
@@ -219,6 +291,8 @@ typedef struct _ROS_VACB
     LIST_ENTRY VacbLruListEntry;
     /* Offset in the file which this view maps. */
     LARGE_INTEGER FileOffset;
+    /* Interrupt time at which the view was last made dirty. */
+    LARGE_INTEGER DirtyTime;
     /* Number of references. */
     volatile ULONG ReferenceCount;
     /* Pointer to the shared cache map for the file which this view maps data for. */
@@ -255,6 +329,9 @@ typedef struct _WORK_QUEUE_ENTRY
         struct
         {
             FILE_OBJECT *FileObject;
+            LARGE_INTEGER FileOffset;
+            ULONG Length;
+            ULONG Serial;
         } Read;
         struct
         {
@@ -340,6 +417,13 @@ NTSTATUS
 NTAPI
 CcWriteVirtualAddress(PROS_VACB Vacb);
 
+NTSTATUS
+NTAPI
+CcWriteVirtualAddressRun(
+    PROS_VACB *Vacbs,
+    ULONG Count
+);
+
 INIT_FUNCTION
 BOOLEAN
 NTAPI
@@ -468,12 +552,25 @@ CcPostWorkQueue(
 
 VOID
 CcPerformReadAhead(
-    IN PFILE_OBJECT FileObject);
+    IN PFILE_OBJECT FileObject,
+    IN LONGLONG FileOffset,
+    IN ULONG Length,
+    IN ULONG Serial);
 
 NTSTATUS
 CcRosInternalFreeVacb(
     IN PROS_VACB Vacb);
 
+PROS_VACB
+CcRosVacbIndexLookup(
+    IN PROS_SHARED_CACHE_MAP SharedCacheMap,
+    IN LONGLONG FileOffset);
+
+VOID
+CcRosVacbIndexRemove(
+    IN PROS_SHARED_CACHE_MAP SharedCacheMap,
+    IN PROS_VACB Vacb);
+
 FORCEINLINE
 BOOLEAN
 DoRangesIntersect(
@@ -78,6 +78,21 @@ typedef struct _KNMI_HANDLER_CALLBACK
     PVOID Handle;
 } KNMI_HANDLER_CALLBACK, *PKNMI_HANDLER_CALLBACK;
 
+typedef struct _KTHREAD_SWITCH_COUNTERS
+{
+    ULONG FindAny;
+    ULONG FindIdeal;
+    ULONG FindLast;
+    ULONG IdleAny;
+    ULONG IdleCurrent;
+    ULONG IdleIdeal;
+    ULONG IdleLast;
+    ULONG PreemptAny;
+    ULONG PreemptCurrent;
+    ULONG PreemptLast;
+    ULONG SwitchToIdle;
+} KTHREAD_SWITCH_COUNTERS, *PKTHREAD_SWITCH_COUNTERS;
+
 typedef PCHAR
 (NTAPI *PKE_BUGCHECK_UNICODE_TO_ANSI)(
     IN PUNICODE_STRING Unicode,
@@ -134,6 +149,8 @@ extern KEVENT KiSwapEvent;
 extern PKPRCB KiProcessorBlock[];
 extern ULONG KiMask32Array[MAXIMUM_PRIORITY];
 extern ULONG_PTR KiIdleSummary;
+extern ULONG_PTR KiIdleSMTSummary;
+extern KTHREAD_SWITCH_COUNTERS KiThreadSwitchCounters;
 extern PVOID KeUserApcDispatcher;
 extern PVOID KeUserCallbackDispatcher;
 extern PVOID KeUserExceptionDispatcher;
@@ -815,6 +832,11 @@ FASTCALL
 KeZeroPages(IN PVOID Address,
             IN ULONG Size);
 
+VOID
+FASTCALL
+KeZeroPagesNonTemporal(IN PVOID Address,
+                       IN ULONG Size);
+
 BOOLEAN
 FASTCALL
 KeInvalidAccessAllowed(IN PVOID TrapInformation OPTIONAL);
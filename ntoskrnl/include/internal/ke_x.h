@@ -1403,6 +1403,52 @@ KxQueueReadyThread(IN PKTHREAD Thread,
     }
 }
 
+//
+// This routine marks the processor as idle in the idle summary, and its whole
+// SMT set as idle once every logical processor in it is.
+//
+FORCEINLINE
+VOID
+KiSetIdleSummary(IN PKPRCB Prcb)
+{
+#ifdef _WIN64
+    InterlockedOr64((PLONG64)&KiIdleSummary, Prcb->SetMember);
+    if ((KiIdleSummary & Prcb->MultiThreadProcessorSet) ==
+        Prcb->MultiThreadProcessorSet)
+    {
+        InterlockedOr64((PLONG64)&KiIdleSMTSummary,
+                        Prcb->MultiThreadProcessorSet);
+    }
+#else
+    InterlockedOr((PLONG)&KiIdleSummary, Prcb->SetMember);
+    if ((KiIdleSummary & Prcb->MultiThreadProcessorSet) ==
+        Prcb->MultiThreadProcessorSet)
+    {
+        InterlockedOr((PLONG)&KiIdleSMTSummary,
+                      Prcb->MultiThreadProcessorSet);
+    }
+#endif
+}
+
+//
+// This routine removes the processor, and therefore its SMT set, from the
+// idle summaries once it has been handed a thread to run.
+//
+FORCEINLINE
+VOID
+KiClearIdleSummary(IN PKPRCB Prcb)
+{
+#ifdef _WIN64
+    InterlockedAnd64((PLONG64)&KiIdleSummary, ~(LONG64)Prcb->SetMember);
+    InterlockedAnd64((PLONG64)&KiIdleSMTSummary,
+                     ~(LONG64)Prcb->MultiThreadProcessorSet);
+#else
+    InterlockedAnd((PLONG)&KiIdleSummary, ~(LONG)Prcb->SetMember);
+    InterlockedAnd((PLONG)&KiIdleSMTSummary,
+                   ~(LONG)Prcb->MultiThreadProcessorSet);
+#endif
+}
+
 //
 // This routine scans for an appropriate ready thread to select at the
 // given priority and for the given CPU.
@@ -1015,6 +1015,10 @@ NTAPI
 MiMapPagesInZeroSpace(IN PMMPFN Pfn1,
                       IN PFN_NUMBER NumberOfPages);
 
+BOOLEAN
+NTAPI
+MiReserveZeroingPtes(IN ULONG Processor);
+
 VOID
 NTAPI
 MiUnmapPagesInZeroSpace(IN PVOID VirtualAddress,
@@ -52,10 +52,16 @@ KiDpcInterruptHandler(VOID)
     }
     else if (Prcb->NextThread)
     {
+        /* Lock the PRCB while we switch threads */
+        KiAcquirePrcbLock(Prcb);
+
         /* Capture current thread data */
         OldThread = Prcb->CurrentThread;
         NewThread = Prcb->NextThread;
 
+        /* Nobody may run the old thread until we're off its stack */
+        KiSetThreadSwapBusy(OldThread);
+
         /* Set new thread data */
         Prcb->NextThread = NULL;
         Prcb->CurrentThread = NewThread;
@@ -64,7 +70,7 @@ KiDpcInterruptHandler(VOID)
         NewThread->State = Running;
         OldThread->WaitReason = WrDispatchInt;
 
-        /* Make the old thread ready */
+        /* Make the old thread ready, this releases the PRCB lock */
         KxQueueReadyThread(OldThread, Prcb);
 
         /* Swap to the new thread */
@@ -86,6 +92,34 @@ KeZeroPages(IN PVOID Address,
     RtlZeroMemory(Address, Size);
 }
 
+VOID
+FASTCALL
+KeZeroPagesNonTemporal(IN PVOID Address,
+                       IN ULONG Size)
+{
+    PULONG64 Pointer, End;
+
+    /* Only whole 32 byte blocks are zeroed with the fast loop */
+    if (Size & 31)
+    {
+        RtlZeroMemory(Address, Size);
+        return;
+    }
+
+    /* Bypass the cache, these pages are not going to be used soon */
+    End = (PULONG64)((ULONG_PTR)Address + Size);
+    for (Pointer = Address; Pointer < End; Pointer += 4)
+    {
+        _mm_stream_si64x((__int64*)&Pointer[0], 0);
+        _mm_stream_si64x((__int64*)&Pointer[1], 0);
+        _mm_stream_si64x((__int64*)&Pointer[2], 0);
+        _mm_stream_si64x((__int64*)&Pointer[3], 0);
+    }
+
+    /* Make the stores visible before the pages are handed out */
+    _mm_sfence();
+}
+
 PVOID
 NTAPI
 KeSwitchKernelStack(PVOID StackBase, PVOID StackLimit)
@@ -136,12 +170,29 @@ KiIdleLoop(VOID)
             KiRetireDpcList(Prcb);
         }
 
+#ifdef CONFIG_SMP
+        /* Check if we should look for work on the other processors */
+        if (Prcb->IdleSchedule)
+        {
+            /* Do it with interrupts on, since it spins on their locks */
+            _enable();
+            KiIdleSchedule(Prcb);
+            _disable();
+        }
+#endif
+
         /* Check if a new thread is scheduled for execution */
         if (Prcb->NextThread)
         {
             /* Enable interrupts */
             _enable();
 
+#ifdef CONFIG_SMP
+            /* Lock the PRCB so the standby thread can't be replaced */
+            KiAcquirePrcbLock(Prcb);
+            KiClearIdleSummary(Prcb);
+#endif
+
             /* Capture current thread data */
             OldThread = Prcb->CurrentThread;
             NewThread = Prcb->NextThread;
@@ -152,6 +203,9 @@ KiIdleLoop(VOID)
 
             /* The thread is now running */
             NewThread->State = Running;
+#ifdef CONFIG_SMP
+            KiReleasePrcbLock(Prcb);
+#endif
 
             /* Do the swap at SYNCH_LEVEL */
             KfRaiseIrql(SYNCH_LEVEL);
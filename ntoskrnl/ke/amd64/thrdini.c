@@ -144,6 +144,11 @@ KiSwapContextResume(
     PKIPCR Pcr = (PKIPCR)KeGetPcr();
     PKPROCESS OldProcess, NewProcess;
 
+#ifdef CONFIG_SMP
+    /* We are off the old thread's stack, so another CPU may now run it */
+    OldThread->SwapBusy = FALSE;
+#endif
+
     /* Setup ring 0 stack pointer */
     Pcr->TssBase->Rsp0 = (ULONG64)NewThread->InitialStack; // FIXME: NPX save area?
     Pcr->Prcb.RspBase = Pcr->TssBase->Rsp0;
@@ -1138,6 +1138,34 @@ KeZeroPages(IN PVOID Address,
     RtlZeroMemory(Address, Size);
 }
 
+VOID
+FASTCALL
+KeZeroPagesNonTemporal(IN PVOID Address,
+                       IN ULONG Size)
+{
+    PULONG Pointer, End;
+
+    /* Non-temporal stores need SSE2 */
+    if (!(KeFeatureBits & KF_XMMI64) || (Size & 15))
+    {
+        RtlZeroMemory(Address, Size);
+        return;
+    }
+
+    /* Bypass the cache, these pages are not going to be used soon */
+    End = (PULONG)((ULONG_PTR)Address + Size);
+    for (Pointer = Address; Pointer < End; Pointer += 4)
+    {
+        _mm_stream_si32((int*)&Pointer[0], 0);
+        _mm_stream_si32((int*)&Pointer[1], 0);
+        _mm_stream_si32((int*)&Pointer[2], 0);
+        _mm_stream_si32((int*)&Pointer[3], 0);
+    }
+
+    /* Make the stores visible before the pages are handed out */
+    _mm_sfence();
+}
+
 VOID
 NTAPI
 KiSaveProcessorState(IN PKTRAP_FRAME TrapFrame,
@@ -294,12 +294,29 @@ KiIdleLoop(VOID)
             KiRetireDpcList(Prcb);
         }
 
+#ifdef CONFIG_SMP
+        /* Check if we should look for work on the other processors */
+        if (Prcb->IdleSchedule)
+        {
+            /* Do it with interrupts on, since it spins on their locks */
+            _enable();
+            KiIdleSchedule(Prcb);
+            _disable();
+        }
+#endif
+
         /* Check if a new thread is scheduled for execution */
         if (Prcb->NextThread)
         {
             /* Enable interrupts */
             _enable();
 
+#ifdef CONFIG_SMP
+            /* Lock the PRCB so the standby thread can't be replaced */
+            KiAcquirePrcbLock(Prcb);
+            KiClearIdleSummary(Prcb);
+#endif
+
             /* Capture current thread data */
             OldThread = Prcb->CurrentThread;
             NewThread = Prcb->NextThread;
@@ -310,6 +327,9 @@ KiIdleLoop(VOID)
 
             /* The thread is now running */
             NewThread->State = Running;
+#ifdef CONFIG_SMP
+            KiReleasePrcbLock(Prcb);
+#endif
 
             /* Switch away from the idle thread */
             KiSwapContext(APC_LEVEL, OldThread);
@@ -334,6 +354,11 @@ KiSwapContextExit(IN PKTHREAD OldThread,
     /* We are on the new thread stack now */
     NewThread = Pcr->PrcbData.CurrentThread;
 
+#ifdef CONFIG_SMP
+    /* We are off the old thread's stack, so another CPU may now run it */
+    OldThread->SwapBusy = FALSE;
+#endif
+
     /* Now we are the new thread. Check if it's in a new process */
     OldProcess = OldThread->ApcState.Process;
     NewProcess = NewThread->ApcState.Process;
@@ -438,9 +463,32 @@ KiSwapContextEntry(IN PKSWITCHFRAME SwitchFrame,
     /* Get the old thread and set its kernel stack */
     OldThread->KernelStack = SwitchFrame;
 
+#ifdef CONFIG_SMP
+    /* Wait for the new thread to be fully switched out on its last CPU */
+    while (NewThread->SwapBusy) YieldProcessor();
+#endif
+
     /* ISRs can change FPU state, so disable interrupts while checking */
     _disable();
 
+#ifdef CONFIG_SMP
+    /* The old thread may resume on another CPU, so save its FPU state now */
+    if (OldThread->NpxState == NPX_STATE_LOADED)
+    {
+        /* Make sure saving won't trap */
+        Cr0 = __readcr0();
+        if (Cr0 & (CR0_MP | CR0_EM | CR0_TS))
+        {
+            __writecr0(Cr0 & ~(CR0_MP | CR0_EM | CR0_TS));
+        }
+
+        /* Save the FPU state and give up ownership of the FPU */
+        Ke386SaveFpuState(KiGetThreadNpxArea(OldThread));
+        OldThread->NpxState = NPX_STATE_NOT_LOADED;
+        Pcr->PrcbData.NpxThread = NULL;
+    }
+#endif
+
     /* Get current and new CR0 and check if they've changed */
     Cr0 = __readcr0();
     NewCr0 = NewThread->NpxState |
@@ -493,10 +541,16 @@ KiDispatchInterrupt(VOID)
     }
     else if (Prcb->NextThread)
     {
+        /* Lock the PRCB while we switch threads */
+        KiAcquirePrcbLock(Prcb);
+
         /* Capture current thread data */
         OldThread = Prcb->CurrentThread;
         NewThread = Prcb->NextThread;
 
+        /* Nobody may run the old thread until we're off its stack */
+        KiSetThreadSwapBusy(OldThread);
+
         /* Set new thread data */
         Prcb->NextThread = NULL;
         Prcb->CurrentThread = NewThread;
@@ -505,7 +559,7 @@ KiDispatchInterrupt(VOID)
         NewThread->State = Running;
         OldThread->WaitReason = WrDispatchInt;
 
-        /* Make the old thread ready */
+        /* Make the old thread ready, this releases the PRCB lock */
         KxQueueReadyThread(OldThread, Prcb);
 
         /* Swap to the new thread */
@@ -12,28 +12,202 @@
 #define NDEBUG
 #include <debug.h>
 
-#ifdef _WIN64
-# define InterlockedOrSetMember(Destination, SetMember) \
-    InterlockedOr64((PLONG64)Destination, SetMember);
-#else
-# define InterlockedOrSetMember(Destination, SetMember) \
-    InterlockedOr((PLONG)Destination, SetMember);
-#endif
-
 /* GLOBALS *******************************************************************/
 
 ULONG_PTR KiIdleSummary;
 ULONG_PTR KiIdleSMTSummary;
+KTHREAD_SWITCH_COUNTERS KiThreadSwitchCounters;
 
 /* FUNCTIONS *****************************************************************/
 
+#ifdef CONFIG_SMP
+FORCEINLINE
+PKTHREAD
+KiFindStealableThread(IN PKPRCB TargetPrcb,
+                      IN PKPRCB Prcb)
+{
+    ULONG Summary;
+    LONG Priority;
+    PLIST_ENTRY ListHead, ListEntry;
+    PKTHREAD Thread;
+
+    /* Scan the target's ready lists from the highest priority down */
+    Summary = TargetPrcb->ReadySummary;
+    while (Summary)
+    {
+        /* Get the highest priority left and remove it from the set */
+        BitScanReverse((PULONG)&Priority, Summary);
+        Summary ^= PRIORITY_MASK(Priority);
+
+        /* Look for a thread that is allowed to run on our CPU */
+        ListHead = &TargetPrcb->DispatcherReadyListHead[Priority];
+        for (ListEntry = ListHead->Flink;
+             ListEntry != ListHead;
+             ListEntry = ListEntry->Flink)
+        {
+            Thread = CONTAINING_RECORD(ListEntry, KTHREAD, WaitListEntry);
+            if (!(Thread->Affinity & Prcb->SetMember)) continue;
+
+            /* Make sure this thread is here for a reason */
+            ASSERT(Thread->Priority == Priority);
+            ASSERT(Thread->NextProcessor == TargetPrcb->Number);
+
+            /* Remove it from the list */
+            if (RemoveEntryList(&Thread->WaitListEntry))
+            {
+                /* The list is empty now, reset the ready summary */
+                TargetPrcb->ReadySummary ^= PRIORITY_MASK(Priority);
+            }
+
+            /* Return the thread */
+            return Thread;
+        }
+    }
+
+    /* Nothing on this CPU can run on ours */
+    return NULL;
+}
+#endif
+
 PKTHREAD
 FASTCALL
 KiIdleSchedule(IN PKPRCB Prcb)
 {
-    /* FIXME: TODO */
-    ASSERTMSG("SMP: Not yet implemented\n", FALSE);
+#ifdef CONFIG_SMP
+    PKPRCB TargetPrcb, BusiestPrcb;
+    PKTHREAD Thread, NextThread;
+    KAFFINITY Tried;
+    ULONG Summary, BusiestSummary;
+    ULONG Index;
+
+    /* Sanity checks */
+    ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
+    ASSERT(Prcb->CurrentThread == Prcb->IdleThread);
+
+    /* Lock our PRCB and check if someone already found us a thread */
+    KiAcquirePrcbLock(Prcb);
+    Prcb->IdleSchedule = FALSE;
+    if (Prcb->NextThread)
+    {
+        /* Let the idle loop switch to it */
+        KiReleasePrcbLock(Prcb);
+        return NULL;
+    }
+
+    /* Check our own ready lists first */
+    Thread = KiSelectReadyThread(0, Prcb);
+    if (Thread)
+    {
+        /* Take ourselves out of the idle summary and run it next */
+        KiClearIdleSummary(Prcb);
+        Thread->State = Standby;
+        Prcb->NextThread = Thread;
+        KiReleasePrcbLock(Prcb);
+        KiThreadSwitchCounters.FindLast++;
+        return Thread;
+    }
+
+    /*
+     * Leave the idle summary while we look elsewhere, so that nobody hands us
+     * a standby thread behind our back. Anyone targeting our CPU directly
+     * will see the idle thread running and preempt it instead.
+     */
+    KiClearIdleSummary(Prcb);
+    KiReleasePrcbLock(Prcb);
+
+    /* Try the busiest processors first */
+    Tried = Prcb->SetMember;
+    for (;;)
+    {
+        /*
+         * Take the processor with the highest ready priority. Comparing the
+         * summaries as numbers also favors the one with the most occupied
+         * priority levels when the highest priority is the same.
+         */
+        BusiestPrcb = NULL;
+        BusiestSummary = 0;
+        for (Index = 0; Index < (ULONG)KeNumberProcessors; Index++)
+        {
+            TargetPrcb = KiProcessorBlock[Index];
+            if (!(TargetPrcb) || (Tried & AFFINITY_MASK(Index))) continue;
+
+            Summary = TargetPrcb->ReadySummary;
+            if (Summary > BusiestSummary)
+            {
+                BusiestPrcb = TargetPrcb;
+                BusiestSummary = Summary;
+            }
+        }
+
+        /* Give up if nobody has anything ready */
+        if (!BusiestPrcb) break;
+        Tried |= BusiestPrcb->SetMember;
+
+        /* Lock it and look for a thread we can run */
+        KiAcquirePrcbLock(BusiestPrcb);
+        Thread = KiFindStealableThread(BusiestPrcb, Prcb);
+        if (Thread)
+        {
+            /* Move it over to our CPU while it's still locked down */
+            Thread->NextProcessor = Prcb->Number;
+            Thread->State = Standby;
+            KiReleasePrcbLock(BusiestPrcb);
+
+            /* Now set it as our next thread */
+            KiAcquirePrcbLock(Prcb);
+            NextThread = Prcb->NextThread;
+            if (NextThread)
+            {
+                /*
+                 * Somebody targeted our CPU directly while we were stealing
+                 * and already made a thread standby here. Run the better of
+                 * the two and put the other one on our own ready list.
+                 */
+                ASSERT(NextThread->State == Standby);
+                if (Thread->Priority > NextThread->Priority)
+                {
+                    Prcb->NextThread = Thread;
+                    Thread = NextThread;
+                }
+
+                /* It never ran, so it goes to the head of its list */
+                Thread->State = Ready;
+                Thread->WaitTime = KeTickCount.LowPart;
+                InsertHeadList(&Prcb->DispatcherReadyListHead[Thread->Priority],
+                               &Thread->WaitListEntry);
+                Prcb->ReadySummary |= PRIORITY_MASK(Thread->Priority);
+                KiReleasePrcbLock(Prcb);
+                return NULL;
+            }
+            Prcb->NextThread = Thread;
+            KiReleasePrcbLock(Prcb);
+
+            /* Update the counters */
+            if (Thread->IdealProcessor == Prcb->Number)
+            {
+                KiThreadSwitchCounters.FindIdeal++;
+            }
+            else
+            {
+                KiThreadSwitchCounters.FindAny++;
+            }
+            return Thread;
+        }
+
+        /* Nothing we could take, try the next one */
+        KiReleasePrcbLock(BusiestPrcb);
+    }
+
+    /* We found nothing, go back in the idle summary unless we got a thread */
+    KiAcquirePrcbLock(Prcb);
+    if (!Prcb->NextThread) KiSetIdleSummary(Prcb);
+    KiReleasePrcbLock(Prcb);
+    return NULL;
+#else
+    /* There is nobody to steal work from on UP */
+    Prcb->IdleSchedule = FALSE;
     return NULL;
+#endif
 }
 
 VOID
@@ -83,6 +257,11 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
     ULONG Processor = 0;
     KPRIORITY OldPriority;
     PKTHREAD NextThread;
+#ifdef CONFIG_SMP
+    ULONG CurrentProcessor;
+    KAFFINITY IdleSet;
+    PULONG Counter;
+#endif
 
     /* Sanity checks */
     ASSERT(Thread->State == DeferredReady);
@@ -228,6 +407,96 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
     OldPriority = Thread->Priority;
     Thread->Preempted = FALSE;
 
+#ifdef CONFIG_SMP
+    /* Check if any idle processor can run this thread */
+    CurrentProcessor = KeGetCurrentPrcb()->Number;
+    IdleSet = KiIdleSummary & Thread->Affinity;
+    if (IdleSet)
+    {
+        /* Prefer the ideal processor, then the last one, then this one */
+        Processor = Thread->IdealProcessor;
+        if (IdleSet & AFFINITY_MASK(Processor))
+        {
+            Counter = &KiThreadSwitchCounters.IdleIdeal;
+        }
+        else if (IdleSet & AFFINITY_MASK(Thread->NextProcessor))
+        {
+            Processor = Thread->NextProcessor;
+            Counter = &KiThreadSwitchCounters.IdleLast;
+        }
+        else if (IdleSet & AFFINITY_MASK(CurrentProcessor))
+        {
+            Processor = CurrentProcessor;
+            Counter = &KiThreadSwitchCounters.IdleCurrent;
+        }
+        else
+        {
+            /* Otherwise take any of them, preferably on a fully idle core */
+            if (IdleSet & KiIdleSMTSummary) IdleSet &= KiIdleSMTSummary;
+            Processor = KeFindNextRightSetAffinity((UCHAR)CurrentProcessor,
+                                                   (ULONG)IdleSet);
+            Counter = &KiThreadSwitchCounters.IdleAny;
+        }
+
+        /* Get the PRCB and lock it */
+        Prcb = KiProcessorBlock[Processor];
+        KiAcquirePrcbLock(Prcb);
+
+        /* Make sure it didn't get work while we weren't looking */
+        if ((KiIdleSummary & AFFINITY_MASK(Processor)) && !(Prcb->NextThread))
+        {
+            /* Take it out of the idle summary and set this thread as next */
+            KiClearIdleSummary(Prcb);
+            Thread->NextProcessor = (UCHAR)Processor;
+            Thread->State = Standby;
+            Prcb->NextThread = Thread;
+            (*Counter)++;
+
+            /* Unlock the PRCB and wake the CPU up if it isn't ours */
+            KiReleasePrcbLock(Prcb);
+            if (Processor != CurrentProcessor)
+            {
+                KiIpiSend(AFFINITY_MASK(Processor), IPI_DPC);
+            }
+            return;
+        }
+
+        /* It's busy now, fall back to the normal path */
+        KiReleasePrcbLock(Prcb);
+    }
+
+    /* Stay on the last processor if we can, since its caches are warm */
+    Processor = Thread->NextProcessor;
+    if (!(Thread->Affinity & AFFINITY_MASK(Processor)))
+    {
+        /* Otherwise use the ideal processor, or any that we are allowed on */
+        Processor = Thread->IdealProcessor;
+        if (!(Thread->Affinity & AFFINITY_MASK(Processor)))
+        {
+            Processor = KeFindNextRightSetAffinity((UCHAR)CurrentProcessor,
+                                                   (ULONG)(Thread->Affinity &
+                                                           KeActiveProcessors));
+        }
+    }
+
+    /* Pick the counter for the case where we preempt someone there */
+    if (Processor == CurrentProcessor)
+    {
+        Counter = &KiThreadSwitchCounters.PreemptCurrent;
+    }
+    else if (Processor == Thread->NextProcessor)
+    {
+        Counter = &KiThreadSwitchCounters.PreemptLast;
+    }
+    else
+    {
+        Counter = &KiThreadSwitchCounters.PreemptAny;
+    }
+
+    /* Get the PRCB and lock it */
+    Prcb = KiProcessorBlock[Processor];
+    KiAcquirePrcbLock(Prcb);
+#else
     /* Queue the thread on CPU 0 and get the PRCB and lock it */
     Thread->NextProcessor = 0;
     Prcb = KiProcessorBlock[0];
@@ -245,6 +514,7 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
         KiReleasePrcbLock(Prcb);
         return;
     }
+#endif
 
     /* Set the CPU number */
     Thread->NextProcessor = (UCHAR)Processor;
@@ -261,6 +531,9 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
         {
             /* Preempt the thread */
             NextThread->Preempted = TRUE;
+#ifdef CONFIG_SMP
+            (*Counter)++;
+#endif
 
             /* Put this one as the next one */
             Thread->State = Standby;
@@ -282,6 +555,9 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
         {
             /* Preempt it if it's already running */
             if (NextThread->State == Running) NextThread->Preempted = TRUE;
+#ifdef CONFIG_SMP
+            (*Counter)++;
+#endif
 
             /* Set the thread on standby and as the next thread */
             Thread->State = Standby;
@@ -337,11 +613,8 @@ KiSelectNextThread(IN PKPRCB Prcb)
         Thread = Prcb->IdleThread;
 
         /* Enable idle scheduling */
-        InterlockedOrSetMember(&KiIdleSummary, Prcb->SetMember);
+        KiSetIdleSummary(Prcb);
         Prcb->IdleSchedule = TRUE;
-
-        /* FIXME: SMT support */
-        ASSERTMSG("SMP: Not yet implemented\n", FALSE);
     }
 
     /* Sanity checks and return the thread */
@@ -385,8 +658,10 @@ KiSwapThread(IN PKTHREAD CurrentThread,
         }
         else
         {
-            /* Set the idle summary */
-            InterlockedOrSetMember(&KiIdleSummary, Prcb->SetMember);
+            /* Set the idle summary and let the idle loop look for work */
+            KiSetIdleSummary(Prcb);
+            Prcb->IdleSchedule = TRUE;
+            KiThreadSwitchCounters.SwitchToIdle++;
 
             /* Schedule the idle thread */
             NextThread = Prcb->IdleThread;
@@ -664,9 +939,8 @@ KiSetPriorityThread(IN PKTHREAD Thread,
             }
             else if (Thread->State == DeferredReady)
             {
-                /* FIXME: TODO */
-                DPRINT1("Deferred state not yet supported\n");
-                ASSERT(FALSE);
+                /* It will be placed with its new priority, just update it */
+                Thread->Priority = (SCHAR)Priority;
             }
             else
             {
@@ -21,6 +21,7 @@
 /* GLOBALS ********************************************************************/
 
 #define POOL_BIG_TABLE_ENTRY_FREE 0x1
+#define POOL_BIG_TABLE_MIGRATE_BATCH 8
 
 typedef struct _POOL_DPC_CONTEXT
 {
@@ -30,6 +31,59 @@ typedef struct _POOL_DPC_CONTEXT
     SIZE_T PoolTrackTableSizeExpansion;
 } POOL_DPC_CONTEXT, *PPOOL_DPC_CONTEXT;
 
+//
+// Per-CPU magazine layer for the block sizes above the lookaside lists.
+// Requests are rounded up to one of POOL_MAGAZINE_CLASSES sizes, freed blocks
+// of such a size go into the magazine loaded on the current CPU, and full and
+// empty magazines are traded between CPUs through a depot per class.
+//
+#define POOL_MAGAZINE_CLASSES       16
+#define POOL_MAGAZINE_MAX_ROUNDS    31
+#define POOL_MAGAZINE_MIN_ROUNDS    2
+#define POOL_MAGAZINE_START_ROUNDS  4
+#define POOL_MAGAZINE_MAX_BYTES     (2 * PAGE_SIZE)
+#define POOL_MAGAZINE_ADAPT_TRIPS   16
+#define POOL_MAGAZINE_NO_CLASS      0xFF
+#define TAG_POOL_MAGAZINE           'gaMP'
+
+typedef struct _POOL_MAGAZINE
+{
+    struct _POOL_MAGAZINE *Next;
+    USHORT Rounds;
+    USHORT Capacity;
+    PVOID Round[POOL_MAGAZINE_MAX_ROUNDS];
+} POOL_MAGAZINE, *PPOOL_MAGAZINE;
+
+//
+// Magazines themselves must come from the lookaside lists, never from the
+// magazine layer
+//
+C_ASSERT(sizeof(POOL_MAGAZINE) + sizeof(POOL_HEADER) <=
+         NUMBER_POOL_LOOKASIDE_LISTS * POOL_BLOCK_SIZE);
+
+typedef struct _POOL_MAGAZINE_CACHE
+{
+    PPOOL_MAGAZINE Loaded;
+    PPOOL_MAGAZINE Previous;
+    ULONG AllocateHits;
+    ULONG AllocateMisses;
+    ULONG FreeHits;
+    ULONG FreeMisses;
+    ULONG WindowOperations;
+    ULONG WindowDepotTrips;
+} POOL_MAGAZINE_CACHE, *PPOOL_MAGAZINE_CACHE;
+
+typedef struct _POOL_MAGAZINE_DEPOT
+{
+    KSPIN_LOCK Lock;
+    PPOOL_MAGAZINE FullMagazines;
+    PPOOL_MAGAZINE EmptyMagazines;
+    ULONG FullCount;
+    ULONG EmptyCount;
+    ULONG Capacity;
+    ULONG MaxCapacity;
+} POOL_MAGAZINE_DEPOT, *PPOOL_MAGAZINE_DEPOT;
+
 ULONG ExpNumberOfPagedPools;
 POOL_DESCRIPTOR NonPagedPoolDescriptor;
 PPOOL_DESCRIPTOR ExpPagedPoolDescriptor[16 + 1];
@@ -39,15 +93,25 @@ SIZE_T PoolTrackTableSize, PoolTrackTableMask;
 SIZE_T PoolBigPageTableSize, PoolBigPageTableHash;
 ULONG ExpBigTableExpansionFailed;
 PPOOL_TRACKER_TABLE PoolTrackTable;
+PPOOL_TRACKER_TABLE ExpPoolTrackTables[MAXIMUM_PROCESSORS];
 PPOOL_TRACKER_BIG_PAGES PoolBigPageTable;
 KSPIN_LOCK ExpTaggedPoolLock;
 ULONG PoolHitTag;
 BOOLEAN ExStopBadTags;
 KSPIN_LOCK ExpLargePoolTableLock;
 ULONG ExpPoolBigEntriesInUse;
+ULONG ExpPoolBigSlotsInUse;
+PPOOL_TRACKER_BIG_PAGES ExpOldBigPageTable;
+SIZE_T ExpOldBigPageTableSize, ExpBigPageMigrateIndex;
+ULONG ExpBigPageLookups, ExpBigPageProbes, ExpBigPageMaxProbes;
 ULONG ExpPoolFlags;
 ULONG ExPoolFailures;
 ULONGLONG MiLastPoolDumpTime;
+ULONG ExpPoolMagazineClasses;
+USHORT ExpPoolMagazineClassSize[POOL_MAGAZINE_CLASSES];
+UCHAR ExpPoolMagazineClassIndex[POOL_LISTS_PER_PAGE];
+POOL_MAGAZINE_DEPOT ExpPoolMagazineDepots[2][POOL_MAGAZINE_CLASSES];
+POOL_MAGAZINE_CACHE ExpPoolMagazineCaches[MAXIMUM_PROCESSORS][2][POOL_MAGAZINE_CLASSES];
 
 /* Pool block/header/list access macros */
 #define POOL_ENTRY(x)       (PPOOL_HEADER)((ULONG_PTR)(x) - sizeof(POOL_HEADER))
@@ -283,6 +347,11 @@ ExpCheckPoolHeader(IN PPOOL_HEADER Entry)
     }
 }
 
+_IRQL_requires_(DISPATCH_LEVEL)
+static
+PPOOL_TRACKER_BIG_PAGES
+ExpFindBigPageEntry(IN PVOID Va);
+
 VOID
 NTAPI
 ExpCheckPoolAllocation(
@@ -291,7 +360,7 @@ ExpCheckPoolAllocation(
     ULONG Tag)
 {
     PPOOL_HEADER Entry;
-    ULONG i;
+    PPOOL_TRACKER_BIG_PAGES BigEntry;
     KIRQL OldIrql;
     POOL_TYPE RealPoolType;
 
@@ -305,25 +374,18 @@ ExpCheckPoolAllocation(
         KeAcquireSpinLock(&ExpLargePoolTableLock, &OldIrql);
 
         /* Find the pool tag */
-        for (i = 0; i < PoolBigPageTableSize; i++)
-        {
-            /* Check if this is our allocation */
-            if (PoolBigPageTable[i].Va == P)
-            {
-                /* Make sure the tag is ok */
-                if (PoolBigPageTable[i].Key != Tag)
-                {
-                    KeBugCheckEx(BAD_POOL_CALLER, 0x0A, (ULONG_PTR)P, PoolBigPageTable[i].Key, Tag);
-                }
+        BigEntry = ExpFindBigPageEntry(P);
 
-                break;
-            }
+        /* Make sure the tag is ok */
+        if ((BigEntry) && (BigEntry->Key != Tag))
+        {
+            KeBugCheckEx(BAD_POOL_CALLER, 0x0A, (ULONG_PTR)P, BigEntry->Key, Tag);
         }
 
         /* Release the lock */
         KeReleaseSpinLock(&ExpLargePoolTableLock, OldIrql);
 
-        if (i == PoolBigPageTableSize)
+        if (!BigEntry)
         {
             /* Did not find the allocation */
             //ASSERT(FALSE);
@@ -462,6 +524,178 @@ ExpComputePartialHashForAddress(IN PVOID BaseAddress)
     return (Result >> 24) ^ (Result >> 16) ^ (Result >> 8) ^ Result;
 }
 
+//
+// The global tracker table only owns the tag keys, which are written once.
+// The counters of a tag live at the same index in a table of the processor
+// doing the allocation or free, so the hot path never writes a cache line
+// shared with other processors. Processor 0 uses the global table itself.
+// Counters of a single processor may go negative when blocks are freed on
+// another one; only the sum over all processors is meaningful.
+//
+VOID
+NTAPI
+ExpInsertPoolTracker(IN ULONG Key,
+                     IN SIZE_T NumberOfBytes,
+                     IN POOL_TYPE PoolType);
+
+static
+PPOOL_TRACKER_TABLE
+ExpGetLocalPoolTracker(IN ULONG Hash)
+{
+    PPOOL_TRACKER_TABLE Table, NewTable;
+    ULONG Processor = KeGetCurrentProcessorNumber();
+
+    Table = ExpPoolTrackTables[Processor];
+    if (Table) return &Table[Hash];
+
+    //
+    // First pool activity on this processor, build its table. The page
+    // allocator does not track anything, so there is no recursion here.
+    //
+    NewTable = MiAllocatePoolPages(NonPagedPool,
+                                   PoolTrackTableSize * sizeof(POOL_TRACKER_TABLE));
+    if (!NewTable)
+    {
+        //
+        // Use the global counters, they are updated atomically anyway
+        //
+        return &PoolTrackTable[Hash];
+    }
+
+    RtlZeroMemory(NewTable, PoolTrackTableSize * sizeof(POOL_TRACKER_TABLE));
+    Table = InterlockedCompareExchangePointer((PVOID*)&ExpPoolTrackTables[Processor],
+                                              NewTable,
+                                              NULL);
+    if (Table)
+    {
+        //
+        // We were preempted by another thread on the same processor
+        //
+        MiFreePoolPages(NewTable);
+        return &Table[Hash];
+    }
+
+    ExpInsertPoolTracker('looP',
+                         ROUND_TO_PAGES(PoolTrackTableSize * sizeof(POOL_TRACKER_TABLE)),
+                         NonPagedPool);
+    return &NewTable[Hash];
+}
+
+static
+VOID
+ExpGetMergedPoolTracker(IN ULONG Hash,
+                        OUT PPOOL_TRACKER_TABLE Result)
+{
+    PPOOL_TRACKER_TABLE TableEntry;
+    ULONG i;
+
+    //
+    // Start with the global entry, which holds the key as well
+    //
+    *Result = PoolTrackTable[Hash];
+
+    //
+    // And add up what all the other processors have counted
+    //
+    for (i = 1; i < MAXIMUM_PROCESSORS; i++)
+    {
+        if (!ExpPoolTrackTables[i]) continue;
+
+        TableEntry = &ExpPoolTrackTables[i][Hash];
+        Result->NonPagedAllocs += TableEntry->NonPagedAllocs;
+        Result->NonPagedFrees += TableEntry->NonPagedFrees;
+        Result->NonPagedBytes += TableEntry->NonPagedBytes;
+        Result->PagedAllocs += TableEntry->PagedAllocs;
+        Result->PagedFrees += TableEntry->PagedFrees;
+        Result->PagedBytes += TableEntry->PagedBytes;
+    }
+}
+
+//
+// Big page tracker lookups. Freed entries keep their address with the free
+// bit set, while entries that were never used hold the free bit alone. Only
+// the latter end a probe sequence, which bounds the cost of a lookup that
+// fails. During a migration, the entries not moved yet are in the old table.
+//
+static
+PPOOL_TRACKER_BIG_PAGES
+ExpProbeBigPageTable(IN PPOOL_TRACKER_BIG_PAGES Table,
+                     IN SIZE_T TableSize,
+                     IN PVOID Va)
+{
+    SIZE_T Hash, Mask = TableSize - 1;
+    ULONG Probes;
+    PPOOL_TRACKER_BIG_PAGES Entry = NULL;
+
+    Hash = ExpComputePartialHashForAddress(Va) & Mask;
+    for (Probes = 1; Probes <= TableSize; Probes++)
+    {
+        if (Table[Hash].Va == Va)
+        {
+            Entry = &Table[Hash];
+            break;
+        }
+
+        if (Table[Hash].Va == (PVOID)POOL_BIG_TABLE_ENTRY_FREE) break;
+        Hash = (Hash + 1) & Mask;
+    }
+
+    ExpBigPageLookups++;
+    ExpBigPageProbes += Probes;
+    if (Probes > ExpBigPageMaxProbes) ExpBigPageMaxProbes = Probes;
+    return Entry;
+}
+
+_IRQL_requires_(DISPATCH_LEVEL)
+static
+PPOOL_TRACKER_BIG_PAGES
+ExpFindBigPageEntry(IN PVOID Va)
+{
+    PPOOL_TRACKER_BIG_PAGES Entry;
+
+    Entry = ExpProbeBigPageTable(PoolBigPageTable, PoolBigPageTableSize, Va);
+    if (!(Entry) && (ExpOldBigPageTable))
+    {
+        Entry = ExpProbeBigPageTable(ExpOldBigPageTable, ExpOldBigPageTableSize, Va);
+    }
+
+    return Entry;
+}
+
+_IRQL_requires_(DISPATCH_LEVEL)
+static
+PPOOL_TRACKER_BIG_PAGES
+ExpInsertBigPageEntry(IN PVOID Va)
+{
+    SIZE_T Hash, Mask = PoolBigPageTableHash;
+    ULONG Probes;
+    PPOOL_TRACKER_BIG_PAGES Entry;
+
+    //
+    // New entries always go to the current table, in the first free entry
+    // of their probe sequence
+    //
+    Hash = ExpComputePartialHashForAddress(Va) & Mask;
+    for (Probes = 1; Probes <= PoolBigPageTableSize; Probes++)
+    {
+        Entry = &PoolBigPageTable[Hash];
+        if ((ULONG_PTR)Entry->Va & POOL_BIG_TABLE_ENTRY_FREE)
+        {
+            if (Entry->Va == (PVOID)POOL_BIG_TABLE_ENTRY_FREE) ExpPoolBigSlotsInUse++;
+            Entry->Va = Va;
+
+            ExpBigPageLookups++;
+            ExpBigPageProbes += Probes;
+            if (Probes > ExpBigPageMaxProbes) ExpBigPageMaxProbes = Probes;
+            return Entry;
+        }
+
+        Hash = (Hash + 1) & Mask;
+    }
+
+    return NULL;
+}
+
 #if DBG
 /*
  * FORCEINLINE
@@ -527,8 +761,13 @@ MiDumpPoolConsumers(BOOLEAN CalledFromDbg, ULONG Tag, ULONG Mask, ULONG Flags)
     for (i = 0; i < PoolTrackTableSize; ++i)
     {
         PPOOL_TRACKER_TABLE TableEntry;
+        POOL_TRACKER_TABLE MergedEntry;
 
-        TableEntry = &PoolTrackTable[i];
+        //
+        // Sum up the counters of all processors for this tag
+        //
+        ExpGetMergedPoolTracker((ULONG)i, &MergedEntry);
+        TableEntry = &MergedEntry;
 
         //
         // We only care about tags which have allocated memory
@@ -613,6 +852,46 @@ MiDumpPoolConsumers(BOOLEAN CalledFromDbg, ULONG Tag, ULONG Mask, ULONG Flags)
         }
     }
 
+    //
+    // In verbose mode, also show how well the per-CPU magazines are doing
+    //
+    if (Verbose)
+    {
+        ULONG Cpu, Class;
+
+        MiDumperPrint(CalledFromDbg, "\nMagazines\tNonPaged\t\t\tPaged\n");
+        MiDumperPrint(CalledFromDbg, "CPU\t\tHits\t\tMisses\t\tHits\t\tMisses\n");
+        for (Cpu = 0; Cpu < (ULONG)KeNumberProcessors; Cpu++)
+        {
+            ULONG NonPagedHits = 0, NonPagedMisses = 0, PagedHits = 0, PagedMisses = 0;
+            PPOOL_MAGAZINE_CACHE Cache;
+
+            for (Class = 0; Class < ExpPoolMagazineClasses; Class++)
+            {
+                Cache = &ExpPoolMagazineCaches[Cpu][NonPagedPool][Class];
+                NonPagedHits += Cache->AllocateHits + Cache->FreeHits;
+                NonPagedMisses += Cache->AllocateMisses + Cache->FreeMisses;
+                Cache = &ExpPoolMagazineCaches[Cpu][PagedPool][Class];
+                PagedHits += Cache->AllocateHits + Cache->FreeHits;
+                PagedMisses += Cache->AllocateMisses + Cache->FreeMisses;
+            }
+
+            MiDumperPrint(CalledFromDbg, "%lu\t\t%lu\t\t%lu\t\t%lu\t\t%lu\n", Cpu,
+                          NonPagedHits, NonPagedMisses, PagedHits, PagedMisses);
+        }
+    }
+
+    //
+    // And how long the big page tracker probe sequences are
+    //
+    if (Verbose)
+    {
+        MiDumperPrint(CalledFromDbg, "\nBig pages: %lu in use, %Iu entries%s, %lu lookups, %lu probes, %lu max\n",
+                      ExpPoolBigEntriesInUse, PoolBigPageTableSize,
+                      ExpOldBigPageTable ? " (resizing)" : "",
+                      ExpBigPageLookups, ExpBigPageProbes, ExpBigPageMaxProbes);
+    }
+
     if (!CalledFromDbg)
     {
         DPRINT1("---------------------\n");
@@ -791,9 +1070,10 @@ ExpRemovePoolTracker(IN ULONG Key,
         if (TableEntry->Key == Key)
         {
             //
-            // Decrement the counters depending on if this was paged or nonpaged
-            // pool
+            // Decrement the counters of this processor depending on if this
+            // was paged or nonpaged pool
             //
+            TableEntry = ExpGetLocalPoolTracker(Hash);
             if ((PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
             {
                 InterlockedIncrement(&TableEntry->NonPagedFrees);
@@ -865,7 +1145,6 @@ ExpInsertPoolTracker(IN ULONG Key,
     // ASSERT on ReactOS features not yet supported
     //
     ASSERT(!(PoolType & SESSION_POOL_MASK));
-    ASSERT(KeGetCurrentProcessorNumber() == 0);
 
     //
     // Why the double indirection? Because normally this function is also used
@@ -894,9 +1173,10 @@ ExpInsertPoolTracker(IN ULONG Key,
         if (TableEntry->Key == Key)
         {
             //
-            // Increment the counters depending on if this was paged or nonpaged
-            // pool
+            // Increment the counters of this processor depending on if this
+            // was paged or nonpaged pool
             //
+            TableEntry = ExpGetLocalPoolTracker(Hash);
             if ((PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
             {
                 InterlockedIncrement(&TableEntry->NonPagedAllocs);
@@ -1003,6 +1283,66 @@ ExInitializePoolDescriptor(IN PPOOL_DESCRIPTOR PoolDescriptor,
     ASSERT(PoolType != PagedPoolSession);
 }
 
+INIT_FUNCTION
+VOID
+NTAPI
+ExpInitializePoolMagazines(VOID)
+{
+    ULONG Class, Size, Step, i, PoolType, MaxRounds;
+    PPOOL_MAGAZINE_DEPOT Depot;
+
+    //
+    // Build the size classes: four per doubling, starting right above the
+    // lookaside lists, so rounding up wastes at most a fifth of the block
+    //
+    Size = NUMBER_POOL_LOOKASIDE_LISTS;
+    Step = NUMBER_POOL_LOOKASIDE_LISTS / 4;
+    for (Class = 0;
+         (Class < POOL_MAGAZINE_CLASSES) && (Size < POOL_LISTS_PER_PAGE - 1);
+         Class++)
+    {
+        if ((Class != 0) && !(Class % 4)) Step *= 2;
+        Size = min(Size + Step, POOL_LISTS_PER_PAGE - 1);
+        ExpPoolMagazineClassSize[Class] = (USHORT)Size;
+    }
+    ExpPoolMagazineClasses = Class;
+
+    //
+    // Map every block size to the smallest class that can hold it. Sizes that
+    // are left over at the top of the page are not cached.
+    //
+    Class = 0;
+    for (i = 0; i < POOL_LISTS_PER_PAGE; i++)
+    {
+        if ((i <= NUMBER_POOL_LOOKASIDE_LISTS) ||
+            (i > ExpPoolMagazineClassSize[ExpPoolMagazineClasses - 1]))
+        {
+            ExpPoolMagazineClassIndex[i] = POOL_MAGAZINE_NO_CLASS;
+            continue;
+        }
+
+        if (i > ExpPoolMagazineClassSize[Class]) Class++;
+        ExpPoolMagazineClassIndex[i] = (UCHAR)Class;
+    }
+
+    //
+    // Bound the memory a magazine of large blocks can hold
+    //
+    for (PoolType = 0; PoolType < 2; PoolType++)
+    {
+        for (Class = 0; Class < ExpPoolMagazineClasses; Class++)
+        {
+            Depot = &ExpPoolMagazineDepots[PoolType][Class];
+            KeInitializeSpinLock(&Depot->Lock);
+            MaxRounds = POOL_MAGAZINE_MAX_BYTES /
+                        (ExpPoolMagazineClassSize[Class] * POOL_BLOCK_SIZE);
+            MaxRounds = max(MaxRounds, POOL_MAGAZINE_MIN_ROUNDS);
+            Depot->MaxCapacity = min(MaxRounds, POOL_MAGAZINE_MAX_ROUNDS);
+            Depot->Capacity = min(Depot->MaxCapacity, POOL_MAGAZINE_START_ROUNDS);
+        }
+    }
+}
+
 INIT_FUNCTION
 VOID
 NTAPI
@@ -1099,6 +1439,7 @@ InitializePool(IN POOL_TYPE PoolType,
 
         RtlZeroMemory(PoolTrackTable,
                       PoolTrackTableSize * sizeof(POOL_TRACKER_TABLE));
+        ExpPoolTrackTables[0] = PoolTrackTable;
 
         //
         // Finally, add the most used tags to speed up those allocations
@@ -1208,6 +1549,11 @@ InitializePool(IN POOL_TYPE PoolType,
                                    0,
                                    Threshold,
                                    NULL);
+
+        //
+        // Setup the size classes of the per-CPU magazines
+        //
+        ExpInitializePoolMagazines();
     }
     else
     {
@@ -1305,6 +1651,211 @@ ExUnlockPool(IN PPOOL_DESCRIPTOR Descriptor,
     }
 }
 
+static
+VOID
+ExpAdaptPoolMagazine(IN PPOOL_MAGAZINE_CACHE Cache,
+                     IN PPOOL_MAGAZINE_DEPOT Depot)
+{
+    //
+    // Called with the depot lock held, on every trip to the depot. Once the
+    // window is complete, compare how often this CPU had to come here: below
+    // a 15/16 hit rate the magazines are too small for the burst size, and
+    // above 63/64 they hold more blocks than needed.
+    //
+    if (++Cache->WindowDepotTrips < POOL_MAGAZINE_ADAPT_TRIPS) return;
+
+    if ((Cache->WindowOperations < Cache->WindowDepotTrips * 16) &&
+        (Depot->Capacity < Depot->MaxCapacity))
+    {
+        Depot->Capacity++;
+    }
+    else if ((Cache->WindowOperations > Cache->WindowDepotTrips * 64) &&
+             (Depot->Capacity > POOL_MAGAZINE_MIN_ROUNDS))
+    {
+        Depot->Capacity--;
+    }
+
+    Cache->WindowOperations = 0;
+    Cache->WindowDepotTrips = 0;
+}
+
+static
+PVOID
+ExpAllocateFromPoolMagazine(IN POOL_TYPE PoolType,
+                            IN ULONG Class)
+{
+    PPOOL_MAGAZINE_CACHE Cache;
+    PPOOL_MAGAZINE_DEPOT Depot;
+    PPOOL_MAGAZINE Magazine, FreeMagazine = NULL;
+    PVOID Block = NULL;
+    KIRQL OldIrql;
+
+    //
+    // The CPU layer is only touched at DISPATCH_LEVEL on its own CPU. Only
+    // the pointers are accessed, never the (maybe paged) blocks themselves.
+    //
+    OldIrql = KeRaiseIrqlToDpcLevel();
+    Cache = &ExpPoolMagazineCaches[KeGetCurrentProcessorNumber()][PoolType][Class];
+    Cache->WindowOperations++;
+
+    Magazine = Cache->Loaded;
+    if (!(Magazine) || !(Magazine->Rounds))
+    {
+        if ((Cache->Previous) && (Cache->Previous->Rounds))
+        {
+            //
+            // The previous magazine still has blocks, swap it in
+            //
+            Cache->Loaded = Cache->Previous;
+            Cache->Previous = Magazine;
+        }
+        else
+        {
+            //
+            // Both are empty, trade the previous one for a full magazine
+            //
+            Depot = &ExpPoolMagazineDepots[PoolType][Class];
+            KeAcquireSpinLockAtDpcLevel(&Depot->Lock);
+            ExpAdaptPoolMagazine(Cache, Depot);
+            Magazine = Depot->FullMagazines;
+            if (Magazine)
+            {
+                Depot->FullMagazines = Magazine->Next;
+                Depot->FullCount--;
+
+                if (Cache->Previous)
+                {
+                    if (Depot->EmptyCount < (ULONG)KeNumberProcessors * 2)
+                    {
+                        Cache->Previous->Next = Depot->EmptyMagazines;
+                        Depot->EmptyMagazines = Cache->Previous;
+                        Depot->EmptyCount++;
+                    }
+                    else
+                    {
+                        FreeMagazine = Cache->Previous;
+                    }
+                }
+
+                Cache->Previous = Cache->Loaded;
+                Cache->Loaded = Magazine;
+            }
+            KeReleaseSpinLockFromDpcLevel(&Depot->Lock);
+
+            if (FreeMagazine) ExFreePoolWithTag(FreeMagazine, TAG_POOL_MAGAZINE);
+            if (!Magazine)
+            {
+                Cache->AllocateMisses++;
+                KeLowerIrql(OldIrql);
+                return NULL;
+            }
+        }
+    }
+
+    Magazine = Cache->Loaded;
+    ASSERT(Magazine->Rounds != 0);
+    Block = Magazine->Round[--Magazine->Rounds];
+    Cache->AllocateHits++;
+    KeLowerIrql(OldIrql);
+    return Block;
+}
+
+static
+BOOLEAN
+ExpFreeToPoolMagazine(IN POOL_TYPE PoolType,
+                      IN ULONG Class,
+                      IN PVOID Block)
+{
+    PPOOL_MAGAZINE_CACHE Cache;
+    PPOOL_MAGAZINE_DEPOT Depot;
+    PPOOL_MAGAZINE Magazine;
+    KIRQL OldIrql;
+
+    OldIrql = KeRaiseIrqlToDpcLevel();
+    Cache = &ExpPoolMagazineCaches[KeGetCurrentProcessorNumber()][PoolType][Class];
+    Cache->WindowOperations++;
+
+    Magazine = Cache->Loaded;
+    if (!(Magazine) || (Magazine->Rounds == Magazine->Capacity))
+    {
+        if ((Cache->Previous) && !(Cache->Previous->Rounds))
+        {
+            //
+            // The previous magazine is empty, swap it in
+            //
+            Cache->Loaded = Cache->Previous;
+            Cache->Previous = Magazine;
+        }
+        else
+        {
+            //
+            // Get an empty magazine from the depot, unless too many full ones
+            // are already waiting there, in which case the block goes back to
+            // the pool
+            //
+            Depot = &ExpPoolMagazineDepots[PoolType][Class];
+            KeAcquireSpinLockAtDpcLevel(&Depot->Lock);
+            ExpAdaptPoolMagazine(Cache, Depot);
+            if (Depot->FullCount >= (ULONG)KeNumberProcessors * 2)
+            {
+                KeReleaseSpinLockFromDpcLevel(&Depot->Lock);
+                Cache->FreeMisses++;
+                KeLowerIrql(OldIrql);
+                return FALSE;
+            }
+
+            Magazine = Depot->EmptyMagazines;
+            if (Magazine)
+            {
+                Depot->EmptyMagazines = Magazine->Next;
+                Depot->EmptyCount--;
+            }
+            KeReleaseSpinLockFromDpcLevel(&Depot->Lock);
+
+            if (!Magazine)
+            {
+                //
+                // Build a new one with the current capacity of this class
+                //
+                Magazine = ExAllocatePoolWithTag(NonPagedPool,
+                                                 sizeof(POOL_MAGAZINE),
+                                                 TAG_POOL_MAGAZINE);
+                if (!Magazine)
+                {
+                    Cache->FreeMisses++;
+                    KeLowerIrql(OldIrql);
+                    return FALSE;
+                }
+
+                Magazine->Rounds = 0;
+                Magazine->Capacity = (USHORT)Depot->Capacity;
+            }
+
+            //
+            // Hand the previous (non-empty) magazine to the depot
+            //
+            if (Cache->Previous)
+            {
+                KeAcquireSpinLockAtDpcLevel(&Depot->Lock);
+                Cache->Previous->Next = Depot->FullMagazines;
+                Depot->FullMagazines = Cache->Previous;
+                Depot->FullCount++;
+                KeReleaseSpinLockFromDpcLevel(&Depot->Lock);
+            }
+
+            Cache->Previous = Cache->Loaded;
+            Cache->Loaded = Magazine;
+        }
+    }
+
+    Magazine = Cache->Loaded;
+    ASSERT(Magazine->Rounds < Magazine->Capacity);
+    Magazine->Round[Magazine->Rounds++] = Block;
+    Cache->FreeHits++;
+    KeLowerIrql(OldIrql);
+    return TRUE;
+}
+
 VOID
 NTAPI
 ExpGetPoolTagInfoTarget(IN PKDPC Dpc,
@@ -1321,9 +1872,16 @@ ExpGetPoolTagInfoTarget(IN PKDPC Dpc,
     //
     if (KeSignalCallDpcSynchronize(SystemArgument2))
     {
-        RtlCopyMemory(Context->PoolTrackTable,
-                      PoolTrackTable,
-                      Context->PoolTrackTableSize * sizeof(POOL_TRACKER_TABLE));
+        ULONG i;
+
+        //
+        // Every processor is spinning in this DPC now, so merging the counters
+        // of all of them gives an exact picture
+        //
+        for (i = 0; i < Context->PoolTrackTableSize; i++)
+        {
+            ExpGetMergedPoolTracker(i, &Context->PoolTrackTable[i]);
+        }
 
         //
         // This is here because ReactOS does not yet support expansion
@@ -1445,93 +2003,144 @@ ExGetPoolTagInfo(IN PSYSTEM_POOLTAG_INFORMATION SystemInformation,
     return Status;
 }
 
-_IRQL_requires_(DISPATCH_LEVEL)
-BOOLEAN
-NTAPI
-ExpExpandBigPageTable(
-    _In_ _IRQL_restores_ KIRQL OldIrql)
+static
+PPOOL_TRACKER_BIG_PAGES
+ExpAllocateBigPageTable(IN SIZE_T TableSize)
 {
-    ULONG OldSize = PoolBigPageTableSize;
-    ULONG NewSize = 2 * OldSize;
-    ULONG NewSizeInBytes;
-    PPOOL_TRACKER_BIG_PAGES NewTable;
-    PPOOL_TRACKER_BIG_PAGES OldTable;
-    ULONG i;
-    ULONG PagesFreed;
-    ULONG Hash;
-    ULONG HashMask;
-
-    /* Must be holding ExpLargePoolTableLock */
-    ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
+    PPOOL_TRACKER_BIG_PAGES Table;
+    SIZE_T i, SizeInBytes;
 
     /* Make sure we don't overflow */
-    if (!NT_SUCCESS(RtlULongMult(2,
-                                 OldSize * sizeof(POOL_TRACKER_BIG_PAGES),
-                                 &NewSizeInBytes)))
+    if (TableSize > (MAXULONG_PTR / sizeof(POOL_TRACKER_BIG_PAGES)))
     {
-        DPRINT1("Overflow expanding big page table. Size=%lu\n", OldSize);
-        KeReleaseSpinLock(&ExpLargePoolTableLock, OldIrql);
-        return FALSE;
+        DPRINT1("Overflow expanding big page table. Size=%Iu\n", TableSize);
+        return NULL;
     }
 
-    NewTable = MiAllocatePoolPages(NonPagedPool, NewSizeInBytes);
-    if (NewTable == NULL)
+    SizeInBytes = TableSize * sizeof(POOL_TRACKER_BIG_PAGES);
+    Table = MiAllocatePoolPages(NonPagedPool, SizeInBytes);
+    if (Table == NULL)
     {
-        DPRINT1("Could not allocate %lu bytes for new big page table\n", NewSizeInBytes);
-        KeReleaseSpinLock(&ExpLargePoolTableLock, OldIrql);
-        return FALSE;
+        DPRINT1("Could not allocate %Iu bytes for new big page table\n", SizeInBytes);
+        return NULL;
     }
 
-    DPRINT("Expanding big pool tracker table to %lu entries\n", NewSize);
-
-    /* Initialize the new table */
-    RtlZeroMemory(NewTable, NewSizeInBytes);
-    for (i = 0; i < NewSize; i++)
+    /* Every entry starts out as never used, which ends the probe sequences */
+    RtlZeroMemory(Table, SizeInBytes);
+    for (i = 0; i < TableSize; i++)
     {
-        NewTable[i].Va = (PVOID)POOL_BIG_TABLE_ENTRY_FREE;
+        Table[i].Va = (PVOID)POOL_BIG_TABLE_ENTRY_FREE;
     }
 
-    /* Copy over all items */
-    OldTable = PoolBigPageTable;
-    HashMask = NewSize - 1;
-    for (i = 0; i < OldSize; i++)
+    ExpInsertPoolTracker('looP', ROUND_TO_PAGES(SizeInBytes), NonPagedPool);
+    return Table;
+}
+
+static
+VOID
+ExpFreeBigPageTable(IN PPOOL_TRACKER_BIG_PAGES Table)
+{
+    PFN_NUMBER PagesFreed;
+
+    PagesFreed = MiFreePoolPages(Table);
+    ExpRemovePoolTracker('looP', PagesFreed << PAGE_SHIFT, NonPagedPool);
+}
+
+_IRQL_requires_(DISPATCH_LEVEL)
+static
+PPOOL_TRACKER_BIG_PAGES
+ExpMigrateBigPageTable(IN SIZE_T Count)
+{
+    PPOOL_TRACKER_BIG_PAGES Entry, NewEntry, RetiredTable;
+
+    /* Must be holding ExpLargePoolTableLock */
+    ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
+
+    //
+    // Move a few entries of the table being retired into the current one.
+    // Moved entries become free in the old table, and not never used, so
+    // that the probe sequences of the entries still there stay intact
+    //
+    while ((ExpOldBigPageTable) && (Count--))
     {
-        /* Skip over empty items */
-        if ((ULONG_PTR)OldTable[i].Va & POOL_BIG_TABLE_ENTRY_FREE)
+        Entry = &ExpOldBigPageTable[ExpBigPageMigrateIndex++];
+        if (!((ULONG_PTR)Entry->Va & POOL_BIG_TABLE_ENTRY_FREE))
         {
-            continue;
+            NewEntry = ExpInsertBigPageEntry(Entry->Va);
+            ASSERT(NewEntry != NULL);
+            NewEntry->Key = Entry->Key;
+            NewEntry->NumberOfPages = Entry->NumberOfPages;
+            InterlockedIncrement((PLONG)&Entry->Va);
         }
 
-        /* Recalculate the hash due to the new table size */
-        Hash = ExpComputePartialHashForAddress(OldTable[i].Va) & HashMask;
-
-        /* Find the location in the new table */
-        while (!((ULONG_PTR)NewTable[Hash].Va & POOL_BIG_TABLE_ENTRY_FREE))
+        if (ExpBigPageMigrateIndex == ExpOldBigPageTableSize)
         {
-            Hash = (Hash + 1) & HashMask;
+            //
+            // Everything has moved, the caller frees the old table once the
+            // lock is released
+            //
+            DPRINT("Big pool tracker table migration done\n");
+            RetiredTable = ExpOldBigPageTable;
+            ExpOldBigPageTable = NULL;
+            ExpOldBigPageTableSize = 0;
+            ExpBigPageMigrateIndex = 0;
+            return RetiredTable;
         }
+    }
 
-        /* We just enlarged the table, so we must have space */
-        ASSERT((ULONG_PTR)NewTable[Hash].Va & POOL_BIG_TABLE_ENTRY_FREE);
+    return NULL;
+}
 
-        /* Finally, copy the item */
-        NewTable[Hash] = OldTable[i];
+static
+VOID
+ExpStartBigPageTableMigration(VOID)
+{
+    PPOOL_TRACKER_BIG_PAGES NewTable;
+    SIZE_T OldSize, NewSize;
+    KIRQL OldIrql;
+
+    //
+    // Only grow when there are enough live entries; a table mostly filled
+    // with freed entries is just replaced by a clean one of the same size
+    //
+    OldSize = PoolBigPageTableSize;
+    NewSize = (ExpPoolBigEntriesInUse > (OldSize / 4)) ? (2 * OldSize) : OldSize;
+
+    //
+    // Build the new table without holding the lock, this is the expensive part
+    //
+    NewTable = ExpAllocateBigPageTable(NewSize);
+    if (!NewTable)
+    {
+        ExpBigTableExpansionFailed++;
+        return;
     }
 
-    /* Activate the new table */
+    KeAcquireSpinLock(&ExpLargePoolTableLock, &OldIrql);
+    if ((ExpOldBigPageTable) || (PoolBigPageTableSize != OldSize))
+    {
+        //
+        // Someone else started a migration in the meantime
+        //
+        KeReleaseSpinLock(&ExpLargePoolTableLock, OldIrql);
+        ExpFreeBigPageTable(NewTable);
+        return;
+    }
+
+    //
+    // Retire the current table, its entries will be moved over by the
+    // next inserts and removals
+    //
+    DPRINT("Migrating big pool tracker table to %Iu entries (%lu in use)\n",
+           NewSize, ExpPoolBigEntriesInUse);
+    ExpOldBigPageTable = PoolBigPageTable;
+    ExpOldBigPageTableSize = OldSize;
+    ExpBigPageMigrateIndex = 0;
     PoolBigPageTable = NewTable;
     PoolBigPageTableSize = NewSize;
-    PoolBigPageTableHash = PoolBigPageTableSize - 1;
-
-    /* Release the lock, we're done changing global state */
+    PoolBigPageTableHash = NewSize - 1;
+    ExpPoolBigSlotsInUse = 0;
     KeReleaseSpinLock(&ExpLargePoolTableLock, OldIrql);
-
-    /* Free the old table and update our tracker */
-    PagesFreed = MiFreePoolPages(OldTable);
-    ExpRemovePoolTracker('looP', PagesFreed << PAGE_SHIFT, 0);
-    ExpInsertPoolTracker('looP', ALIGN_UP_BY(NewSizeInBytes, PAGE_SIZE), 0);
-
-    return TRUE;
 }
 
 BOOLEAN
@@ -1541,98 +2150,65 @@ ExpAddTagForBigPages(IN PVOID Va,
                      IN ULONG NumberOfPages,
                      IN POOL_TYPE PoolType)
 {
-    ULONG Hash, i = 0;
-    PVOID OldVa;
     KIRQL OldIrql;
-    SIZE_T TableSize;
-    PPOOL_TRACKER_BIG_PAGES Entry, EntryEnd, EntryStart;
+    BOOLEAN Migrate;
+    PPOOL_TRACKER_BIG_PAGES Entry, RetiredTable;
     ASSERT(((ULONG_PTR)Va & POOL_BIG_TABLE_ENTRY_FREE) == 0);
     ASSERT(!(PoolType & SESSION_POOL_MASK));
 
     //
-    // As the table is expandable, these values must only be read after acquiring
-    // the lock to avoid a teared access during an expansion
+    // As the table is resizable, the table and its size must only be read
+    // after acquiring the lock
     // NOTE: Windows uses a special reader/writer SpinLock to improve
     // performance in the common case (add/remove a tracker entry)
     //
-Retry:
-    Hash = ExpComputePartialHashForAddress(Va);
     KeAcquireSpinLock(&ExpLargePoolTableLock, &OldIrql);
-    Hash &= PoolBigPageTableHash;
-    TableSize = PoolBigPageTableSize;
 
     //
-    // We loop from the current hash bucket to the end of the table, and then
-    // rollover to hash bucket 0 and keep going from there. If we return back
-    // to the beginning, then we attempt expansion at the bottom of the loop
+    // Do our share of an ongoing migration first
     //
-    EntryStart = Entry = &PoolBigPageTable[Hash];
-    EntryEnd = &PoolBigPageTable[TableSize];
-    do
+    RetiredTable = ExpMigrateBigPageTable(POOL_BIG_TABLE_MIGRATE_BATCH);
+
+    Entry = ExpInsertBigPageEntry(Va);
+    if (!Entry && ExpOldBigPageTable)
     {
         //
-        // Make sure that this is a free entry and attempt to atomically make the
-        // entry busy now
-        // NOTE: the Interlocked operation cannot fail with an exclusive SpinLock
+        // The new table cannot be full unless the migration lags far behind,
+        // finish it now and try again
         //
-        OldVa = Entry->Va;
-        if (((ULONG_PTR)OldVa & POOL_BIG_TABLE_ENTRY_FREE) &&
-            (NT_VERIFY(InterlockedCompareExchangePointer(&Entry->Va, Va, OldVa) == OldVa)))
-        {
-            //
-            // We now own this entry, write down the size and the pool tag
-            //
-            Entry->Key = Key;
-            Entry->NumberOfPages = NumberOfPages;
-
-            //
-            // Add one more entry to the count, and see if we're getting within
-            // 25% of the table size, at which point we'll do an expansion now
-            // to avoid blocking too hard later on.
-            //
-            // Note that we only do this if it's also been the 16th time that we
-            // keep losing the race or that we are not finding a free entry anymore,
-            // which implies a massive number of concurrent big pool allocations.
-            //
-            InterlockedIncrementUL(&ExpPoolBigEntriesInUse);
-            if ((i >= 16) && (ExpPoolBigEntriesInUse > (TableSize / 4)))
-            {
-                DPRINT("Attempting expansion since we now have %lu entries\n",
-                        ExpPoolBigEntriesInUse);
-                ASSERT(TableSize == PoolBigPageTableSize);
-                ExpExpandBigPageTable(OldIrql);
-                return TRUE;
-            }
-
-            //
-            // We have our entry, return
-            //
-            KeReleaseSpinLock(&ExpLargePoolTableLock, OldIrql);
-            return TRUE;
-        }
+        ASSERT(RetiredTable == NULL);
+        RetiredTable = ExpMigrateBigPageTable(ExpOldBigPageTableSize);
+        Entry = ExpInsertBigPageEntry(Va);
+    }
 
+    if (Entry)
+    {
         //
-        // We don't have our entry yet, so keep trying, making the entry list
-        // circular if we reach the last entry. We'll eventually break out of
-        // the loop once we've rolled over and returned back to our original
-        // hash bucket
+        // We now own this entry, write down the size and the pool tag
         //
-        i++;
-        if (++Entry >= EntryEnd) Entry = &PoolBigPageTable[0];
-    } while (Entry != EntryStart);
+        Entry->Key = Key;
+        Entry->NumberOfPages = NumberOfPages;
+        InterlockedIncrementUL(&ExpPoolBigEntriesInUse);
+    }
 
     //
-    // This means there's no free hash buckets whatsoever, so we now have
-    // to attempt expanding the table
+    // Start a migration once half of the table has been used, so the probe
+    // sequences stay short
     //
-    ASSERT(TableSize == PoolBigPageTableSize);
-    if (ExpExpandBigPageTable(OldIrql))
+    Migrate = (!ExpOldBigPageTable) &&
+              (ExpPoolBigSlotsInUse > (PoolBigPageTableSize / 2));
+    KeReleaseSpinLock(&ExpLargePoolTableLock, OldIrql);
+
+    if (RetiredTable) ExpFreeBigPageTable(RetiredTable);
+    if (Migrate) ExpStartBigPageTableMigration();
+
+    if (!Entry)
     {
-        goto Retry;
+        DPRINT1("Big pool table is full\n");
+        return FALSE;
     }
-    ExpBigTableExpansionFailed++;
-    DPRINT1("Big pool table expansion failed\n");
-    return FALSE;
+
+    return TRUE;
 }
 
 ULONG
@@ -1641,61 +2217,36 @@ ExpFindAndRemoveTagBigPages(IN PVOID Va,
                             OUT PULONG_PTR BigPages,
                             IN POOL_TYPE PoolType)
 {
-    BOOLEAN FirstTry = TRUE;
-    SIZE_T TableSize;
     KIRQL OldIrql;
-    ULONG PoolTag, Hash;
-    PPOOL_TRACKER_BIG_PAGES Entry;
+    ULONG PoolTag;
+    PPOOL_TRACKER_BIG_PAGES Entry, RetiredTable;
     ASSERT(((ULONG_PTR)Va & POOL_BIG_TABLE_ENTRY_FREE) == 0);
     ASSERT(!(PoolType & SESSION_POOL_MASK));
 
-    //
-    // As the table is expandable, these values must only be read after acquiring
-    // the lock to avoid a teared access during an expansion
-    //
-    Hash = ExpComputePartialHashForAddress(Va);
     KeAcquireSpinLock(&ExpLargePoolTableLock, &OldIrql);
-    Hash &= PoolBigPageTableHash;
-    TableSize = PoolBigPageTableSize;
+    RetiredTable = ExpMigrateBigPageTable(POOL_BIG_TABLE_MIGRATE_BATCH);
 
     //
-    // Loop while trying to find this big page allocation
+    // Look in the current table first, then in the one being retired
     //
-    while (PoolBigPageTable[Hash].Va != Va)
+    Entry = ExpFindBigPageEntry(Va);
+    if (!Entry)
     {
         //
-        // Increment the size until we go past the end of the table
+        // This means it was never inserted into the pool table and it
+        // received the special "BIG" tag -- return that and return 0
+        // so that the code can ask Mm for the page count instead
         //
-        if (++Hash >= TableSize)
-        {
-            //
-            // Is this the second time we've tried?
-            //
-            if (!FirstTry)
-            {
-                //
-                // This means it was never inserted into the pool table and it
-                // received the special "BIG" tag -- return that and return 0
-                // so that the code can ask Mm for the page count instead
-                //
-                KeReleaseSpinLock(&ExpLargePoolTableLock, OldIrql);
-                *BigPages = 0;
-                return ' GIB';
-            }
-
-            //
-            // The first time this happens, reset the hash index and try again
-            //
-            Hash = 0;
-            FirstTry = FALSE;
-        }
+        KeReleaseSpinLock(&ExpLargePoolTableLock, OldIrql);
+        if (RetiredTable) ExpFreeBigPageTable(RetiredTable);
+        *BigPages = 0;
+        return ' GIB';
     }
 
     //
     // Now capture all the information we need from the entry, since after we
     // release the lock, the data can change
     //
-    Entry = &PoolBigPageTable[Hash];
     *BigPages = Entry->NumberOfPages;
     PoolTag = Entry->Key;
 
@@ -1706,6 +2257,7 @@ ExpFindAndRemoveTagBigPages(IN PVOID Va,
     InterlockedIncrement((PLONG)&Entry->Va);
     InterlockedDecrementUL(&ExpPoolBigEntriesInUse);
     KeReleaseSpinLock(&ExpLargePoolTableLock, OldIrql);
+    if (RetiredTable) ExpFreeBigPageTable(RetiredTable);
     return PoolTag;
 }
 
@@ -1791,6 +2343,22 @@ ExQueryPoolUsage(OUT PULONG PagedPoolPages,
             }
         }
     }
+
+    //
+    // Blocks handed out by the per-CPU magazines count as lookaside hits too
+    //
+    for (i = 0; i < (ULONG)KeNumberProcessors; i++)
+    {
+        ULONG Class;
+
+        for (Class = 0; Class < ExpPoolMagazineClasses; Class++)
+        {
+            *NonPagedPoolLookasideHits +=
+                ExpPoolMagazineCaches[i][NonPagedPool][Class].AllocateHits;
+            *PagedPoolLookasideHits +=
+                ExpPoolMagazineCaches[i][PagedPool][Class].AllocateHits;
+        }
+    }
 }
 
 VOID
@@ -1856,7 +2424,7 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
     PPOOL_HEADER Entry, NextEntry, FragmentEntry;
     KIRQL OldIrql;
     USHORT BlockSize, i;
-    ULONG OriginalType;
+    ULONG OriginalType, Class;
     PKPRCB Prcb = KeGetCurrentPrcb();
     PGENERAL_LOOKASIDE LookasideList;
 
@@ -2076,6 +2644,36 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
             return POOL_FREE_BLOCK(Entry);
         }
     }
+    else if (ExpPoolMagazineClassIndex[i] != POOL_MAGAZINE_NO_CLASS)
+    {
+        //
+        // Round larger blocks up to their magazine class, so that they can be
+        // cached on free, and try the per-CPU magazines first
+        //
+        Class = ExpPoolMagazineClassIndex[i];
+        i = ExpPoolMagazineClassSize[Class];
+        Entry = ExpAllocateFromPoolMagazine(PoolType, Class);
+        if (Entry)
+        {
+            //
+            // Get the real entry, write down its pool type, and track it
+            //
+            Entry--;
+            ASSERT(Entry->BlockSize == i);
+            Entry->PoolType = OriginalType + 1;
+            ExpInsertPoolTracker(Tag,
+                                 Entry->BlockSize * POOL_BLOCK_SIZE,
+                                 OriginalType);
+
+            //
+            // Return the pool allocation
+            //
+            Entry->PoolTag = Tag;
+            (POOL_FREE_BLOCK(Entry))->Flink = NULL;
+            (POOL_FREE_BLOCK(Entry))->Blink = NULL;
+            return POOL_FREE_BLOCK(Entry);
+        }
+    }
 
     //
     // Loop in the free lists looking for a block if this size. Start with the
@@ -2702,6 +3300,20 @@ ExFreePoolWithTag(IN PVOID P,
             return;
         }
     }
+    else if ((ExpPoolMagazineClassIndex[BlockSize] != POOL_MAGAZINE_NO_CLASS) &&
+             (ExpPoolMagazineClassSize[ExpPoolMagazineClassIndex[BlockSize]] == BlockSize))
+    {
+        //
+        // This block has the exact size of a magazine class, so try caching
+        // it in the per-CPU magazines
+        //
+        if (ExpFreeToPoolMagazine(PoolType,
+                                  ExpPoolMagazineClassIndex[BlockSize],
+                                  P))
+        {
+            return;
+        }
+    }
 
     //
     // Get the pointer to the next entry
@@ -19,6 +19,7 @@
 
 PMMPTE MmFirstReservedMappingPte, MmLastReservedMappingPte;
 PMMPTE MiFirstReservedZeroingPte;
+PMMPTE MiProcessorZeroingPtes[MAXIMUM_PROCESSORS];
 MMPTE HyperTemplatePte;
 PEPROCESS HyperProcess;
 KIRQL HyperIrql;
@@ -125,9 +126,12 @@ MiMapPagesInZeroSpace(IN PMMPFN Pfn1,
     ASSERT(NumberOfPages <= MI_ZERO_PTES);
 
     //
-    // Pick the first zeroing PTE
+    // Pick the zeroing PTEs of this processor. Zeroing threads are bound to
+    // their processor, so nobody else uses this block and the local TB flush
+    // below is enough
     //
-    PointerPte = MiFirstReservedZeroingPte;
+    PointerPte = MiProcessorZeroingPtes[KeGetCurrentProcessorNumber()];
+    ASSERT(PointerPte != NULL);
 
     //
     // Now get the first free PTE
@@ -180,6 +184,36 @@ MiMapPagesInZeroSpace(IN PMMPFN Pfn1,
     return MiPteToAddress(PointerPte);
 }
 
+BOOLEAN
+NTAPI
+MiReserveZeroingPtes(IN ULONG Processor)
+{
+    PMMPTE PointerPte;
+
+    ASSERT(KeGetCurrentIrql() == PASSIVE_LEVEL);
+    ASSERT(Processor < MAXIMUM_PROCESSORS);
+
+    /* Already done? */
+    if (MiProcessorZeroingPtes[Processor]) return TRUE;
+
+    /* The boot processor uses the PTEs reserved during initialization */
+    if (Processor == 0)
+    {
+        MiProcessorZeroingPtes[0] = MiFirstReservedZeroingPte;
+        return TRUE;
+    }
+
+    /* Reserve system PTEs with the same layout as the boot ones */
+    PointerPte = MiReserveSystemPtes(MI_ZERO_PTES + 1, SystemPteSpace);
+    if (!PointerPte) return FALSE;
+    RtlZeroMemory(PointerPte, (MI_ZERO_PTES + 1) * sizeof(MMPTE));
+
+    /* Set the counter to maximum */
+    PointerPte->u.Hard.PageFrameNumber = MI_ZERO_PTES;
+    MiProcessorZeroingPtes[Processor] = PointerPte;
+    return TRUE;
+}
+
 VOID
 NTAPI
 MiUnmapPagesInZeroSpace(IN PVOID VirtualAddress,
@@ -28,6 +28,8 @@ typedef struct _IRP_FIND_CTXT
 extern PVOID MmNonPagedPoolEnd0;
 extern SIZE_T PoolBigPageTableSize;
 extern PPOOL_TRACKER_BIG_PAGES PoolBigPageTable;
+extern SIZE_T ExpOldBigPageTableSize;
+extern PPOOL_TRACKER_BIG_PAGES ExpOldBigPageTable;
 
 #define POOL_BIG_TABLE_ENTRY_FREE 0x1
 
@@ -216,7 +218,9 @@ ExpKdbgExtPoolUsed(
 
 static
 VOID
-ExpKdbgExtPoolFindLargePool(
+ExpKdbgExtPoolFindLargePoolTable(
+    PPOOL_TRACKER_BIG_PAGES Table,
+    SIZE_T TableSize,
     ULONG Tag,
     ULONG Mask,
     VOID (NTAPI* FoundCallback)(PPOOL_TRACKER_BIG_PAGES, PVOID),
@@ -224,33 +228,52 @@ ExpKdbgExtPoolFindLargePool(
 {
     ULONG i;
 
-    KdbpPrint("Scanning large pool allocation table for Tag: %.4s (%p : %p)\n", (PCHAR)&Tag, &PoolBigPageTable[0], &PoolBigPageTable[PoolBigPageTableSize - 1]);
+    KdbpPrint("Scanning large pool allocation table for Tag: %.4s (%p : %p)\n", (PCHAR)&Tag, &Table[0], &Table[TableSize - 1]);
 
-    for (i = 0; i < PoolBigPageTableSize; i++)
+    for (i = 0; i < TableSize; i++)
     {
         /* Free entry? */
-        if ((ULONG_PTR)PoolBigPageTable[i].Va & POOL_BIG_TABLE_ENTRY_FREE)
+        if ((ULONG_PTR)Table[i].Va & POOL_BIG_TABLE_ENTRY_FREE)
         {
             continue;
         }
 
-        if ((PoolBigPageTable[i].Key & Mask) == (Tag & Mask))
+        if ((Table[i].Key & Mask) == (Tag & Mask))
         {
             if (FoundCallback != NULL)
             {
-                FoundCallback(&PoolBigPageTable[i], CallbackContext);
+                FoundCallback(&Table[i], CallbackContext);
             }
             else
             {
                 /* Print the line */
                 KdbpPrint("%p: tag %.4s, size: %I64x\n",
-                          PoolBigPageTable[i].Va, (PCHAR)&PoolBigPageTable[i].Key,
-                          PoolBigPageTable[i].NumberOfPages << PAGE_SHIFT);
+                          Table[i].Va, (PCHAR)&Table[i].Key,
+                          Table[i].NumberOfPages << PAGE_SHIFT);
             }
         }
     }
 }
 
+static
+VOID
+ExpKdbgExtPoolFindLargePool(
+    ULONG Tag,
+    ULONG Mask,
+    VOID (NTAPI* FoundCallback)(PPOOL_TRACKER_BIG_PAGES, PVOID),
+    PVOID CallbackContext)
+{
+    ExpKdbgExtPoolFindLargePoolTable(PoolBigPageTable, PoolBigPageTableSize,
+                                     Tag, Mask, FoundCallback, CallbackContext);
+
+    /* Entries not moved yet by a resize are still in the old table */
+    if (ExpOldBigPageTable)
+    {
+        ExpKdbgExtPoolFindLargePoolTable(ExpOldBigPageTable, ExpOldBigPageTableSize,
+                                         Tag, Mask, FoundCallback, CallbackContext);
+    }
+}
+
 static
 BOOLEAN
 ExpKdbgExtValidatePoolHeader(
@@ -17,7 +17,19 @@
 
 /* GLOBALS ********************************************************************/
 
+/* Pages zeroed per PFN lock acquisition and zero space mapping */
+#define MI_ZERO_BATCH_PAGES     16
+C_ASSERT(MI_ZERO_BATCH_PAGES <= MI_ZERO_PTES);
+
+/* Upper bound on zeroing threads, more only fight for memory bandwidth */
+#define MI_MAX_ZEROING_THREADS  8
+
+/* Interval (in ms) at which an idle zeroing thread picks up leftovers */
+#define MI_ZERO_IDLE_PERIOD     1000
+
 KEVENT MmZeroingPageEvent;
+KTIMER MiZeroingIdleTimer;
+ULONG MiZeroingThreads;
 
 /* PRIVATE FUNCTIONS **********************************************************/
 
@@ -31,34 +43,28 @@ NTAPI
 MiFreeInitializationCode(IN PVOID StartVa,
 IN PVOID EndVa);
 
+static
 VOID
-NTAPI
-MmZeroPageThread(VOID)
+MiZeroFreePages(IN ULONG Processor)
 {
-    PKTHREAD Thread = KeGetCurrentThread();
-    PVOID StartAddress, EndAddress;
     PVOID WaitObjects[2];
     KIRQL OldIrql;
     PVOID ZeroAddress;
     PFN_NUMBER PageIndex, FreePage;
-    PMMPFN Pfn1;
+    PFN_NUMBER PageList[MI_ZERO_BATCH_PAGES];
+    ULONG Count, i;
+    PMMPFN Pfn1, PfnList;
 
-    /* Get the discardable sections to free them */
-    MiFindInitializationCode(&StartAddress, &EndAddress);
-    if (StartAddress) MiFreeInitializationCode(StartAddress, EndAddress);
-    DPRINT("Free non-cache pages: %lx\n", MmAvailablePages + MiMemoryConsumers[MC_CACHE].PagesUsed);
-
-    /* Set our priority to 0 */
-    Thread->BasePriority = 0;
-    KeSetPriorityThread(Thread, 0);
+    /* Stay on our processor, the zero space PTEs are per processor */
+    KeSetSystemAffinityThread(AFFINITY_MASK(Processor));
 
     /* Setup the wait objects */
     WaitObjects[0] = &MmZeroingPageEvent;
-//    WaitObjects[1] = &PoSystemIdleTimer; FIXME: Implement idle timer
+    WaitObjects[1] = &MiZeroingIdleTimer;
 
     while (TRUE)
     {
-        KeWaitForMultipleObjects(1, // 2
+        KeWaitForMultipleObjects(2,
                                  WaitObjects,
                                  WaitAny,
                                  WrFreePage,
@@ -77,36 +83,139 @@ MmZeroPageThread(VOID)
                 break;
             }
 
-            PageIndex = MmFreePageListHead.Flink;
-            ASSERT(PageIndex != LIST_HEAD);
-            Pfn1 = MiGetPfnEntry(PageIndex);
-            MI_SET_USAGE(MI_USAGE_ZERO_LOOP);
-            MI_SET_PROCESS2("Kernel 0 Loop");
-            FreePage = MiRemoveAnyPage(MI_GET_PAGE_COLOR(PageIndex));
-
-            /* The first global free page should also be the first on its own list */
-            if (FreePage != PageIndex)
+            /* Grab a batch of free pages, chained through their PFN entries */
+            PfnList = (PMMPFN)LIST_HEAD;
+            Count = 0;
+            do
             {
-                KeBugCheckEx(PFN_LIST_CORRUPT,
-                             0x8F,
-                             FreePage,
-                             PageIndex,
-                             0);
-            }
+                PageIndex = MmFreePageListHead.Flink;
+                ASSERT(PageIndex != LIST_HEAD);
+                Pfn1 = MiGetPfnEntry(PageIndex);
+                MI_SET_USAGE(MI_USAGE_ZERO_LOOP);
+                MI_SET_PROCESS2("Kernel 0 Loop");
+                FreePage = MiRemoveAnyPage(MI_GET_PAGE_COLOR(PageIndex));
+
+                /* The first global free page should also be the first on its own list */
+                if (FreePage != PageIndex)
+                {
+                    KeBugCheckEx(PFN_LIST_CORRUPT,
+                                 0x8F,
+                                 FreePage,
+                                 PageIndex,
+                                 0);
+                }
+
+                Pfn1->u1.Flink = (ULONG_PTR)PfnList;
+                PfnList = Pfn1;
+                PageList[Count++] = PageIndex;
+            } while ((Count < MI_ZERO_BATCH_PAGES) && (MmFreePageListHead.Total));
 
-            Pfn1->u1.Flink = LIST_HEAD;
             MiReleasePfnLock(OldIrql);
 
-            ZeroAddress = MiMapPagesInZeroSpace(Pfn1, 1);
+            /* Zero the whole batch through a single mapping */
+            ZeroAddress = MiMapPagesInZeroSpace(PfnList, Count);
             ASSERT(ZeroAddress);
-            RtlZeroMemory(ZeroAddress, PAGE_SIZE);
-            MiUnmapPagesInZeroSpace(ZeroAddress, 1);
+            KeZeroPagesNonTemporal(ZeroAddress, Count * PAGE_SIZE);
+            MiUnmapPagesInZeroSpace(ZeroAddress, Count);
 
             OldIrql = MiAcquirePfnLock();
 
-            MiInsertPageInList(&MmZeroedPageListHead, PageIndex);
+            for (i = 0; i < Count; i++)
+            {
+                MiInsertPageInList(&MmZeroedPageListHead, PageList[i]);
+            }
+        }
+    }
+}
+
+static
+VOID
+NTAPI
+MiZeroPageWorkerThread(IN PVOID Context)
+{
+    PKTHREAD Thread = KeGetCurrentThread();
+
+    /* Set our priority to 0 */
+    Thread->BasePriority = 0;
+    KeSetPriorityThread(Thread, 0);
+
+    MiZeroFreePages(PtrToUlong(Context));
+}
+
+static
+VOID
+MiCreateZeroingThreads(VOID)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    HANDLE ThreadHandle;
+    ULONG Processor, Count;
+    NTSTATUS Status;
+
+    Count = min(KeNumberProcessors, MI_MAX_ZEROING_THREADS);
+
+    /* The calling thread is the zeroing thread for the boot processor */
+    MiReserveZeroingPtes(0);
+    MiZeroingThreads = 1;
+
+    for (Processor = 1; Processor < Count; Processor++)
+    {
+        /* Without zero space PTEs this processor simply does not zero */
+        if (!MiReserveZeroingPtes(Processor))
+        {
+            DPRINT1("No zeroing PTEs for processor %lu\n", Processor);
+            break;
         }
+
+        InitializeObjectAttributes(&ObjectAttributes, NULL, 0, NULL, NULL);
+        Status = PsCreateSystemThread(&ThreadHandle,
+                                      THREAD_ALL_ACCESS,
+                                      &ObjectAttributes,
+                                      NULL,
+                                      NULL,
+                                      MiZeroPageWorkerThread,
+                                      UlongToPtr(Processor));
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Failed to create zeroing thread for processor %lu: 0x%lx\n", Processor, Status);
+            break;
+        }
+
+        ZwClose(ThreadHandle);
+        MiZeroingThreads++;
     }
+
+    DPRINT("Using %lu zeroing threads\n", MiZeroingThreads);
+}
+
+VOID
+NTAPI
+MmZeroPageThread(VOID)
+{
+    PKTHREAD Thread = KeGetCurrentThread();
+    PVOID StartAddress, EndAddress;
+    LARGE_INTEGER DueTime;
+
+    /* Get the discardable sections to free them */
+    MiFindInitializationCode(&StartAddress, &EndAddress);
+    if (StartAddress) MiFreeInitializationCode(StartAddress, EndAddress);
+    DPRINT("Free non-cache pages: %lx\n", MmAvailablePages + MiMemoryConsumers[MC_CACHE].PagesUsed);
+
+    /* Set our priority to 0 */
+    Thread->BasePriority = 0;
+    KeSetPriorityThread(Thread, 0);
+
+    /*
+     * The idle timer is a periodic synchronization timer, so each tick wakes
+     * a single zeroing thread to zero the pages left below the event threshold
+     */
+    KeInitializeTimerEx(&MiZeroingIdleTimer, SynchronizationTimer);
+    DueTime.QuadPart = Int32x32To64(MI_ZERO_IDLE_PERIOD, -10000);
+    KeSetTimerEx(&MiZeroingIdleTimer, DueTime, MI_ZERO_IDLE_PERIOD, NULL);
+
+    /* Start the zeroing threads of the other processors */
+    MiCreateZeroingThreads();
+
+    MiZeroFreePages(0);
 }
 
 /* EOF */
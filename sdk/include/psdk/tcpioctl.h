@@ -102,6 +102,9 @@
 
 /* TCP connection options */
 #define TCP_SOCKET_NODELAY 1
+#define TCP_SOCKET_WINDOW  6
+/* ReactOS specific: size of the send buffer */
+#define TCP_SOCKET_SNDBUF  0x100
 
 typedef struct IFEntry
 {
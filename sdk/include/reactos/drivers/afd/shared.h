@@ -59,6 +59,34 @@ typedef struct _AFD_POLL_INFO {
     AFD_HANDLE			        Handles[1];
 } AFD_POLL_INFO, *PAFD_POLL_INFO;
 
+/* ReactOS extension: readiness of a socket delivered to its completion port */
+typedef struct _AFD_READINESS_INFO {
+    ULONG				Events;
+    PVOID				Context;
+} AFD_READINESS_INFO, *PAFD_READINESS_INFO;
+
+typedef struct _AFD_TRANSMIT_FILE_INFO {
+    HANDLE				FileHandle;
+    LARGE_INTEGER			Offset;
+    LARGE_INTEGER			WriteLength;
+    ULONG				SendPacketLength;
+    ULONG				Flags;
+    AFD_WSABUF				Buffers[2];	/* Head and tail */
+} AFD_TRANSMIT_FILE_INFO, *PAFD_TRANSMIT_FILE_INFO;
+
+/* The receive part looks like an AFD_RECV_INFO with a single buffer, which
+ * holds the data followed by the local and remote addresses */
+typedef struct _AFD_SUPER_ACCEPT_INFO {
+    PAFD_WSABUF				BufferArray;
+    ULONG				BufferCount;
+    ULONG				AfdFlags;
+    ULONG				TdiFlags;
+    HANDLE				AcceptHandle;
+    ULONG				ReceiveDataLength;
+    ULONG				LocalAddressLength;
+    ULONG				RemoteAddressLength;
+} AFD_SUPER_ACCEPT_INFO, *PAFD_SUPER_ACCEPT_INFO;
+
 typedef struct _AFD_ACCEPT_DATA {
     ULONG				UseSAN;
     ULONG				SequenceNumber;
@@ -113,6 +141,7 @@ typedef struct _AFD_SEND_INFO_UDP {
 } AFD_SEND_INFO_UDP, *PAFD_SEND_INFO_UDP;
 
 C_ASSERT(sizeof(AFD_RECV_INFO) == sizeof(AFD_SEND_INFO));
+C_ASSERT(FIELD_OFFSET(AFD_SUPER_ACCEPT_INFO, AcceptHandle) == sizeof(AFD_RECV_INFO));
 
 typedef struct  _AFD_CONNECT_INFO {
     BOOLEAN				UseSAN;
@@ -219,6 +248,10 @@ typedef struct _AFD_TDI_HANDLE_DATA
 #define AFD_OVERLAPPED			0x2L
 #define AFD_IMMEDIATE                   0x4L
 
+/* AFD TransmitFile flags, same as the TF_ flags */
+#define AFD_TF_DISCONNECT		0x01L
+#define AFD_TF_REUSE_SOCKET		0x02L
+
 /* IOCTL Generation */
 #define FSCTL_AFD_BASE                  FILE_DEVICE_NETWORK
 #define _AFD_CONTROL_CODE(Operation,Method) \
@@ -256,11 +289,14 @@ typedef struct _AFD_TDI_HANDLE_DATA
 #define AFD_SET_DISCONNECT_DATA_SIZE    28
 #define AFD_SET_DISCONNECT_OPTIONS_SIZE 29
 #define AFD_GET_INFO			30
+#define AFD_TRANSMIT_FILE		31
+#define AFD_SUPER_ACCEPT		32
 #define AFD_EVENT_SELECT		33
 #define AFD_ENUM_NETWORK_EVENTS         34
 #define AFD_DEFER_ACCEPT		35
 #define AFD_GET_PENDING_CONNECT_DATA	41
 #define AFD_VALIDATE_GROUP		42
+#define AFD_SET_READINESS		0x100
 
 /* AFD IOCTLs */
 
@@ -326,6 +362,10 @@ typedef struct _AFD_TDI_HANDLE_DATA
   _AFD_CONTROL_CODE(AFD_SET_DISCONNECT_OPTIONS_SIZE, METHOD_NEITHER)
 #define IOCTL_AFD_GET_INFO \
   _AFD_CONTROL_CODE(AFD_GET_INFO, METHOD_NEITHER)
+#define IOCTL_AFD_TRANSMIT_FILE \
+  _AFD_CONTROL_CODE(AFD_TRANSMIT_FILE, METHOD_NEITHER)
+#define IOCTL_AFD_SUPER_ACCEPT \
+  _AFD_CONTROL_CODE(AFD_SUPER_ACCEPT, METHOD_NEITHER)
 #define IOCTL_AFD_EVENT_SELECT \
   _AFD_CONTROL_CODE(AFD_EVENT_SELECT, METHOD_NEITHER)
 #define IOCTL_AFD_DEFER_ACCEPT \
@@ -336,6 +376,8 @@ typedef struct _AFD_TDI_HANDLE_DATA
   _AFD_CONTROL_CODE(AFD_ENUM_NETWORK_EVENTS, METHOD_NEITHER)
 #define IOCTL_AFD_VALIDATE_GROUP \
   _AFD_CONTROL_CODE(AFD_VALIDATE_GROUP, METHOD_NEITHER)
+#define IOCTL_AFD_SET_READINESS \
+  _AFD_CONTROL_CODE(AFD_SET_READINESS, METHOD_NEITHER)
 
 typedef struct _AFD_SOCKET_INFORMATION {
     BOOL CommandChannel;
@@ -110,6 +110,8 @@
 #define COMPRESSION_FORMAT_NONE         (0x0000)
 #define COMPRESSION_FORMAT_DEFAULT      (0x0001)
 #define COMPRESSION_FORMAT_LZNT1        (0x0002)
+#define COMPRESSION_FORMAT_XPRESS       (0x0003)
+#define COMPRESSION_FORMAT_XPRESS_HUFF  (0x0004)
 #define COMPRESSION_ENGINE_STANDARD     (0x0000)
 #define COMPRESSION_ENGINE_MAXIMUM      (0x0100)
 #define COMPRESSION_ENGINE_HIBER        (0x0200)
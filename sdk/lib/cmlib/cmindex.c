@@ -455,6 +455,28 @@ CmpFindSubKeyInLeaf(IN PHHIVE Hive,
     return High;
 }
 
+static inline
+ULONG
+CmpUpcaseHashChar(IN WCHAR Char)
+{
+    /* Check what kind of char we have */
+    if (Char >= L'a')
+    {
+        /* In the lower case region... is it truly lower case? */
+        if (Char < L'z')
+        {
+            /* Yes! Calculate it ourselves! */
+            return Char - L'a' + L'A';
+        }
+
+        /* No, use the API */
+        return RtlUpcaseUnicodeChar(Char);
+    }
+
+    /* Reuse the char, it's already upcased */
+    return Char;
+}
+
 ULONG
 NTAPI
 CmpComputeHashKey(IN ULONG Hash,
@@ -462,7 +484,7 @@ CmpComputeHashKey(IN ULONG Hash,
                   IN BOOLEAN AllowSeparators)
 {
     LPWSTR Cp;
-    ULONG Value, i;
+    ULONG i;
 
     /* Make some sanity checks on our parameters */
     ASSERT((Name->Length == 0) ||
@@ -479,30 +501,9 @@ CmpComputeHashKey(IN ULONG Hash,
         /* Make sure we don't have a separator when we shouldn't */
         ASSERT(AllowSeparators || (*Cp != OBJ_NAME_PATH_SEPARATOR));
 
-        /* Check what kind of char we have */
-        if (*Cp >= L'a')
-        {
-            /* In the lower case region... is it truly lower case? */
-            if (*Cp < L'z')
-            {
-                /* Yes! Calculate it ourselves! */
-                Value = *Cp - L'a' + L'A';
-            }
-            else
-            {
-                /* No, use the API */
-                Value = RtlUpcaseUnicodeChar(*Cp);
-            }
-        }
-        else
-        {
-            /* Reuse the char, it's already upcased */
-            Value = *Cp;
-        }
-
-        /* Multiply by a prime and add our value */
+        /* Multiply by a prime and add the upcased char */
         Hash *= 37;
-        Hash += Value;
+        Hash += CmpUpcaseHashChar(*Cp);
     }
 
     /* Return the hash */
@@ -678,6 +679,505 @@ CmpFindSubKeyByHash(IN PHHIVE Hive,
     return HCELL_NIL;
 }
 
+static ULONG
+NTAPI
+CmpComputeKeyNodeHash(IN PCM_KEY_NODE Node)
+{
+    PUCHAR CompressedName;
+    ULONG Hash = 0, i;
+
+    /* Hash the name the way CmpComputeHashKey hashes its expanded form */
+    if (Node->Flags & KEY_COMP_NAME)
+    {
+        CompressedName = (PUCHAR)Node->Name;
+        for (i = 0; i < Node->NameLength; i++)
+        {
+            Hash = Hash * 37 + CmpUpcaseHashChar((WCHAR)CompressedName[i]);
+        }
+    }
+    else
+    {
+        for (i = 0; i < Node->NameLength / sizeof(WCHAR); i++)
+        {
+            Hash = Hash * 37 + CmpUpcaseHashChar(Node->Name[i]);
+        }
+    }
+
+    return Hash;
+}
+
+static inline
+ULONG
+CmpSubKeyHashSlot(IN PCM_SUBKEY_HASH Hash,
+                  IN ULONG HashKey)
+{
+    /* The name hash is weak in its low bits, so take the top of a product */
+    return (HashKey * 0x9E3779B1) >> (32 - Hash->Shift);
+}
+
+static VOID
+NTAPI
+CmpInsertSubKeyHash(IN PCM_SUBKEY_HASH Hash,
+                    IN HCELL_INDEX Cell,
+                    IN ULONG HashKey)
+{
+    ULONG Slot, Mask = (1 << Hash->Shift) - 1;
+
+    /* Take the first free slot from the home of the name */
+    Slot = CmpSubKeyHashSlot(Hash, HashKey);
+    while (Hash->Table[Slot].Cell != HCELL_NIL) Slot = (Slot + 1) & Mask;
+    Hash->Table[Slot].Cell = Cell;
+    Hash->Table[Slot].HashKey = HashKey;
+}
+
+static BOOLEAN
+NTAPI
+CmpDeleteSubKeyHash(IN PCM_SUBKEY_HASH Hash,
+                    IN HCELL_INDEX Cell,
+                    IN ULONG HashKey)
+{
+    ULONG Slot, Next, Home, Mask = (1 << Hash->Shift) - 1;
+
+    /* Find the slot of the cell */
+    for (Slot = CmpSubKeyHashSlot(Hash, HashKey);
+         Hash->Table[Slot].Cell != Cell;
+         Slot = (Slot + 1) & Mask)
+    {
+        if (Hash->Table[Slot].Cell == HCELL_NIL) return FALSE;
+    }
+
+    /*
+     * Pull back the entries after it whose home comes before the hole, so
+     * that no probe run is cut short by the slot we free.
+     */
+    for (Next = (Slot + 1) & Mask;
+         Hash->Table[Next].Cell != HCELL_NIL;
+         Next = (Next + 1) & Mask)
+    {
+        Home = CmpSubKeyHashSlot(Hash, Hash->Table[Next].HashKey);
+        if ((Slot <= Next) ? ((Slot < Home) && (Home <= Next)) :
+                             ((Slot < Home) || (Home <= Next)))
+        {
+            continue;
+        }
+
+        Hash->Table[Slot] = Hash->Table[Next];
+        Slot = Next;
+    }
+
+    Hash->Table[Slot].Cell = HCELL_NIL;
+    return TRUE;
+}
+
+static BOOLEAN
+NTAPI
+CmpAddLeafToSubKeyHash(IN PHHIVE Hive,
+                       IN PCM_SUBKEY_HASH Hash,
+                       IN PCM_KEY_INDEX Leaf,
+                       IN OUT PULONG Entries)
+{
+    PCM_KEY_FAST_INDEX FastIndex = (PCM_KEY_FAST_INDEX)Leaf;
+    PCM_KEY_NODE Node;
+    HCELL_INDEX Cell;
+    ULONG HashKey, i;
+
+    for (i = 0; i < Leaf->Count; i++)
+    {
+        /* Don't overflow the table if the counts in the node are off */
+        if (!*Entries) return FALSE;
+
+        if (Leaf->Signature == CM_KEY_HASH_LEAF)
+        {
+            /* Hash leaves already carry the hash of every name */
+            Cell = FastIndex->List[i].Cell;
+            HashKey = FastIndex->List[i].HashKey;
+        }
+        else
+        {
+            Cell = (Leaf->Signature == CM_KEY_FAST_LEAF) ?
+                   FastIndex->List[i].Cell : Leaf->List[i];
+
+            Node = (PCM_KEY_NODE)HvGetCell(Hive, Cell);
+            if (!Node) return FALSE;
+            HashKey = CmpComputeKeyNodeHash(Node);
+            HvReleaseCell(Hive, Cell);
+        }
+
+        CmpInsertSubKeyHash(Hash, Cell, HashKey);
+        (*Entries)--;
+    }
+
+    return TRUE;
+}
+
+static PCM_SUBKEY_HASH
+NTAPI
+CmpBuildSubKeyHash(IN PHHIVE Hive,
+                   IN PCM_KEY_NODE Parent,
+                   IN ULONG Count)
+{
+    PCM_SUBKEY_HASH Hash;
+    PCM_KEY_INDEX Index, Leaf;
+    ULONG Shift, Type, i;
+    BOOLEAN Result = TRUE;
+
+    /* Start at most half full, so that probe runs stay short as keys get added */
+    for (Shift = 1; (1UL << Shift) < Count * 2; Shift++);
+
+    Hash = Hive->Allocate(FIELD_OFFSET(CM_SUBKEY_HASH, Table[1 << Shift]),
+                          TRUE,
+                          TAG_CM);
+    if (!Hash) return NULL;
+
+    Hash->Shift = Shift;
+    for (i = 0; i < (1UL << Shift); i++) Hash->Table[i].Cell = HCELL_NIL;
+
+    for (Type = 0; Type < HTYPE_COUNT; Type++)
+    {
+        Hash->SubKeyLists[Type] = Parent->SubKeyLists[Type];
+        Hash->SubKeyCounts[Type] = Parent->SubKeyCounts[Type];
+    }
+
+    /* Enter every subkey of every storage type */
+    for (Type = 0; (Type < Hive->StorageTypeCount) && Result; Type++)
+    {
+        if (!Parent->SubKeyCounts[Type]) continue;
+
+        Index = (PCM_KEY_INDEX)HvGetCell(Hive, Parent->SubKeyLists[Type]);
+        if (!Index)
+        {
+            Result = FALSE;
+            break;
+        }
+
+        if (Index->Signature == CM_KEY_INDEX_ROOT)
+        {
+            for (i = 0; (i < Index->Count) && Result; i++)
+            {
+                Leaf = (PCM_KEY_INDEX)HvGetCell(Hive, Index->List[i]);
+                if (!Leaf)
+                {
+                    Result = FALSE;
+                    break;
+                }
+
+                Result = CmpAddLeafToSubKeyHash(Hive, Hash, Leaf, &Count);
+                HvReleaseCell(Hive, Index->List[i]);
+            }
+        }
+        else
+        {
+            Result = CmpAddLeafToSubKeyHash(Hive, Hash, Index, &Count);
+        }
+
+        HvReleaseCell(Hive, Parent->SubKeyLists[Type]);
+    }
+
+    /* The indexes must hold exactly as many keys as the node says */
+    if (!Result || Count)
+    {
+        Hive->Free(Hash, 0);
+        return NULL;
+    }
+
+    return Hash;
+}
+
+static BOOLEAN
+NTAPI
+CmpIsSubKeyHashCurrent(IN PCM_SUBKEY_HASH Hash,
+                       IN PCM_KEY_NODE Node)
+{
+    ULONG Type;
+
+    for (Type = 0; Type < HTYPE_COUNT; Type++)
+    {
+        if ((Hash->SubKeyLists[Type] != Node->SubKeyLists[Type]) ||
+            (Hash->SubKeyCounts[Type] != Node->SubKeyCounts[Type]))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static PCM_SUBKEY_HASH_ENTRY
+NTAPI
+CmpGetSubKeyHashEntry(IN PHHIVE Hive,
+                      IN PCM_KEY_NODE Node,
+                      IN BOOLEAN Create)
+{
+    PCM_SUBKEY_HASH_TABLE Table;
+    PCM_SUBKEY_HASH_ENTRY volatile *Bucket;
+    PCM_SUBKEY_HASH_ENTRY First, Entry, NewEntry = NULL;
+
+    /* Allocate the table of the hive the first time */
+    Table = Hive->SubKeyHashTable;
+    if (!Table)
+    {
+        if (!Create) return NULL;
+
+        Table = Hive->Allocate(sizeof(CM_SUBKEY_HASH_TABLE), TRUE, TAG_CM);
+        if (!Table) return NULL;
+        RtlZeroMemory(Table, sizeof(CM_SUBKEY_HASH_TABLE));
+
+        First = InterlockedCompareExchangePointer((PVOID*)&Hive->SubKeyHashTable,
+                                                  Table,
+                                                  NULL);
+        if (First)
+        {
+            /* Somebody else was faster */
+            Hive->Free(Table, 0);
+            Table = (PCM_SUBKEY_HASH_TABLE)First;
+        }
+    }
+
+    /*
+     * Entries are only ever pushed, so lookups of other keys can walk the
+     * bucket while we add to it.
+     */
+    Bucket = &Table->Buckets[((ULONG_PTR)Node / sizeof(ULONG_PTR)) %
+                             CMP_SUBKEY_HASH_BUCKETS];
+    First = *Bucket;
+    for (;;)
+    {
+        for (Entry = First; Entry; Entry = Entry->Next)
+        {
+            if (Entry->Node == Node)
+            {
+                if (NewEntry) Hive->Free(NewEntry, 0);
+                return Entry;
+            }
+        }
+
+        if (!Create) return NULL;
+
+        if (!NewEntry)
+        {
+            NewEntry = Hive->Allocate(sizeof(CM_SUBKEY_HASH_ENTRY), TRUE, TAG_CM);
+            if (!NewEntry) return NULL;
+            NewEntry->Node = Node;
+            NewEntry->Hash = NULL;
+            NewEntry->Retired = NULL;
+        }
+
+        NewEntry->Next = First;
+        Entry = InterlockedCompareExchangePointer((PVOID*)Bucket, NewEntry, First);
+        if (Entry == First) return NewEntry;
+        First = Entry;
+    }
+}
+
+/*
+ * A lookup that replaces a stale hash can't free it, other lookups under the
+ * same parent may still be reading it. It goes on the retired list of the
+ * entry, which is freed by the next caller that owns the parent.
+ */
+static VOID
+NTAPI
+CmpRetireSubKeyHash(IN PCM_SUBKEY_HASH_ENTRY Entry,
+                    IN PCM_SUBKEY_HASH Hash)
+{
+    PCM_SUBKEY_HASH First, Current;
+
+    First = Entry->Retired;
+    for (;;)
+    {
+        Hash->NextRetired = First;
+        Current = InterlockedCompareExchangePointer((PVOID*)&Entry->Retired,
+                                                    Hash,
+                                                    First);
+        if (Current == First) break;
+        First = Current;
+    }
+}
+
+static VOID
+NTAPI
+CmpFreeRetiredSubKeyHashes(IN PHHIVE Hive,
+                           IN PCM_SUBKEY_HASH_ENTRY Entry)
+{
+    PCM_SUBKEY_HASH Hash, NextHash;
+
+    Hash = InterlockedExchangePointer((PVOID*)&Entry->Retired, NULL);
+    for (; Hash; Hash = NextHash)
+    {
+        NextHash = Hash->NextRetired;
+        Hive->Free(Hash, 0);
+    }
+}
+
+/*
+ * CmpAddSubKey and CmpRemoveSubKey take the hash of the parent away while
+ * they change its indexes, and give it back updated. The caller of those
+ * owns the subkeys of the parent, so no lookup can be reading the hash.
+ */
+static PCM_SUBKEY_HASH
+NTAPI
+CmpDetachSubKeyHash(IN PHHIVE Hive,
+                    IN PCM_KEY_NODE Node)
+{
+    PCM_SUBKEY_HASH_ENTRY Entry;
+    PCM_SUBKEY_HASH Hash;
+
+    Entry = CmpGetSubKeyHashEntry(Hive, Node, FALSE);
+    if (!Entry) return NULL;
+
+    /* Nobody can be reading the hashes that lookups replaced anymore */
+    CmpFreeRetiredSubKeyHashes(Hive, Entry);
+
+    Hash = InterlockedExchangePointer((PVOID*)&Entry->Hash, NULL);
+    if (Hash && !CmpIsSubKeyHashCurrent(Hash, Node))
+    {
+        /* It doesn't describe the node anymore, rebuild it on demand */
+        Hive->Free(Hash, 0);
+        Hash = NULL;
+    }
+
+    return Hash;
+}
+
+static VOID
+NTAPI
+CmpAttachSubKeyHash(IN PHHIVE Hive,
+                    IN PCM_KEY_NODE Node,
+                    IN PCM_SUBKEY_HASH Hash)
+{
+    PCM_SUBKEY_HASH_ENTRY Entry;
+    ULONG Type;
+
+    for (Type = 0; Type < HTYPE_COUNT; Type++)
+    {
+        Hash->SubKeyLists[Type] = Node->SubKeyLists[Type];
+        Hash->SubKeyCounts[Type] = Node->SubKeyCounts[Type];
+    }
+
+    Entry = CmpGetSubKeyHashEntry(Hive, Node, FALSE);
+    if (!Entry ||
+        InterlockedCompareExchangePointer((PVOID*)&Entry->Hash, Hash, NULL))
+    {
+        Hive->Free(Hash, 0);
+    }
+}
+
+static BOOLEAN
+NTAPI
+CmpFindSubKeyInHash(IN PHHIVE Hive,
+                    IN PCM_KEY_NODE Parent,
+                    IN PCUNICODE_STRING SearchName,
+                    OUT PHCELL_INDEX SubKey)
+{
+    PCM_SUBKEY_HASH_ENTRY Entry;
+    PCM_SUBKEY_HASH Hash, NewHash, CurrentHash;
+    ULONG Count = 0, HashKey, Slot, Mask, Type;
+
+    /* Binary search is good enough for narrow keys */
+    for (Type = 0; Type < Hive->StorageTypeCount; Type++)
+    {
+        Count += Parent->SubKeyCounts[Type];
+    }
+    if (Count < CMP_SUBKEY_HASH_THRESHOLD) return FALSE;
+
+    Entry = CmpGetSubKeyHashEntry(Hive, Parent, TRUE);
+    if (!Entry) return FALSE;
+
+    /*
+     * Build the hash if this is the first lookup, or if somebody changed the
+     * subkeys without going through CmpAddSubKey or CmpRemoveSubKey.
+     */
+    Hash = Entry->Hash;
+    if (!Hash || !CmpIsSubKeyHashCurrent(Hash, Parent))
+    {
+        NewHash = CmpBuildSubKeyHash(Hive, Parent, Count);
+        if (!NewHash) return FALSE;
+
+        CurrentHash = InterlockedCompareExchangePointer((PVOID*)&Entry->Hash,
+                                                        NewHash,
+                                                        Hash);
+        if (CurrentHash != Hash)
+        {
+            /* Another lookup replaced it at the same time, use theirs */
+            Hive->Free(NewHash, 0);
+            Hash = CurrentHash;
+            if (!Hash || !CmpIsSubKeyHashCurrent(Hash, Parent)) return FALSE;
+        }
+        else
+        {
+            /* Other lookups may still be reading the stale one */
+            if (Hash) CmpRetireSubKeyHash(Entry, Hash);
+            Hash = NewHash;
+        }
+    }
+
+    /* Walk the probe run of the name until a match or a free slot */
+    HashKey = CmpComputeHashKey(0, SearchName, FALSE);
+    Mask = (1 << Hash->Shift) - 1;
+    for (Slot = CmpSubKeyHashSlot(Hash, HashKey);
+         Hash->Table[Slot].Cell != HCELL_NIL;
+         Slot = (Slot + 1) & Mask)
+    {
+        if ((Hash->Table[Slot].HashKey == HashKey) &&
+            !(CmpDoCompareKeyName(Hive, SearchName, Hash->Table[Slot].Cell)))
+        {
+            *SubKey = Hash->Table[Slot].Cell;
+            return TRUE;
+        }
+    }
+
+    /* The hash holds every subkey, so the name isn't there */
+    *SubKey = HCELL_NIL;
+    return TRUE;
+}
+
+VOID
+NTAPI
+CmpFreeSubKeyHashTable(IN PHHIVE Hive)
+{
+    PCM_SUBKEY_HASH_TABLE Table = Hive->SubKeyHashTable;
+    PCM_SUBKEY_HASH_ENTRY Entry, NextEntry;
+    ULONG i;
+
+    if (!Table) return;
+
+    for (i = 0; i < CMP_SUBKEY_HASH_BUCKETS; i++)
+    {
+        for (Entry = Table->Buckets[i]; Entry; Entry = NextEntry)
+        {
+            NextEntry = Entry->Next;
+            if (Entry->Hash) Hive->Free(Entry->Hash, 0);
+            CmpFreeRetiredSubKeyHashes(Hive, Entry);
+            Hive->Free(Entry, 0);
+        }
+    }
+
+    Hive->Free(Table, 0);
+    Hive->SubKeyHashTable = NULL;
+}
+
+/*
+ * Called when a key node is deleted and whenever a cell is freed, so that a
+ * key node later allocated at the same address doesn't find the hash of the
+ * old one. The entry itself stays in its bucket, since lookups of other keys
+ * may be walking it, and is reused by whatever node gets that address next.
+ * The caller owns the cell, so no lookup can be reading its hashes.
+ */
+VOID
+NTAPI
+CmpInvalidateSubKeyHash(IN PHHIVE Hive,
+                        IN PVOID CellData)
+{
+    PCM_SUBKEY_HASH_ENTRY Entry;
+    PCM_SUBKEY_HASH Hash;
+
+    Entry = CmpGetSubKeyHashEntry(Hive, (PCM_KEY_NODE)CellData, FALSE);
+    if (!Entry) return;
+
+    Hash = InterlockedExchangePointer((PVOID*)&Entry->Hash, NULL);
+    if (Hash) Hive->Free(Hash, 0);
+    CmpFreeRetiredSubKeyHashes(Hive, Entry);
+}
+
 HCELL_INDEX
 NTAPI
 CmpFindSubKeyByName(IN PHHIVE Hive,
@@ -689,6 +1189,9 @@ CmpFindSubKeyByName(IN PHHIVE Hive,
     HCELL_INDEX SubKey, CellToRelease;
     ULONG Found;
 
+    /* Wide keys are looked up through their in-memory hash */
+    if (CmpFindSubKeyInHash(Hive, Parent, SearchName, &SubKey)) return SubKey;
+
     /* Loop each storage type */
     for (i = 0; i < Hive->StorageTypeCount; i++)
     {
@@ -1474,6 +1977,7 @@ CmpAddSubKey(IN PHHIVE Hive,
     UNICODE_STRING Name;
     HCELL_INDEX IndexCell = HCELL_NIL, CellToRelease = HCELL_NIL, LeafCell;
     PHCELL_INDEX RootPointer = NULL;
+    PCM_SUBKEY_HASH Hash;
     ULONG Type, i;
     BOOLEAN IsCompressed;
     PAGED_CODE();
@@ -1533,6 +2037,9 @@ CmpAddSubKey(IN PHHIVE Hive,
         ASSERT(FALSE);
     }
 
+    /* The subkeys are about to change */
+    Hash = CmpDetachSubKeyHash(Hive, KeyNode);
+
     /* Find out the type of the cell, and check if this is the first subkey */
     Type = HvGetCellType(Child);
     if (!KeyNode->SubKeyCounts[Type])
@@ -1681,6 +2188,21 @@ CmpAddSubKey(IN PHHIVE Hive,
         KeyNode->SubKeyLists[Type] = LeafCell;
     }
 
+    /* Enter the new key in the hash, unless it is getting crowded */
+    if (Hash)
+    {
+        if ((KeyNode->SubKeyCounts[Stable] + KeyNode->SubKeyCounts[Volatile]) * 4 <=
+            (3UL << Hash->Shift))
+        {
+            CmpInsertSubKeyHash(Hash, Child, CmpComputeHashKey(0, &Name, FALSE));
+            CmpAttachSubKeyHash(Hive, KeyNode, Hash);
+        }
+        else
+        {
+            Hive->Free(Hash, 0);
+        }
+    }
+
     /* If the name was compressed, free our copy */
     if (IsCompressed) Hive->Free(Name.Buffer, 0);
 
@@ -1707,6 +2229,7 @@ CmpRemoveSubKey(IN PHHIVE Hive,
     ULONG Storage, RootIndex = INVALID_INDEX, LeafIndex;
     BOOLEAN Result = FALSE;
     HCELL_INDEX CellToRelease1 = HCELL_NIL, CellToRelease2  = HCELL_NIL;
+    PCM_SUBKEY_HASH Hash = NULL;
 
     /* Get the target key node */
     Node = (PCM_KEY_NODE)HvGetCell(Hive, TargetKey);
@@ -1765,6 +2288,9 @@ CmpRemoveSubKey(IN PHHIVE Hive,
     ASSERT(HvIsCellDirty(Hive, ParentKey));
     HvReleaseCell(Hive, ParentKey);
 
+    /* The subkeys are about to change */
+    Hash = CmpDetachSubKeyHash(Hive, Node);
+
     /* Get the storage type and make sure it's not empty */
     Storage = HvGetCellType(TargetKey);
     ASSERT(Node->SubKeyCounts[Storage] != 0);
@@ -1863,7 +2389,20 @@ CmpRemoveSubKey(IN PHHIVE Hive,
     /* If we got here, now we're done */
     Result = TRUE;
 
+    /* Take the key out of the hash too, unless the parent isn't wide anymore */
+    if (Hash &&
+        ((Node->SubKeyCounts[Stable] + Node->SubKeyCounts[Volatile]) >=
+         CMP_SUBKEY_HASH_THRESHOLD / 2) &&
+        CmpDeleteSubKeyHash(Hash, TargetKey, CmpComputeHashKey(0, &SearchName, TRUE)))
+    {
+        CmpAttachSubKeyHash(Hive, Node, Hash);
+        Hash = NULL;
+    }
+
 Exit:
+    /* Drop the hash if we couldn't keep it up to date */
+    if (Hash) Hive->Free(Hash, 0);
+
     /* Release any cells we may have been holding */
     if (CellToRelease1 != HCELL_NIL) HvReleaseCell(Hive, CellToRelease1);
     if (CellToRelease2 != HCELL_NIL) HvReleaseCell(Hive, CellToRelease2);
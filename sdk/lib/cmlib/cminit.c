@@ -70,55 +70,159 @@ CmCreateRootNode(
     return TRUE;
 }
 
+/* Deeper than any legitimate hive, stops cycles in a corrupted one */
+#define CMP_MAX_PREPARE_DEPTH   512
+
 static VOID CMAPI
 CmpPrepareKey(
     PHHIVE RegistryHive,
-    PCM_KEY_NODE KeyCell);
+    HCELL_INDEX KeyCellIndex,
+    ULONG Depth);
+
+/*
+ * The cells of a hive that was just loaded are not trusted yet. Make sure the
+ * cell is aligned, allocated, lies wholly inside its bin and has room for the
+ * DataSize bytes the caller is about to read.
+ */
+static BOOLEAN CMAPI
+CmpIsPrepareCellValid(
+    PHHIVE RegistryHive,
+    HCELL_INDEX CellIndex,
+    ULONG DataSize)
+{
+    PHBIN Bin;
+    PHCELL Cell;
+    ULONG Offset, BinStart, BinEnd;
+    LONG Size;
+
+    if (CellIndex == HCELL_NIL ||
+        HvGetCellType(CellIndex) != Stable ||
+        (CellIndex & 7) != 0 ||
+        !HvIsCellAllocated(RegistryHive, CellIndex))
+    {
+        return FALSE;
+    }
+
+    Offset = CellIndex & ~HCELL_TYPE_MASK;
+    if (RegistryHive->Flat)
+    {
+        BinStart = 0;
+        BinEnd = RegistryHive->BaseBlock->Length;
+    }
+    else
+    {
+        Bin = (PHBIN)RegistryHive->Storage[Stable].BlockList[HvGetCellBlock(CellIndex)].BinAddress;
+        BinStart = Bin->FileOffset + sizeof(HBIN);
+        BinEnd = Bin->FileOffset + Bin->Size;
+    }
+
+    /* The header must not overlap the bin header nor run past the bin */
+    if (Offset < BinStart || Offset >= BinEnd || BinEnd - Offset < sizeof(HCELL))
+        return FALSE;
+
+    /* Allocated cells have a negative size, which must cover the data */
+    Cell = (PHCELL)HvGetCell(RegistryHive, CellIndex) - 1;
+    Size = Cell->Size;
+    if (Size >= 0)
+        return FALSE;
+    Size = -Size;
+
+    return ((ULONG)Size >= sizeof(HCELL) + DataSize &&
+            (ULONG)Size <= BinEnd - Offset);
+}
 
 static VOID CMAPI
 CmpPrepareIndexOfKeys(
     PHHIVE RegistryHive,
-    PCM_KEY_INDEX IndexCell)
+    HCELL_INDEX IndexCellIndex,
+    ULONG Depth)
 {
+    PCM_KEY_INDEX IndexCell;
+    LONG CellSize;
+    ULONG Count;
     ULONG i;
 
+    if (!CmpIsPrepareCellValid(RegistryHive, IndexCellIndex,
+                               FIELD_OFFSET(CM_KEY_INDEX, List)))
+    {
+        DPRINT1("Invalid index cell %08lx\n", IndexCellIndex);
+        return;
+    }
+
+    IndexCell = HvGetCell(RegistryHive, IndexCellIndex);
+    CellSize = HvGetCellSize(RegistryHive, IndexCell);
+    Count = IndexCell->Count;
+
     if (IndexCell->Signature == CM_KEY_INDEX_ROOT ||
         IndexCell->Signature == CM_KEY_INDEX_LEAF)
     {
-        for (i = 0; i < IndexCell->Count; i++)
+        /* Do not read entries past the end of the cell */
+        if (CellSize < (LONG)FIELD_OFFSET(CM_KEY_INDEX, List[Count]))
         {
-            PCM_KEY_INDEX SubIndexCell = HvGetCell(RegistryHive, IndexCell->List[i]);
+            DPRINT1("Index cell %08lx is too small for %lu entries\n", IndexCellIndex, Count);
+            return;
+        }
+
+        for (i = 0; i < Count; i++)
+        {
+            PCM_KEY_INDEX SubIndexCell;
+
+            if (!CmpIsPrepareCellValid(RegistryHive, IndexCell->List[i],
+                                       FIELD_OFFSET(CM_KEY_INDEX, List)))
+                continue;
+
+            SubIndexCell = HvGetCell(RegistryHive, IndexCell->List[i]);
             if (SubIndexCell->Signature == CM_KEY_NODE_SIGNATURE)
-                CmpPrepareKey(RegistryHive, (PCM_KEY_NODE)SubIndexCell);
-            else
-                CmpPrepareIndexOfKeys(RegistryHive, SubIndexCell);
+                CmpPrepareKey(RegistryHive, IndexCell->List[i], Depth);
+            else if (IndexCell->Signature == CM_KEY_INDEX_ROOT &&
+                     SubIndexCell->Signature != CM_KEY_INDEX_ROOT)
+                CmpPrepareIndexOfKeys(RegistryHive, IndexCell->List[i], Depth);
         }
-   }
+    }
     else if (IndexCell->Signature == CM_KEY_FAST_LEAF ||
              IndexCell->Signature == CM_KEY_HASH_LEAF)
     {
         PCM_KEY_FAST_INDEX HashCell = (PCM_KEY_FAST_INDEX)IndexCell;
-        for (i = 0; i < HashCell->Count; i++)
+
+        if (CellSize < (LONG)FIELD_OFFSET(CM_KEY_FAST_INDEX, List[Count]))
         {
-            PCM_KEY_NODE SubKeyCell = HvGetCell(RegistryHive, HashCell->List[i].Cell);
-            CmpPrepareKey(RegistryHive, SubKeyCell);
+            DPRINT1("Index cell %08lx is too small for %lu entries\n", IndexCellIndex, Count);
+            return;
+        }
+
+        for (i = 0; i < Count; i++)
+        {
+            CmpPrepareKey(RegistryHive, HashCell->List[i].Cell, Depth);
         }
     }
     else
     {
         DPRINT1("IndexCell->Signature %x\n", IndexCell->Signature);
-        ASSERT(FALSE);
     }
 }
 
 static VOID CMAPI
 CmpPrepareKey(
     PHHIVE RegistryHive,
-    PCM_KEY_NODE KeyCell)
+    HCELL_INDEX KeyCellIndex,
+    ULONG Depth)
 {
-    PCM_KEY_INDEX IndexCell;
+    PCM_KEY_NODE KeyCell;
 
-    ASSERT(KeyCell->Signature == CM_KEY_NODE_SIGNATURE);
+    if (!CmpIsPrepareCellValid(RegistryHive, KeyCellIndex,
+                               FIELD_OFFSET(CM_KEY_NODE, Name)) ||
+        Depth >= CMP_MAX_PREPARE_DEPTH)
+    {
+        DPRINT1("Invalid key cell %08lx at depth %lu\n", KeyCellIndex, Depth);
+        return;
+    }
+
+    KeyCell = HvGetCell(RegistryHive, KeyCellIndex);
+    if (KeyCell->Signature != CM_KEY_NODE_SIGNATURE)
+    {
+        DPRINT1("Key cell %08lx has signature %x\n", KeyCellIndex, KeyCell->Signature);
+        return;
+    }
 
     KeyCell->SubKeyCounts[Volatile] = 0;
     // KeyCell->SubKeyLists[Volatile] = HCELL_NIL; // FIXME! Done only on Windows < XP.
@@ -126,8 +230,7 @@ CmpPrepareKey(
     /* Enumerate and add subkeys */
     if (KeyCell->SubKeyCounts[Stable] > 0)
     {
-        IndexCell = HvGetCell(RegistryHive, KeyCell->SubKeyLists[Stable]);
-        CmpPrepareIndexOfKeys(RegistryHive, IndexCell);
+        CmpPrepareIndexOfKeys(RegistryHive, KeyCell->SubKeyLists[Stable], Depth + 1);
     }
 }
 
@@ -135,8 +238,5 @@ VOID CMAPI
 CmPrepareHive(
     PHHIVE RegistryHive)
 {
-    PCM_KEY_NODE RootCell;
-
-    RootCell = HvGetCell(RegistryHive, RegistryHive->BaseBlock->RootCell);
-    CmpPrepareKey(RegistryHive, RootCell);
+    CmpPrepareKey(RegistryHive, RegistryHive->BaseBlock->RootCell, 0);
 }
@@ -224,6 +224,9 @@ CmpFreeKeyByCell(IN PHHIVE Hive,
         CmpFreeSecurityDescriptor(Hive, Cell);
     }
 
+    /* Drop the subkey name hash of the key, if it ever had one */
+    CmpInvalidateSubKeyHash(Hive, CellData);
+
     /* Free the key body itself, and then return our status */
     if (!CmpFreeKeyBody(Hive, Cell)) return STATUS_INSUFFICIENT_RESOURCES;
     return STATUS_SUCCESS;
@@ -121,6 +121,28 @@
     RtlClearAllBits(
         IN PRTL_BITMAP BitMapHeader);
 
+    // The host tools never share a hive between threads
+    static inline PVOID
+    InterlockedCompareExchangePointer(
+        IN OUT PVOID volatile *Destination,
+        IN PVOID Exchange,
+        IN PVOID Comperand)
+    {
+        PVOID Initial = *Destination;
+        if (Initial == Comperand) *Destination = Exchange;
+        return Initial;
+    }
+
+    static inline PVOID
+    InterlockedExchangePointer(
+        IN OUT PVOID volatile *Target,
+        IN PVOID Value)
+    {
+        PVOID Initial = *Target;
+        *Target = Value;
+        return Initial;
+    }
+
     #define RtlCheckBit(BMH,BP) (((((PLONG)(BMH)->Buffer)[(BP) / 32]) >> ((BP) % 32)) & 0x1)
     #define UNREFERENCED_PARAMETER(P) {(P)=(P);}
 
@@ -308,6 +330,38 @@ typedef struct _HV_TRACK_CELL_REF
     USHORT StaticCount;
 } HV_TRACK_CELL_REF, *PHV_TRACK_CELL_REF;
 
+//
+// In-memory name hash of the subkeys of a wide key node. It is built by the
+// first lookup, kept up to date by CmpAddSubKey and CmpRemoveSubKey, dropped
+// when the node cell is freed, and never written to the hive. The lists and
+// counts of the node it describes tell a lookup whether somebody else changed
+// the node since, in which case the lookup builds a new one.
+//
+#define CMP_SUBKEY_HASH_THRESHOLD       128
+#define CMP_SUBKEY_HASH_BUCKETS         64
+
+typedef struct _CM_SUBKEY_HASH
+{
+    HCELL_INDEX SubKeyLists[HTYPE_COUNT];
+    ULONG SubKeyCounts[HTYPE_COUNT];
+    ULONG Shift;
+    struct _CM_SUBKEY_HASH *NextRetired;
+    CM_INDEX Table[ANYSIZE_ARRAY];
+} CM_SUBKEY_HASH, *PCM_SUBKEY_HASH;
+
+typedef struct _CM_SUBKEY_HASH_ENTRY
+{
+    struct _CM_SUBKEY_HASH_ENTRY *Next;
+    PCM_KEY_NODE Node;
+    PCM_SUBKEY_HASH volatile Hash;
+    PCM_SUBKEY_HASH volatile Retired;
+} CM_SUBKEY_HASH_ENTRY, *PCM_SUBKEY_HASH_ENTRY;
+
+typedef struct _CM_SUBKEY_HASH_TABLE
+{
+    PCM_SUBKEY_HASH_ENTRY volatile Buckets[CMP_SUBKEY_HASH_BUCKETS];
+} CM_SUBKEY_HASH_TABLE, *PCM_SUBKEY_HASH_TABLE;
+
 extern ULONG CmlibTraceLevel;
 
 //
@@ -473,6 +527,10 @@ HvpAddBin(
    ULONG Size,
    HSTORAGE_TYPE Storage);
 
+VOID CMAPI
+HvpInitializeFreeDisplay(
+   PHHIVE Hive);
+
 NTSTATUS CMAPI
 HvpCreateHiveFreeCellList(
    PHHIVE Hive);
@@ -539,6 +597,19 @@ CmpRemoveSubKey(
     IN HCELL_INDEX TargetKey
 );
 
+VOID
+NTAPI
+CmpFreeSubKeyHashTable(
+    IN PHHIVE Hive
+);
+
+VOID
+NTAPI
+CmpInvalidateSubKeyHash(
+    IN PHHIVE Hive,
+    IN PVOID CellData
+);
+
 BOOLEAN
 NTAPI
 CmpMarkIndexDirty(
@@ -143,32 +143,106 @@ HvIsCellDirty(IN PHHIVE Hive,
     return IsDirty;
 }
 
+/*
+ * Free cells are kept in segregated lists. Every list below
+ * HFREE_DISPLAY_LARGE holds cells of one 16 byte size class, so the head of
+ * any non-empty list at or above the requested class is a fit. Larger cells
+ * share the last list, which is searched best-fit. FreeSummary has one bit
+ * per non-empty list so that empty classes are skipped without touching
+ * the hive.
+ *
+ * The lists are doubly linked through the data of the free cells, which
+ * lets a cell be unlinked (e.g. when coalescing) without walking its list.
+ * Cells too small to hold both links are never listed; they are only
+ * reclaimed when a neighbour gets freed.
+ */
+typedef struct _HCELL_FREE_LINKS
+{
+    HCELL_INDEX Next;
+    HCELL_INDEX Prev;
+} HCELL_FREE_LINKS, *PHCELL_FREE_LINKS;
+
+#define HFREE_MINIMUM_SIZE  (sizeof(HCELL) + sizeof(HCELL_FREE_LINKS))
+
+/* How many more large cells to look at once a fit has been found */
+#define HFREE_LARGE_SCAN    16
+
+static __inline PHCELL_FREE_LINKS CMAPI
+HvpGetFreeLinks(
+    PHHIVE RegistryHive,
+    HCELL_INDEX CellIndex)
+{
+    return (PHCELL_FREE_LINKS)(HvpGetCellHeader(RegistryHive, CellIndex) + 1);
+}
+
 static __inline ULONG CMAPI
 HvpComputeFreeListIndex(
     ULONG Size)
 {
     ULONG Index;
-    static CCHAR FindFirstSet[128] = {
-        0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3,
-        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-        5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-        5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
-        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
-        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
-        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6};
-
-    ASSERT(Size >= (1 << 3));
-    Index = (Size >> 3) - 1;
-    if (Index >= 16)
+
+    ASSERT(Size >= HFREE_GRANULARITY);
+    Index = (Size / HFREE_GRANULARITY) - 1;
+    if (Index > HFREE_DISPLAY_LARGE)
+        Index = HFREE_DISPLAY_LARGE;
+
+    return Index;
+}
+
+static __inline ULONG CMAPI
+HvpFindFirstSetBit(
+    ULONG Mask)
+{
+    ULONG Bit = 0;
+
+    ASSERT(Mask != 0);
+    if (!(Mask & 0xFFFF)) { Bit += 16; Mask >>= 16; }
+    if (!(Mask & 0xFF))   { Bit += 8;  Mask >>= 8;  }
+    if (!(Mask & 0xF))    { Bit += 4;  Mask >>= 4;  }
+    if (!(Mask & 0x3))    { Bit += 2;  Mask >>= 2;  }
+    if (!(Mask & 0x1))    { Bit += 1; }
+
+    return Bit;
+}
+
+/* Returns the first non-empty free list at or above Index, or HFREE_DISPLAY_SIZE */
+static ULONG CMAPI
+HvpFindFreeListIndex(
+    PDUAL Dual,
+    ULONG Index)
+{
+    ULONG Word;
+    ULONG Mask;
+
+    Word = Index / 32;
+    Mask = Dual->FreeSummary[Word] & ~((1UL << (Index % 32)) - 1);
+    for (;;)
     {
-        if (Index > 127)
-            Index = 23;
-        else
-            Index = FindFirstSet[Index] + 16;
+        if (Mask != 0)
+            return Word * 32 + HvpFindFirstSetBit(Mask);
+
+        if (++Word == HFREE_SUMMARY_SIZE)
+            return HFREE_DISPLAY_SIZE;
+
+        Mask = Dual->FreeSummary[Word];
     }
+}
 
-    return Index;
+VOID CMAPI
+HvpInitializeFreeDisplay(
+    PHHIVE Hive)
+{
+    ULONG Storage;
+    ULONG Index;
+
+    for (Storage = Stable; Storage < HTYPE_COUNT; Storage++)
+    {
+        for (Index = 0; Index < HFREE_DISPLAY_SIZE; Index++)
+            Hive->Storage[Storage].FreeDisplay[Index] = HCELL_NIL;
+
+        RtlZeroMemory(Hive->Storage[Storage].FreeSummary,
+                      sizeof(Hive->Storage[Storage].FreeSummary));
+    }
 }
 
 static NTSTATUS CMAPI
@@ -177,19 +251,28 @@ HvpAddFree(
     PHCELL FreeBlock,
     HCELL_INDEX FreeIndex)
 {
-    PHCELL_INDEX FreeBlockData;
-    HSTORAGE_TYPE Storage;
+    PHCELL_FREE_LINKS Links;
+    PDUAL Dual;
     ULONG Index;
 
     ASSERT(RegistryHive != NULL);
     ASSERT(FreeBlock != NULL);
 
-    Storage = HvGetCellType(FreeIndex);
+    /* Too small to be linked, it can only grow by coalescing */
+    if ((ULONG)FreeBlock->Size < HFREE_MINIMUM_SIZE)
+        return STATUS_SUCCESS;
+
+    Dual = &RegistryHive->Storage[HvGetCellType(FreeIndex)];
     Index = HvpComputeFreeListIndex((ULONG)FreeBlock->Size);
 
-    FreeBlockData = (PHCELL_INDEX)(FreeBlock + 1);
-    *FreeBlockData = RegistryHive->Storage[Storage].FreeDisplay[Index];
-    RegistryHive->Storage[Storage].FreeDisplay[Index] = FreeIndex;
+    Links = (PHCELL_FREE_LINKS)(FreeBlock + 1);
+    Links->Next = Dual->FreeDisplay[Index];
+    Links->Prev = HCELL_NIL;
+    if (Links->Next != HCELL_NIL)
+        HvpGetFreeLinks(RegistryHive, Links->Next)->Prev = FreeIndex;
+
+    Dual->FreeDisplay[Index] = FreeIndex;
+    Dual->FreeSummary[Index / 32] |= 1UL << (Index % 32);
 
     /* FIXME: Eventually get rid of free bins. */
 
@@ -202,47 +285,41 @@ HvpRemoveFree(
     PHCELL CellBlock,
     HCELL_INDEX CellIndex)
 {
-    PHCELL_INDEX FreeCellData;
-    PHCELL_INDEX pFreeCellOffset;
-    HSTORAGE_TYPE Storage;
-    ULONG Index, FreeListIndex;
+    PHCELL_FREE_LINKS Links;
+    PDUAL Dual;
+    ULONG Index;
 
     ASSERT(RegistryHive->ReadOnly == FALSE);
 
-    Storage = HvGetCellType(CellIndex);
+    if ((ULONG)CellBlock->Size < HFREE_MINIMUM_SIZE)
+        return;
+
+    Dual = &RegistryHive->Storage[HvGetCellType(CellIndex)];
     Index = HvpComputeFreeListIndex((ULONG)CellBlock->Size);
+    Links = (PHCELL_FREE_LINKS)(CellBlock + 1);
 
-    pFreeCellOffset = &RegistryHive->Storage[Storage].FreeDisplay[Index];
-    while (*pFreeCellOffset != HCELL_NIL)
+    if (Links->Prev == HCELL_NIL)
     {
-        FreeCellData = (PHCELL_INDEX)HvGetCell(RegistryHive, *pFreeCellOffset);
-        if (*pFreeCellOffset == CellIndex)
+        /* Only the head of the list has no predecessor */
+        if (Dual->FreeDisplay[Index] != CellIndex)
         {
-            *pFreeCellOffset = *FreeCellData;
+            CMLTRACE(CMLIB_HCELL_DEBUG, "%s - Cell %08lx is not on free list %lu (head %08lx)\n",
+                     __FUNCTION__, CellIndex, Index, Dual->FreeDisplay[Index]);
+            ASSERT(FALSE);
             return;
         }
-        pFreeCellOffset = FreeCellData;
-    }
 
-    /* Something bad happened, print a useful trace info and bugcheck */
-    CMLTRACE(CMLIB_HCELL_DEBUG, "-- beginning of HvpRemoveFree trace --\n");
-    CMLTRACE(CMLIB_HCELL_DEBUG, "block we are about to free: %08x\n", CellIndex);
-    CMLTRACE(CMLIB_HCELL_DEBUG, "chosen free list index: %u\n", Index);
-    for (FreeListIndex = 0; FreeListIndex < 24; FreeListIndex++)
+        Dual->FreeDisplay[Index] = Links->Next;
+        if (Links->Next == HCELL_NIL)
+            Dual->FreeSummary[Index / 32] &= ~(1UL << (Index % 32));
+    }
+    else
     {
-        CMLTRACE(CMLIB_HCELL_DEBUG, "free list [%u]: ", FreeListIndex);
-        pFreeCellOffset = &RegistryHive->Storage[Storage].FreeDisplay[FreeListIndex];
-        while (*pFreeCellOffset != HCELL_NIL)
-        {
-            CMLTRACE(CMLIB_HCELL_DEBUG, "%08x ", *pFreeCellOffset);
-            FreeCellData = (PHCELL_INDEX)HvGetCell(RegistryHive, *pFreeCellOffset);
-            pFreeCellOffset = FreeCellData;
-        }
-        CMLTRACE(CMLIB_HCELL_DEBUG, "\n");
+        HvpGetFreeLinks(RegistryHive, Links->Prev)->Next = Links->Next;
     }
-    CMLTRACE(CMLIB_HCELL_DEBUG, "-- end of HvpRemoveFree trace --\n");
 
-    ASSERT(FALSE);
+    if (Links->Next != HCELL_NIL)
+        HvpGetFreeLinks(RegistryHive, Links->Next)->Prev = Links->Prev;
 }
 
 static HCELL_INDEX CMAPI
@@ -251,28 +328,55 @@ HvpFindFree(
     ULONG Size,
     HSTORAGE_TYPE Storage)
 {
-    PHCELL_INDEX FreeCellData;
-    HCELL_INDEX FreeCellOffset;
-    PHCELL_INDEX pFreeCellOffset;
+    PDUAL Dual = &RegistryHive->Storage[Storage];
+    HCELL_INDEX CellIndex;
+    HCELL_INDEX BestIndex;
+    PHCELL Cell;
+    PHCELL BestCell;
     ULONG Index;
+    ULONG Scan;
+
+    Index = HvpFindFreeListIndex(Dual, HvpComputeFreeListIndex(Size));
+    if (Index == HFREE_DISPLAY_SIZE)
+        return HCELL_NIL;
 
-    for (Index = HvpComputeFreeListIndex(Size); Index < 24; Index++)
+    if (Index < HFREE_DISPLAY_LARGE)
+    {
+        /* Exact size class, the first cell is as good as any other */
+        BestIndex = Dual->FreeDisplay[Index];
+        BestCell = HvpGetCellHeader(RegistryHive, BestIndex);
+        ASSERT((ULONG)BestCell->Size >= Size);
+    }
+    else
     {
-        pFreeCellOffset = &RegistryHive->Storage[Storage].FreeDisplay[Index];
-        while (*pFreeCellOffset != HCELL_NIL)
+        /* Best fit among the large cells, bounded once something fits */
+        BestIndex = HCELL_NIL;
+        BestCell = NULL;
+        Scan = 0;
+        for (CellIndex = Dual->FreeDisplay[Index];
+             CellIndex != HCELL_NIL;
+             CellIndex = ((PHCELL_FREE_LINKS)(Cell + 1))->Next)
         {
-            FreeCellData = (PHCELL_INDEX)HvGetCell(RegistryHive, *pFreeCellOffset);
-            if ((ULONG)HvpGetCellFullSize(RegistryHive, FreeCellData) >= Size)
+            Cell = HvpGetCellHeader(RegistryHive, CellIndex);
+            if ((ULONG)Cell->Size >= Size &&
+                (BestCell == NULL || Cell->Size < BestCell->Size))
             {
-                FreeCellOffset = *pFreeCellOffset;
-                *pFreeCellOffset = *FreeCellData;
-                return FreeCellOffset;
+                BestIndex = CellIndex;
+                BestCell = Cell;
+                if ((ULONG)Cell->Size == Size)
+                    break;
             }
-            pFreeCellOffset = FreeCellData;
+
+            if (BestCell != NULL && ++Scan >= HFREE_LARGE_SCAN)
+                break;
         }
+
+        if (BestCell == NULL)
+            return HCELL_NIL;
     }
 
-    return HCELL_NIL;
+    HvpRemoveFree(RegistryHive, BestCell, BestIndex);
+    return BestIndex;
 }
 
 NTSTATUS CMAPI
@@ -285,14 +389,9 @@ HvpCreateHiveFreeCellList(
     ULONG FreeOffset;
     PHBIN Bin;
     NTSTATUS Status;
-    ULONG Index;
 
     /* Initialize the free cell list */
-    for (Index = 0; Index < 24; Index++)
-    {
-        Hive->Storage[Stable].FreeDisplay[Index] = HCELL_NIL;
-        Hive->Storage[Volatile].FreeDisplay[Index] = HCELL_NIL;
-    }
+    HvpInitializeFreeDisplay(Hive);
 
     BlockOffset = 0;
     BlockIndex = 0;
@@ -305,6 +404,18 @@ HvpCreateHiveFreeCellList(
         while (FreeOffset < Bin->Size)
         {
             FreeBlock = (PHCELL)((ULONG_PTR)Bin + FreeOffset);
+
+            /* Each cell must be sized in multiples of 8 and must end within its bin */
+            if (FreeBlock->Size == 0 ||
+                (FreeBlock->Size & 7) ||
+                (FreeBlock->Size > 0 && (ULONG)FreeBlock->Size > Bin->Size - FreeOffset) ||
+                (FreeBlock->Size < 0 && (ULONG)0 - (ULONG)FreeBlock->Size > Bin->Size - FreeOffset))
+            {
+                DPRINT1("Invalid cell at offset 0x%x of bin 0x%x, Size 0x%x\n",
+                        (unsigned)FreeOffset, (unsigned)Bin->FileOffset, (unsigned)FreeBlock->Size);
+                return STATUS_REGISTRY_CORRUPT;
+            }
+
             if (FreeBlock->Size > 0)
             {
                 Status = HvpAddFree(Hive, FreeBlock, Bin->FileOffset + FreeOffset);
@@ -457,6 +568,9 @@ HvFreeCell(
 
     ASSERT(Free->Size < 0);
 
+    /* The cell may be reused by another key node, forget its subkey hash */
+    CmpInvalidateSubKeyHash(RegistryHive, Free + 1);
+
     Free->Size = -Free->Size;
 
     CellType = HvGetCellType(CellIndex);
@@ -489,15 +603,10 @@ HvFreeCell(
                     ((HCELL_INDEX)((ULONG_PTR)Neighbor - (ULONG_PTR)Bin +
                      Bin->FileOffset)) | (CellIndex & HCELL_TYPE_MASK);
 
-                if (HvpComputeFreeListIndex(Neighbor->Size) !=
-                    HvpComputeFreeListIndex(Neighbor->Size + Free->Size))
-                {
-                   HvpRemoveFree(RegistryHive, Neighbor, NeighborCellIndex);
-                   Neighbor->Size += Free->Size;
-                   HvpAddFree(RegistryHive, Neighbor, NeighborCellIndex);
-                }
-                else
-                    Neighbor->Size += Free->Size;
+                /* Unlinking is cheap, move it to its new size class */
+                HvpRemoveFree(RegistryHive, Neighbor, NeighborCellIndex);
+                Neighbor->Size += Free->Size;
+                HvpAddFree(RegistryHive, Neighbor, NeighborCellIndex);
 
                 if (CellType == Stable)
                     HvMarkCellDirty(RegistryHive, NeighborCellIndex, FALSE);
@@ -97,6 +97,18 @@ typedef ULONG HCELL_INDEX, *PHCELL_INDEX;
 #define HvGetCellBlock(Cell)            \
     ((ULONG)(((Cell) & HCELL_BLOCK_MASK) >> HCELL_BLOCK_SHIFT))
 
+//
+// Free Cell Lists
+//
+// Cells up to HFREE_LARGE_SIZE live in exact 16 byte size classes, anything
+// bigger shares the last list. These are in-memory structures only.
+//
+#define HFREE_GRANULARITY               16
+#define HFREE_LARGE_SIZE                2048
+#define HFREE_DISPLAY_SIZE              (HFREE_LARGE_SIZE / HFREE_GRANULARITY)
+#define HFREE_DISPLAY_LARGE             (HFREE_DISPLAY_SIZE - 1)
+#define HFREE_SUMMARY_SIZE              (HFREE_DISPLAY_SIZE / 32)
+
 typedef enum
 {
     Stable   = 0,
@@ -277,8 +289,8 @@ typedef struct _DUAL
     PHMAP_DIRECTORY Map;
     PHMAP_ENTRY BlockList; // PHMAP_TABLE SmallDir;
     ULONG Guard;
-    HCELL_INDEX FreeDisplay[24]; // FREE_DISPLAY FreeDisplay[24];
-    ULONG FreeSummary;
+    HCELL_INDEX FreeDisplay[HFREE_DISPLAY_SIZE]; // FREE_DISPLAY FreeDisplay[24];
+    ULONG FreeSummary[HFREE_SUMMARY_SIZE];
     LIST_ENTRY FreeBins;
 } DUAL, *PDUAL;
 
@@ -329,6 +341,9 @@ typedef struct _HHIVE
     ULONG StorageTypeCount;
     ULONG Version;
     DUAL Storage[HTYPE_COUNT];
+
+    /* ReactOS: subkey name hashes of wide keys, see cmindex.c */
+    struct _CM_SUBKEY_HASH_TABLE *SubKeyHashTable;
 } HHIVE, *PHHIVE;
 
 #define IsFreeCell(Cell)    ((Cell)->Size >= 0)
@@ -162,7 +162,6 @@ HvpCreateHive(
     IN PCUNICODE_STRING FileName OPTIONAL)
 {
     PHBASE_BLOCK BaseBlock;
-    ULONG Index;
 
     /* Allocate the base block */
     BaseBlock = HvpAllocBaseBlockAligned(RegistryHive, FALSE, TAG_CM);
@@ -197,11 +196,7 @@ HvpCreateHive(
     RegistryHive->BaseBlock = BaseBlock;
     RegistryHive->Version = BaseBlock->Minor; // == HSYS_MINOR
 
-    for (Index = 0; Index < 24; Index++)
-    {
-        RegistryHive->Storage[Stable].FreeDisplay[Index] = HCELL_NIL;
-        RegistryHive->Storage[Volatile].FreeDisplay[Index] = HCELL_NIL;
-    }
+    HvpInitializeFreeDisplay(RegistryHive);
 
     HvpInitFileName(BaseBlock, FileName);
 
@@ -229,6 +224,7 @@ HvpInitializeMemoryHive(
     ULONG BitmapSize;
     PULONG BitmapBuffer;
     SIZE_T ChunkSize;
+    NTSTATUS Status;
 
     ChunkSize = ChunkBase->Length;
     DPRINT("ChunkSize: %zx\n", ChunkSize);
@@ -267,15 +263,23 @@ HvpInitializeMemoryHive(
         return STATUS_NO_MEMORY;
     }
 
+    /* Bins copied before a corrupt one is found must be freed on failure */
+    RtlZeroMemory(Hive->Storage[Stable].BlockList,
+                  Hive->Storage[Stable].Length * sizeof(HMAP_ENTRY));
+
     for (BlockIndex = 0; BlockIndex < Hive->Storage[Stable].Length; )
     {
         Bin = (PHBIN)((ULONG_PTR)ChunkBase + (BlockIndex + 1) * HBLOCK_SIZE);
         if (Bin->Signature != HV_HBIN_SIGNATURE ||
-           (Bin->Size % HBLOCK_SIZE) != 0)
+           (Bin->Size % HBLOCK_SIZE) != 0 ||
+            Bin->Size == 0 ||
+            Bin->Size / HBLOCK_SIZE > Hive->Storage[Stable].Length - BlockIndex ||
+            Bin->FileOffset != BlockIndex * HBLOCK_SIZE)
         {
-            DPRINT1("Invalid bin at BlockIndex %lu, Signature 0x%x, Size 0x%x\n",
-                    (unsigned long)BlockIndex, (unsigned)Bin->Signature, (unsigned)Bin->Size);
-            Hive->Free(Hive->Storage[Stable].BlockList, 0);
+            DPRINT1("Invalid bin at BlockIndex %lu, Signature 0x%x, Size 0x%x, FileOffset 0x%x\n",
+                    (unsigned long)BlockIndex, (unsigned)Bin->Signature, (unsigned)Bin->Size,
+                    (unsigned)Bin->FileOffset);
+            HvpFreeHiveBins(Hive);
             Hive->Free(Hive->BaseBlock, Hive->BaseBlockAlloc);
             return STATUS_REGISTRY_CORRUPT;
         }
@@ -283,7 +287,7 @@ HvpInitializeMemoryHive(
         NewBin = Hive->Allocate(Bin->Size, TRUE, TAG_CM);
         if (NewBin == NULL)
         {
-            Hive->Free(Hive->Storage[Stable].BlockList, 0);
+            HvpFreeHiveBins(Hive);
             Hive->Free(Hive->BaseBlock, Hive->BaseBlockAlloc);
             return STATUS_NO_MEMORY;
         }
@@ -306,11 +310,12 @@ HvpInitializeMemoryHive(
         BlockIndex += Bin->Size / HBLOCK_SIZE;
     }
 
-    if (HvpCreateHiveFreeCellList(Hive))
+    Status = HvpCreateHiveFreeCellList(Hive);
+    if (!NT_SUCCESS(Status))
     {
         HvpFreeHiveBins(Hive);
         Hive->Free(Hive->BaseBlock, Hive->BaseBlockAlloc);
-        return STATUS_NO_MEMORY;
+        return Status;
     }
 
     BitmapSize = ROUND_UP(Hive->Storage[Stable].Length,
@@ -623,6 +628,8 @@ VOID CMAPI
 HvFree(
     PHHIVE RegistryHive)
 {
+    CmpFreeSubKeyHashTable(RegistryHive);
+
     if (!RegistryHive->ReadOnly)
     {
         /* Release hive bitmap */
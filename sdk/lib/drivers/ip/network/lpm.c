@@ -0,0 +1,240 @@
+/*
+ * PROJECT:     ReactOS TCP/IP protocol driver
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Longest prefix match tree for IPv4 routes
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ * NOTES:
+ *   The tree does no locking of its own. It is also built into the
+ *   routebench host tool, which then defines LPM_HOST.
+ */
+
+#ifndef LPM_HOST
+#include "precomp.h"
+#endif
+
+static ULONG LpmMask( UINT Length ) {
+    return Length ? 0xFFFFFFFF << (32 - Length) : 0;
+}
+
+static UINT LpmBit( ULONG Key, UINT Index ) {
+    return (Key >> (31 - Index)) & 1;
+}
+
+static UINT LpmCommonLength( ULONG Key1, ULONG Key2, UINT MaxLength ) {
+    ULONG Difference = Key1 ^ Key2;
+    UINT Length = 0;
+
+    while (Length < MaxLength && !(Difference & 0x80000000)) {
+        Difference <<= 1;
+        Length++;
+    }
+
+    return Length;
+}
+
+static BOOLEAN LpmMatches( PLPM_NODE Node, ULONG Address ) {
+    return ((Address ^ Node->Prefix) & LpmMask(Node->PrefixLength)) == 0;
+}
+
+static PLPM_NODE *LpmLinkOf( PLPM_TREE Tree, PLPM_NODE Node ) {
+    if (!Node->Parent)
+        return &Tree->Root;
+
+    return &Node->Parent->Child[Node->Parent->Child[1] == Node];
+}
+
+static PLPM_NODE LpmCreateNode( ULONG Prefix, UINT PrefixLength ) {
+    PLPM_NODE Node;
+
+    Node = ExAllocatePoolWithTag(NonPagedPool, sizeof(LPM_NODE), LPM_TAG);
+    if (!Node)
+        return NULL;
+
+    RtlZeroMemory(Node, sizeof(LPM_NODE));
+    Node->Prefix = Prefix & LpmMask(PrefixLength);
+    Node->PrefixLength = PrefixLength;
+    return Node;
+}
+
+VOID LpmInitialize(
+    PLPM_TREE Tree)
+/*
+ * FUNCTION: Initializes an empty tree
+ * ARGUMENTS:
+ *     Tree = Pointer to the tree
+ */
+{
+    Tree->Root = NULL;
+    Tree->NodeCount = 0;
+}
+
+PLPM_NODE LpmInsert(
+    PLPM_TREE Tree,
+    ULONG Prefix,
+    UINT PrefixLength)
+/*
+ * FUNCTION: Finds or creates the node of a prefix
+ * ARGUMENTS:
+ *     Tree         = Pointer to the tree
+ *     Prefix       = Prefix in host order
+ *     PrefixLength = Number of significant bits of the prefix
+ * RETURNS:
+ *     Pointer to the node, NULL if there are not enough resources
+ * NOTES:
+ *     A new node has no value, the caller sets it
+ */
+{
+    PLPM_NODE *Link = &Tree->Root;
+    PLPM_NODE Node, Parent = NULL, New, Join;
+    UINT Common;
+
+    Prefix &= LpmMask(PrefixLength);
+
+    /* Walk down as long as the nodes are prefixes of the new one */
+    while ((Node = *Link)) {
+        Common = LpmCommonLength(Node->Prefix, Prefix,
+                                 min(Node->PrefixLength, PrefixLength));
+        if (Common < Node->PrefixLength)
+            break;
+
+        if (Node->PrefixLength == PrefixLength)
+            return Node;
+
+        Parent = Node;
+        Link = &Node->Child[LpmBit(Prefix, Node->PrefixLength)];
+    }
+
+    New = LpmCreateNode(Prefix, PrefixLength);
+    if (!New)
+        return NULL;
+
+    if (!Node) {
+        New->Parent = Parent;
+        *Link = New;
+        Tree->NodeCount++;
+        return New;
+    }
+
+    if (Common == PrefixLength) {
+        /* The new prefix covers the node */
+        New->Child[LpmBit(Node->Prefix, PrefixLength)] = Node;
+        New->Parent = Parent;
+        Node->Parent = New;
+        *Link = New;
+        Tree->NodeCount++;
+        return New;
+    }
+
+    /* The two diverge, join them where they do */
+    Join = LpmCreateNode(Prefix, Common);
+    if (!Join) {
+        ExFreePoolWithTag(New, LPM_TAG);
+        return NULL;
+    }
+
+    Join->Child[LpmBit(Prefix, Common)] = New;
+    Join->Child[LpmBit(Node->Prefix, Common)] = Node;
+    Join->Parent = Parent;
+    New->Parent = Join;
+    Node->Parent = Join;
+    *Link = Join;
+    Tree->NodeCount += 2;
+    return New;
+}
+
+PLPM_NODE LpmFind(
+    PLPM_TREE Tree,
+    ULONG Prefix,
+    UINT PrefixLength)
+/*
+ * FUNCTION: Finds the node of a prefix
+ * ARGUMENTS:
+ *     Tree         = Pointer to the tree
+ *     Prefix       = Prefix in host order
+ *     PrefixLength = Number of significant bits of the prefix
+ * RETURNS:
+ *     Pointer to the node if the prefix has a value, NULL if not
+ */
+{
+    PLPM_NODE Node = Tree->Root;
+
+    Prefix &= LpmMask(PrefixLength);
+
+    while (Node && Node->PrefixLength <= PrefixLength && LpmMatches(Node, Prefix)) {
+        if (Node->PrefixLength == PrefixLength)
+            return Node->Value ? Node : NULL;
+
+        Node = Node->Child[LpmBit(Prefix, Node->PrefixLength)];
+    }
+
+    return NULL;
+}
+
+PLPM_NODE LpmLookup(
+    PLPM_TREE Tree,
+    ULONG Address)
+/*
+ * FUNCTION: Finds the longest prefix with a value that covers an address
+ * ARGUMENTS:
+ *     Tree    = Pointer to the tree
+ *     Address = Address in host order
+ * RETURNS:
+ *     Pointer to the node, NULL if no prefix covers the address
+ */
+{
+    PLPM_NODE Node = Tree->Root, Best = NULL;
+
+    while (Node && LpmMatches(Node, Address)) {
+        if (Node->Value)
+            Best = Node;
+
+        if (Node->PrefixLength == 32)
+            break;
+
+        Node = Node->Child[LpmBit(Address, Node->PrefixLength)];
+    }
+
+    return Best;
+}
+
+VOID LpmRemove(
+    PLPM_TREE Tree,
+    PLPM_NODE Node)
+/*
+ * FUNCTION: Removes the value of a prefix
+ * ARGUMENTS:
+ *     Tree = Pointer to the tree
+ *     Node = Pointer to the node of the prefix
+ * NOTES:
+ *     Nodes that no longer join two subtrees are freed, so the node
+ *     must not be used afterwards
+ */
+{
+    PLPM_NODE Parent, Child;
+
+    Node->Value = NULL;
+
+    /* Still needed to join its children */
+    if (Node->Child[0] && Node->Child[1])
+        return;
+
+    Parent = Node->Parent;
+    Child = Node->Child[0] ? Node->Child[0] : Node->Child[1];
+
+    *LpmLinkOf(Tree, Node) = Child;
+    if (Child)
+        Child->Parent = Parent;
+    ExFreePoolWithTag(Node, LPM_TAG);
+    Tree->NodeCount--;
+
+    /* A joining parent left with a single child goes as well */
+    if (!Child && Parent && !Parent->Value) {
+        Child = Parent->Child[0] ? Parent->Child[0] : Parent->Child[1];
+        *LpmLinkOf(Tree, Parent) = Child;
+        Child->Parent = Parent->Parent;
+        ExFreePoolWithTag(Parent, LPM_TAG);
+        Tree->NodeCount--;
+    }
+}
+
+/* EOF */
@@ -14,8 +14,26 @@
 
 #include "precomp.h"
 
+/* Number of destinations remembered by the route cache */
+#define FIB_CACHE_SIZE 256
+
+/*
+ * Route cache entry. Lookups read it without taking the FIB lock, the
+ * sequence tells them whether they got a consistent copy. Entries made
+ * for an older generation of the FIB are stale.
+ */
+typedef struct _FIB_CACHE_ENTRY {
+    volatile LONG Sequence;       /* Odd while the entry is being written */
+    LONG Generation;              /* FIB generation the entry was made for */
+    ULONG Destination;            /* IPv4 destination, network order */
+    PNEIGHBOR_CACHE_ENTRY Router; /* NCE of the router to use */
+} FIB_CACHE_ENTRY, *PFIB_CACHE_ENTRY;
+
 LIST_ENTRY FIBListHead;
 KSPIN_LOCK FIBLock;
+LPM_TREE FIBTree;
+volatile LONG FIBGeneration;
+FIB_CACHE_ENTRY FIBCache[FIB_CACHE_SIZE];
 
 void RouterDumpRoutes() {
     PLIST_ENTRY CurrentEntry;
@@ -54,6 +72,77 @@ VOID FreeFIB(
 }
 
 
+static PFIB_CACHE_ENTRY RouterCacheEntry( ULONG Destination ) {
+    return &FIBCache[(Destination * 2654435761U) >> 24];
+}
+
+
+static PNEIGHBOR_CACHE_ENTRY RouterLookupCache(
+    ULONG Destination)
+/*
+ * FUNCTION: Looks up a destination in the route cache
+ * ARGUMENTS:
+ *     Destination = IPv4 destination address in network order
+ * RETURNS:
+ *     Pointer to NCE of the router to use, NULL if not cached
+ * NOTES:
+ *     Does not take the forward information base lock. Routers that
+ *     are no longer known to be reachable are not returned, so that
+ *     the FIB gets a chance to pick another one
+ */
+{
+    PFIB_CACHE_ENTRY Entry = RouterCacheEntry(Destination);
+    PNEIGHBOR_CACHE_ENTRY NCE;
+    LONG Sequence, Generation;
+    ULONG Address;
+
+    Sequence = Entry->Sequence;
+    if (Sequence & 1)
+        return NULL;
+
+    KeMemoryBarrier();
+    Generation = Entry->Generation;
+    Address    = Entry->Destination;
+    NCE        = Entry->Router;
+    KeMemoryBarrier();
+
+    if (Entry->Sequence != Sequence ||
+        Generation != FIBGeneration ||
+        Address != Destination || !NCE)
+        return NULL;
+
+    if (NCE->State & (NUD_STALE | NUD_INCOMPLETE))
+        return NULL;
+
+    return NCE;
+}
+
+
+static VOID RouterFillCache(
+    ULONG Destination,
+    PNEIGHBOR_CACHE_ENTRY NCE,
+    LONG Generation)
+/*
+ * FUNCTION: Remembers the router to use for a destination
+ * ARGUMENTS:
+ *     Destination = IPv4 destination address in network order
+ *     NCE         = Pointer to NCE of the router to use
+ *     Generation  = FIB generation the router was found in
+ * NOTES:
+ *     The forward information base lock must be held when called,
+ *     which keeps writers of the same entry apart
+ */
+{
+    PFIB_CACHE_ENTRY Entry = RouterCacheEntry(Destination);
+
+    InterlockedIncrement(&Entry->Sequence);
+    Entry->Generation  = Generation;
+    Entry->Destination = Destination;
+    Entry->Router      = NCE;
+    InterlockedIncrement(&Entry->Sequence);
+}
+
+
 VOID DestroyFIBE(
     PFIB_ENTRY FIBE)
 /*
@@ -64,11 +153,32 @@ VOID DestroyFIBE(
  *     The forward information base lock must be held when called
  */
 {
+    PLPM_NODE Node = FIBE->Node;
+    PFIB_ENTRY Previous;
+
     TI_DbgPrint(DEBUG_ROUTER, ("Called. FIBE (0x%X).\n", FIBE));
 
     /* Unlink the FIB entry from the list */
     RemoveEntryList(&FIBE->ListEntry);
 
+    /* And from the routes of its prefix */
+    if (Node) {
+        if (Node->Value == FIBE) {
+            Node->Value = FIBE->NextSamePrefix;
+        } else {
+            Previous = Node->Value;
+            while (Previous->NextSamePrefix != FIBE)
+                Previous = Previous->NextSamePrefix;
+            Previous->NextSamePrefix = FIBE->NextSamePrefix;
+        }
+
+        if (!Node->Value)
+            LpmRemove(&FIBTree, Node);
+    }
+
+    /* Cached routes may have used it */
+    InterlockedIncrement(&FIBGeneration);
+
     /* And free the FIB entry */
     FreeFIB(FIBE);
 }
@@ -139,53 +249,6 @@ UINT CopyFIBs( PIP_INTERFACE IF, PFIB_ENTRY Target ) {
 }
 
 
-UINT CommonPrefixLength(
-    PIP_ADDRESS Address1,
-    PIP_ADDRESS Address2)
-/*
- * FUNCTION: Computes the length of the longest prefix common to two addresses
- * ARGUMENTS:
- *     Address1 = Pointer to first address
- *     Address2 = Pointer to second address
- * NOTES:
- *     The two addresses must be of the same type
- * RETURNS:
- *     Length of longest common prefix
- */
-{
-    PUCHAR Addr1, Addr2;
-    UINT Size;
-    UINT i, j;
-    UINT Bitmask;
-
-    TI_DbgPrint(DEBUG_ROUTER, ("Called. Address1 (0x%X)  Address2 (0x%X).\n", Address1, Address2));
-
-    /*TI_DbgPrint(DEBUG_ROUTER, ("Target  (%s) \n", A2S(Address1)));*/
-    /*TI_DbgPrint(DEBUG_ROUTER, ("Adapter (%s).\n", A2S(Address2)));*/
-
-    if (Address1->Type == IP_ADDRESS_V4)
-        Size = sizeof(IPv4_RAW_ADDRESS);
-    else
-        Size = sizeof(IPv6_RAW_ADDRESS);
-
-    Addr1 = (PUCHAR)&Address1->Address.IPv4Address;
-    Addr2 = (PUCHAR)&Address2->Address.IPv4Address;
-
-    /* Find first non-matching byte */
-    for (i = 0; i < Size && Addr1[i] == Addr2[i]; i++);
-    if( i == Size ) return 8 * i;
-
-    /* Find first non-matching bit */
-    Bitmask = 0x80;
-    for (j = 0; (Addr1[i] & Bitmask) == (Addr2[i] & Bitmask); j++)
-        Bitmask >>= 1;
-
-    TI_DbgPrint(DEBUG_ROUTER, ("Returning %d\n", 8 * i + j));
-
-    return 8 * i + j;
-}
-
-
 PFIB_ENTRY RouterAddRoute(
     PIP_ADDRESS NetworkAddress,
     PIP_ADDRESS Netmask,
@@ -206,7 +269,9 @@ PFIB_ENTRY RouterAddRoute(
  *     these references
  */
 {
-    PFIB_ENTRY FIBE;
+    KIRQL OldIrql;
+    PFIB_ENTRY FIBE, Last;
+    PLPM_NODE Node;
 
     TI_DbgPrint(DEBUG_ROUTER, ("Called. NetworkAddress (0x%X)  Netmask (0x%X) "
         "Router (0x%X)  Metric (%d).\n", NetworkAddress, Netmask, Router, Metric));
@@ -228,9 +293,40 @@ PFIB_ENTRY RouterAddRoute(
 		   sizeof(FIBE->Netmask) );
     FIBE->Router         = Router;
     FIBE->Metric         = Metric;
+    FIBE->Node           = NULL;
+    FIBE->NextSamePrefix = NULL;
+
+    TcpipAcquireSpinLock(&FIBLock, &OldIrql);
+
+    /* IPv4 routes are looked up through the route tree */
+    if (NetworkAddress->Type == IP_ADDRESS_V4 && Netmask->Type == IP_ADDRESS_V4) {
+        Node = LpmInsert(&FIBTree,
+                         IPv4NToHl(NetworkAddress->Address.IPv4Address),
+                         AddrCountPrefixBits(Netmask));
+        if (!Node) {
+            TcpipReleaseSpinLock(&FIBLock, OldIrql);
+            TI_DbgPrint(MIN_TRACE, ("Insufficient resources.\n"));
+            FreeFIB(FIBE);
+            return NULL;
+        }
+
+        /* Routes of the same prefix are tried in the order they were added */
+        if (!Node->Value) {
+            Node->Value = FIBE;
+        } else {
+            Last = Node->Value;
+            while (Last->NextSamePrefix)
+                Last = Last->NextSamePrefix;
+            Last->NextSamePrefix = FIBE;
+        }
+        FIBE->Node = Node;
+    }
 
     /* Add FIB to the forward information base */
-    TcpipInterlockedInsertTailList(&FIBListHead, &FIBE->ListEntry, &FIBLock);
+    InsertTailList(&FIBListHead, &FIBE->ListEntry);
+    InterlockedIncrement(&FIBGeneration);
+
+    TcpipReleaseSpinLock(&FIBLock, OldIrql);
 
     return FIBE;
 }
@@ -245,45 +341,55 @@ PNEIGHBOR_CACHE_ENTRY RouterGetRoute(PIP_ADDRESS Destination)
  *     Pointer to NCE for router, NULL if none was found
  * NOTES:
  *     If found the NCE is referenced
+ *     The route with the longest matching prefix wins. Among routes with
+ *     the same prefix, the first one whose router is not stale is used
  */
 {
     KIRQL OldIrql;
-    PLIST_ENTRY CurrentEntry;
-    PLIST_ENTRY NextEntry;
     PFIB_ENTRY Current;
+    PLPM_NODE Node;
     UCHAR State;
-    UINT Length, BestLength = 0, MaskLength;
-    PNEIGHBOR_CACHE_ENTRY NCE, BestNCE = NULL;
+    LONG Generation;
+    PNEIGHBOR_CACHE_ENTRY BestNCE = NULL;
 
     TI_DbgPrint(DEBUG_ROUTER, ("Called. Destination (0x%X)\n", Destination));
 
     TI_DbgPrint(DEBUG_ROUTER, ("Destination (%s)\n", A2S(Destination)));
 
-    TcpipAcquireSpinLock(&FIBLock, &OldIrql);
+    if (Destination->Type != IP_ADDRESS_V4) {
+        TI_DbgPrint(DEBUG_ROUTER, ("Don't know address type %d\n", Destination->Type));
+        return NULL;
+    }
 
-    CurrentEntry = FIBListHead.Flink;
-    while (CurrentEntry != &FIBListHead) {
-        NextEntry = CurrentEntry->Flink;
-	    Current = CONTAINING_RECORD(CurrentEntry, FIB_ENTRY, ListEntry);
+    BestNCE = RouterLookupCache(Destination->Address.IPv4Address);
+    if (BestNCE) {
+        TI_DbgPrint(DEBUG_ROUTER,("Routing to %s (cached)\n", A2S(&BestNCE->Address)));
+        return BestNCE;
+    }
 
-        NCE   = Current->Router;
-        State = NCE->State;
+    TcpipAcquireSpinLock(&FIBLock, &OldIrql);
 
-	Length = CommonPrefixLength(Destination, &Current->NetworkAddress);
-	MaskLength = AddrCountPrefixBits(&Current->Netmask);
+    Generation = FIBGeneration;
+    Node = LpmLookup(&FIBTree, IPv4NToHl(Destination->Address.IPv4Address));
+    if (Node) {
+        for (Current = Node->Value; Current; Current = Current->NextSamePrefix) {
+            State = Current->Router->State;
 
-	TI_DbgPrint(DEBUG_ROUTER,("This-Route: %s (Sharing %d bits)\n",
-				  A2S(&NCE->Address), Length));
+            TI_DbgPrint(DEBUG_ROUTER,("This-Route: %s (Sharing %d bits)\n",
+                                      A2S(&Current->Router->Address), Node->PrefixLength));
 
-	if(Length >= MaskLength && (Length > BestLength || !BestNCE) &&
-           ((!(State & NUD_STALE) && !(State & NUD_INCOMPLETE)) || !BestNCE)) {
-	    /* This seems to be a better router */
-	    BestNCE    = NCE;
-	    BestLength = Length;
-	    TI_DbgPrint(DEBUG_ROUTER,("Route selected\n"));
-	}
+            if (!(State & NUD_STALE) && !(State & NUD_INCOMPLETE)) {
+                BestNCE = Current->Router;
+                break;
+            }
+        }
 
-        CurrentEntry = NextEntry;
+        if (BestNCE) {
+            RouterFillCache(Destination->Address.IPv4Address, BestNCE, Generation);
+        } else {
+            /* Nothing better known, try the first one */
+            BestNCE = ((PFIB_ENTRY)Node->Value)->Router;
+        }
     }
 
     TcpipReleaseSpinLock(&FIBLock, OldIrql);
@@ -492,6 +598,11 @@ NTSTATUS RouterStartup(
     /* Initialize the Forward Information Base */
     InitializeListHead(&FIBListHead);
     TcpipInitializeSpinLock(&FIBLock);
+    LpmInitialize(&FIBTree);
+
+    /* Empty cache entries belong to generation 0 */
+    RtlZeroMemory(FIBCache, sizeof(FIBCache));
+    FIBGeneration = 1;
 
     return STATUS_SUCCESS;
 }
@@ -365,6 +365,7 @@ TCPSendEventHandler(void *arg, const u16_t space)
     NTSTATUS Status;
     PMDL Mdl;
     ULONG BytesSent;
+    BOOLEAN More, Queued = FALSE;
     
     ReferenceObject(Connection);
 
@@ -392,9 +393,12 @@ TCPSendEventHandler(void *arg, const u16_t space)
          ("Connection->SocketContext: %x\n",
           Connection->SocketContext));
         
+        /* Coalesce the queued requests and only send once they are all written */
+        More = !IsListEmpty(&Connection->SendRequest);
+
         Status = TCPTranslateError(LibTCPSend(Connection,
                                               SendBuffer,
-                                              SendLen, &BytesSent, TRUE));
+                                              SendLen, &BytesSent, TRUE, More));
         
         TI_DbgPrint(DEBUG_TCP,("TCP Bytes: %d\n", BytesSent));
         
@@ -411,6 +415,9 @@ TCPSendEventHandler(void *arg, const u16_t space)
                         ("Completing Send request: %x %x\n",
                          Bucket->Request, Status));
             
+            if (Status == STATUS_SUCCESS)
+                Queued = More;
+
             Bucket->Status = Status;
             Bucket->Information = (Bucket->Status == STATUS_SUCCESS) ? BytesSent : 0;
                         
@@ -418,6 +425,10 @@ TCPSendEventHandler(void *arg, const u16_t space)
         }
     }
 
+    /* Send what the last writes left queued */
+    if (Queued)
+        LibTCPOutput(Connection);
+
     //  If we completed all outstanding send requests then finish all pending shutdown requests,
     //  cancel the timer and dereference the connection
     if (IsListEmpty(&Connection->SendRequest))
@@ -547,6 +547,7 @@ NTSTATUS TCPSendData
                                           BufferData,
                                           SendLength,
                                           BytesSent,
+                                          FALSE,
                                           FALSE));
     
     TI_DbgPrint(DEBUG_TCP,("[IP, TCPSendData] Send: %x, %d\n", Status, SendLength));
@@ -691,6 +692,21 @@ TCPSetNoDelay(
     return STATUS_SUCCESS;
 }
 
+NTSTATUS
+TCPSetWindow(
+    PCONNECTION_ENDPOINT Connection,
+    ULONG ReceiveWindow,
+    ULONG SendBuffer)
+{
+    if (!Connection)
+        return STATUS_UNSUCCESSFUL;
+
+    if (Connection->SocketContext == NULL)
+        return STATUS_UNSUCCESSFUL;
+
+    return TCPTranslateError(LibTCPSetWindow(Connection, ReceiveWindow, SendBuffer));
+}
+
 NTSTATUS
 TCPGetSocketStatus(
     PCONNECTION_ENDPOINT Connection,
@@ -109,8 +109,20 @@
   #error "MEMP_NUM_REASSDATA > IP_REASS_MAX_PBUFS doesn't make sense since each struct ip_reassdata must hold 2 pbufs at least!"
 #endif
 #endif /* !MEMP_MEM_MALLOC */
-#if (LWIP_TCP && (TCP_WND > 0xffff))
-  #error "If you want to use TCP, TCP_WND must fit in an u16_t, so, you have to reduce it in your lwipopts.h"
+#if (LWIP_TCP && !LWIP_WND_SCALE && (TCP_WND > 0xffff))
+  #error "If you want to use TCP, TCP_WND must fit in an u16_t, so, you have to reduce it in your lwipopts.h (or enable LWIP_WND_SCALE)"
+#endif
+#if (LWIP_TCP && !LWIP_WND_SCALE && (TCP_SND_BUF_MAX > 0xffff))
+  #error "If you want to use TCP, TCP_SND_BUF_MAX must fit in an u16_t, so, you have to reduce it in your lwipopts.h (or enable LWIP_WND_SCALE)"
+#endif
+#if (LWIP_TCP && LWIP_WND_SCALE && ((TCP_RCV_SCALE < 0) || (TCP_RCV_SCALE > 14)))
+  #error "TCP_RCV_SCALE must be between 0 and 14 (RFC 7323)"
+#endif
+#if (LWIP_TCP && LWIP_WND_SCALE && (TCP_WND > (0xffff << TCP_RCV_SCALE)))
+  #error "TCP_WND is too large for TCP_RCV_SCALE, so, you have to reduce it or increase TCP_RCV_SCALE in your lwipopts.h"
+#endif
+#if (LWIP_TCP && (TCP_SND_BUF_MAX < TCP_SND_BUF))
+  #error "TCP_SND_BUF_MAX must be at least as much as TCP_SND_BUF"
 #endif
 #if (LWIP_TCP && (TCP_SND_QUEUELEN > 0xffff))
   #error "If you want to use TCP, TCP_SND_QUEUELEN must fit in an u16_t, so, you have to reduce it in your lwipopts.h"
@@ -172,7 +172,7 @@ tcp_close_shutdown(struct tcp_pcb *pcb, u8_t rst_on_unacked_data)
   err_t err;
 
   if (rst_on_unacked_data && ((pcb->state == ESTABLISHED) || (pcb->state == CLOSE_WAIT))) {
-    if ((pcb->refused_data != NULL) || (pcb->rcv_wnd != TCP_WND)) {
+    if ((pcb->refused_data != NULL) || (pcb->rcv_wnd < TCP_WND_MAX(pcb))) {
       /* Not all data received by application, send RST to tell the remote
          side about this. */
       LWIP_ASSERT("pcb->flags & TF_RXCLOSED", pcb->flags & TF_RXCLOSED);
@@ -580,7 +580,7 @@ u32_t tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb)
 {
   u32_t new_right_edge = pcb->rcv_nxt + pcb->rcv_wnd;
 
-  if (TCP_SEQ_GEQ(new_right_edge, pcb->rcv_ann_right_edge + LWIP_MIN((TCP_WND / 2), pcb->mss))) {
+  if (TCP_SEQ_GEQ(new_right_edge, pcb->rcv_ann_right_edge + LWIP_MIN((TCP_WND_MAX(pcb) / 2), pcb->mss))) {
     /* we can advertise more window */
     pcb->rcv_ann_wnd = pcb->rcv_wnd;
     return new_right_edge - pcb->rcv_ann_right_edge;
@@ -592,8 +592,8 @@ u32_t tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb)
     } else {
       /* keep the right edge of window constant */
       u32_t new_rcv_ann_wnd = pcb->rcv_ann_right_edge - pcb->rcv_nxt;
-      LWIP_ASSERT("new_rcv_ann_wnd <= 0xffff", new_rcv_ann_wnd <= 0xffff);
-      pcb->rcv_ann_wnd = (u16_t)new_rcv_ann_wnd;
+      LWIP_ASSERT("new_rcv_ann_wnd <= TCP_WND_LIMIT", new_rcv_ann_wnd <= TCP_WND_LIMIT);
+      pcb->rcv_ann_wnd = (tcpwnd_size_t)new_rcv_ann_wnd;
     }
     return 0;
   }
@@ -611,22 +611,24 @@ void
 tcp_recved(struct tcp_pcb *pcb, u16_t len)
 {
   int wnd_inflation;
+  tcpwnd_size_t rcv_wnd;
 
   /* pcb->state LISTEN not allowed here */
   LWIP_ASSERT("don't call tcp_recved for listen-pcbs",
     pcb->state != LISTEN);
-  LWIP_ASSERT("tcp_recved: len would wrap rcv_wnd\n",
-              len <= 0xffff - pcb->rcv_wnd );
 
-  pcb->rcv_wnd += len;
-  if (pcb->rcv_wnd > TCP_WND) {
-    pcb->rcv_wnd = TCP_WND;
+  rcv_wnd = (tcpwnd_size_t)(pcb->rcv_wnd + len);
+  if ((rcv_wnd > TCP_WND_MAX(pcb)) || (rcv_wnd < pcb->rcv_wnd)) {
+    /* window got too big or tcpwnd_size_t wrapped */
+    pcb->rcv_wnd = TCP_WND_MAX(pcb);
+  } else {
+    pcb->rcv_wnd = rcv_wnd;
   }
 
   wnd_inflation = tcp_update_rcv_ann_wnd(pcb);
 
   /* If the change in the right edge of window is significant (default
-   * watermark is TCP_WND/4), then send an explicit update now.
+   * watermark is TCP_WND/4 or 4 segments), then send an explicit update now.
    * Otherwise wait for a packet to be sent in the normal course of
    * events (or more window to be available later) */
   if (wnd_inflation >= TCP_WND_UPDATE_THRESHOLD) {
@@ -634,8 +636,71 @@ tcp_recved(struct tcp_pcb *pcb, u16_t len)
     tcp_output(pcb);
   }
 
-  LWIP_DEBUGF(TCP_DEBUG, ("tcp_recved: recveived %"U16_F" bytes, wnd %"U16_F" (%"U16_F").\n",
-         len, pcb->rcv_wnd, TCP_WND - pcb->rcv_wnd));
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_recved: recveived %"U16_F" bytes, wnd %"TCPWNDSIZE_F" (%"TCPWNDSIZE_F").\n",
+         len, pcb->rcv_wnd, (tcpwnd_size_t)(TCP_WND_MAX(pcb) - pcb->rcv_wnd)));
+}
+
+/**
+ * Sets the receive window a connection may open up to, i.e. how much
+ * received data the application is willing to buffer.
+ * Windows above 64KB are only announced if the remote host agreed to
+ * the window scale option.
+ *
+ * @param pcb the tcp_pcb to change
+ * @param wnd the new receive window in bytes
+ */
+void
+tcp_setrcvwnd(struct tcp_pcb *pcb, u32_t wnd)
+{
+  tcpwnd_size_t old_wnd_max;
+
+  LWIP_ASSERT("don't call tcp_setrcvwnd for listen-pcbs",
+    pcb->state != LISTEN);
+
+  old_wnd_max = TCP_WND_MAX(pcb);
+  pcb->rcv_wnd_max = (tcpwnd_size_t)LWIP_MAX(LWIP_MIN(wnd, TCP_WND_LIMIT), TCP_MSS);
+
+  if (pcb->state == CLOSED) {
+    /* nothing has been announced yet */
+    pcb->rcv_wnd = TCP_WND_MAX(pcb);
+    pcb->rcv_ann_wnd = TCP_WND_MAX(pcb);
+  } else if (TCP_WND_MAX(pcb) > old_wnd_max) {
+    /* open the window by what it grew, a smaller window is only
+       applied by tcp_recved() to avoid shrinking the announced one */
+    pcb->rcv_wnd += TCP_WND_MAX(pcb) - old_wnd_max;
+    if (tcp_update_rcv_ann_wnd(pcb) >= TCP_WND_UPDATE_THRESHOLD) {
+      tcp_ack_now(pcb);
+      tcp_output(pcb);
+    }
+  }
+
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_setrcvwnd: wnd %"TCPWNDSIZE_F" (max %"TCPWNDSIZE_F").\n",
+         pcb->rcv_wnd, pcb->rcv_wnd_max));
+}
+
+/**
+ * Sets the size of the send buffer, i.e. how much data tcp_write()
+ * accepts before it has been acknowledged.
+ * The buffer is not made smaller than what is currently queued.
+ *
+ * @param pcb the tcp_pcb to change
+ * @param size the new send buffer size in bytes, up to TCP_SND_BUF_MAX
+ */
+void
+tcp_setsndbuf(struct tcp_pcb *pcb, u32_t size)
+{
+  tcpwnd_size_t queued;
+
+  LWIP_ASSERT("don't call tcp_setsndbuf for listen-pcbs",
+    pcb->state != LISTEN);
+
+  queued = pcb->snd_buf_max - pcb->snd_buf;
+  size = LWIP_MAX(LWIP_MIN(size, TCP_SND_BUF_MAX), 2 * TCP_MSS);
+  pcb->snd_buf_max = (tcpwnd_size_t)LWIP_MAX(size, queued);
+  pcb->snd_buf = pcb->snd_buf_max - queued;
+
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_setsndbuf: size %"TCPWNDSIZE_F" (%"TCPWNDSIZE_F" free).\n",
+         pcb->snd_buf_max, pcb->snd_buf));
 }
 
 /**
@@ -743,8 +808,8 @@ tcp_connect(struct tcp_pcb *pcb, ip_addr_t *ipaddr, u16_t port,
   pcb->snd_nxt = iss;
   pcb->lastack = iss - 1;
   pcb->snd_lbb = iss - 1;
-  pcb->rcv_wnd = TCP_WND;
-  pcb->rcv_ann_wnd = TCP_WND;
+  pcb->rcv_wnd = TCP_WND_MAX(pcb);
+  pcb->rcv_ann_wnd = TCP_WND_MAX(pcb);
   pcb->rcv_ann_right_edge = pcb->rcv_nxt;
   pcb->snd_wnd = TCP_WND;
   /* As initial send MSS, we use TCP_MSS but limit it to 536.
@@ -788,7 +853,7 @@ void
 tcp_slowtmr(void)
 {
   struct tcp_pcb *pcb, *prev;
-  u16_t eff_wnd;
+  tcpwnd_size_t eff_wnd;
   u8_t pcb_remove;      /* flag if a PCB should be removed */
   u8_t pcb_reset;       /* flag if a RST should be sent when removing */
   err_t err;
@@ -867,8 +932,8 @@ tcp_slowtmr_start:
             pcb->ssthresh = (pcb->mss << 1);
           }
           pcb->cwnd = pcb->mss;
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"U16_F
-                                       " ssthresh %"U16_F"\n",
+          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"TCPWNDSIZE_F
+                                       " ssthresh %"TCPWNDSIZE_F"\n",
                                        pcb->cwnd, pcb->ssthresh));
  
           /* The following needs to be called AFTER cwnd is set to one
@@ -1098,7 +1163,7 @@ tcp_process_refused_data(struct tcp_pcb *pcb)
     if (refused_flags & PBUF_FLAG_TCP_FIN) {
       /* correct rcv_wnd as the application won't call tcp_recved()
          for the FIN's seqno */
-      if (pcb->rcv_wnd != TCP_WND) {
+      if (pcb->rcv_wnd < TCP_WND_MAX(pcb)) {
         pcb->rcv_wnd++;
       }
       TCP_EVENT_CLOSED(pcb, err);
@@ -1307,9 +1372,13 @@ tcp_alloc(u8_t prio)
     memset(pcb, 0, sizeof(struct tcp_pcb));
     pcb->prio = prio;
     pcb->snd_buf = TCP_SND_BUF;
+    pcb->snd_buf_max = TCP_SND_BUF;
     pcb->snd_queuelen = 0;
-    pcb->rcv_wnd = TCP_WND;
-    pcb->rcv_ann_wnd = TCP_WND;
+    /* Until the window scale option has been agreed on, only 16 bits
+       of the window can be announced */
+    pcb->rcv_wnd_max = TCP_WND;
+    pcb->rcv_wnd = TCP_WND_MAX(pcb);
+    pcb->rcv_ann_wnd = TCP_WND_MAX(pcb);
     pcb->tos = 0;
     pcb->ttl = TCP_TTL;
     /* As initial send MSS, we use TCP_MSS but limit it to 536.
@@ -69,12 +69,21 @@ static u16_t tcplen;
 static u8_t recv_flags;
 static struct pbuf *recv_data;
 
+#if LWIP_TCP_SACK
+/* SACK blocks of the incoming segment, set by tcp_parseopt() */
+static u8_t sack_num;
+static u32_t sack_left[TCP_MAX_SACK_BLOCKS], sack_right[TCP_MAX_SACK_BLOCKS];
+#endif /* LWIP_TCP_SACK */
+
 struct tcp_pcb *tcp_input_pcb;
 
 /* Forward declarations. */
 static err_t tcp_process(struct tcp_pcb *pcb);
 static void tcp_receive(struct tcp_pcb *pcb);
 static void tcp_parseopt(struct tcp_pcb *pcb);
+#if LWIP_TCP_SACK
+static void tcp_sack_update(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_SACK */
 
 static err_t tcp_listen_input(struct tcp_pcb_listen *pcb);
 static err_t tcp_timewait_input(struct tcp_pcb *pcb);
@@ -330,9 +339,22 @@ tcp_input(struct pbuf *p, struct netif *inp)
            called when new send buffer space is available, we call it
            now. */
         if (pcb->acked > 0) {
-          TCP_EVENT_SENT(pcb, pcb->acked, err);
-          if (err == ERR_ABRT) {
-            goto aborted;
+          u16_t acked16;
+#if LWIP_WND_SCALE
+          /* pcb->acked is u32_t but the sent callback only takes a u16_t,
+             so we might have to call it multiple times. */
+          u32_t acked = pcb->acked;
+          while (acked > 0) {
+            acked16 = (u16_t)LWIP_MIN(acked, 0xffffu);
+            acked -= acked16;
+#else
+          {
+            acked16 = pcb->acked;
+#endif
+            TCP_EVENT_SENT(pcb, acked16, err);
+            if (err == ERR_ABRT) {
+              goto aborted;
+            }
           }
         }
 
@@ -368,7 +390,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
           } else {
             /* correct rcv_wnd as the application won't call tcp_recved()
                for the FIN's seqno */
-            if (pcb->rcv_wnd != TCP_WND) {
+            if (pcb->rcv_wnd < TCP_WND_MAX(pcb)) {
               pcb->rcv_wnd++;
             }
             TCP_EVENT_CLOSED(pcb, err);
@@ -485,7 +507,6 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
     npcb->rcv_ann_right_edge = npcb->rcv_nxt;
     npcb->snd_wnd = tcphdr->wnd;
     npcb->snd_wnd_max = tcphdr->wnd;
-    npcb->ssthresh = npcb->snd_wnd;
     npcb->snd_wl1 = seqno - 1;/* initialise to seqno-1 to force window update */
     npcb->callback_arg = pcb->callback_arg;
 #if LWIP_CALLBACK_API
@@ -499,6 +520,7 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
 
     /* Parse any options in the SYN. */
     tcp_parseopt(npcb);
+    npcb->ssthresh = TCP_INITIAL_SSTHRESH(npcb);
 #if TCP_CALCULATE_EFF_SEND_MSS
     npcb->mss = tcp_eff_send_mss(npcb->mss, &(npcb->remote_ip));
 #endif /* TCP_CALCULATE_EFF_SEND_MSS */
@@ -644,9 +666,9 @@ tcp_process(struct tcp_pcb *pcb)
       pcb->mss = tcp_eff_send_mss(pcb->mss, &(pcb->remote_ip));
 #endif /* TCP_CALCULATE_EFF_SEND_MSS */
 
-      /* Set ssthresh again after changing pcb->mss (already set in tcp_connect
-       * but for the default value of pcb->mss) */
-      pcb->ssthresh = pcb->mss * 10;
+      /* Set ssthresh again now that the window scale is known (already set
+       * in tcp_connect but for the default value of pcb->mss) */
+      pcb->ssthresh = TCP_INITIAL_SSTHRESH(pcb);
 
       pcb->cwnd = ((pcb->cwnd == 1) ? (pcb->mss * 2) : pcb->mss);
       LWIP_ASSERT("pcb->snd_queuelen > 0", (pcb->snd_queuelen > 0));
@@ -684,7 +706,7 @@ tcp_process(struct tcp_pcb *pcb)
     if (flags & TCP_ACK) {
       /* expected ACK number? */
       if (TCP_SEQ_BETWEEN(ackno, pcb->lastack+1, pcb->snd_nxt)) {
-        u16_t old_cwnd;
+        tcpwnd_size_t old_cwnd;
         pcb->state = ESTABLISHED;
         LWIP_DEBUGF(TCP_DEBUG, ("TCP connection established %"U16_F" -> %"U16_F".\n", inseg.tcphdr->src, inseg.tcphdr->dest));
 #if LWIP_CALLBACK_API
@@ -869,12 +891,12 @@ tcp_receive(struct tcp_pcb *pcb)
     /* Update window. */
     if (TCP_SEQ_LT(pcb->snd_wl1, seqno) ||
        (pcb->snd_wl1 == seqno && TCP_SEQ_LT(pcb->snd_wl2, ackno)) ||
-       (pcb->snd_wl2 == ackno && tcphdr->wnd > pcb->snd_wnd)) {
-      pcb->snd_wnd = tcphdr->wnd;
+       (pcb->snd_wl2 == ackno && (u32_t)SND_WND_SCALE(pcb, tcphdr->wnd) > pcb->snd_wnd)) {
+      pcb->snd_wnd = SND_WND_SCALE(pcb, tcphdr->wnd);
       /* keep track of the biggest window announced by the remote host to calculate
          the maximum segment size */
-      if (pcb->snd_wnd_max < tcphdr->wnd) {
-        pcb->snd_wnd_max = tcphdr->wnd;
+      if (pcb->snd_wnd_max < pcb->snd_wnd) {
+        pcb->snd_wnd_max = pcb->snd_wnd;
       }
       pcb->snd_wl1 = seqno;
       pcb->snd_wl2 = ackno;
@@ -888,10 +910,10 @@ tcp_receive(struct tcp_pcb *pcb)
         /* stop persist timer */
           pcb->persist_backoff = 0;
       }
-      LWIP_DEBUGF(TCP_WND_DEBUG, ("tcp_receive: window update %"U16_F"\n", pcb->snd_wnd));
+      LWIP_DEBUGF(TCP_WND_DEBUG, ("tcp_receive: window update %"TCPWNDSIZE_F"\n", pcb->snd_wnd));
 #if TCP_WND_DEBUG
     } else {
-      if (pcb->snd_wnd != tcphdr->wnd) {
+      if (pcb->snd_wnd != (tcpwnd_size_t)SND_WND_SCALE(pcb, tcphdr->wnd)) {
         LWIP_DEBUGF(TCP_WND_DEBUG, 
                     ("tcp_receive: no window update lastack %"U32_F" ackno %"
                      U32_F" wl1 %"U32_F" seqno %"U32_F" wl2 %"U32_F"\n",
@@ -900,6 +922,12 @@ tcp_receive(struct tcp_pcb *pcb)
 #endif /* TCP_WND_DEBUG */
     }
 
+#if LWIP_TCP_SACK
+    if ((pcb->flags & TF_SACK) && (sack_num > 0)) {
+      tcp_sack_update(pcb);
+    }
+#endif /* LWIP_TCP_SACK */
+
     /* (From Stevens TCP/IP Illustrated Vol II, p970.) Its only a
      * duplicate ack if:
      * 1) It doesn't ACK new data 
@@ -938,9 +966,15 @@ tcp_receive(struct tcp_pcb *pcb)
               if (pcb->dupacks > 3) {
                 /* Inflate the congestion window, but not if it means that
                    the value overflows. */
-                if ((u16_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
+                if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
                   pcb->cwnd += pcb->mss;
                 }
+#if LWIP_TCP_SACK
+                /* Repair the next hole the SACK blocks revealed */
+                if ((pcb->flags & (TF_INFR | TF_SACK)) == (TF_INFR | TF_SACK)) {
+                  tcp_rexmit_sack(pcb);
+                }
+#endif /* LWIP_TCP_SACK */
               } else if (pcb->dupacks == 3) {
                 /* Do fast retransmit */
                 tcp_rexmit_fast(pcb);
@@ -961,8 +995,15 @@ tcp_receive(struct tcp_pcb *pcb)
          in fast retransmit. Also reset the congestion window to the
          slow start threshold. */
       if (pcb->flags & TF_INFR) {
-        pcb->flags &= ~TF_INFR;
-        pcb->cwnd = pcb->ssthresh;
+#if LWIP_TCP_SACK
+        /* A partial ACK keeps a SACK connection in fast recovery, the
+           next hole is retransmitted below (RFC 6675) */
+        if (!(pcb->flags & TF_SACK) || TCP_SEQ_GEQ(ackno, pcb->recover))
+#endif /* LWIP_TCP_SACK */
+        {
+          pcb->flags &= ~TF_INFR;
+          pcb->cwnd = pcb->ssthresh;
+        }
       }
 
       /* Reset the number of retransmissions. */
@@ -971,8 +1012,9 @@ tcp_receive(struct tcp_pcb *pcb)
       /* Reset the retransmission time-out. */
       pcb->rto = (pcb->sa >> 3) + pcb->sv;
 
-      /* Update the send buffer space. Diff between the two can never exceed 64K? */
-      pcb->acked = (u16_t)(ackno - pcb->lastack);
+      /* Update the send buffer space. Diff between the two can never exceed
+         the send buffer. */
+      pcb->acked = (tcpwnd_size_t)(ackno - pcb->lastack);
 
       pcb->snd_buf += pcb->acked;
 
@@ -983,17 +1025,25 @@ tcp_receive(struct tcp_pcb *pcb)
       /* Update the congestion control variables (cwnd and
          ssthresh). */
       if (pcb->state >= ESTABLISHED) {
+#if LWIP_TCP_SACK
+        if (pcb->flags & TF_INFR) {
+          /* Partial ACK: deflate the window by what was acked, but let
+             one more segment out */
+          pcb->cwnd = ((pcb->cwnd > pcb->acked) ? (pcb->cwnd - pcb->acked) : 0) + pcb->mss;
+          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: partial ACK cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
+        } else
+#endif /* LWIP_TCP_SACK */
         if (pcb->cwnd < pcb->ssthresh) {
-          if ((u16_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
+          if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
             pcb->cwnd += pcb->mss;
           }
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"U16_F"\n", pcb->cwnd));
+          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
         } else {
-          u16_t new_cwnd = (pcb->cwnd + pcb->mss * pcb->mss / pcb->cwnd);
+          tcpwnd_size_t new_cwnd = (pcb->cwnd + pcb->mss * pcb->mss / pcb->cwnd);
           if (new_cwnd > pcb->cwnd) {
             pcb->cwnd = new_cwnd;
           }
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: congestion avoidance cwnd %"U16_F"\n", pcb->cwnd));
+          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: congestion avoidance cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
         }
       }
       LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_receive: ACK for %"U32_F", unacked->seqno %"U32_F":%"U32_F"\n",
@@ -1041,6 +1091,12 @@ tcp_receive(struct tcp_pcb *pcb)
         pcb->rtime = 0;
 
       pcb->polltmr = 0;
+
+#if LWIP_TCP_SACK
+      if (pcb->flags & TF_INFR) {
+        tcp_rexmit_sack(pcb);
+      }
+#endif /* LWIP_TCP_SACK */
     } else {
       /* Fix bug bug #21582: out of sequence ACK, didn't really ack anything */
       pcb->acked = 0;
@@ -1362,12 +1418,23 @@ tcp_receive(struct tcp_pcb *pcb)
 
 
         /* Acknowledge the segment(s). */
-        tcp_ack(pcb);
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+        if ((pcb->flags & TF_SACK) && (pcb->ooseq != NULL)) {
+          /* holes remain, tell the remote host right away */
+          tcp_ack_now(pcb);
+        } else
+#endif /* LWIP_TCP_SACK && TCP_QUEUE_OOSEQ */
+        {
+          tcp_ack(pcb);
+        }
 
       } else {
         /* We get here if the incoming segment is out-of-sequence. */
-        tcp_send_empty_ack(pcb);
 #if TCP_QUEUE_OOSEQ
+#if LWIP_TCP_SACK
+        /* reported in the first SACK block of the ACK below */
+        pcb->ooseq_last = seqno;
+#endif /* LWIP_TCP_SACK */
         /* We queue the segment on the ->ooseq queue. */
         if (pcb->ooseq == NULL) {
           pcb->ooseq = tcp_seg_copy(&inseg);
@@ -1514,6 +1581,9 @@ tcp_receive(struct tcp_pcb *pcb)
         }
 #endif /* TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS */
 #endif /* TCP_QUEUE_OOSEQ */
+        /* Send the duplicate ACK once the segment is queued, so that
+           its SACK blocks include it. */
+        tcp_send_empty_ack(pcb);
       }
     } else {
       /* The incoming segment is not withing the window. */
@@ -1530,11 +1600,57 @@ tcp_receive(struct tcp_pcb *pcb)
   }
 }
 
+#if LWIP_TCP_SACK
+/**
+ * Marks the unacked segments covered by the SACK blocks of the incoming
+ * segment, and keeps track of the highest sequence number SACKed.
+ *
+ * Called from tcp_receive().
+ *
+ * @param pcb the tcp_pcb for which a segment arrived
+ */
+static void
+tcp_sack_update(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+  u32_t left, right, seg_seqno;
+  u8_t i;
+
+  if (TCP_SEQ_LT(pcb->sack_high, pcb->lastack)) {
+    pcb->sack_high = pcb->lastack;
+  }
+
+  for (i = 0; i < sack_num; i++) {
+    left = sack_left[i];
+    right = sack_right[i];
+    /* Ignore blocks that are bogus or already covered by the ACK */
+    if (!TCP_SEQ_LT(left, right) || TCP_SEQ_LEQ(right, ackno) ||
+        TCP_SEQ_GT(right, pcb->snd_nxt)) {
+      continue;
+    }
+    /* pcb->unacked is sorted */
+    for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+      seg_seqno = ntohl(seg->tcphdr->seqno);
+      if (TCP_SEQ_GEQ(seg_seqno, right)) {
+        break;
+      }
+      if (TCP_SEQ_GEQ(seg_seqno, left) &&
+          TCP_SEQ_LEQ(seg_seqno + TCP_TCPLEN(seg), right)) {
+        seg->flags |= TF_SEG_SACKED;
+      }
+    }
+    if (TCP_SEQ_GT(right, pcb->sack_high)) {
+      pcb->sack_high = right;
+    }
+  }
+}
+#endif /* LWIP_TCP_SACK */
+
 /**
  * Parses the options contained in the incoming segment. 
  *
  * Called from tcp_listen_input() and tcp_process().
- * Currently, only the MSS option is supported!
+ * Supported are the MSS, timestamp, window scale and SACK options.
  *
  * @param pcb the tcp_pcb for which a segment arrived
  */
@@ -1547,6 +1663,11 @@ tcp_parseopt(struct tcp_pcb *pcb)
 #if LWIP_TCP_TIMESTAMPS
   u32_t tsval;
 #endif
+#if LWIP_TCP_SACK
+  u16_t b;
+
+  sack_num = 0;
+#endif
 
   opts = (u8_t *)tcphdr + TCP_HLEN;
 
@@ -1599,6 +1720,62 @@ tcp_parseopt(struct tcp_pcb *pcb)
         /* Advance to next option */
         c += 0x0A;
         break;
+#endif
+#if LWIP_WND_SCALE
+      case 0x03:
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: WND_SCALE\n"));
+        if (opts[c + 1] != 0x03 || c + 0x03 > max_c) {
+          /* Bad length */
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+          return;
+        }
+        /* Only valid in a SYN. We announce the option in our SYN either
+           way, or in our SYN|ACK because the remote host did. */
+        if ((flags & TCP_SYN) && !(pcb->flags & TF_WND_SCALE)) {
+          pcb->snd_scale = LWIP_MIN(opts[c + 2], 14);
+          pcb->rcv_scale = TCP_RCV_SCALE;
+          pcb->flags |= TF_WND_SCALE;
+          /* Nothing has been received yet, so the full window can be used */
+          pcb->rcv_wnd = TCP_WND_MAX(pcb);
+          pcb->rcv_ann_wnd = TCP_WND_MAX(pcb);
+        }
+        /* Advance to next option */
+        c += 0x03;
+        break;
+#endif
+#if LWIP_TCP_SACK
+      case 0x04:
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: SACK_PERM\n"));
+        if (opts[c + 1] != 0x02 || c + 0x02 > max_c) {
+          /* Bad length */
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+          return;
+        }
+        if (flags & TCP_SYN) {
+          pcb->flags |= TF_SACK;
+        }
+        /* Advance to next option */
+        c += 0x02;
+        break;
+      case 0x05:
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: SACK\n"));
+        if (opts[c + 1] < 0x0A || ((opts[c + 1] - 2) & 7) != 0 ||
+            c + opts[c + 1] > max_c) {
+          /* Bad length */
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+          return;
+        }
+        /* Keep the blocks for tcp_receive() */
+        for (b = c + 2; b < c + opts[c + 1] && sack_num < TCP_MAX_SACK_BLOCKS; b += 8) {
+          sack_left[sack_num] = ((u32_t)opts[b] << 24) | ((u32_t)opts[b + 1] << 16) |
+                                ((u32_t)opts[b + 2] << 8) | opts[b + 3];
+          sack_right[sack_num] = ((u32_t)opts[b + 4] << 24) | ((u32_t)opts[b + 5] << 16) |
+                                 ((u32_t)opts[b + 6] << 8) | opts[b + 7];
+          sack_num++;
+        }
+        /* Advance to next option */
+        c += opts[c + 1];
+        break;
 #endif
       default:
         LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: other\n"));
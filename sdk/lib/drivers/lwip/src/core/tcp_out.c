@@ -105,7 +105,7 @@ tcp_output_alloc_header(struct tcp_pcb *pcb, u16_t optlen, u16_t datalen,
     tcphdr->seqno = seqno_be;
     tcphdr->ackno = htonl(pcb->rcv_nxt);
     TCPH_HDRLEN_FLAGS_SET(tcphdr, (5 + optlen / 4), TCP_ACK);
-    tcphdr->wnd = htons(pcb->rcv_ann_wnd);
+    tcphdr->wnd = htons(TCPWND16(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd)));
     tcphdr->chksum = 0;
     tcphdr->urgp = 0;
 
@@ -306,7 +306,7 @@ tcp_write_checks(struct tcp_pcb *pcb, u16_t len)
 
   /* fail on too much data */
   if (len > pcb->snd_buf) {
-    LWIP_DEBUGF(TCP_OUTPUT_DEBUG | 3, ("tcp_write: too much data (len=%"U16_F" > snd_buf=%"U16_F")\n",
+    LWIP_DEBUGF(TCP_OUTPUT_DEBUG | 3, ("tcp_write: too much data (len=%"U16_F" > snd_buf=%"TCPWNDSIZE_F")\n",
       len, pcb->snd_buf));
     pcb->flags |= TF_NAGLEMEMERR;
     return ERR_MEM;
@@ -370,7 +370,7 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
 #endif /* TCP_CHECKSUM_ON_COPY */
   err_t err;
   /* don't allocate segments bigger than half the maximum window we ever received */
-  u16_t mss_local = LWIP_MIN(pcb->mss, pcb->snd_wnd_max/2);
+  u16_t mss_local = (u16_t)LWIP_MIN(pcb->mss, pcb->snd_wnd_max/2);
 
 #if LWIP_NETIF_TX_SINGLE_PBUF
   /* Always copy to try to create single pbufs for TX */
@@ -742,6 +742,17 @@ tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags)
 
   if (flags & TCP_SYN) {
     optflags = TF_SEG_OPTS_MSS;
+#if LWIP_WND_SCALE
+    /* A SYN|ACK only carries the option if the SYN did */
+    if ((pcb->state != SYN_RCVD) || (pcb->flags & TF_WND_SCALE)) {
+      optflags |= TF_SEG_OPTS_WND_SCALE;
+    }
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK
+    if ((pcb->state != SYN_RCVD) || (pcb->flags & TF_SACK)) {
+      optflags |= TF_SEG_OPTS_SACK_PERM;
+    }
+#endif /* LWIP_TCP_SACK */
   }
 #if LWIP_TCP_TIMESTAMPS
   if ((pcb->flags & TF_TIMESTAMP)) {
@@ -834,6 +845,61 @@ tcp_build_timestamp_option(struct tcp_pcb *pcb, u32_t *opts)
 }
 #endif
 
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+/* Build the SACK blocks describing pcb->ooseq: contiguous segments are
+ * merged and the block holding the most recently received segment comes
+ * first, as required by RFC 2018.
+ *
+ * @param pcb tcp_pcb
+ * @param left left edges of the blocks (host byte order)
+ * @param right right edges of the blocks (host byte order)
+ * @param max maximum number of blocks to build
+ * @return number of blocks built
+ */
+static u8_t
+tcp_build_sack_blocks(struct tcp_pcb *pcb, u32_t *left, u32_t *right, u8_t max)
+{
+  struct tcp_seg *seg;
+  u32_t seqno, start, end;
+  u8_t num = 0;
+  u8_t first = 0;
+
+  seg = pcb->ooseq;
+  while (seg != NULL) {
+    /* tcp_input() already converted seqno to host byte order */
+    start = seg->tcphdr->seqno;
+    end = start + TCP_TCPLEN(seg);
+    /* ooseq is sorted and its segments do not overlap */
+    for (seg = seg->next; seg != NULL; seg = seg->next) {
+      seqno = seg->tcphdr->seqno;
+      if (seqno != end) {
+        break;
+      }
+      end = seqno + TCP_TCPLEN(seg);
+    }
+    if (TCP_SEQ_BETWEEN(pcb->ooseq_last, start, end - 1)) {
+      /* Most recent block goes first, the others follow in order */
+      left[num] = left[0];
+      right[num] = right[0];
+      left[0] = start;
+      right[0] = end;
+      first = 1;
+    } else {
+      left[num] = start;
+      right[num] = end;
+    }
+    if (++num == max) {
+      if (first || seg == NULL) {
+        break;
+      }
+      /* Keep looking for the most recent block, replacing the last one */
+      num--;
+    }
+  }
+  return num;
+}
+#endif /* LWIP_TCP_SACK && TCP_QUEUE_OOSEQ */
+
 /** Send an ACK without data.
  *
  * @param pcb Protocol control block for the TCP connection to send the ACK
@@ -843,13 +909,27 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
 {
   struct pbuf *p;
   struct tcp_hdr *tcphdr;
+  u32_t *opts;
   u8_t optlen = 0;
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+  u32_t sack_left[TCP_MAX_SACK_BLOCKS], sack_right[TCP_MAX_SACK_BLOCKS];
+  u8_t sack_num = 0;
+  u8_t i;
+#endif /* LWIP_TCP_SACK && TCP_QUEUE_OOSEQ */
 
 #if LWIP_TCP_TIMESTAMPS
   if (pcb->flags & TF_TIMESTAMP) {
     optlen = LWIP_TCP_OPT_LENGTH(TF_SEG_OPTS_TS);
   }
 #endif
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+  if ((pcb->flags & TF_SACK) && (pcb->ooseq != NULL)) {
+    /* Each block takes 8 bytes, after two NOPs and the kind and length */
+    sack_num = tcp_build_sack_blocks(pcb, sack_left, sack_right,
+                                     (u8_t)LWIP_MIN(TCP_MAX_SACK_BLOCKS, (40 - optlen - 4) / 8));
+    optlen += 4 + 8 * sack_num;
+  }
+#endif /* LWIP_TCP_SACK && TCP_QUEUE_OOSEQ */
 
   p = tcp_output_alloc_header(pcb, optlen, 0, htonl(pcb->snd_nxt));
   if (p == NULL) {
@@ -863,13 +943,26 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   pcb->flags &= ~(TF_ACK_DELAY | TF_ACK_NOW);
 
   /* NB. MSS option is only sent on SYNs, so ignore it here */
+  opts = (u32_t *)(void *)(tcphdr + 1);
+  LWIP_UNUSED_ARG(opts);
 #if LWIP_TCP_TIMESTAMPS
   pcb->ts_lastacksent = pcb->rcv_nxt;
 
   if (pcb->flags & TF_TIMESTAMP) {
-    tcp_build_timestamp_option(pcb, (u32_t *)(tcphdr + 1));
+    tcp_build_timestamp_option(pcb, opts);
+    opts += 3;
   }
 #endif 
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+  if (sack_num != 0) {
+    /* Pad with two NOP options to keep the blocks aligned */
+    *opts++ = htonl(0x01010500 | (2 + 8 * sack_num));
+    for (i = 0; i < sack_num; i++) {
+      *opts++ = htonl(sack_left[i]);
+      *opts++ = htonl(sack_right[i]);
+    }
+  }
+#endif /* LWIP_TCP_SACK && TCP_QUEUE_OOSEQ */
 
 #if CHECKSUM_GEN_TCP
   tcphdr->chksum = inet_chksum_pseudo(p, &(pcb->local_ip), &(pcb->remote_ip),
@@ -945,13 +1038,13 @@ tcp_output(struct tcp_pcb *pcb)
 #endif /* TCP_OUTPUT_DEBUG */
 #if TCP_CWND_DEBUG
   if (seg == NULL) {
-    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_output: snd_wnd %"U16_F
-                                 ", cwnd %"U16_F", wnd %"U32_F
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_output: snd_wnd %"TCPWNDSIZE_F
+                                 ", cwnd %"TCPWNDSIZE_F", wnd %"U32_F
                                  ", seg == NULL, ack %"U32_F"\n",
                                  pcb->snd_wnd, pcb->cwnd, wnd, pcb->lastack));
   } else {
     LWIP_DEBUGF(TCP_CWND_DEBUG, 
-                ("tcp_output: snd_wnd %"U16_F", cwnd %"U16_F", wnd %"U32_F
+                ("tcp_output: snd_wnd %"TCPWNDSIZE_F", cwnd %"TCPWNDSIZE_F", wnd %"U32_F
                  ", effwnd %"U32_F", seq %"U32_F", ack %"U32_F"\n",
                  pcb->snd_wnd, pcb->cwnd, wnd,
                  ntohl(seg->tcphdr->seqno) - pcb->lastack + seg->len,
@@ -975,7 +1068,7 @@ tcp_output(struct tcp_pcb *pcb)
       break;
     }
 #if TCP_CWND_DEBUG
-    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_output: snd_wnd %"U16_F", cwnd %"U16_F", wnd %"U32_F", effwnd %"U32_F", seq %"U32_F", ack %"U32_F", i %"S16_F"\n",
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_output: snd_wnd %"TCPWNDSIZE_F", cwnd %"TCPWNDSIZE_F", wnd %"U32_F", effwnd %"U32_F", seq %"U32_F", ack %"U32_F", i %"S16_F"\n",
                             pcb->snd_wnd, pcb->cwnd, wnd,
                             ntohl(seg->tcphdr->seqno) + seg->len -
                             pcb->lastack,
@@ -1060,7 +1153,15 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
   seg->tcphdr->ackno = htonl(pcb->rcv_nxt);
 
   /* advertise our receive window size in this TCP segment */
-  seg->tcphdr->wnd = htons(pcb->rcv_ann_wnd);
+#if LWIP_WND_SCALE
+  if (seg->flags & TF_SEG_OPTS_WND_SCALE) {
+    /* The window of a SYN segment is never scaled */
+    seg->tcphdr->wnd = htons(TCPWND16(pcb->rcv_ann_wnd));
+  } else
+#endif /* LWIP_WND_SCALE */
+  {
+    seg->tcphdr->wnd = htons(TCPWND16(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd)));
+  }
 
   pcb->rcv_ann_right_edge = pcb->rcv_nxt + pcb->rcv_ann_wnd;
 
@@ -1085,6 +1186,18 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
     opts += 3;
   }
 #endif
+#if LWIP_WND_SCALE
+  if (seg->flags & TF_SEG_OPTS_WND_SCALE) {
+    *opts = TCP_BUILD_WND_SCALE_OPTION();
+    opts += 1;
+  }
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK
+  if (seg->flags & TF_SEG_OPTS_SACK_PERM) {
+    *opts = TCP_BUILD_SACK_PERM_OPTION();
+    opts += 1;
+  }
+#endif /* LWIP_TCP_SACK */
 
   /* Set retransmission timer running if it is not currently enabled 
      This must be set before checking the route. */
@@ -1212,7 +1325,7 @@ tcp_rst(u32_t seqno, u32_t ackno,
   tcphdr->seqno = htonl(seqno);
   tcphdr->ackno = htonl(ackno);
   TCPH_HDRLEN_FLAGS_SET(tcphdr, TCP_HLEN/4, TCP_RST | TCP_ACK);
-  tcphdr->wnd = PP_HTONS(TCP_WND);
+  tcphdr->wnd = PP_HTONS(TCPWND16(TCP_WND));
   tcphdr->chksum = 0;
   tcphdr->urgp = 0;
 
@@ -1245,7 +1358,17 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
   }
 
   /* Move all unacked segments to the head of the unsent queue */
-  for (seg = pcb->unacked; seg->next != NULL; seg = seg->next);
+  for (seg = pcb->unacked; seg->next != NULL; seg = seg->next) {
+#if LWIP_TCP_SACK
+    /* RFC 2018: the receiver may have discarded SACKed data since */
+    seg->flags &= ~TF_SEG_SACKED;
+#endif /* LWIP_TCP_SACK */
+  }
+#if LWIP_TCP_SACK
+  seg->flags &= ~TF_SEG_SACKED;
+  /* A timeout ends fast recovery */
+  pcb->flags &= ~TF_INFR;
+#endif /* LWIP_TCP_SACK */
   /* concatenate unsent queue after unacked queue */
   seg->next = pcb->unsent;
   /* unsent queue is the concatenated queue (of unacked, unsent) */
@@ -1265,27 +1388,23 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
 }
 
 /**
- * Requeue the first unacked segment for retransmission
+ * Requeue an unacked segment for retransmission
  *
- * Called by tcp_receive() for fast retramsmit.
- *
- * @param pcb the tcp_pcb for which to retransmit the first unacked segment
+ * @param pcb the tcp_pcb the segment belongs to
+ * @param seg the segment on pcb->unacked to retransmit
  */
 void
-tcp_rexmit(struct tcp_pcb *pcb)
+tcp_rexmit_seg(struct tcp_pcb *pcb, struct tcp_seg *seg)
 {
-  struct tcp_seg *seg;
   struct tcp_seg **cur_seg;
 
-  if (pcb->unacked == NULL) {
-    return;
+  /* Unlink the segment from the unacked queue */
+  for (cur_seg = &(pcb->unacked); *cur_seg != seg; cur_seg = &((*cur_seg)->next)) {
+    LWIP_ASSERT("tcp_rexmit_seg: segment not on unacked", *cur_seg != NULL);
   }
+  *cur_seg = seg->next;
 
-  /* Move the first unacked segment to the unsent queue */
-  /* Keep the unsent queue sorted. */
-  seg = pcb->unacked;
-  pcb->unacked = seg->next;
-
+  /* Move it to the unsent queue, keeping the unsent queue sorted. */
   cur_seg = &(pcb->unsent);
   while (*cur_seg &&
     TCP_SEQ_LT(ntohl((*cur_seg)->tcphdr->seqno), ntohl(seg->tcphdr->seqno))) {
@@ -1300,17 +1419,69 @@ tcp_rexmit(struct tcp_pcb *pcb)
   }
 #endif /* TCP_OVERSIZE */
 
-  ++pcb->nrtx;
-
   /* Don't take any rtt measurements after retransmitting. */
   pcb->rttest = 0;
 
   /* Do the actual retransmission. */
   snmp_inc_tcpretranssegs();
+}
+
+/**
+ * Requeue the first unacked segment for retransmission
+ *
+ * Called by tcp_receive() for fast retramsmit.
+ *
+ * @param pcb the tcp_pcb for which to retransmit the first unacked segment
+ */
+void
+tcp_rexmit(struct tcp_pcb *pcb)
+{
+  if (pcb->unacked == NULL) {
+    return;
+  }
+
+  tcp_rexmit_seg(pcb, pcb->unacked);
+
+  ++pcb->nrtx;
+
   /* No need to call tcp_output: we are always called from tcp_input()
      and thus tcp_output directly returns. */
 }
 
+#if LWIP_TCP_SACK
+/**
+ * Requeue the next hole reported by SACK for retransmission
+ *
+ * Called by tcp_receive() during fast recovery: every segment that is
+ * neither SACKed nor retransmitted yet, and lies below the highest SACKed
+ * sequence number, is considered lost (a simplified RFC 6675 scoreboard).
+ *
+ * @param pcb the tcp_pcb in fast recovery
+ * @return 1 if a segment was requeued, 0 if there is no hole left
+ */
+u8_t
+tcp_rexmit_sack(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+  u32_t seqno;
+
+  for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+    seqno = ntohl(seg->tcphdr->seqno);
+    if (TCP_SEQ_GEQ(seqno, pcb->sack_high) && seg != pcb->unacked) {
+      /* Not known to be lost */
+      break;
+    }
+    if (!(seg->flags & TF_SEG_SACKED) && TCP_SEQ_GEQ(seqno, pcb->rexmit_high)) {
+      LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_rexmit_sack: hole at %"U32_F"\n", seqno));
+      pcb->rexmit_high = seqno + TCP_TCPLEN(seg);
+      tcp_rexmit_seg(pcb, seg);
+      return 1;
+    }
+  }
+  return 0;
+}
+#endif /* LWIP_TCP_SACK */
+
 
 /**
  * Handle retransmission after three dupacks received
@@ -1327,6 +1498,11 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
                  "), fast retransmit %"U32_F"\n",
                  (u16_t)pcb->dupacks, pcb->lastack,
                  ntohl(pcb->unacked->tcphdr->seqno)));
+#if LWIP_TCP_SACK
+    /* Recovery ends once everything sent so far is acknowledged */
+    pcb->recover = pcb->snd_nxt;
+    pcb->rexmit_high = ntohl(pcb->unacked->tcphdr->seqno) + TCP_TCPLEN(pcb->unacked);
+#endif /* LWIP_TCP_SACK */
     tcp_rexmit(pcb);
 
     /* Set ssthresh to half of the minimum of the current
@@ -1340,7 +1516,7 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
     /* The minimum value for ssthresh should be 2 MSS */
     if (pcb->ssthresh < 2*pcb->mss) {
       LWIP_DEBUGF(TCP_FR_DEBUG, 
-                  ("tcp_receive: The minimum value for ssthresh %"U16_F
+                  ("tcp_receive: The minimum value for ssthresh %"TCPWNDSIZE_F
                    " should be min 2 mss %"U16_F"...\n",
                    pcb->ssthresh, 2*pcb->mss));
       pcb->ssthresh = 2*pcb->mss;
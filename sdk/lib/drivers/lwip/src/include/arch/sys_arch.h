@@ -38,6 +38,16 @@ sys_arch_protect(sys_prot_t *lev);
 void
 sys_arch_unprotect(sys_prot_t lev);
 
+u32_t
+sys_arch_sem_trywait(sys_sem_t* sem);
+
 void
 sys_shutdown(void);
 
+/* Memory pools in rosmem.c */
+void
+memp_arch_shutdown(void);
+
+void
+memp_arch_dump(void);
+
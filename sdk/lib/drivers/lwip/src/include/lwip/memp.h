@@ -83,9 +83,19 @@ extern const u16_t memp_sizes[MEMP_MAX];
 
 #include "mem.h"
 
+#if MEMP_ARCH_MALLOC
+void  memp_arch_init(void);
+void *memp_arch_malloc(memp_t type);
+void  memp_arch_free(memp_t type, void *mem);
+
+#define memp_init()           memp_arch_init()
+#define memp_malloc(type)     memp_arch_malloc(type)
+#define memp_free(type, mem)  memp_arch_free((type), (mem))
+#else /* MEMP_ARCH_MALLOC */
 #define memp_init()
 #define memp_malloc(type)     mem_malloc(memp_sizes[type])
 #define memp_free(type, mem)  mem_free(mem)
+#endif /* MEMP_ARCH_MALLOC */
 
 #else /* MEMP_MEM_MALLOC */
 
@@ -115,6 +115,15 @@
 #define MEMP_MEM_MALLOC                 0
 #endif
 
+/**
+ * MEMP_ARCH_MALLOC==1: With MEMP_MEM_MALLOC, let the port allocate the memp
+ * types through memp_arch_init(), memp_arch_malloc() and memp_arch_free()
+ * instead of mem_malloc(), e.g. to keep typed pools.
+ */
+#ifndef MEMP_ARCH_MALLOC
+#define MEMP_ARCH_MALLOC                0
+#endif
+
 /**
  * MEM_ALIGNMENT: should be set to the alignment of the CPU
  *    4 byte alignment -> #define MEM_ALIGNMENT 4
@@ -977,21 +986,30 @@
 #define TCP_SND_BUF                     (2 * TCP_MSS)
 #endif
 
+/**
+ * TCP_SND_BUF_MAX: Largest sender buffer (bytes) tcp_setsndbuf() accepts.
+ * Values above 0xffff need LWIP_WND_SCALE.
+ */
+#ifndef TCP_SND_BUF_MAX
+#define TCP_SND_BUF_MAX                 TCP_SND_BUF
+#endif
+
 /**
  * TCP_SND_QUEUELEN: TCP sender buffer space (pbufs). This must be at least
- * as much as (2 * TCP_SND_BUF/TCP_MSS) for things to work.
+ * as much as (2 * TCP_SND_BUF_MAX/TCP_MSS) for things to work.
  */
 #ifndef TCP_SND_QUEUELEN
-#define TCP_SND_QUEUELEN                ((4 * (TCP_SND_BUF) + (TCP_MSS - 1))/(TCP_MSS))
+#define TCP_SND_QUEUELEN                ((4 * (TCP_SND_BUF_MAX) + (TCP_MSS - 1))/(TCP_MSS))
 #endif
 
 /**
  * TCP_SNDLOWAT: TCP writable space (bytes). This must be less than
  * TCP_SND_BUF. It is the amount of space which must be available in the
  * TCP snd_buf for select to return writable (combined with TCP_SNDQUEUELOWAT).
+ * It is compared against tcp_sndbuf(), so it cannot exceed 0xFFFF.
  */
 #ifndef TCP_SNDLOWAT
-#define TCP_SNDLOWAT                    LWIP_MIN(LWIP_MAX(((TCP_SND_BUF)/2), (2 * TCP_MSS) + 1), (TCP_SND_BUF) - 1)
+#define TCP_SNDLOWAT                    LWIP_MIN(LWIP_MIN(LWIP_MAX(((TCP_SND_BUF)/2), (2 * TCP_MSS) + 1), (TCP_SND_BUF) - 1), 0xFFFF)
 #endif
 
 /**
@@ -1060,12 +1078,32 @@
 #define LWIP_TCP_TIMESTAMPS             0
 #endif
 
+/**
+ * LWIP_WND_SCALE==1: support the TCP window scale option (RFC 7323).
+ * TCP_WND and TCP_SND_BUF_MAX may then be larger than 0xffff.
+ * TCP_RCV_SCALE is the shift announced for our receive window (0..14), it
+ * limits the largest receive window to (0xffff << TCP_RCV_SCALE).
+ */
+#ifndef LWIP_WND_SCALE
+#define LWIP_WND_SCALE                  0
+#define TCP_RCV_SCALE                   0
+#endif
+
+/**
+ * LWIP_TCP_SACK==1: support selective acknowledgements (RFC 2018).
+ * Out of sequence segments are reported to the remote host, and segments
+ * the remote host reports are skipped when recovering from losses.
+ */
+#ifndef LWIP_TCP_SACK
+#define LWIP_TCP_SACK                   0
+#endif
+
 /**
  * TCP_WND_UPDATE_THRESHOLD: difference in window to trigger an
  * explicit window update
  */
 #ifndef TCP_WND_UPDATE_THRESHOLD
-#define TCP_WND_UPDATE_THRESHOLD   (TCP_WND / 4)
+#define TCP_WND_UPDATE_THRESHOLD   LWIP_MIN((TCP_WND / 4), (TCP_MSS * 4))
 #endif
 
 /**
@@ -48,6 +48,25 @@ extern "C" {
 
 struct tcp_pcb;
 
+#if LWIP_WND_SCALE
+/** Window sizes (and the send buffer) need 32 bits once windows are scaled */
+typedef u32_t tcpwnd_size_t;
+#define TCPWNDSIZE_F   U32_F
+#define RCV_WND_SCALE(pcb, wnd) (((wnd) >> (pcb)->rcv_scale))
+#define SND_WND_SCALE(pcb, wnd) (((wnd) << (pcb)->snd_scale))
+/** Largest window that can be announced with TCP_RCV_SCALE */
+#define TCP_WND_LIMIT  ((tcpwnd_size_t)0xFFFF << TCP_RCV_SCALE)
+#else /* LWIP_WND_SCALE */
+typedef u16_t tcpwnd_size_t;
+#define TCPWNDSIZE_F   U16_F
+#define RCV_WND_SCALE(pcb, wnd) (wnd)
+#define SND_WND_SCALE(pcb, wnd) (wnd)
+#define TCP_WND_LIMIT  ((tcpwnd_size_t)0xFFFF)
+#endif /* LWIP_WND_SCALE */
+
+/** Limits a window (or a buffer size) to what fits into 16 bits */
+#define TCPWND16(x)    ((u16_t)LWIP_MIN((x), 0xFFFF))
+
 /** Function prototype for tcp accept callback functions. Called when a new
  * connection can be accepted on a listening pcb.
  *
@@ -174,7 +193,7 @@ struct tcp_pcb {
   /* ports are in host byte order */
   u16_t remote_port;
   
-  u8_t flags;
+  u16_t flags;
 #define TF_ACK_DELAY   ((u8_t)0x01U)   /* Delayed ACK. */
 #define TF_ACK_NOW     ((u8_t)0x02U)   /* Immediate ACK. */
 #define TF_INFR        ((u8_t)0x04U)   /* In fast recovery. */
@@ -183,6 +202,8 @@ struct tcp_pcb {
 #define TF_FIN         ((u8_t)0x20U)   /* Connection was closed locally (FIN segment enqueued). */
 #define TF_NODELAY     ((u8_t)0x40U)   /* Disable Nagle algorithm */
 #define TF_NAGLEMEMERR ((u8_t)0x80U)   /* nagle enabled, memerr, try to output to prevent delayed ACK to happen */
+#define TF_WND_SCALE   ((u16_t)0x0100U) /* Window scale option enabled */
+#define TF_SACK        ((u16_t)0x0200U) /* Selective acknowledgements enabled */
 
   /* the rest of the fields are in host byte order
      as we have to do some math with them */
@@ -194,9 +215,10 @@ struct tcp_pcb {
 
   /* receiver variables */
   u32_t rcv_nxt;   /* next seqno expected */
-  u16_t rcv_wnd;   /* receiver window available */
-  u16_t rcv_ann_wnd; /* receiver window to announce */
+  tcpwnd_size_t rcv_wnd;   /* receiver window available */
+  tcpwnd_size_t rcv_ann_wnd; /* receiver window to announce */
   u32_t rcv_ann_right_edge; /* announced right edge of window */
+  tcpwnd_size_t rcv_wnd_max; /* receiver window to open up to */
 
   /* Retransmission timer. */
   s16_t rtime;
@@ -216,20 +238,21 @@ struct tcp_pcb {
   u32_t lastack; /* Highest acknowledged seqno. */
 
   /* congestion avoidance/control variables */
-  u16_t cwnd;
-  u16_t ssthresh;
+  tcpwnd_size_t cwnd;
+  tcpwnd_size_t ssthresh;
 
   /* sender variables */
   u32_t snd_nxt;   /* next new seqno to be sent */
   u32_t snd_wl1, snd_wl2; /* Sequence and acknowledgement numbers of last
                              window update. */
   u32_t snd_lbb;       /* Sequence number of next byte to be buffered. */
-  u16_t snd_wnd;   /* sender window */
-  u16_t snd_wnd_max; /* the maximum sender window announced by the remote host */
+  tcpwnd_size_t snd_wnd;   /* sender window */
+  tcpwnd_size_t snd_wnd_max; /* the maximum sender window announced by the remote host */
 
-  u16_t acked;
+  tcpwnd_size_t acked;
 
-  u16_t snd_buf;   /* Available buffer space for sending (in bytes). */
+  tcpwnd_size_t snd_buf;   /* Available buffer space for sending (in bytes). */
+  tcpwnd_size_t snd_buf_max; /* Size of the send buffer (in bytes). */
 #define TCP_SNDQUEUELEN_OVERFLOW (0xffffU-3)
   u16_t snd_queuelen; /* Available buffer space for sending (in tcp_segs). */
 
@@ -265,6 +288,24 @@ struct tcp_pcb {
   u32_t ts_recent;
 #endif /* LWIP_TCP_TIMESTAMPS */
 
+#if LWIP_WND_SCALE
+  u8_t snd_scale;
+  u8_t rcv_scale;
+#endif /* LWIP_WND_SCALE */
+
+#if LWIP_TCP_SACK
+  /* snd_nxt when fast recovery was entered */
+  u32_t recover;
+  /* highest seqno SACKed by the remote host */
+  u32_t sack_high;
+  /* end of the last hole retransmitted during fast recovery */
+  u32_t rexmit_high;
+#if TCP_QUEUE_OOSEQ
+  /* seqno of the most recently received out of sequence segment */
+  u32_t ooseq_last;
+#endif /* TCP_QUEUE_OOSEQ */
+#endif /* LWIP_TCP_SACK */
+
   /* idle time before KEEPALIVE is sent */
   u32_t keep_idle;
 #if LWIP_TCP_KEEPALIVE
@@ -323,7 +364,7 @@ void             tcp_poll    (struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interv
 void             tcp_err     (struct tcp_pcb *pcb, tcp_err_fn err);
 
 #define          tcp_mss(pcb)             (((pcb)->flags & TF_TIMESTAMP) ? ((pcb)->mss - 12)  : (pcb)->mss)
-#define          tcp_sndbuf(pcb)          ((pcb)->snd_buf)
+#define          tcp_sndbuf(pcb)          (TCPWND16((pcb)->snd_buf))
 #define          tcp_sndqueuelen(pcb)     ((pcb)->snd_queuelen)
 #define          tcp_nagle_disable(pcb)   ((pcb)->flags |= TF_NODELAY)
 #define          tcp_nagle_enable(pcb)    ((pcb)->flags &= ~TF_NODELAY)
@@ -339,6 +380,8 @@ void             tcp_err     (struct tcp_pcb *pcb, tcp_err_fn err);
 #endif /* TCP_LISTEN_BACKLOG */
 
 void             tcp_recved  (struct tcp_pcb *pcb, u16_t len);
+void             tcp_setrcvwnd(struct tcp_pcb *pcb, u32_t wnd);
+void             tcp_setsndbuf(struct tcp_pcb *pcb, u32_t size);
 err_t            tcp_bind    (struct tcp_pcb *pcb, ip_addr_t *ipaddr,
                               u16_t port);
 err_t            tcp_connect (struct tcp_pcb *pcb, ip_addr_t *ipaddr,
@@ -69,6 +69,9 @@ err_t            tcp_send_empty_ack(struct tcp_pcb *pcb);
 void             tcp_rexmit  (struct tcp_pcb *pcb);
 void             tcp_rexmit_rto  (struct tcp_pcb *pcb);
 void             tcp_rexmit_fast (struct tcp_pcb *pcb);
+#if LWIP_TCP_SACK
+u8_t             tcp_rexmit_sack (struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_SACK */
 u32_t            tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb);
 err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
 
@@ -292,12 +295,42 @@ struct tcp_seg {
 #define TF_SEG_OPTS_TS          (u8_t)0x02U /* Include timestamp option. */
 #define TF_SEG_DATA_CHECKSUMMED (u8_t)0x04U /* ALL data (not the header) is
                                                checksummed into 'chksum' */
+#define TF_SEG_OPTS_WND_SCALE   (u8_t)0x08U /* Include window scale option. */
+#define TF_SEG_OPTS_SACK_PERM   (u8_t)0x10U /* Include SACK permitted option. */
+#define TF_SEG_SACKED           (u8_t)0x20U /* Segment was SACKed by the
+                                               remote host */
   struct tcp_hdr *tcphdr;  /* the TCP header */
 };
 
 #define LWIP_TCP_OPT_LENGTH(flags)              \
   (flags & TF_SEG_OPTS_MSS ? 4  : 0) +          \
-  (flags & TF_SEG_OPTS_TS  ? 12 : 0)
+  (flags & TF_SEG_OPTS_TS  ? 12 : 0) +          \
+  (flags & TF_SEG_OPTS_WND_SCALE ? 4 : 0) +     \
+  (flags & TF_SEG_OPTS_SACK_PERM ? 4 : 0)
+
+/** Window scale shift announced in our SYN, RFC 7323 allows up to 14 */
+#if LWIP_WND_SCALE
+#define TCP_BUILD_WND_SCALE_OPTION() htonl(0x01030300 | TCP_RCV_SCALE)
+#endif /* LWIP_WND_SCALE */
+
+/** SACK permitted option, padded with two NOPs */
+#define TCP_BUILD_SACK_PERM_OPTION() PP_HTONL(0x01010402)
+
+/** Most SACK blocks an ACK can carry (3 if the timestamp option is sent, too) */
+#define TCP_MAX_SACK_BLOCKS 4
+
+/** Receive window the pcb may open up to. Without the window scale option,
+ * only 16 bits of it can be announced. */
+#if LWIP_WND_SCALE
+#define TCP_WND_MAX(pcb) ((tcpwnd_size_t)(((pcb)->flags & TF_WND_SCALE) ? \
+                           (pcb)->rcv_wnd_max : TCPWND16((pcb)->rcv_wnd_max)))
+#else /* LWIP_WND_SCALE */
+#define TCP_WND_MAX(pcb) ((pcb)->rcv_wnd_max)
+#endif /* LWIP_WND_SCALE */
+
+/** RFC 5681 lets ssthresh start arbitrarily high: use the largest window
+ * the remote host can announce. */
+#define TCP_INITIAL_SSTHRESH(pcb) ((tcpwnd_size_t)SND_WND_SCALE(pcb, 0xFFFF))
 
 /** This returns a TCP header option for MSS in an u32_t */
 #define TCP_BUILD_MSS_OPTION(mss) htonl(0x02040000 | ((mss) & 0xFFFF))
@@ -8,6 +8,9 @@
 #define MEM_LIBC_MALLOC                 1
 #define MEMP_MEM_MALLOC                 1
 
+/* rosmem.c keeps a pool for each memp type */
+#define MEMP_ARCH_MALLOC                1
+
 /* Define LWIP_COMPAT_MUTEX if the port has no mutexes and binary semaphores
  should be used instead */
 #define LWIP_COMPAT_MUTEX               1
@@ -64,10 +67,20 @@
  * add support for other transport mediums */
 #define TCP_MSS                         1460
 
-#define TCP_WND                         0xFFFF
+/* Windows past 64 KB need the window scale option. A shift of 7 lets
+ * SO_RCVBUF open the window up to 8 MB */
+#define LWIP_WND_SCALE                  1
+
+#define TCP_RCV_SCALE                   7
+
+#define LWIP_TCP_SACK                   1
+
+#define TCP_WND                         0x40000
 
 #define TCP_SND_BUF                     TCP_WND
 
+#define TCP_SND_BUF_MAX                 (8 * 1024 * 1024)
+
 #define TCP_MAXRTX                      8
 
 #define TCP_SYNMAXRTX                   4
@@ -78,6 +91,10 @@
 
 #define LWIP_CALLBACK_API               1
 
+/* Lets rostcp make raw API calls in the calling thread while the tcpip
+ * thread is idle instead of queueing them to it */
+#define LWIP_TCPIP_CORE_LOCKING         1
+
 #define LWIP_NETIF_API                  1
 
 #define LWIP_SOCKET                     0
@@ -44,6 +44,7 @@ struct lwip_callback_msg
             PCONNECTION_ENDPOINT Connection;
             void *Data;
             u16_t DataLength;
+            int More;
         } Send;
         struct {
             PCONNECTION_ENDPOINT Connection;
@@ -59,6 +60,11 @@ struct lwip_callback_msg
             PCONNECTION_ENDPOINT Connection;
             int Callback;
         } Close;
+        struct {
+            PCONNECTION_ENDPOINT Connection;
+            u32_t ReceiveWindow;
+            u32_t SendBuffer;
+        } Window;
     } Input;
     
     /* Output */
@@ -85,6 +91,9 @@ struct lwip_callback_msg
         struct {
             err_t Error;
         } Close;
+        struct {
+            err_t Error;
+        } Window;
     } Output;
 };
 
@@ -101,10 +110,12 @@ extern void TCPRecvEventHandler(void *arg);
 PTCP_PCB    LibTCPSocket(void *arg);
 err_t       LibTCPBind(PCONNECTION_ENDPOINT Connection, struct ip_addr *const ipaddr, const u16_t port);
 PTCP_PCB    LibTCPListen(PCONNECTION_ENDPOINT Connection, const u8_t backlog);
-err_t       LibTCPSend(PCONNECTION_ENDPOINT Connection, void *const dataptr, const u16_t len, u32_t *sent, const int safe);
+err_t       LibTCPSend(PCONNECTION_ENDPOINT Connection, void *const dataptr, const u16_t len, u32_t *sent, const int safe, const int more);
+void        LibTCPOutput(PCONNECTION_ENDPOINT Connection);
 err_t       LibTCPConnect(PCONNECTION_ENDPOINT Connection, struct ip_addr *const ipaddr, const u16_t port);
 err_t       LibTCPShutdown(PCONNECTION_ENDPOINT Connection, const int shut_rx, const int shut_tx);
 err_t       LibTCPClose(PCONNECTION_ENDPOINT Connection, const int safe, const int callback);
+err_t       LibTCPSetWindow(PCONNECTION_ENDPOINT Connection, const u32_t rcvwnd, const u32_t sndbuf);
 
 err_t       LibTCPGetPeerName(PTCP_PCB pcb, struct ip_addr *const ipaddr, u16_t *const port);
 err_t       LibTCPGetHostName(PTCP_PCB pcb, struct ip_addr *const ipaddr, u16_t *const port);
@@ -2,15 +2,250 @@
 
 #include "lwip/def.h"
 #include "lwip/mem.h"
+#include "lwip/memp.h"
+#include "lwip/pbuf.h"
 
 #ifndef LWIP_TAG
     #define LWIP_TAG 'PIwl'
 #endif
 
+/* Every pbuf, segment and PCB is allocated here, mostly on the receive path, so we
+ * don't go to the nonpaged pool for each of them. Each memp type gets a pool of fixed
+ * size blocks, and malloc() hands out blocks of a few size classes, the largest of
+ * which holds a full sized packet with its pbuf. A pool is a lookaside list per
+ * processor, so an allocation is mostly a pop from a free list without contention.
+ * Blocks may be freed on another processor than the one they came from. The lists
+ * only hold plain pool allocations with our tag, which lets us free blocks straight
+ * to the pool before the pools exist or after they're gone */
+
+typedef struct _LWIP_MEM_POOL
+{
+    PNPAGED_LOOKASIDE_LIST Lists;
+    SIZE_T Size;
+    const char *Name;
+    LONG Failures;
+} LWIP_MEM_POOL, *PLWIP_MEM_POOL;
+
+/* Prepended to malloc() blocks so free() finds their size class */
+typedef union _LWIP_MEM_HEADER
+{
+    ULONG SizeClass;
+    ULONGLONG Alignment;
+} LWIP_MEM_HEADER, *PLWIP_MEM_HEADER;
+
+#define LWIP_MEM_NO_CLASS               ((ULONG)-1)
+
+/* Headers and segments without data, anything up to an MTU sized packet */
+#define LWIP_MEM_SMALL_SIZE             128
+#define LWIP_MEM_MEDIUM_SIZE            512
+#define LWIP_MEM_PACKET_SIZE            (LWIP_MEM_ALIGN_SIZE(sizeof(struct pbuf)) + \
+                                         PBUF_POOL_BUFSIZE + 40)
+
+static const char * const MempNames[MEMP_MAX] = {
+#define LWIP_MEMPOOL(name,num,size,desc) (desc),
+#include "lwip/memp_std.h"
+};
+
+static LWIP_MEM_POOL MempPools[MEMP_MAX];
+
+static LWIP_MEM_POOL SizeClasses[] = {
+    { NULL, sizeof(LWIP_MEM_HEADER) + LWIP_MEM_SMALL_SIZE, "MALLOC_SMALL", 0 },
+    { NULL, sizeof(LWIP_MEM_HEADER) + LWIP_MEM_MEDIUM_SIZE, "MALLOC_MEDIUM", 0 },
+    { NULL, sizeof(LWIP_MEM_HEADER) + LWIP_MEM_PACKET_SIZE, "MALLOC_PACKET", 0 }
+};
+
+static
+BOOLEAN
+PoolInitialize(PLWIP_MEM_POOL Pool)
+{
+    PNPAGED_LOOKASIDE_LIST Lists;
+    ULONG i;
+
+    Lists = ExAllocatePoolWithTag(NonPagedPool,
+                                  KeNumberProcessors * sizeof(NPAGED_LOOKASIDE_LIST),
+                                  LWIP_TAG);
+    if (!Lists)
+        return FALSE;
+
+    for (i = 0; i < (ULONG)KeNumberProcessors; i++)
+    {
+        ExInitializeNPagedLookasideList(&Lists[i],
+                                        NULL,
+                                        NULL,
+                                        0,
+                                        Pool->Size,
+                                        LWIP_TAG,
+                                        0);
+    }
+
+    Pool->Failures = 0;
+    Pool->Lists = Lists;
+
+    return TRUE;
+}
+
+static
+void
+PoolDelete(PLWIP_MEM_POOL Pool)
+{
+    PNPAGED_LOOKASIDE_LIST Lists = Pool->Lists;
+    ULONG i;
+
+    if (!Lists)
+        return;
+
+    Pool->Lists = NULL;
+
+    for (i = 0; i < (ULONG)KeNumberProcessors; i++)
+        ExDeleteNPagedLookasideList(&Lists[i]);
+
+    ExFreePoolWithTag(Lists, LWIP_TAG);
+}
+
+static
+void *
+PoolAllocate(PLWIP_MEM_POOL Pool)
+{
+    PNPAGED_LOOKASIDE_LIST Lists = Pool->Lists;
+    void *mem;
+
+    if (Lists)
+        mem = ExAllocateFromNPagedLookasideList(&Lists[KeGetCurrentProcessorNumber()]);
+    else
+        mem = ExAllocatePoolWithTag(NonPagedPool, Pool->Size, LWIP_TAG);
+
+    if (!mem)
+        InterlockedIncrement(&Pool->Failures);
+
+    return mem;
+}
+
+static
+void
+PoolFree(PLWIP_MEM_POOL Pool, void *mem)
+{
+    PNPAGED_LOOKASIDE_LIST Lists = Pool->Lists;
+
+    if (Lists)
+        ExFreeToNPagedLookasideList(&Lists[KeGetCurrentProcessorNumber()], mem);
+    else
+        ExFreePoolWithTag(mem, LWIP_TAG);
+}
+
+static
+void
+PoolDump(PLWIP_MEM_POOL Pool)
+{
+    ULONG Allocates = 0, Misses = 0, Frees = 0;
+    ULONG i;
+
+    if (!Pool->Lists)
+        return;
+
+    for (i = 0; i < (ULONG)KeNumberProcessors; i++)
+    {
+        Allocates += Pool->Lists[i].L.TotalAllocates;
+        Misses += Pool->Lists[i].L.AllocateMisses;
+        Frees += Pool->Lists[i].L.TotalFrees;
+    }
+
+    DbgPrint("\t%-16s %5lu bytes: %lu allocations, %lu from pool, %lu in use, %ld failed\n",
+             Pool->Name,
+             (ULONG)Pool->Size,
+             Allocates,
+             Misses,
+             Allocates - Frees,
+             Pool->Failures);
+}
+
+void
+memp_arch_init(void)
+{
+    ULONG i;
+
+    for (i = 0; i < MEMP_MAX; i++)
+    {
+        MempPools[i].Size = memp_sizes[i];
+        MempPools[i].Name = MempNames[i];
+        if (!PoolInitialize(&MempPools[i]))
+            DbgPrint("No pool for %s, using nonpaged pool\n", MempNames[i]);
+    }
+
+    for (i = 0; i < sizeof(SizeClasses) / sizeof(SizeClasses[0]); i++)
+    {
+        if (!PoolInitialize(&SizeClasses[i]))
+            DbgPrint("No pool for %s, using nonpaged pool\n", SizeClasses[i].Name);
+    }
+}
+
+void
+memp_arch_shutdown(void)
+{
+    ULONG i;
+
+    for (i = 0; i < MEMP_MAX; i++)
+        PoolDelete(&MempPools[i]);
+
+    for (i = 0; i < sizeof(SizeClasses) / sizeof(SizeClasses[0]); i++)
+        PoolDelete(&SizeClasses[i]);
+}
+
+void
+memp_arch_dump(void)
+{
+    ULONG i;
+
+    DbgPrint("lwIP memory pools:\n");
+
+    for (i = 0; i < MEMP_MAX; i++)
+        PoolDump(&MempPools[i]);
+
+    for (i = 0; i < sizeof(SizeClasses) / sizeof(SizeClasses[0]); i++)
+        PoolDump(&SizeClasses[i]);
+}
+
+void *
+memp_arch_malloc(memp_t type)
+{
+    /* The pool sizes are set up before lwIP allocates anything */
+    return PoolAllocate(&MempPools[type]);
+}
+
+void
+memp_arch_free(memp_t type, void *mem)
+{
+    PoolFree(&MempPools[type], mem);
+}
+
 void *
 malloc(mem_size_t size)
 {
-    return ExAllocatePoolWithTag(NonPagedPool, size, LWIP_TAG);
+    PLWIP_MEM_HEADER Header;
+    ULONG SizeClass;
+
+    for (SizeClass = 0; SizeClass < sizeof(SizeClasses) / sizeof(SizeClasses[0]); SizeClass++)
+    {
+        if (sizeof(LWIP_MEM_HEADER) + size <= SizeClasses[SizeClass].Size)
+            break;
+    }
+
+    if (SizeClass < sizeof(SizeClasses) / sizeof(SizeClasses[0]))
+    {
+        Header = PoolAllocate(&SizeClasses[SizeClass]);
+    }
+    else
+    {
+        /* Too large for any of them */
+        SizeClass = LWIP_MEM_NO_CLASS;
+        Header = ExAllocatePoolWithTag(NonPagedPool, sizeof(LWIP_MEM_HEADER) + size, LWIP_TAG);
+    }
+
+    if (!Header)
+        return NULL;
+
+    Header->SizeClass = SizeClass;
+
+    return Header + 1;
 }
 
 void *
@@ -28,7 +263,12 @@ calloc(mem_size_t count, mem_size_t size)
 void
 free(void *mem)
 {
-    ExFreePoolWithTag(mem, LWIP_TAG);
+    PLWIP_MEM_HEADER Header = (PLWIP_MEM_HEADER)mem - 1;
+
+    if (Header->SizeClass == LWIP_MEM_NO_CLASS)
+        ExFreePoolWithTag(Header, LWIP_TAG);
+    else
+        PoolFree(&SizeClasses[Header->SizeClass], Header);
 }
 
 /* This is only used to trim in lwIP */
@@ -28,6 +28,13 @@ static const char * const tcp_state_str[] = {
  * a lot of unnecessary thread swapping and it could definitely be faster, but I don't want
  * to going messing around in lwIP because I have no desire to create another mess like oskittcp */
 
+/* With LWIP_TCPIP_CORE_LOCKING the tcpip thread only holds the core lock while it works
+ * on a message or a timer. When the lock is free, the callbacks that never call back into
+ * our event handlers run right away in the calling thread and skip the round trip. We
+ * never wait for the lock: callers often hold a connection lock which the tcpip thread
+ * takes in our event handlers, and waiting on lwIP's semaphores outside of its threads
+ * is not safe at shutdown */
+
 extern KEVENT TerminationEvent;
 extern NPAGED_LOOKASIDE_LIST MessageLookasideList;
 extern NPAGED_LOOKASIDE_LIST QueueEntryLookasideList;
@@ -50,6 +57,40 @@ LibTCPDumpPcb(PVOID SocketContext)
     pcb->remote_port);
 }
 
+static
+BOOLEAN
+LibTCPTryDirectCall(tcpip_callback_fn function, void *arg)
+{
+#if LWIP_TCPIP_CORE_LOCKING
+    if (sys_arch_sem_trywait(&lock_tcpip_core) != SYS_ARCH_TIMEOUT)
+    {
+        function(arg);
+        UNLOCK_TCPIP_CORE();
+
+        return TRUE;
+    }
+#endif
+
+    return FALSE;
+}
+
+static
+void
+LibTCPCall(tcpip_callback_fn function, void *arg)
+{
+    if (!LibTCPTryDirectCall(function, arg))
+        tcpip_callback_with_block(function, arg, 1);
+}
+
+static
+void
+LibTCPFreePacket(struct pbuf *p)
+{
+    /* Free it right away if we can get into the core */
+    if (!LibTCPTryDirectCall((tcpip_callback_fn)pbuf_free, p))
+        pbuf_free_callback(p);
+}
+
 static
 void
 LibTCPEmptyQueue(PCONNECTION_ENDPOINT Connection)
@@ -146,8 +187,8 @@ NTSTATUS LibTCPGetDataFromConnectionQueue(PCONNECTION_ENDPOINT Connection, PUCHA
 
             if (qp != NULL)
             {
-                /* Use this special pbuf free callback function because we're outside tcpip thread */
-                pbuf_free_callback(qp->p);
+                /* We're outside tcpip thread */
+                LibTCPFreePacket(qp->p);
 
                 ExFreeToNPagedLookasideList(&QueueEntryLookasideList, qp);
             }
@@ -349,7 +390,7 @@ LibTCPSocket(void *arg)
         KeInitializeEvent(&msg->Event, NotificationEvent, FALSE);
         msg->Input.Socket.Arg = arg;
 
-        tcpip_callback_with_block(LibTCPSocketCallback, msg, 1);
+        LibTCPCall(LibTCPSocketCallback, msg);
 
         if (WaitForEventSafely(&msg->Event))
             ret = msg->Output.Socket.NewPcb;
@@ -404,7 +445,7 @@ LibTCPBind(PCONNECTION_ENDPOINT Connection, struct ip_addr *const ipaddr, const
         msg->Input.Bind.IpAddress = ipaddr;
         msg->Input.Bind.Port = port;
 
-        tcpip_callback_with_block(LibTCPBindCallback, msg, 1);
+        LibTCPCall(LibTCPBindCallback, msg);
 
         if (WaitForEventSafely(&msg->Event))
             ret = msg->Output.Bind.Error;
@@ -457,7 +498,7 @@ LibTCPListen(PCONNECTION_ENDPOINT Connection, const u8_t backlog)
         msg->Input.Listen.Connection = Connection;
         msg->Input.Listen.Backlog = backlog;
 
-        tcpip_callback_with_block(LibTCPListenCallback, msg, 1);
+        LibTCPCall(LibTCPListenCallback, msg);
 
         if (WaitForEventSafely(&msg->Event))
             ret = msg->Output.Listen.NewPcb;
@@ -496,6 +537,12 @@ LibTCPSendCallback(void *arg)
     }
 
     SendFlags = TCP_WRITE_FLAG_COPY;
+    if (msg->Input.Send.More)
+    {
+        /* The next write follows right away so let it fill our segments */
+        SendFlags |= TCP_WRITE_FLAG_MORE;
+    }
+
     SendLength = msg->Input.Send.DataLength;
     if (tcp_sndbuf(pcb) == 0)
     {
@@ -518,8 +565,9 @@ LibTCPSendCallback(void *arg)
                                        SendFlags);
     if (msg->Output.Send.Error == ERR_OK)
     {
-        /* Queued successfully so try to send it */
-        tcp_output((PTCP_PCB)msg->Input.Send.Connection->SocketContext);
+        /* Queued successfully so try to send it, unless more is coming */
+        if (!msg->Input.Send.More)
+            tcp_output((PTCP_PCB)msg->Input.Send.Connection->SocketContext);
         msg->Output.Send.Information = SendLength;
     }
     else if (msg->Output.Send.Error == ERR_MEM)
@@ -533,7 +581,7 @@ done:
 }
 
 err_t
-LibTCPSend(PCONNECTION_ENDPOINT Connection, void *const dataptr, const u16_t len, u32_t *sent, const int safe)
+LibTCPSend(PCONNECTION_ENDPOINT Connection, void *const dataptr, const u16_t len, u32_t *sent, const int safe, const int more)
 {
     err_t ret;
     struct lwip_callback_msg *msg;
@@ -545,11 +593,12 @@ LibTCPSend(PCONNECTION_ENDPOINT Connection, void *const dataptr, const u16_t len
         msg->Input.Send.Connection = Connection;
         msg->Input.Send.Data = dataptr;
         msg->Input.Send.DataLength = len;
+        msg->Input.Send.More = more;
 
         if (safe)
             LibTCPSendCallback(msg);
         else
-            tcpip_callback_with_block(LibTCPSendCallback, msg, 1);
+            LibTCPCall(LibTCPSendCallback, msg);
 
         if (WaitForEventSafely(&msg->Event))
             ret = msg->Output.Send.Error;
@@ -569,6 +618,14 @@ LibTCPSend(PCONNECTION_ENDPOINT Connection, void *const dataptr, const u16_t len
     return ERR_MEM;
 }
 
+void
+LibTCPOutput(PCONNECTION_ENDPOINT Connection)
+{
+    /* Sends what the writes with the more flag left queued. Only called in tcpip thread */
+    if (Connection->SocketContext)
+        tcp_output((PTCP_PCB)Connection->SocketContext);
+}
+
 static
 void
 LibTCPConnectCallback(void *arg)
@@ -611,7 +668,7 @@ LibTCPConnect(PCONNECTION_ENDPOINT Connection, struct ip_addr *const ipaddr, con
         msg->Input.Connect.IpAddress = ipaddr;
         msg->Input.Connect.Port = port;
 
-        tcpip_callback_with_block(LibTCPConnectCallback, msg, 1);
+        LibTCPCall(LibTCPConnectCallback, msg);
 
         if (WaitForEventSafely(&msg->Event))
         {
@@ -805,6 +862,65 @@ LibTCPClose(PCONNECTION_ENDPOINT Connection, const int safe, const int callback)
     return ERR_MEM;
 }
 
+static
+void
+LibTCPSetWindowCallback(void *arg)
+{
+    struct lwip_callback_msg *msg = arg;
+    PTCP_PCB pcb;
+
+    ASSERT(msg);
+
+    pcb = msg->Input.Window.Connection->SocketContext;
+    if (!pcb)
+    {
+        msg->Output.Window.Error = ERR_CLSD;
+        goto done;
+    }
+
+    /* A size of 0 leaves that side alone. lwIP clamps both to what it
+     * supports: the window can only grow past 64 KB with window scaling */
+    if (msg->Input.Window.ReceiveWindow)
+        tcp_setrcvwnd(pcb, msg->Input.Window.ReceiveWindow);
+
+    if (msg->Input.Window.SendBuffer)
+        tcp_setsndbuf(pcb, msg->Input.Window.SendBuffer);
+
+    msg->Output.Window.Error = ERR_OK;
+
+done:
+    KeSetEvent(&msg->Event, IO_NO_INCREMENT, FALSE);
+}
+
+err_t
+LibTCPSetWindow(PCONNECTION_ENDPOINT Connection, const u32_t rcvwnd, const u32_t sndbuf)
+{
+    struct lwip_callback_msg *msg;
+    err_t ret;
+
+    msg = ExAllocateFromNPagedLookasideList(&MessageLookasideList);
+    if (msg)
+    {
+        KeInitializeEvent(&msg->Event, NotificationEvent, FALSE);
+        msg->Input.Window.Connection = Connection;
+        msg->Input.Window.ReceiveWindow = rcvwnd;
+        msg->Input.Window.SendBuffer = sndbuf;
+
+        LibTCPCall(LibTCPSetWindowCallback, msg);
+
+        if (WaitForEventSafely(&msg->Event))
+            ret = msg->Output.Window.Error;
+        else
+            ret = ERR_CLSD;
+
+        ExFreeToNPagedLookasideList(&MessageLookasideList, msg);
+
+        return ret;
+    }
+
+    return ERR_MEM;
+}
+
 void
 LibTCPAccept(PTCP_PCB pcb, struct tcp_pcb *listen_pcb, void *arg)
 {
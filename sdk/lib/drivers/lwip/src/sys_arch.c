@@ -129,6 +129,27 @@ sys_arch_sem_wait(sys_sem_t* sem, u32_t timeout)
     return SYS_ARCH_TIMEOUT;
 }
 
+u32_t
+sys_arch_sem_trywait(sys_sem_t* sem)
+{
+    LARGE_INTEGER LargeTimeout;
+
+    /* A zero timeout never blocks, so this is fine at DISPATCH_LEVEL and
+     * does not terminate callers outside of our threads at shutdown */
+    LargeTimeout.QuadPart = 0;
+
+    if (KeWaitForSingleObject(&sem->Event,
+                              Executive,
+                              KernelMode,
+                              FALSE,
+                              &LargeTimeout) == STATUS_SUCCESS)
+    {
+        return 0;
+    }
+
+    return SYS_ARCH_TIMEOUT;
+}
+
 err_t
 sys_mbox_new(sys_mbox_t *mbox, int size)
 {    
@@ -361,4 +382,11 @@ sys_shutdown(void)
     
     ExDeleteNPagedLookasideList(&MessageLookasideList);
     ExDeleteNPagedLookasideList(&QueueEntryLookasideList);
+
+#if DBG
+    memp_arch_dump();
+#endif
+
+    /* Blocks still in use go back to the nonpaged pool once freed */
+    memp_arch_shutdown();
 }
@@ -40,20 +40,22 @@ tcp_remove_all(void)
 static struct pbuf*
 tcp_create_segment_wnd(ip_addr_t* src_ip, ip_addr_t* dst_ip,
                    u16_t src_port, u16_t dst_port, void* data, size_t data_len,
-                   u32_t seqno, u32_t ackno, u8_t headerflags, u16_t wnd)
+                   u32_t seqno, u32_t ackno, u8_t headerflags, u16_t wnd,
+                   u8_t* opts, u8_t optlen)
 {
   struct pbuf *p, *q;
   struct ip_hdr* iphdr;
   struct tcp_hdr* tcphdr;
-  u16_t pbuf_len = (u16_t)(sizeof(struct ip_hdr) + sizeof(struct tcp_hdr) + data_len);
+  u16_t hdr_len = (u16_t)(sizeof(struct tcp_hdr) + optlen);
+  u16_t pbuf_len = (u16_t)(sizeof(struct ip_hdr) + hdr_len + data_len);
 
   p = pbuf_alloc(PBUF_RAW, pbuf_len, PBUF_POOL);
   EXPECT_RETNULL(p != NULL);
   /* first pbuf must be big enough to hold the headers */
-  EXPECT_RETNULL(p->len >= (sizeof(struct ip_hdr) + sizeof(struct tcp_hdr)));
+  EXPECT_RETNULL(p->len >= (sizeof(struct ip_hdr) + hdr_len));
   if (data_len > 0) {
     /* first pbuf must be big enough to hold at least 1 data byte, too */
-    EXPECT_RETNULL(p->len > (sizeof(struct ip_hdr) + sizeof(struct tcp_hdr)));
+    EXPECT_RETNULL(p->len > (sizeof(struct ip_hdr) + hdr_len));
   }
 
   for(q = p; q != NULL; q = q->next) {
@@ -77,23 +79,28 @@ tcp_create_segment_wnd(ip_addr_t* src_ip, ip_addr_t* dst_ip,
   tcphdr->dest  = htons(dst_port);
   tcphdr->seqno = htonl(seqno);
   tcphdr->ackno = htonl(ackno);
-  TCPH_HDRLEN_SET(tcphdr, sizeof(struct tcp_hdr)/4);
+  TCPH_HDRLEN_SET(tcphdr, hdr_len/4);
   TCPH_FLAGS_SET(tcphdr, headerflags);
   tcphdr->wnd   = htons(wnd);
+  if (optlen > 0) {
+    /* options must be padded to a multiple of 4 bytes */
+    EXPECT_RETNULL((optlen & 3) == 0);
+    memcpy(tcphdr + 1, opts, optlen);
+  }
 
   if (data_len > 0) {
     /* let p point to TCP data */
-    pbuf_header(p, -(s16_t)sizeof(struct tcp_hdr));
+    pbuf_header(p, -(s16_t)hdr_len);
     /* copy data */
     pbuf_take(p, data, data_len);
     /* let p point to TCP header again */
-    pbuf_header(p, sizeof(struct tcp_hdr));
+    pbuf_header(p, hdr_len);
   }
 
   /* calculate checksum */
 
-  tcphdr->chksum = inet_chksum_pseudo(p,
-          IP_PROTO_TCP, p->tot_len, src_ip, dst_ip);
+  tcphdr->chksum = inet_chksum_pseudo(p, src_ip, dst_ip,
+          IP_PROTO_TCP, p->tot_len);
 
   pbuf_header(p, sizeof(struct ip_hdr));
 
@@ -107,7 +114,7 @@ tcp_create_segment(ip_addr_t* src_ip, ip_addr_t* dst_ip,
                    u32_t seqno, u32_t ackno, u8_t headerflags)
 {
   return tcp_create_segment_wnd(src_ip, dst_ip, src_port, dst_port, data,
-    data_len, seqno, ackno, headerflags, TCP_WND);
+    data_len, seqno, ackno, headerflags, TCPWND16(TCP_WND), NULL, 0);
 }
 
 /** Create a TCP segment usable for passing to tcp_input
@@ -131,7 +138,20 @@ struct pbuf* tcp_create_rx_segment_wnd(struct tcp_pcb* pcb, void* data, size_t d
                    u32_t seqno_offset, u32_t ackno_offset, u8_t headerflags, u16_t wnd)
 {
   return tcp_create_segment_wnd(&pcb->remote_ip, &pcb->local_ip, pcb->remote_port, pcb->local_port,
-    data, data_len, pcb->rcv_nxt + seqno_offset, pcb->lastack + ackno_offset, headerflags, wnd);
+    data, data_len, pcb->rcv_nxt + seqno_offset, pcb->lastack + ackno_offset, headerflags, wnd, NULL, 0);
+}
+
+/** Create a TCP segment usable for passing to tcp_input
+ * - IP-addresses, ports, seqno and ackno are taken from pcb
+ * - seqno and ackno can be altered with an offset
+ * - TCP options (padded to a multiple of 4 bytes) are added
+ */
+struct pbuf* tcp_create_rx_segment_opts(struct tcp_pcb* pcb, void* data, size_t data_len,
+                   u32_t seqno_offset, u32_t ackno_offset, u8_t headerflags, u8_t* opts, u8_t optlen)
+{
+  return tcp_create_segment_wnd(&pcb->remote_ip, &pcb->local_ip, pcb->remote_port, pcb->local_port,
+    data, data_len, pcb->rcv_nxt + seqno_offset, pcb->lastack + ackno_offset, headerflags,
+    TCPWND16(TCP_WND), opts, optlen);
 }
 
 /** Safely bring a tcp_pcb into the requested state */
@@ -239,18 +259,15 @@ void test_tcp_input(struct pbuf *p, struct netif *inp)
 {
   struct ip_hdr *iphdr = (struct ip_hdr*)p->payload;
   /* these lines are a hack, don't use them as an example :-) */
-  ip_addr_copy(*ipX_current_dest_addr(), iphdr->dest);
-  ip_addr_copy(*ipX_current_src_addr(), iphdr->src);
+  ip_addr_copy(*ip_current_dest_addr(), iphdr->dest);
+  ip_addr_copy(*ip_current_src_addr(), iphdr->src);
   ip_current_netif() = inp;
   ip_current_header() = iphdr;
 
-  /* since adding IPv6, p->payload must point to tcp header, not ip header */
-  pbuf_header(p, -(s16_t)sizeof(struct ip_hdr));
-
   tcp_input(p, inp);
 
-  ipX_current_dest_addr()->addr = 0;
-  ipX_current_src_addr()->addr = 0;
+  ip_current_dest_addr()->addr = 0;
+  ip_current_src_addr()->addr = 0;
   ip_current_netif() = NULL;
   ip_current_header() = NULL;
 }
@@ -654,6 +654,206 @@ START_TEST(test_tcp_tx_full_window_lost_from_unacked)
 }
 END_TEST
 
+/** Check that the window is scaled in both directions once the window
+ * scale option has been negotiated */
+START_TEST(test_tcp_wnd_scale)
+{
+#if LWIP_WND_SCALE
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct pbuf* p;
+  struct tcp_hdr* tcphdr;
+  char data[] = {1, 2, 3, 4};
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  LWIP_UNUSED_ARG(_i);
+
+  /* initialize local vars */
+  IP4_ADDR(&local_ip,  192, 168,   1, 1);
+  IP4_ADDR(&remote_ip, 192, 168,   1, 2);
+  IP4_ADDR(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  /* create and initialize the pcb */
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  /* pretend the option was exchanged in the SYNs */
+  pcb->flags |= TF_WND_SCALE;
+  pcb->snd_scale = 2;
+  pcb->rcv_scale = TCP_RCV_SCALE;
+  pcb->rcv_wnd = pcb->rcv_ann_wnd = TCP_WND_MAX(pcb);
+
+  /* the window of an incoming segment is shifted by snd_scale */
+  p = tcp_create_rx_segment_wnd(pcb, NULL, 0, 0, 0, TCP_ACK, 0x2000);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->snd_wnd == 0x8000);
+
+  /* the window we announce is shifted by rcv_scale */
+  txcounters.copy_tx_packets = 1;
+  p = tcp_create_rx_segment(pcb, data, sizeof(data), 0, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(counters.recved_bytes == sizeof(data));
+  tcp_fasttmr();
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT_RET(txcounters.tx_packets != NULL);
+  tcphdr = (struct tcp_hdr*)((u8_t*)txcounters.tx_packets->payload + IP_HLEN);
+  EXPECT(ntohl(tcphdr->ackno) == pcb->rcv_nxt);
+  EXPECT(ntohs(tcphdr->wnd) == TCPWND16(pcb->rcv_ann_wnd >> TCP_RCV_SCALE));
+  pbuf_free(txcounters.tx_packets);
+  txcounters.tx_packets = NULL;
+
+  /* make sure the pcb is freed */
+  EXPECT_RET(lwip_stats.memp[MEMP_TCP_PCB].used == 1);
+  tcp_abort(pcb);
+  EXPECT_RET(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+#else /* LWIP_WND_SCALE */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_WND_SCALE */
+}
+END_TEST
+
+#if LWIP_TCP_SACK
+/** Build a SACK option from pairs of left and right edges */
+static u8_t
+test_tcp_build_sack(u8_t *opts, u32_t *edges, u8_t num)
+{
+  u8_t i, len = 0;
+  opts[len++] = 1;
+  opts[len++] = 1;
+  opts[len++] = 5;
+  opts[len++] = (u8_t)(2 + 8 * num);
+  for (i = 0; i < 2 * num; i++) {
+    opts[len++] = (u8_t)(edges[i] >> 24);
+    opts[len++] = (u8_t)(edges[i] >> 16);
+    opts[len++] = (u8_t)(edges[i] >> 8);
+    opts[len++] = (u8_t)edges[i];
+  }
+  return len;
+}
+#endif /* LWIP_TCP_SACK */
+
+/** Lose two segments out of five: the first one is recovered by fast
+ * retransmit, the second one by the SACK blocks on the partial ACK. */
+START_TEST(test_tcp_sack_rexmit)
+{
+#if LWIP_TCP_SACK
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct pbuf* p;
+  struct tcp_hdr* tcphdr;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  u8_t opts[40], optlen;
+  u32_t edges[4], iss;
+  err_t err;
+  u16_t i;
+  LWIP_UNUSED_ARG(_i);
+
+  for (i = 0; i < sizeof(tx_data); i++) {
+    tx_data[i] = (u8_t)i;
+  }
+
+  /* initialize local vars */
+  IP4_ADDR(&local_ip,  192, 168,   1, 1);
+  IP4_ADDR(&remote_ip, 192, 168,   1, 2);
+  IP4_ADDR(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  /* create and initialize the pcb */
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  pcb->mss = TCP_MSS;
+  pcb->flags |= TF_SACK;
+  /* disable initial congestion window (we don't send a SYN here...) */
+  pcb->cwnd = pcb->snd_wnd;
+  iss = pcb->lastack;
+
+  /* send 5 mss-sized segments */
+  for (i = 0; i < 5; i++) {
+    err = tcp_write(pcb, &tx_data[i * TCP_MSS], TCP_MSS, TCP_WRITE_FLAG_COPY);
+    EXPECT_RET(err == ERR_OK);
+  }
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT(txcounters.num_tx_calls == 5);
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  /* segments 1 and 3 are lost, 3 dupacks report the others */
+  edges[0] = iss + 1 * TCP_MSS;
+  edges[1] = iss + 2 * TCP_MSS;
+  optlen = test_tcp_build_sack(opts, edges, 1);
+  p = tcp_create_rx_segment_opts(pcb, NULL, 0, 0, 0, TCP_ACK, opts, optlen);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->dupacks == 1);
+  edges[0] = iss + 3 * TCP_MSS;
+  edges[1] = iss + 4 * TCP_MSS;
+  edges[2] = iss + 1 * TCP_MSS;
+  edges[3] = iss + 2 * TCP_MSS;
+  optlen = test_tcp_build_sack(opts, edges, 2);
+  p = tcp_create_rx_segment_opts(pcb, NULL, 0, 0, 0, TCP_ACK, opts, optlen);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->dupacks == 2);
+  EXPECT(txcounters.num_tx_calls == 0);
+  edges[1] = iss + 5 * TCP_MSS;
+  optlen = test_tcp_build_sack(opts, edges, 2);
+  p = tcp_create_rx_segment_opts(pcb, NULL, 0, 0, 0, TCP_ACK, opts, optlen);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->dupacks == 3);
+  EXPECT(pcb->sack_high == iss + 5 * TCP_MSS);
+  EXPECT((pcb->flags & TF_INFR) != 0);
+  /* fast retransmit of segment 1 */
+  EXPECT(txcounters.num_tx_calls == 1);
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  /* partial ACK up to segment 3 retransmits it right away */
+  txcounters.copy_tx_packets = 1;
+  edges[0] = iss + 3 * TCP_MSS;
+  edges[1] = iss + 5 * TCP_MSS;
+  optlen = test_tcp_build_sack(opts, edges, 1);
+  p = tcp_create_rx_segment_opts(pcb, NULL, 0, 0, 2 * TCP_MSS, TCP_ACK, opts, optlen);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT((pcb->flags & TF_INFR) != 0);
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT_RET(txcounters.tx_packets != NULL);
+  tcphdr = (struct tcp_hdr*)((u8_t*)txcounters.tx_packets->payload + IP_HLEN);
+  EXPECT(ntohl(tcphdr->seqno) == iss + 2 * TCP_MSS);
+  pbuf_free(txcounters.tx_packets);
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  /* the full ACK ends the recovery */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, 3 * TCP_MSS, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT((pcb->flags & TF_INFR) == 0);
+  /* back to congestion avoidance from ssthresh */
+  EXPECT(pcb->cwnd >= pcb->ssthresh && pcb->cwnd < pcb->ssthresh + TCP_MSS);
+  EXPECT(pcb->unacked == NULL);
+  EXPECT(pcb->unsent == NULL);
+
+  /* make sure the pcb is freed */
+  EXPECT_RET(lwip_stats.memp[MEMP_TCP_PCB].used == 1);
+  tcp_abort(pcb);
+  EXPECT_RET(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+#else /* LWIP_TCP_SACK */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_SACK */
+}
+END_TEST
+
 /** Create the suite including all tests for this module */
 Suite *
 tcp_suite(void)
@@ -665,7 +865,9 @@ tcp_suite(void)
     test_tcp_fast_rexmit_wraparound,
     test_tcp_rto_rexmit_wraparound,
     test_tcp_tx_full_window_lost_from_unacked,
-    test_tcp_tx_full_window_lost_from_unsent
+    test_tcp_tx_full_window_lost_from_unsent,
+    test_tcp_wnd_scale,
+    test_tcp_sack_rexmit
   };
   return create_suite("TCP", tests, sizeof(tests)/sizeof(TFun), tcp_setup, tcp_teardown);
 }
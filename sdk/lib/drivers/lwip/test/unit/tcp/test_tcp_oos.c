@@ -927,6 +927,133 @@ FIN_TEST(test_tcp_recv_ooseq_double_FIN_14, 14)
 FIN_TEST(test_tcp_recv_ooseq_double_FIN_15, 15)
 
 
+#if LWIP_TCP_SACK
+/** Get the SACK blocks of the ACK sent last, and free it
+ *
+ * @param txcounters the counters the ACK was copied to
+ * @param edges left and right edges of the blocks
+ * @return number of blocks
+ */
+static int
+tcp_oos_get_sack(struct test_tcp_txcounters *txcounters, u32_t *edges)
+{
+  u8_t *opts;
+  int optlen, i, num = 0;
+  struct tcp_hdr *tcphdr;
+
+  EXPECT_RETX(txcounters->tx_packets != NULL, -1);
+  tcphdr = (struct tcp_hdr*)((u8_t*)txcounters->tx_packets->payload + IP_HLEN);
+  opts = (u8_t*)(tcphdr + 1);
+  optlen = TCPH_HDRLEN(tcphdr) * 4 - TCP_HLEN;
+  for (i = 0; i < optlen; ) {
+    if (opts[i] == 1) {
+      i++;
+    } else if (opts[i] == 5) {
+      for (num = 0; num < (opts[i + 1] - 2) / 4; num++) {
+        u8_t *b = &opts[i + 2 + 4 * num];
+        edges[num] = ((u32_t)b[0] << 24) | ((u32_t)b[1] << 16) | ((u32_t)b[2] << 8) | b[3];
+      }
+      num /= 2;
+      break;
+    } else {
+      i += opts[i + 1];
+    }
+  }
+  pbuf_free(txcounters->tx_packets);
+  txcounters->tx_packets = NULL;
+  txcounters->num_tx_calls = 0;
+  return num;
+}
+#endif /* LWIP_TCP_SACK */
+
+/** Receive segments out of sequence and check the SACK blocks of the
+ * ACKs sent for them: the most recent one first, merged if contiguous */
+START_TEST(test_tcp_recv_ooseq_sack)
+{
+#if LWIP_TCP_SACK
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct pbuf* p;
+  char data[40];
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  u32_t edges[2 * TCP_MAX_SACK_BLOCKS], isn;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  for(i = 0; i < (int)sizeof(data); i++) {
+    data[i] = (char)i;
+  }
+
+  /* initialize local vars */
+  IP4_ADDR(&local_ip,  192, 168,   1, 1);
+  IP4_ADDR(&remote_ip, 192, 168,   1, 2);
+  IP4_ADDR(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  txcounters.copy_tx_packets = 1;
+  /* initialize counter struct */
+  memset(&counters, 0, sizeof(counters));
+  counters.expected_data_len = sizeof(data);
+  counters.expected_data = data;
+
+  /* create and initialize the pcb */
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  pcb->flags |= TF_SACK;
+  isn = pcb->rcv_nxt;
+
+  /* bytes 10..19 */
+  p = tcp_create_rx_segment(pcb, &data[10], 10, 10, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(tcp_oos_get_sack(&txcounters, edges) == 1);
+  EXPECT(edges[0] == isn + 10 && edges[1] == isn + 20);
+
+  /* bytes 30..39: reported first */
+  p = tcp_create_rx_segment(pcb, &data[30], 10, 30, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(tcp_oos_get_sack(&txcounters, edges) == 2);
+  EXPECT(edges[0] == isn + 30 && edges[1] == isn + 40);
+  EXPECT(edges[2] == isn + 10 && edges[3] == isn + 20);
+
+  /* bytes 20..29 fill the gap between the two blocks */
+  p = tcp_create_rx_segment(pcb, &data[20], 10, 20, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(tcp_oos_get_sack(&txcounters, edges) == 1);
+  EXPECT(edges[0] == isn + 10 && edges[1] == isn + 40);
+  EXPECT(counters.recv_calls == 0);
+
+  /* bytes 0..9 deliver everything */
+  p = tcp_create_rx_segment(pcb, &data[0], 10, 0, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(counters.recved_bytes == sizeof(data));
+  EXPECT(pcb->ooseq == NULL);
+  EXPECT(pcb->rcv_nxt == isn + 40);
+  if (txcounters.tx_packets != NULL) {
+    /* no SACK once the queue is empty */
+    EXPECT(tcp_oos_get_sack(&txcounters, edges) == 0);
+  }
+
+  /* make sure the pcb is freed */
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 1);
+  tcp_abort(pcb);
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+#else /* LWIP_TCP_SACK */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_SACK */
+}
+END_TEST
+
+
 /** Create the suite including all tests for this module */
 Suite *
 tcp_oos_suite(void)
@@ -952,7 +1079,8 @@ tcp_oos_suite(void)
     test_tcp_recv_ooseq_double_FIN_12,
     test_tcp_recv_ooseq_double_FIN_13,
     test_tcp_recv_ooseq_double_FIN_14,
-    test_tcp_recv_ooseq_double_FIN_15
+    test_tcp_recv_ooseq_double_FIN_15,
+    test_tcp_recv_ooseq_sack
   };
   return create_suite("TCP_OOS", tests, sizeof(tests)/sizeof(TFun), tcp_oos_setup, tcp_oos_teardown);
 }
\ No newline at end of file
@@ -20,8 +20,68 @@
 #define COMPRESSION_FORMAT_MASK  0x00FF
 #define COMPRESSION_ENGINE_MASK  0xFF00
 
+/* Match finder shared by all compressors */
+#define LZ_MIN_MATCH             3
+#define LZ_HASH_BITS             12
+#define LZ_HASH_SIZE             (1 << LZ_HASH_BITS)
+#define LZ_MAX_CHAIN             128
+
+/* LZNT1 compresses independent chunks of 4KB */
+#define LZNT1_CHUNK_SIZE         0x1000
+
+/* XPRESS, the plain LZ77 variant of MS-XCA */
+#define XPRESS_WINDOW_SIZE       0x2000
+#define XPRESS_MAX_MATCH         0xFFFF
+
+/* XPRESS Huffman, the LZ77+Huffman variant of MS-XCA */
+#define XPRESS_HUFF_BLOCK_SIZE   0x10000
+#define XPRESS_HUFF_WINDOW_SIZE  0x10000
+#define XPRESS_HUFF_MAX_OFFSET   0xFFFF
+#define XPRESS_HUFF_MAX_MATCH    0x7FFF
+#define XPRESS_HUFF_SYMBOLS      512
+#define XPRESS_HUFF_EOF          256
+#define XPRESS_HUFF_TABLE_SIZE   (XPRESS_HUFF_SYMBOLS / 2)
+#define XPRESS_HUFF_MAX_CODE     15
+#define XPRESS_HUFF_FAST_BITS    9
+
+/* TYPES ********************************************************************/
+
+typedef struct _RTLP_LZ_MATCHER
+{
+    PULONG Head;
+    PULONG Prev;
+    ULONG WindowMask;
+    ULONG MaxChain;
+} RTLP_LZ_MATCHER, *PRTLP_LZ_MATCHER;
 
-
+typedef struct _RTLP_HUFF_WORKSPACE
+{
+    ULONG Frequencies[XPRESS_HUFF_SYMBOLS];
+    USHORT Codes[XPRESS_HUFF_SYMBOLS];
+    UCHAR Lengths[XPRESS_HUFF_SYMBOLS];
+    USHORT Leaves[XPRESS_HUFF_SYMBOLS];
+    USHORT Parents[2 * XPRESS_HUFF_SYMBOLS];
+    ULONG Weights[2 * XPRESS_HUFF_SYMBOLS];
+    ULONG Tokens[XPRESS_HUFF_BLOCK_SIZE];
+} RTLP_HUFF_WORKSPACE, *PRTLP_HUFF_WORKSPACE;
+
+typedef struct _RTLP_HUFF_DECODER
+{
+    USHORT Fast[1 << XPRESS_HUFF_FAST_BITS];
+    USHORT Symbols[XPRESS_HUFF_SYMBOLS];
+    ULONG First[XPRESS_HUFF_MAX_CODE + 1];
+    ULONG Count[XPRESS_HUFF_MAX_CODE + 1];
+    ULONG Index[XPRESS_HUFF_MAX_CODE + 1];
+} RTLP_HUFF_DECODER, *PRTLP_HUFF_DECODER;
+
+typedef struct _RTLP_BIT_WRITER
+{
+    PUCHAR Buffer;
+    ULONG Position;
+    ULONG Slot[2];
+    ULONG Bits;
+    ULONG Count;
+} RTLP_BIT_WRITER, *PRTLP_BIT_WRITER;
 
 /* FUNCTIONS ****************************************************************/
 
@@ -216,57 +276,1065 @@ out:
 }
 
 
+/* Compressed streams are little endian and not aligned */
+FORCEINLINE
+USHORT
+RtlpReadUshort(IN PUCHAR Buffer)
+{
+    return (USHORT)(Buffer[0] | (Buffer[1] << 8));
+}
+
+FORCEINLINE
+ULONG
+RtlpReadUlong(IN PUCHAR Buffer)
+{
+    return (ULONG)Buffer[0] | ((ULONG)Buffer[1] << 8) |
+           ((ULONG)Buffer[2] << 16) | ((ULONG)Buffer[3] << 24);
+}
+
+FORCEINLINE
+VOID
+RtlpWriteUshort(IN PUCHAR Buffer,
+                IN ULONG Value)
+{
+    Buffer[0] = (UCHAR)Value;
+    Buffer[1] = (UCHAR)(Value >> 8);
+}
+
+FORCEINLINE
+VOID
+RtlpWriteUlong(IN PUCHAR Buffer,
+               IN ULONG Value)
+{
+    Buffer[0] = (UCHAR)Value;
+    Buffer[1] = (UCHAR)(Value >> 8);
+    Buffer[2] = (UCHAR)(Value >> 16);
+    Buffer[3] = (UCHAR)(Value >> 24);
+}
+
+FORCEINLINE
+ULONG
+RtlpHighBit(IN ULONG Value)
+{
+    ULONG Bit = 0;
+
+    while (Value >>= 1)
+        Bit++;
+
+    return Bit;
+}
+
+FORCEINLINE
+ULONG
+RtlpLzHash(IN PUCHAR Data)
+{
+    ULONG Value = Data[0] | (Data[1] << 8) | (Data[2] << 16);
+
+    return (Value * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static ULONG
+RtlpLzWorkSpaceSize(IN USHORT Engine,
+                    IN ULONG WindowSize)
+{
+    ULONG Size = LZ_HASH_SIZE * sizeof(ULONG);
+
+    /* The maximum engine chains every position of the window */
+    if (Engine == COMPRESSION_ENGINE_MAXIMUM)
+        Size += WindowSize * sizeof(ULONG);
+
+    return Size;
+}
+
+/*
+ * The standard engine only looks at the most recent position with the same
+ * hash, the maximum engine follows the hash chain through the whole window.
+ * Returns the part of the workspace behind the match finder tables.
+ */
+static PUCHAR
+RtlpLzInitializeMatcher(OUT PRTLP_LZ_MATCHER Matcher,
+                        IN PVOID WorkSpace,
+                        IN USHORT Engine,
+                        IN ULONG WindowSize)
+{
+    Matcher->Head = WorkSpace;
+    RtlZeroMemory(Matcher->Head, LZ_HASH_SIZE * sizeof(ULONG));
+
+    if (Engine == COMPRESSION_ENGINE_MAXIMUM)
+    {
+        Matcher->Prev = Matcher->Head + LZ_HASH_SIZE;
+        Matcher->WindowMask = WindowSize - 1;
+        Matcher->MaxChain = LZ_MAX_CHAIN;
+        return (PUCHAR)(Matcher->Prev + WindowSize);
+    }
+
+    Matcher->Prev = NULL;
+    Matcher->WindowMask = 0;
+    Matcher->MaxChain = 1;
+    return (PUCHAR)(Matcher->Head + LZ_HASH_SIZE);
+}
+
+FORCEINLINE
+VOID
+RtlpLzInsert(IN PRTLP_LZ_MATCHER Matcher,
+             IN PUCHAR Buffer,
+             IN ULONG Position,
+             IN ULONG End)
+{
+    ULONG Hash;
+
+    if (End - Position < LZ_MIN_MATCH)
+        return;
+
+    /* Positions are stored biased by one, so that zero means empty */
+    Hash = RtlpLzHash(Buffer + Position);
+    if (Matcher->Prev)
+        Matcher->Prev[Position & Matcher->WindowMask] = Matcher->Head[Hash];
+    Matcher->Head[Hash] = Position + 1;
+}
+
+/*
+ * Finds the longest earlier match for the data at Position, not before
+ * Lowest nor further back than MaxOffset. Returns 0 if there is none.
+ */
+static ULONG
+RtlpLzFindMatch(IN PRTLP_LZ_MATCHER Matcher,
+                IN PUCHAR Buffer,
+                IN ULONG Position,
+                IN ULONG End,
+                IN ULONG Lowest,
+                IN ULONG MaxOffset,
+                IN ULONG MaxLength,
+                OUT PULONG Offset)
+{
+    PUCHAR Current = Buffer + Position;
+    PUCHAR Match;
+    ULONG Candidate, Next, Limit, Length, BestLength = 0, Chain;
+
+    MaxLength = min(MaxLength, End - Position);
+    if (MaxLength < LZ_MIN_MATCH)
+        return 0;
+
+    Limit = (Position - Lowest > MaxOffset) ? Position - MaxOffset : Lowest;
+    Candidate = Matcher->Head[RtlpLzHash(Current)];
+
+    for (Chain = Matcher->MaxChain; Chain && Candidate > Limit; Chain--)
+    {
+        Match = Buffer + Candidate - 1;
+        if (Match[BestLength] == Current[BestLength] &&
+            Match[0] == Current[0] &&
+            Match[1] == Current[1] &&
+            Match[2] == Current[2])
+        {
+            for (Length = LZ_MIN_MATCH; Length < MaxLength; Length++)
+            {
+                if (Match[Length] != Current[Length])
+                    break;
+            }
+
+            if (Length > BestLength)
+            {
+                BestLength = Length;
+                *Offset = Position - (Candidate - 1);
+                if (Length == MaxLength)
+                    break;
+            }
+        }
+
+        if (!Matcher->Prev)
+            break;
+
+        /* Chains only go backwards, anything else is a recycled slot */
+        Next = Matcher->Prev[(Candidate - 1) & Matcher->WindowMask];
+        if (Next >= Candidate)
+            break;
+        Candidate = Next;
+    }
+
+    return BestLength;
+}
+
+static VOID
+RtlpLzInsertRange(IN PRTLP_LZ_MATCHER Matcher,
+                  IN PUCHAR Buffer,
+                  IN ULONG Position,
+                  IN ULONG Length,
+                  IN ULONG End)
+{
+    while (Length--)
+        RtlpLzInsert(Matcher, Buffer, Position++, End);
+}
+
+/*
+ * Compresses one LZNT1 chunk into Output. Returns the size of the compressed
+ * data, or 0 if it would not be smaller than the chunk itself.
+ */
+static ULONG
+RtlpCompressChunkLZNT1(IN PRTLP_LZ_MATCHER Matcher,
+                       IN PUCHAR Buffer,
+                       IN ULONG Start,
+                       IN ULONG Size,
+                       OUT PUCHAR Output)
+{
+    PUCHAR Chunk = Buffer + Start;
+    ULONG Position = 0, OutPos = 0, FlagPos, Bit;
+    ULONG DisplacementBits, Length, Offset, Code;
+    UCHAR Flags;
+
+    while (Position < Size)
+    {
+        FlagPos = OutPos++;
+        Flags = 0;
+
+        for (Bit = 0; Bit < 8 && Position < Size; Bit++)
+        {
+            if (OutPos + sizeof(USHORT) >= Size)
+                return 0;
+
+            /* Offsets get more bits as the chunk fills, like the decoder expects */
+            for (DisplacementBits = 12; DisplacementBits > 4; DisplacementBits--)
+                if ((1U << (DisplacementBits - 1)) < Position) break;
+
+            Length = RtlpLzFindMatch(Matcher,
+                                     Buffer,
+                                     Start + Position,
+                                     Start + Size,
+                                     Start,
+                                     1 << DisplacementBits,
+                                     (1 << (16 - DisplacementBits)) + 2,
+                                     &Offset);
+            if (Length)
+            {
+                Code = ((Offset - 1) << (16 - DisplacementBits)) | (Length - 3);
+                RtlpWriteUshort(Output + OutPos, Code);
+                OutPos += sizeof(USHORT);
+                Flags |= 1 << Bit;
+
+                RtlpLzInsertRange(Matcher, Buffer, Start + Position, Length, Start + Size);
+                Position += Length;
+            }
+            else
+            {
+                RtlpLzInsert(Matcher, Buffer, Start + Position, Start + Size);
+                Output[OutPos++] = Chunk[Position++];
+            }
+        }
+
+        Output[FlagPos] = Flags;
+    }
+
+    return OutPos;
+}
+
+static NTSTATUS
+RtlpCompressBufferLZNT1(IN USHORT Engine,
+                        IN PUCHAR UncompressedBuffer,
+                        IN ULONG UncompressedBufferSize,
+                        OUT PUCHAR CompressedBuffer,
+                        IN ULONG CompressedBufferSize,
+                        OUT PULONG FinalCompressedSize,
+                        IN PVOID WorkSpace)
+{
+    RTLP_LZ_MATCHER Matcher;
+    PUCHAR Scratch, Data;
+    ULONG Position = 0, OutPos = 0, Size, Compressed, Header;
+
+    Scratch = RtlpLzInitializeMatcher(&Matcher, WorkSpace, Engine, LZNT1_CHUNK_SIZE);
+
+    while (Position < UncompressedBufferSize)
+    {
+        Size = min(LZNT1_CHUNK_SIZE, UncompressedBufferSize - Position);
+
+        /* Chunks that don't shrink are stored as they are */
+        Compressed = RtlpCompressChunkLZNT1(&Matcher, UncompressedBuffer, Position, Size, Scratch);
+        if (Compressed)
+        {
+            Header = 0xB000 | (Compressed - 1);
+            Data = Scratch;
+        }
+        else
+        {
+            Compressed = Size;
+            Header = 0x3000 | (Size - 1);
+            Data = UncompressedBuffer + Position;
+        }
+
+        if (CompressedBufferSize - OutPos < sizeof(USHORT) + Compressed)
+            return STATUS_BUFFER_TOO_SMALL;
+
+        RtlpWriteUshort(CompressedBuffer + OutPos, Header);
+        RtlCopyMemory(CompressedBuffer + OutPos + sizeof(USHORT), Data, Compressed);
+        OutPos += sizeof(USHORT) + Compressed;
+        Position += Size;
+    }
+
+    if (FinalCompressedSize)
+        *FinalCompressedSize = OutPos;
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Plain XPRESS: a 32-bit flag word, most significant bit first, precedes
+ * every 32 literals or matches. Match lengths of 10 and more spill into a
+ * shared half byte, then a byte, then a 16 or 32-bit count.
+ */
+static NTSTATUS
+RtlpCompressBufferXpress(IN USHORT Engine,
+                         IN PUCHAR UncompressedBuffer,
+                         IN ULONG UncompressedBufferSize,
+                         OUT PUCHAR CompressedBuffer,
+                         IN ULONG CompressedBufferSize,
+                         OUT PULONG FinalCompressedSize,
+                         IN PVOID WorkSpace)
+{
+    RTLP_LZ_MATCHER Matcher;
+    ULONG Position = 0, OutPos, FlagPos = 0, FlagCount = 0, Flags = 0;
+    ULONG HalfBytePos = 0, Length, MatchLength, Offset;
+
+    RtlpLzInitializeMatcher(&Matcher, WorkSpace, Engine, XPRESS_WINDOW_SIZE);
+
+    if (CompressedBufferSize < sizeof(ULONG))
+        return STATUS_BUFFER_TOO_SMALL;
+    OutPos = sizeof(ULONG);
+
+    while (Position < UncompressedBufferSize)
+    {
+        /* The longest match encoding plus a new flag word */
+        if (CompressedBufferSize - OutPos < 10)
+            return STATUS_BUFFER_TOO_SMALL;
+
+        MatchLength = RtlpLzFindMatch(&Matcher,
+                                      UncompressedBuffer,
+                                      Position,
+                                      UncompressedBufferSize,
+                                      0,
+                                      XPRESS_WINDOW_SIZE,
+                                      XPRESS_MAX_MATCH,
+                                      &Offset);
+        if (MatchLength)
+        {
+            Length = MatchLength - 3;
+            if (Length < 7)
+            {
+                RtlpWriteUshort(CompressedBuffer + OutPos, ((Offset - 1) << 3) | Length);
+                OutPos += sizeof(USHORT);
+            }
+            else
+            {
+                RtlpWriteUshort(CompressedBuffer + OutPos, ((Offset - 1) << 3) | 7);
+                OutPos += sizeof(USHORT);
+
+                Length -= 7;
+                if (!HalfBytePos)
+                {
+                    HalfBytePos = OutPos;
+                    CompressedBuffer[OutPos++] = (UCHAR)min(Length, 15);
+                }
+                else
+                {
+                    CompressedBuffer[HalfBytePos] |= (UCHAR)(min(Length, 15) << 4);
+                    HalfBytePos = 0;
+                }
+
+                if (Length >= 15)
+                {
+                    Length -= 15;
+                    if (Length < 255)
+                    {
+                        CompressedBuffer[OutPos++] = (UCHAR)Length;
+                    }
+                    else
+                    {
+                        CompressedBuffer[OutPos++] = 255;
+                        RtlpWriteUshort(CompressedBuffer + OutPos, MatchLength - 3);
+                        OutPos += sizeof(USHORT);
+                    }
+                }
+            }
+
+            Flags = (Flags << 1) | 1;
+            RtlpLzInsertRange(&Matcher, UncompressedBuffer, Position, MatchLength,
+                              UncompressedBufferSize);
+            Position += MatchLength;
+        }
+        else
+        {
+            RtlpLzInsert(&Matcher, UncompressedBuffer, Position, UncompressedBufferSize);
+            CompressedBuffer[OutPos++] = UncompressedBuffer[Position++];
+            Flags <<= 1;
+        }
+
+        if (++FlagCount == 32)
+        {
+            RtlpWriteUlong(CompressedBuffer + FlagPos, Flags);
+            FlagCount = 0;
+            FlagPos = OutPos;
+            OutPos += sizeof(ULONG);
+        }
+    }
+
+    /* Unused flags are set, the decoder stops at a match past the end */
+    if (FlagCount)
+        Flags = (Flags << (32 - FlagCount)) | ((1U << (32 - FlagCount)) - 1);
+    else
+        Flags = 0xFFFFFFFF;
+    RtlpWriteUlong(CompressedBuffer + FlagPos, Flags);
+
+    if (FinalCompressedSize)
+        *FinalCompressedSize = OutPos;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+RtlpDecompressBufferXpress(OUT PUCHAR UncompressedBuffer,
+                           IN ULONG UncompressedBufferSize,
+                           IN PUCHAR CompressedBuffer,
+                           IN ULONG CompressedBufferSize,
+                           OUT PULONG FinalUncompressedSize)
+{
+    ULONG InPos = 0, OutPos = 0, Flags = 0, FlagCount = 0;
+    ULONG HalfBytePos = 0, Code, Length, Offset;
+
+    while (OutPos < UncompressedBufferSize)
+    {
+        if (!FlagCount)
+        {
+            if (CompressedBufferSize - InPos < sizeof(ULONG))
+                break;
+            Flags = RtlpReadUlong(CompressedBuffer + InPos);
+            InPos += sizeof(ULONG);
+            FlagCount = 32;
+        }
+
+        FlagCount--;
+        if (!(Flags & (1U << FlagCount)))
+        {
+            if (InPos >= CompressedBufferSize)
+                break;
+            UncompressedBuffer[OutPos++] = CompressedBuffer[InPos++];
+            continue;
+        }
+
+        /* A match flag past the end of the input ends the stream */
+        if (InPos == CompressedBufferSize)
+            break;
+        if (CompressedBufferSize - InPos < sizeof(USHORT))
+            return STATUS_BAD_COMPRESSION_BUFFER;
+
+        Code = RtlpReadUshort(CompressedBuffer + InPos);
+        InPos += sizeof(USHORT);
+        Offset = (Code >> 3) + 1;
+        Length = Code & 7;
+
+        if (Length == 7)
+        {
+            if (!HalfBytePos)
+            {
+                if (InPos >= CompressedBufferSize)
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+                HalfBytePos = InPos;
+                Length = CompressedBuffer[InPos++] & 0xF;
+            }
+            else
+            {
+                Length = CompressedBuffer[HalfBytePos] >> 4;
+                HalfBytePos = 0;
+            }
+
+            if (Length == 15)
+            {
+                if (InPos >= CompressedBufferSize)
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+                Length = CompressedBuffer[InPos++];
+
+                if (Length == 255)
+                {
+                    if (CompressedBufferSize - InPos < sizeof(USHORT))
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    Length = RtlpReadUshort(CompressedBuffer + InPos);
+                    InPos += sizeof(USHORT);
+
+                    if (!Length)
+                    {
+                        if (CompressedBufferSize - InPos < sizeof(ULONG))
+                            return STATUS_BAD_COMPRESSION_BUFFER;
+                        Length = RtlpReadUlong(CompressedBuffer + InPos);
+                        InPos += sizeof(ULONG);
+                    }
+
+                    if (Length < 15 + 7)
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    Length -= 15 + 7;
+                }
+                Length += 15;
+            }
+            Length += 7;
+        }
+        Length += 3;
+
+        if (Offset > OutPos)
+            return STATUS_BAD_COMPRESSION_BUFFER;
+
+        /* Source and destination may overlap */
+        Length = min(Length, UncompressedBufferSize - OutPos);
+        while (Length--)
+        {
+            UncompressedBuffer[OutPos] = UncompressedBuffer[OutPos - Offset];
+            OutPos++;
+        }
+    }
+
+    if (FinalUncompressedSize)
+        *FinalUncompressedSize = OutPos;
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Builds length limited code lengths for the counted symbols. The two lightest
+ * nodes are merged from two queues, the sorted leaves and the merged nodes,
+ * which come out in order by themselves. Codes that get too long flatten the
+ * frequencies and start over.
+ */
+static VOID
+RtlpHuffBuildLengths(IN OUT PRTLP_HUFF_WORKSPACE Huff)
+{
+    ULONG Count, Symbol, Weight, Leaf, Node, Next, Pick, MaxLength, i, j;
+
+    /* A code needs at least two symbols */
+    for (Symbol = 0, Count = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+    {
+        if (Huff->Frequencies[Symbol])
+            Count++;
+    }
+    for (Symbol = 0; Count < 2; Symbol++)
+    {
+        if (!Huff->Frequencies[Symbol])
+        {
+            Huff->Frequencies[Symbol] = 1;
+            Count++;
+        }
+    }
+
+    for (;;)
+    {
+        Count = 0;
+        for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+        {
+            Weight = Huff->Frequencies[Symbol];
+            if (!Weight)
+                continue;
+
+            for (i = Count; i > 0 && Huff->Frequencies[Huff->Leaves[i - 1]] > Weight; i--)
+                Huff->Leaves[i] = Huff->Leaves[i - 1];
+            Huff->Leaves[i] = (USHORT)Symbol;
+            Count++;
+        }
+
+        for (i = 0; i < Count; i++)
+            Huff->Weights[i] = Huff->Frequencies[Huff->Leaves[i]];
+
+        Leaf = 0;
+        Node = Count;
+        for (Next = Count; Next < 2 * Count - 1; Next++)
+        {
+            for (j = 0; j < 2; j++)
+            {
+                if (Leaf < Count && (Node >= Next || Huff->Weights[Leaf] <= Huff->Weights[Node]))
+                    Pick = Leaf++;
+                else
+                    Pick = Node++;
+
+                Huff->Parents[Pick] = (USHORT)Next;
+                Huff->Weights[Next] = j ? Huff->Weights[Next] + Huff->Weights[Pick] : Huff->Weights[Pick];
+            }
+        }
+
+        /* Parents come after their children, so walk down from the root */
+        Huff->Weights[2 * Count - 2] = 0;
+        for (i = 2 * Count - 2; i-- > 0;)
+            Huff->Weights[i] = Huff->Weights[Huff->Parents[i]] + 1;
+
+        RtlZeroMemory(Huff->Lengths, sizeof(Huff->Lengths));
+        MaxLength = 0;
+        for (i = 0; i < Count; i++)
+        {
+            Huff->Lengths[Huff->Leaves[i]] = (UCHAR)Huff->Weights[i];
+            MaxLength = max(MaxLength, Huff->Weights[i]);
+        }
+
+        if (MaxLength <= XPRESS_HUFF_MAX_CODE)
+            break;
+
+        for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+        {
+            if (Huff->Frequencies[Symbol])
+                Huff->Frequencies[Symbol] = (Huff->Frequencies[Symbol] >> 1) | 1;
+        }
+    }
+}
+
+/* Canonical codes: shorter codes first, then by symbol */
+static VOID
+RtlpHuffBuildCodes(IN OUT PRTLP_HUFF_WORKSPACE Huff)
+{
+    ULONG Count[XPRESS_HUFF_MAX_CODE + 1] = { 0 };
+    ULONG Next[XPRESS_HUFF_MAX_CODE + 1];
+    ULONG Code = 0, Length, Symbol;
+
+    for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+        Count[Huff->Lengths[Symbol]]++;
+
+    for (Length = 1; Length <= XPRESS_HUFF_MAX_CODE; Length++)
+    {
+        Next[Length] = Code;
+        Code = (Code + Count[Length]) << 1;
+    }
+
+    for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+    {
+        Length = Huff->Lengths[Symbol];
+        if (Length)
+            Huff->Codes[Symbol] = (USHORT)Next[Length]++;
+    }
+}
+
+/*
+ * The bit stream is made of 16-bit words, and literal bytes are interleaved
+ * with it. Two words are always reserved ahead, which is exactly what the
+ * decoder holds in its bit buffer, so it finds the bytes where we put them.
+ */
+static VOID
+RtlpBitWriterStart(IN OUT PRTLP_BIT_WRITER Writer)
+{
+    Writer->Slot[0] = Writer->Position;
+    Writer->Slot[1] = Writer->Position + sizeof(USHORT);
+    Writer->Position += 2 * sizeof(USHORT);
+    Writer->Bits = 0;
+    Writer->Count = 0;
+}
+
+FORCEINLINE
+VOID
+RtlpWriteBits(IN OUT PRTLP_BIT_WRITER Writer,
+              IN ULONG Length,
+              IN ULONG Value)
+{
+    Writer->Bits = (Writer->Bits << Length) | Value;
+    Writer->Count += Length;
+
+    if (Writer->Count > 16)
+    {
+        Writer->Count -= 16;
+        RtlpWriteUshort(Writer->Buffer + Writer->Slot[0], Writer->Bits >> Writer->Count);
+        Writer->Slot[0] = Writer->Slot[1];
+        Writer->Slot[1] = Writer->Position;
+        Writer->Position += sizeof(USHORT);
+    }
+}
+
+static VOID
+RtlpBitWriterFinish(IN OUT PRTLP_BIT_WRITER Writer)
+{
+    RtlpWriteUshort(Writer->Buffer + Writer->Slot[0], Writer->Bits << (16 - Writer->Count));
+    RtlpWriteUshort(Writer->Buffer + Writer->Slot[1], 0);
+}
+
+/*
+ * XPRESS Huffman: blocks of 64KB, each with its own table of 4-bit code
+ * lengths for 256 literals and 256 match symbols. A match symbol holds the
+ * number of offset bits and up to 15 of the length, and the last block ends
+ * with symbol 256, which no real match here uses.
+ */
 static NTSTATUS
-RtlpCompressBufferLZNT1(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
-                        ULONG chunk_size, ULONG *final_size, UCHAR *workspace)
+RtlpCompressBufferXpressHuff(IN USHORT Engine,
+                             IN PUCHAR UncompressedBuffer,
+                             IN ULONG UncompressedBufferSize,
+                             OUT PUCHAR CompressedBuffer,
+                             IN ULONG CompressedBufferSize,
+                             OUT PULONG FinalCompressedSize,
+                             IN PVOID WorkSpace)
 {
-        UCHAR *src_cur = src, *src_end = src + src_size;
-        UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
-        ULONG block_size;
+    RTLP_LZ_MATCHER Matcher;
+    RTLP_BIT_WRITER Writer;
+    PRTLP_HUFF_WORKSPACE Huff;
+    ULONG Position = 0, BlockEnd, Tokens, Token, Length, Offset, OffsetBits, Symbol, i;
+    BOOLEAN LastBlock;
+
+    Huff = (PRTLP_HUFF_WORKSPACE)RtlpLzInitializeMatcher(&Matcher, WorkSpace, Engine,
+                                                         XPRESS_HUFF_WINDOW_SIZE);
+    Writer.Buffer = CompressedBuffer;
+    Writer.Position = 0;
+
+    do
+    {
+        if (UncompressedBufferSize - Position < XPRESS_HUFF_BLOCK_SIZE)
+        {
+            BlockEnd = UncompressedBufferSize;
+            LastBlock = TRUE;
+        }
+        else
+        {
+            BlockEnd = Position + XPRESS_HUFF_BLOCK_SIZE;
+            LastBlock = FALSE;
+        }
+
+        /* Parse the block first, the table depends on it */
+        RtlZeroMemory(Huff->Frequencies, sizeof(Huff->Frequencies));
+        Tokens = 0;
+        while (Position < BlockEnd)
+        {
+            Length = RtlpLzFindMatch(&Matcher,
+                                     UncompressedBuffer,
+                                     Position,
+                                     BlockEnd,
+                                     0,
+                                     XPRESS_HUFF_MAX_OFFSET,
+                                     XPRESS_HUFF_MAX_MATCH,
+                                     &Offset);
+            if (Length == LZ_MIN_MATCH && Offset == 1)
+                Length = 0;
+
+            if (Length)
+            {
+                Symbol = 256 + (RtlpHighBit(Offset) << 4) + min(Length - 3, 15);
+                Huff->Tokens[Tokens++] = 0x80000000 | (Length << 16) | Offset;
+                RtlpLzInsertRange(&Matcher, UncompressedBuffer, Position, Length,
+                                  UncompressedBufferSize);
+                Position += Length;
+            }
+            else
+            {
+                Symbol = UncompressedBuffer[Position];
+                Huff->Tokens[Tokens++] = Symbol;
+                RtlpLzInsert(&Matcher, UncompressedBuffer, Position, UncompressedBufferSize);
+                Position++;
+            }
+
+            Huff->Frequencies[Symbol]++;
+        }
+
+        if (LastBlock)
+            Huff->Frequencies[XPRESS_HUFF_EOF]++;
 
-        while (src_cur < src_end)
+        RtlpHuffBuildLengths(Huff);
+        RtlpHuffBuildCodes(Huff);
+
+        if (CompressedBufferSize - Writer.Position < XPRESS_HUFF_TABLE_SIZE + 4 * sizeof(USHORT))
+            return STATUS_BUFFER_TOO_SMALL;
+
+        for (i = 0; i < XPRESS_HUFF_TABLE_SIZE; i++)
         {
-            /* determine size of current chunk */
-            block_size = min(0x1000, src_end - src_cur);
-            if (dst_cur + sizeof(WORD) + block_size > dst_end)
+            CompressedBuffer[Writer.Position + i] =
+                Huff->Lengths[2 * i] | (Huff->Lengths[2 * i + 1] << 4);
+        }
+        Writer.Position += XPRESS_HUFF_TABLE_SIZE;
+        RtlpBitWriterStart(&Writer);
+
+        for (i = 0; i < Tokens; i++)
+        {
+            /* Two words of bits and up to three literal bytes */
+            if (CompressedBufferSize - Writer.Position < 4 * sizeof(USHORT))
                 return STATUS_BUFFER_TOO_SMALL;
 
-            /* write (uncompressed) chunk header */
-            *(WORD *)dst_cur = 0x3000 | (block_size - 1);
-            dst_cur += sizeof(WORD);
+            Token = Huff->Tokens[i];
+            if (!(Token & 0x80000000))
+            {
+                RtlpWriteBits(&Writer, Huff->Lengths[Token], Huff->Codes[Token]);
+                continue;
+            }
 
-            /* write chunk content */
-            memcpy(dst_cur, src_cur, block_size);
-            dst_cur += block_size;
-            src_cur += block_size;
+            Length = ((Token >> 16) & 0x7FFF) - 3;
+            Offset = Token & 0xFFFF;
+            OffsetBits = RtlpHighBit(Offset);
+            Symbol = 256 + (OffsetBits << 4) + min(Length, 15);
+            RtlpWriteBits(&Writer, Huff->Lengths[Symbol], Huff->Codes[Symbol]);
+
+            if (Length >= 15)
+            {
+                if (Length - 15 < 255)
+                {
+                    Writer.Buffer[Writer.Position++] = (UCHAR)(Length - 15);
+                }
+                else
+                {
+                    Writer.Buffer[Writer.Position++] = 255;
+                    RtlpWriteUshort(Writer.Buffer + Writer.Position, Length);
+                    Writer.Position += sizeof(USHORT);
+                }
+            }
+
+            RtlpWriteBits(&Writer, OffsetBits, Offset - (1 << OffsetBits));
         }
 
-        if (final_size)
-            *final_size = dst_cur - dst;
+        if (LastBlock)
+        {
+            if (CompressedBufferSize - Writer.Position < sizeof(USHORT))
+                return STATUS_BUFFER_TOO_SMALL;
+            RtlpWriteBits(&Writer, Huff->Lengths[XPRESS_HUFF_EOF], Huff->Codes[XPRESS_HUFF_EOF]);
+        }
+
+        RtlpBitWriterFinish(&Writer);
+    } while (!LastBlock);
+
+    if (FinalCompressedSize)
+        *FinalCompressedSize = Writer.Position;
+
+    return STATUS_SUCCESS;
+}
+
+static BOOLEAN
+RtlpHuffBuildDecoder(OUT PRTLP_HUFF_DECODER Decoder,
+                     IN PUCHAR Table)
+{
+    ULONG Next[XPRESS_HUFF_MAX_CODE + 1];
+    ULONG Length, Symbol, Code, Left, Index, Fill, i, j;
+
+    RtlZeroMemory(Decoder->Count, sizeof(Decoder->Count));
+    for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+        Decoder->Count[(Table[Symbol / 2] >> ((Symbol & 1) * 4)) & 0xF]++;
+    Decoder->Count[0] = 0;
+
+    /* Reject over-subscribed and empty codes */
+    Left = 1;
+    for (Length = 1; Length <= XPRESS_HUFF_MAX_CODE; Length++)
+    {
+        Left <<= 1;
+        if (Decoder->Count[Length] > Left)
+            return FALSE;
+        Left -= Decoder->Count[Length];
+    }
+    if (Left == (1 << XPRESS_HUFF_MAX_CODE))
+        return FALSE;
+
+    Code = 0;
+    Index = 0;
+    for (Length = 1; Length <= XPRESS_HUFF_MAX_CODE; Length++)
+    {
+        Decoder->First[Length] = Code;
+        Decoder->Index[Length] = Next[Length] = Index;
+        Index += Decoder->Count[Length];
+        Code = (Code + Decoder->Count[Length]) << 1;
+    }
+
+    for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+    {
+        Length = (Table[Symbol / 2] >> ((Symbol & 1) * 4)) & 0xF;
+        if (Length)
+            Decoder->Symbols[Next[Length]++] = (USHORT)Symbol;
+    }
+
+    /* Short codes are looked up directly, all entries starting with them */
+    RtlZeroMemory(Decoder->Fast, sizeof(Decoder->Fast));
+    for (Length = 1; Length <= XPRESS_HUFF_FAST_BITS; Length++)
+    {
+        Fill = 1 << (XPRESS_HUFF_FAST_BITS - Length);
+        for (i = 0; i < Decoder->Count[Length]; i++)
+        {
+            Code = (Decoder->First[Length] + i) << (XPRESS_HUFF_FAST_BITS - Length);
+            Symbol = Decoder->Symbols[Decoder->Index[Length] + i];
+            for (j = 0; j < Fill; j++)
+                Decoder->Fast[Code + j] = (USHORT)((Symbol << 4) | Length);
+        }
+    }
+
+    return TRUE;
+}
+
+FORCEINLINE
+ULONG
+RtlpHuffDecodeSymbol(IN PRTLP_HUFF_DECODER Decoder,
+                     IN ULONG NextBits,
+                     OUT PULONG Length)
+{
+    ULONG Entry, Code, Bits;
+
+    Entry = Decoder->Fast[NextBits >> (32 - XPRESS_HUFF_FAST_BITS)];
+    if (Entry)
+    {
+        *Length = Entry & 0xF;
+        return Entry >> 4;
+    }
+
+    for (Bits = XPRESS_HUFF_FAST_BITS + 1; Bits <= XPRESS_HUFF_MAX_CODE; Bits++)
+    {
+        Code = (NextBits >> (32 - Bits)) - Decoder->First[Bits];
+        if (Code < Decoder->Count[Bits])
+        {
+            *Length = Bits;
+            return Decoder->Symbols[Decoder->Index[Bits] + Code];
+        }
+    }
 
-        return STATUS_SUCCESS;
+    return XPRESS_HUFF_SYMBOLS;
 }
 
+/* Consumes bits, and reloads a word once the low one is used up */
+FORCEINLINE
+VOID
+RtlpHuffSkipBits(IN PUCHAR Buffer,
+                 IN ULONG BufferSize,
+                 IN OUT PULONG Position,
+                 IN OUT PULONG NextBits,
+                 IN OUT PLONG ExtraBits,
+                 IN ULONG Count)
+{
+    ULONG Word = 0;
+
+    *NextBits <<= Count;
+    *ExtraBits -= Count;
+    if (*ExtraBits < 0)
+    {
+        if (*Position + sizeof(USHORT) <= BufferSize)
+            Word = RtlpReadUshort(Buffer + *Position);
+        *NextBits |= Word << -*ExtraBits;
+        *Position += sizeof(USHORT);
+        *ExtraBits += 16;
+    }
+}
 
 static NTSTATUS
-RtlpWorkSpaceSizeLZNT1(USHORT Engine,
-                       PULONG BufferAndWorkSpaceSize,
-                       PULONG FragmentWorkSpaceSize)
+RtlpDecompressBufferXpressHuff(OUT PUCHAR UncompressedBuffer,
+                               IN ULONG UncompressedBufferSize,
+                               IN PUCHAR CompressedBuffer,
+                               IN ULONG CompressedBufferSize,
+                               OUT PULONG FinalUncompressedSize)
 {
-   if (Engine == COMPRESSION_ENGINE_STANDARD)
-   {
-      *BufferAndWorkSpaceSize = 0x8010;
-      *FragmentWorkSpaceSize = 0x1000;
-      return(STATUS_SUCCESS);
-   }
-   else if (Engine == COMPRESSION_ENGINE_MAXIMUM)
-   {
-      *BufferAndWorkSpaceSize = 0x10;
-      *FragmentWorkSpaceSize = 0x1000;
-      return(STATUS_SUCCESS);
-   }
+    RTLP_HUFF_DECODER Decoder;
+    ULONG InPos = 0, OutPos = 0, BlockEnd, NextBits, Symbol, Bits, Length, Offset;
+    LONG ExtraBits;
+
+    while (OutPos < UncompressedBufferSize)
+    {
+        if (InPos >= CompressedBufferSize ||
+            CompressedBufferSize - InPos < XPRESS_HUFF_TABLE_SIZE + 2 * sizeof(USHORT))
+        {
+            return STATUS_BAD_COMPRESSION_BUFFER;
+        }
+
+        if (!RtlpHuffBuildDecoder(&Decoder, CompressedBuffer + InPos))
+            return STATUS_BAD_COMPRESSION_BUFFER;
+        InPos += XPRESS_HUFF_TABLE_SIZE;
 
-   return(STATUS_NOT_SUPPORTED);
+        NextBits = ((ULONG)RtlpReadUshort(CompressedBuffer + InPos) << 16) |
+                   RtlpReadUshort(CompressedBuffer + InPos + sizeof(USHORT));
+        InPos += 2 * sizeof(USHORT);
+        ExtraBits = 16;
+
+        if (UncompressedBufferSize - OutPos > XPRESS_HUFF_BLOCK_SIZE)
+            BlockEnd = OutPos + XPRESS_HUFF_BLOCK_SIZE;
+        else
+            BlockEnd = UncompressedBufferSize;
+
+        while (OutPos < BlockEnd)
+        {
+            Symbol = RtlpHuffDecodeSymbol(&Decoder, NextBits, &Bits);
+            if (Symbol >= XPRESS_HUFF_SYMBOLS)
+                return STATUS_BAD_COMPRESSION_BUFFER;
+            RtlpHuffSkipBits(CompressedBuffer, CompressedBufferSize, &InPos, &NextBits, &ExtraBits, Bits);
+
+            if (Symbol < 256)
+            {
+                UncompressedBuffer[OutPos++] = (UCHAR)Symbol;
+                continue;
+            }
+
+            if (Symbol == XPRESS_HUFF_EOF && InPos >= CompressedBufferSize)
+                goto out;
+
+            Symbol -= 256;
+            Bits = Symbol >> 4;
+            Length = Symbol & 0xF;
+
+            if (Length == 15)
+            {
+                if (InPos >= CompressedBufferSize)
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+                Length = CompressedBuffer[InPos++];
+
+                if (Length == 255)
+                {
+                    if (InPos + sizeof(USHORT) > CompressedBufferSize)
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    Length = RtlpReadUshort(CompressedBuffer + InPos);
+                    InPos += sizeof(USHORT);
+
+                    if (Length < 15)
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    Length -= 15;
+                }
+                Length += 15;
+            }
+            Length += 3;
+
+            /* Zero offset bits stand for an offset of one */
+            Offset = (1 << Bits) + (Bits ? NextBits >> (32 - Bits) : 0);
+            RtlpHuffSkipBits(CompressedBuffer, CompressedBufferSize, &InPos, &NextBits, &ExtraBits, Bits);
+
+            if (Offset > OutPos)
+                return STATUS_BAD_COMPRESSION_BUFFER;
+
+            Length = min(Length, UncompressedBufferSize - OutPos);
+            while (Length--)
+            {
+                UncompressedBuffer[OutPos] = UncompressedBuffer[OutPos - Offset];
+                OutPos++;
+            }
+        }
+
+        if (InPos >= CompressedBufferSize)
+            break;
+    }
+
+out:
+    if (FinalUncompressedSize)
+        *FinalUncompressedSize = OutPos;
+
+    return STATUS_SUCCESS;
+}
+
+
+static NTSTATUS
+RtlpWorkSpaceSize(IN USHORT Format,
+                  IN USHORT Engine,
+                  OUT PULONG BufferAndWorkSpaceSize,
+                  OUT PULONG FragmentWorkSpaceSize)
+{
+    if (Format != COMPRESSION_FORMAT_LZNT1 &&
+        Format != COMPRESSION_FORMAT_XPRESS &&
+        Format != COMPRESSION_FORMAT_XPRESS_HUFF)
+    {
+        return STATUS_UNSUPPORTED_COMPRESSION;
+    }
+
+    if (Engine != COMPRESSION_ENGINE_STANDARD &&
+        Engine != COMPRESSION_ENGINE_MAXIMUM)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    switch (Format)
+    {
+        case COMPRESSION_FORMAT_LZNT1:
+            /* The chunk is compressed aside, in case it doesn't shrink */
+            *BufferAndWorkSpaceSize = RtlpLzWorkSpaceSize(Engine, LZNT1_CHUNK_SIZE) +
+                                      LZNT1_CHUNK_SIZE;
+            *FragmentWorkSpaceSize = LZNT1_CHUNK_SIZE;
+            return STATUS_SUCCESS;
+
+        case COMPRESSION_FORMAT_XPRESS:
+            *BufferAndWorkSpaceSize = RtlpLzWorkSpaceSize(Engine, XPRESS_WINDOW_SIZE);
+            *FragmentWorkSpaceSize = 0;
+            return STATUS_SUCCESS;
+
+        default:
+            *BufferAndWorkSpaceSize = RtlpLzWorkSpaceSize(Engine, XPRESS_HUFF_WINDOW_SIZE) +
+                                      sizeof(RTLP_HUFF_WORKSPACE);
+            *FragmentWorkSpaceSize = 0;
+            return STATUS_SUCCESS;
+    }
 }
 
 
@@ -284,27 +1352,62 @@ RtlCompressBuffer(IN USHORT CompressionFormatAndEngine,
                   IN PVOID WorkSpace)
 {
    USHORT Format = CompressionFormatAndEngine & COMPRESSION_FORMAT_MASK;
-   /* USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK; */
+   USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK;
 
    if ((Format == COMPRESSION_FORMAT_NONE) ||
          (Format == COMPRESSION_FORMAT_DEFAULT))
       return(STATUS_INVALID_PARAMETER);
 
-   if (Format == COMPRESSION_FORMAT_LZNT1)
-      return(RtlpCompressBufferLZNT1(UncompressedBuffer,
-                                     UncompressedBufferSize,
-                                     CompressedBuffer,
-                                     CompressedBufferSize,
-                                     UncompressedChunkSize,
-                                     FinalCompressedSize,
-                                     WorkSpace));
+   if ((Format != COMPRESSION_FORMAT_LZNT1) &&
+         (Format != COMPRESSION_FORMAT_XPRESS) &&
+         (Format != COMPRESSION_FORMAT_XPRESS_HUFF))
+      return(STATUS_UNSUPPORTED_COMPRESSION);
+
+   if ((Engine != COMPRESSION_ENGINE_STANDARD) &&
+         (Engine != COMPRESSION_ENGINE_MAXIMUM))
+      return(STATUS_NOT_SUPPORTED);
 
-   return(STATUS_UNSUPPORTED_COMPRESSION);
+   /* The match finder lives in the workspace */
+   if (!WorkSpace)
+      return(STATUS_INVALID_PARAMETER);
+
+   switch (Format)
+   {
+      case COMPRESSION_FORMAT_LZNT1:
+         return(RtlpCompressBufferLZNT1(Engine,
+                                        UncompressedBuffer,
+                                        UncompressedBufferSize,
+                                        CompressedBuffer,
+                                        CompressedBufferSize,
+                                        FinalCompressedSize,
+                                        WorkSpace));
+
+      case COMPRESSION_FORMAT_XPRESS:
+         return(RtlpCompressBufferXpress(Engine,
+                                         UncompressedBuffer,
+                                         UncompressedBufferSize,
+                                         CompressedBuffer,
+                                         CompressedBufferSize,
+                                         FinalCompressedSize,
+                                         WorkSpace));
+
+      default:
+         return(RtlpCompressBufferXpressHuff(Engine,
+                                             UncompressedBuffer,
+                                             UncompressedBufferSize,
+                                             CompressedBuffer,
+                                             CompressedBufferSize,
+                                             FinalCompressedSize,
+                                             WorkSpace));
+   }
 }
 
 
 /*
- * @unimplemented
+ * Compresses every chunk on its own, as file systems store them. All-zero
+ * chunks take no space, and chunks that don't shrink are stored as they are.
+ *
+ * @implemented
  */
 NTSTATUS NTAPI
 RtlCompressChunks(IN PUCHAR UncompressedBuffer,
@@ -315,12 +1418,77 @@ RtlCompressChunks(IN PUCHAR UncompressedBuffer,
                   IN ULONG CompressedDataInfoLength,
                   IN PVOID WorkSpace)
 {
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
+    PUCHAR Chunk;
+    ULONG ChunkSize, NumberOfChunks, Length, OutPos = 0, Room, FinalSize, i, j;
+    NTSTATUS Status;
+
+    if (CompressedDataInfo->ChunkShift < 9 || CompressedDataInfo->ChunkShift > 16)
+        return STATUS_INVALID_PARAMETER;
+
+    ChunkSize = 1 << CompressedDataInfo->ChunkShift;
+    NumberOfChunks = (UncompressedBufferSize + ChunkSize - 1) >> CompressedDataInfo->ChunkShift;
+    if (NumberOfChunks > MAXUSHORT)
+        return STATUS_INVALID_PARAMETER;
+
+    if (CompressedDataInfoLength < FIELD_OFFSET(COMPRESSED_DATA_INFO, CompressedChunkSizes) +
+                                   NumberOfChunks * sizeof(ULONG))
+    {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    for (i = 0; i < NumberOfChunks; i++)
+    {
+        Chunk = UncompressedBuffer + (i << CompressedDataInfo->ChunkShift);
+        Length = min(ChunkSize, UncompressedBufferSize - (i << CompressedDataInfo->ChunkShift));
+
+        for (j = 0; j < Length; j++)
+        {
+            if (Chunk[j])
+                break;
+        }
+        if (j == Length)
+        {
+            CompressedDataInfo->CompressedChunkSizes[i] = 0;
+            continue;
+        }
+
+        /* Only keep the compressed form if it saves something */
+        Room = min(CompressedBufferSize - OutPos, Length - 1);
+        Status = RtlCompressBuffer(CompressedDataInfo->CompressionFormatAndEngine,
+                                   Chunk,
+                                   Length,
+                                   CompressedBuffer + OutPos,
+                                   Room,
+                                   LZNT1_CHUNK_SIZE,
+                                   &FinalSize,
+                                   WorkSpace);
+        if (Status == STATUS_BUFFER_TOO_SMALL)
+        {
+            if (CompressedBufferSize - OutPos < Length)
+                return STATUS_BUFFER_TOO_SMALL;
+
+            RtlCopyMemory(CompressedBuffer + OutPos, Chunk, Length);
+            FinalSize = Length;
+        }
+        else if (!NT_SUCCESS(Status))
+        {
+            return Status;
+        }
+
+        CompressedDataInfo->CompressedChunkSizes[i] = FinalSize;
+        OutPos += FinalSize;
+    }
+
+    CompressedDataInfo->NumberOfChunks = (USHORT)NumberOfChunks;
+    return STATUS_SUCCESS;
 }
 
 /*
- * @unimplemented
+ * A chunk of size zero is all zeroes, and one that takes the full chunk size
+ * is stored uncompressed. Once the chunks run past the compressed buffer,
+ * they continue in the tail buffer.
+ *
+ * @implemented
  */
 NTSTATUS NTAPI
 RtlDecompressChunks(OUT PUCHAR UncompressedBuffer,
@@ -331,8 +1499,60 @@ RtlDecompressChunks(OUT PUCHAR UncompressedBuffer,
                     IN ULONG CompressedTailSize,
                     IN PCOMPRESSED_DATA_INFO CompressedDataInfo)
 {
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
+    PUCHAR Input = CompressedBuffer, InputEnd = CompressedBuffer + CompressedBufferSize;
+    ULONG ChunkSize, Position = 0, Length, Size, FinalSize, i;
+    BOOLEAN InTail = FALSE;
+    NTSTATUS Status;
+
+    if (CompressedDataInfo->ChunkShift < 9 || CompressedDataInfo->ChunkShift > 16)
+        return STATUS_INVALID_PARAMETER;
+    ChunkSize = 1 << CompressedDataInfo->ChunkShift;
+
+    for (i = 0; i < CompressedDataInfo->NumberOfChunks && Position < UncompressedBufferSize; i++)
+    {
+        Length = min(ChunkSize, UncompressedBufferSize - Position);
+        Size = CompressedDataInfo->CompressedChunkSizes[i];
+
+        if (!Size)
+        {
+            RtlZeroMemory(UncompressedBuffer + Position, Length);
+            Position += Length;
+            continue;
+        }
+
+        if ((ULONG)(InputEnd - Input) < Size)
+        {
+            if (InTail || CompressedTailSize < Size)
+                return STATUS_BAD_COMPRESSION_BUFFER;
+
+            Input = CompressedTail;
+            InputEnd = CompressedTail + CompressedTailSize;
+            InTail = TRUE;
+        }
+
+        if (Size >= Length)
+        {
+            RtlCopyMemory(UncompressedBuffer + Position, Input, Length);
+        }
+        else
+        {
+            Status = RtlDecompressBuffer(CompressedDataInfo->CompressionFormatAndEngine,
+                                         UncompressedBuffer + Position,
+                                         Length,
+                                         Input,
+                                         Size,
+                                         &FinalSize);
+            if (!NT_SUCCESS(Status))
+                return Status;
+
+            RtlZeroMemory(UncompressedBuffer + Position + FinalSize, Length - FinalSize);
+        }
+
+        Input += Size;
+        Position += Length;
+    }
+
+    return STATUS_SUCCESS;
 }
 
 /*
@@ -378,6 +1598,20 @@ RtlDecompressBuffer(IN USHORT CompressionFormat,
                     IN ULONG CompressedBufferSize,
                     OUT PULONG FinalUncompressedSize)
 {
+    /* Fragments only exist for LZNT1 */
+    switch (CompressionFormat & COMPRESSION_FORMAT_MASK)
+    {
+        case COMPRESSION_FORMAT_XPRESS:
+            return RtlpDecompressBufferXpress(UncompressedBuffer, UncompressedBufferSize,
+                                              CompressedBuffer, CompressedBufferSize,
+                                              FinalUncompressedSize);
+
+        case COMPRESSION_FORMAT_XPRESS_HUFF:
+            return RtlpDecompressBufferXpressHuff(UncompressedBuffer, UncompressedBufferSize,
+                                                  CompressedBuffer, CompressedBufferSize,
+                                                  FinalUncompressedSize);
+    }
+
     return RtlDecompressFragment(CompressionFormat, UncompressedBuffer, UncompressedBufferSize,
                                  CompressedBuffer, CompressedBufferSize, 0, FinalUncompressedSize, NULL);
 }
@@ -398,7 +1632,7 @@ RtlDescribeChunk(IN USHORT CompressionFormat,
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 NTSTATUS NTAPI
 RtlGetCompressionWorkSpaceSize(IN USHORT CompressionFormatAndEngine,
@@ -412,12 +1646,10 @@ RtlGetCompressionWorkSpaceSize(IN USHORT CompressionFormatAndEngine,
          (Format == COMPRESSION_FORMAT_DEFAULT))
       return(STATUS_INVALID_PARAMETER);
 
-   if (Format == COMPRESSION_FORMAT_LZNT1)
-      return(RtlpWorkSpaceSizeLZNT1(Engine,
-                                    CompressBufferAndWorkSpaceSize,
-                                    CompressFragmentWorkSpaceSize));
-
-   return(STATUS_UNSUPPORTED_COMPRESSION);
+   return(RtlpWorkSpaceSize(Format,
+                            Engine,
+                            CompressBufferAndWorkSpaceSize,
+                            CompressFragmentWorkSpaceSize));
 }
 
 
@@ -2017,6 +2017,14 @@ RtlAllocateHeap(IN PVOID HeapPtr,
 
     Index = AllocationSize >> HEAP_ENTRY_SHIFT;
 
+    /* Small plain blocks come from the low fragmentation front end, if enabled */
+    if ((Heap->FrontEndHeapType == HEAP_FRONT_LOWFRAGHEAP) &&
+        (EntryFlags == HEAP_ENTRY_BUSY))
+    {
+        InUseEntry = RtlpLfhAllocate(Heap, Flags, Size, Index);
+        if (InUseEntry) return InUseEntry + 1;
+    }
+
     /* Acquire the lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2206,7 +2214,7 @@ BOOLEAN NTAPI RtlFreeHeap(
     USHORT TagIndex = 0;
     SIZE_T BlockSize;
     PHEAP_VIRTUAL_ALLOC_ENTRY VirtualEntry;
-    BOOLEAN Locked = FALSE;
+    BOOLEAN Locked = FALSE, LfhBlock;
     NTSTATUS Status;
 
     /* Freeing NULL pointer is a legal operation */
@@ -2226,10 +2234,14 @@ BOOLEAN NTAPI RtlFreeHeap(
     /* Protect with SEH in case the pointer is not valid */
     _SEH2_TRY
     {
+        /* Blocks of the low fragmentation front end don't live in a segment */
+        LfhBlock = (HeapEntry->SegmentOffset == HEAP_LFH_INDEX) &&
+                   RtlpLfhIsValidBlock(Heap, HeapEntry);
+
         /* Check this entry, fail if it's invalid */
         if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY) ||
             (((ULONG_PTR)Ptr & 0x7) != 0) ||
-            (HeapEntry->SegmentOffset >= HEAP_SEGMENTS))
+            (!LfhBlock && (HeapEntry->SegmentOffset >= HEAP_SEGMENTS)))
         {
             /* This is an invalid block */
             DPRINT1("HEAP: Trying to free an invalid address %p!\n", Ptr);
@@ -2246,6 +2258,13 @@ BOOLEAN NTAPI RtlFreeHeap(
     }
     _SEH2_END;
 
+    /* The front end has its own locking */
+    if (LfhBlock)
+    {
+        RtlpLfhFree(Heap, HeapEntry);
+        return TRUE;
+    }
+
     /* Lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2676,6 +2695,20 @@ RtlReAllocateHeap(HANDLE HeapPtr,
         AllocationSize += sizeof(HEAP_ENTRY_EXTRA);
     }
 
+    /* Get the pointer to the in-use entry */
+    InUseEntry = (PHEAP_ENTRY)Ptr - 1;
+
+    /* Blocks of the low fragmentation front end are resized by it */
+    if ((InUseEntry->SegmentOffset == HEAP_LFH_INDEX) &&
+        RtlpLfhIsValidBlock(Heap, InUseEntry))
+    {
+        return RtlpLfhReAllocate(Heap,
+                                 Flags,
+                                 Ptr,
+                                 Size,
+                                 AllocationSize >> HEAP_ENTRY_SHIFT);
+    }
+
     /* Acquire the lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2684,9 +2717,6 @@ RtlReAllocateHeap(HANDLE HeapPtr,
         Flags &= ~HEAP_NO_SERIALIZE;
     }
 
-    /* Get the pointer to the in-use entry */
-    InUseEntry = (PHEAP_ENTRY)Ptr - 1;
-
     /* If that entry is not really in-use, we have a problem */
     if (!(InUseEntry->Flags & HEAP_ENTRY_BUSY))
     {
@@ -3235,6 +3265,13 @@ RtlpValidateHeapEntry(
     if ((ULONG_PTR)HeapEntry & (HEAP_ENTRY_SIZE - 1)) goto invalid_entry;
     if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY)) goto invalid_entry;
 
+    /* Front end blocks are checked by the front end */
+    if (HeapEntry->SegmentOffset == HEAP_LFH_INDEX)
+    {
+        if (!RtlpLfhIsValidBlock(Heap, HeapEntry)) goto invalid_entry;
+        return TRUE;
+    }
+
     BigAllocation = HeapEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC;
     Segment = Heap->Segments[HeapEntry->SegmentOffset];
 
@@ -3988,6 +4025,9 @@ RtlSetHeapInformation(IN HANDLE HeapHandle OPTIONAL,
                       IN PVOID HeapInformation,
                       IN SIZE_T HeapInformationLength)
 {
+    PHEAP Heap = (PHEAP)HeapHandle;
+    NTSTATUS Status;
+
     /* Setting heap information is not really supported except for enabling LFH */
     if (HeapInformationClass == HeapCompatibilityInformation)
     {
@@ -3999,13 +4039,28 @@ RtlSetHeapInformation(IN HANDLE HeapHandle OPTIONAL,
         }
 
         /* Check for a special magic value for enabling LFH */
-        if (*(PULONG)HeapInformation != 2)
+        if (*(PULONG)HeapInformation != HEAP_FRONT_LOWFRAGHEAP)
         {
             return STATUS_UNSUCCESSFUL;
         }
 
-        DPRINT1("RtlSetHeapInformation() needs to enable LFH\n");
-        return STATUS_SUCCESS;
+        /* The front end is user mode only, and needs a heap it can lock */
+        if (!Heap ||
+            RtlpGetMode() != UserMode ||
+            RtlpHeapIsSpecial(Heap->Flags | Heap->ForceFlags) ||
+            (Heap->Flags & (HEAP_NO_SERIALIZE |
+                            HEAP_CREATE_ALIGN_16 |
+                            HEAP_TAIL_CHECKING_ENABLED |
+                            HEAP_FREE_CHECKING_ENABLED)))
+        {
+            return STATUS_UNSUCCESSFUL;
+        }
+
+        RtlEnterHeapLock(Heap->LockVariable, TRUE);
+        Status = RtlpLfhCreate(Heap);
+        RtlLeaveHeapLock(Heap->LockVariable);
+
+        return Status;
     }
 
     return STATUS_SUCCESS;
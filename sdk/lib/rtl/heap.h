@@ -318,6 +318,67 @@ typedef struct _HEAP_VIRTUAL_ALLOC_ENTRY
     HEAP_ENTRY BusyBlock;
 } HEAP_VIRTUAL_ALLOC_ENTRY, *PHEAP_VIRTUAL_ALLOC_ENTRY;
 
+/* Low fragmentation heap front end */
+#define HEAP_FRONT_LOWFRAGHEAP          2
+#define HEAP_LFH_INDEX                  0xFF
+#define HEAP_LFH_BUCKETS                80
+#define HEAP_LFH_MAX_BLOCK_UNITS        256
+#define HEAP_LFH_AFFINITY_SLOTS         16
+#define HEAP_LFH_NO_SLOT                0xFF
+#define HEAP_LFH_ACTIVATION_THRESHOLD   16
+#define HEAP_LFH_MIN_BLOCK_COUNT        8
+#define HEAP_LFH_USER_BLOCKS_SIZE       (2 * PAGE_SIZE)
+#define HEAP_LFH_ZONE_SIZE              (2 * PAGE_SIZE)
+
+typedef struct _HEAP_LFH_SUBSEGMENT
+{
+    LIST_ENTRY ListEntry;
+    struct _HEAP_LFH_BUCKET *Bucket;
+    struct _HEAP_LFH_USER_BLOCKS *UserBlocks;
+    SINGLE_LIST_ENTRY FreeBlocks;
+    volatile LONG Lock;
+    USHORT FreeCount;
+    USHORT BlockCount;
+    UCHAR Slot;
+    BOOLEAN OnPartialList;
+} HEAP_LFH_SUBSEGMENT, *PHEAP_LFH_SUBSEGMENT;
+
+typedef struct _HEAP_LFH_USER_BLOCKS
+{
+    union
+    {
+        PHEAP_LFH_SUBSEGMENT SubSegment;
+        HEAP_ENTRY Alignment;
+    };
+} HEAP_LFH_USER_BLOCKS, *PHEAP_LFH_USER_BLOCKS;
+
+typedef struct _HEAP_LFH_ZONE
+{
+    LIST_ENTRY ListEntry;
+    HEAP_LFH_SUBSEGMENT SubSegments[ANYSIZE_ARRAY];
+} HEAP_LFH_ZONE, *PHEAP_LFH_ZONE;
+
+typedef struct _HEAP_LFH_BUCKET
+{
+    volatile LONG Lock;
+    volatile LONG UsageCount;
+    volatile BOOLEAN Active;
+    USHORT BlockUnits;
+    USHORT BlockCount;
+    LIST_ENTRY PartialList;
+    struct _HEAP_LFH *Lfh;
+    PHEAP_LFH_SUBSEGMENT volatile Slots[HEAP_LFH_AFFINITY_SLOTS];
+} HEAP_LFH_BUCKET, *PHEAP_LFH_BUCKET;
+
+typedef struct _HEAP_LFH
+{
+    PHEAP Heap;
+    volatile LONG Lock;
+    LIST_ENTRY ZoneList;
+    LIST_ENTRY FreeSubSegments;
+    HEAP_LFH_BUCKET Buckets[HEAP_LFH_BUCKETS];
+} HEAP_LFH, *PHEAP_LFH;
+
 /* Global variables */
 extern RTL_CRITICAL_SECTION RtlpProcessHeapsListLock;
 extern BOOLEAN RtlpPageHeapEnabled;
@@ -397,6 +458,31 @@ RtlDebugSizeHeap(HANDLE HeapPtr,
                  ULONG Flags,
                  PVOID Ptr);
 
+/* heaplfh.c */
+NTSTATUS NTAPI
+RtlpLfhCreate(PHEAP Heap);
+
+PHEAP_ENTRY NTAPI
+RtlpLfhAllocate(PHEAP Heap,
+                ULONG Flags,
+                SIZE_T Size,
+                SIZE_T Index);
+
+VOID NTAPI
+RtlpLfhFree(PHEAP Heap,
+            PHEAP_ENTRY HeapEntry);
+
+PVOID NTAPI
+RtlpLfhReAllocate(PHEAP Heap,
+                  ULONG Flags,
+                  PVOID Ptr,
+                  SIZE_T Size,
+                  SIZE_T Index);
+
+BOOLEAN NTAPI
+RtlpLfhIsValidBlock(PHEAP Heap,
+                    PHEAP_ENTRY HeapEntry);
+
 /* heappage.c */
 
 HANDLE NTAPI
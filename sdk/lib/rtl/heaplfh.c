@@ -0,0 +1,566 @@
+/*
+ * PROJECT:     ReactOS Runtime Library
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Low fragmentation heap front end
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+/*
+ * The front end serves small blocks from per size class buckets. Each bucket
+ * carves its blocks out of subsegments, which are arrays of equally sized
+ * blocks allocated from the back end heap. Threads are spread over a set of
+ * affinity slots, each slot owning its own active subsegment, so that threads
+ * allocating concurrently from the same bucket usually don't share a lock.
+ *
+ * A block is a regular HEAP_ENTRY whose SegmentOffset is HEAP_LFH_INDEX and
+ * whose PreviousSize is its distance in entries from the user blocks header,
+ * which points back to the owning subsegment. RtlSizeHeap and the user info
+ * routines therefore work on front end blocks unchanged.
+ *
+ * Bucket and subsegment locks are leaf locks: the back end heap lock is never
+ * acquired while one of them is held.
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl.h>
+#include <heap.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* FUNCTIONS *****************************************************************/
+
+FORCEINLINE
+VOID
+RtlpLfhAcquireLock(IN volatile LONG *Lock)
+{
+    ULONG SpinCount = 0;
+
+    while (InterlockedExchange(Lock, 1))
+    {
+        /* Spin for a while, then give the owner a chance to run */
+        do
+        {
+            if (++SpinCount < 1024)
+            {
+                YieldProcessor();
+            }
+            else
+            {
+                ZwYieldExecution();
+                SpinCount = 0;
+            }
+        } while (*Lock);
+    }
+}
+
+FORCEINLINE
+VOID
+RtlpLfhReleaseLock(IN volatile LONG *Lock)
+{
+    InterlockedExchange(Lock, 0);
+}
+
+FORCEINLINE
+ULONG
+RtlpLfhBucketIndex(IN SIZE_T Units)
+{
+    /* One unit granularity up to 32 units, then 2, 4 and 8 units */
+    if (Units <= 32) return (ULONG)Units - 1;
+    if (Units <= 64) return 32 + (ULONG)(Units - 33) / 2;
+    if (Units <= 128) return 48 + (ULONG)(Units - 65) / 4;
+    return 64 + (ULONG)(Units - 129) / 8;
+}
+
+FORCEINLINE
+USHORT
+RtlpLfhBucketUnits(IN ULONG Index)
+{
+    if (Index < 32) return (USHORT)(Index + 1);
+    if (Index < 48) return (USHORT)(34 + 2 * (Index - 32));
+    if (Index < 64) return (USHORT)(68 + 4 * (Index - 48));
+    return (USHORT)(136 + 8 * (Index - 64));
+}
+
+FORCEINLINE
+UCHAR
+RtlpLfhGetSlot(VOID)
+{
+    /* Thread IDs are multiples of 4 */
+    return (UCHAR)(((ULONG_PTR)NtCurrentTeb()->ClientId.UniqueThread >> 2) &
+                   (HEAP_LFH_AFFINITY_SLOTS - 1));
+}
+
+FORCEINLINE
+PHEAP_LFH_SUBSEGMENT
+RtlpLfhGetSubSegment(IN PHEAP_ENTRY HeapEntry)
+{
+    return ((PHEAP_LFH_USER_BLOCKS)(HeapEntry - HeapEntry->PreviousSize))->SubSegment;
+}
+
+static
+PHEAP_LFH_SUBSEGMENT
+RtlpLfhAllocateSubSegment(IN PHEAP_LFH Lfh)
+{
+    PHEAP_LFH_SUBSEGMENT SubSegment = NULL;
+    PHEAP_LFH_ZONE Zone;
+    ULONG i, Count;
+
+    /* Reuse a retired descriptor if possible */
+    RtlpLfhAcquireLock(&Lfh->Lock);
+    if (!IsListEmpty(&Lfh->FreeSubSegments))
+    {
+        SubSegment = CONTAINING_RECORD(RemoveHeadList(&Lfh->FreeSubSegments),
+                                       HEAP_LFH_SUBSEGMENT,
+                                       ListEntry);
+    }
+    RtlpLfhReleaseLock(&Lfh->Lock);
+    if (SubSegment) return SubSegment;
+
+    /* Get a new zone of descriptors. Zones are never given back while the heap
+       lives, so a stale descriptor pointer always points to a descriptor */
+    Zone = RtlAllocateHeap(Lfh->Heap, HEAP_ZERO_MEMORY, HEAP_LFH_ZONE_SIZE);
+    if (!Zone) return NULL;
+
+    Count = (HEAP_LFH_ZONE_SIZE - FIELD_OFFSET(HEAP_LFH_ZONE, SubSegments)) /
+            sizeof(HEAP_LFH_SUBSEGMENT);
+
+    /* Keep the first descriptor, the others go to the free list */
+    RtlpLfhAcquireLock(&Lfh->Lock);
+    InsertTailList(&Lfh->ZoneList, &Zone->ListEntry);
+    for (i = 1; i < Count; i++)
+    {
+        InsertTailList(&Lfh->FreeSubSegments, &Zone->SubSegments[i].ListEntry);
+    }
+    RtlpLfhReleaseLock(&Lfh->Lock);
+
+    return &Zone->SubSegments[0];
+}
+
+static
+VOID
+RtlpLfhFreeSubSegment(IN PHEAP_LFH Lfh,
+                      IN PHEAP_LFH_SUBSEGMENT SubSegment)
+{
+    RtlpLfhAcquireLock(&Lfh->Lock);
+    InsertTailList(&Lfh->FreeSubSegments, &SubSegment->ListEntry);
+    RtlpLfhReleaseLock(&Lfh->Lock);
+}
+
+static
+PHEAP_LFH_SUBSEGMENT
+RtlpLfhCreateSubSegment(IN PHEAP_LFH Lfh,
+                        IN PHEAP_LFH_BUCKET Bucket,
+                        IN UCHAR Slot)
+{
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+    PHEAP_LFH_USER_BLOCKS UserBlocks;
+    PHEAP_ENTRY Block;
+    ULONG i;
+
+    SubSegment = RtlpLfhAllocateSubSegment(Lfh);
+    if (!SubSegment) return NULL;
+
+    /* The user blocks are always bigger than the largest front end block,
+       so this goes to the back end */
+    UserBlocks = RtlAllocateHeap(Lfh->Heap,
+                                 0,
+                                 sizeof(HEAP_LFH_USER_BLOCKS) +
+                                 ((SIZE_T)Bucket->BlockCount * Bucket->BlockUnits << HEAP_ENTRY_SHIFT));
+    if (!UserBlocks)
+    {
+        RtlpLfhFreeSubSegment(Lfh, SubSegment);
+        return NULL;
+    }
+
+    UserBlocks->SubSegment = SubSegment;
+
+    /* A thread holding a stale pointer may still look at the descriptor */
+    RtlpLfhAcquireLock(&SubSegment->Lock);
+
+    SubSegment->Bucket = Bucket;
+    SubSegment->UserBlocks = UserBlocks;
+    SubSegment->FreeBlocks.Next = NULL;
+    SubSegment->FreeCount = Bucket->BlockCount;
+    SubSegment->BlockCount = Bucket->BlockCount;
+    SubSegment->OnPartialList = FALSE;
+
+    /* Owned by the slot from the start, so that frees of a previous
+       incarnation don't take it for an unowned one */
+    SubSegment->Slot = Slot;
+
+    /* Build the free list, lowest address first */
+    for (i = Bucket->BlockCount; i > 0; i--)
+    {
+        Block = (PHEAP_ENTRY)(UserBlocks + 1) + (i - 1) * Bucket->BlockUnits;
+
+        Block->Size = Bucket->BlockUnits;
+        Block->Flags = 0;
+        Block->SmallTagIndex = 0;
+        Block->PreviousSize = (USHORT)(Block - (PHEAP_ENTRY)UserBlocks);
+        Block->SegmentOffset = HEAP_LFH_INDEX;
+        Block->UnusedBytes = 0;
+
+        PushEntryList(&SubSegment->FreeBlocks, (PSINGLE_LIST_ENTRY)(Block + 1));
+    }
+
+    RtlpLfhReleaseLock(&SubSegment->Lock);
+
+    return SubSegment;
+}
+
+static
+BOOLEAN
+RtlpLfhRefillSlot(IN PHEAP_LFH Lfh,
+                  IN PHEAP_LFH_BUCKET Bucket,
+                  IN UCHAR Slot,
+                  IN PHEAP_LFH_SUBSEGMENT OldSubSegment)
+{
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+
+    RtlpLfhAcquireLock(&Bucket->Lock);
+
+    /* Another thread sharing the slot may have been faster */
+    if (Bucket->Slots[Slot] != OldSubSegment)
+    {
+        RtlpLfhReleaseLock(&Bucket->Lock);
+        return TRUE;
+    }
+
+    /* Detach the exhausted subsegment, frees put it back on the partial list */
+    if (OldSubSegment)
+    {
+        RtlpLfhAcquireLock(&OldSubSegment->Lock);
+        if (OldSubSegment->FreeCount)
+        {
+            /* Blocks were freed meanwhile, keep using it */
+            RtlpLfhReleaseLock(&OldSubSegment->Lock);
+            RtlpLfhReleaseLock(&Bucket->Lock);
+            return TRUE;
+        }
+
+        OldSubSegment->Slot = HEAP_LFH_NO_SLOT;
+        Bucket->Slots[Slot] = NULL;
+        RtlpLfhReleaseLock(&OldSubSegment->Lock);
+    }
+
+    /* Prefer a partially used subsegment over a new one */
+    if (!IsListEmpty(&Bucket->PartialList))
+    {
+        SubSegment = CONTAINING_RECORD(RemoveHeadList(&Bucket->PartialList),
+                                       HEAP_LFH_SUBSEGMENT,
+                                       ListEntry);
+
+        RtlpLfhAcquireLock(&SubSegment->Lock);
+        SubSegment->OnPartialList = FALSE;
+        SubSegment->Slot = Slot;
+        Bucket->Slots[Slot] = SubSegment;
+        RtlpLfhReleaseLock(&SubSegment->Lock);
+
+        RtlpLfhReleaseLock(&Bucket->Lock);
+        return TRUE;
+    }
+
+    RtlpLfhReleaseLock(&Bucket->Lock);
+
+    /* Create a new one, without holding any lock while in the back end */
+    SubSegment = RtlpLfhCreateSubSegment(Lfh, Bucket, Slot);
+    if (!SubSegment) return FALSE;
+
+    RtlpLfhAcquireLock(&Bucket->Lock);
+    RtlpLfhAcquireLock(&SubSegment->Lock);
+
+    if (!Bucket->Slots[Slot])
+    {
+        Bucket->Slots[Slot] = SubSegment;
+    }
+    else
+    {
+        /* The slot got refilled meanwhile, leave it for later */
+        SubSegment->Slot = HEAP_LFH_NO_SLOT;
+        InsertTailList(&Bucket->PartialList, &SubSegment->ListEntry);
+        SubSegment->OnPartialList = TRUE;
+    }
+
+    RtlpLfhReleaseLock(&SubSegment->Lock);
+    RtlpLfhReleaseLock(&Bucket->Lock);
+
+    return TRUE;
+}
+
+NTSTATUS
+NTAPI
+RtlpLfhCreate(PHEAP Heap)
+{
+    PHEAP_LFH Lfh;
+    PHEAP_LFH_BUCKET Bucket;
+    SIZE_T BlockSize;
+    ULONG i;
+
+    /* Nothing to do if the front end is already there */
+    if (Heap->FrontEndHeapType == HEAP_FRONT_LOWFRAGHEAP) return STATUS_SUCCESS;
+
+    Lfh = RtlAllocateHeap(Heap, HEAP_ZERO_MEMORY, sizeof(HEAP_LFH));
+    if (!Lfh) return STATUS_NO_MEMORY;
+
+    Lfh->Heap = Heap;
+    InitializeListHead(&Lfh->ZoneList);
+    InitializeListHead(&Lfh->FreeSubSegments);
+
+    for (i = 0; i < HEAP_LFH_BUCKETS; i++)
+    {
+        Bucket = &Lfh->Buckets[i];
+        Bucket->Lfh = Lfh;
+        Bucket->BlockUnits = RtlpLfhBucketUnits(i);
+        InitializeListHead(&Bucket->PartialList);
+
+        /* Size subsegments so that they never come from the front end themselves */
+        BlockSize = (SIZE_T)Bucket->BlockUnits << HEAP_ENTRY_SHIFT;
+        Bucket->BlockCount = (USHORT)max(HEAP_LFH_USER_BLOCKS_SIZE / BlockSize,
+                                         HEAP_LFH_MIN_BLOCK_COUNT);
+    }
+
+    /* Publish the front end before allocations may start to use it */
+    InterlockedExchangePointer(&Heap->FrontEndHeap, Lfh);
+    Heap->FrontEndHeapType = HEAP_FRONT_LOWFRAGHEAP;
+
+    return STATUS_SUCCESS;
+}
+
+PHEAP_ENTRY
+NTAPI
+RtlpLfhAllocate(PHEAP Heap,
+                ULONG Flags,
+                SIZE_T Size,
+                SIZE_T Index)
+{
+    PHEAP_LFH Lfh = (PHEAP_LFH)Heap->FrontEndHeap;
+    PHEAP_LFH_BUCKET Bucket;
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+    PSINGLE_LIST_ENTRY Entry;
+    PHEAP_ENTRY HeapEntry;
+    UCHAR Slot;
+
+    if (Index > HEAP_LFH_MAX_BLOCK_UNITS) return NULL;
+    Bucket = &Lfh->Buckets[RtlpLfhBucketIndex(Index)];
+
+    /* A bucket is only served by the front end once it sees enough traffic */
+    if (!Bucket->Active)
+    {
+        if (InterlockedIncrement(&Bucket->UsageCount) < HEAP_LFH_ACTIVATION_THRESHOLD)
+            return NULL;
+
+        Bucket->Active = TRUE;
+    }
+
+    Slot = RtlpLfhGetSlot();
+
+    for (;;)
+    {
+        SubSegment = Bucket->Slots[Slot];
+        if (SubSegment)
+        {
+            RtlpLfhAcquireLock(&SubSegment->Lock);
+
+            /* The descriptor may have been detached or reused meanwhile */
+            if ((SubSegment->Bucket == Bucket) &&
+                (SubSegment->Slot == Slot) &&
+                (Entry = PopEntryList(&SubSegment->FreeBlocks)))
+            {
+                SubSegment->FreeCount--;
+                RtlpLfhReleaseLock(&SubSegment->Lock);
+                break;
+            }
+
+            RtlpLfhReleaseLock(&SubSegment->Lock);
+        }
+
+        /* Let the back end handle it if no subsegment can be had */
+        if (!RtlpLfhRefillSlot(Lfh, Bucket, Slot, SubSegment)) return NULL;
+    }
+
+    HeapEntry = (PHEAP_ENTRY)Entry - 1;
+    HeapEntry->Flags = HEAP_ENTRY_BUSY;
+    HeapEntry->UnusedBytes = (UCHAR)(((SIZE_T)Bucket->BlockUnits << HEAP_ENTRY_SHIFT) - Size);
+
+    if (Flags & HEAP_ZERO_MEMORY)
+        RtlZeroMemory(HeapEntry + 1, Size);
+
+    return HeapEntry;
+}
+
+VOID
+NTAPI
+RtlpLfhFree(PHEAP Heap,
+            PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH Lfh = (PHEAP_LFH)Heap->FrontEndHeap;
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+    PHEAP_LFH_BUCKET Bucket;
+    PHEAP_LFH_USER_BLOCKS UserBlocks = NULL;
+    BOOLEAN Update;
+
+    SubSegment = RtlpLfhGetSubSegment(HeapEntry);
+    Bucket = SubSegment->Bucket;
+
+    HeapEntry->Flags = 0;
+
+    RtlpLfhAcquireLock(&SubSegment->Lock);
+    PushEntryList(&SubSegment->FreeBlocks, (PSINGLE_LIST_ENTRY)(HeapEntry + 1));
+    SubSegment->FreeCount++;
+
+    /* A subsegment without a slot goes back to the partial list once it has a
+       free block, and back to the heap once all of its blocks are free */
+    Update = (SubSegment->Slot == HEAP_LFH_NO_SLOT) &&
+             ((SubSegment->FreeCount == 1) ||
+              (SubSegment->FreeCount == SubSegment->BlockCount));
+
+    RtlpLfhReleaseLock(&SubSegment->Lock);
+    if (!Update) return;
+
+    /* Check again with the locks in the right order */
+    RtlpLfhAcquireLock(&Bucket->Lock);
+    RtlpLfhAcquireLock(&SubSegment->Lock);
+
+    if ((SubSegment->Slot == HEAP_LFH_NO_SLOT) &&
+        (SubSegment->Bucket == Bucket) &&
+        SubSegment->UserBlocks)
+    {
+        if (SubSegment->FreeCount == SubSegment->BlockCount)
+        {
+            if (SubSegment->OnPartialList)
+            {
+                RemoveEntryList(&SubSegment->ListEntry);
+                SubSegment->OnPartialList = FALSE;
+            }
+
+            /* Retire it */
+            UserBlocks = SubSegment->UserBlocks;
+            SubSegment->UserBlocks = NULL;
+            SubSegment->FreeBlocks.Next = NULL;
+            SubSegment->FreeCount = 0;
+            SubSegment->BlockCount = 0;
+        }
+        else if (SubSegment->FreeCount && !SubSegment->OnPartialList)
+        {
+            InsertTailList(&Bucket->PartialList, &SubSegment->ListEntry);
+            SubSegment->OnPartialList = TRUE;
+        }
+    }
+
+    RtlpLfhReleaseLock(&SubSegment->Lock);
+    RtlpLfhReleaseLock(&Bucket->Lock);
+
+    if (UserBlocks)
+    {
+        RtlpLfhFreeSubSegment(Lfh, SubSegment);
+        RtlFreeHeap(Heap, 0, UserBlocks);
+    }
+}
+
+PVOID
+NTAPI
+RtlpLfhReAllocate(PHEAP Heap,
+                  ULONG Flags,
+                  PVOID Ptr,
+                  SIZE_T Size,
+                  SIZE_T Index)
+{
+    PHEAP_LFH Lfh = (PHEAP_LFH)Heap->FrontEndHeap;
+    PHEAP_ENTRY HeapEntry = (PHEAP_ENTRY)Ptr - 1;
+    EXCEPTION_RECORD ExceptionRecord;
+    SIZE_T OldSize;
+    PVOID NewPtr;
+
+    OldSize = ((SIZE_T)HeapEntry->Size << HEAP_ENTRY_SHIFT) - HeapEntry->UnusedBytes;
+
+    /* Stay in the same block if the new size maps to the same bucket */
+    if ((Index <= HEAP_LFH_MAX_BLOCK_UNITS) &&
+        !(Flags & HEAP_EXTRA_FLAGS_MASK) &&
+        (Lfh->Buckets[RtlpLfhBucketIndex(Index)].BlockUnits == HeapEntry->Size))
+    {
+        if ((Flags & HEAP_ZERO_MEMORY) && (Size > OldSize))
+            RtlZeroMemory((PCHAR)Ptr + OldSize, Size - OldSize);
+
+        HeapEntry->UnusedBytes = (UCHAR)(((SIZE_T)HeapEntry->Size << HEAP_ENTRY_SHIFT) - Size);
+        return Ptr;
+    }
+
+    if (Flags & HEAP_REALLOC_IN_PLACE_ONLY)
+    {
+        DPRINT1("Realloc in place failed, but it was the only option\n");
+        NewPtr = NULL;
+    }
+    else
+    {
+        /* Move it, preserving the user settable flags */
+        NewPtr = RtlAllocateHeap(Heap,
+                                 (Flags & ~(HEAP_ZERO_MEMORY | HEAP_SETTABLE_USER_FLAGS | HEAP_TAG_MASK)) |
+                                 ((HeapEntry->Flags & HEAP_ENTRY_SETTABLE_FLAGS) << 4),
+                                 Size);
+        if (NewPtr)
+        {
+            RtlMoveMemory(NewPtr, Ptr, min(Size, OldSize));
+
+            if ((Flags & HEAP_ZERO_MEMORY) && (Size > OldSize))
+                RtlZeroMemory((PCHAR)NewPtr + OldSize, Size - OldSize);
+
+            RtlpLfhFree(Heap, HeapEntry);
+        }
+    }
+
+    if (!NewPtr && (Flags & HEAP_GENERATE_EXCEPTIONS))
+    {
+        /* Generate an exception if required */
+        ExceptionRecord.ExceptionCode = STATUS_NO_MEMORY;
+        ExceptionRecord.ExceptionRecord = NULL;
+        ExceptionRecord.NumberParameters = 1;
+        ExceptionRecord.ExceptionFlags = 0;
+        ExceptionRecord.ExceptionInformation[0] = Size;
+
+        RtlRaiseException(&ExceptionRecord);
+    }
+
+    return NewPtr;
+}
+
+BOOLEAN
+NTAPI
+RtlpLfhIsValidBlock(PHEAP Heap,
+                    PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH_USER_BLOCKS UserBlocks;
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+    PHEAP_LFH_BUCKET Bucket;
+    SIZE_T Offset;
+
+    if (Heap->FrontEndHeapType != HEAP_FRONT_LOWFRAGHEAP) return FALSE;
+
+    /* Front end blocks never have extra stuff, fill patterns or neighbours */
+    if ((HeapEntry->Flags & ~HEAP_ENTRY_SETTABLE_FLAGS) != HEAP_ENTRY_BUSY ||
+        HeapEntry->SegmentOffset != HEAP_LFH_INDEX ||
+        !HeapEntry->PreviousSize)
+    {
+        return FALSE;
+    }
+
+    /* The user blocks header must point to a descriptor which points back */
+    UserBlocks = (PHEAP_LFH_USER_BLOCKS)(HeapEntry - HeapEntry->PreviousSize);
+    SubSegment = UserBlocks->SubSegment;
+    if (!SubSegment || SubSegment->UserBlocks != UserBlocks) return FALSE;
+
+    Bucket = SubSegment->Bucket;
+    if (Bucket->Lfh != Heap->FrontEndHeap ||
+        HeapEntry->Size != Bucket->BlockUnits)
+    {
+        return FALSE;
+    }
+
+    /* And the entry must be the start of one of its blocks */
+    Offset = HeapEntry->PreviousSize - 1;
+    return (Offset % Bucket->BlockUnits == 0) &&
+           (Offset / Bucket->BlockUnits < SubSegment->BlockCount);
+}
+
+/* EOF */
@@ -0,0 +1,368 @@
+/*
+ * PROJECT:     ReactOS compression benchmark
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Round trip and throughput benchmark for the compression engines
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include "compbench.h"
+
+/* GLOBALS ******************************************************************/
+
+typedef struct _CPB_CODEC
+{
+    PCSTR Name;
+    USHORT FormatAndEngine;
+} CPB_CODEC, *PCPB_CODEC;
+
+typedef struct _CPB_SAMPLE
+{
+    PCSTR Name;
+    PUCHAR Data;
+    ULONG Size;
+} CPB_SAMPLE, *PCPB_SAMPLE;
+
+static const CPB_CODEC CpbCodecs[] =
+{
+    { "lznt1",      COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_STANDARD },
+    { "lznt1/max",  COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_MAXIMUM },
+    { "xpress",     COMPRESSION_FORMAT_XPRESS | COMPRESSION_ENGINE_STANDARD },
+    { "xpress/max", COMPRESSION_FORMAT_XPRESS | COMPRESSION_ENGINE_MAXIMUM },
+    { "huff",       COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_STANDARD },
+    { "huff/max",   COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_MAXIMUM },
+};
+
+static const PCSTR CpbWords[] =
+{
+    "the", "registry", "of", "and", "system", "driver", "to", "file", "a",
+    "in", "memory", "is", "kernel", "for", "object", "handle", "that", "with",
+    "process", "thread", "on", "by", "section", "security", "as", "be", "this",
+    "device", "volume", "cache", "from", "an", "it", "mapped", "view", "page",
+};
+
+static ULONG CpbSeed = 1;
+
+/* FUNCTIONS ****************************************************************/
+
+/* Deterministic generator, so that every run compresses the same data */
+static ULONG
+CpbRandom(VOID)
+{
+    CpbSeed = CpbSeed * 1103515245 + 12345;
+    return (CpbSeed >> 1) & 0x7FFFFFFF;
+}
+
+static double
+CpbSeconds(
+    IN clock_t Start)
+{
+    return (double)(clock() - Start) / CLOCKS_PER_SEC;
+}
+
+static BOOLEAN
+CpbReadFile(
+    IN PCSTR FileName,
+    OUT PCPB_SAMPLE Sample)
+{
+    FILE *File;
+    long Length;
+
+    File = fopen(FileName, "rb");
+    if (!File)
+    {
+        printf("Unable to open '%s'\n", FileName);
+        return FALSE;
+    }
+
+    fseek(File, 0, SEEK_END);
+    Length = ftell(File);
+    fseek(File, 0, SEEK_SET);
+
+    Sample->Data = malloc(Length > 0 ? Length : 1);
+    if (Length < 0 || !Sample->Data || fread(Sample->Data, 1, Length, File) != (size_t)Length)
+    {
+        printf("Unable to read '%s'\n", FileName);
+        free(Sample->Data);
+        fclose(File);
+        return FALSE;
+    }
+
+    Sample->Name = FileName;
+    Sample->Size = (ULONG)Length;
+    fclose(File);
+    return TRUE;
+}
+
+/*
+ * The built-in corpus: words, records with slowly changing fields, mostly
+ * empty pages, and noise. Between them they cover the usual range from very
+ * compressible to not compressible at all.
+ */
+static ULONG
+CpbBuildCorpus(
+    OUT PCPB_SAMPLE Samples)
+{
+    PUCHAR Data;
+    PCSTR Word;
+    ULONG Size, Position, Length, i;
+
+    Size = 1024 * 1024;
+    Data = malloc(Size);
+    for (Position = 0; Position < Size;)
+    {
+        Word = CpbWords[CpbRandom() % _countof(CpbWords)];
+        Length = min((ULONG)strlen(Word), Size - Position);
+        memcpy(Data + Position, Word, Length);
+        Position += Length;
+        if (Position < Size)
+            Data[Position++] = (CpbRandom() % 12) ? ' ' : '\n';
+    }
+    Samples[0].Name = "text";
+    Samples[0].Data = Data;
+    Samples[0].Size = Size;
+
+    Data = malloc(Size);
+    for (i = 0; i < Size / 16; i++)
+    {
+        RtlZeroMemory(Data + i * 16, 16);
+        Data[i * 16 + 0] = (UCHAR)i;
+        Data[i * 16 + 1] = (UCHAR)(i >> 8);
+        Data[i * 16 + 4] = (UCHAR)(CpbRandom() % 4);
+        Data[i * 16 + 8] = 0x40;
+        Data[i * 16 + 12] = (UCHAR)CpbRandom();
+    }
+    Samples[1].Name = "records";
+    Samples[1].Data = Data;
+    Samples[1].Size = Size;
+
+    Size = 256 * 1024;
+    Data = calloc(Size, 1);
+    for (i = 0; i < Size / 64; i++)
+        Data[CpbRandom() % Size] = (UCHAR)CpbRandom();
+    Samples[2].Name = "sparse";
+    Samples[2].Data = Data;
+    Samples[2].Size = Size;
+
+    Data = malloc(Size);
+    for (i = 0; i < Size; i++)
+        Data[i] = (UCHAR)(CpbRandom() >> 8);
+    Samples[3].Name = "random";
+    Samples[3].Data = Data;
+    Samples[3].Size = Size;
+
+    return 4;
+}
+
+/* Chunked round trip, the way file systems compress */
+static BOOLEAN
+CpbTestChunks(
+    IN PCPB_SAMPLE Sample,
+    IN USHORT FormatAndEngine,
+    IN PVOID WorkSpace)
+{
+    PCOMPRESSED_DATA_INFO Info;
+    PUCHAR Compressed, Uncompressed;
+    ULONG InfoLength, Chunks;
+    NTSTATUS Status;
+    BOOLEAN Result = FALSE;
+
+    Chunks = (Sample->Size + 0xFFF) >> 12;
+    InfoLength = FIELD_OFFSET(COMPRESSED_DATA_INFO, CompressedChunkSizes) + Chunks * sizeof(ULONG);
+    Info = calloc(1, InfoLength);
+    Compressed = malloc(Sample->Size + 1);
+    Uncompressed = malloc(Sample->Size + 1);
+    if (!Info || !Compressed || !Uncompressed)
+        goto Quit;
+
+    Info->CompressionFormatAndEngine = FormatAndEngine;
+    Info->ChunkShift = 12;
+    Status = RtlCompressChunks(Sample->Data, Sample->Size, Compressed, Sample->Size,
+                               Info, InfoLength, WorkSpace);
+    if (!NT_SUCCESS(Status))
+    {
+        printf("  RtlCompressChunks failed with 0x%08x\n", (unsigned)Status);
+        goto Quit;
+    }
+
+    Status = RtlDecompressChunks(Uncompressed, Sample->Size, Compressed, Sample->Size,
+                                 NULL, 0, Info);
+    if (!NT_SUCCESS(Status))
+    {
+        printf("  RtlDecompressChunks failed with 0x%08x\n", (unsigned)Status);
+        goto Quit;
+    }
+
+    Result = !memcmp(Uncompressed, Sample->Data, Sample->Size);
+    if (!Result)
+        printf("  Chunked round trip mismatch\n");
+
+Quit:
+    free(Info);
+    free(Compressed);
+    free(Uncompressed);
+    return Result;
+}
+
+static BOOLEAN
+CpbRunCodec(
+    IN PCPB_SAMPLE Sample,
+    IN const CPB_CODEC *Codec,
+    IN ULONG Iterations)
+{
+    PUCHAR Compressed = NULL, Uncompressed = NULL;
+    PVOID WorkSpace = NULL;
+    ULONG WorkSpaceSize, FragmentSize, CompressedMax, CompressedSize = 0, FinalSize = 0, i;
+    double CompressTime, DecompressTime, Megabytes;
+    clock_t Start;
+    NTSTATUS Status;
+    BOOLEAN Result = FALSE;
+
+    Status = RtlGetCompressionWorkSpaceSize(Codec->FormatAndEngine, &WorkSpaceSize, &FragmentSize);
+    if (!NT_SUCCESS(Status))
+    {
+        printf("%-12s %-10s workspace query failed with 0x%08x\n",
+               Sample->Name, Codec->Name, (unsigned)Status);
+        return FALSE;
+    }
+
+    /* Incompressible data grows by the flags, headers and tables */
+    CompressedMax = Sample->Size + Sample->Size / 4 + 4096;
+    WorkSpace = malloc(WorkSpaceSize);
+    Compressed = malloc(CompressedMax);
+    Uncompressed = malloc(Sample->Size + 1);
+    if (!WorkSpace || !Compressed || !Uncompressed)
+    {
+        printf("Out of memory\n");
+        goto Quit;
+    }
+
+    Start = clock();
+    for (i = 0; i < Iterations; i++)
+    {
+        Status = RtlCompressBuffer(Codec->FormatAndEngine, Sample->Data, Sample->Size,
+                                   Compressed, CompressedMax, 4096, &CompressedSize, WorkSpace);
+        if (!NT_SUCCESS(Status))
+        {
+            printf("%-12s %-10s compression failed with 0x%08x\n",
+                   Sample->Name, Codec->Name, (unsigned)Status);
+            goto Quit;
+        }
+    }
+    CompressTime = CpbSeconds(Start);
+
+    Start = clock();
+    for (i = 0; i < Iterations; i++)
+    {
+        Status = RtlDecompressBuffer(Codec->FormatAndEngine & 0xFF, Uncompressed, Sample->Size,
+                                     Compressed, CompressedSize, &FinalSize);
+        if (!NT_SUCCESS(Status))
+        {
+            printf("%-12s %-10s decompression failed with 0x%08x\n",
+                   Sample->Name, Codec->Name, (unsigned)Status);
+            goto Quit;
+        }
+    }
+    DecompressTime = CpbSeconds(Start);
+
+    if (FinalSize != Sample->Size || memcmp(Uncompressed, Sample->Data, Sample->Size))
+    {
+        printf("%-12s %-10s round trip mismatch (%u of %u bytes)\n",
+               Sample->Name, Codec->Name, (unsigned)FinalSize, (unsigned)Sample->Size);
+        goto Quit;
+    }
+
+    Megabytes = (double)Sample->Size * Iterations / (1024 * 1024);
+    printf("%-12s %-10s %10u %10u %6.1f%% %9.1f %9.1f\n",
+           Sample->Name,
+           Codec->Name,
+           (unsigned)Sample->Size,
+           (unsigned)CompressedSize,
+           Sample->Size ? 100.0 * CompressedSize / Sample->Size : 100.0,
+           CompressTime > 0 ? Megabytes / CompressTime : 0.0,
+           DecompressTime > 0 ? Megabytes / DecompressTime : 0.0);
+
+    Result = CpbTestChunks(Sample, Codec->FormatAndEngine, WorkSpace);
+
+Quit:
+    free(WorkSpace);
+    free(Compressed);
+    free(Uncompressed);
+    return Result;
+}
+
+static void
+CpbUsage(VOID)
+{
+    ULONG i;
+
+    printf("Usage: compbench [-i iterations] [-c codec] [file ...]\n"
+           "Compresses every file with every codec, checks the round trip and\n"
+           "reports the ratio and the throughput in MB/s. Without files, a\n"
+           "built-in corpus is used. Codecs:");
+    for (i = 0; i < _countof(CpbCodecs); i++)
+        printf(" %s", CpbCodecs[i].Name);
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    CPB_SAMPLE Samples[64];
+    PCSTR CodecName = NULL;
+    ULONG Count = 0, Iterations = 4, Failures = 0, i, j;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (!strcmp(argv[Arg], "-i") && Arg + 1 < argc)
+        {
+            Iterations = strtoul(argv[++Arg], NULL, 0);
+            Iterations = max(Iterations, 1);
+        }
+        else if (!strcmp(argv[Arg], "-c") && Arg + 1 < argc)
+        {
+            CodecName = argv[++Arg];
+        }
+        else if (argv[Arg][0] == '-')
+        {
+            CpbUsage();
+            return 1;
+        }
+        else if (Count < _countof(Samples))
+        {
+            if (!CpbReadFile(argv[Arg], &Samples[Count]))
+                return 1;
+            Count++;
+        }
+    }
+
+    if (!Count)
+        Count = CpbBuildCorpus(Samples);
+
+    printf("%-12s %-10s %10s %10s %7s %9s %9s\n",
+           "Sample", "Codec", "Size", "Packed", "Ratio", "Comp MB/s", "Dec MB/s");
+
+    for (i = 0; i < Count; i++)
+    {
+        for (j = 0; j < _countof(CpbCodecs); j++)
+        {
+            if (CodecName && strcmp(CodecName, CpbCodecs[j].Name))
+                continue;
+
+            if (!CpbRunCodec(&Samples[i], &CpbCodecs[j], Iterations))
+                Failures++;
+        }
+        free(Samples[i].Data);
+    }
+
+    if (Failures)
+    {
+        printf("%u round trip(s) failed\n", (unsigned)Failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* EOF */
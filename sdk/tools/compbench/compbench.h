@@ -0,0 +1,121 @@
+/*
+ * PROJECT:     ReactOS compression benchmark
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Host benchmark for the runtime library compression engines
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <typedefs.h>
+
+#ifndef FORCEINLINE
+#define FORCEINLINE static __inline
+#endif
+
+#ifndef _countof
+#define _countof(_Array) (sizeof(_Array) / sizeof(_Array[0]))
+#endif
+
+#ifndef min
+#define min(a, b)  (((a) < (b)) ? (a) : (b))
+#endif
+
+#ifndef max
+#define max(a, b)  (((a) > (b)) ? (a) : (b))
+#endif
+
+// Definitions copied from <ntstatus.h>
+#define STATUS_SUCCESS                   ((NTSTATUS)0x00000000)
+#define STATUS_NOT_IMPLEMENTED           ((NTSTATUS)0xC0000002)
+#define STATUS_ACCESS_VIOLATION          ((NTSTATUS)0xC0000005)
+#define STATUS_INVALID_PARAMETER         ((NTSTATUS)0xC000000D)
+#define STATUS_BUFFER_TOO_SMALL          ((NTSTATUS)0xC0000023)
+#define STATUS_NOT_SUPPORTED             ((NTSTATUS)0xC00000BB)
+#define STATUS_BAD_COMPRESSION_BUFFER    ((NTSTATUS)0xC0000242)
+#define STATUS_UNSUPPORTED_COMPRESSION   ((NTSTATUS)0xC000025F)
+
+// Definitions copied from <ntifs.h>
+#define COMPRESSION_FORMAT_NONE         (0x0000)
+#define COMPRESSION_FORMAT_DEFAULT      (0x0001)
+#define COMPRESSION_FORMAT_LZNT1        (0x0002)
+#define COMPRESSION_FORMAT_XPRESS       (0x0003)
+#define COMPRESSION_FORMAT_XPRESS_HUFF  (0x0004)
+#define COMPRESSION_ENGINE_STANDARD     (0x0000)
+#define COMPRESSION_ENGINE_MAXIMUM      (0x0100)
+#define COMPRESSION_ENGINE_HIBER        (0x0200)
+
+typedef struct _COMPRESSED_DATA_INFO {
+    USHORT CompressionFormatAndEngine;
+    UCHAR CompressionUnitShift;
+    UCHAR ChunkShift;
+    UCHAR ClusterShift;
+    UCHAR Reserved;
+    USHORT NumberOfChunks;
+    ULONG CompressedChunkSizes[ANYSIZE_ARRAY];
+} COMPRESSED_DATA_INFO, *PCOMPRESSED_DATA_INFO;
+
+/* compress.c */
+NTSTATUS NTAPI
+RtlCompressBuffer(
+    IN USHORT CompressionFormatAndEngine,
+    IN PUCHAR UncompressedBuffer,
+    IN ULONG UncompressedBufferSize,
+    OUT PUCHAR CompressedBuffer,
+    IN ULONG CompressedBufferSize,
+    IN ULONG UncompressedChunkSize,
+    OUT PULONG FinalCompressedSize,
+    IN PVOID WorkSpace);
+
+NTSTATUS NTAPI
+RtlDecompressBuffer(
+    IN USHORT CompressionFormat,
+    OUT PUCHAR UncompressedBuffer,
+    IN ULONG UncompressedBufferSize,
+    IN PUCHAR CompressedBuffer,
+    IN ULONG CompressedBufferSize,
+    OUT PULONG FinalUncompressedSize);
+
+NTSTATUS NTAPI
+RtlDecompressFragment(
+    IN USHORT format,
+    OUT PUCHAR uncompressed,
+    IN ULONG uncompressed_size,
+    IN PUCHAR compressed,
+    IN ULONG compressed_size,
+    IN ULONG offset,
+    OUT PULONG final_size,
+    IN PVOID workspace);
+
+NTSTATUS NTAPI
+RtlCompressChunks(
+    IN PUCHAR UncompressedBuffer,
+    IN ULONG UncompressedBufferSize,
+    OUT PUCHAR CompressedBuffer,
+    IN ULONG CompressedBufferSize,
+    IN OUT PCOMPRESSED_DATA_INFO CompressedDataInfo,
+    IN ULONG CompressedDataInfoLength,
+    IN PVOID WorkSpace);
+
+NTSTATUS NTAPI
+RtlDecompressChunks(
+    OUT PUCHAR UncompressedBuffer,
+    IN ULONG UncompressedBufferSize,
+    IN PUCHAR CompressedBuffer,
+    IN ULONG CompressedBufferSize,
+    IN PUCHAR CompressedTail,
+    IN ULONG CompressedTailSize,
+    IN PCOMPRESSED_DATA_INFO CompressedDataInfo);
+
+NTSTATUS NTAPI
+RtlGetCompressionWorkSpaceSize(
+    IN USHORT CompressionFormatAndEngine,
+    OUT PULONG CompressBufferAndWorkSpaceSize,
+    OUT PULONG CompressFragmentWorkSpaceSize);
+
+/* EOF */
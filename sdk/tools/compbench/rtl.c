@@ -0,0 +1,11 @@
+/*
+ * PROJECT:     ReactOS compression benchmark
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Runtime library compression engines, built for the host
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include "compbench.h"
+#include <compress.c>
+
+/* EOF */
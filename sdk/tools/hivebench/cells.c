@@ -0,0 +1,373 @@
+/*
+ * PROJECT:     ReactOS hive benchmark
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Cell allocator trace replay
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include "hivebench.h"
+
+/* TYPES ********************************************************************/
+
+/*
+ * A cell trace is a list of operations on numbered cells, one per line:
+ *
+ *   a <id> <size>   allocate <size> bytes for cell <id>
+ *   r <id> <size>   reallocate cell <id> to <size> bytes
+ *   f <id>          free cell <id>
+ *
+ * Empty lines and lines starting with '#' are ignored.
+ */
+typedef struct _HVB_TRACE_OP
+{
+    CHAR Type;
+    ULONG Id;
+    ULONG Size;
+} HVB_TRACE_OP, *PHVB_TRACE_OP;
+
+typedef struct _HVB_TRACE
+{
+    ULONG Count;
+    ULONG Max;
+    ULONG IdCount;
+    PHVB_TRACE_OP Ops;
+} HVB_TRACE, *PHVB_TRACE;
+
+typedef struct _HVB_LIVE_CELL
+{
+    HCELL_INDEX Cell;
+    ULONG Size;
+} HVB_LIVE_CELL, *PHVB_LIVE_CELL;
+
+/* FUNCTIONS ****************************************************************/
+
+static BOOLEAN
+HvbAddTraceOp(
+    IN OUT PHVB_TRACE Trace,
+    IN CHAR Type,
+    IN ULONG Id,
+    IN ULONG Size)
+{
+    PHVB_TRACE_OP Ops;
+
+    if (Trace->Count == Trace->Max)
+    {
+        Trace->Max = Trace->Max ? Trace->Max * 2 : 4096;
+        Ops = realloc(Trace->Ops, Trace->Max * sizeof(HVB_TRACE_OP));
+        if (!Ops)
+            return FALSE;
+        Trace->Ops = Ops;
+    }
+
+    Trace->Ops[Trace->Count].Type = Type;
+    Trace->Ops[Trace->Count].Id = Id;
+    Trace->Ops[Trace->Count].Size = Size;
+    Trace->Count++;
+
+    if (Id >= Trace->IdCount)
+        Trace->IdCount = Id + 1;
+
+    return TRUE;
+}
+
+static BOOLEAN
+HvbReadTrace(
+    IN PCSTR FileName,
+    OUT PHVB_TRACE Trace)
+{
+    FILE *File;
+    CHAR Line[128];
+    CHAR Type;
+    ULONG LineNumber = 0;
+    unsigned int Id, Size;
+
+    File = fopen(FileName, "r");
+    if (!File)
+    {
+        printf("Unable to open trace '%s'\n", FileName);
+        return FALSE;
+    }
+
+    while (fgets(Line, sizeof(Line), File))
+    {
+        LineNumber++;
+        Type = Line[0];
+        Size = 0;
+
+        if (Type == '#' || Type == '\n' || Type == '\r' || Type == '\0')
+            continue;
+
+        if (((Type == 'a' || Type == 'r') && sscanf(Line + 1, "%u %u", &Id, &Size) != 2) ||
+            (Type == 'f' && sscanf(Line + 1, "%u", &Id) != 1) ||
+            (Type != 'a' && Type != 'r' && Type != 'f'))
+        {
+            printf("%s(%u): invalid trace operation\n", FileName, LineNumber);
+            fclose(File);
+            return FALSE;
+        }
+
+        if (!HvbAddTraceOp(Trace, Type, Id, Size))
+        {
+            fclose(File);
+            return FALSE;
+        }
+    }
+
+    fclose(File);
+    return TRUE;
+}
+
+static BOOLEAN
+HvbWriteTrace(
+    IN PCSTR FileName,
+    IN PHVB_TRACE Trace)
+{
+    FILE *File;
+    ULONG i;
+
+    File = fopen(FileName, "w");
+    if (!File)
+    {
+        printf("Unable to create trace '%s'\n", FileName);
+        return FALSE;
+    }
+
+    fprintf(File, "# hivebench cell trace, %u operations\n", Trace->Count);
+    for (i = 0; i < Trace->Count; i++)
+    {
+        if (Trace->Ops[i].Type == 'f')
+            fprintf(File, "f %u\n", Trace->Ops[i].Id);
+        else
+            fprintf(File, "%c %u %u\n", Trace->Ops[i].Type, Trace->Ops[i].Id, Trace->Ops[i].Size);
+    }
+
+    fclose(File);
+    return TRUE;
+}
+
+/* Rough mix of the cells a busy hive is made of */
+static ULONG
+HvbRandomCellSize(VOID)
+{
+    ULONG Kind = HvbRandom() % 100;
+
+    if (Kind < 40)
+        return HvbRandomRange(24, 60);      /* Value cells */
+    if (Kind < 65)
+        return HvbRandomRange(76, 140);     /* Key nodes */
+    if (Kind < 80)
+        return HvbRandomRange(8, 40);       /* Small data and security */
+    if (Kind < 95)
+        return HvbRandomRange(8, 512);      /* Index and value lists */
+
+    return HvbRandomRange(1024, 16000);     /* Large data */
+}
+
+/*
+ * Generates a churn trace whose number of live cells hovers around
+ * LiveTarget, with some of the cells growing the way lists do.
+ */
+static BOOLEAN
+HvbGenerateTrace(
+    IN ULONG OpCount,
+    IN ULONG LiveTarget,
+    OUT PHVB_TRACE Trace)
+{
+    PULONG Live;
+    ULONG LiveCount = 0;
+    ULONG NextId = 0;
+    ULONG Slot, Id;
+    BOOLEAN Success = TRUE;
+
+    Live = malloc((OpCount + 1) * sizeof(ULONG));
+    if (!Live)
+        return FALSE;
+
+    while (Success && Trace->Count < OpCount)
+    {
+        if (LiveCount > 0 && HvbRandom() % (2 * LiveTarget) < LiveCount)
+        {
+            Slot = HvbRandom() % LiveCount;
+            Id = Live[Slot];
+            Live[Slot] = Live[--LiveCount];
+            Success = HvbAddTraceOp(Trace, 'f', Id, 0);
+        }
+        else if (LiveCount > 0 && HvbRandom() % 10 == 0)
+        {
+            Id = Live[HvbRandom() % LiveCount];
+            Success = HvbAddTraceOp(Trace, 'r', Id, HvbRandomCellSize() * 2);
+        }
+        else
+        {
+            Live[LiveCount++] = NextId;
+            Success = HvbAddTraceOp(Trace, 'a', NextId++, HvbRandomCellSize());
+        }
+    }
+
+    free(Live);
+    return Success;
+}
+
+/* Stamps both ends of a cell so that overlapping allocations get caught */
+static VOID
+HvbStampCell(
+    IN PHHIVE Hive,
+    IN PHVB_LIVE_CELL Live,
+    IN ULONG Id)
+{
+    PUCHAR Data = HvGetCell(Hive, Live->Cell);
+
+    *(PULONG)Data = Id;
+    if (Live->Size >= 2 * sizeof(ULONG))
+        *(PULONG)(Data + ((Live->Size - sizeof(ULONG)) & ~3)) = ~Id;
+}
+
+static BOOLEAN
+HvbCheckCell(
+    IN PHHIVE Hive,
+    IN PHVB_LIVE_CELL Live,
+    IN ULONG Id)
+{
+    PUCHAR Data = HvGetCell(Hive, Live->Cell);
+
+    if (*(PULONG)Data != Id)
+        return FALSE;
+    if (Live->Size >= 2 * sizeof(ULONG) &&
+        *(PULONG)(Data + ((Live->Size - sizeof(ULONG)) & ~3)) != ~Id)
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static BOOLEAN
+HvbReplayTrace(
+    IN PHHIVE Hive,
+    IN PHVB_TRACE Trace)
+{
+    PHVB_LIVE_CELL Cells;
+    PHVB_TRACE_OP Op;
+    HCELL_INDEX Cell;
+    ULONG i;
+
+    Cells = malloc((Trace->IdCount + 1) * sizeof(HVB_LIVE_CELL));
+    if (!Cells)
+        return FALSE;
+    for (i = 0; i <= Trace->IdCount; i++)
+        Cells[i].Cell = HCELL_NIL;
+
+    for (i = 0; i < Trace->Count; i++)
+    {
+        Op = &Trace->Ops[i];
+
+        if (Op->Type != 'a' && Cells[Op->Id].Cell == HCELL_NIL)
+        {
+            printf("Operation %u: cell %u is not allocated\n", i, Op->Id);
+            goto Failure;
+        }
+        if (Op->Type != 'a' && !HvbCheckCell(Hive, &Cells[Op->Id], Op->Id))
+        {
+            printf("Operation %u: cell %u (%08x) was overwritten\n", i, Op->Id, Cells[Op->Id].Cell);
+            goto Failure;
+        }
+
+        switch (Op->Type)
+        {
+            case 'a':
+                if (Cells[Op->Id].Cell != HCELL_NIL)
+                {
+                    printf("Operation %u: cell %u is already allocated\n", i, Op->Id);
+                    goto Failure;
+                }
+                Cell = HvAllocateCell(Hive, max(Op->Size, sizeof(ULONG)), Stable, HCELL_NIL);
+                break;
+
+            case 'r':
+                Cell = HvReallocateCell(Hive, Cells[Op->Id].Cell, max(Op->Size, sizeof(ULONG)));
+                break;
+
+            default:
+                HvFreeCell(Hive, Cells[Op->Id].Cell);
+                Cells[Op->Id].Cell = HCELL_NIL;
+                continue;
+        }
+
+        if (Cell == HCELL_NIL)
+        {
+            printf("Operation %u: out of hive space\n", i);
+            goto Failure;
+        }
+
+        Cells[Op->Id].Cell = Cell;
+        Cells[Op->Id].Size = max(Op->Size, sizeof(ULONG));
+        HvbStampCell(Hive, &Cells[Op->Id], Op->Id);
+    }
+
+    free(Cells);
+    return TRUE;
+
+Failure:
+    free(Cells);
+    return FALSE;
+}
+
+int
+HvbCellBenchmark(
+    IN PHVB_OPTIONS Options)
+{
+    HVB_HIVE Hive;
+    HVB_TRACE Trace;
+    NTSTATUS Status;
+    clock_t Start;
+    double Seconds;
+    int Result = 1;
+
+    RtlZeroMemory(&Trace, sizeof(Trace));
+
+    if (Options->TraceFile)
+    {
+        if (!HvbReadTrace(Options->TraceFile, &Trace))
+            goto Quit;
+    }
+    else if (!HvbGenerateTrace(Options->Count, max(Options->Count / 8, 1), &Trace))
+    {
+        printf("Unable to generate the trace\n");
+        goto Quit;
+    }
+
+    if (Options->OutputFile && !HvbWriteTrace(Options->OutputFile, &Trace))
+        goto Quit;
+
+    Status = HvbCreateHive(&Hive);
+    if (!NT_SUCCESS(Status))
+    {
+        printf("HvInitialize() failed, Status 0x%08x\n", Status);
+        goto Quit;
+    }
+
+    Start = clock();
+    if (HvbReplayTrace(&Hive.Hive, &Trace))
+    {
+        Seconds = HvbSeconds(Start);
+        printf("operations     %u\n", Trace.Count);
+        if (!Options->Deterministic)
+        {
+            printf("time           %.3f s\n", Seconds);
+            if (Seconds > 0)
+                printf("ops/sec        %.0f\n", Trace.Count / Seconds);
+        }
+        HvbPrintHiveStats(&Hive.Hive);
+        Result = 0;
+    }
+
+    HvbFreeHive(&Hive);
+
+Quit:
+    free(Trace.Ops);
+    return Result;
+}
+
+/* EOF */
@@ -0,0 +1,512 @@
+/*
+ * PROJECT:     ReactOS hive benchmark
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Mutation fuzzer for the hive loader and key lookups
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <signal.h>
+
+#include "hivebench.h"
+
+/* GLOBALS ******************************************************************/
+
+#define HVB_FUZZ_MAX_DEPTH      64
+#define HVB_FUZZ_MAX_KEYS       4096
+#define HVB_FUZZ_MAX_CHILDREN   256
+#define HVB_FUZZ_NAME_LENGTH    256
+
+/* Seed of the running iteration, reported if the library crashes */
+static volatile ULONG HvbFuzzSeed;
+
+/*
+ * Seeds that crashed the library before, replayed against the built-in
+ * hive with the default mutation count on every run.
+ */
+#define HVB_FUZZ_MUTATIONS      4
+
+static const ULONG HvbFuzzRegressions[] =
+{
+    521,    /* Misaligned index cell read past its bin by CmPrepareHive */
+};
+
+/* FUNCTIONS ****************************************************************/
+
+static void
+HvbFuzzCrash(int Signal)
+{
+    printf("\n*** Signal %d, reproduce with -s %u -n 1 and the same -i and -m\n",
+           Signal, HvbFuzzSeed);
+    fflush(stdout);
+    exit(2);
+}
+
+/*
+ * The library trusts the cells a key points to, so the walk only hands it
+ * keys whose index and value list check out. Corruption that gets past
+ * these checks and crashes a lookup is what the fuzzer is after.
+ */
+static ULONG
+HvbCellDataSize(
+    IN PHHIVE Hive,
+    IN HCELL_INDEX Cell)
+{
+    PHMAP_ENTRY Entry;
+    PHBIN Bin;
+    PHCELL Header;
+    ULONG Size;
+
+    if (Cell == HCELL_NIL ||
+        HvGetCellType(Cell) != Stable ||
+        (Cell & 7) != 0 ||
+        !HvIsCellAllocated(Hive, Cell))
+    {
+        return 0;
+    }
+
+    /* The header itself must be inside the bin before we read it */
+    Entry = &Hive->Storage[Stable].BlockList[HvGetCellBlock(Cell)];
+    Bin = (PHBIN)Entry->BinAddress;
+    Header = (PHCELL)(Entry->BlockAddress + (Cell & HCELL_OFFSET_MASK));
+    if ((ULONG_PTR)Header < (ULONG_PTR)(Bin + 1) ||
+        (ULONG_PTR)Bin + Bin->Size - (ULONG_PTR)Header < sizeof(HCELL) ||
+        Header->Size >= 0)
+    {
+        return 0;
+    }
+
+    Size = (ULONG)0 - (ULONG)Header->Size;
+    if (Size < sizeof(HCELL) ||
+        Size > (ULONG_PTR)Bin + Bin->Size - (ULONG_PTR)Header)
+    {
+        return 0;
+    }
+
+    return Size - sizeof(HCELL);
+}
+
+static PCM_KEY_NODE
+HvbGetKeyNode(
+    IN PHHIVE Hive,
+    IN HCELL_INDEX Cell)
+{
+    PCM_KEY_NODE Node;
+    ULONG Size = HvbCellDataSize(Hive, Cell);
+
+    if (Size < FIELD_OFFSET(CM_KEY_NODE, Name))
+        return NULL;
+
+    Node = (PCM_KEY_NODE)HvGetCell(Hive, Cell);
+    if (Node->Signature != CM_KEY_NODE_SIGNATURE ||
+        Node->NameLength > Size - FIELD_OFFSET(CM_KEY_NODE, Name) ||
+        Node->SubKeyCounts[Volatile] != 0)
+    {
+        return NULL;
+    }
+
+    return Node;
+}
+
+static PCM_KEY_VALUE
+HvbGetKeyValue(
+    IN PHHIVE Hive,
+    IN HCELL_INDEX Cell)
+{
+    PCM_KEY_VALUE Value;
+    ULONG Size = HvbCellDataSize(Hive, Cell);
+
+    if (Size < FIELD_OFFSET(CM_KEY_VALUE, Name))
+        return NULL;
+
+    Value = (PCM_KEY_VALUE)HvGetCell(Hive, Cell);
+    if (Value->Signature != CM_KEY_VALUE_SIGNATURE ||
+        Value->NameLength > Size - FIELD_OFFSET(CM_KEY_VALUE, Name))
+    {
+        return NULL;
+    }
+
+    return Value;
+}
+
+static BOOLEAN
+HvbIsValidIndex(
+    IN PHHIVE Hive,
+    IN HCELL_INDEX Cell,
+    IN BOOLEAN AllowRoot,
+    IN OUT PULONG Count)
+{
+    PCM_KEY_INDEX Index;
+    PCM_KEY_FAST_INDEX FastIndex;
+    ULONG Size = HvbCellDataSize(Hive, Cell);
+    ULONG i;
+
+    if (Size < FIELD_OFFSET(CM_KEY_INDEX, List))
+        return FALSE;
+
+    Index = (PCM_KEY_INDEX)HvGetCell(Hive, Cell);
+    switch (Index->Signature)
+    {
+        case CM_KEY_INDEX_ROOT:
+        case CM_KEY_INDEX_LEAF:
+            if ((Index->Signature == CM_KEY_INDEX_ROOT && !AllowRoot) ||
+                Size < FIELD_OFFSET(CM_KEY_INDEX, List[Index->Count]))
+            {
+                return FALSE;
+            }
+
+            for (i = 0; i < Index->Count; i++)
+            {
+                if (Index->Signature == CM_KEY_INDEX_ROOT ?
+                    !HvbIsValidIndex(Hive, Index->List[i], FALSE, Count) :
+                    !HvbGetKeyNode(Hive, Index->List[i]))
+                {
+                    return FALSE;
+                }
+            }
+            if (Index->Signature == CM_KEY_INDEX_LEAF)
+                *Count += Index->Count;
+            return TRUE;
+
+        case CM_KEY_FAST_LEAF:
+        case CM_KEY_HASH_LEAF:
+            FastIndex = (PCM_KEY_FAST_INDEX)Index;
+            if (Size < FIELD_OFFSET(CM_KEY_FAST_INDEX, List[FastIndex->Count]))
+                return FALSE;
+
+            for (i = 0; i < FastIndex->Count; i++)
+            {
+                if (!HvbGetKeyNode(Hive, FastIndex->List[i].Cell))
+                    return FALSE;
+            }
+            *Count += FastIndex->Count;
+            return TRUE;
+
+        default:
+            return FALSE;
+    }
+}
+
+static BOOLEAN
+HvbIsValidValueList(
+    IN PHHIVE Hive,
+    IN PCHILD_LIST ValueList)
+{
+    PHCELL_INDEX List;
+    ULONG i;
+
+    if (ValueList->Count == 0)
+        return TRUE;
+
+    if (HvbCellDataSize(Hive, ValueList->List) < ValueList->Count * sizeof(HCELL_INDEX))
+        return FALSE;
+
+    List = (PHCELL_INDEX)HvGetCell(Hive, ValueList->List);
+    for (i = 0; i < ValueList->Count; i++)
+    {
+        if (!HvbGetKeyValue(Hive, List[i]))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Returns FALSE if the name has a path separator, which a key lookup never gets */
+static BOOLEAN
+HvbGetName(
+    OUT PUNICODE_STRING Name,
+    OUT PWCHAR Buffer,
+    IN PWCHAR Source,
+    IN USHORT Length,
+    IN BOOLEAN Compressed)
+{
+    ULONG Count, i;
+
+    if (Compressed)
+    {
+        Count = min(Length, HVB_FUZZ_NAME_LENGTH);
+        CmpCopyCompressedName(Buffer, Count * sizeof(WCHAR), Source, Count);
+    }
+    else
+    {
+        Count = min(Length / sizeof(WCHAR), HVB_FUZZ_NAME_LENGTH);
+        RtlCopyMemory(Buffer, Source, Count * sizeof(WCHAR));
+    }
+
+    Name->Buffer = Buffer;
+    Name->Length = Name->MaximumLength = (USHORT)(Count * sizeof(WCHAR));
+
+    for (i = 0; i < Count; i++)
+    {
+        if (Buffer[i] == OBJ_NAME_PATH_SEPARATOR)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Looks every value and subkey up by the name it carries */
+static VOID
+HvbWalkKey(
+    IN PHHIVE Hive,
+    IN PCM_KEY_NODE Node,
+    IN ULONG Depth,
+    IN OUT PULONG Budget,
+    IN OUT PULONG Skipped)
+{
+    WCHAR Buffer[HVB_FUZZ_NAME_LENGTH];
+    UNICODE_STRING Name;
+    PCM_KEY_NODE Child;
+    PCM_KEY_VALUE Value;
+    PHCELL_INDEX ValueList;
+    HCELL_INDEX ChildCell;
+    ULONG Count = 0;
+    ULONG i;
+
+    if (Depth > HVB_FUZZ_MAX_DEPTH || *Budget == 0)
+        return;
+    (*Budget)--;
+
+    if (!HvbIsValidValueList(Hive, &Node->ValueList) ||
+        (Node->SubKeyCounts[Stable] &&
+         (!HvbIsValidIndex(Hive, Node->SubKeyLists[Stable], TRUE, &Count) ||
+          Count != Node->SubKeyCounts[Stable])))
+    {
+        (*Skipped)++;
+        return;
+    }
+
+    if (Node->ValueList.Count)
+    {
+        ValueList = (PHCELL_INDEX)HvGetCell(Hive, Node->ValueList.List);
+        for (i = 0; i < min(Node->ValueList.Count, HVB_FUZZ_MAX_CHILDREN); i++)
+        {
+            Value = (PCM_KEY_VALUE)HvGetCell(Hive, ValueList[i]);
+            HvbGetName(&Name, Buffer, Value->Name, Value->NameLength,
+                       (Value->Flags & VALUE_COMP_NAME) != 0);
+            CmpFindValueByName(Hive, Node, &Name);
+        }
+    }
+
+    for (i = 0; i < min(Node->SubKeyCounts[Stable], HVB_FUZZ_MAX_CHILDREN); i++)
+    {
+        ChildCell = CmpFindSubKeyByNumber(Hive, Node, i);
+        Child = HvbGetKeyNode(Hive, ChildCell);
+        if (!Child)
+            continue;
+
+        if (HvbGetName(&Name, Buffer, Child->Name, Child->NameLength,
+                       (Child->Flags & KEY_COMP_NAME) != 0))
+        {
+            CmpFindSubKeyByName(Hive, Node, &Name);
+        }
+
+        HvbWalkKey(Hive, Child, Depth + 1, Budget, Skipped);
+    }
+}
+
+/* Builds a small hive with every kind of index when no input is given */
+static BOOLEAN
+HvbBuildFuzzImage(
+    OUT PUCHAR *Image,
+    OUT PULONG ImageSize)
+{
+    WCHAR Buffer[32];
+    UNICODE_STRING Name;
+    HVB_HIVE Hive;
+    HCELL_INDEX Root, Parent;
+    ULONG i;
+    BOOLEAN Success = FALSE;
+
+    if (!NT_SUCCESS(HvbCreateHive(&Hive)))
+        return FALSE;
+
+    if (!CmCreateRootNode(&Hive.Hive, L""))
+        goto Quit;
+
+    Root = Hive.Hive.BaseBlock->RootCell;
+    for (i = 0; i < 600; i++)
+    {
+        HvbInitName(&Name, Buffer, _countof(Buffer), "Key", i);
+        if (HvbCreateKey(&Hive.Hive, Root, &Name) == HCELL_NIL)
+            goto Quit;
+    }
+
+    Parent = Root;
+    for (i = 0; i < 16; i++)
+    {
+        HvbInitName(&Name, Buffer, _countof(Buffer), "Level", i);
+        Parent = HvbCreateKey(&Hive.Hive, Parent, &Name);
+        if (Parent == HCELL_NIL)
+            goto Quit;
+    }
+
+    if (!HvbWriteHive(&Hive))
+        goto Quit;
+
+    *Image = malloc(Hive.ImageSize);
+    if (*Image)
+    {
+        RtlCopyMemory(*Image, Hive.Image, Hive.ImageSize);
+        *ImageSize = Hive.ImageSize;
+        Success = TRUE;
+    }
+
+Quit:
+    HvbFreeHive(&Hive);
+    return Success;
+}
+
+static VOID
+HvbMutate(
+    IN OUT PUCHAR Image,
+    IN ULONG ImageSize,
+    IN ULONG Mutations)
+{
+    ULONG Offset;
+    ULONG i;
+
+    /* Leave the base block alone, its checksum rejects nearly any change */
+    for (i = 0; i < Mutations; i++)
+    {
+        Offset = HBLOCK_SIZE + HvbRandom() % (ImageSize - HBLOCK_SIZE);
+        switch (HvbRandom() % 4)
+        {
+            case 0: Image[Offset] ^= (UCHAR)(1 << (HvbRandom() % 8)); break;
+            case 1: Image[Offset] = (UCHAR)HvbRandom(); break;
+            case 2: Image[Offset] = 0x00; break;
+            default: Image[Offset] = 0xFF; break;
+        }
+    }
+}
+
+static BOOLEAN
+HvbFuzzIteration(
+    IN PUCHAR Work,
+    IN PUCHAR Image,
+    IN ULONG ImageSize,
+    IN ULONG Seed,
+    IN ULONG Mutations,
+    IN OUT PULONG Keys,
+    IN OUT PULONG Skipped)
+{
+    HVB_HIVE Hive;
+    ULONG Budget;
+    PCM_KEY_NODE Root;
+
+    HvbFuzzSeed = Seed;
+    HvbSeed = Seed;
+
+    RtlCopyMemory(Work, Image, ImageSize);
+    HvbMutate(Work, ImageSize, Mutations);
+
+    if (!NT_SUCCESS(HvbLoadHive(&Hive, Work, ImageSize)))
+        return FALSE;
+
+    Budget = HVB_FUZZ_MAX_KEYS;
+    Root = HvbGetKeyNode(&Hive.Hive, Hive.Hive.BaseBlock->RootCell);
+    if (Root)
+        HvbWalkKey(&Hive.Hive, Root, 0, &Budget, Skipped);
+    *Keys += HVB_FUZZ_MAX_KEYS - Budget;
+
+    HvbWriteHive(&Hive);
+    HvbFreeHive(&Hive);
+    return TRUE;
+}
+
+int
+HvbFuzz(
+    IN PHVB_OPTIONS Options)
+{
+    PUCHAR Image = NULL;
+    PUCHAR Work = NULL;
+    ULONG ImageSize;
+    ULONG Iteration;
+    ULONG Regressions = 0;
+    ULONG Loaded = 0, Rejected = 0, Keys = 0, Skipped = 0;
+    clock_t Start;
+    double Seconds;
+    int Result = 1;
+
+    if (Options->InputFile)
+    {
+        if (!HvbReadFile(Options->InputFile, &Image, &ImageSize))
+            return 1;
+    }
+    else if (!HvbBuildFuzzImage(&Image, &ImageSize))
+    {
+        printf("Unable to build the hive to fuzz\n");
+        return 1;
+    }
+
+    if (ImageSize <= HBLOCK_SIZE)
+    {
+        printf("The hive has no bins to mutate\n");
+        goto Quit;
+    }
+
+    Work = malloc(ImageSize);
+    if (!Work)
+        goto Quit;
+
+    signal(SIGSEGV, HvbFuzzCrash);
+    signal(SIGABRT, HvbFuzzCrash);
+
+    /* The regression seeds only reproduce against the hive they were found on */
+    if (!Options->InputFile)
+    {
+        ULONG RegressionKeys = 0, RegressionSkipped = 0;
+
+        for (Iteration = 0; Iteration < _countof(HvbFuzzRegressions); Iteration++)
+        {
+            HvbFuzzIteration(Work, Image, ImageSize,
+                             HvbFuzzRegressions[Iteration], HVB_FUZZ_MUTATIONS,
+                             &RegressionKeys, &RegressionSkipped);
+            Regressions++;
+        }
+    }
+
+    Start = clock();
+    for (Iteration = 0; Iteration < Options->Count; Iteration++)
+    {
+        /* Every iteration has its own seed, so that it can be replayed alone */
+        if (Options->Verbose)
+        {
+            printf("iteration %u, seed %u\n", Iteration, Options->Seed + Iteration);
+            fflush(stdout);
+        }
+
+        if (HvbFuzzIteration(Work, Image, ImageSize,
+                             Options->Seed + Iteration, Options->Mutations,
+                             &Keys, &Skipped))
+        {
+            Loaded++;
+        }
+        else
+        {
+            Rejected++;
+        }
+    }
+    Seconds = HvbSeconds(Start);
+
+    signal(SIGSEGV, SIG_DFL);
+    signal(SIGABRT, SIG_DFL);
+
+    printf("regressions    %u\n", Regressions);
+    printf("iterations     %u\n", Options->Count);
+    printf("loaded         %u\n", Loaded);
+    printf("rejected       %u\n", Rejected);
+    printf("keys walked    %u\n", Keys);
+    printf("keys skipped   %u\n", Skipped);
+    if (!Options->Deterministic && Seconds > 0)
+        printf("iterations/sec %.0f\n", Options->Count / Seconds);
+    Result = 0;
+
+Quit:
+    free(Work);
+    free(Image);
+    return Result;
+}
+
+/* EOF */
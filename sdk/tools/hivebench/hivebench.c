@@ -0,0 +1,424 @@
+/*
+ * PROJECT:     ReactOS hive benchmark
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Host benchmark for the registry hive library
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include "hivebench.h"
+
+/* GLOBALS ******************************************************************/
+
+ULONG HvbSeed = 1;
+
+/* FUNCTIONS ****************************************************************/
+
+PVOID
+NTAPI
+CmpAllocate(
+    IN SIZE_T Size,
+    IN BOOLEAN Paged,
+    IN ULONG Tag)
+{
+    return (PVOID)malloc((size_t)Size);
+}
+
+VOID
+NTAPI
+CmpFree(
+    IN PVOID Ptr,
+    IN ULONG Quota)
+{
+    free(Ptr);
+}
+
+/* Deterministic generator, so that a seed always yields the same workload */
+ULONG
+HvbRandom(VOID)
+{
+    HvbSeed = HvbSeed * 1103515245 + 12345;
+    return (HvbSeed >> 1) & 0x7FFFFFFF;
+}
+
+ULONG
+HvbRandomRange(
+    IN ULONG Low,
+    IN ULONG High)
+{
+    return Low + HvbRandom() % (High - Low + 1);
+}
+
+double
+HvbSeconds(
+    IN clock_t Start)
+{
+    return (double)(clock() - Start) / CLOCKS_PER_SEC;
+}
+
+BOOLEAN
+HvbReadFile(
+    IN PCSTR FileName,
+    OUT PUCHAR *Data,
+    OUT PULONG Size)
+{
+    FILE *File;
+    long Length;
+
+    File = fopen(FileName, "rb");
+    if (!File)
+    {
+        printf("Unable to open '%s'\n", FileName);
+        return FALSE;
+    }
+
+    fseek(File, 0, SEEK_END);
+    Length = ftell(File);
+    fseek(File, 0, SEEK_SET);
+
+    *Data = malloc(Length > 0 ? Length : 1);
+    if (Length < 0 || !*Data || fread(*Data, 1, Length, File) != (size_t)Length)
+    {
+        printf("Unable to read '%s'\n", FileName);
+        free(*Data);
+        fclose(File);
+        return FALSE;
+    }
+
+    *Size = (ULONG)Length;
+    fclose(File);
+    return TRUE;
+}
+
+/*
+ * The hive "file" is a memory image, so that writing a hive measures the
+ * library rather than the disk.
+ */
+static BOOLEAN
+HvbReserveImage(
+    IN OUT PHVB_HIVE Hive,
+    IN ULONG Size)
+{
+    PUCHAR Image;
+    ULONG NewMax;
+
+    if (Size <= Hive->ImageMax)
+        return TRUE;
+
+    NewMax = max(Size, Hive->ImageMax * 2);
+    Image = realloc(Hive->Image, NewMax);
+    if (!Image)
+        return FALSE;
+
+    Hive->Image = Image;
+    Hive->ImageMax = NewMax;
+    return TRUE;
+}
+
+static BOOLEAN
+NTAPI
+HvbFileSetSize(
+    IN PHHIVE RegistryHive,
+    IN ULONG FileType,
+    IN ULONG FileSize,
+    IN ULONG OldFileSize)
+{
+    PHVB_HIVE Hive = CONTAINING_RECORD(RegistryHive, HVB_HIVE, Hive);
+
+    if (!HvbReserveImage(Hive, FileSize))
+        return FALSE;
+
+    if (FileSize > Hive->ImageSize)
+        RtlZeroMemory(Hive->Image + Hive->ImageSize, FileSize - Hive->ImageSize);
+
+    Hive->ImageSize = FileSize;
+    return TRUE;
+}
+
+static BOOLEAN
+NTAPI
+HvbFileWrite(
+    IN PHHIVE RegistryHive,
+    IN ULONG FileType,
+    IN PULONG FileOffset,
+    IN PVOID Buffer,
+    IN SIZE_T BufferLength)
+{
+    PHVB_HIVE Hive = CONTAINING_RECORD(RegistryHive, HVB_HIVE, Hive);
+    ULONG End = *FileOffset + (ULONG)BufferLength;
+
+    if (!HvbReserveImage(Hive, End))
+        return FALSE;
+
+    if (*FileOffset > Hive->ImageSize)
+        RtlZeroMemory(Hive->Image + Hive->ImageSize, *FileOffset - Hive->ImageSize);
+
+    RtlCopyMemory(Hive->Image + *FileOffset, Buffer, BufferLength);
+    Hive->ImageSize = max(Hive->ImageSize, End);
+    return TRUE;
+}
+
+static BOOLEAN
+NTAPI
+HvbFileRead(
+    IN PHHIVE RegistryHive,
+    IN ULONG FileType,
+    IN PULONG FileOffset,
+    OUT PVOID Buffer,
+    IN SIZE_T BufferLength)
+{
+    PHVB_HIVE Hive = CONTAINING_RECORD(RegistryHive, HVB_HIVE, Hive);
+
+    if (*FileOffset + BufferLength > Hive->ImageSize)
+        return FALSE;
+
+    RtlCopyMemory(Buffer, Hive->Image + *FileOffset, BufferLength);
+    return TRUE;
+}
+
+static BOOLEAN
+NTAPI
+HvbFileFlush(
+    IN PHHIVE RegistryHive,
+    IN ULONG FileType,
+    PLARGE_INTEGER FileOffset,
+    ULONG Length)
+{
+    return TRUE;
+}
+
+static NTSTATUS
+HvbInitializeHive(
+    OUT PHVB_HIVE Hive,
+    IN ULONG OperationType,
+    IN PVOID HiveData OPTIONAL)
+{
+    RtlZeroMemory(Hive, sizeof(*Hive));
+
+    return HvInitialize(&Hive->Hive,
+                        OperationType,
+                        HIVE_NOLAZYFLUSH,
+                        HFILE_TYPE_PRIMARY,
+                        HiveData,
+                        CmpAllocate,
+                        CmpFree,
+                        HvbFileSetSize,
+                        HvbFileWrite,
+                        HvbFileRead,
+                        HvbFileFlush,
+                        1,
+                        NULL);
+}
+
+NTSTATUS
+HvbCreateHive(
+    OUT PHVB_HIVE Hive)
+{
+    return HvbInitializeHive(Hive, HINIT_CREATE, NULL);
+}
+
+NTSTATUS
+HvbLoadHive(
+    OUT PHVB_HIVE Hive,
+    IN PUCHAR Image,
+    IN ULONG ImageSize)
+{
+    PHBASE_BLOCK BaseBlock = (PHBASE_BLOCK)Image;
+
+    /* The library trusts the length in the base block, check it against the file */
+    if (ImageSize < sizeof(HBASE_BLOCK) ||
+        BaseBlock->Length > ImageSize - HBLOCK_SIZE ||
+        (BaseBlock->Length % HBLOCK_SIZE) != 0)
+    {
+        return STATUS_REGISTRY_CORRUPT;
+    }
+
+    return HvbInitializeHive(Hive, HINIT_MEMORY, Image);
+}
+
+BOOLEAN
+HvbWriteHive(
+    IN OUT PHVB_HIVE Hive)
+{
+    Hive->ImageSize = 0;
+    return HvWriteHive(&Hive->Hive);
+}
+
+VOID
+HvbFreeHive(
+    IN OUT PHVB_HIVE Hive)
+{
+    HvFree(&Hive->Hive);
+    free(Hive->Image);
+    Hive->Image = NULL;
+    Hive->ImageSize = Hive->ImageMax = 0;
+}
+
+/* FNV-1a of the written image, a stable fingerprint for regression runs */
+ULONG
+HvbImageChecksum(
+    IN PHVB_HIVE Hive)
+{
+    ULONG Hash = 2166136261U;
+    ULONG i;
+
+    for (i = 0; i < Hive->ImageSize; i++)
+        Hash = (Hash ^ Hive->Image[i]) * 16777619U;
+
+    return Hash;
+}
+
+VOID
+HvbGetHiveStats(
+    IN PHHIVE Hive,
+    IN HSTORAGE_TYPE Storage,
+    OUT PHVB_HIVE_STATS Stats)
+{
+    PHBIN Bin;
+    PHCELL Cell;
+    ULONG BlockIndex;
+    ULONG Offset;
+    ULONG Size;
+
+    RtlZeroMemory(Stats, sizeof(*Stats));
+    Stats->Length = Hive->Storage[Storage].Length * HBLOCK_SIZE;
+
+    for (BlockIndex = 0; BlockIndex < Hive->Storage[Storage].Length; )
+    {
+        Bin = (PHBIN)Hive->Storage[Storage].BlockList[BlockIndex].BinAddress;
+        Stats->Bins++;
+
+        for (Offset = sizeof(HBIN); Offset < Bin->Size; Offset += Size)
+        {
+            Cell = (PHCELL)((ULONG_PTR)Bin + Offset);
+            if (Cell->Size > 0)
+            {
+                Size = Cell->Size;
+                Stats->FreeCells++;
+                Stats->FreeBytes += Size;
+                Stats->LargestFree = max(Stats->LargestFree, Size);
+            }
+            else
+            {
+                Size = -Cell->Size;
+                Stats->UsedCells++;
+                Stats->UsedBytes += Size;
+            }
+
+            if (Size == 0)
+                break;
+        }
+
+        BlockIndex += Bin->Size / HBLOCK_SIZE;
+    }
+}
+
+VOID
+HvbPrintHiveStats(
+    IN PHHIVE Hive)
+{
+    HVB_HIVE_STATS Stats;
+
+    HvbGetHiveStats(Hive, Stable, &Stats);
+    printf("hive size      %u bytes in %u bins\n", Stats.Length, Stats.Bins);
+    printf("used cells     %u (%u bytes)\n", Stats.UsedCells, Stats.UsedBytes);
+    printf("free cells     %u (%u bytes, largest %u)\n",
+           Stats.FreeCells, Stats.FreeBytes, Stats.LargestFree);
+    if (Stats.Length)
+    {
+        printf("free space     %.1f%%\n",
+               100.0 * Stats.FreeBytes / Stats.Length);
+    }
+}
+
+static VOID
+HvbUsage(VOID)
+{
+    printf("Usage: hivebench <command> [options]\n"
+           "\n"
+           "Commands:\n"
+           "  cells      Replay a cell allocation trace against a new hive\n"
+           "  keys       Run key and value workloads and write the hive\n"
+           "  fuzz       Load mutated copies of a hive and walk them\n"
+           "\n"
+           "Options:\n"
+           "  -n count   Operations (cells, keys) or iterations (fuzz)\n"
+           "  -s seed    Seed of the generated workload (default 1)\n"
+           "  -d         Deterministic output: no timings, for regression runs\n"
+           "  -v         Verbose output\n"
+           "  -t trace   cells: replay the given trace instead of generating one\n"
+           "  -o file    cells: save the replayed trace; keys: save the last hive\n"
+           "  -i hive    keys, fuzz: start from this hive file\n"
+           "  -w name    keys: run only the deep, wide or values workload\n"
+           "  -m count   fuzz: bytes to mutate per iteration (default 4)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    HVB_OPTIONS Options;
+    int i;
+
+    RtlZeroMemory(&Options, sizeof(Options));
+    Options.Seed = 1;
+    Options.Mutations = 4;
+
+    if (argc < 2)
+    {
+        HvbUsage();
+        return 1;
+    }
+
+    for (i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-d") == 0)
+            Options.Deterministic = TRUE;
+        else if (strcmp(argv[i], "-v") == 0)
+            Options.Verbose = TRUE;
+        else if (i + 1 < argc && strcmp(argv[i], "-n") == 0)
+            Options.Count = strtoul(argv[++i], NULL, 0);
+        else if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+            Options.Seed = strtoul(argv[++i], NULL, 0);
+        else if (i + 1 < argc && strcmp(argv[i], "-m") == 0)
+            Options.Mutations = strtoul(argv[++i], NULL, 0);
+        else if (i + 1 < argc && strcmp(argv[i], "-t") == 0)
+            Options.TraceFile = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-o") == 0)
+            Options.OutputFile = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-i") == 0)
+            Options.InputFile = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-w") == 0)
+            Options.Workload = argv[++i];
+        else
+        {
+            HvbUsage();
+            return 1;
+        }
+    }
+
+    HvbSeed = Options.Seed;
+
+    if (strcmp(argv[1], "cells") == 0)
+    {
+        if (!Options.Count)
+            Options.Count = 1000000;
+        return HvbCellBenchmark(&Options);
+    }
+    else if (strcmp(argv[1], "keys") == 0)
+    {
+        if (!Options.Count)
+            Options.Count = 100000;
+        return HvbKeyBenchmark(&Options);
+    }
+    else if (strcmp(argv[1], "fuzz") == 0)
+    {
+        if (!Options.Count)
+            Options.Count = 1000;
+        return HvbFuzz(&Options);
+    }
+
+    HvbUsage();
+    return 1;
+}
+
+/* EOF */
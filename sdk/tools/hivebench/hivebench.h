@@ -0,0 +1,159 @@
+/*
+ * PROJECT:     ReactOS hive benchmark
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Host benchmark for the registry hive library
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <typedefs.h>
+
+unsigned char BitScanForward(ULONG * Index, unsigned long Mask);
+unsigned char BitScanReverse(ULONG * const Index, unsigned long Mask);
+#define RtlFillMemoryUlong(dst, len, val) memset(dst, val, len)
+
+#ifdef _M_AMD64
+#define BitScanForward64 _BitScanForward64
+#define BitScanReverse64 _BitScanReverse64
+#endif
+
+#ifndef _MSC_VER
+#ifndef _countof
+#define _countof(_Array) (sizeof(_Array) / sizeof(_Array[0]))
+#endif
+#endif
+
+#ifndef max
+#define max(a, b)  (((a) > (b)) ? (a) : (b))
+#endif
+
+#define RtlFillMemory(Destination, Length, Fill) memset(Destination, Fill, Length)
+
+// Definitions copied from <winnt.h>
+#define REG_BINARY                       3
+
+#define CMLIB_HOST
+#include <cmlib.h>
+
+/* A hive together with the in-memory image it is written to */
+typedef struct _HVB_HIVE
+{
+    HHIVE Hive;
+    PUCHAR Image;
+    ULONG ImageSize;
+    ULONG ImageMax;
+} HVB_HIVE, *PHVB_HIVE;
+
+typedef struct _HVB_HIVE_STATS
+{
+    ULONG Bins;
+    ULONG Length;
+    ULONG UsedCells;
+    ULONG UsedBytes;
+    ULONG FreeCells;
+    ULONG FreeBytes;
+    ULONG LargestFree;
+} HVB_HIVE_STATS, *PHVB_HIVE_STATS;
+
+typedef struct _HVB_OPTIONS
+{
+    PCSTR InputFile;
+    PCSTR OutputFile;
+    PCSTR TraceFile;
+    PCSTR Workload;
+    ULONG Count;
+    ULONG Seed;
+    ULONG Mutations;
+    BOOLEAN Deterministic;
+    BOOLEAN Verbose;
+} HVB_OPTIONS, *PHVB_OPTIONS;
+
+/* hivebench.c */
+extern ULONG HvbSeed;
+
+ULONG
+HvbRandom(VOID);
+
+ULONG
+HvbRandomRange(
+    IN ULONG Low,
+    IN ULONG High);
+
+double
+HvbSeconds(
+    IN clock_t Start);
+
+BOOLEAN
+HvbReadFile(
+    IN PCSTR FileName,
+    OUT PUCHAR *Data,
+    OUT PULONG Size);
+
+NTSTATUS
+HvbCreateHive(
+    OUT PHVB_HIVE Hive);
+
+NTSTATUS
+HvbLoadHive(
+    OUT PHVB_HIVE Hive,
+    IN PUCHAR Image,
+    IN ULONG ImageSize);
+
+BOOLEAN
+HvbWriteHive(
+    IN OUT PHVB_HIVE Hive);
+
+VOID
+HvbFreeHive(
+    IN OUT PHVB_HIVE Hive);
+
+ULONG
+HvbImageChecksum(
+    IN PHVB_HIVE Hive);
+
+VOID
+HvbGetHiveStats(
+    IN PHHIVE Hive,
+    IN HSTORAGE_TYPE Storage,
+    OUT PHVB_HIVE_STATS Stats);
+
+VOID
+HvbPrintHiveStats(
+    IN PHHIVE Hive);
+
+/* cells.c */
+int
+HvbCellBenchmark(
+    IN PHVB_OPTIONS Options);
+
+/* keys.c */
+VOID
+HvbInitName(
+    OUT PUNICODE_STRING Name,
+    OUT PWCHAR Buffer,
+    IN ULONG BufferCount,
+    IN PCSTR Prefix,
+    IN ULONG Number);
+
+HCELL_INDEX
+HvbCreateKey(
+    IN PHHIVE Hive,
+    IN HCELL_INDEX Parent,
+    IN PUNICODE_STRING Name);
+
+int
+HvbKeyBenchmark(
+    IN PHVB_OPTIONS Options);
+
+/* fuzz.c */
+int
+HvbFuzz(
+    IN PHVB_OPTIONS Options);
+
+/* EOF */
@@ -0,0 +1,596 @@
+/*
+ * PROJECT:     ReactOS hive benchmark
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Key and value workloads
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include "hivebench.h"
+
+/* TYPES ********************************************************************/
+
+#define HVB_NAME_LENGTH     32
+#define HVB_DEEP_LEVELS     32
+#define HVB_VALUES_PER_KEY  16
+#define HVB_WRITE_COUNT     8
+
+typedef struct _HVB_PHASE
+{
+    ULONG Operations;
+    double Seconds;
+} HVB_PHASE, *PHVB_PHASE;
+
+typedef struct _HVB_WORKLOAD
+{
+    PCSTR Name;
+    BOOLEAN (*Run)(IN PHVB_HIVE Hive, IN HCELL_INDEX Base, IN ULONG Count,
+                   OUT PHVB_PHASE Create, OUT PHVB_PHASE Lookup);
+} HVB_WORKLOAD, *PHVB_WORKLOAD;
+
+/* FUNCTIONS ****************************************************************/
+
+VOID
+HvbInitName(
+    OUT PUNICODE_STRING Name,
+    OUT PWCHAR Buffer,
+    IN ULONG BufferCount,
+    IN PCSTR Prefix,
+    IN ULONG Number)
+{
+    CHAR AnsiName[HVB_NAME_LENGTH];
+    ULONG i;
+
+    snprintf(AnsiName, sizeof(AnsiName), "%s%08x", Prefix, Number);
+    for (i = 0; AnsiName[i] && i < BufferCount - 1; i++)
+        Buffer[i] = (WCHAR)AnsiName[i];
+    Buffer[i] = UNICODE_NULL;
+
+    Name->Buffer = Buffer;
+    Name->Length = (USHORT)(i * sizeof(WCHAR));
+    Name->MaximumLength = (USHORT)(BufferCount * sizeof(WCHAR));
+}
+
+HCELL_INDEX
+HvbCreateKey(
+    IN PHHIVE Hive,
+    IN HCELL_INDEX Parent,
+    IN PUNICODE_STRING Name)
+{
+    PCM_KEY_NODE ParentNode;
+    PCM_KEY_NODE Node;
+    HCELL_INDEX Cell;
+
+    /* Like CmpDoCreate, make sure the name is not taken yet */
+    ParentNode = (PCM_KEY_NODE)HvGetCell(Hive, Parent);
+    if (CmpFindSubKeyByName(Hive, ParentNode, Name) != HCELL_NIL)
+        return HCELL_NIL;
+
+    Cell = HvAllocateCell(Hive,
+                          FIELD_OFFSET(CM_KEY_NODE, Name) + CmpNameSize(Hive, Name),
+                          Stable,
+                          HCELL_NIL);
+    if (Cell == HCELL_NIL)
+        return HCELL_NIL;
+
+    /* The cell comes back zeroed, only set what is not zero */
+    Node = (PCM_KEY_NODE)HvGetCell(Hive, Cell);
+    Node->Signature = CM_KEY_NODE_SIGNATURE;
+    Node->Parent = Parent;
+    Node->SubKeyLists[Stable] = HCELL_NIL;
+    Node->SubKeyLists[Volatile] = HCELL_NIL;
+    Node->ValueList.List = HCELL_NIL;
+    Node->Security = HCELL_NIL;
+    Node->Class = HCELL_NIL;
+    Node->NameLength = CmpCopyName(Hive, Node->Name, Name);
+    if (Node->NameLength < Name->Length)
+        Node->Flags |= KEY_COMP_NAME;
+
+    if (!CmpAddSubKey(Hive, Parent, Cell))
+    {
+        HvFreeCell(Hive, Cell);
+        return HCELL_NIL;
+    }
+
+    ParentNode = (PCM_KEY_NODE)HvGetCell(Hive, Parent);
+    if (ParentNode->MaxNameLen < Name->Length)
+        ParentNode->MaxNameLen = Name->Length;
+
+    return Cell;
+}
+
+static HCELL_INDEX
+HvbSetValue(
+    IN PHHIVE Hive,
+    IN HCELL_INDEX KeyCell,
+    IN PUNICODE_STRING Name,
+    IN ULONG DataSize)
+{
+    PCM_KEY_NODE Node;
+    PCM_KEY_VALUE Value;
+    HCELL_INDEX ValueCell;
+    HCELL_INDEX DataCell;
+    ULONG ChildIndex;
+
+    Node = (PCM_KEY_NODE)HvGetCell(Hive, KeyCell);
+    if (!CmpFindNameInList(Hive, &Node->ValueList, Name, &ChildIndex, &ValueCell) ||
+        ValueCell != HCELL_NIL)
+    {
+        return HCELL_NIL;
+    }
+
+    ValueCell = HvAllocateCell(Hive,
+                               FIELD_OFFSET(CM_KEY_VALUE, Name) + CmpNameSize(Hive, Name),
+                               Stable,
+                               HCELL_NIL);
+    if (ValueCell == HCELL_NIL)
+        return HCELL_NIL;
+
+    Value = (PCM_KEY_VALUE)HvGetCell(Hive, ValueCell);
+    Value->Signature = CM_KEY_VALUE_SIGNATURE;
+    Value->Type = REG_BINARY;
+    Value->NameLength = CmpCopyName(Hive, Value->Name, Name);
+    if (Value->NameLength < Name->Length)
+        Value->Flags = VALUE_COMP_NAME;
+
+    /* Small data lives in the value cell itself */
+    if (DataSize <= sizeof(HCELL_INDEX))
+    {
+        RtlFillMemory(&Value->Data, DataSize, (UCHAR)DataSize);
+        Value->DataLength = DataSize | CM_KEY_VALUE_SPECIAL_SIZE;
+    }
+    else
+    {
+        DataCell = HvAllocateCell(Hive, DataSize, Stable, HCELL_NIL);
+        if (DataCell == HCELL_NIL)
+        {
+            HvFreeCell(Hive, ValueCell);
+            return HCELL_NIL;
+        }
+
+        RtlFillMemory(HvGetCell(Hive, DataCell), DataSize, (UCHAR)DataSize);
+        Value->Data = DataCell;
+        Value->DataLength = DataSize;
+    }
+
+    if (!NT_SUCCESS(CmpAddValueToList(Hive, ValueCell, ChildIndex, Stable, &Node->ValueList)))
+    {
+        CmpFreeValue(Hive, ValueCell);
+        return HCELL_NIL;
+    }
+
+    if (Node->MaxValueNameLen < Name->Length)
+        Node->MaxValueNameLen = Name->Length;
+    if (Node->MaxValueDataLen < DataSize)
+        Node->MaxValueDataLen = DataSize;
+
+    return ValueCell;
+}
+
+static BOOLEAN
+HvbLookupKey(
+    IN PHHIVE Hive,
+    IN HCELL_INDEX Parent,
+    IN PUNICODE_STRING Name,
+    IN HCELL_INDEX Expected)
+{
+    PCM_KEY_NODE Node = (PCM_KEY_NODE)HvGetCell(Hive, Parent);
+
+    if (CmpFindSubKeyByName(Hive, Node, Name) != Expected)
+    {
+        printf("Lookup of key %08x returned the wrong cell\n", Expected);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Random permutation of 0..Count-1, so that names are not inserted in order */
+static PULONG
+HvbShuffle(
+    IN ULONG Count)
+{
+    PULONG Order;
+    ULONG i, j, Temp;
+
+    Order = malloc(max(Count, 1) * sizeof(ULONG));
+    if (!Order)
+        return NULL;
+
+    for (i = 0; i < Count; i++)
+        Order[i] = i;
+
+    for (i = Count; i > 1; i--)
+    {
+        j = HvbRandom() % i;
+        Temp = Order[i - 1];
+        Order[i - 1] = Order[j];
+        Order[j] = Temp;
+    }
+
+    return Order;
+}
+
+/* Chains of HVB_DEEP_LEVELS nested keys, looked up level by level */
+static BOOLEAN
+HvbRunDeep(
+    IN PHVB_HIVE Hive,
+    IN HCELL_INDEX Base,
+    IN ULONG Count,
+    OUT PHVB_PHASE Create,
+    OUT PHVB_PHASE Lookup)
+{
+    WCHAR Buffer[HVB_NAME_LENGTH];
+    UNICODE_STRING Name;
+    PHCELL_INDEX Cells;
+    HCELL_INDEX Parent;
+    ULONG Chains = max(Count / HVB_DEEP_LEVELS, 1);
+    ULONG Chain, Level;
+    clock_t Start;
+    BOOLEAN Success = FALSE;
+
+    Cells = malloc(Chains * HVB_DEEP_LEVELS * sizeof(HCELL_INDEX));
+    if (!Cells)
+        return FALSE;
+
+    Start = clock();
+    for (Chain = 0; Chain < Chains; Chain++)
+    {
+        Parent = Base;
+        for (Level = 0; Level < HVB_DEEP_LEVELS; Level++)
+        {
+            HvbInitName(&Name, Buffer, _countof(Buffer), Level ? "Level" : "Chain", Level ? Level : Chain);
+            Parent = HvbCreateKey(&Hive->Hive, Parent, &Name);
+            if (Parent == HCELL_NIL)
+                goto Quit;
+            Cells[Chain * HVB_DEEP_LEVELS + Level] = Parent;
+        }
+    }
+    Create->Operations = Chains * HVB_DEEP_LEVELS;
+    Create->Seconds = HvbSeconds(Start);
+
+    Start = clock();
+    for (Chain = 0; Chain < Chains; Chain++)
+    {
+        Parent = Base;
+        for (Level = 0; Level < HVB_DEEP_LEVELS; Level++)
+        {
+            HvbInitName(&Name, Buffer, _countof(Buffer), Level ? "Level" : "Chain", Level ? Level : Chain);
+            if (!HvbLookupKey(&Hive->Hive, Parent, &Name, Cells[Chain * HVB_DEEP_LEVELS + Level]))
+                goto Quit;
+            Parent = Cells[Chain * HVB_DEEP_LEVELS + Level];
+        }
+    }
+    Lookup->Operations = Chains * HVB_DEEP_LEVELS;
+    Lookup->Seconds = HvbSeconds(Start);
+    Success = TRUE;
+
+Quit:
+    free(Cells);
+    return Success;
+}
+
+/* One parent with Count children, inserted and looked up in random order */
+static BOOLEAN
+HvbRunWide(
+    IN PHVB_HIVE Hive,
+    IN HCELL_INDEX Base,
+    IN ULONG Count,
+    OUT PHVB_PHASE Create,
+    OUT PHVB_PHASE Lookup)
+{
+    WCHAR Buffer[HVB_NAME_LENGTH];
+    UNICODE_STRING Name;
+    PHCELL_INDEX Cells;
+    PULONG Order;
+    ULONG i;
+    clock_t Start;
+    BOOLEAN Success = FALSE;
+
+    Cells = malloc(max(Count, 1) * sizeof(HCELL_INDEX));
+    Order = HvbShuffle(Count);
+    if (!Cells || !Order)
+        goto Quit;
+
+    Start = clock();
+    for (i = 0; i < Count; i++)
+    {
+        HvbInitName(&Name, Buffer, _countof(Buffer), "Wide", Order[i]);
+        Cells[Order[i]] = HvbCreateKey(&Hive->Hive, Base, &Name);
+        if (Cells[Order[i]] == HCELL_NIL)
+            goto Quit;
+    }
+    Create->Operations = Count;
+    Create->Seconds = HvbSeconds(Start);
+
+    free(Order);
+    Order = HvbShuffle(Count);
+    if (!Order)
+        goto Quit;
+
+    Start = clock();
+    for (i = 0; i < Count; i++)
+    {
+        HvbInitName(&Name, Buffer, _countof(Buffer), "Wide", Order[i]);
+        if (!HvbLookupKey(&Hive->Hive, Base, &Name, Cells[Order[i]]))
+            goto Quit;
+    }
+    Lookup->Operations = Count;
+    Lookup->Seconds = HvbSeconds(Start);
+
+    /* Delete every other key, the others must still be found and only them */
+    for (i = 0; i < Count; i += 2)
+    {
+        if (!NT_SUCCESS(CmpFreeKeyByCell(&Hive->Hive, Cells[i], TRUE)))
+        {
+            printf("Unable to delete key %08x\n", Cells[i]);
+            goto Quit;
+        }
+        Cells[i] = HCELL_NIL;
+    }
+    for (i = 0; i < Count; i++)
+    {
+        HvbInitName(&Name, Buffer, _countof(Buffer), "Wide", i);
+        if (!HvbLookupKey(&Hive->Hive, Base, &Name, Cells[i]))
+            goto Quit;
+    }
+    Success = TRUE;
+
+Quit:
+    free(Order);
+    free(Cells);
+    return Success;
+}
+
+/* Keys with HVB_VALUES_PER_KEY values of mixed sizes each */
+static BOOLEAN
+HvbRunValues(
+    IN PHVB_HIVE Hive,
+    IN HCELL_INDEX Base,
+    IN ULONG Count,
+    OUT PHVB_PHASE Create,
+    OUT PHVB_PHASE Lookup)
+{
+    WCHAR Buffer[HVB_NAME_LENGTH];
+    UNICODE_STRING Name;
+    PHCELL_INDEX Keys;
+    PHCELL_INDEX Values;
+    PCM_KEY_NODE Node;
+    ULONG KeyCount = max(Count / HVB_VALUES_PER_KEY, 1);
+    ULONG Key, i;
+    clock_t Start;
+    BOOLEAN Success = FALSE;
+
+    Keys = malloc(KeyCount * sizeof(HCELL_INDEX));
+    Values = malloc(KeyCount * HVB_VALUES_PER_KEY * sizeof(HCELL_INDEX));
+    if (!Keys || !Values)
+        goto Quit;
+
+    for (Key = 0; Key < KeyCount; Key++)
+    {
+        HvbInitName(&Name, Buffer, _countof(Buffer), "Values", Key);
+        Keys[Key] = HvbCreateKey(&Hive->Hive, Base, &Name);
+        if (Keys[Key] == HCELL_NIL)
+            goto Quit;
+    }
+
+    Start = clock();
+    for (Key = 0; Key < KeyCount; Key++)
+    {
+        for (i = 0; i < HVB_VALUES_PER_KEY; i++)
+        {
+            HvbInitName(&Name, Buffer, _countof(Buffer), "Value", i);
+            Values[Key * HVB_VALUES_PER_KEY + i] =
+                HvbSetValue(&Hive->Hive, Keys[Key], &Name, HvbRandomRange(0, 256));
+            if (Values[Key * HVB_VALUES_PER_KEY + i] == HCELL_NIL)
+                goto Quit;
+        }
+    }
+    Create->Operations = KeyCount * HVB_VALUES_PER_KEY;
+    Create->Seconds = HvbSeconds(Start);
+
+    Start = clock();
+    for (Key = 0; Key < KeyCount; Key++)
+    {
+        Node = (PCM_KEY_NODE)HvGetCell(&Hive->Hive, Keys[Key]);
+        for (i = 0; i < HVB_VALUES_PER_KEY; i++)
+        {
+            HvbInitName(&Name, Buffer, _countof(Buffer), "Value", HVB_VALUES_PER_KEY - 1 - i);
+            if (CmpFindValueByName(&Hive->Hive, Node, &Name) !=
+                Values[Key * HVB_VALUES_PER_KEY + HVB_VALUES_PER_KEY - 1 - i])
+            {
+                printf("Lookup of value %u of key %u failed\n", HVB_VALUES_PER_KEY - 1 - i, Key);
+                goto Quit;
+            }
+        }
+    }
+    Lookup->Operations = KeyCount * HVB_VALUES_PER_KEY;
+    Lookup->Seconds = HvbSeconds(Start);
+    Success = TRUE;
+
+Quit:
+    free(Values);
+    free(Keys);
+    return Success;
+}
+
+static VOID
+HvbPrintPhase(
+    IN PHVB_OPTIONS Options,
+    IN PCSTR Workload,
+    IN PCSTR Phase,
+    IN PHVB_PHASE Result)
+{
+    printf("%-8s %-8s %10u ops", Workload, Phase, Result->Operations);
+    if (!Options->Deterministic)
+    {
+        printf("  %8.3f s", Result->Seconds);
+        if (Result->Seconds > 0)
+            printf("  %12.0f ops/sec", Result->Operations / Result->Seconds);
+    }
+    printf("\n");
+}
+
+static BOOLEAN
+HvbSaveImage(
+    IN PCSTR FileName,
+    IN PHVB_HIVE Hive)
+{
+    FILE *File;
+    BOOLEAN Success;
+
+    File = fopen(FileName, "wb");
+    if (!File)
+    {
+        printf("Unable to create '%s'\n", FileName);
+        return FALSE;
+    }
+
+    Success = (fwrite(Hive->Image, 1, Hive->ImageSize, File) == Hive->ImageSize);
+    fclose(File);
+    return Success;
+}
+
+static BOOLEAN
+HvbRunWorkload(
+    IN PHVB_OPTIONS Options,
+    IN PHVB_WORKLOAD Workload,
+    IN PUCHAR InputImage OPTIONAL,
+    IN ULONG InputSize)
+{
+    WCHAR Buffer[HVB_NAME_LENGTH];
+    UNICODE_STRING Name;
+    HVB_HIVE Hive;
+    HVB_HIVE_STATS Before, After;
+    HVB_PHASE Create, Lookup, Write;
+    HCELL_INDEX Base;
+    NTSTATUS Status;
+    clock_t Start;
+    ULONG i;
+    BOOLEAN Success = FALSE;
+
+    /* Every workload starts from the same hive and the same seed */
+    HvbSeed = Options->Seed;
+
+    if (InputImage)
+    {
+        Status = HvbLoadHive(&Hive, InputImage, InputSize);
+    }
+    else
+    {
+        Status = HvbCreateHive(&Hive);
+        if (NT_SUCCESS(Status) && !CmCreateRootNode(&Hive.Hive, L""))
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+    }
+    if (!NT_SUCCESS(Status))
+    {
+        printf("Unable to initialize the hive, Status 0x%08x\n", Status);
+        return FALSE;
+    }
+
+    HvbGetHiveStats(&Hive.Hive, Stable, &Before);
+
+    /* Keep the workload apart from whatever the loaded hive contains */
+    for (i = Options->Seed; ; i++)
+    {
+        HvbInitName(&Name, Buffer, _countof(Buffer), "HiveBench", i);
+        if (CmpFindSubKeyByName(&Hive.Hive,
+                                HvGetCell(&Hive.Hive, Hive.Hive.BaseBlock->RootCell),
+                                &Name) == HCELL_NIL)
+        {
+            break;
+        }
+    }
+    Base = HvbCreateKey(&Hive.Hive, Hive.Hive.BaseBlock->RootCell, &Name);
+    if (Base == HCELL_NIL)
+    {
+        printf("Unable to create the base key\n");
+        goto Quit;
+    }
+
+    RtlZeroMemory(&Create, sizeof(Create));
+    RtlZeroMemory(&Lookup, sizeof(Lookup));
+    if (!Workload->Run(&Hive, Base, Options->Count, &Create, &Lookup))
+    {
+        printf("%s workload failed\n", Workload->Name);
+        goto Quit;
+    }
+
+    Start = clock();
+    for (i = 0; i < HVB_WRITE_COUNT; i++)
+    {
+        if (!HvbWriteHive(&Hive))
+        {
+            printf("HvWriteHive() failed\n");
+            goto Quit;
+        }
+    }
+    Write.Operations = HVB_WRITE_COUNT;
+    Write.Seconds = HvbSeconds(Start);
+
+    HvbGetHiveStats(&Hive.Hive, Stable, &After);
+
+    HvbPrintPhase(Options, Workload->Name, "create", &Create);
+    HvbPrintPhase(Options, Workload->Name, "lookup", &Lookup);
+    HvbPrintPhase(Options, Workload->Name, "write", &Write);
+    printf("%-8s %-8s %10u -> %u bytes (+%u), %u bytes free\n",
+           Workload->Name, "hive", Before.Length, After.Length,
+           After.Length - Before.Length, After.FreeBytes);
+    printf("%-8s %-8s %10u bytes, checksum %08x\n",
+           Workload->Name, "image", Hive.ImageSize, HvbImageChecksum(&Hive));
+
+    if (Options->Verbose)
+        HvbPrintHiveStats(&Hive.Hive);
+
+    Success = TRUE;
+    if (Options->OutputFile)
+        Success = HvbSaveImage(Options->OutputFile, &Hive);
+
+Quit:
+    HvbFreeHive(&Hive);
+    return Success;
+}
+
+int
+HvbKeyBenchmark(
+    IN PHVB_OPTIONS Options)
+{
+    static HVB_WORKLOAD Workloads[] =
+    {
+        { "deep", HvbRunDeep },
+        { "wide", HvbRunWide },
+        { "values", HvbRunValues },
+    };
+    PUCHAR InputImage = NULL;
+    ULONG InputSize = 0;
+    ULONG i, Runs = 0;
+    int Result = 0;
+
+    if (Options->InputFile &&
+        !HvbReadFile(Options->InputFile, &InputImage, &InputSize))
+    {
+        return 1;
+    }
+
+    for (i = 0; i < _countof(Workloads); i++)
+    {
+        if (Options->Workload && strcmp(Options->Workload, Workloads[i].Name) != 0)
+            continue;
+
+        Runs++;
+        if (!HvbRunWorkload(Options, &Workloads[i], InputImage, InputSize))
+            Result = 1;
+    }
+
+    if (Runs == 0)
+    {
+        printf("Unknown workload '%s'\n", Options->Workload);
+        Result = 1;
+    }
+
+    free(InputImage);
+    return Result;
+}
+
+/* EOF */
@@ -0,0 +1,162 @@
+/*
+ * PROJECT:     ReactOS hive benchmark
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Runtime library routines needed by the hive library
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include <stdlib.h>
+#include <stdarg.h>
+
+/* gcc defaults to cdecl */
+#if defined(__GNUC__)
+#undef __cdecl
+#define __cdecl
+#endif
+
+#include "hivebench.h"
+#include <bitmap.c>
+
+VOID NTAPI
+RtlInitUnicodeString(
+    IN OUT PUNICODE_STRING DestinationString,
+    IN PCWSTR SourceString)
+{
+    SIZE_T DestSize;
+
+    if (SourceString)
+    {
+        DestSize = strlenW(SourceString) * sizeof(WCHAR);
+        DestinationString->Length = (USHORT)DestSize;
+        DestinationString->MaximumLength = (USHORT)DestSize + sizeof(WCHAR);
+    }
+    else
+    {
+        DestinationString->Length = 0;
+        DestinationString->MaximumLength = 0;
+    }
+
+    DestinationString->Buffer = (PWCHAR)SourceString;
+}
+
+WCHAR NTAPI
+RtlUpcaseUnicodeChar(
+    IN WCHAR Source)
+{
+    if (Source < 'a')
+        return Source;
+
+    if (Source <= 'z')
+        return (Source - ('a' - 'A'));
+
+    return Source;
+}
+
+LONG NTAPI
+RtlCompareUnicodeString(
+    IN PCUNICODE_STRING String1,
+    IN PCUNICODE_STRING String2,
+    IN BOOLEAN CaseInSensitive)
+{
+    USHORT Length, i;
+    WCHAR c1, c2;
+
+    Length = min(String1->Length, String2->Length) / sizeof(WCHAR);
+    for (i = 0; i < Length; i++)
+    {
+        c1 = String1->Buffer[i];
+        c2 = String2->Buffer[i];
+        if (CaseInSensitive)
+        {
+            c1 = RtlUpcaseUnicodeChar(c1);
+            c2 = RtlUpcaseUnicodeChar(c2);
+        }
+
+        if (c1 != c2)
+            return c1 - c2;
+    }
+
+    return String1->Length - String2->Length;
+}
+
+VOID NTAPI
+KeQuerySystemTime(
+    OUT PLARGE_INTEGER CurrentTime)
+{
+    /* Keep the hive contents independent of when the benchmark ran */
+    CurrentTime->QuadPart = 0;
+}
+
+ULONG
+__cdecl
+DbgPrint(
+  IN CHAR *Format,
+  IN ...)
+{
+    va_list ap;
+    va_start(ap, Format);
+    vprintf(Format, ap);
+    va_end(ap);
+
+    return 0;
+}
+
+VOID
+NTAPI
+RtlAssert(IN PVOID FailedAssertion,
+          IN PVOID FileName,
+          IN ULONG LineNumber,
+          IN PCHAR Message OPTIONAL)
+{
+    DbgPrint("Assertion \'%s\' failed at %s line %u: %s\n",
+             (PCHAR)FailedAssertion,
+             (PCHAR)FileName,
+             LineNumber,
+             Message ? Message : "");
+    abort();
+}
+
+// FIXME: DECLSPEC_NORETURN
+VOID
+NTAPI
+KeBugCheckEx(
+    IN ULONG BugCheckCode,
+    IN ULONG_PTR BugCheckParameter1,
+    IN ULONG_PTR BugCheckParameter2,
+    IN ULONG_PTR BugCheckParameter3,
+    IN ULONG_PTR BugCheckParameter4)
+{
+    printf("*** STOP: 0x%08X (0x%p,0x%p,0x%p,0x%p)\n",
+           BugCheckCode,
+           (PVOID)BugCheckParameter1,
+           (PVOID)BugCheckParameter2,
+           (PVOID)BugCheckParameter3,
+           (PVOID)BugCheckParameter4);
+    abort();
+}
+
+unsigned char BitScanForward(ULONG * Index, unsigned long Mask)
+{
+    *Index = 0;
+    while (Mask && ((Mask & 1) == 0))
+    {
+        Mask >>= 1;
+        ++(*Index);
+    }
+    return Mask ? 1 : 0;
+}
+
+unsigned char BitScanReverse(ULONG * const Index, unsigned long Mask)
+{
+    ULONG Value = (ULONG)Mask;
+
+    *Index = 31;
+    while (Value && ((Value & 0x80000000) == 0))
+    {
+        Value <<= 1;
+        --(*Index);
+    }
+    return Value ? 1 : 0;
+}
+
+/* EOF */
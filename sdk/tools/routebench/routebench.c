@@ -0,0 +1,373 @@
+/*
+ * PROJECT:     ReactOS route lookup benchmark
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Checks the route lookup tree against a linear scan and times both
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include "routebench.h"
+
+/* GLOBALS ******************************************************************/
+
+typedef struct _RTB_ROUTE
+{
+    ULONG Prefix;
+    UINT PrefixLength;
+    PLPM_NODE Node;
+} RTB_ROUTE, *PRTB_ROUTE;
+
+static ULONG RtbSeed = 1;
+
+/* FUNCTIONS ****************************************************************/
+
+/* Deterministic generator, so that every run builds the same tables */
+static ULONG
+RtbRandom(VOID)
+{
+    RtbSeed = RtbSeed * 1103515245 + 12345;
+    return (RtbSeed >> 1) & 0x7FFFFFFF;
+}
+
+static ULONG
+RtbRandom32(VOID)
+{
+    return (RtbRandom() << 16) ^ RtbRandom();
+}
+
+static ULONG
+RtbMask(
+    IN UINT Length)
+{
+    return Length ? 0xFFFFFFFF << (32 - Length) : 0;
+}
+
+static double
+RtbSeconds(
+    IN clock_t Start)
+{
+    return (double)(clock() - Start) / CLOCKS_PER_SEC;
+}
+
+/* Prefix lengths as found in routing tables, mostly /16 to /24 */
+static UINT
+RtbRandomLength(VOID)
+{
+    static const UINT Lengths[] = { 0, 8, 12, 16, 16, 20, 22, 24, 24, 24, 28, 30, 32 };
+
+    return Lengths[RtbRandom() % _countof(Lengths)];
+}
+
+/* Addresses near the prefixes in the table, so that lookups hit them */
+static ULONG
+RtbRandomAddress(
+    IN PRTB_ROUTE Routes,
+    IN ULONG Count)
+{
+    PRTB_ROUTE Route;
+
+    if (!Count || !(RtbRandom() % 4))
+        return RtbRandom32();
+
+    Route = &Routes[RtbRandom() % Count];
+    return Route->Prefix | (RtbRandom32() & ~RtbMask(Route->PrefixLength));
+}
+
+/* Reference longest prefix match, the way the route table used to be searched */
+static PRTB_ROUTE
+RtbLinearLookup(
+    IN PRTB_ROUTE Routes,
+    IN ULONG Count,
+    IN ULONG Address)
+{
+    PRTB_ROUTE Best = NULL;
+    ULONG Index;
+
+    for (Index = 0; Index < Count; Index++)
+    {
+        if (((Address ^ Routes[Index].Prefix) & RtbMask(Routes[Index].PrefixLength)) == 0 &&
+            (!Best || Routes[Index].PrefixLength > Best->PrefixLength))
+        {
+            Best = &Routes[Index];
+        }
+    }
+
+    return Best;
+}
+
+static ULONG
+RtbCheckNode(
+    IN PLPM_NODE Node,
+    IN PLPM_NODE Parent,
+    IN PULONG Values)
+{
+    ULONG Count = 1;
+    UINT Bit;
+
+    if (Node->Parent != Parent)
+    {
+        printf("FAIL: %08lx/%u has a bad parent link\n", (unsigned long)Node->Prefix, Node->PrefixLength);
+        exit(1);
+    }
+
+    if (Node->Prefix & ~RtbMask(Node->PrefixLength))
+    {
+        printf("FAIL: %08lx/%u has bits past its length\n", (unsigned long)Node->Prefix, Node->PrefixLength);
+        exit(1);
+    }
+
+    if (!Node->Value && (!Node->Child[0] || !Node->Child[1]))
+    {
+        printf("FAIL: %08lx/%u joins less than two subtrees\n", (unsigned long)Node->Prefix, Node->PrefixLength);
+        exit(1);
+    }
+
+    if (Node->Value)
+        (*Values)++;
+
+    for (Bit = 0; Bit < 2; Bit++)
+    {
+        PLPM_NODE Child = Node->Child[Bit];
+
+        if (!Child)
+            continue;
+
+        if (Child->PrefixLength <= Node->PrefixLength ||
+            ((Child->Prefix ^ Node->Prefix) & RtbMask(Node->PrefixLength)) ||
+            ((Child->Prefix >> (31 - Node->PrefixLength)) & 1) != Bit)
+        {
+            printf("FAIL: %08lx/%u is misplaced\n", (unsigned long)Child->Prefix, Child->PrefixLength);
+            exit(1);
+        }
+
+        Count += RtbCheckNode(Child, Node, Values);
+    }
+
+    return Count;
+}
+
+static VOID
+RtbCheckTree(
+    IN PLPM_TREE Tree,
+    IN ULONG RouteCount)
+{
+    ULONG Values = 0, Nodes = 0;
+
+    if (Tree->Root)
+        Nodes = RtbCheckNode(Tree->Root, NULL, &Values);
+
+    if (Nodes != Tree->NodeCount || Values != RouteCount || Nodes > 2 * RouteCount)
+    {
+        printf("FAIL: %lu nodes (%u counted), %lu values for %lu routes\n",
+               (unsigned long)Nodes, Tree->NodeCount,
+               (unsigned long)Values, (unsigned long)RouteCount);
+        exit(1);
+    }
+}
+
+/* Random inserts and removes, every lookup checked against the linear scan */
+static VOID
+RtbTest(
+    IN ULONG Operations)
+{
+    PRTB_ROUTE Routes, Expected;
+    LPM_TREE Tree;
+    PLPM_NODE Node;
+    ULONG Count = 0, Operation, Index, Address;
+    const ULONG MaxRoutes = 512;
+
+    Routes = malloc(MaxRoutes * sizeof(RTB_ROUTE));
+    if (!Routes)
+    {
+        printf("Out of memory\n");
+        exit(1);
+    }
+
+    LpmInitialize(&Tree);
+
+    for (Operation = 0; Operation < Operations; Operation++)
+    {
+        if (Count && (Count == MaxRoutes || RtbRandom() % 3 == 0))
+        {
+            Index = RtbRandom() % Count;
+            LpmRemove(&Tree, Routes[Index].Node);
+            Routes[Index] = Routes[--Count];
+        }
+        else
+        {
+            UINT Length = RtbRandomLength();
+            ULONG Prefix = RtbRandom32() & RtbMask(Length);
+
+            /* Short prefixes get reused, which also covers duplicates */
+            if (LpmFind(&Tree, Prefix, Length))
+                continue;
+
+            Node = LpmInsert(&Tree, Prefix, Length);
+            if (!Node || Node->Value)
+            {
+                printf("FAIL: insert of %08lx/%u\n", (unsigned long)Prefix, Length);
+                exit(1);
+            }
+
+            Node->Value = &Routes[Count];
+            Routes[Count].Prefix = Prefix;
+            Routes[Count].PrefixLength = Length;
+            Routes[Count].Node = Node;
+            Count++;
+        }
+
+        RtbCheckTree(&Tree, Count);
+
+        for (Index = 0; Index < 16; Index++)
+        {
+            Address = RtbRandomAddress(Routes, Count);
+            Expected = RtbLinearLookup(Routes, Count, Address);
+            Node = LpmLookup(&Tree, Address);
+
+            if ((Expected ? Expected->Node : NULL) != Node)
+            {
+                printf("FAIL: lookup of %08lx\n", (unsigned long)Address);
+                exit(1);
+            }
+        }
+
+        for (Index = 0; Index < Count; Index++)
+        {
+            if (LpmFind(&Tree, Routes[Index].Prefix, Routes[Index].PrefixLength) != Routes[Index].Node)
+            {
+                printf("FAIL: find of %08lx/%u\n", (unsigned long)Routes[Index].Prefix, Routes[Index].PrefixLength);
+                exit(1);
+            }
+        }
+    }
+
+    while (Count)
+    {
+        LpmRemove(&Tree, Routes[--Count].Node);
+        RtbCheckTree(&Tree, Count);
+    }
+
+    if (Tree.Root)
+    {
+        printf("FAIL: tree not empty after removing every route\n");
+        exit(1);
+    }
+
+    printf("Passed %lu operations\n", (unsigned long)Operations);
+    free(Routes);
+}
+
+static VOID
+RtbBenchmark(
+    IN ULONG RouteCount,
+    IN ULONG Lookups)
+{
+    PRTB_ROUTE Routes;
+    PULONG Addresses;
+    LPM_TREE Tree;
+    PLPM_NODE Node;
+    ULONG Index, Count = 0, Hits;
+    clock_t Start;
+    double Linear, Trie;
+
+    Routes = malloc(RouteCount * sizeof(RTB_ROUTE));
+    Addresses = malloc(Lookups * sizeof(ULONG));
+    if (!Routes || !Addresses)
+    {
+        printf("Out of memory\n");
+        exit(1);
+    }
+
+    LpmInitialize(&Tree);
+
+    while (Count < RouteCount)
+    {
+        UINT Length = RtbRandomLength();
+        ULONG Prefix = RtbRandom32() & RtbMask(Length);
+
+        if (LpmFind(&Tree, Prefix, Length))
+            continue;
+
+        Node = LpmInsert(&Tree, Prefix, Length);
+        if (!Node)
+        {
+            printf("Out of memory\n");
+            exit(1);
+        }
+
+        Node->Value = &Routes[Count];
+        Routes[Count].Prefix = Prefix;
+        Routes[Count].PrefixLength = Length;
+        Routes[Count].Node = Node;
+        Count++;
+    }
+
+    for (Index = 0; Index < Lookups; Index++)
+        Addresses[Index] = RtbRandomAddress(Routes, Count);
+
+    Hits = 0;
+    Start = clock();
+    for (Index = 0; Index < Lookups; Index++)
+        Hits += RtbLinearLookup(Routes, Count, Addresses[Index]) != NULL;
+    Linear = RtbSeconds(Start);
+
+    Hits = 0;
+    Start = clock();
+    for (Index = 0; Index < Lookups; Index++)
+        Hits += LpmLookup(&Tree, Addresses[Index]) != NULL;
+    Trie = RtbSeconds(Start);
+
+    printf("%6lu routes %6u nodes  linear %8.1f ns  tree %6.1f ns  (%lu hits)\n",
+           (unsigned long)RouteCount, Tree.NodeCount,
+           Linear * 1e9 / Lookups, Trie * 1e9 / Lookups, (unsigned long)Hits);
+
+    while (Count)
+        LpmRemove(&Tree, Routes[--Count].Node);
+
+    free(Addresses);
+    free(Routes);
+}
+
+static VOID
+RtbUsage(VOID)
+{
+    printf("Usage: routebench [-t operations] [-l lookups]\n"
+           "  -t operations  Random inserts and removes checked by the test (default 20000)\n"
+           "  -l lookups     Lookups timed per table size (default 200000)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static const ULONG RouteCounts[] = { 4, 16, 64, 256, 1024, 4096 };
+    ULONG Operations = 20000, Lookups = 200000, Index;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (!strcmp(argv[Arg], "-t") && Arg + 1 < argc)
+        {
+            Operations = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (!strcmp(argv[Arg], "-l") && Arg + 1 < argc)
+        {
+            Lookups = strtoul(argv[++Arg], NULL, 0);
+            if (!Lookups)
+                Lookups = 1;
+        }
+        else
+        {
+            RtbUsage();
+            return 1;
+        }
+    }
+
+    RtbTest(Operations);
+
+    for (Index = 0; Index < _countof(RouteCounts); Index++)
+        RtbBenchmark(RouteCounts[Index], Lookups);
+
+    return 0;
+}
+
+/* EOF */
@@ -0,0 +1,33 @@
+/*
+ * PROJECT:     ReactOS route lookup benchmark
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Host test and benchmark for the TCP/IP route lookup tree
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <typedefs.h>
+
+#ifndef _countof
+#define _countof(_Array) (sizeof(_Array) / sizeof(_Array[0]))
+#endif
+
+#ifndef min
+#define min(a, b)  (((a) < (b)) ? (a) : (b))
+#endif
+
+#define LPM_HOST
+
+#define NonPagedPool 0
+#define ExAllocatePoolWithTag(PoolType, NumberOfBytes, Tag) malloc(NumberOfBytes)
+#define ExFreePoolWithTag(P, Tag) free(P)
+
+#include <lpm.h>
+
+/* EOF */
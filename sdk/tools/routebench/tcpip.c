@@ -0,0 +1,11 @@
+/*
+ * PROJECT:     ReactOS route lookup benchmark
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     TCP/IP route lookup tree, built for the host
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include "routebench.h"
+#include <lpm.c>
+
+/* EOF */
@@ -126,7 +126,8 @@ typedef struct _SHARED_FACE_CACHE {
 } SHARED_FACE_CACHE, *PSHARED_FACE_CACHE;
 
 typedef struct _SHARED_FACE {
-  FT_Face       Face;
+  FT_Face       Face;           /* NULL until first used if loaded from the font catalog */
+  FT_Long       FaceIndex;
   LONG          RefCount;
   PSHARED_MEM   Memory;
   SHARED_FACE_CACHE EnglishUS;
@@ -25,7 +25,10 @@ typedef struct _FONT_ENTRY_COLL_MEM
 
 typedef struct _FONT_CACHE_ENTRY
 {
-    LIST_ENTRY ListEntry;
+    LIST_ENTRY ListEntry;       /* LRU list, most recently used first */
+    LIST_ENTRY HashEntry;
+    LONG RefCount;              /* The cache holds one until it evicts the entry */
+    SIZE_T Size;                /* What the entry counts against the cache budget */
     int GlyphIndex;
     FT_Face Face;
     FT_BitmapGlyph BitmapGlyph;
@@ -55,6 +58,48 @@ typedef struct FONTSUBST_ENTRY
 } FONTSUBST_ENTRY, *PFONTSUBST_ENTRY;
 
 
+/*
+ * FONT_CATALOG_FACE --- what the font catalog remembers about a loaded face,
+ * one per FONT_ENTRY. The entries of a file are stored next to each other.
+ * FileName has room for any file name, which is shorter than MAX_PATH.
+ */
+#define FONT_CATALOG_MAGIC      'TACF'
+#define FONT_CATALOG_VERSION    2
+
+typedef struct FONT_CATALOG_HEADER
+{
+    ULONG           Magic;
+    ULONG           Version;
+    ULONG           FaceSize;       /* sizeof(FONT_CATALOG_FACE) */
+    ULONG           Count;
+} FONT_CATALOG_HEADER, *PFONT_CATALOG_HEADER;
+
+typedef struct FONT_CATALOG_FACE
+{
+    WCHAR           FileName[MAX_PATH];
+    LARGE_INTEGER   FileSize;
+    LARGE_INTEGER   LastWriteTime;
+    LONG            FaceIndex;
+    LONG            CharSetIndex;
+    LANGID          LangID;         /* language of the UserLanguage names */
+    BOOLEAN         IsTrueType;
+    BYTE            CharSet;
+    BYTE            OriginalItalic;
+    LONG            OriginalWeight;
+    LONG            tmHeight;
+    LONG            tmAscent;
+    LONG            tmDescent;
+    LONG            tmInternalLeading;
+    LONG            EmHeight;
+    WCHAR           FaceName[LF_FACESIZE];
+    WCHAR           StyleName[LF_FACESIZE];
+    WCHAR           EnglishFamily[LF_FACESIZE];
+    WCHAR           EnglishFullName[LF_FULLFACESIZE];
+    WCHAR           UserFamily[LF_FACESIZE];
+    WCHAR           UserFullName[LF_FULLFACESIZE];
+} FONT_CATALOG_FACE, *PFONT_CATALOG_FACE;
+
+
 typedef struct GDI_LOAD_FONT
 {
     PUNICODE_STRING     pFileName;
@@ -64,5 +109,12 @@ typedef struct GDI_LOAD_FONT
     BOOL                IsTrueType;
     BYTE                CharSet;
     PFONT_ENTRY_MEM     PrivateEntry;
+    /* font catalog */
+    PFONT_CATALOG_FACE  CatalogFaces;   /* cached faces of the file, or NULL */
+    ULONG               CatalogCount;
+    BOOL                CatalogRecord;  /* record the loaded faces */
+    ULONG               CatalogStart;   /* first recorded face of the file */
+    LARGE_INTEGER       FileSize;
+    LARGE_INTEGER       LastWriteTime;
 } GDI_LOAD_FONT, *PGDI_LOAD_FONT;
 
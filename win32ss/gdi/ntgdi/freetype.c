@@ -58,6 +58,29 @@ FT_Library  g_FreeTypeLibrary;
 static UNICODE_STRING g_FontRegPath =
     RTL_CONSTANT_STRING(L"\\REGISTRY\\Machine\\Software\\Microsoft\\Windows NT\\CurrentVersion\\Fonts");
 
+/* font catalog, only used while InitFontSupport loads the fonts */
+static UNICODE_STRING g_FontCatalogPath =
+    RTL_CONSTANT_STRING(L"\\SystemRoot\\Fonts\\fontcat.dat");
+
+#define FONT_CATALOG_MAX_FACES  4096
+
+/* The faces of one file in the catalog */
+typedef struct FONT_CATALOG_RUN
+{
+    ULONG Start;
+    ULONG Count;
+} FONT_CATALOG_RUN, *PFONT_CATALOG_RUN;
+
+static BOOL               g_FontCatalogActive = FALSE;
+static BOOL               g_FontCatalogDirty = FALSE;
+static PFONT_CATALOG_FACE g_FontCatalog = NULL;       /* as read from the disk */
+static ULONG              g_FontCatalogCount = 0;
+static PFONT_CATALOG_RUN  g_FontCatalogRuns = NULL;   /* the files in g_FontCatalog, sorted */
+static ULONG              g_FontCatalogRunCount = 0;
+static PFONT_CATALOG_FACE g_FontCatalogNew = NULL;    /* the fonts loaded this time */
+static ULONG              g_FontCatalogNewCount = 0;
+static ULONG              g_FontCatalogNewMax = 0;
+
 
 /* The FreeType library is not thread safe, so we have
    to serialize access to it */
@@ -88,10 +111,35 @@ static BOOL             g_RenderingEnabled = TRUE;
 #define ASSERT_FREETYPE_LOCK_NOT_HELD() \
     ASSERT(g_FreeTypeLock->Owner != KeGetCurrentThread())
 
-#define MAX_FONT_CACHE 256
-
-static LIST_ENTRY g_FontCacheListHead;
-static UINT g_FontCacheNumEntries;
+/* The glyph cache is hashed on face, glyph, height and render mode, the
+   matrix is only compared. It's bounded by the memory the bitmaps take rather
+   than by a number of entries. It doesn't use g_FreeTypeLock: a face always
+   hashes to the same shard, and each shard has its own lock for its LRU list
+   and hash chains. Entries are reference counted, so a glyph handed out by the
+   cache stays valid until ftGdiGlyphCacheRelease, even if it's evicted */
+#define FONT_CACHE_BUDGET       (1024 * 1024)
+#define FONT_CACHE_SHARDS       16
+#define FONT_CACHE_HASH_SIZE    64      /* Per shard */
+
+typedef struct _FONT_CACHE_SHARD
+{
+    FAST_MUTEX Lock;
+    LIST_ENTRY ListHead;        /* LRU list, most recently used first */
+    LIST_ENTRY HashTable[FONT_CACHE_HASH_SIZE];
+    UINT NumEntries;
+} FONT_CACHE_SHARD, *PFONT_CACHE_SHARD;
+
+/* Fast Mutexes must be allocated from non paged pool */
+static PFONT_CACHE_SHARD g_FontCacheShards;
+static volatile LONG g_FontCacheSize;
+static LONG g_FontCacheNextVictim;
+
+static struct
+{
+    LONG64 Hits;
+    LONG64 Misses;
+    LONG64 Evictions;
+} g_FontCacheStats;
 
 static PWCHAR g_ElfScripts[32] =   /* These are in the order of the fsCsb[0] bits */
 {
@@ -211,20 +259,21 @@ SharedFaceCache_Init(PSHARED_FACE_CACHE Cache)
 }
 
 static PSHARED_FACE
-SharedFace_Create(FT_Face Face, PSHARED_MEM Memory)
+SharedFace_Create(FT_Face Face, PSHARED_MEM Memory, FT_Long FaceIndex)
 {
     PSHARED_FACE Ptr;
     Ptr = ExAllocatePoolWithTag(PagedPool, sizeof(SHARED_FACE), TAG_FONT);
     if (Ptr)
     {
         Ptr->Face = Face;
+        Ptr->FaceIndex = FaceIndex;
         Ptr->RefCount = 1;
         Ptr->Memory = Memory;
         SharedFaceCache_Init(&Ptr->EnglishUS);
         SharedFaceCache_Init(&Ptr->UserLanguage);
 
         SharedMem_AddRef(Memory);
-        DPRINT("Creating SharedFace for %s\n", Face->family_name ? Face->family_name : "<NULL>");
+        DPRINT("Creating SharedFace for %s\n", (Face && Face->family_name) ? Face->family_name : "<NULL>");
     }
     return Ptr;
 }
@@ -253,28 +302,55 @@ SharedFace_AddRef(PSHARED_FACE Ptr)
     ++Ptr->RefCount;
 }
 
+static PFONT_CACHE_SHARD
+FontCacheShard(FT_Face Face)
+{
+    ULONG Hash = (ULONG)((ULONG_PTR)Face >> 4);
+
+    Hash ^= Hash >> 16;
+    Hash *= 0x45D9F3B;
+    Hash ^= Hash >> 16;
+
+    return &g_FontCacheShards[Hash % FONT_CACHE_SHARDS];
+}
+
+/* Freeing a glyph only returns its memory to the pool, so the last reference
+   can be dropped without g_FreeTypeLock */
+VOID APIENTRY
+ftGdiGlyphCacheRelease(PFONT_CACHE_ENTRY Entry)
+{
+    if (InterlockedDecrement(&Entry->RefCount) == 0)
+    {
+        FT_Done_Glyph((FT_Glyph)Entry->BitmapGlyph);
+        ExFreePoolWithTag(Entry, TAG_FONT);
+    }
+}
+
+/* Unlink an entry, the caller drops the cache's reference once the shard is unlocked */
 static void
-RemoveCachedEntry(PFONT_CACHE_ENTRY Entry)
+RemoveCachedEntry(PFONT_CACHE_SHARD Shard, PFONT_CACHE_ENTRY Entry)
 {
-    ASSERT_FREETYPE_LOCK_HELD();
+    ASSERT(Shard->Lock.Owner == KeGetCurrentThread());
 
-    FT_Done_Glyph((FT_Glyph)Entry->BitmapGlyph);
     RemoveEntryList(&Entry->ListEntry);
-    ExFreePoolWithTag(Entry, TAG_FONT);
-    g_FontCacheNumEntries--;
-    ASSERT(g_FontCacheNumEntries <= MAX_FONT_CACHE);
+    RemoveEntryList(&Entry->HashEntry);
+    Shard->NumEntries--;
+    InterlockedExchangeAdd(&g_FontCacheSize, -(LONG)Entry->Size);
 }
 
 static void
 RemoveCacheEntries(FT_Face Face)
 {
+    PFONT_CACHE_SHARD Shard = FontCacheShard(Face);
     PLIST_ENTRY CurrentEntry, NextEntry;
     PFONT_CACHE_ENTRY FontEntry;
+    LIST_ENTRY Removed;
 
-    ASSERT_FREETYPE_LOCK_HELD();
+    InitializeListHead(&Removed);
 
-    for (CurrentEntry = g_FontCacheListHead.Flink;
-         CurrentEntry != &g_FontCacheListHead;
+    ExEnterCriticalRegionAndAcquireFastMutexUnsafe(&Shard->Lock);
+    for (CurrentEntry = Shard->ListHead.Flink;
+         CurrentEntry != &Shard->ListHead;
          CurrentEntry = NextEntry)
     {
         FontEntry = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_ENTRY, ListEntry);
@@ -282,9 +358,71 @@ RemoveCacheEntries(FT_Face Face)
 
         if (FontEntry->Face == Face)
         {
-            RemoveCachedEntry(FontEntry);
+            RemoveCachedEntry(Shard, FontEntry);
+            InsertTailList(&Removed, &FontEntry->ListEntry);
         }
     }
+    ExReleaseFastMutexUnsafeAndLeaveCriticalRegion(&Shard->Lock);
+
+    while (!IsListEmpty(&Removed))
+    {
+        CurrentEntry = RemoveHeadList(&Removed);
+        ftGdiGlyphCacheRelease(CONTAINING_RECORD(CurrentEntry, FONT_CACHE_ENTRY, ListEntry));
+    }
+}
+
+/* Evict the least recently used glyphs until the cache fits its budget. Each
+   shard is locked in turn, so it may take a glyph from another face's shard */
+static void
+TrimFontCache(PFONT_CACHE_ENTRY Keep)
+{
+    PFONT_CACHE_SHARD Shard;
+    PFONT_CACHE_ENTRY Victim;
+    ULONG Tries;
+
+    for (Tries = 0;
+         Tries < FONT_CACHE_SHARDS && g_FontCacheSize > FONT_CACHE_BUDGET;
+         Tries++)
+    {
+        Shard = &g_FontCacheShards[(ULONG)InterlockedIncrement(&g_FontCacheNextVictim) % FONT_CACHE_SHARDS];
+        Victim = NULL;
+
+        ExEnterCriticalRegionAndAcquireFastMutexUnsafe(&Shard->Lock);
+        if (!IsListEmpty(&Shard->ListHead))
+        {
+            Victim = CONTAINING_RECORD(Shard->ListHead.Blink, FONT_CACHE_ENTRY, ListEntry);
+            if (Victim == Keep)
+                Victim = NULL;
+            else
+                RemoveCachedEntry(Shard, Victim);
+        }
+        ExReleaseFastMutexUnsafeAndLeaveCriticalRegion(&Shard->Lock);
+
+        if (Victim)
+        {
+            InterlockedIncrement64(&g_FontCacheStats.Evictions);
+            ftGdiGlyphCacheRelease(Victim);
+            Tries = 0;
+        }
+    }
+}
+
+VOID FASTCALL
+ftGdiGlyphCacheQueryStats(PFONT_CACHE_STATS Stats)
+{
+    UINT i;
+
+    /* A snapshot, the shards aren't locked */
+    Stats->Hits = (ULONGLONG)g_FontCacheStats.Hits;
+    Stats->Misses = (ULONGLONG)g_FontCacheStats.Misses;
+    Stats->Evictions = (ULONGLONG)g_FontCacheStats.Evictions;
+    Stats->Glyphs = 0;
+    for (i = 0; i < FONT_CACHE_SHARDS; i++)
+    {
+        Stats->Glyphs += g_FontCacheShards[i].NumEntries;
+    }
+    Stats->Size = (SIZE_T)g_FontCacheSize;
+    Stats->Budget = FONT_CACHE_BUDGET;
 }
 
 static void SharedMem_Release(PSHARED_MEM Ptr)
@@ -326,9 +464,12 @@ SharedFace_Release(PSHARED_FACE Ptr)
     --Ptr->RefCount;
     if (Ptr->RefCount == 0)
     {
-        DPRINT("Releasing SharedFace for %s\n", Ptr->Face->family_name ? Ptr->Face->family_name : "<NULL>");
-        RemoveCacheEntries(Ptr->Face);
-        FT_Done_Face(Ptr->Face);
+        DPRINT("Releasing SharedFace for %s\n", (Ptr->Face && Ptr->Face->family_name) ? Ptr->Face->family_name : "<NULL>");
+        if (Ptr->Face)
+        {
+            RemoveCacheEntries(Ptr->Face);
+            FT_Done_Face(Ptr->Face);
+        }
         SharedMem_Release(Ptr->Memory);
         SharedFaceCache_Release(&Ptr->EnglishUS);
         SharedFaceCache_Release(&Ptr->UserLanguage);
@@ -656,14 +797,355 @@ IntLoadFontSubstList(PLIST_ENTRY pHead)
     return NT_SUCCESS(Status);
 }
 
+/* Orders the catalog by file name, then by size and time stamp */
+static INT
+IntCompareCatalogFile(PCWSTR FileName, PLARGE_INTEGER FileSize,
+                      PLARGE_INTEGER LastWriteTime, PFONT_CATALOG_FACE CatalogFace)
+{
+    INT Ret = _wcsicmp(FileName, CatalogFace->FileName);
+    if (Ret != 0)
+        return Ret;
+
+    if (FileSize->QuadPart != CatalogFace->FileSize.QuadPart)
+        return (FileSize->QuadPart < CatalogFace->FileSize.QuadPart) ? -1 : 1;
+
+    if (LastWriteTime->QuadPart != CatalogFace->LastWriteTime.QuadPart)
+        return (LastWriteTime->QuadPart < CatalogFace->LastWriteTime.QuadPart) ? -1 : 1;
+
+    return 0;
+}
+
+static int __cdecl
+IntCompareCatalogRuns(const void *x, const void *y)
+{
+    PFONT_CATALOG_FACE Face1 = &g_FontCatalog[((PFONT_CATALOG_RUN)x)->Start];
+    PFONT_CATALOG_FACE Face2 = &g_FontCatalog[((PFONT_CATALOG_RUN)y)->Start];
+
+    return IntCompareCatalogFile(Face1->FileName, &Face1->FileSize,
+                                 &Face1->LastWriteTime, Face2);
+}
+
+/*
+ * IntIndexFontCatalog
+ *
+ * Sorts the files of the catalog once, so that each font file loaded at
+ * startup finds its faces with a binary search.
+ */
+static VOID
+IntIndexFontCatalog(VOID)
+{
+    PFONT_CATALOG_FACE CatalogFace;
+    ULONG i, Runs = 0;
+
+    g_FontCatalogRuns = ExAllocatePoolWithTag(PagedPool,
+                                              g_FontCatalogCount * sizeof(FONT_CATALOG_RUN),
+                                              TAG_FONT);
+    if (!g_FontCatalogRuns)
+    {
+        /* Without an index, every file gets opened and recorded again */
+        ExFreePoolWithTag(g_FontCatalog, TAG_FONT);
+        g_FontCatalog = NULL;
+        g_FontCatalogCount = 0;
+        return;
+    }
+
+    /* The faces of a file are next to each other */
+    for (i = 0; i < g_FontCatalogCount; ++i)
+    {
+        CatalogFace = &g_FontCatalog[i];
+        if (i > 0 &&
+            IntCompareCatalogFile(CatalogFace->FileName, &CatalogFace->FileSize,
+                                  &CatalogFace->LastWriteTime, &CatalogFace[-1]) == 0)
+        {
+            g_FontCatalogRuns[Runs - 1].Count++;
+            continue;
+        }
+
+        g_FontCatalogRuns[Runs].Start = i;
+        g_FontCatalogRuns[Runs].Count = 1;
+        ++Runs;
+    }
+
+    qsort(g_FontCatalogRuns, Runs, sizeof(FONT_CATALOG_RUN), IntCompareCatalogRuns);
+    g_FontCatalogRunCount = Runs;
+}
+
+/*
+ * IntLoadFontCatalog
+ *
+ * Reads the font catalog, so that unchanged font files don't need to have
+ * their faces opened at startup.
+ */
+static VOID
+IntLoadFontCatalog(VOID)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK Iosb;
+    FONT_CATALOG_HEADER Header;
+    PFONT_CATALOG_FACE CatalogFace;
+    HANDLE FileHandle;
+    NTSTATUS Status;
+    ULONG i, Size;
+
+    g_FontCatalogActive = TRUE;
+
+    InitializeObjectAttributes(&ObjectAttributes, &g_FontCatalogPath,
+                               OBJ_KERNEL_HANDLE | OBJ_CASE_INSENSITIVE, NULL, NULL);
+    Status = ZwOpenFile(&FileHandle,
+                        FILE_GENERIC_READ | SYNCHRONIZE,
+                        &ObjectAttributes,
+                        &Iosb,
+                        FILE_SHARE_READ,
+                        FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT("No font catalog (Status 0x%lx)\n", Status);
+        return;
+    }
+
+    Status = ZwReadFile(FileHandle, NULL, NULL, NULL, &Iosb,
+                        &Header, sizeof(Header), NULL, NULL);
+    if (!NT_SUCCESS(Status) || Iosb.Information != sizeof(Header) ||
+        Header.Magic != FONT_CATALOG_MAGIC ||
+        Header.Version != FONT_CATALOG_VERSION ||
+        Header.FaceSize != sizeof(FONT_CATALOG_FACE) ||
+        Header.Count == 0 || Header.Count > FONT_CATALOG_MAX_FACES)
+    {
+        DPRINT1("Ignoring invalid font catalog\n");
+        ZwClose(FileHandle);
+        return;
+    }
+
+    Size = Header.Count * sizeof(FONT_CATALOG_FACE);
+    g_FontCatalog = ExAllocatePoolWithTag(PagedPool, Size, TAG_FONT);
+    if (g_FontCatalog)
+    {
+        Status = ZwReadFile(FileHandle, NULL, NULL, NULL, &Iosb,
+                            g_FontCatalog, Size, NULL, NULL);
+        if (NT_SUCCESS(Status) && Iosb.Information == Size)
+        {
+            g_FontCatalogCount = Header.Count;
+        }
+        else
+        {
+            DPRINT1("Could not read the font catalog (Status 0x%lx)\n", Status);
+            ExFreePoolWithTag(g_FontCatalog, TAG_FONT);
+            g_FontCatalog = NULL;
+        }
+    }
+    ZwClose(FileHandle);
+
+    /* Don't trust the strings to be terminated */
+    for (i = 0; i < g_FontCatalogCount; ++i)
+    {
+        CatalogFace = &g_FontCatalog[i];
+        CatalogFace->FileName[_countof(CatalogFace->FileName) - 1] = UNICODE_NULL;
+        CatalogFace->FaceName[_countof(CatalogFace->FaceName) - 1] = UNICODE_NULL;
+        CatalogFace->StyleName[_countof(CatalogFace->StyleName) - 1] = UNICODE_NULL;
+        CatalogFace->EnglishFamily[_countof(CatalogFace->EnglishFamily) - 1] = UNICODE_NULL;
+        CatalogFace->EnglishFullName[_countof(CatalogFace->EnglishFullName) - 1] = UNICODE_NULL;
+        CatalogFace->UserFamily[_countof(CatalogFace->UserFamily) - 1] = UNICODE_NULL;
+        CatalogFace->UserFullName[_countof(CatalogFace->UserFullName) - 1] = UNICODE_NULL;
+    }
+
+    if (g_FontCatalogCount)
+        IntIndexFontCatalog();
+}
+
+/*
+ * IntSaveFontCatalog
+ *
+ * Writes the fonts loaded at startup back to the font catalog if anything
+ * has changed, and stops using the catalog.
+ */
+static VOID
+IntSaveFontCatalog(VOID)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK Iosb;
+    FONT_CATALOG_HEADER Header;
+    HANDLE FileHandle;
+    NTSTATUS Status;
+
+    if ((g_FontCatalogDirty || g_FontCatalogNewCount != g_FontCatalogCount) &&
+        g_FontCatalogNewCount != 0)
+    {
+        InitializeObjectAttributes(&ObjectAttributes, &g_FontCatalogPath,
+                                   OBJ_KERNEL_HANDLE | OBJ_CASE_INSENSITIVE, NULL, NULL);
+        Status = ZwCreateFile(&FileHandle,
+                              FILE_GENERIC_WRITE | SYNCHRONIZE,
+                              &ObjectAttributes,
+                              &Iosb,
+                              NULL,
+                              FILE_ATTRIBUTE_NORMAL,
+                              0,
+                              FILE_OVERWRITE_IF,
+                              FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE,
+                              NULL,
+                              0);
+        if (NT_SUCCESS(Status))
+        {
+            Header.Magic = FONT_CATALOG_MAGIC;
+            Header.Version = FONT_CATALOG_VERSION;
+            Header.FaceSize = sizeof(FONT_CATALOG_FACE);
+            Header.Count = g_FontCatalogNewCount;
+
+            Status = ZwWriteFile(FileHandle, NULL, NULL, NULL, &Iosb,
+                                 &Header, sizeof(Header), NULL, NULL);
+            if (NT_SUCCESS(Status))
+            {
+                Status = ZwWriteFile(FileHandle, NULL, NULL, NULL, &Iosb,
+                                     g_FontCatalogNew,
+                                     g_FontCatalogNewCount * sizeof(FONT_CATALOG_FACE),
+                                     NULL, NULL);
+            }
+            ZwClose(FileHandle);
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Could not write the font catalog (Status 0x%lx)\n", Status);
+        }
+    }
+
+    if (g_FontCatalog)
+        ExFreePoolWithTag(g_FontCatalog, TAG_FONT);
+    if (g_FontCatalogRuns)
+        ExFreePoolWithTag(g_FontCatalogRuns, TAG_FONT);
+    if (g_FontCatalogNew)
+        ExFreePoolWithTag(g_FontCatalogNew, TAG_FONT);
+
+    g_FontCatalog = g_FontCatalogNew = NULL;
+    g_FontCatalogRuns = NULL;
+    g_FontCatalogCount = g_FontCatalogRunCount = 0;
+    g_FontCatalogNewCount = g_FontCatalogNewMax = 0;
+    g_FontCatalogDirty = g_FontCatalogActive = FALSE;
+}
+
+/* The catalog is keyed by the file name without its directory */
+static PCWSTR
+IntFontCatalogFileName(PCUNICODE_STRING PathName)
+{
+    PCWSTR pszFileName = wcsrchr(PathName->Buffer, L'\\');
+    return (pszFileName ? pszFileName + 1 : PathName->Buffer);
+}
+
+/*
+ * IntLookupFontCatalog
+ *
+ * Finds the cached faces of a font file that has not changed since the
+ * catalog was written.
+ */
+static VOID
+IntLookupFontCatalog(PGDI_LOAD_FONT pLoadFont)
+{
+    PCWSTR pszFileName = IntFontCatalogFileName(pLoadFont->pFileName);
+    PFONT_CATALOG_FACE CatalogFace;
+    PFONT_CATALOG_RUN Run;
+    ULONG i, Low, High, Count = 0;
+    INT Ret;
+
+    pLoadFont->CatalogFaces = NULL;
+    pLoadFont->CatalogCount = 0;
+
+    /* Binary search the sorted files */
+    Low = 0;
+    High = g_FontCatalogRunCount;
+    while (Low < High)
+    {
+        i = Low + (High - Low) / 2;
+        Run = &g_FontCatalogRuns[i];
+        Ret = IntCompareCatalogFile(pszFileName, &pLoadFont->FileSize,
+                                    &pLoadFont->LastWriteTime, &g_FontCatalog[Run->Start]);
+        if (Ret == 0)
+        {
+            pLoadFont->CatalogFaces = &g_FontCatalog[Run->Start];
+            Count = Run->Count;
+            break;
+        }
+
+        if (Ret < 0)
+            High = i;
+        else
+            Low = i + 1;
+    }
+
+    /* Each face must come with its first charset before the others */
+    for (i = 0; i < Count; ++i)
+    {
+        CatalogFace = &pLoadFont->CatalogFaces[i];
+        if (CatalogFace->FaceIndex < 0 || CatalogFace->CharSetIndex < 0 ||
+            (CatalogFace->CharSetIndex > 0 &&
+             (i == 0 || CatalogFace[-1].FaceIndex != CatalogFace->FaceIndex)))
+        {
+            DPRINT1("Broken font catalog entry for '%wZ'\n", pLoadFont->pFileName);
+            pLoadFont->CatalogFaces = NULL;
+            Count = 0;
+            break;
+        }
+    }
+
+    pLoadFont->CatalogCount = Count;
+}
+
+static PFONT_CATALOG_FACE
+IntAllocCatalogFace(VOID)
+{
+    PFONT_CATALOG_FACE NewCatalog;
+    ULONG NewMax;
+
+    if (g_FontCatalogNewCount >= FONT_CATALOG_MAX_FACES)
+        return NULL;
+
+    if (g_FontCatalogNewCount == g_FontCatalogNewMax)
+    {
+        NewMax = (g_FontCatalogNewMax ? g_FontCatalogNewMax * 2 : 64);
+        NewCatalog = ExAllocatePoolWithTag(PagedPool,
+                                           NewMax * sizeof(FONT_CATALOG_FACE),
+                                           TAG_FONT);
+        if (!NewCatalog)
+            return NULL;
+
+        if (g_FontCatalogNew)
+        {
+            RtlCopyMemory(NewCatalog, g_FontCatalogNew,
+                          g_FontCatalogNewCount * sizeof(FONT_CATALOG_FACE));
+            ExFreePoolWithTag(g_FontCatalogNew, TAG_FONT);
+        }
+        g_FontCatalogNew = NewCatalog;
+        g_FontCatalogNewMax = NewMax;
+    }
+
+    return &g_FontCatalogNew[g_FontCatalogNewCount++];
+}
+
 BOOL FASTCALL
 InitFontSupport(VOID)
 {
     ULONG ulError;
+    UINT i, j;
 
     InitializeListHead(&g_FontListHead);
-    InitializeListHead(&g_FontCacheListHead);
-    g_FontCacheNumEntries = 0;
+
+    g_FontCacheShards = ExAllocatePoolWithTag(NonPagedPool,
+                                              FONT_CACHE_SHARDS * sizeof(FONT_CACHE_SHARD),
+                                              TAG_INTERNAL_SYNC);
+    if (g_FontCacheShards == NULL)
+    {
+        return FALSE;
+    }
+    for (i = 0; i < FONT_CACHE_SHARDS; i++)
+    {
+        ExInitializeFastMutex(&g_FontCacheShards[i].Lock);
+        InitializeListHead(&g_FontCacheShards[i].ListHead);
+        for (j = 0; j < FONT_CACHE_HASH_SIZE; j++)
+        {
+            InitializeListHead(&g_FontCacheShards[i].HashTable[j]);
+        }
+        g_FontCacheShards[i].NumEntries = 0;
+    }
+    g_FontCacheSize = 0;
+
     /* Fast Mutexes must be allocated from non paged pool */
     g_FontListLock = ExAllocatePoolWithTag(NonPagedPool, sizeof(FAST_MUTEX), TAG_INTERNAL_SYNC);
     if (g_FontListLock == NULL)
@@ -686,6 +1168,8 @@ InitFontSupport(VOID)
         return FALSE;
     }
 
+    IntLoadFontCatalog();
+
     if (!IntLoadFontsInRegistry())
     {
         DPRINT1("Fonts registry is empty.\n");
@@ -694,6 +1178,8 @@ InitFontSupport(VOID)
         IntLoadSystemFonts();
     }
 
+    IntSaveFontCatalog();
+
     IntLoadFontSubstList(&g_FontSubstListHead);
 
 #if DBG
@@ -1046,6 +1532,53 @@ IntLoadSystemFonts(VOID)
 static FT_Error
 IntRequestFontSize(PDC dc, PFONTGDI FontGDI, LONG lfWidth, LONG lfHeight);
 
+static NTSTATUS
+IntGetFontLocalizedName(PUNICODE_STRING pNameW, PSHARED_FACE SharedFace,
+                        FT_UShort NameID, FT_UShort LangID);
+
+/*
+ * IntEnsureFontFace
+ *
+ * Fonts loaded from the font catalog have their face opened on first use.
+ */
+static BOOL
+IntEnsureFontFace(PFONTGDI FontGDI)
+{
+    PSHARED_FACE SharedFace = FontGDI->SharedFace;
+    FT_Error Error = 0;
+    FT_Face Face;
+
+    ASSERT_FREETYPE_LOCK_NOT_HELD();
+
+    if (SharedFace->Face)
+        return TRUE;
+
+    IntLockFreeType();
+    if (!SharedFace->Face)
+    {
+        Error = FT_New_Memory_Face(g_FreeTypeLibrary,
+                                   SharedFace->Memory->Buffer,
+                                   SharedFace->Memory->BufferSize,
+                                   SharedFace->FaceIndex,
+                                   &Face);
+        if (!Error)
+        {
+            SharedFace->Face = Face;
+            IntRequestFontSize(NULL, FontGDI, 0, 0);
+        }
+    }
+    IntUnLockFreeType();
+
+    if (Error)
+    {
+        DPRINT1("Error opening font face %ld of '%S' (error code: %d)\n",
+                SharedFace->FaceIndex, FontGDI->Filename, Error);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 /* NOTE: If nIndex < 0 then return the number of charsets. */
 UINT FASTCALL IntGetCharSet(INT nIndex, FT_ULong CodePageRange1)
 {
@@ -1076,6 +1609,141 @@ UINT FASTCALL IntGetCharSet(INT nIndex, FT_ULong CodePageRange1)
 /* pixels to points */
 #define PX2PT(pixels) FT_MulDiv((pixels), 72, 96)
 
+/* Appends the name of a loaded face to the registry value name of its file */
+static VOID
+IntAppendRegValueName(PGDI_LOAD_FONT pLoadFont, PFONT_ENTRY Entry)
+{
+    PUNICODE_STRING pValueName = &pLoadFont->RegValueName;
+    USHORT NameLength = Entry->FaceName.Length;
+
+    if (Entry->StyleName.Length)
+        NameLength += Entry->StyleName.Length + sizeof(WCHAR);
+
+    if (pLoadFont->RegValueName.Length == 0)
+    {
+        pValueName->Length = 0;
+        pValueName->MaximumLength = NameLength + sizeof(WCHAR);
+        pValueName->Buffer = ExAllocatePoolWithTag(PagedPool,
+                                                   pValueName->MaximumLength,
+                                                   TAG_USTR);
+        pValueName->Buffer[0] = UNICODE_NULL;
+        RtlAppendUnicodeStringToString(pValueName, &Entry->FaceName);
+    }
+    else
+    {
+        UNICODE_STRING NewString;
+        USHORT Length = pValueName->Length + 3 * sizeof(WCHAR) + NameLength;
+        NewString.Length = 0;
+        NewString.MaximumLength = Length + sizeof(WCHAR);
+        NewString.Buffer = ExAllocatePoolWithTag(PagedPool,
+                                                 NewString.MaximumLength,
+                                                 TAG_USTR);
+        NewString.Buffer[0] = UNICODE_NULL;
+
+        RtlAppendUnicodeStringToString(&NewString, pValueName);
+        RtlAppendUnicodeToString(&NewString, L" & ");
+        RtlAppendUnicodeStringToString(&NewString, &Entry->FaceName);
+
+        RtlFreeUnicodeString(pValueName);
+        *pValueName = NewString;
+    }
+    if (Entry->StyleName.Length)
+    {
+        RtlAppendUnicodeToString(pValueName, L" ");
+        RtlAppendUnicodeStringToString(pValueName, &Entry->StyleName);
+    }
+}
+
+static BOOL
+IntStoreCatalogName(PWSTR Buffer, SIZE_T Count, PCUNICODE_STRING Name)
+{
+    if (Name->Length >= Count * sizeof(WCHAR))
+        return FALSE;   /* doesn't fit */
+
+    RtlCopyMemory(Buffer, Name->Buffer, Name->Length);
+    Buffer[Name->Length / sizeof(WCHAR)] = UNICODE_NULL;
+    return TRUE;
+}
+
+static BOOL
+IntStoreCatalogLocalizedName(PWSTR Buffer, SIZE_T Count, PSHARED_FACE SharedFace,
+                             FT_UShort NameID, FT_UShort LangID)
+{
+    UNICODE_STRING Name;
+    BOOL Ret;
+
+    RtlInitUnicodeString(&Name, NULL);
+    if (!NT_SUCCESS(IntGetFontLocalizedName(&Name, SharedFace, NameID, LangID)))
+        return FALSE;
+
+    Ret = IntStoreCatalogName(Buffer, Count, &Name);
+    RtlFreeUnicodeString(&Name);
+    return Ret;
+}
+
+/*
+ * IntRecordCatalogFace
+ *
+ * Adds a face loaded from a font file to the font catalog. If any face of
+ * the file can't be recorded, none of them are.
+ */
+static VOID
+IntRecordCatalogFace(PGDI_LOAD_FONT pLoadFont, PFONT_ENTRY Entry,
+                     FT_Long FontIndex, INT CharSetIndex)
+{
+    PFONTGDI FontGDI = Entry->Font;
+    PSHARED_FACE SharedFace = FontGDI->SharedFace;
+    PFONT_CATALOG_FACE CatalogFace;
+    UNICODE_STRING FileName;
+
+    if (!pLoadFont->CatalogRecord)
+        return;
+
+    CatalogFace = IntAllocCatalogFace();
+    if (!CatalogFace)
+        goto Discard;
+
+    RtlZeroMemory(CatalogFace, sizeof(*CatalogFace));
+    RtlInitUnicodeString(&FileName, IntFontCatalogFileName(pLoadFont->pFileName));
+    CatalogFace->FileSize = pLoadFont->FileSize;
+    CatalogFace->LastWriteTime = pLoadFont->LastWriteTime;
+    CatalogFace->FaceIndex = FontIndex;
+    CatalogFace->CharSetIndex = CharSetIndex;
+    CatalogFace->LangID = gusLanguageID;
+    CatalogFace->IsTrueType = !!pLoadFont->IsTrueType;
+    CatalogFace->CharSet = FontGDI->CharSet;
+    CatalogFace->OriginalItalic = FontGDI->OriginalItalic;
+    CatalogFace->OriginalWeight = FontGDI->OriginalWeight;
+    CatalogFace->tmHeight = FontGDI->tmHeight;
+    CatalogFace->tmAscent = FontGDI->tmAscent;
+    CatalogFace->tmDescent = FontGDI->tmDescent;
+    CatalogFace->tmInternalLeading = FontGDI->tmInternalLeading;
+    CatalogFace->EmHeight = FontGDI->EmHeight;
+
+    if (!IntStoreCatalogName(CatalogFace->FileName, _countof(CatalogFace->FileName), &FileName) ||
+        !IntStoreCatalogName(CatalogFace->FaceName, _countof(CatalogFace->FaceName), &Entry->FaceName) ||
+        !IntStoreCatalogName(CatalogFace->StyleName, _countof(CatalogFace->StyleName), &Entry->StyleName) ||
+        !IntStoreCatalogLocalizedName(CatalogFace->EnglishFamily, _countof(CatalogFace->EnglishFamily),
+                                      SharedFace, TT_NAME_ID_FONT_FAMILY, LANG_ENGLISH) ||
+        !IntStoreCatalogLocalizedName(CatalogFace->EnglishFullName, _countof(CatalogFace->EnglishFullName),
+                                      SharedFace, TT_NAME_ID_FULL_NAME, LANG_ENGLISH) ||
+        !IntStoreCatalogLocalizedName(CatalogFace->UserFamily, _countof(CatalogFace->UserFamily),
+                                      SharedFace, TT_NAME_ID_FONT_FAMILY, gusLanguageID) ||
+        !IntStoreCatalogLocalizedName(CatalogFace->UserFullName, _countof(CatalogFace->UserFullName),
+                                      SharedFace, TT_NAME_ID_FULL_NAME, gusLanguageID))
+    {
+        goto Discard;
+    }
+
+    g_FontCatalogDirty = TRUE;
+    return;
+
+Discard:
+    DPRINT("Not adding '%wZ' to the font catalog\n", pLoadFont->pFileName);
+    g_FontCatalogNewCount = pLoadFont->CatalogStart;
+    pLoadFont->CatalogRecord = FALSE;
+}
+
 static INT FASTCALL
 IntGdiLoadFontsFromMemory(PGDI_LOAD_FONT pLoadFont,
                           PSHARED_FACE SharedFace, FT_Long FontIndex, INT CharSetIndex)
@@ -1091,7 +1759,6 @@ IntGdiLoadFontsFromMemory(PGDI_LOAD_FONT pLoadFont,
     INT                 FaceCount = 0, CharSetCount = 0;
     PUNICODE_STRING     pFileName       = pLoadFont->pFileName;
     DWORD               Characteristics = pLoadFont->Characteristics;
-    PUNICODE_STRING     pValueName = &pLoadFont->RegValueName;
     TT_OS2 *            pOS2;
     INT                 BitIndex;
     FT_UShort           os2_version;
@@ -1110,7 +1777,8 @@ IntGdiLoadFontsFromMemory(PGDI_LOAD_FONT pLoadFont,
                     &Face);
 
         if (!Error)
-            SharedFace = SharedFace_Create(Face, pLoadFont->Memory);
+            SharedFace = SharedFace_Create(Face, pLoadFont->Memory,
+                                           ((FontIndex != -1) ? FontIndex : 0));
 
         IntUnLockFreeType();
 
@@ -1349,6 +2017,10 @@ IntGdiLoadFontsFromMemory(PGDI_LOAD_FONT pLoadFont,
         IntUnLockGlobalFonts();
     }
 
+    /* The first charset of a face is recorded with its registry name below */
+    if (CharSetIndex != -1)
+        IntRecordCatalogFace(pLoadFont, Entry, FontIndex, CharSetIndex);
+
     if (FontIndex == -1)
     {
         if (FT_IS_SFNT(Face))
@@ -1369,50 +2041,157 @@ IntGdiLoadFontsFromMemory(PGDI_LOAD_FONT pLoadFont,
     if (CharSetIndex == -1)
     {
         INT i;
-        USHORT NameLength = Entry->FaceName.Length;
 
-        if (Entry->StyleName.Length)
-            NameLength += Entry->StyleName.Length + sizeof(WCHAR);
+        /*
+         * Recorded here rather than above so that the catalog keeps the faces
+         * in the order their names go into the registry value.
+         */
+        IntRecordCatalogFace(pLoadFont, Entry, FontIndex, 0);
+        IntAppendRegValueName(pLoadFont, Entry);
 
-        if (pLoadFont->RegValueName.Length == 0)
+        for (i = 1; i < CharSetCount; ++i)
         {
-            pValueName->Length = 0;
-            pValueName->MaximumLength = NameLength + sizeof(WCHAR);
-            pValueName->Buffer = ExAllocatePoolWithTag(PagedPool,
-                                                       pValueName->MaximumLength,
-                                                       TAG_USTR);
-            pValueName->Buffer[0] = UNICODE_NULL;
-            RtlAppendUnicodeStringToString(pValueName, &Entry->FaceName);
+            /* Do not count charsets towards 'faces' loaded */
+            IntGdiLoadFontsFromMemory(pLoadFont, SharedFace, FontIndex, i);
         }
-        else
+    }
+
+    return FaceCount;   /* number of loaded faces */
+}
+
+static VOID
+SharedFaceCache_Fill(PSHARED_FACE_CACHE Cache, PCWSTR FontFamily, PCWSTR FullName)
+{
+    RtlCreateUnicodeString(&Cache->FontFamily, FontFamily);
+    RtlCreateUnicodeString(&Cache->FullName, FullName);
+}
+
+/*
+ * IntGdiLoadFontsFromCatalog
+ *
+ * Adds the faces of a font file as the font catalog describes them. The
+ * faces are left closed until IntEnsureFontFace is called on them.
+ */
+static INT FASTCALL
+IntGdiLoadFontsFromCatalog(PGDI_LOAD_FONT pLoadFont)
+{
+    PFONT_CATALOG_FACE CatalogFace, NewFace;
+    PSHARED_FACE SharedFace = NULL;
+    PFONT_ENTRY Entry;
+    PFONTGDI FontGDI;
+    PUNICODE_STRING pFileName = pLoadFont->pFileName;
+    INT FaceCount = 0;
+    ULONG i;
+
+    ASSERT(!(pLoadFont->Characteristics & FR_PRIVATE));
+
+    for (i = 0; i < pLoadFont->CatalogCount; ++i)
+    {
+        CatalogFace = &pLoadFont->CatalogFaces[i];
+
+        /* The other charsets of a face directly follow its first one */
+        if (CatalogFace->CharSetIndex == 0)
         {
-            UNICODE_STRING NewString;
-            USHORT Length = pValueName->Length + 3 * sizeof(WCHAR) + NameLength;
-            NewString.Length = 0;
-            NewString.MaximumLength = Length + sizeof(WCHAR);
-            NewString.Buffer = ExAllocatePoolWithTag(PagedPool,
-                                                     NewString.MaximumLength,
-                                                     TAG_USTR);
-            NewString.Buffer[0] = UNICODE_NULL;
+            SharedFace = SharedFace_Create(NULL, pLoadFont->Memory, CatalogFace->FaceIndex);
+            if (!SharedFace)
+                break;
 
-            RtlAppendUnicodeStringToString(&NewString, pValueName);
-            RtlAppendUnicodeToString(&NewString, L" & ");
-            RtlAppendUnicodeStringToString(&NewString, &Entry->FaceName);
+            SharedFaceCache_Fill(&SharedFace->EnglishUS,
+                                 CatalogFace->EnglishFamily, CatalogFace->EnglishFullName);
+            if (CatalogFace->LangID == gusLanguageID &&
+                PRIMARYLANGID(gusLanguageID) != LANG_ENGLISH)
+            {
+                SharedFaceCache_Fill(&SharedFace->UserLanguage,
+                                     CatalogFace->UserFamily, CatalogFace->UserFullName);
+            }
+        }
+        else
+        {
+            ASSERT(SharedFace && SharedFace->FaceIndex == CatalogFace->FaceIndex);
+            IntLockFreeType();
+            SharedFace_AddRef(SharedFace);
+            IntUnLockFreeType();
+        }
 
-            RtlFreeUnicodeString(pValueName);
-            *pValueName = NewString;
+        Entry = ExAllocatePoolWithTag(PagedPool, sizeof(FONT_ENTRY), TAG_FONT);
+        FontGDI = EngAllocMem(FL_ZERO_MEMORY, sizeof(FONTGDI), GDITAG_RFONT);
+        if (Entry)
+        {
+            RtlZeroMemory(Entry, sizeof(*Entry));
+            RtlCreateUnicodeString(&Entry->FaceName, CatalogFace->FaceName);
+            if (CatalogFace->StyleName[0])
+                RtlCreateUnicodeString(&Entry->StyleName, CatalogFace->StyleName);
         }
-        if (Entry->StyleName.Length)
+        if (FontGDI)
         {
-            RtlAppendUnicodeToString(pValueName, L" ");
-            RtlAppendUnicodeStringToString(pValueName, &Entry->StyleName);
+            FontGDI->Filename = ExAllocatePoolWithTag(PagedPool,
+                                                      pFileName->Length + sizeof(UNICODE_NULL),
+                                                      GDITAG_PFF);
+        }
+        if (!Entry || !Entry->FaceName.Buffer ||
+            (CatalogFace->StyleName[0] && !Entry->StyleName.Buffer) ||
+            !FontGDI || !FontGDI->Filename)
+        {
+            if (Entry)
+            {
+                RtlFreeUnicodeString(&Entry->FaceName);
+                RtlFreeUnicodeString(&Entry->StyleName);
+                ExFreePoolWithTag(Entry, TAG_FONT);
+            }
+            if (FontGDI)
+            {
+                if (FontGDI->Filename)
+                    ExFreePoolWithTag(FontGDI->Filename, GDITAG_PFF);
+                EngFreeMem(FontGDI);
+            }
+            SharedFace_Release(SharedFace);
+            EngSetLastError(ERROR_NOT_ENOUGH_MEMORY);
+            break;
         }
 
-        for (i = 1; i < CharSetCount; ++i)
+        RtlCopyMemory(FontGDI->Filename, pFileName->Buffer, pFileName->Length);
+        FontGDI->Filename[pFileName->Length / sizeof(WCHAR)] = UNICODE_NULL;
+
+        FontGDI->SharedFace = SharedFace;
+        FontGDI->CharSet = CatalogFace->CharSet;
+        FontGDI->OriginalItalic = CatalogFace->OriginalItalic;
+        FontGDI->RequestItalic = FALSE;
+        FontGDI->OriginalWeight = CatalogFace->OriginalWeight;
+        FontGDI->RequestWeight = FW_NORMAL;
+        FontGDI->tmHeight = CatalogFace->tmHeight;
+        FontGDI->tmAscent = CatalogFace->tmAscent;
+        FontGDI->tmDescent = CatalogFace->tmDescent;
+        FontGDI->tmInternalLeading = CatalogFace->tmInternalLeading;
+        FontGDI->EmHeight = CatalogFace->EmHeight;
+        FontGDI->Magic = FONTGDI_MAGIC;
+
+        Entry->Font = FontGDI;
+        Entry->NotEnum = (pLoadFont->Characteristics & FR_NOT_ENUM);
+
+        IntLockGlobalFonts();
+        InsertTailList(&g_FontListHead, &Entry->ListEntry);
+        IntUnLockGlobalFonts();
+
+        if (CatalogFace->IsTrueType)
+            pLoadFont->IsTrueType = TRUE;
+
+        if (CatalogFace->CharSetIndex == 0)
         {
-            /* Do not count charsets towards 'faces' loaded */
-            IntGdiLoadFontsFromMemory(pLoadFont, SharedFace, FontIndex, i);
+            ++FaceCount;
+            IntAppendRegValueName(pLoadFont, Entry);
         }
+
+        /* Keep it in the catalog */
+        NewFace = IntAllocCatalogFace();
+        if (NewFace)
+            *NewFace = *CatalogFace;
+    }
+
+    if (i < pLoadFont->CatalogCount)
+    {
+        /* Only part of the file got loaded, have it read in full next time */
+        g_FontCatalogNewCount = pLoadFont->CatalogStart;
+        g_FontCatalogDirty = TRUE;
     }
 
     return FaceCount;   /* number of loaded faces */
@@ -1470,6 +2249,7 @@ IntGdiAddFontResourceEx(PUNICODE_STRING FileName, DWORD Characteristics,
     UNICODE_STRING PathName;
     LPWSTR pszBuffer;
     PFILE_OBJECT FileObject;
+    FILE_NETWORK_OPEN_INFORMATION FileInfo;
     static const UNICODE_STRING TrueTypePostfix = RTL_CONSTANT_STRING(L" (TrueType)");
     static const UNICODE_STRING DosPathPrefix = RTL_CONSTANT_STRING(L"\\??\\");
 
@@ -1509,6 +2289,22 @@ IntGdiAddFontResourceEx(PUNICODE_STRING FileName, DWORD Characteristics,
         return 0;
     }
 
+    /* Size and time stamp are what the font catalog checks */
+    LoadFont.CatalogFaces = NULL;
+    LoadFont.CatalogCount = 0;
+    LoadFont.CatalogRecord = FALSE;
+    if (g_FontCatalogActive && !(Characteristics & FR_PRIVATE))
+    {
+        Status = ZwQueryInformationFile(FileHandle, &Iosb, &FileInfo, sizeof(FileInfo),
+                                        FileNetworkOpenInformation);
+        if (NT_SUCCESS(Status))
+        {
+            LoadFont.FileSize = FileInfo.EndOfFile;
+            LoadFont.LastWriteTime = FileInfo.LastWriteTime;
+            LoadFont.CatalogRecord = TRUE;
+        }
+    }
+
     Status = ObReferenceObjectByHandle(FileHandle, FILE_READ_DATA, NULL,
                                        KernelMode, (PVOID*)&FileObject, NULL);
     if (!NT_SUCCESS(Status))
@@ -1551,7 +2347,20 @@ IntGdiAddFontResourceEx(PUNICODE_STRING FileName, DWORD Characteristics,
     LoadFont.IsTrueType         = FALSE;
     LoadFont.CharSet            = DEFAULT_CHARSET;
     LoadFont.PrivateEntry       = NULL;
-    FontCount = IntGdiLoadFontsFromMemory(&LoadFont, NULL, -1, -1);
+    LoadFont.CatalogStart       = g_FontCatalogNewCount;
+
+    FontCount = 0;
+    if (LoadFont.CatalogRecord && LoadFont.Memory)
+    {
+        IntLookupFontCatalog(&LoadFont);
+        if (LoadFont.CatalogFaces)
+            FontCount = IntGdiLoadFontsFromCatalog(&LoadFont);
+    }
+    if (FontCount == 0)
+    {
+        /* Not in the catalog (or it failed): open the faces and record them */
+        FontCount = IntGdiLoadFontsFromMemory(&LoadFont, NULL, -1, -1);
+    }
 
     /* Release our copy */
     IntLockFreeType();
@@ -1843,6 +2652,7 @@ IntGdiAddFontMemResource(PVOID Buffer, DWORD dwSize, PDWORD pNumAdded)
     RtlInitUnicodeString(&LoadFont.RegValueName, NULL);
     LoadFont.IsTrueType         = FALSE;
     LoadFont.PrivateEntry       = NULL;
+    LoadFont.CatalogRecord      = FALSE;
     FaceCount = IntGdiLoadFontsFromMemory(&LoadFont, NULL, -1, -1);
 
     RtlFreeUnicodeString(&LoadFont.RegValueName);
@@ -2668,6 +3478,13 @@ IntGetFontLocalizedName(PUNICODE_STRING pNameW, PSHARED_FACE SharedFace,
         return DuplicateUnicodeString(&Cache->FullName, pNameW);
     }
 
+    if (Face == NULL)
+    {
+        /* The face is still closed, see IntEnsureFontFace */
+        DPRINT1("Name %u of a closed face was not cached\n", NameID);
+        return STATUS_NOT_FOUND;
+    }
+
     BestIndex = -1;
     BestScore = 0;
 
@@ -2811,11 +3628,16 @@ FontFamilyFillInfo(PFONTFAMILYINFO Info, LPCWSTR FaceName,
     DWORD fs0;
     NTSTATUS status;
     PSHARED_FACE SharedFace = FontGDI->SharedFace;
-    FT_Face Face = SharedFace->Face;
+    FT_Face Face;
     UNICODE_STRING NameW;
 
     RtlInitUnicodeString(&NameW, NULL);
     RtlZeroMemory(Info, sizeof(FONTFAMILYINFO));
+    if (!IntEnsureFontFace(FontGDI))
+    {
+        return;
+    }
+    Face = SharedFace->Face;
     Size = IntGetOutlineTextMetrics(FontGDI, 0, NULL);
     Otm = ExAllocatePoolWithTag(PagedPool, Size, GDITAG_TEXT);
     if (!Otm)
@@ -3130,7 +3952,30 @@ SameScaleMatrix(
             FLOATOBJ_Equal(&pmx1->efM22, &pmx2->efM22));
 }
 
-FT_BitmapGlyph APIENTRY
+static
+PLIST_ENTRY
+FontCacheBucket(
+    PFONT_CACHE_SHARD Shard,
+    FT_Face Face,
+    INT GlyphIndex,
+    INT Height,
+    FT_Render_Mode RenderMode)
+{
+    ULONG Hash;
+
+    Hash = (ULONG)((ULONG_PTR)Face >> 4);
+    Hash = Hash * 31 + (ULONG)GlyphIndex;
+    Hash = Hash * 31 + (ULONG)Height;
+    Hash = Hash * 31 + (ULONG)RenderMode;
+    Hash ^= Hash >> 16;
+    Hash *= 0x45D9F3B;
+    Hash ^= Hash >> 16;
+
+    return &Shard->HashTable[Hash % FONT_CACHE_HASH_SIZE];
+}
+
+/* Doesn't need g_FreeTypeLock. The caller releases the entry it gets */
+PFONT_CACHE_ENTRY APIENTRY
 ftGdiGlyphCacheGet(
     FT_Face Face,
     INT GlyphIndex,
@@ -3138,16 +3983,18 @@ ftGdiGlyphCacheGet(
     FT_Render_Mode RenderMode,
     PMATRIX pmx)
 {
-    PLIST_ENTRY CurrentEntry;
-    PFONT_CACHE_ENTRY FontEntry;
+    PFONT_CACHE_SHARD Shard = FontCacheShard(Face);
+    PLIST_ENTRY Bucket, CurrentEntry;
+    PFONT_CACHE_ENTRY FontEntry = NULL;
 
-    ASSERT_FREETYPE_LOCK_HELD();
+    ExEnterCriticalRegionAndAcquireFastMutexUnsafe(&Shard->Lock);
 
-    for (CurrentEntry = g_FontCacheListHead.Flink;
-         CurrentEntry != &g_FontCacheListHead;
+    Bucket = FontCacheBucket(Shard, Face, GlyphIndex, Height, RenderMode);
+    for (CurrentEntry = Bucket->Flink;
+         CurrentEntry != Bucket;
          CurrentEntry = CurrentEntry->Flink)
     {
-        FontEntry = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_ENTRY, ListEntry);
+        FontEntry = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_ENTRY, HashEntry);
         if ((FontEntry->Face == Face) &&
             (FontEntry->GlyphIndex == GlyphIndex) &&
             (FontEntry->Height == Height) &&
@@ -3156,14 +4003,21 @@ ftGdiGlyphCacheGet(
             break;
     }
 
-    if (CurrentEntry == &g_FontCacheListHead)
+    if (CurrentEntry == Bucket)
     {
-        return NULL;
+        FontEntry = NULL;
+    }
+    else
+    {
+        InterlockedIncrement(&FontEntry->RefCount);
+        RemoveEntryList(&FontEntry->ListEntry);
+        InsertHeadList(&Shard->ListHead, &FontEntry->ListEntry);
     }
 
-    RemoveEntryList(CurrentEntry);
-    InsertHeadList(&g_FontCacheListHead, CurrentEntry);
-    return FontEntry->BitmapGlyph;
+    ExReleaseFastMutexUnsafeAndLeaveCriticalRegion(&Shard->Lock);
+
+    InterlockedIncrement64(FontEntry ? &g_FontCacheStats.Hits : &g_FontCacheStats.Misses);
+    return FontEntry;
 }
 
 /* no cache */
@@ -3208,7 +4062,9 @@ ftGdiGlyphSet(
     return BitmapGlyph;
 }
 
-FT_BitmapGlyph APIENTRY
+/* Renders the glyph in the slot, so it needs g_FreeTypeLock. The caller
+   releases the entry it gets */
+PFONT_CACHE_ENTRY APIENTRY
 ftGdiGlyphCacheSet(
     FT_Face Face,
     INT GlyphIndex,
@@ -3217,6 +4073,7 @@ ftGdiGlyphCacheSet(
     FT_GlyphSlot GlyphSlot,
     FT_Render_Mode RenderMode)
 {
+    PFONT_CACHE_SHARD Shard = FontCacheShard(Face);
     FT_Glyph GlyphCopy;
     INT error;
     PFONT_CACHE_ENTRY NewEntry;
@@ -3268,15 +4125,25 @@ ftGdiGlyphCacheSet(
     NewEntry->Height = Height;
     NewEntry->RenderMode = RenderMode;
     NewEntry->mxWorldToDevice = *pmx;
+    NewEntry->Size = sizeof(FONT_CACHE_ENTRY) + sizeof(FT_BitmapGlyphRec) +
+                     (SIZE_T)abs(BitmapGlyph->bitmap.pitch) * BitmapGlyph->bitmap.rows;
 
-    InsertHeadList(&g_FontCacheListHead, &NewEntry->ListEntry);
-    if (++g_FontCacheNumEntries > MAX_FONT_CACHE)
-    {
-        NewEntry = CONTAINING_RECORD(g_FontCacheListHead.Blink, FONT_CACHE_ENTRY, ListEntry);
-        RemoveCachedEntry(NewEntry);
-    }
+    /* One reference for the cache and one for the caller */
+    NewEntry->RefCount = 2;
 
-    return BitmapGlyph;
+    /* Another thread may have cached the same glyph meanwhile, both copies
+       are valid and the older one ages out */
+    ExEnterCriticalRegionAndAcquireFastMutexUnsafe(&Shard->Lock);
+    InsertHeadList(&Shard->ListHead, &NewEntry->ListEntry);
+    InsertHeadList(FontCacheBucket(Shard, Face, GlyphIndex, Height, RenderMode), &NewEntry->HashEntry);
+    Shard->NumEntries++;
+    InterlockedExchangeAdd(&g_FontCacheSize, (LONG)NewEntry->Size);
+    ExReleaseFastMutexUnsafeAndLeaveCriticalRegion(&Shard->Lock);
+
+    /* Make room for it, but keep the new glyph, the caller is about to draw it */
+    TrimFontCache(NewEntry);
+
+    return NewEntry;
 }
 
 
@@ -4229,6 +5096,7 @@ TextIntGetTextExtentPoint(PDC dc,
     FT_Face face;
     FT_GlyphSlot glyph;
     FT_BitmapGlyph realglyph;
+    PFONT_CACHE_ENTRY CacheEntry = NULL;
     INT error, glyph_index, i, previous;
     ULONGLONG TotalWidth64 = 0;
     BOOL use_kerning;
@@ -4273,10 +5141,11 @@ TextIntGetTextExtentPoint(PDC dc,
         glyph_index = get_glyph_index_flagged(face, *String, GTEF_INDICES, fl);
 
         if (EmuBold || EmuItalic)
-            realglyph = NULL;
+            CacheEntry = NULL;
         else
-            realglyph = ftGdiGlyphCacheGet(face, glyph_index, plf->lfHeight,
-                                           RenderMode, pmxWorldToDevice);
+            CacheEntry = ftGdiGlyphCacheGet(face, glyph_index, plf->lfHeight,
+                                            RenderMode, pmxWorldToDevice);
+        realglyph = CacheEntry ? CacheEntry->BitmapGlyph : NULL;
 
         if (EmuBold || EmuItalic || !realglyph)
         {
@@ -4301,12 +5170,13 @@ TextIntGetTextExtentPoint(PDC dc,
             }
             else
             {
-                realglyph = ftGdiGlyphCacheSet(face,
-                                               glyph_index,
-                                               plf->lfHeight,
-                                               pmxWorldToDevice,
-                                               glyph,
-                                               RenderMode);
+                CacheEntry = ftGdiGlyphCacheSet(face,
+                                                glyph_index,
+                                                plf->lfHeight,
+                                                pmxWorldToDevice,
+                                                glyph,
+                                                RenderMode);
+                realglyph = CacheEntry ? CacheEntry->BitmapGlyph : NULL;
             }
 
             if (!realglyph)
@@ -4340,6 +5210,10 @@ TextIntGetTextExtentPoint(PDC dc,
         {
             FT_Done_Glyph((FT_Glyph)realglyph);
         }
+        else
+        {
+            ftGdiGlyphCacheRelease(CacheEntry);
+        }
 
         previous = glyph_index;
         String++;
@@ -5020,6 +5894,42 @@ GetFontPenalty(const LOGFONTW *               LogFont,
     return Penalty;     /* success */
 }
 
+/* The part of GetFontPenalty that is known without opening the face */
+static UINT
+GetFontPenaltyLowerBound(const LOGFONTW *LogFont, PFONTGDI FontGDI)
+{
+    ULONG Penalty = 0;
+    PSHARED_FACE_CACHE Cache;
+    UNICODE_STRING FaceName;
+    BYTE Byte = LogFont->lfCharSet;
+
+    if (Byte != FontGDI->CharSet && Byte != DEFAULT_CHARSET && Byte != ANSI_CHARSET)
+    {
+        GOT_PENALTY("CharSet", 65000);
+    }
+
+    if (LogFont->lfFaceName[0] != UNICODE_NULL)
+    {
+        if (PRIMARYLANGID(gusLanguageID) == LANG_ENGLISH)
+            Cache = &FontGDI->SharedFace->EnglishUS;
+        else
+            Cache = &FontGDI->SharedFace->UserLanguage;
+
+        /* GetFontPenalty compares with the localized family and full names */
+        if (Cache->FontFamily.Buffer && Cache->FullName.Buffer)
+        {
+            RtlInitUnicodeString(&FaceName, LogFont->lfFaceName);
+            if (!RtlEqualUnicodeString(&FaceName, &Cache->FontFamily, TRUE) &&
+                !RtlEqualUnicodeString(&FaceName, &Cache->FullName, TRUE))
+            {
+                GOT_PENALTY("FaceName", 10000);
+            }
+        }
+    }
+
+    return Penalty;
+}
+
 #undef GOT_PENALTY
 
 static __inline VOID
@@ -5034,6 +5944,7 @@ FindBestFontFromList(FONTOBJ **FontObj, ULONG *MatchPenalty,
     OUTLINETEXTMETRICW *Otm = NULL;
     UINT OtmSize, OldOtmSize = 0;
     FT_Face Face;
+    INT Pass;
 
     ASSERT(FontObj);
     ASSERT(MatchPenalty);
@@ -5044,42 +5955,61 @@ FindBestFontFromList(FONTOBJ **FontObj, ULONG *MatchPenalty,
     OldOtmSize = 0x200;
     Otm = ExAllocatePoolWithTag(PagedPool, OldOtmSize, GDITAG_TEXT);
 
-    /* get the FontObj of lowest penalty */
-    for (Entry = Head->Flink; Entry != Head; Entry = Entry->Flink)
+    /*
+     * Get the FontObj of lowest penalty. The fonts whose name and charset
+     * match go first, so that the faces the font catalog left closed can
+     * mostly be skipped: they are only opened if they can still win.
+     */
+    for (Pass = 0; Pass < 2; ++Pass)
     {
-        CurrentEntry = CONTAINING_RECORD(Entry, FONT_ENTRY, ListEntry);
-
-        FontGDI = CurrentEntry->Font;
-        ASSERT(FontGDI);
-        Face = FontGDI->SharedFace->Face;
-
-        /* get text metrics */
-        OtmSize = IntGetOutlineTextMetrics(FontGDI, 0, NULL);
-        if (OtmSize > OldOtmSize)
+        for (Entry = Head->Flink; Entry != Head; Entry = Entry->Flink)
         {
-            if (Otm)
-                ExFreePoolWithTag(Otm, GDITAG_TEXT);
-            Otm = ExAllocatePoolWithTag(PagedPool, OtmSize, GDITAG_TEXT);
-        }
+            CurrentEntry = CONTAINING_RECORD(Entry, FONT_ENTRY, ListEntry);
 
-        /* update FontObj if lowest penalty */
-        if (Otm)
-        {
-            IntLockFreeType();
-            IntRequestFontSize(NULL, FontGDI, LogFont->lfWidth, LogFont->lfHeight);
-            IntUnLockFreeType();
+            FontGDI = CurrentEntry->Font;
+            ASSERT(FontGDI);
 
-            OtmSize = IntGetOutlineTextMetrics(FontGDI, OtmSize, Otm);
-            if (!OtmSize)
-                continue;
+            Penalty = GetFontPenaltyLowerBound(LogFont, FontGDI);
+            if ((Pass == 0) != (Penalty == 0))
+                continue;   /* done in the other pass */
 
-            OldOtmSize = OtmSize;
+            if (FontGDI->SharedFace->Face == NULL)
+            {
+                if (*MatchPenalty != 0xFFFFFFFF && Penalty >= *MatchPenalty)
+                    continue;
+                if (!IntEnsureFontFace(FontGDI))
+                    continue;
+            }
+            Face = FontGDI->SharedFace->Face;
 
-            Penalty = GetFontPenalty(LogFont, Otm, Face->style_name);
-            if (*MatchPenalty == 0xFFFFFFFF || Penalty < *MatchPenalty)
+            /* get text metrics */
+            OtmSize = IntGetOutlineTextMetrics(FontGDI, 0, NULL);
+            if (OtmSize > OldOtmSize)
+            {
+                if (Otm)
+                    ExFreePoolWithTag(Otm, GDITAG_TEXT);
+                Otm = ExAllocatePoolWithTag(PagedPool, OtmSize, GDITAG_TEXT);
+            }
+
+            /* update FontObj if lowest penalty */
+            if (Otm)
             {
-                *FontObj = GDIToObj(FontGDI, FONT);
-                *MatchPenalty = Penalty;
+                IntLockFreeType();
+                IntRequestFontSize(NULL, FontGDI, LogFont->lfWidth, LogFont->lfHeight);
+                IntUnLockFreeType();
+
+                OtmSize = IntGetOutlineTextMetrics(FontGDI, OtmSize, Otm);
+                if (!OtmSize)
+                    continue;
+
+                OldOtmSize = OtmSize;
+
+                Penalty = GetFontPenalty(LogFont, Otm, Face->style_name);
+                if (*MatchPenalty == 0xFFFFFFFF || Penalty < *MatchPenalty)
+                {
+                    *FontObj = GDIToObj(FontGDI, FONT);
+                    *MatchPenalty = Penalty;
+                }
             }
         }
     }
@@ -5854,6 +6784,16 @@ ScaleLong(LONG lValue, PFLOATOBJ pef)
     return lValue;
 }
 
+/* A glyph fetched for drawing, referenced from the cache or owned by the caller */
+typedef struct _TEXT_GLYPH
+{
+    FT_BitmapGlyph BitmapGlyph;
+    PFONT_CACHE_ENTRY CacheEntry;
+    LONG Kerning;
+} TEXT_GLYPH, *PTEXT_GLYPH;
+
+#define TEXT_GLYPH_STACK_COUNT 16
+
 BOOL
 APIENTRY
 IntExtTextOutW(
@@ -5880,6 +6820,10 @@ IntExtTextOutW(
     FT_Face face;
     FT_GlyphSlot glyph;
     FT_BitmapGlyph realglyph;
+    PFONT_CACHE_ENTRY CacheEntry;
+    TEXT_GLYPH GlyphBuffer[TEXT_GLYPH_STACK_COUNT];
+    PTEXT_GLYPH Glyphs = GlyphBuffer;
+    INT GlyphCount = 0;
     LONGLONG TextLeft, RealXStart;
     ULONG TextTop, previous, BackgroundLeft;
     FT_Bool use_kerning;
@@ -5903,7 +6847,7 @@ IntExtTextOutW(
     FLOATOBJ Scale;
     LOGFONTW *plf;
     BOOL EmuBold, EmuItalic;
-    int thickness;
+    int thickness, position;
     BOOL bResult;
 
     /* Check if String is valid */
@@ -6107,10 +7051,11 @@ IntExtTextOutW(
             glyph_index = get_glyph_index_flagged(face, *TempText, ETO_GLYPH_INDEX, fuOptions);
 
             if (EmuBold || EmuItalic)
-                realglyph = NULL;
+                CacheEntry = NULL;
             else
-                realglyph = ftGdiGlyphCacheGet(face, glyph_index, plf->lfHeight,
-                                               RenderMode, pmxWorldToDevice);
+                CacheEntry = ftGdiGlyphCacheGet(face, glyph_index, plf->lfHeight,
+                                                RenderMode, pmxWorldToDevice);
+            realglyph = CacheEntry ? CacheEntry->BitmapGlyph : NULL;
             if (!realglyph)
             {
                 if (EmuItalic)
@@ -6133,12 +7078,13 @@ IntExtTextOutW(
                 }
                 else
                 {
-                    realglyph = ftGdiGlyphCacheSet(face,
-                                                   glyph_index,
-                                                   plf->lfHeight,
-                                                   pmxWorldToDevice,
-                                                   glyph,
-                                                   RenderMode);
+                    CacheEntry = ftGdiGlyphCacheSet(face,
+                                                    glyph_index,
+                                                    plf->lfHeight,
+                                                    pmxWorldToDevice,
+                                                    glyph,
+                                                    RenderMode);
+                    realglyph = CacheEntry ? CacheEntry->BitmapGlyph : NULL;
                 }
                 if (!realglyph)
                 {
@@ -6163,6 +7109,10 @@ IntExtTextOutW(
                 FT_Done_Glyph((FT_Glyph)realglyph);
                 realglyph = NULL;
             }
+            else
+            {
+                ftGdiGlyphCacheRelease(CacheEntry);
+            }
 
             previous = glyph_index;
             TempText++;
@@ -6313,27 +7263,35 @@ IntExtTextOutW(
         }
     }
 
-    EXLATEOBJ_vInitialize(&exloRGB2Dst, &gpalRGB, psurf->ppal, 0, 0, 0);
-    EXLATEOBJ_vInitialize(&exloDst2RGB, psurf->ppal, &gpalRGB, 0, 0, 0);
+    if (Count > TEXT_GLYPH_STACK_COUNT)
+    {
+        Glyphs = ExAllocatePoolWithTag(PagedPool, Count * sizeof(TEXT_GLYPH), GDITAG_TEXTOUT);
+        if (!Glyphs)
+        {
+            IntUnLockFreeType();
+            EngSetLastError(ERROR_NOT_ENOUGH_MEMORY);
+            bResult = FALSE;
+            goto Cleanup;
+        }
+    }
 
     /* Assume success */
     bResult = TRUE;
 
     /*
-     * The main rendering loop.
+     * Fetch the glyphs while FreeType is locked. Cached glyphs stay referenced
+     * until they are drawn, so the drawing below does not hold the lock.
      */
-    TextLeft = RealXStart;
-    TextTop = YStart;
-    BackgroundLeft = (RealXStart + 32) >> 6;
     for (i = 0; i < Count; ++i)
     {
         glyph_index = get_glyph_index_flagged(face, String[i], ETO_GLYPH_INDEX, fuOptions);
 
         if (EmuBold || EmuItalic)
-            realglyph = NULL;
+            CacheEntry = NULL;
         else
-            realglyph = ftGdiGlyphCacheGet(face, glyph_index, plf->lfHeight,
-                                           RenderMode, pmxWorldToDevice);
+            CacheEntry = ftGdiGlyphCacheGet(face, glyph_index, plf->lfHeight,
+                                            RenderMode, pmxWorldToDevice);
+        realglyph = CacheEntry ? CacheEntry->BitmapGlyph : NULL;
         if (!realglyph)
         {
             if (EmuItalic)
@@ -6358,12 +7316,13 @@ IntExtTextOutW(
             }
             else
             {
-                realglyph = ftGdiGlyphCacheSet(face,
-                                               glyph_index,
-                                               plf->lfHeight,
-                                               pmxWorldToDevice,
-                                               glyph,
-                                               RenderMode);
+                CacheEntry = ftGdiGlyphCacheSet(face,
+                                                glyph_index,
+                                                plf->lfHeight,
+                                                pmxWorldToDevice,
+                                                glyph,
+                                                RenderMode);
+                realglyph = CacheEntry ? CacheEntry->BitmapGlyph : NULL;
             }
             if (!realglyph)
             {
@@ -6373,13 +7332,49 @@ IntExtTextOutW(
             }
         }
 
-        /* retrieve kerning distance and move pen position */
+        Glyphs[i].BitmapGlyph = realglyph;
+        Glyphs[i].CacheEntry = CacheEntry;
+        Glyphs[i].Kerning = 0;
+
+        /* retrieve kerning distance */
         if (use_kerning && previous && glyph_index && NULL == Dx)
         {
             FT_Vector delta;
             FT_Get_Kerning(face, previous, glyph_index, 0, &delta);
-            TextLeft += delta.x;
+            Glyphs[i].Kerning = delta.x;
         }
+
+        previous = glyph_index;
+        ++GlyphCount;
+    }
+
+    if (!face->units_per_EM)
+    {
+        position = 0;
+    }
+    else
+    {
+        position = face->underline_position *
+            face->size->metrics.y_ppem / face->units_per_EM;
+    }
+
+    IntUnLockFreeType();
+
+    EXLATEOBJ_vInitialize(&exloRGB2Dst, &gpalRGB, psurf->ppal, 0, 0, 0);
+    EXLATEOBJ_vInitialize(&exloDst2RGB, psurf->ppal, &gpalRGB, 0, 0, 0);
+
+    /*
+     * The main rendering loop.
+     */
+    TextLeft = RealXStart;
+    TextTop = YStart;
+    BackgroundLeft = (RealXStart + 32) >> 6;
+    for (i = 0; i < GlyphCount; ++i)
+    {
+        realglyph = Glyphs[i].BitmapGlyph;
+
+        /* move pen position by the kerning distance */
+        TextLeft += Glyphs[i].Kerning;
         DPRINT("TextLeft: %I64d\n", TextLeft);
         DPRINT("TextTop: %lu\n", TextTop);
         DPRINT("Advance: %d\n", realglyph->root.advance.x);
@@ -6504,16 +7499,7 @@ IntExtTextOutW(
 
         if (plf->lfUnderline)
         {
-            int i, position;
-            if (!face->units_per_EM)
-            {
-                position = 0;
-            }
-            else
-            {
-                position = face->underline_position *
-                    face->size->metrics.y_ppem / face->units_per_EM;
-            }
+            int i;
             for (i = -thickness / 2; i < -thickness / 2 + thickness; ++i)
             {
                 EngLineTo(SurfObj,
@@ -6566,25 +7552,30 @@ IntExtTextOutW(
         {
             TextTop -= Dx[2 * i + 1] << 6;
         }
-
-        previous = glyph_index;
-
-        if (EmuBold || EmuItalic)
-        {
-            FT_Done_Glyph((FT_Glyph)realglyph);
-            realglyph = NULL;
-        }
     }
 
     if (pdcattr->flTextAlign & TA_UPDATECP) {
         pdcattr->ptlCurrent.x = DestRect.right - dc->ptlDCOrig.x;
     }
 
-    IntUnLockFreeType();
-
     EXLATEOBJ_vCleanup(&exloRGB2Dst);
     EXLATEOBJ_vCleanup(&exloDst2RGB);
 
+    /* Bold and italic do not use the cache */
+    if (EmuBold || EmuItalic)
+    {
+        for (i = 0; i < GlyphCount; ++i)
+            FT_Done_Glyph((FT_Glyph)Glyphs[i].BitmapGlyph);
+    }
+    else
+    {
+        for (i = 0; i < GlyphCount; ++i)
+            ftGdiGlyphCacheRelease(Glyphs[i].CacheEntry);
+    }
+
+    if (Glyphs != GlyphBuffer)
+        ExFreePoolWithTag(Glyphs, GDITAG_TEXTOUT);
+
 Cleanup:
 
     DC_vFinishBlit(dc, NULL);
@@ -69,6 +69,7 @@ KdbCommand_Gdi_help(VOID)
              "- handle <handle> - Displays information about a handle\n"
              "- entry <entry> - Displays an ENTRY, <entry> can be a pointer or index\n"
              "- baseobject <object> - Displays a BASEOBJECT\n"
+             "- glyphcache - Displays the glyph cache counters\n"
 #if DBG_ENABLE_EVENT_LOGGING
              "- eventlist <object> - Displays the eventlist for an object\n"
 #endif
@@ -278,6 +279,23 @@ KdbCommand_Gdi_baseobject(char *argv)
 {
 }
 
+static
+VOID
+KdbCommand_Gdi_glyphcache(VOID)
+{
+    FONT_CACHE_STATS Stats;
+    ULONGLONG Lookups;
+
+    ftGdiGlyphCacheQueryStats(&Stats);
+    Lookups = Stats.Hits + Stats.Misses;
+
+    DbgPrint("Glyph cache: %lu glyphs, %Iu of %Iu bytes\n",
+             Stats.Glyphs, Stats.Size, Stats.Budget);
+    DbgPrint(" Hits = %I64u, Misses = %I64u (%I64u%% hit rate)\n",
+             Stats.Hits, Stats.Misses, Lookups ? Stats.Hits * 100 / Lookups : 0);
+    DbgPrint(" Evictions = %I64u\n", Stats.Evictions);
+}
+
 #if DBG_ENABLE_EVENT_LOGGING
 static
 VOID
@@ -347,6 +365,10 @@ DbgGdiKdbgCliCallback(
     {
         KdbCommand_Gdi_baseobject(argv[1]);
     }
+    else if (stricmp(argv[0], "!gdi.glyphcache") == 0)
+    {
+        KdbCommand_Gdi_glyphcache();
+    }
 #if DBG_ENABLE_EVENT_LOGGING
     else if (stricmp(argv[0], "!gdi.eventlist") == 0)
     {
@@ -71,6 +71,17 @@ typedef struct _LFONT
    EX_PUSH_LOCK lock;
 } TEXTOBJ, *PTEXTOBJ, LFONT, *PLFONT;
 
+/* Counters of the FreeType glyph cache */
+typedef struct _FONT_CACHE_STATS
+{
+  ULONGLONG Hits;
+  ULONGLONG Misses;
+  ULONGLONG Evictions;
+  ULONG     Glyphs;
+  SIZE_T    Size;
+  SIZE_T    Budget;
+} FONT_CACHE_STATS, *PFONT_CACHE_STATS;
+
 /*  Internal interface  */
 
 #define LFONT_AllocFontWithHandle() ((PLFONT)GDIOBJ_AllocObjWithHandle(GDI_OBJECT_TYPE_FONT, sizeof(TEXTOBJ)))
@@ -135,6 +146,7 @@ DWORD FASTCALL ftGdiGetFontData(PFONTGDI,DWORD,DWORD,PVOID,DWORD);
 BOOL FASTCALL IntGdiGetFontResourceInfo(PUNICODE_STRING,PVOID,DWORD*,DWORD);
 BOOL FASTCALL ftGdiRealizationInfo(PFONTGDI,PREALIZATION_INFO);
 DWORD FASTCALL ftGdiGetKerningPairs(PFONTGDI,DWORD,LPKERNINGPAIR);
+VOID FASTCALL ftGdiGlyphCacheQueryStats(PFONT_CACHE_STATS);
 BOOL NTAPI GreExtTextOutW(IN HDC,IN INT,IN INT,IN UINT,IN OPTIONAL RECTL*,
     IN LPCWSTR, IN INT, IN OPTIONAL LPINT, IN DWORD);
 DWORD FASTCALL IntGetCharDimensions(HDC, PTEXTMETRICW, PDWORD);